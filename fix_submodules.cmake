@@ -21,12 +21,35 @@ endif()
 
 get_filename_component(REPO_NAME "${SRC_REPO}" NAME)
 
+# The fast-export and fast-import of each run record their marks, so
+# the next exports only the commits made since, and imports them on
+# top of what is already in DST_REPO.  The marks are only kept once
+# the whole pipeline succeeds, so a failed run is simply repeated.
+# Remove DST_REPO to rewrite the whole history again, as is needed if
+# SRC_REPO was converted anew.
+set(export_marks "${DST_REPO}/fixup-export.marks")
+set(import_marks "${DST_REPO}/fixup-import.marks")
+set(import_export_marks "")
+set(import_import_marks "")
+set(incremental "")
+if(EXISTS "${export_marks}" AND EXISTS "${import_marks}")
+  set(import_export_marks "--import-marks='${export_marks}'")
+  set(import_import_marks "--import-marks='${import_marks}'")
+  set(incremental "--incremental")
+endif()
+
 execute_process(COMMAND bash -e -o pipefail -c
-  "( cd '${SRC_REPO}' && '${GIT}' fast-export --all ) | (
-    '${FIX_SUBMODULE_REFS}' --rules '${RULES_FILE}' --repo-name '${REPO_NAME}' ) | (
-    cd '${DST_REPO}' && '${GIT}' fast-import --quiet --force )"
+  "( cd '${SRC_REPO}' && '${GIT}' fast-export --all \
+      ${import_export_marks} --export-marks='${export_marks}.new' ) | (
+    '${FIX_SUBMODULE_REFS}' --rules '${RULES_FILE}' --repo-name '${REPO_NAME}' ${incremental} ) | (
+    cd '${DST_REPO}' && '${GIT}' fast-import --quiet --force \
+      ${import_import_marks} --export-marks='${import_marks}.new' )"
   ERROR_VARIABLE message
   RESULT_VARIABLE result)
 if(NOT result EQUAL 0)
+  file(REMOVE "${export_marks}.new" "${import_marks}.new")
   message(FATAL_ERROR "Failed to fix submodule refs: ${message}")
 endif()
+
+file(RENAME "${export_marks}.new" "${export_marks}")
+file(RENAME "${import_marks}.new" "${import_marks}")
@@ -16,6 +16,22 @@ BOOST_FUSION_DEFINE_STRUCT((boost2git), ContentRule,
   (int, line)
   )
 
+// An SVN path, relative to each branch, that is converted nowhere
+BOOST_FUSION_DEFINE_STRUCT((boost2git), ExcludeRule,
+  (path, svn_path)
+  (int, line)
+  )
+
+// Consecutive SVN revisions by one author that the importer may
+// squash into a single commit per ref: those by the author named, if
+// kind is "author", or if kind is "path", those changing only paths
+// within the given one, relative to each branch
+BOOST_FUSION_DEFINE_STRUCT((boost2git), SquashRule,
+  (std::string, kind)
+  (std::string, value)
+  (int, line)
+  )
+
 BOOST_FUSION_DEFINE_STRUCT((boost2git), BranchRule,
   (std::size_t, min)
   (std::size_t, max)
@@ -36,6 +52,8 @@ BOOST_FUSION_DEFINE_STRUCT((boost2git), RepoRule,
   (std::vector<boost2git::ContentRule>, content_rules)
   (std::vector<boost2git::BranchRule>, branch_rules)
   (std::vector<boost2git::BranchRule>, tag_rules)
+  (std::vector<boost2git::ExcludeRule>, exclusions)
+  (std::vector<boost2git::SquashRule>, squash_rules)
   )
 
 namespace boost2git
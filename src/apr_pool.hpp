@@ -20,19 +20,22 @@
 
 #include <apr_general.h>
 #include <svn_pools.h>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+class AprPoolRecycler;
 
 class AprPool
   {
   public:
     AprPool(apr_pool_t *parent = 0)
+      : recycler(0)
       {
       pool = svn_pool_create(parent);
       }
-    ~AprPool()
-      {
-      if (pool)
-          svn_pool_destroy(pool);
-      }
+    inline ~AprPool();
 
     AprPool(AprPool const&) = delete;
     void operator=(AprPool const&) = delete;
@@ -40,14 +43,15 @@ class AprPool
     AprPool(AprPool&& rhs) 
       { 
       pool = rhs.pool; 
+      recycler = rhs.recycler;
       rhs.pool = 0; 
       }
 
     AprPool& operator=(AprPool&& rhs) 
       { 
-      if (pool) 
-        svn_pool_destroy(pool); 
+      release();
       pool = rhs.pool; 
+      recycler = rhs.recycler;
       rhs.pool = 0; 
       return *this;
       }
@@ -69,7 +73,131 @@ class AprPool
       return pool;
       }
   private:
+    friend class AprPoolRecycler;
+    AprPool(apr_pool_t *pool, AprPoolRecycler* recycler)
+      : pool(pool), recycler(recycler)
+      {}
+
+    inline void release();
+
     apr_pool_t *pool;
+    AprPoolRecycler* recycler;  // to which the pool is returned, if any
+  };
+
+// Hands out subpools of one parent that are made again and again,
+// e.g. those of each SVN revision, taking them back cleared when
+// they're destroyed instead of destroying them, so that they're
+// created only once.  Up to max_kept are kept for reuse.  Those kept
+// are guarded by a mutex, so pools can be returned on a thread other
+// than the one that took them.  Must outlive the pools it hands out,
+// and be outlived by the parent.
+class AprPoolRecycler
+  {
+  public:
+    explicit AprPoolRecycler(apr_pool_t* parent, std::size_t max_kept = 8)
+      : parent(parent), max_kept(max_kept)
+      {}
+
+    AprPoolRecycler(AprPoolRecycler const&) = delete;
+    void operator=(AprPoolRecycler const&) = delete;
+
+    AprPool take()
+      {
+      apr_pool_t* pool = 0;
+      {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (!kept.empty())
+        {
+        pool = kept.back();
+        kept.pop_back();
+        }
+      }
+      if (pool)
+        ++reused();
+      else
+        {
+        pool = svn_pool_create(parent);
+        ++created();
+        }
+      return AprPool(pool, this);
+      }
+
+    // Totals over every recycler, for --profile
+    static std::atomic<std::uint64_t>& created()
+      {
+      static std::atomic<std::uint64_t> n(0);
+      return n;
+      }
+    static std::atomic<std::uint64_t>& reused()
+      {
+      static std::atomic<std::uint64_t> n(0);
+      return n;
+      }
+
+  private:
+    friend class AprPool;
+
+    void give_back(apr_pool_t* pool)
+      {
+      svn_pool_clear(pool);
+      std::lock_guard<std::mutex> lock(mutex);
+      if (kept.size() < max_kept)
+        kept.push_back(pool);
+      else
+        svn_pool_destroy(pool);
+      }
+
+    apr_pool_t* parent;
+    std::size_t max_kept;
+    std::mutex mutex;
+    std::vector<apr_pool_t*> kept;
+  };
+
+inline AprPool::~AprPool()
+  {
+  release();
+  }
+
+inline void AprPool::release()
+  {
+  if (!pool)
+    return;
+  if (recycler)
+    recycler->give_back(pool);
+  else
+    svn_pool_destroy(pool);
+  pool = 0;
+  }
+
+// Lends a long-lived pool for the allocations of one item of many,
+// e.g. one file of a revision, clearing it on destruction.  Clearing
+// keeps the pool's memory for the next item, so the memory used stays
+// flat however many items there are, without a subpool being created
+// and destroyed for each.  Borrowers mustn't nest.
+class AprScratch
+  {
+  public:
+    explicit AprScratch(AprPool& pool)
+      : pool(pool)
+      {}
+    ~AprScratch()
+      {
+      pool.clear();
+      }
+
+    AprScratch(AprScratch const&) = delete;
+    void operator=(AprScratch const&) = delete;
+
+    operator apr_pool_t*() const
+      {
+      return pool;
+      }
+    apr_pool_t* data() const
+      {
+      return pool;
+      }
+  private:
+    AprPool& pool;
   };
 
 #endif /* APR_POOL_HPP */
@@ -0,0 +1,118 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef ARENA_DWA20131025_HPP
+# define ARENA_DWA20131025_HPP
+
+# include <algorithm>
+# include <cstddef>
+# include <cstdint>
+# include <memory>
+# include <vector>
+
+// A monotonic memory arena, the analogue for C++ containers of the
+// APR pool each svn::revision carries: allocation bumps a pointer,
+// deallocation does nothing, and reset() makes all of the memory
+// available again at once.  The chunks obtained from the heap are
+// kept across resets, so once the arena has grown to fit the largest
+// workload it performs no further heap allocation.
+class arena
+{
+ public:
+    explicit arena(std::size_t chunk_size = 1 << 16)
+        : chunk_size(chunk_size), current(0), pos(0) {}
+
+    arena(arena const&) = delete;
+    void operator=(arena const&) = delete;
+
+    void* allocate(std::size_t size, std::size_t align)
+    {
+        for (;; ++current, pos = 0)
+        {
+            if (current == chunks.size())
+            {
+                // Oversized requests get a chunk of their own
+                std::size_t const n = std::max(size + align, chunk_size);
+                chunk c = { std::unique_ptr<char[]>(new char[n]), n };
+                chunks.push_back(std::move(c));
+            }
+
+            char* const base = chunks[current].data.get();
+            std::size_t const start = 
+                (reinterpret_cast<std::uintptr_t>(base + pos) + align - 1) / align * align
+                - reinterpret_cast<std::uintptr_t>(base);
+            if (start + size <= chunks[current].size)
+            {
+                pos = start + size;
+                return base + start;
+            }
+        }
+    }
+
+    // The bytes obtained from the heap, which reset() keeps
+    std::size_t bytes_held() const
+    {
+        std::size_t n = 0;
+        for (auto const& c : chunks)
+            n += c.size;
+        return n;
+    }
+
+    // Invalidate everything allocated so far
+    void reset()
+    {
+        current = 0;
+        pos = 0;
+    }
+
+ private:
+    struct chunk
+    {
+        std::unique_ptr<char[]> data;
+        std::size_t size;
+    };
+
+    std::size_t const chunk_size;
+    std::vector<chunk> chunks;
+    std::size_t current;        // the chunk being allocated from
+    std::size_t pos;            // the first free byte in it
+};
+
+// A standard allocator drawing on an arena
+template <class T>
+struct arena_allocator
+{
+    typedef T value_type;
+
+    explicit arena_allocator(arena& a) : a(&a) {}
+
+    template <class U>
+    arena_allocator(arena_allocator<U> const& x) : a(x.a) {}
+
+    T* allocate(std::size_t n)
+    {
+        return static_cast<T*>(a->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T*, std::size_t) {}
+
+    template <class U>
+    struct rebind { typedef arena_allocator<U> other; };
+
+    template <class U>
+    friend bool operator==(arena_allocator const& x, arena_allocator<U> const& y)
+    { return x.a == y.a; }
+
+    template <class U>
+    friend bool operator!=(arena_allocator const& x, arena_allocator<U> const& y)
+    { return x.a != y.a; }
+
+ private:
+    template <class U> friend struct arena_allocator;
+    arena* a;
+};
+
+template <class T>
+using arena_vector = std::vector<T, arena_allocator<T> >;
+
+#endif // ARENA_DWA20131025_HPP
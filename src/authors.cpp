@@ -23,6 +23,7 @@
 static boost::regex regex("(.+\\H)\\h*=\\h*(.+)");
 
 Authors::Authors(std::string const& filename)
+  : nobody("committer nobody <nobody@localhost> ")
   {
   std::string line;
   boost::smatch match;
@@ -38,7 +39,7 @@ Authors::Authors(std::string const& filename)
       }
     if (regex_match(line, match, regex))
       {
-      map.insert(std::make_pair(match[1], match[2]));
+      map.insert(std::make_pair(match[1], "committer " + match[2] + " "));
       }
     else
       {
@@ -50,11 +51,11 @@ Authors::Authors(std::string const& filename)
     }
   }
 
-std::string const& Authors::operator[](std::string const& svnuser) const
+std::string const& Authors::committer(std::string const& svnuser) const
   {
   if (svnuser.empty())
     {
-    return svnuser;
+    return nobody;
     }
   typedef boost::unordered_map<std::string, std::string> map_t;
   map_t::const_iterator it = map.find(svnuser);
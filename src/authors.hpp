@@ -20,13 +20,17 @@
 
 #include <boost/unordered_map.hpp>
 
+// The Git identities of SVN users, each held as the start of the
+// committer line of a fast-import commit, "committer <identity> ", so
+// that writing one is a copy followed by the date.
 class Authors
   {
   public:
     explicit Authors(std::string const& filename);
-    std::string const& operator[](std::string const& svnuser) const;
+    std::string const& committer(std::string const& svnuser) const;
   private:
     boost::unordered_map<std::string, std::string> map;
+    std::string nobody;
   };
 
 #endif /* AUTHORS_HPP */
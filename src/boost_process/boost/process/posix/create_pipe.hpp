@@ -13,14 +13,35 @@
 #include <boost/process/config.hpp>
 #include <boost/process/posix/pipe.hpp>
 #include <boost/system/error_code.hpp>
+#include <fcntl.h>
 #include <unistd.h>
 
 namespace boost { namespace process { namespace posix {
 
+namespace detail {
+
+// Both ends of the pipe are close-on-exec, so that they are inherited
+// only by the child they are bound to, and not by every child started
+// while they are open.
+inline int pipe_cloexec(int fds[2])
+{
+#if defined(__linux__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)
+    return ::pipe2(fds, O_CLOEXEC);
+#else
+    if (::pipe(fds) == -1)
+        return -1;
+    ::fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    ::fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return 0;
+#endif
+}
+
+}
+
 inline pipe create_pipe()
 {
     int fds[2];
-    if (::pipe(fds) == -1)
+    if (detail::pipe_cloexec(fds) == -1)
         BOOST_PROCESS_THROW_LAST_SYSTEM_ERROR("pipe(2) failed");
     return pipe(fds[0], fds[1]);
 }
@@ -28,7 +49,7 @@ inline pipe create_pipe()
 inline pipe create_pipe(boost::system::error_code &ec)
 {
     int fds[2];
-    if (::pipe(fds) == -1)
+    if (detail::pipe_cloexec(fds) == -1)
         BOOST_PROCESS_RETURN_LAST_SYSTEM_ERROR(ec);
     else
         ec.clear();
@@ -11,6 +11,7 @@
 #define BOOST_PROCESS_POSIX_INITIALIZERS_BIND_FD_HPP
 
 #include <boost/process/posix/initializers/initializer_base.hpp>
+#include <fcntl.h>
 #include <unistd.h>
 
 namespace boost { namespace process { namespace posix { namespace initializers {
@@ -24,7 +25,12 @@ public:
     template <class PosixExecutor>
     void on_exec_setup(PosixExecutor&) const
     {
-        ::dup2(fd_.handle(), id_);
+        // dup2 clears close-on-exec, which create_pipe sets, except
+        // when it has nothing to do
+        if (fd_.handle() == id_)
+            ::fcntl(id_, F_SETFD, 0);
+        else
+            ::dup2(fd_.handle(), id_);
     }
 
 private:
@@ -12,6 +12,7 @@
 
 #include <boost/process/posix/initializers/initializer_base.hpp>
 #include <boost/iostreams/device/file_descriptor.hpp>
+#include <fcntl.h>
 #include <unistd.h>
 
 namespace boost { namespace process { namespace posix { namespace initializers {
@@ -25,7 +26,12 @@ public:
     template <class PosixExecutor>
     void on_exec_setup(PosixExecutor&) const
     {
-        ::dup2(sink_.handle(), STDERR_FILENO);
+        // dup2 clears close-on-exec, which create_pipe sets, except
+        // when it has nothing to do
+        if (sink_.handle() == STDERR_FILENO)
+            ::fcntl(STDERR_FILENO, F_SETFD, 0);
+        else
+            ::dup2(sink_.handle(), STDERR_FILENO);
     }
 
 private:
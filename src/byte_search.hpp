@@ -0,0 +1,117 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef BYTE_SEARCH_DWA20131027_HPP
+# define BYTE_SEARCH_DWA20131027_HPP
+
+# include <cstddef>
+
+# if defined(__AVX2__)
+#  include <immintrin.h>
+# elif defined(__SSE2__)
+#  include <emmintrin.h>
+# endif
+
+// Searches of byte arrays used on patrie's lookup paths and by
+// text_normalizer, comparing 32 (with AVX2) or 16 (with SSE2) bytes
+// at a time where the compiler targets those instruction sets, and a
+// byte at a time otherwise.
+namespace byte_search
+{
+  // Return the first position of c in [first, last), or last
+  inline char const* find(char const* first, char const* last, char c)
+  {
+# if defined(__AVX2__)
+      __m256i const needle = _mm256_set1_epi8(c);
+      for (; last - first >= 32; first += 32)
+      {
+          __m256i const block = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(first));
+          unsigned const mask = unsigned(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle)));
+          if (mask)
+              return first + __builtin_ctz(mask);
+      }
+# endif
+# if defined(__SSE2__)
+      __m128i const needle16 = _mm_set1_epi8(c);
+      for (; last - first >= 16; first += 16)
+      {
+          __m128i const block = _mm_loadu_si128(reinterpret_cast<__m128i const*>(first));
+          unsigned const mask = unsigned(_mm_movemask_epi8(_mm_cmpeq_epi8(block, needle16)));
+          if (mask)
+              return first + __builtin_ctz(mask);
+      }
+# endif
+      for (; first != last; ++first)
+      {
+          if (*first == c)
+              return first;
+      }
+      return last;
+  }
+
+  // Return the first position of either c or d in [first, last), or
+  // last
+  inline char const* find_either(char const* first, char const* last, char c, char d)
+  {
+# if defined(__AVX2__)
+      __m256i const c32 = _mm256_set1_epi8(c), d32 = _mm256_set1_epi8(d);
+      for (; last - first >= 32; first += 32)
+      {
+          __m256i const block = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(first));
+          unsigned const mask = unsigned(_mm256_movemask_epi8(
+              _mm256_or_si256(_mm256_cmpeq_epi8(block, c32), _mm256_cmpeq_epi8(block, d32))));
+          if (mask)
+              return first + __builtin_ctz(mask);
+      }
+# endif
+# if defined(__SSE2__)
+      __m128i const c16 = _mm_set1_epi8(c), d16 = _mm_set1_epi8(d);
+      for (; last - first >= 16; first += 16)
+      {
+          __m128i const block = _mm_loadu_si128(reinterpret_cast<__m128i const*>(first));
+          unsigned const mask = unsigned(_mm_movemask_epi8(
+              _mm_or_si128(_mm_cmpeq_epi8(block, c16), _mm_cmpeq_epi8(block, d16))));
+          if (mask)
+              return first + __builtin_ctz(mask);
+      }
+# endif
+      for (; first != last; ++first)
+      {
+          if (*first == c || *first == d)
+              return first;
+      }
+      return last;
+  }
+
+  // Return the length of the common prefix of the n-byte arrays at
+  // a and b
+  inline std::size_t common_prefix(char const* a, char const* b, std::size_t n)
+  {
+      std::size_t i = 0;
+# if defined(__AVX2__)
+      for (; n - i >= 32; i += 32)
+      {
+          __m256i const x = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(a + i));
+          __m256i const y = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(b + i));
+          unsigned const mask = ~unsigned(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)));
+          if (mask)
+              return i + __builtin_ctz(mask);
+      }
+# endif
+# if defined(__SSE2__)
+      for (; n - i >= 16; i += 16)
+      {
+          __m128i const x = _mm_loadu_si128(reinterpret_cast<__m128i const*>(a + i));
+          __m128i const y = _mm_loadu_si128(reinterpret_cast<__m128i const*>(b + i));
+          unsigned const mask = ~unsigned(_mm_movemask_epi8(_mm_cmpeq_epi8(x, y))) & 0xFFFF;
+          if (mask)
+              return i + __builtin_ctz(mask);
+      }
+# endif
+      while (i != n && a[i] == b[i])
+          ++i;
+      return i;
+  }
+}
+
+#endif // BYTE_SEARCH_DWA20131027_HPP
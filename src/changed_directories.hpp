@@ -0,0 +1,132 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef CHANGED_DIRECTORIES_DWA20131101_HPP
+# define CHANGED_DIRECTORIES_DWA20131101_HPP
+
+# include "state_file.hpp"
+# include <boost/filesystem.hpp>
+# include <algorithm>
+# include <cassert>
+# include <cstdint>
+# include <exception>
+# include <string>
+# include <vector>
+
+// The directories holding the files that each SVN revision adds,
+// changes or copies, which are the files the importer must find
+// rules for.  Each revision's directories are sorted and stored as
+// the length of the prefix shared with the one before, in two
+// bytes, followed by the rest of the name and a NUL.  The directories
+// of a copied tree share long prefixes, so this keeps an index of the
+// whole history small enough to hold in memory and on disk.
+struct changed_directories
+{
+    static std::uint64_t const format = 0x3130737269646332ull; // "2cdirs01"
+
+    changed_directories() : revisions(1) {}
+
+    // The last revision indexed; the index starts empty, at revision 0
+    int last_revision() const
+    {
+        return int(revisions.size()) - 1;
+    }
+
+    // Record the directories changed by the revision after the last
+    // one indexed
+    void add(std::vector<std::string> directories)
+    {
+        std::sort(directories.begin(), directories.end());
+        directories.erase(
+            std::unique(directories.begin(), directories.end()), directories.end());
+
+        std::string encoded;
+        std::string const* previous = nullptr;
+        for (auto const& d : directories)
+        {
+            std::size_t shared = 0;
+            if (previous)
+            {
+                std::size_t const n = std::min(previous->size(), d.size());
+                shared = std::mismatch(d.begin(), d.begin() + n, previous->begin()).first - d.begin();
+                shared = std::min<std::size_t>(shared, 0xFFFF);
+            }
+            encoded += char(shared & 0xFF);
+            encoded += char(shared >> 8);
+            encoded.append(d, shared, std::string::npos);
+            encoded += '\0';
+            previous = &d;
+        }
+        revisions.push_back(std::move(encoded));
+    }
+
+    // Call f with the name of each directory revnum changed, in order
+    template <class F>
+    void for_each(int revnum, F const& f) const
+    {
+        assert(revnum >= 0 && revnum <= last_revision());
+        std::string const& encoded = revisions[revnum];
+        std::string name;
+        for (std::size_t i = 0; i < encoded.size();)
+        {
+            std::size_t const shared 
+                = (unsigned char)encoded[i] | std::size_t((unsigned char)encoded[i + 1]) << 8;
+            std::size_t const end = encoded.find('\0', i + 2);
+            name.resize(shared);
+            name.append(encoded, i + 2, end - (i + 2));
+            f(name);
+            i = end + 1;
+        }
+    }
+
+    // Store the index of the SVN repository with the given UUID.
+    // Failure only costs the next run the indexing, so it is not
+    // reported.
+    void save(std::string const& filename, std::string const& uuid) const
+    {
+        state_file::writer w;
+        w.word(format).str(uuid).word(revisions.size());
+        for (auto const& r : revisions)
+            w.str(r);
+
+        boost::system::error_code ec;
+        boost::filesystem::create_directories(
+            boost::filesystem::path(filename).parent_path(), ec);
+        try
+        {
+            w.save(filename);
+        }
+        catch (std::exception const&) {}
+    }
+
+    // If filename holds an index of the SVN repository with the given
+    // UUID, read it and return true; otherwise return false.
+    bool load(std::string const& filename, std::string const& uuid)
+    {
+        boost::system::error_code ec;
+        if (!boost::filesystem::exists(filename, ec))
+            return false;
+        try
+        {
+            state_file::reader r(filename);
+            if (r.word() != format || r.str() != uuid)
+                return false;
+            std::vector<std::string> result(r.word());
+            for (auto& encoded : result)
+                encoded = r.str();
+            if (result.empty())
+                return false;
+            revisions.swap(result);
+            return true;
+        }
+        catch (std::exception const&)
+        {
+            return false;
+        }
+    }
+
+ private:
+    std::vector<std::string> revisions; // encoded, indexed by revision number
+};
+
+#endif // CHANGED_DIRECTORIES_DWA20131101_HPP
@@ -0,0 +1,49 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef CHANGES_INDEX_DWA20131102_HPP
+# define CHANGES_INDEX_DWA20131102_HPP
+
+# include "revision_index.hpp"
+# include <cstdint>
+# include <string>
+# include <utility>
+
+// How the changes of a revision_index are stored
+template <class Change>
+struct change_format
+{
+    static std::uint64_t const format = 0x323073676e686332ull; // "2chngs02"
+
+    static void write(state_file::writer& w, Change const& x)
+    {
+        w.str(x.path).word(x.change_kind).word(x.node_kind).word(x.text_mod)
+            .str(x.copyfrom_path).word(std::uint64_t(x.copyfrom_rev));
+    }
+
+    static void read(state_file::reader& r, Change& c)
+    {
+        c.path = r.str();
+        c.change_kind = static_cast<decltype(c.change_kind)>(r.word());
+        c.node_kind = static_cast<decltype(c.node_kind)>(r.word());
+        c.text_mod = r.word() != 0;
+        c.copyfrom_path = r.str();
+        c.copyfrom_rev = static_cast<decltype(c.copyfrom_rev)>(r.word());
+    }
+};
+
+// The paths changed by each SVN revision, as svn_fs_paths_changed2
+// reports them, indexed once for every later run.
+//
+// Change is svn::change, or anything with the same members.
+template <class Change>
+struct changes_index : revision_index<Change, change_format<Change> >
+{
+    changes_index(
+        std::string const& filename, std::string const& uuid,
+        revision_date_function date_of)
+        : revision_index<Change, change_format<Change> >(filename, uuid, std::move(date_of))
+    {}
+};
+
+#endif // CHANGES_INDEX_DWA20131102_HPP
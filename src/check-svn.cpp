@@ -0,0 +1,355 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Checks how fast svn2git will be able to read an SVN repository,
+// before hours are spent finding out.  The layout of an FSFS
+// repository is read from its db/ directory: its format, sharding,
+// the shards not yet packed, whether rep-sharing is on, and whether
+// it lies in memory.  Then files changed by revisions spread evenly
+// over the history are read back in full, timing the reconstruction
+// of their contents from SVN's deltas, and the length of each one's
+// history estimates its delta chain: FSFS deltifies each version of a
+// node against the one whose predecessor count is its own with the
+// lowest set bit cleared, so reading it applies as many deltas as its
+// count has bits set.  What's found is reported with the changes that
+// would make the conversion faster.
+
+// See svn.cpp
+#define SVN_DEPRECATED
+
+#include "svn.hpp"
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/vfs.h>
+#include <svn_fs.h>
+
+namespace svn_health {
+
+struct Options
+  {
+  std::string svn_repo;
+  unsigned samples;
+  unsigned max_history;
+  };
+
+Options options;
+
+// What the db/ directory says of an FSFS repository
+struct fsfs_layout
+  {
+  int format;                   // 0 if not FSFS
+  int shard_size;               // 0 for a linear layout
+  int min_unpacked_rev;
+  bool rep_cache;               // db/rep-cache.db exists
+  std::uint64_t revs_bytes;     // of db/revs
+  bool in_memory;               // on a tmpfs
+  };
+
+bool read_first_line(std::string const& file, std::string& line)
+  {
+  std::ifstream in(file.c_str());
+  return bool(std::getline(in, line));
+  }
+
+fsfs_layout read_layout(std::string const& repo_path)
+  {
+  namespace fs = boost::filesystem;
+  fsfs_layout result = fsfs_layout();
+  std::string const db = repo_path + "/db/";
+  std::string line;
+  if (!read_first_line(db + "fs-type", line) || line != "fsfs")
+    return result;
+
+  // As fsfs_readahead reads it
+  std::ifstream format_file((db + "format").c_str());
+  if (!(format_file >> result.format) || result.format <= 0)
+    return fsfs_layout();
+  while (std::getline(format_file, line))
+    {
+    std::istringstream words(line);
+    std::string option, layout;
+    if (words >> option >> layout && option == "layout" && layout == "sharded")
+      words >> result.shard_size;
+    }
+  if (result.shard_size > 0 && read_first_line(db + "min-unpacked-rev", line))
+    result.min_unpacked_rev = std::atoi(line.c_str());
+  result.rep_cache = fs::exists(db + "rep-cache.db");
+
+  for (fs::recursive_directory_iterator i(db + "revs"), end; i != end; ++i)
+    {
+    boost::system::error_code ec;
+    if (fs::is_regular_file(i->status()))
+      result.revs_bytes += fs::file_size(i->path(), ec);
+    }
+
+  struct statfs s;
+  result.in_memory = ::statfs(db.c_str(), &s) == 0 && s.f_type == 0x01021994; // TMPFS_MAGIC
+  return result;
+  }
+
+// The memory the kernel says is available, in bytes, or 0 if unknown
+std::uint64_t available_memory()
+  {
+  std::ifstream meminfo("/proc/meminfo");
+  for (std::string name; meminfo >> name;)
+    {
+    std::uint64_t kib;
+    if (!(meminfo >> kib))
+      break;
+    if (name == "MemAvailable:")
+      return kib << 10;
+    meminfo.ignore(64, '\n');
+    }
+  return 0;
+  }
+
+// A file read back from SVN
+struct sample
+  {
+  int revnum;
+  std::string path;
+  std::uint64_t bytes;
+  double seconds;
+  unsigned predecessors;        // up to options.max_history
+  unsigned chain;               // the deltas estimated to be applied
+  };
+
+unsigned bits_set(unsigned n)
+  {
+  unsigned result = 0;
+  for (; n; n &= n - 1)
+    ++result;
+  return result;
+  }
+
+// Read the file at svn_path in rev, timing it, and count its history
+sample read_back(svn::revision const& rev, std::string const& svn_path)
+  {
+  AprScratch scope(rev.scratch);
+  sample result = { rev.revnum, svn_path, 0, 0, 0, 0 };
+
+  auto const start = std::chrono::steady_clock::now();
+  svn_stream_t* in = svn::call(svn_fs_file_contents, rev.fs_root, svn_path.c_str(), scope);
+  char buffer[1 << 16];
+  for (;;)
+    {
+    apr_size_t len = sizeof(buffer);
+    svn::check(svn_stream_read, in, &buffer[0], &len);
+    result.bytes += len;
+    if (len < sizeof(buffer))
+      break;
+    }
+  result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  svn_fs_history_t* history = svn::call(svn_fs_node_history, rev.fs_root, svn_path.c_str(), scope);
+  while (result.predecessors <= options.max_history
+         && (history = svn::call(svn_fs_history_prev, history, TRUE, scope)))
+    ++result.predecessors;
+  // The first step back is to the version read
+  if (result.predecessors > 0)
+    --result.predecessors;
+  result.chain = bits_set(result.predecessors);
+  return result;
+  }
+
+// Read back a file changed by each of the sampled revisions
+std::vector<sample> sample_history(svn const& repo, int latest)
+  {
+  std::vector<sample> result;
+  unsigned const n = std::min<unsigned>(options.samples, latest);
+  for (unsigned i = 0; i < n; ++i)
+    {
+    int const revnum = int(std::uint64_t(latest) * (i + 1) / n);
+    std::vector<svn::change> changes;
+    repo.changes(revnum, changes);
+    // The last file the revision changed the contents of
+    for (auto c = changes.rbegin(); c != changes.rend(); ++c)
+      {
+      if (c->node_kind == svn_node_file && c->change_kind != svn_fs_path_change_delete
+          && (c->text_mod || c->change_kind != svn_fs_path_change_modify))
+        {
+        result.push_back(read_back(repo[revnum], c->path));
+        break;
+        }
+      }
+    }
+  return result;
+  }
+
+std::string megabytes(std::uint64_t bytes)
+  {
+  std::ostringstream os;
+  os << std::fixed << std::setprecision(1) << bytes / 1048576.0 << " MB";
+  return os.str();
+  }
+
+void run()
+  {
+  svn const repo(options.svn_repo, std::string());
+  int const latest = repo.latest_revision();
+  fsfs_layout const layout = read_layout(options.svn_repo);
+  std::vector<std::string> advice;
+
+  std::cout << options.svn_repo << ": " << latest << " revisions\n";
+  if (layout.format == 0)
+    {
+    std::cout << "  not an FSFS repository; its layout isn't checked\n";
+    }
+  else
+    {
+    std::cout << "  FSFS format " << layout.format << ", ";
+    if (layout.shard_size > 0)
+      std::cout << "sharded by " << layout.shard_size << " revisions\n";
+    else
+      std::cout << "linear\n";
+    std::cout << "  revision data: " << megabytes(layout.revs_bytes)
+              << (layout.in_memory ? ", in memory (tmpfs)\n" : "\n");
+    std::cout << "  rep-sharing cache: " << (layout.rep_cache ? "present\n" : "absent\n");
+
+    if (layout.shard_size == 0)
+      advice.push_back(
+        "The repository isn't sharded, so every revision is a file of one huge directory; "
+        "dump it and load it into a repository made by a current svnadmin");
+    if (layout.format < 6)
+      advice.push_back(
+        "Format " + std::to_string(layout.format) + " predates packed revision properties, "
+        "so each revision's log message is a file of its own; run \"svnadmin upgrade\", "
+        "then \"svnadmin pack\"");
+    else if (layout.format < 7)
+      advice.push_back(
+        "Format 6 predates logically addressed revisions, which make reading many of them "
+        "cheaper; dumping and loading into a repository made by svnadmin 1.9 or later gets them");
+
+    if (layout.shard_size > 0)
+      {
+      int const complete = (latest + 1) / layout.shard_size;
+      int const unpacked = complete - layout.min_unpacked_rev / layout.shard_size;
+      std::cout << "  shards: " << complete << " complete, " << unpacked << " of them unpacked\n";
+      if (unpacked > 0)
+        advice.push_back(
+          std::to_string(unpacked) + " complete shards aren't packed, so their revisions are "
+          "read from as many small files; run \"svnadmin pack\"");
+      }
+    if (!layout.rep_cache && layout.format >= 4)
+      std::cout << "  (without rep-sharing, identical contents are stored again; "
+                   "this costs space rather than conversion time)\n";
+
+    std::uint64_t const memory = available_memory();
+    if (!layout.in_memory && memory > 0 && layout.revs_bytes < memory / 2)
+      advice.push_back(
+        "The revision data (" + megabytes(layout.revs_bytes) + ") would fit in the "
+        + megabytes(memory) + " of memory available; copy the repository to a RAM disk, "
+        "or convert with --fsfs-readahead");
+    }
+
+  std::vector<sample> samples = sample_history(repo, latest);
+  if (!samples.empty())
+    {
+    std::uint64_t bytes = 0;
+    double seconds = 0;
+    unsigned chains = 0, longest_chain = 0;
+    for (auto const& s : samples)
+      {
+      bytes += s.bytes;
+      seconds += s.seconds;
+      chains += s.chain;
+      longest_chain = std::max(longest_chain, s.chain);
+      }
+    double const mean_chain = double(chains) / samples.size();
+    std::cout << std::fixed << std::setprecision(1)
+              << "  read back " << samples.size() << " files, " << megabytes(bytes) << ", in "
+              << std::setprecision(3) << seconds << " s: "
+              << std::setprecision(1) << (seconds > 0 ? bytes / seconds / 1048576 : 0.0) << " MB/s, "
+              << std::setprecision(2) << 1000 * seconds / samples.size() << " ms a file\n"
+              << "  estimated delta chains: " << std::setprecision(1) << mean_chain
+              << " deltas on average, " << longest_chain << " at most\n";
+
+    // The slowest, which say where the time goes
+    std::sort(samples.begin(), samples.end(),
+      [](sample const& x, sample const& y) { return x.seconds > y.seconds; });
+    std::cout << "  slowest:\n";
+    for (std::size_t i = 0; i < std::min<std::size_t>(samples.size(), 5); ++i)
+      {
+      auto const& s = samples[i];
+      std::cout << "    r" << s.revnum << " " << s.path << ": " << megabytes(s.bytes) << " in "
+                << std::setprecision(3) << s.seconds << " s, " << s.predecessors
+                << (s.predecessors > options.max_history ? "+" : "") << " earlier versions, ~"
+                << s.chain << " deltas\n";
+      }
+
+    if (longest_chain > 12 || mean_chain > 8)
+      advice.push_back(
+        "Reading a file applies up to " + std::to_string(longest_chain) + " deltas; files with "
+        "long histories are slow to read.  Loading a dump into a repository made by svnadmin "
+        "1.8 or later limits the chains (see max-deltification-walk in db/fsfs.conf)");
+    if (seconds > 0 && bytes / seconds < 20 * 1048576.0 && !layout.in_memory)
+      advice.push_back(
+        "Contents were reconstructed at under 20 MB/s; the disk may be the limit, "
+        "so try a RAM disk, --fsfs-readahead, or --prefetch-revisions");
+    }
+
+  if (advice.empty())
+    std::cout << "\nNothing found that would slow the conversion.\n";
+  else
+    {
+    std::cout << "\nRecommendations:\n";
+    for (auto const& a : advice)
+      std::cout << "  - " << a << "\n";
+    }
+  std::cout << std::flush;
+  }
+
+}
+
+int main(int argc, char **argv)
+  {
+  using svn_health::options;
+  namespace po = boost::program_options;
+  po::options_description program_options("Allowed options");
+  program_options.add_options()
+    ("help,h", "produce help message")
+    ("svnrepo", po::value(&options.svn_repo)->value_name("PATH")->required(),
+      "the SVN repository to check")
+    ("samples", po::value(&options.samples)->value_name("NUMBER")->default_value(100),
+      "read back a file changed by each of NUMBER revisions spread over the history")
+    ("max-history", po::value(&options.max_history)->value_name("NUMBER")->default_value(4096),
+      "follow each file's history back at most NUMBER versions")
+    ;
+  po::positional_options_description positional;
+  positional.add("svnrepo", 1);
+
+  try
+    {
+    po::variables_map variables;
+    store(po::command_line_parser(argc, argv)
+      .options(program_options)
+      .positional(positional)
+      .run(), variables);
+    if (variables.count("help"))
+      {
+      std::cout << "Usage: " << argv[0] << " [options] SVNREPO\n"
+                << program_options << std::endl;
+      return 0;
+      }
+    notify(variables);
+    svn_health::run();
+    return 0;
+    }
+  catch (std::exception& error)
+    {
+    std::cerr << error.what() << std::endl;
+    return -1;
+    }
+  }
@@ -0,0 +1,97 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef COMMIT_GRAPH_DWA20131202_HPP
+# define COMMIT_GRAPH_DWA20131202_HPP
+
+# include <algorithm>
+# include <cstddef>
+# include <cstdint>
+# include <unordered_set>
+# include <vector>
+
+// The parents of the commits a repository's fast-import has been
+// given in this run, by mark, for --reduce-merges to tell which merge
+// parents are already ancestors of another parent.  Each commit has a
+// generation number, one more than its parents' greatest, so that a
+// search for an ancestor can pass over the commits too old to lead to
+// it.  Commits written by earlier runs are unknown, with no parents
+// and generation zero; nothing is reachable through them, which only
+// ever leaves a redundant parent in place.
+class commit_graph
+{
+ public:
+    // Record that the commit with the given mark has the given parents
+    void add(int mark, std::vector<int> const& parents)
+    {
+        std::size_t const m = std::size_t(mark);
+        if (m >= nodes.size())
+            nodes.resize(m + 1);
+        node& n = nodes[m];
+        n.first_parent = std::uint32_t(parent_marks.size());
+        n.parents = std::uint32_t(parents.size());
+        n.generation = 1;
+        for (int p : parents)
+        {
+            parent_marks.push_back(p);
+            n.generation = std::max(n.generation, generation(p) + 1);
+        }
+    }
+
+    // True iff the commit marked to is from or one of its ancestors,
+    // as far as is known.  The search gives up, returning false, after
+    // looking at limit commits.
+    bool reaches(int from, int to, std::size_t limit) const
+    {
+        if (from == to)
+            return true;
+        std::uint32_t const target = generation(to);
+        std::vector<int> pending(1, from);
+        std::unordered_set<int> seen(pending.begin(), pending.end());
+        while (!pending.empty())
+        {
+            int const m = pending.back();
+            pending.pop_back();
+            if (std::size_t(m) >= nodes.size())
+                continue;
+            node const& n = nodes[m];
+            for (std::uint32_t i = 0; i < n.parents; ++i)
+            {
+                int const p = parent_marks[n.first_parent + i];
+                if (p == to)
+                    return true;
+                // Only younger commits can descend from the target
+                if (generation(p) <= target || !seen.insert(p).second)
+                    continue;
+                if (seen.size() > limit)
+                    return false;
+                pending.push_back(p);
+            }
+        }
+        return false;
+    }
+
+    std::size_t bytes_held() const
+    {
+        return nodes.capacity() * sizeof(node) + parent_marks.capacity() * sizeof(int);
+    }
+
+ private:
+    struct node
+    {
+        node() : first_parent(0), parents(0), generation(0) {}
+        std::uint32_t first_parent; // in parent_marks
+        std::uint32_t parents;
+        std::uint32_t generation;   // zero if unknown
+    };
+
+    std::uint32_t generation(int mark) const
+    {
+        return std::size_t(mark) < nodes.size() ? nodes[mark].generation : 0;
+    }
+
+    std::vector<node> nodes;    // by mark
+    std::vector<int> parent_marks;
+};
+
+#endif // COMMIT_GRAPH_DWA20131202_HPP
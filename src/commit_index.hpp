@@ -0,0 +1,258 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef COMMIT_INDEX_DWA20131125_HPP
+# define COMMIT_INDEX_DWA20131125_HPP
+
+# include <boost/iostreams/device/mapped_file.hpp>
+# include <boost/filesystem.hpp>
+# include <algorithm>
+# include <cctype>
+# include <cstddef>
+# include <cstdint>
+# include <cstring>
+# include <fstream>
+# include <stdexcept>
+# include <string>
+# include <vector>
+
+# include <unistd.h>
+
+// The Git commits a conversion made, by the SVN revision each was
+// made in, written with --commit-index and read in place from a
+// memory mapping by find-commits.  After a 16-byte header come:
+//
+//   records   one per commit, sorted by repository, ref and revision
+//   by_rev    the indices of the records, sorted by revision
+//   by_sha    the indices of the records, sorted by SHA-1
+//   names     the names of the repositories and refs, NUL-terminated,
+//             in sorted order
+//
+// all in native 32-bit words.  A record names its repository and ref
+// by their offsets among the names, so that comparing the offsets
+// compares the names, and every lookup is a binary search.
+namespace commit_index
+{
+    char const magic[8] = { '2', 'c', 'm', 't', 'i', 'x', '0', '1' };
+
+    struct record
+    {
+        std::uint32_t revnum;
+        std::uint32_t repo;         // offsets among the names
+        std::uint32_t ref;
+        std::uint32_t mark;
+        unsigned char sha[20];      // all zero if unknown
+    };
+
+    // A commit as the writer is given it
+    struct entry
+    {
+        std::size_t revnum;
+        std::string repo;
+        std::string ref;
+        std::size_t mark;
+        unsigned char sha[20];
+    };
+
+    // The 40 hex digits of sha
+    inline std::string hex(unsigned char const* sha)
+    {
+        static char const digits[] = "0123456789abcdef";
+        std::string result(40, '0');
+        for (std::size_t i = 0; i < 20; ++i)
+        {
+            result[2 * i] = digits[sha[i] >> 4];
+            result[2 * i + 1] = digits[sha[i] & 0xF];
+        }
+        return result;
+    }
+
+    // Write the index of entries to filename, replacing it atomically
+    inline void write(std::string const& filename, std::vector<entry> const& entries)
+    {
+        std::vector<std::string> names;
+        for (auto const& e : entries)
+        {
+            names.push_back(e.repo);
+            names.push_back(e.ref);
+        }
+        std::sort(names.begin(), names.end());
+        names.erase(std::unique(names.begin(), names.end()), names.end());
+
+        std::string name_bytes;
+        std::vector<std::uint32_t> offsets;
+        for (auto const& n : names)
+        {
+            offsets.push_back(std::uint32_t(name_bytes.size()));
+            name_bytes.append(n.c_str(), n.size() + 1);
+        }
+        name_bytes.append((4 - name_bytes.size() % 4) % 4, '\0');
+        auto offset_of = [&](std::string const& n) {
+            return offsets[std::lower_bound(names.begin(), names.end(), n) - names.begin()];
+        };
+
+        std::vector<record> records;
+        records.reserve(entries.size());
+        for (auto const& e : entries)
+        {
+            record r = { std::uint32_t(e.revnum), offset_of(e.repo), offset_of(e.ref),
+                         std::uint32_t(e.mark), {} };
+            std::memcpy(r.sha, e.sha, sizeof(r.sha));
+            records.push_back(r);
+        }
+        std::sort(records.begin(), records.end(), [](record const& x, record const& y) {
+                return x.repo != y.repo ? x.repo < y.repo
+                    : x.ref != y.ref ? x.ref < y.ref : x.revnum < y.revnum; });
+
+        std::vector<std::uint32_t> by_rev(records.size()), by_sha(records.size());
+        for (std::uint32_t i = 0; i < records.size(); ++i)
+            by_rev[i] = by_sha[i] = i;
+        std::stable_sort(by_rev.begin(), by_rev.end(), [&](std::uint32_t x, std::uint32_t y) {
+                return records[x].revnum < records[y].revnum; });
+        std::stable_sort(by_sha.begin(), by_sha.end(), [&](std::uint32_t x, std::uint32_t y) {
+                return std::memcmp(records[x].sha, records[y].sha, sizeof(records[x].sha)) < 0; });
+
+        std::string const tmp = filename + ".tmp" + std::to_string(::getpid());
+        {
+            std::ofstream out(tmp.c_str(), std::ios::binary | std::ios::trunc);
+            std::uint32_t const counts[2] = {
+                std::uint32_t(records.size()), std::uint32_t(name_bytes.size()) };
+            out.write(magic, sizeof(magic));
+            out.write(reinterpret_cast<char const*>(counts), sizeof(counts));
+            out.write(reinterpret_cast<char const*>(records.data()), records.size() * sizeof(record));
+            out.write(reinterpret_cast<char const*>(by_rev.data()), by_rev.size() * 4);
+            out.write(reinterpret_cast<char const*>(by_sha.data()), by_sha.size() * 4);
+            out.write(name_bytes.data(), name_bytes.size());
+            out.close();
+            if (!out)
+                throw std::runtime_error("Couldn't write " + tmp);
+        }
+        boost::filesystem::rename(tmp, filename);
+    }
+
+    class reader
+    {
+     public:
+        explicit reader(std::string const& filename)
+            : file(filename)
+        {
+            std::uint32_t counts[2];
+            if (file.size() < sizeof(magic) + sizeof(counts)
+                || std::memcmp(file.data(), magic, sizeof(magic)) != 0)
+            {
+                throw std::runtime_error(filename + " is not a commit index");
+            }
+            std::memcpy(counts, file.data() + sizeof(magic), sizeof(counts));
+            count = counts[0];
+            name_bytes = counts[1];
+            if (file.size() != sizeof(magic) + sizeof(counts)
+                + count * (sizeof(record) + 8) + std::size_t(name_bytes))
+            {
+                throw std::runtime_error("Commit index " + filename + " is truncated");
+            }
+            records = reinterpret_cast<record const*>(file.data() + sizeof(magic) + sizeof(counts));
+            by_rev = reinterpret_cast<std::uint32_t const*>(records + count);
+            by_sha = by_rev + count;
+            names = reinterpret_cast<char const*>(by_sha + count);
+        }
+
+        std::size_t size() const { return count; }
+
+        char const* name(std::uint32_t offset) const { return names + offset; }
+
+        // The commit kept in ref of repo made at or before revnum, or
+        // null if there is none
+        record const* find(std::string const& repo, std::string const& ref, std::size_t revnum) const
+        {
+            std::uint32_t repo_offset, ref_offset;
+            if (!find_name(repo, repo_offset) || !find_name(ref, ref_offset))
+                return nullptr;
+            record const* const end = records + count;
+            record const* const after = std::upper_bound(
+                records, end, revnum, [&](std::size_t rev, record const& r) {
+                    return repo_offset != r.repo ? repo_offset < r.repo
+                        : ref_offset != r.ref ? ref_offset < r.ref : rev < r.revnum; });
+            if (after == records)
+                return nullptr;
+            record const* const found = after - 1;
+            return found->repo == repo_offset && found->ref == ref_offset ? found : nullptr;
+        }
+
+        // The commits made in revnum
+        std::vector<record const*> made_in(std::size_t revnum) const
+        {
+            auto const range = std::equal_range(
+                by_rev, by_rev + count, revnum, rev_order(records));
+            std::vector<record const*> result;
+            for (auto i = range.first; i != range.second; ++i)
+                result.push_back(records + *i);
+            return result;
+        }
+
+        // The commits whose SHA-1s start with the hex digits of prefix
+        std::vector<record const*> with_sha(std::string prefix) const
+        {
+            std::transform(prefix.begin(), prefix.end(), prefix.begin(), ::tolower);
+            auto const first = std::lower_bound(
+                by_sha, by_sha + count, prefix, [this](std::uint32_t i, std::string const& p) {
+                    return hex(records[i].sha).compare(0, p.size(), p) < 0; });
+            std::vector<record const*> result;
+            for (auto i = first; i != by_sha + count; ++i)
+            {
+                if (hex(records[*i].sha).compare(0, prefix.size(), prefix) != 0)
+                    break;
+                result.push_back(records + *i);
+            }
+            return result;
+        }
+
+     private:
+        struct rev_order
+        {
+            explicit rev_order(record const* records) : records(records) {}
+            bool operator()(std::uint32_t i, std::size_t revnum) const { return records[i].revnum < revnum; }
+            bool operator()(std::size_t revnum, std::uint32_t i) const { return revnum < records[i].revnum; }
+            record const* records;
+        };
+
+        // The offset of the name n, if there is one; the names are in
+        // sorted order
+        bool find_name(std::string const& n, std::uint32_t& offset) const
+        {
+            std::uint32_t lo = 0, hi = name_bytes;
+            while (lo < hi)
+            {
+                // Back up to the start of the name around the middle
+                std::uint32_t mid = lo + (hi - lo) / 2;
+                while (mid > lo && names[mid - 1] != '\0')
+                    --mid;
+                if (names[mid] == '\0')   // padding at the end
+                {
+                    hi = mid;
+                    continue;
+                }
+                int const c = std::strcmp(names + mid, n.c_str());
+                if (c == 0)
+                {
+                    offset = mid;
+                    return true;
+                }
+                if (c < 0)
+                    lo = mid + std::uint32_t(std::strlen(names + mid)) + 1;
+                else
+                    hi = mid;
+            }
+            return false;
+        }
+
+        boost::iostreams::mapped_file_source file;
+        std::size_t count;
+        std::uint32_t name_bytes;
+        record const* records;
+        std::uint32_t const* by_rev;
+        std::uint32_t const* by_sha;
+        char const* names;
+    };
+}
+
+#endif // COMMIT_INDEX_DWA20131125_HPP
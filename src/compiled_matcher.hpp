@@ -0,0 +1,28 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef COMPILED_MATCHER_DWA20131112_HPP
+# define COMPILED_MATCHER_DWA20131112_HPP
+
+# include <cstddef>
+# include <cstdint>
+
+// A patrie's longest_match, compiled into code by
+// patrie::write_compiled_matcher for one particular set of rules
+struct compiled_matcher
+{
+    // Of the rules it was compiled from; see patrie::digest
+    std::uint64_t digest;
+
+    // One more than the position in patrie::all_rules() of the rule
+    // matching the SVN path [key, key + size) at revision, or zero if
+    // none does
+    std::size_t (*longest_match)(char const* key, std::size_t size, std::size_t revision);
+};
+
+// Built with SVN2GIT_COMPILED_MATCHER, svn2git and patrie_bench link
+// the matcher generate_matcher compiled from the rules named by
+// COMPILED_MATCHER_RULES at build time
+extern compiled_matcher const generated_matcher;
+
+#endif // COMPILED_MATCHER_DWA20131112_HPP
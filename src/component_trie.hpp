@@ -0,0 +1,180 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef COMPONENT_TRIE_DWA20131113_HPP
+# define COMPONENT_TRIE_DWA20131113_HPP
+
+# include <algorithm>
+# include <cstdint>
+# include <string>
+# include <vector>
+
+// An alternative to patrie's longest_match, for comparison by
+// patrie_bench.  Rules match whole path components, so instead of a
+// node per run of characters, this trie has a node per directory,
+// and finds the child for the next component with one probe of a
+// hash table keyed on the parent and the component's text.  A
+// directory boundary is simply the end of a component, so there are
+// no partial labels to compare and no boundaries to check.
+//
+// Rule must provide svn_path() (a path, whose leading and trailing
+// slashes are stripped), min and max, and the rules inserted must
+// not overlap, as patrie guarantees.
+template <class Rule>
+class component_trie
+{
+ public:
+    component_trie()
+        : nodes(1), slots(16, 0)
+    {}
+
+    void insert(Rule const& rule)
+    {
+        std::string const& svn_path = rule.svn_path().str();
+        std::uint32_t n = 0;
+        for (char const* start = svn_path.data(), *finish = start + svn_path.size(); start != finish;)
+        {
+            char const* end = std::find(start, finish, '/');
+            n = demand_child(n, start, end);
+            start = end == finish ? end : end + 1;
+        }
+
+        std::vector<Rule const*>& rules = nodes[n].rules;
+        rules.insert(
+            std::lower_bound(rules.begin(), rules.end(), &rule,
+                             [](Rule const* x, Rule const* y) { return x->max < y->max; }),
+            &rule);
+    }
+
+    // The rule with the longest SVN path that is [start, finish) or
+    // one of its parent directories, at the given revision, or null
+    Rule const* longest_match(char const* start, char const* finish, std::size_t revision) const
+    {
+        std::uint32_t n = 0;
+        Rule const* found = find_rule(nodes[0], revision);
+        while (start != finish)
+        {
+            // Find the end of the component and hash it in one pass
+            std::uint64_t h = seed(n);
+            char const* end = start;
+            for (; end != finish && *end != '/'; ++end)
+                h = (h ^ (unsigned char)*end) * prime;
+
+            n = find_child(n, h, start, end);
+            if (n == 0)
+                break;
+            if (Rule const* r = find_rule(nodes[n], revision))
+                found = r;
+            start = end == finish ? end : end + 1;
+        }
+        return found;
+    }
+
+    Rule const* longest_match(std::string const& key, std::size_t revision) const
+    {
+        return longest_match(key.data(), key.data() + key.size(), revision);
+    }
+
+ private:
+    struct node
+    {
+        std::vector<Rule const*> rules; // ordered by max
+    };
+
+    // A link from a parent to the child for one component, whose
+    // text is kept in labels
+    struct edge
+    {
+        std::uint64_t hash;
+        std::uint32_t parent, child;
+        std::uint32_t text_begin, text_end;
+    };
+
+    static std::uint64_t const prime = 1099511628211ull; // FNV-1a
+
+    static std::uint64_t seed(std::uint32_t parent)
+    {
+        return (14695981039346656037ull ^ parent) * prime;
+    }
+
+    static std::uint64_t hash(std::uint32_t parent, char const* start, char const* end)
+    {
+        std::uint64_t h = seed(parent);
+        for (; start != end; ++start)
+            h = (h ^ (unsigned char)*start) * prime;
+        return h;
+    }
+
+    static Rule const* find_rule(node const& n, std::size_t revision)
+    {
+        auto p = std::lower_bound(
+            n.rules.begin(), n.rules.end(), revision,
+            [](Rule const* r, std::size_t rev) { return std::size_t(r->max) < rev; });
+        return p != n.rules.end() && std::size_t((*p)->min) <= revision ? *p : nullptr;
+    }
+
+    // The child of parent for the component [start, end), whose hash
+    // is h, or 0 (the root, never a child) if there is none
+    std::uint32_t find_child(std::uint32_t parent, std::uint64_t h, char const* start, char const* end) const
+    {
+        std::size_t const mask = slots.size() - 1;
+        for (std::size_t i = std::size_t(h) & mask;; i = (i + 1) & mask)
+        {
+            std::uint32_t const s = slots[i];
+            if (s == 0)
+                return 0;
+            edge const& e = edges[s - 1];
+            if (e.hash == h && e.parent == parent
+                && std::size_t(end - start) == e.text_end - e.text_begin
+                && std::equal(start, end, labels.data() + e.text_begin))
+                return e.child;
+        }
+    }
+
+    std::uint32_t demand_child(std::uint32_t parent, char const* start, char const* end)
+    {
+        std::uint64_t const h = hash(parent, start, end);
+        if (std::uint32_t child = find_child(parent, h, start, end))
+            return child;
+
+        // Keep the table at most half full
+        if ((edges.size() + 1) * 2 > slots.size())
+            grow();
+
+        edge e;
+        e.hash = h;
+        e.parent = parent;
+        e.child = std::uint32_t(nodes.size());
+        e.text_begin = std::uint32_t(labels.size());
+        labels.append(start, end);
+        e.text_end = std::uint32_t(labels.size());
+        edges.push_back(e);
+        nodes.push_back(node());
+        place(std::uint32_t(edges.size()));
+        return e.child;
+    }
+
+    // Put the edge numbered slot (one more than its index) into the table
+    void place(std::uint32_t slot)
+    {
+        std::size_t const mask = slots.size() - 1;
+        std::size_t i = std::size_t(edges[slot - 1].hash) & mask;
+        while (slots[i] != 0)
+            i = (i + 1) & mask;
+        slots[i] = slot;
+    }
+
+    void grow()
+    {
+        slots.assign(slots.size() * 2, 0);
+        for (std::uint32_t s = 1; s <= edges.size(); ++s)
+            place(s);
+    }
+
+    std::vector<node> nodes;            // nodes[0] is the root
+    std::vector<edge> edges;
+    std::vector<std::uint32_t> slots;   // open addressing: edge number, or 0 if empty
+    std::string labels;
+};
+
+#endif // COMPONENT_TRIE_DWA20131113_HPP
@@ -6,10 +6,17 @@
 #include "options.hpp"
 #include <boost/foreach.hpp>
 
+#include <algorithm>
+#include <atomic>
 #include <string>
 #include <set>
 #include <map>
+#include <deque>
+#include <iomanip>
 #include <iostream>
+#include <mutex>
+#include <tuple>
+#include <vector>
 #include <cassert>
 
 typedef std::map<
@@ -20,21 +27,141 @@ typedef std::map<
 static branch_repositories declared;
 static branch_repositories matched;
 
+// What coverage::match records about each rule, in the order the
+// rules were declared.  Matching only bumps these, possibly on several
+// threads at once; the maps above are filled from them when the
+// report is made.
+struct rule_counters
+  {
+  explicit rule_counters(Rule const* rule) : rule(rule), hits(0), first(0), last(0) {}
+
+  Rule const* rule;
+  std::atomic<std::size_t> hits;
+  std::atomic<std::size_t> first;   // revisions matched, or zero
+  std::atomic<std::size_t> last;
+  };
+
+static std::deque<rule_counters> counters;
+
+// The work of converting files, charged by coverage::convert to each
+// rule and to the SVN paths' prefixes, under conversion_mutex, since
+// the slices of a dry run convert on threads of their own
+struct conversion_cost
+  {
+  conversion_cost() : files(0), bytes(0), seconds(0) {}
+
+  conversion_cost& add(std::uint64_t bytes, double seconds)
+    {
+    ++files;
+    this->bytes += bytes;
+    this->seconds += seconds;
+    return *this;
+    }
+
+  std::uint64_t files;
+  std::uint64_t bytes;
+  double seconds;
+  };
+
+// The costs are reported for prefixes of this many components, and the
+// largest of each table
+static std::size_t const prefix_components = 3;
+static std::size_t const reported_costs = 20;
+
+static std::mutex conversion_mutex;
+static std::map<Rule const*, conversion_cost> rule_costs;
+static std::map<std::string, conversion_cost> prefix_costs;
+
+// The largest files converted, in a heap whose top is the smallest of
+// them: their bytes, revisions and SVN paths
+typedef std::tuple<std::uint64_t, std::size_t, std::string> blob_cost;
+static std::vector<blob_cost> largest_blobs;
+
 void coverage::declare(Rule const& r)
   {
   if (!options.coverage)
     return;
   declared[r.branch_rule].insert(r.repo_rule);
+  r.coverage_index = counters.size();
+  counters.emplace_back(&r);
   }
 
 void coverage::match(Rule const& r, std::size_t revision)
   {
   if (!options.coverage)
     return;
-  // std::cout << "** Matching: " << r << " in " << declared.size() << " declared rules" << std::endl;
-  assert(declared.find(r.branch_rule) != declared.end());
-  matched[r.branch_rule].insert(r.repo_rule);
-  // std::cout << "** match count: " << matched[r.branch_rule].size() << std::endl;
+  assert(r.coverage_index < counters.size() && counters[r.coverage_index].rule == &r);
+  rule_counters& c = counters[r.coverage_index];
+  c.hits.fetch_add(1, std::memory_order_relaxed);
+
+  // Revisions may be matched out of order when they are analyzed in
+  // parallel
+  std::size_t first = c.first.load(std::memory_order_relaxed);
+  while ((first == 0 || revision < first)
+         && !c.first.compare_exchange_weak(first, revision, std::memory_order_relaxed))
+    {}
+  std::size_t last = c.last.load(std::memory_order_relaxed);
+  while (last < revision
+         && !c.last.compare_exchange_weak(last, revision, std::memory_order_relaxed))
+    {}
+  }
+
+void coverage::convert(
+  Rule const& r, std::string const& svn_path, std::size_t revision,
+  std::uint64_t bytes, double seconds)
+  {
+  if (!options.coverage)
+    return;
+
+  // The prefix is of the file's directory
+  std::size_t const dir_end = svn_path.rfind('/');
+  std::size_t end = dir_end == std::string::npos ? 0 : svn_path.find('/');
+  for (std::size_t n = 1; n < prefix_components && end < dir_end; ++n)
+    end = svn_path.find('/', end + 1);
+
+  std::lock_guard<std::mutex> lock(conversion_mutex);
+  rule_costs[&r].add(bytes, seconds);
+  prefix_costs[svn_path.substr(0, end)].add(bytes, seconds);
+
+  std::greater<blob_cost> const smaller_on_top;
+  if (largest_blobs.size() < reported_costs)
+    {
+    largest_blobs.emplace_back(bytes, revision, svn_path);
+    std::push_heap(largest_blobs.begin(), largest_blobs.end(), smaller_on_top);
+    }
+  else if (bytes > std::get<0>(largest_blobs.front()))
+    {
+    std::pop_heap(largest_blobs.begin(), largest_blobs.end(), smaller_on_top);
+    largest_blobs.back() = blob_cost(bytes, revision, svn_path);
+    std::push_heap(largest_blobs.begin(), largest_blobs.end(), smaller_on_top);
+    }
+  }
+
+// Print the most expensive of costs, the most bytes first, each named
+// by name()
+template <class Key, class Name>
+static void report_costs(
+  char const* title, std::map<Key, conversion_cost> const& costs, Name name)
+  {
+  if (costs.empty())
+    return;
+  std::vector<std::pair<Key, conversion_cost> > ranked(costs.begin(), costs.end());
+  std::sort(ranked.begin(), ranked.end(),
+            [](std::pair<Key, conversion_cost> const& x, std::pair<Key, conversion_cost> const& y)
+              { return x.second.bytes > y.second.bytes; });
+  if (ranked.size() > reported_costs)
+    ranked.resize(reported_costs);
+
+  std::cout << "Conversion cost by " << title << ":\n"
+            << std::setw(16) << "bytes" << std::setw(12) << "files"
+            << std::setw(12) << "seconds" << "  " << title << '\n';
+  for (auto const& x : ranked)
+    {
+    std::cout << std::setw(16) << x.second.bytes << std::setw(12) << x.second.files
+              << std::fixed << std::setprecision(3) << std::setw(12) << x.second.seconds
+              << "  " << name(x.first) << '\n';
+    }
+  std::cout << std::endl;
   }
 
 struct project1st
@@ -63,6 +190,12 @@ struct less_utilized
 
 void coverage::report()
   {
+  BOOST_FOREACH(rule_counters const& c, counters)
+    {
+    if (c.hits.load(std::memory_order_relaxed) > 0)
+      matched[c.rule->branch_rule].insert(c.rule->repo_rule);
+    }
+
   std::vector<boost2git::BranchRule const*> by_utilization;
   
   std::transform(declared.begin(), declared.end(), std::back_inserter(by_utilization), project1st());
@@ -89,4 +222,45 @@ void coverage::report()
       }
       std::cout << std::endl;
     }
+
+  // How often, and over what span of revisions, each rule matched
+  BOOST_FOREACH(rule_counters const& c, counters)
+    {
+    Rule const& r = *c.rule;
+    int const line = r.content_rule ? r.content_rule->line : r.branch_rule->line;
+    std::cout << options.rules_file << ":" << line << ": " << r.svn_path()
+              << " ==> " << r.git_address() << ": ";
+    std::size_t const hits = c.hits.load(std::memory_order_relaxed);
+    if (hits == 0)
+      std::cout << "never matched" << std::endl;
+    else
+      std::cout << hits << " matches, r" << c.first.load(std::memory_order_relaxed)
+                << " to r" << c.last.load(std::memory_order_relaxed) << std::endl;
+    }
+
+  // What converting the files cost, ranked
+  std::lock_guard<std::mutex> lock(conversion_mutex);
+  std::cout << std::endl;
+  report_costs("rule", rule_costs, [](Rule const* r)
+    {
+    int const line = r->content_rule ? r->content_rule->line : r->branch_rule->line;
+    return options.rules_file + ":" + std::to_string(line) + ": " + r->svn_path().str()
+      + " ==> " + r->git_address();
+    });
+  report_costs("SVN path prefix", prefix_costs, [](std::string const& prefix)
+    { return prefix.empty() ? std::string("/") : prefix; });
+
+  if (!largest_blobs.empty())
+    {
+    std::vector<blob_cost> blobs = largest_blobs;
+    std::sort(blobs.begin(), blobs.end(), std::greater<blob_cost>());
+    std::cout << "Largest files converted:\n"
+              << std::setw(16) << "bytes" << std::setw(12) << "revision" << "  path\n";
+    for (auto const& b : blobs)
+      {
+      std::cout << std::setw(16) << std::get<0>(b) << std::setw(12) << std::get<1>(b)
+                << "  " << std::get<2>(b) << '\n';
+      }
+    std::cout << std::endl;
+    }
   }
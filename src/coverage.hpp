@@ -4,7 +4,9 @@
 #ifndef COVERAGE_DWA2013428_HPP
 # define COVERAGE_DWA2013428_HPP
 
+# include <cstdint>
 # include <cstdlib>
+# include <string>
 
 struct Rule;
 
@@ -12,6 +14,14 @@ struct coverage
 {
     static void declare(Rule const& r);
     static void match(Rule const& r, std::size_t revision);
+
+    // Charge the conversion of the file at svn_path in revision, by
+    // r, which wrote bytes of contents in the given seconds, to r and
+    // to the SVN path's prefix
+    static void convert(
+        Rule const& r, std::string const& svn_path, std::size_t revision,
+        std::uint64_t bytes, double seconds);
+
     static void report();
 };
 
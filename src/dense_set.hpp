@@ -0,0 +1,126 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef DENSE_SET_DWA20131125_HPP
+# define DENSE_SET_DWA20131125_HPP
+
+# include <boost/iterator/iterator_facade.hpp>
+# include <algorithm>
+# include <cassert>
+# include <cstddef>
+# include <cstdint>
+# include <vector>
+
+// A set of objects numbered densely from 0 by their id(), such as
+// git_repository, kept as a bit per number.  Inserting, erasing and
+// testing cost a few integer operations, and iteration visits the
+// members in order of their numbers, a word of 64 at a time.  The
+// objects are found from their numbers in a table, by_id, owned by
+// the caller, which may grow while the set is in use.
+template <class T>
+class dense_set
+{
+    typedef std::uint64_t word;
+    static std::size_t const word_bits = 64;
+
+ public:
+    explicit dense_set(std::vector<T*> const& by_id) : by_id(&by_id), members(0) {}
+
+    // Returns true iff x wasn't in the set already
+    bool insert(T* x)
+    {
+        std::size_t const i = x->id();
+        assert((*by_id)[i] == x);
+        if (i / word_bits >= bits.size())
+            bits.resize(i / word_bits + 1);
+        word& w = bits[i / word_bits];
+        word const bit = word(1) << i % word_bits;
+        if (w & bit)
+            return false;
+        w |= bit;
+        ++members;
+        return true;
+    }
+
+    template <class Range>
+    void insert(Range const& r)
+    {
+        for (T* x : r)
+            insert(x);
+    }
+
+    // Returns the number of members erased: 1 or 0
+    std::size_t erase(T const* x)
+    {
+        std::size_t const i = x->id();
+        if (!contains(i))
+            return 0;
+        bits[i / word_bits] &= ~(word(1) << i % word_bits);
+        --members;
+        return 1;
+    }
+
+    std::size_t count(T const* x) const { return contains(x->id()) ? 1 : 0; }
+    std::size_t size() const { return members; }
+    bool empty() const { return members == 0; }
+
+    // Empty the set, keeping its storage
+    void clear()
+    {
+        std::fill(bits.begin(), bits.end(), word(0));
+        members = 0;
+    }
+
+    class const_iterator
+        : public boost::iterator_facade<const_iterator, T* const, boost::forward_traversal_tag, T*>
+    {
+     public:
+        const_iterator() : s(nullptr), i(0) {}
+
+     private:
+        friend class dense_set;
+        friend class boost::iterator_core_access;
+
+        const_iterator(dense_set const* s, std::size_t i) : s(s), i(s->next(i)) {}
+
+        T* dereference() const { return (*s->by_id)[i]; }
+        bool equal(const_iterator const& other) const { return i == other.i; }
+        void increment() { i = s->next(i + 1); }
+
+        dense_set const* s;
+        std::size_t i;
+    };
+
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, end_index()); }
+
+ private:
+    bool contains(std::size_t i) const
+    {
+        return i / word_bits < bits.size() && (bits[i / word_bits] >> i % word_bits & 1);
+    }
+
+    std::size_t end_index() const { return bits.size() * word_bits; }
+
+    // The number of the first member at or after i, or end_index()
+    std::size_t next(std::size_t i) const
+    {
+        std::size_t n = i / word_bits;
+        if (n >= bits.size())
+            return end_index();
+        word w = bits[n] & (~word(0) << i % word_bits);
+        while (w == 0)
+        {
+            if (++n == bits.size())
+                return end_index();
+            w = bits[n];
+        }
+        return n * word_bits + __builtin_ctzll(w);
+    }
+
+    std::vector<T*> const* by_id;
+    std::vector<word> bits;
+    std::size_t members;
+};
+
+#endif // DENSE_SET_DWA20131125_HPP
@@ -0,0 +1,91 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef DIRECTORY_CACHE_DWA20131024_HPP
+# define DIRECTORY_CACHE_DWA20131024_HPP
+
+# include "lru_cache.hpp"
+
+# include <cstddef>
+# include <cstdint>
+# include <cstdlib>
+# include <cstring>
+# include <memory>
+# include <string>
+# include <utility>
+# include <vector>
+
+// A bounded, least-recently-used cache of SVN directory listings.
+// Listings are keyed by the directory's node-revision ID, which SVN
+// never reuses for different contents, so entries stay valid across
+// revisions and are only ever dropped to respect the size limit.
+struct directory_cache
+{
+    struct entry
+    {
+        std::string name;
+        bool is_dir;
+        std::string node_id;    // empty unless is_dir
+        std::uint64_t location; // see location_of
+    };
+    typedef std::vector<entry> listing;
+
+    // Where FSFS stored the node-revision whose ID is node_id, e.g.
+    // "2.0.r13/4271", as its revision in the high 24 bits and its
+    // offset in that revision's file in the low 40.  A file's contents
+    // are usually written just before its node-revision, so reading
+    // files in this order reads the revision files mostly forwards.
+    // Zero for the IDs of other filesystems.
+    static std::uint64_t location_of(char const* node_id)
+    {
+        char const* r = std::strstr(node_id, ".r");
+        if (!r)
+            return 0;
+        char* end;
+        std::uint64_t const revnum = std::strtoull(r + 2, &end, 10);
+        if (*end != '/')
+            return 0;
+        std::uint64_t const offset = std::strtoull(end + 1, nullptr, 10);
+        return revnum << 40 | (offset & ((std::uint64_t(1) << 40) - 1));
+    }
+
+    // Hold at most max_entries directory entries, over all listings.
+    // Each listing also counts as an entry, so that empty directories
+    // are bounded too.
+    explicit directory_cache(std::size_t max_entries)
+        : listings("directory listings", max_entries) {}
+
+    // Return the listing stored for node_id, or null if there is none
+    std::shared_ptr<listing const> find(std::string const& node_id)
+    {
+        return listings.find(node_id);
+    }
+
+    // Store the listing of node_id, returning it for the caller's use.
+    // Listings larger than the whole cache are returned unstored.
+    std::shared_ptr<listing const> insert(std::string const& node_id, listing l)
+    {
+        std::size_t const cost = l.size() + 1;
+        return listings.insert(node_id, std::move(l), cost);
+    }
+
+    std::size_t entries() const { return listings.weight(); }
+
+    // Hold at most n entries from now on, dropping the least recently
+    // used listings beyond them; see --memory-budget
+    void set_max_entries(std::size_t n)
+    {
+        listings.set_max_weight(n);
+    }
+
+    // An estimate of the memory held, for --memory-csv
+    std::size_t bytes_held() const
+    {
+        return listings.weight() * (sizeof(entry) + 24) + listings.size() * 128;
+    }
+
+ private:
+    lru_cache<std::string, listing> listings;
+};
+
+#endif // DIRECTORY_CACHE_DWA20131024_HPP
@@ -0,0 +1,370 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Finds the branches and tags of an SVN repository in its history, so
+// that the refs of an abstract repository such as common_branches can
+// be written without an outside list of them.  The paths each
+// revision changes are read on several threads, from the index of
+// changed paths where svn2git has already made it, and filling it in
+// where not, then followed in order: a directory copied beneath one
+// of the --branches or --tags directories, and not within a ref
+// already there, starts a ref, and deleting it ends the ref.  Where a
+// revision adds a directory and copies directories into it, as
+// cvs2svn made branches, the added directory is the ref.  Each ref
+// found is printed as a rule,
+//
+//   [FIRST:LAST] "/branches/NAME/" : "NAME"; // from SOURCE@REV, ...
+//
+// in a branches and a tags section, with the copy it was made from
+// and the revisions that changed it.
+#include "svn.hpp"
+
+#include <boost/program_options.hpp>
+#include <algorithm>
+#include <condition_variable>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace discover_refs {
+
+struct Options
+  {
+  std::string svn_repo;
+  std::vector<std::string> branches;
+  std::vector<std::string> tags;
+  unsigned jobs;
+  };
+
+Options options;
+
+struct ref
+  {
+  std::string path;             // with leading and trailing slashes
+  std::string name;
+  bool tag;
+  svn_revnum_t created;
+  svn_revnum_t deleted;         // zero while the ref lives
+  std::string source;
+  svn_revnum_t source_revision;
+  svn_revnum_t last_changed;
+  unsigned revisions_changed;
+  };
+
+// The directories beneath which refs are made, with leading and
+// trailing slashes
+struct ref_root
+  {
+  std::string path;
+  bool tag;
+  };
+
+// What the revisions' changes make of the refs, followed in order
+class ref_tracker
+  {
+public:
+  explicit ref_tracker(std::vector<ref_root> const& roots) : roots(roots) {}
+
+  void add_revision(svn_revnum_t revnum, std::vector<svn::change> const& changes)
+    {
+    // The directories the revision adds without copying, in which
+    // cvs2svn copied the directories of a new branch
+    std::set<std::string> added;
+    for (auto const& c : changes)
+      {
+      if (c.node_kind == svn_node_dir && c.change_kind == svn_fs_path_change_add
+          && c.copyfrom_path.empty())
+        added.insert(c.path + "/");
+      }
+
+    for (auto const& c : changes)
+      {
+      std::string const dir = c.path + "/";
+      ref_root const* const root = root_of(dir);
+      if (!root)
+        continue;
+
+      if (c.change_kind == svn_fs_path_change_delete || c.change_kind == svn_fs_path_change_replace)
+        end_refs(dir, revnum);
+
+      if (c.node_kind == svn_node_dir && !c.copyfrom_path.empty() && !owner(dir)
+          && (c.change_kind == svn_fs_path_change_add || c.change_kind == svn_fs_path_change_replace))
+        start_ref(*root, dir, c, revnum, added);
+      else if (ref* r = owner(dir))
+        changed(*r, revnum);
+      }
+    }
+
+  // Every ref found, ended or not, in the order they were made
+  std::vector<ref> const& all() const { return refs; }
+
+private:
+  ref_root const* root_of(std::string const& dir) const
+    {
+    for (auto const& r : roots)
+      {
+      if (dir.size() > r.path.size() && dir.compare(0, r.path.size(), r.path) == 0)
+        return &r;
+      }
+    return nullptr;
+    }
+
+  // The live ref at dir or holding it, if any
+  ref* owner(std::string const& dir)
+    {
+    for (std::size_t end = dir.size(); end > 1; end = dir.rfind('/', end - 2) + 1)
+      {
+      auto const p = live.find(dir.substr(0, end));
+      if (p != live.end())
+        return &refs[p->second];
+      }
+    return nullptr;
+    }
+
+  // End the live refs at dir or within it
+  void end_refs(std::string const& dir, svn_revnum_t revnum)
+    {
+    for (auto p = live.lower_bound(dir);
+         p != live.end() && p->first.compare(0, dir.size(), dir) == 0;)
+      {
+      refs[p->second].deleted = revnum;
+      p = live.erase(p);
+      }
+    }
+
+  void start_ref(
+    ref_root const& root, std::string dir, svn::change const& c, svn_revnum_t revnum,
+    std::set<std::string> const& added)
+    {
+    // The highest directory added with it beneath the root, whose
+    // source is the copy's with the same relative path removed
+    std::string source = c.copyfrom_path + "/";
+    for (std::size_t slash; dir.size() > root.path.size()
+           && (slash = dir.rfind('/', dir.size() - 2)) >= root.path.size()
+           && added.count(dir.substr(0, slash + 1));)
+      {
+      std::string const suffix = dir.substr(slash + 1);
+      dir.resize(slash + 1);
+      if (source.size() > suffix.size()
+          && source.compare(source.size() - suffix.size(), suffix.size(), suffix) == 0)
+        source.resize(source.size() - suffix.size());
+      }
+    if (live.count(dir))
+      return changed(refs[live[dir]], revnum);
+
+    ref r;
+    r.path = dir;
+    r.name = dir.substr(root.path.size(), dir.size() - root.path.size() - 1);
+    r.tag = root.tag;
+    r.created = revnum;
+    r.deleted = 0;
+    r.source = source;
+    r.source_revision = c.copyfrom_rev;
+    r.last_changed = revnum;
+    r.revisions_changed = 1;
+    live[dir] = refs.size();
+    refs.push_back(r);
+    }
+
+  static void changed(ref& r, svn_revnum_t revnum)
+    {
+    if (r.last_changed != revnum)
+      ++r.revisions_changed;
+    r.last_changed = revnum;
+    }
+
+  std::vector<ref_root> const& roots;
+  std::vector<ref> refs;
+  std::map<std::string, std::size_t> live;   // by path, into refs
+  };
+
+// Reads the changes of revisions 1..last on jobs threads, handing
+// them to consume in order.  The readers stay within a window of
+// revisions ahead of it, so memory is bounded however long the
+// history.
+template <class Consume>
+void read_changes(svn const& repo, svn_revnum_t last, unsigned jobs, Consume consume)
+  {
+  svn_revnum_t const window = 1024;
+  std::mutex mutex;
+  std::condition_variable ready, room;
+  std::map<svn_revnum_t, std::vector<svn::change> > read;
+  svn_revnum_t next = 1, consumed = 0;
+  std::exception_ptr error;
+
+  auto reader = [&]
+    {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!error)
+      {
+      room.wait(lock, [&] { return error || next > last || next <= consumed + window; });
+      if (error || next > last)
+        return;
+      svn_revnum_t const revnum = next++;
+      lock.unlock();
+      std::vector<svn::change> changes;
+      try
+        {
+        repo.changes_on_thread(revnum, changes);
+        }
+      catch (...)
+        {
+        lock.lock();
+        error = std::current_exception();
+        ready.notify_all();
+        room.notify_all();
+        return;
+        }
+      lock.lock();
+      read[revnum].swap(changes);
+      ready.notify_all();
+      }
+    };
+
+  std::vector<std::thread> threads;
+  for (unsigned t = 0; t < std::max(jobs, 1u); ++t)
+    threads.emplace_back(reader);
+  try
+    {
+    for (svn_revnum_t revnum = 1; revnum <= last; ++revnum)
+      {
+      std::vector<svn::change> changes;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        ready.wait(lock, [&] { return error || read.count(revnum); });
+        if (error)
+          break;
+        changes.swap(read[revnum]);
+        read.erase(revnum);
+        consumed = revnum;
+        room.notify_all();
+      }
+      // Later runs, of this or of svn2git, find them in the index
+      repo.indexed_changes.add(revnum, changes);
+      consume(revnum, changes);
+      }
+    }
+  catch (...)
+    {
+    std::lock_guard<std::mutex> lock(mutex);
+    error = std::current_exception();
+    room.notify_all();
+    }
+  for (auto& t : threads)
+    t.join();
+  if (error)
+    std::rethrow_exception(error);
+  }
+
+void print_rules(std::vector<ref> const& refs, bool tags)
+  {
+  std::cout << "  " << (tags ? "tags" : "branches") << "\n  {\n";
+  for (auto const& r : refs)
+    {
+    if (r.tag != tags)
+      continue;
+    std::cout << "    [" << r.created << ":";
+    if (r.deleted)
+      std::cout << r.deleted - 1;
+    std::cout << "] \"" << r.path << "\" : \"" << r.name << "\"; // from "
+              << r.source << "@" << r.source_revision << ", changed in " << r.revisions_changed
+              << (r.revisions_changed == 1 ? " revision" : " revisions")
+              << ", last in r" << r.last_changed;
+    if (r.deleted)
+      std::cout << ", deleted in r" << r.deleted;
+    std::cout << "\n";
+    }
+  std::cout << "  }\n";
+  }
+
+void run()
+  {
+  std::vector<ref_root> roots;
+  for (auto const* dirs : { &options.branches, &options.tags })
+    {
+    for (std::string dir : *dirs)
+      {
+      dir.erase(0, dir.find_first_not_of('/'));
+      dir.erase(dir.find_last_not_of('/') + 1);
+      if (dir.empty())
+        throw std::runtime_error("The root of the repository can't hold the refs");
+      ref_root const root = { "/" + dir + "/", dirs == &options.tags };
+      roots.push_back(root);
+      }
+    }
+
+  svn const repo(options.svn_repo, std::string());
+  svn_revnum_t const last = repo.latest_revision();
+  ref_tracker tracker(roots);
+  read_changes(repo, last, options.jobs,
+    [&](svn_revnum_t revnum, std::vector<svn::change> const& changes)
+      {
+      tracker.add_revision(revnum, changes);
+      });
+  repo.save_changes();
+
+  std::vector<ref> refs = tracker.all();
+  std::stable_sort(refs.begin(), refs.end(),
+    [](ref const& x, ref const& y) { return x.path < y.path; });
+  std::cout << "// " << refs.size() << " refs found in r1 to r" << last << " of "
+            << options.svn_repo << "\n";
+  print_rules(refs, false);
+  print_rules(refs, true);
+  std::cout << std::flush;
+  }
+
+}
+
+int main(int argc, char **argv)
+  {
+  using discover_refs::options;
+  namespace po = boost::program_options;
+  po::options_description program_options("Allowed options");
+  program_options.add_options()
+    ("help,h", "produce help message")
+    ("svnrepo", po::value(&options.svn_repo)->value_name("PATH")->required(),
+      "the SVN repository to search")
+    ("branches", po::value(&options.branches)->value_name("PATH")
+      ->default_value(std::vector<std::string>(1, "branches"), "branches"),
+      "a directory in which branches are made; may be repeated")
+    ("tags", po::value(&options.tags)->value_name("PATH")
+      ->default_value(std::vector<std::string>(1, "tags"), "tags"),
+      "a directory in which tags are made; may be repeated")
+    ("jobs,j", po::value(&options.jobs)->value_name("NUMBER")
+      ->default_value(std::max(std::thread::hardware_concurrency(), 1u)),
+      "read the revisions' changes on NUMBER threads")
+    ;
+  po::positional_options_description positional;
+  positional.add("svnrepo", 1);
+
+  try
+    {
+    po::variables_map variables;
+    store(po::command_line_parser(argc, argv)
+      .options(program_options)
+      .positional(positional)
+      .run(), variables);
+    if (variables.count("help"))
+      {
+      std::cout << "Usage: " << argv[0] << " [options] SVNREPO\n"
+                << program_options << std::endl;
+      return 0;
+      }
+    notify(variables);
+    discover_refs::run();
+    return 0;
+    }
+  catch (std::exception& error)
+    {
+    std::cerr << error.what() << std::endl;
+    return -1;
+    }
+  }
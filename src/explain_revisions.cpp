@@ -0,0 +1,230 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// See svn.cpp
+#define SVN_DEPRECATED
+
+#include "explain_revisions.hpp"
+#include "revision_planner.hpp"
+#include "ruleset.hpp"
+#include "options.hpp"
+#include "svn.hpp"
+#include "path.hpp"
+#include "log.hpp"
+#include <boost/range/size.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <svn_fs.h>
+
+namespace
+{
+    // What converting a revision, or several, would take
+    struct cost
+    {
+        std::uint64_t files;
+        std::uint64_t bytes;        // of the files' contents
+        std::uint64_t new_bytes;    // of those not yet sent to the repository
+        std::uint64_t deletions;
+        std::uint64_t copies;
+        std::uint64_t transitions;
+        std::uint64_t commits;
+        std::uint64_t ls_round_trips;
+
+        cost& operator+=(cost const& x)
+        {
+            files += x.files;
+            bytes += x.bytes;
+            new_bytes += x.new_bytes;
+            deletions += x.deletions;
+            copies += x.copies;
+            transitions += x.transitions;
+            commits += x.commits;
+            ls_round_trips += x.ls_round_trips;
+            return *this;
+        }
+
+        // In the units of history_profile::cost, counting a unit
+        // for each "ls" round trip too
+        std::uint64_t units() const
+        {
+            return 1 + files + deletions + copies + transitions + ls_round_trips + (new_bytes >> 16);
+        }
+    };
+
+    void print_header(char const* first_column)
+    {
+        std::cout << std::setw(32) << std::left << first_column << std::right
+                  << std::setw(10) << "files" << std::setw(14) << "bytes" << std::setw(14) << "new bytes"
+                  << std::setw(10) << "deletions" << std::setw(8) << "copies"
+                  << std::setw(12) << "transitions" << std::setw(9) << "commits"
+                  << std::setw(7) << "ls" << '\n';
+    }
+
+    void print_row(std::string const& name, cost const& c)
+    {
+        std::cout << std::setw(32) << std::left << name << std::right
+                  << std::setw(10) << c.files << std::setw(14) << c.bytes << std::setw(14) << c.new_bytes
+                  << std::setw(10) << c.deletions << std::setw(8) << c.copies
+                  << std::setw(12) << c.transitions << std::setw(9) << c.commits
+                  << std::setw(7) << c.ls_round_trips << '\n';
+    }
+
+    // The SVN SHA-1 of the contents of svn_path in rev, or an empty
+    // string if SVN hasn't recorded one
+    std::string content_checksum(svn::revision const& rev, path const& svn_path)
+    {
+        AprScratch scope(rev.scratch);
+        svn_checksum_t* checksum = svn::call(
+            svn_fs_file_checksum, svn_checksum_sha1, rev.fs_root, svn_path.c_str(), FALSE, scope);
+        return checksum ? svn_checksum_to_cstring(checksum, scope) : std::string();
+    }
+}
+
+void explain_revisions(svn const& svn_repo, Ruleset const& ruleset, int first, int last)
+{
+    revision_planner planner(svn_repo, ruleset, false);
+    auto const& matcher = ruleset.matcher();
+
+    // The super-module of each repository that has one
+    std::map<std::string, std::string> super_modules;
+    for (auto const& r : ruleset.repositories())
+    {
+        if (!r.submodule_in_repo.empty())
+            super_modules[r.name] = r.submodule_in_repo;
+    }
+
+    // The contents sent to each repository so far, by their SVN
+    // SHA-1s, and the refs with a commit; fast-import is only sent
+    // contents once, and the first commit of a ref has no parent to
+    // compare with, so it needs no "ls"
+    std::map<std::string, std::unordered_set<std::string> > contents_sent;
+    std::set<std::pair<std::string, std::string> > refs_committed;
+
+    std::map<std::string, cost> by_repository;
+    std::vector<std::pair<int, cost> > by_revision;
+    cost total = cost();
+    revision_plan plan;
+    std::vector<svn::change> changes;
+
+    std::cout << "Cost of converting r" << first << " to r" << last << ":\n";
+    print_header("revision");
+    for (int revnum = first; revnum <= last; ++revnum)
+    {
+        svn_repo.changes(revnum, changes);
+        if (planner.changes_nothing(revnum, changes))
+        {
+            planner.skipped(revnum, revnum);
+            continue;
+        }
+        matcher.set_current_revision(revnum);
+        svn::revision const rev = svn_repo[revnum];
+        planner.plan(rev, plan);
+        std::cout << plan.log;
+
+        cost c = cost();
+        c.copies = plan.directory_copies.size();
+        c.transitions = boost::size(matcher.rules_in_transition(revnum));
+        c.deletions = plan.deletions.size();
+
+        // The refs the revision commits to, with the files, bytes
+        // and deletions of each repository
+        std::set<std::pair<std::string, std::string> > refs;
+        std::map<std::string, cost> repository_costs;
+        for (auto const& d : plan.deletions)
+        {
+            refs.emplace(d.match->git_repo_name(), d.match->git_ref_name());
+            ++repository_costs[d.match->git_repo_name()].deletions;
+        }
+        for (auto const& m : plan.merges)
+            refs.emplace(m.match->git_repo_name(), m.match->git_ref_name());
+        for (auto const& m : plan.recorded_merges)
+            refs.emplace(m.match->git_repo_name(), m.match->git_ref_name());
+        for (auto const& f : plan.files)
+        {
+            std::string const& repo = f.match->git_repo_name();
+            refs.emplace(repo, f.match->git_ref_name());
+
+            AprScratch scope(rev.scratch);
+            std::uint64_t const length = svn::call(
+                svn_fs_file_length, rev.fs_root, f.svn_path.c_str(), scope);
+            std::string const checksum = content_checksum(rev, f.svn_path);
+            bool const sent = !checksum.empty() && !contents_sent[repo].insert(checksum).second;
+
+            cost& rc = repository_costs[repo];
+            ++rc.files;
+            rc.bytes += length;
+            c.files += 1;
+            c.bytes += length;
+            if (!sent)
+            {
+                rc.new_bytes += length;
+                c.new_bytes += length;
+            }
+        }
+
+        // A submodule's commit records a new gitlink in the same
+        // ref of its super-module
+        for (auto r = refs.begin(); r != refs.end(); ++r)
+        {
+            auto const s = super_modules.find(r->first);
+            if (s != super_modules.end())
+                refs.emplace(s->second, r->second);
+        }
+
+        // A commit of a ref that has a parent asks fast-import for its
+        // tree unless the tree is modeled, or with --local-tree-check,
+        // the commit writes nothing
+        for (auto const& r : refs)
+        {
+            cost& rc = repository_costs[r.first];
+            ++rc.commits;
+            ++c.commits;
+            bool const has_parent = !refs_committed.insert(r).second;
+            bool const writes = rc.files + rc.deletions > 0;
+            if (has_parent && !options.tree_model && !(options.local_tree_check && !writes))
+            {
+                ++rc.ls_round_trips;
+                ++c.ls_round_trips;
+            }
+        }
+        for (auto const& rc : repository_costs)
+            by_repository[rc.first] += rc.second;
+
+        print_row("r" + std::to_string(revnum), c);
+        total += c;
+        by_revision.emplace_back(revnum, c);
+    }
+
+    std::cout << "\nBy repository:\n";
+    print_header("repository");
+    for (auto const& r : by_repository)
+        print_row(r.first, r.second);
+    print_row("total", total);
+
+    // The revisions costing most, in history_profile's units
+    std::size_t const most = std::min<std::size_t>(by_revision.size(), 10);
+    std::partial_sort(
+        by_revision.begin(), by_revision.begin() + most, by_revision.end(),
+        [](std::pair<int, cost> const& x, std::pair<int, cost> const& y) {
+            return x.second.units() > y.second.units(); });
+    std::uint64_t const total_units = std::max<std::uint64_t>(total.units(), 1);
+    std::cout << "\nCostliest revisions:\n";
+    for (std::size_t i = 0; i < most; ++i)
+    {
+        std::uint64_t const units = by_revision[i].second.units();
+        std::cout << "  r" << std::setw(8) << std::left << by_revision[i].first << std::right
+                  << std::setw(12) << units << " units, " << std::fixed << std::setprecision(1)
+                  << std::setw(5) << 100.0 * units / total_units << "%\n";
+    }
+    std::cout << std::flush;
+}
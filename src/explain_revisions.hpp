@@ -0,0 +1,20 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef EXPLAIN_REVISIONS_DWA20131126_HPP
+# define EXPLAIN_REVISIONS_DWA20131126_HPP
+
+class svn;
+class Ruleset;
+
+// Report what converting revisions first..last would cost, without
+// starting fast-import: the first phase of importing each revision is
+// run as the importer would, and its plan measured.  Each revision
+// that changes anything gets a line giving the files it would convert
+// and the bytes of their contents, the deletions, copies and rule
+// transitions, the commits it would make and the "ls" round trips
+// they would wait on.  Totals follow, by repository and overall,
+// with the revisions costing most.  See --explain.
+void explain_revisions(svn const& svn_repo, Ruleset const& ruleset, int first, int last);
+
+#endif // EXPLAIN_REVISIONS_DWA20131126_HPP
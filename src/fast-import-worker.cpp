@@ -0,0 +1,127 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Runs the git fast-imports of an svn2git given --fast-import-worker,
+// on a machine of its own, so that the processes of the largest
+// conversions are spread over several.  Each connection svn2git makes
+// starts one fast-import, for a repository beneath --root, which must
+// be where svn2git sees it too, e.g. on shared storage; the commands
+// and the responses to them are relayed over the connection
+// compressed.  See remote_fast_import.hpp.
+#include "remote_fast_import.hpp"
+#include <boost/program_options.hpp>
+#include <boost/process.hpp>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace import_worker {
+
+struct Options
+  {
+  std::string root;
+  std::string git;
+  std::string port;
+  };
+
+Options options;
+
+// Listen at options.port on every address of this machine
+int listen_at_port()
+  {
+  addrinfo hints = addrinfo();
+  hints.ai_family = AF_INET6;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE;
+  addrinfo* found;
+  if (int const e = ::getaddrinfo(nullptr, options.port.c_str(), &hints, &found))
+    {
+    hints.ai_family = AF_INET;
+    if (::getaddrinfo(nullptr, options.port.c_str(), &hints, &found) != 0)
+      throw std::runtime_error("Couldn't listen at port " + options.port + ": " + ::gai_strerror(e));
+    }
+  int const listener = ::socket(found->ai_family, found->ai_socktype | SOCK_CLOEXEC, found->ai_protocol);
+  int const on = 1;
+  bool const listening = listener >= 0
+    && ::setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) == 0
+    && ::bind(listener, found->ai_addr, found->ai_addrlen) == 0
+    && ::listen(listener, SOMAXCONN) == 0;
+  ::freeaddrinfo(found);
+  if (!listening)
+    throw std::runtime_error("Couldn't listen at port " + options.port + ": " + std::strerror(errno));
+  return listener;
+  }
+
+// Serve each connection on a thread of its own, for as long as the
+// fast-import it starts runs
+void run()
+  {
+  int const listener = listen_at_port();
+  std::cout << "serving git fast-import for " << options.root << " at port " << options.port
+            << std::endl;
+  for (;;)
+    {
+    int const socket = ::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+    if (socket < 0)
+      {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      throw std::runtime_error(std::string("Couldn't accept a connection: ") + std::strerror(errno));
+      }
+    std::thread(serve_fast_import, socket, options.root, options.git).detach();
+    }
+  }
+} // namespace import_worker
+
+int main(int argc, char **argv)
+  {
+  using import_worker::options;
+  namespace po = boost::program_options;
+  po::options_description program_options("Allowed options");
+  program_options.add_options()
+    ("help,h", "produce help message")
+    ("git", po::value(&options.git)->value_name("PATH"),
+      "the git executable to use (by default the one on the PATH)")
+    ("port", po::value(&options.port)->value_name("PORT")->required(),
+      "the port to listen at, which svn2git --fast-import-worker names")
+    ("root", po::value(&options.root)->value_name("DIRECTORY")->required(),
+      "import only into repositories beneath DIRECTORY, as svn2git sees them too")
+    ;
+  po::positional_options_description positional;
+  positional.add("root", 1);
+
+  po::variables_map variables;
+  store(po::command_line_parser(argc, argv)
+    .options(program_options)
+    .positional(positional)
+    .run(), variables);
+  if (variables.count("help"))
+    {
+    std::cout << "Usage: " << argv[0] << " [options] --port PORT ROOT\n"
+              << program_options << std::endl;
+    return 0;
+    }
+
+  try
+    {
+    notify(variables);
+    if (options.root.empty() || options.root[0] != '/')
+      throw std::runtime_error("--root must be an absolute path");
+    if (options.git.empty())
+      options.git = boost::process::search_path("git");
+    import_worker::run();
+    }
+  catch (std::exception& error)
+    {
+    std::cerr << error.what() << std::endl;
+    return -1;
+    }
+  }
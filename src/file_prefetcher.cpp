@@ -0,0 +1,188 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// See svn.cpp
+#define SVN_DEPRECATED
+
+#include "file_prefetcher.hpp"
+#include "svn.hpp"
+#include "svn_handle.hpp"
+
+#include <svn_fs.h>
+#include <svn_repos.h>
+#include <stdexcept>
+
+file_prefetcher::file_prefetcher(
+    std::string const& repo_path, unsigned nthreads, std::size_t budget_bytes)
+    : repo_path(repo_path), budget(budget_bytes), next(0), next_finished(0), buffered(0),
+      revnum(0), generation(0), stopping(false)
+{
+    for (unsigned i = 0; i < nthreads; ++i)
+        threads.emplace_back(&file_prefetcher::work, this);
+}
+
+file_prefetcher::~file_prefetcher()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work_ready.notify_all();
+    for (auto& t : threads)
+        t.join();
+}
+
+void file_prefetcher::clear()
+{
+    ++generation;
+    queue.clear();
+    next = 0;
+    items.clear();
+    finished.clear();
+    next_finished = 0;
+    buffered = 0;
+}
+
+void file_prefetcher::start(int revnum, std::vector<path> files)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        clear();
+        this->revnum = revnum;
+        queue = std::move(files);
+        for (auto const& f : queue)
+            items[f.str()];
+    }
+    work_ready.notify_all();
+}
+
+void file_prefetcher::finish()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    clear();
+}
+
+bool file_prefetcher::take(path const& svn_path, std::string& contents)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    auto p = items.find(svn_path.str());
+    if (p == items.end())
+        return false;
+
+    // Not started yet; it's quicker for the caller to read it than
+    // to wait in line
+    if (p->second.state == item::queued)
+    {
+        items.erase(p);
+        return false;
+    }
+
+    // The entry can't be erased while it's being read, since only
+    // this thread erases entries.
+    item& x = p->second;
+    item_done.wait(lock, [&x]{ return x.state == item::done; });
+
+    std::string error = std::move(x.error);
+    contents = std::move(x.contents);
+    buffered -= contents.size();
+    items.erase(p);
+    lock.unlock();
+    work_ready.notify_all();
+
+    if (!error.empty())
+        throw std::runtime_error(error);
+    return true;
+}
+
+bool file_prefetcher::take_next(path& svn_path, std::string& contents)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;)
+    {
+        item_done.wait(lock, [this]{ return next_finished < finished.size() || items.empty(); });
+        if (next_finished == finished.size())
+            return false;
+
+        // Skip those take() has had
+        auto p = items.find(finished[next_finished++]);
+        if (p == items.end())
+            continue;
+
+        svn_path = path(p->first);
+        std::string error = std::move(p->second.error);
+        contents = std::move(p->second.contents);
+        buffered -= contents.size();
+        items.erase(p);
+        lock.unlock();
+        work_ready.notify_all();
+
+        if (!error.empty())
+            throw std::runtime_error(error);
+        return true;
+    }
+}
+
+extern "C"
+{
+    static svn_error_t *append_to_string(void *baton, const char *data, apr_size_t *len)
+    {
+        static_cast<std::string*>(baton)->append(data, *len);
+        return SVN_NO_ERROR;
+    }
+}
+
+void file_prefetcher::work()
+{
+    AprPool file_pool;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;)
+    {
+        work_ready.wait(
+            lock, [this]{ return stopping || (next < queue.size() && buffered < budget); });
+        if (stopping)
+            return;
+
+        path const svn_path = queue[next++];
+        auto p = items.find(svn_path.str());
+        if (p == items.end() || p->second.state != item::queued)
+            continue;             // taken by the importer
+
+        p->second.state = item::reading;
+        unsigned const work_generation = generation;
+        int const work_revnum = revnum;
+        lock.unlock();
+
+        std::string contents;
+        std::string error;
+        try
+        {
+            // Opened on the first read, so failing to open the
+            // repository fails that read
+            svn_fs_root_t* const fs_root = svn_handle::of_thread(repo_path).revision_root(work_revnum);
+            AprScratch scope(file_pool);
+            svn_stream_t* in_stream = svn::call(
+                svn_fs_file_contents, fs_root, svn_path.c_str(), scope.data());
+            svn_stream_t* out_stream = svn_stream_create(&contents, scope);
+            svn_stream_set_write(out_stream, append_to_string);
+            svn::check(svn_stream_copy3, in_stream, out_stream, nullptr, nullptr, scope);
+        }
+        catch(std::exception const& e)
+        {
+            error = "reading " + svn_path.str() + ": " + e.what();
+        }
+
+        lock.lock();
+        if (generation != work_generation)
+            continue;             // the revision was finished without it
+
+        item& x = items[svn_path.str()];
+        buffered += contents.size();
+        x.contents = std::move(contents);
+        x.error = std::move(error);
+        x.state = item::done;
+        finished.push_back(svn_path.str());
+        item_done.notify_all();
+    }
+}
@@ -0,0 +1,88 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef FILE_PREFETCHER_DWA20131021_HPP
+# define FILE_PREFETCHER_DWA20131021_HPP
+
+# include "path.hpp"
+
+# include <condition_variable>
+# include <memory>
+# include <mutex>
+# include <string>
+# include <thread>
+# include <unordered_map>
+# include <vector>
+
+// Reads the contents of SVN files on a pool of background threads,
+// so that decompressing and undeltifying them in libsvn_fs overlaps
+// with writing to the fast-import processes.  Each thread reads
+// through its own svn_handle, since neither APR pools nor svn_fs
+// objects may be shared between threads.
+//
+// The importer remains the only writer: it announces the files of a
+// revision with start() and collects their contents with take(), in
+// whatever order its passes visit them.  Contents that haven't begun
+// to be read when they're asked for are left to the caller, so the
+// importer never waits on work stuck behind the memory budget.
+struct file_prefetcher
+{
+    file_prefetcher(
+        std::string const& repo_path, unsigned threads, std::size_t budget_bytes);
+    ~file_prefetcher();
+
+    // Discard any outstanding work and begin reading files, in order,
+    // as of the given revision.
+    void start(int revnum, std::vector<path> files);
+
+    // If the contents of svn_path have been or are being read,
+    // (wait for them and) move them into contents, returning true.
+    // Otherwise, the file won't be read in the background and the
+    // caller must read it.  Errors from the background read are
+    // rethrown here.
+    bool take(path const& svn_path, std::string& contents);
+
+    // Wait for the next file of the revision to be read, in the
+    // order the threads finish them, and move its name and contents
+    // into svn_path and contents, returning true.  Returns false once
+    // every file has been taken.  Errors are rethrown as by take().
+    bool take_next(path& svn_path, std::string& contents);
+
+    // Discard any outstanding work for the current revision
+    void finish();
+
+ private:
+    struct item
+    {
+        enum state_t { queued, reading, done };
+        item() : state(queued) {}
+
+        state_t state;
+        std::string contents;
+        std::string error;
+    };
+
+    void work();
+    void clear(); // requires mutex to be held
+
+    std::string const repo_path;
+    std::size_t const budget;
+
+    std::mutex mutex;
+    std::condition_variable work_ready; // when queue or budget improves
+    std::condition_variable item_done;  // when an item becomes done
+
+    std::vector<path> queue;
+    std::size_t next;                   // index into queue
+    std::unordered_map<std::string, item> items;
+    std::vector<std::string> finished; // items done, in order, some taken
+    std::size_t next_finished;          // index into finished
+    std::size_t buffered;               // bytes held in done items
+    int revnum;
+    unsigned generation;                // bumped when work is discarded
+    bool stopping;
+
+    std::vector<std::thread> threads;
+};
+
+#endif // FILE_PREFETCHER_DWA20131021_HPP
@@ -0,0 +1,141 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Looks up the Git commits of a conversion in the index svn2git
+// --commit-index wrote, instead of searching the repositories'
+// histories for the revisions in their commit messages.  Each query
+// is one of
+//
+//   rREVISION            the commits made in an SVN revision, e.g. r12345
+//   REPO:REF@REVISION    the commit kept in REF of REPO as of REVISION,
+//                        e.g. boost:refs/heads/master@12345
+//   SHA1                 the commits whose SHA-1s start with these hex
+//                        digits, at least 4 of them
+//
+// and each commit found is printed as
+//
+//   rREVISION REPO REF :MARK SHA1
+//
+// with "-" for a SHA-1 the index doesn't know.
+#include "commit_index.hpp"
+
+#include <boost/program_options.hpp>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace find_commits {
+
+struct Options
+  {
+  std::string index;
+  std::vector<std::string> queries;
+  };
+
+Options options;
+
+void print(commit_index::reader const& index, commit_index::record const& r)
+  {
+  static unsigned char const unknown[20] = {};
+  std::cout << "r" << r.revnum << " " << index.name(r.repo) << " " << index.name(r.ref)
+            << " :" << r.mark << " "
+            << (std::memcmp(r.sha, unknown, sizeof(unknown)) == 0 ? "-" : commit_index::hex(r.sha))
+            << "\n";
+  }
+
+// The revision number written as digits with an optional leading r,
+// or -1 if it isn't one
+long revision(std::string const& s)
+  {
+  std::string const digits = !s.empty() && s[0] == 'r' ? s.substr(1) : s;
+  if (digits.empty() || digits.find_first_not_of("0123456789") != std::string::npos)
+    return -1;
+  return std::strtol(digits.c_str(), nullptr, 10);
+  }
+
+// Print what query finds, returning false if it finds nothing
+bool answer(commit_index::reader const& index, std::string const& query)
+  {
+  std::size_t const colon = query.find(':');
+  std::size_t const at = query.rfind('@');
+  if (colon != std::string::npos && at != std::string::npos && colon < at)
+    {
+    long const revnum = revision(query.substr(at + 1));
+    if (revnum < 0)
+      throw std::runtime_error("Not a revision in " + query);
+    commit_index::record const* r = index.find(
+      query.substr(0, colon), query.substr(colon + 1, at - colon - 1), revnum);
+    if (r)
+      print(index, *r);
+    return r != nullptr;
+    }
+
+  std::vector<commit_index::record const*> found;
+  long const revnum = revision(query);
+  if (revnum >= 0 && query[0] == 'r')
+    found = index.made_in(revnum);
+  else if (query.size() >= 4 && query.size() <= 40
+           && query.find_first_not_of("0123456789abcdefABCDEF") == std::string::npos)
+    found = index.with_sha(query);
+  else
+    throw std::runtime_error(
+      "Expected rREVISION, REPO:REF@REVISION or at least 4 digits of a SHA-1, not " + query);
+  for (auto r : found)
+    print(index, *r);
+  return !found.empty();
+  }
+
+}
+
+int main(int argc, char **argv)
+  {
+  using find_commits::options;
+  namespace po = boost::program_options;
+  po::options_description program_options("Allowed options");
+  program_options.add_options()
+    ("help,h", "produce help message")
+    ("index", po::value(&options.index)->value_name("FILE")->required(),
+      "the index written by svn2git --commit-index")
+    ("query", po::value(&options.queries)->value_name("QUERY"),
+      "a revision, e.g. r12345, REPO:REF@REVISION, or at least 4 digits of a SHA-1")
+    ;
+  po::positional_options_description positional;
+  positional.add("index", 1).add("query", -1);
+
+  try
+    {
+    po::variables_map variables;
+    store(po::command_line_parser(argc, argv)
+      .options(program_options)
+      .positional(positional)
+      .run(), variables);
+    if (variables.count("help"))
+      {
+      std::cout << "Usage: " << argv[0] << " [options] INDEX QUERY...\n"
+                << program_options << std::endl;
+      return 0;
+      }
+    notify(variables);
+
+    commit_index::reader const index(options.index);
+    bool all_found = true;
+    for (auto const& q : options.queries)
+      {
+      if (!find_commits::answer(index, q))
+        {
+        std::cerr << "Nothing found for " << q << std::endl;
+        all_found = false;
+        }
+      }
+    return all_found ? 0 : 1;
+    }
+  catch (std::exception& error)
+    {
+    std::cerr << error.what() << std::endl;
+    return -1;
+    }
+  }
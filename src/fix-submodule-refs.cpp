@@ -15,6 +15,17 @@
 #include <iostream>
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/range/adaptor/map.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
 
 namespace fix_submodule {
 
@@ -24,109 +35,292 @@ struct Repository
   Repository* submodule_in_repo;
   std::string submodule_path;
   mark_sha_map mark2sha;
+  bool marks_read;
   };
 
 typedef std::map<std::string, Repository> RepoStore;
-typedef std::map<std::string, Repository const*> SubmoduleMap;
+typedef std::map<std::string, Repository*> SubmoduleMap;
 
 struct Options
   {
   std::string rules_file;
   std::string repo_name;
+  unsigned jobs;
+  bool incremental;
   };
 
 Options options;
 
 void read_marks_file(Repository& repo)
   {
-  std::string marks_path = marks_file_path(repo.name);
-  std::ifstream marks(marks_path.c_str());
-  if (marks.fail())
-    throw std::runtime_error("Couldn't open marks file: " + marks_path);
-  marks.exceptions( std::ifstream::badbit );
-
-  char colon, newline;
-  std::pair<unsigned long, std::string> mark_sha;
-  while (marks >> colon >> mark_sha.first >> mark_sha.second)
-    {
-    if (colon != ':')
-        throw std::runtime_error("Expected colon in marks file: " + marks_path);
-    marks.read(&newline, 1);
-    if (newline != '\n')
-        throw std::runtime_error("Expected newline in marks file: " + marks_path);
-
-    // Insert the mapping.  All kinds of efficiencies are possible
-    // here, but I was more interested in getting the logic right.
-    mark_sha_map::iterator where = find_sha_pos(repo.mark2sha, mark_sha.first);
-    
-    // Make sure we're not mapping the same mark twice.
-    if (where != repo.mark2sha.end() && where->first == mark_sha.first)
-        throw std::runtime_error("Duplicate mark mapping in " + marks_path);
-    
-    repo.mark2sha.insert(where, mark_sha);
-    }
+  repo.mark2sha.read_marks_file(marks_file_path(repo.name));
+  repo.marks_read = true;
   }
 
-void transform_import_stream(
-    Repository const& super_module,
-    SubmoduleMap const& submodules
-  )
+// Read the marks files of the given repositories on up to jobs
+// threads, rethrowing the first error encountered
+void read_marks_files(std::vector<Repository*> const& repos, unsigned jobs)
   {
-  std::istream& in = std::cin;
-  std::ostream& out = std::cout;
-    
-  char const submodule_prefix[] = "M 160000 ";
-  std::size_t const submodule_prefix_length = std::strlen(submodule_prefix);
-  std::size_t const sha_length = 40;
-
-  char const data_prefix[] = "data ";
-  std::size_t const data_prefix_length = std::strlen(data_prefix);
-
-  in.exceptions( std::istream::badbit );
-  out.exceptions( std::ostream::failbit | std::ostream::badbit );
-  
-  std::string line;
-  while (getline(in, line))
+  std::atomic<std::size_t> next(0);
+  std::exception_ptr error;
+  std::mutex error_mutex;
+
+  auto worker = [&]()
     {
-    if (boost::starts_with(line, submodule_prefix))
+    for (std::size_t i; (i = next++) < repos.size();)
       {
-      unsigned long mark = boost::lexical_cast<unsigned long>(
-          line.substr(submodule_prefix_length, sha_length));
-      std::string submodule_path = line.substr(submodule_prefix_length + sha_length + 1);
-
-      SubmoduleMap::const_iterator sub_repo = submodules.find(submodule_path);
-      assert(sub_repo != submodules.end());
-        
-      mark_sha_map::const_iterator const mark_sha = find_sha_pos(sub_repo->second->mark2sha, mark);
-      if (mark_sha->first != mark)
+      try
+        {
+        read_marks_file(*repos[i]);
+        }
+      catch (...)
         {
-        throw std::runtime_error(
-            "unmapped mark " + to_string(mark) + " in " + marks_file_path(sub_repo->second->name)
-          );
+        std::lock_guard<std::mutex> lock(error_mutex);
+        if (!error)
+          error = std::current_exception();
         }
-      out << submodule_prefix << mark_sha->second << " " << submodule_path << "\n";
       }
-    else
+    };
+
+  std::vector<std::thread> threads;
+  for (unsigned t = 1; t < std::min<std::size_t>(jobs, repos.size()); ++t)
+    threads.emplace_back(worker);
+  worker();
+  for (auto& t : threads)
+    t.join();
+  if (error)
+    std::rethrow_exception(error);
+  }
+
+// Copies the fast-export stream on stdin to stdout, replacing the
+// marks in the super-module's gitlinks with SHA-1s.  The stream is
+// read in large blocks and scanned for line ends with memchr, and the
+// payloads of data commands, which are most of its bytes, are passed
+// through unexamined: spliced from pipe to pipe where the kernel
+// allows, and otherwise copied a block at a time.  A submodule's marks
+// file not read beforehand is read at its first gitlink, so that an
+// incremental export reads only those of the submodules it changes.
+class import_stream_rewriter
+  {
+public:
+  explicit import_stream_rewriter(SubmoduleMap const& submodules)
+    : submodules(submodules), in_buf(block_size), in_begin(0), in_end(0),
+      eof(false), can_splice(true)
+    {
+    out_buf.reserve(block_size);
+    }
+
+  void run()
+    {
+    static char const submodule_prefix[] = "M 160000 ";
+    static char const data_prefix[] = "data ";
+
+    while (std::size_t const length = buffer_line())
+      {
+      char const* const line = in_buf.data() + in_begin;
+      in_begin += length;
+
+      if (starts_with(line, length, submodule_prefix) && is_mark(line, length))
+        write_gitlink(line, length);
+      else
+        write(line, length);
+
+      if (starts_with(line, length, data_prefix))
+        pass_through(data_size(line, length));
+      }
+    flush();
+    }
+
+private:
+  static std::size_t const block_size = 1 << 20;
+  static std::size_t const prefix_length = 9;  // of "M 160000 "
+  static std::size_t const sha_length = mark_sha_map::sha_length;
+
+  template <std::size_t N>
+  static bool starts_with(char const* line, std::size_t length, char const (&prefix)[N])
+    {
+    return length >= N - 1 && std::memcmp(line, prefix, N - 1) == 0;
+    }
+
+  // True iff the gitlink holds a zero-padded mark.  Gitlinks written
+  // by svn2git --resolve-gitlinks already hold a SHA-1, and are left
+  // alone.
+  static bool is_mark(char const* line, std::size_t length)
+    {
+    if (length < prefix_length + sha_length + 1)
+      return false;
+    for (char const* p = line + prefix_length; p != line + prefix_length + sha_length; ++p)
       {
-      out << line << "\n";
+      if (*p < '0' || *p > '9')
+        return false;
       }
+    return true;
+    }
 
-    if (boost::starts_with(line, data_prefix))
+  static std::size_t data_size(char const* line, std::size_t length)
+    {
+    std::string const digits(line + 5, line + length - (line[length - 1] == '\n'));
+    return boost::lexical_cast<std::size_t>(digits);
+    }
+
+  void write_gitlink(char const* line, std::size_t length)
+    {
+    unsigned long mark = 0;
+    for (char const* p = line + prefix_length; p != line + prefix_length + sha_length; ++p)
+      mark = mark * 10 + (*p - '0');
+
+    char const* const path_begin = line + prefix_length + sha_length + 1;
+    std::string const submodule_path(
+      path_begin, line + length - (line[length - 1] == '\n'));
+
+    SubmoduleMap::const_iterator const sub_repo = submodules.find(submodule_path);
+    if (sub_repo == submodules.end())
+      throw std::runtime_error("gitlink to unknown submodule path " + submodule_path);
+
+    Repository& sub = *sub_repo->second;
+    if (!sub.marks_read)
+      read_marks_file(sub);
+    char sha[sha_length];
+    if (!sub.mark2sha.find(mark, sha))
       {
-      std::size_t length = boost::lexical_cast<std::size_t>(
-          line.substr(data_prefix_length));
-        
-      while (length > 0)
+      throw std::runtime_error(
+          "unmapped mark " + to_string(mark) + " in " + marks_file_path(sub.name)
+        );
+      }
+    write(line, prefix_length);
+    write(sha, sha_length);
+    write(path_begin - 1, line + length - (path_begin - 1));
+    }
+
+  // Make sure the next line, or what remains of the input if it has
+  // no line end, is buffered at in_begin.  Return its length,
+  // including the line end, or zero at the end of the input.
+  std::size_t buffer_line()
+    {
+    std::size_t scanned = 0;
+    for (;;)
+      {
+      char const* const begin = in_buf.data() + in_begin;
+      if (void const* lf = std::memchr(begin + scanned, '\n', in_end - in_begin - scanned))
+        return static_cast<char const*>(lf) - begin + 1;
+      if (eof)
+        return in_end - in_begin;
+
+      scanned = in_end - in_begin;
+      std::memmove(in_buf.data(), begin, scanned);
+      in_begin = 0;
+      in_end = scanned;
+      if (in_end == in_buf.size())
+        in_buf.resize(in_buf.size() * 2);
+      fill();
+      }
+    }
+
+  // Read what is available into the free end of the input buffer
+  void fill()
+    {
+    std::size_t const n = read_some(in_buf.data() + in_end, in_buf.size() - in_end);
+    if (n == 0)
+      eof = true;
+    in_end += n;
+    }
+
+  // Copy n bytes of input to the output unexamined
+  void pass_through(std::size_t n)
+    {
+    std::size_t const buffered = std::min(n, in_end - in_begin);
+    write(in_buf.data() + in_begin, buffered);
+    in_begin += buffered;
+    n -= buffered;
+    if (n == 0)
+      return;
+
+    flush();
+    in_begin = in_end = 0;
+#ifdef __linux__
+    while (can_splice && n > 0)
+      {
+      ssize_t const spliced = ::splice(0, 0, 1, 0, n, SPLICE_F_MOVE | SPLICE_F_MORE);
+      if (spliced < 0 && errno == EINTR)
+        continue;
+      if (spliced < 0 && errno == EINVAL)
         {
-        char buf[2048];
-        std::size_t num_to_read = std::min(length, sizeof(buf));
-        in.read(buf, num_to_read);
-        out.write(buf, num_to_read);
-        length -= num_to_read;
+        // Neither end is a pipe, so copy instead
+        can_splice = false;
+        break;
         }
+      if (spliced < 0)
+        throw std::runtime_error(std::string("splice: ") + std::strerror(errno));
+      if (spliced == 0)
+        truncated();
+      n -= spliced;
+      }
+#endif
+    while (n > 0)
+      {
+      std::size_t const got = read_some(in_buf.data(), std::min(n, in_buf.size()));
+      if (got == 0)
+        truncated();
+      write_fd(in_buf.data(), got);
+      n -= got;
       }
     }
-  }
+
+  void write(char const* data, std::size_t n)
+    {
+    if (out_buf.size() + n > block_size)
+      {
+      flush();
+      if (n >= block_size)
+        return write_fd(data, n);
+      }
+    out_buf.insert(out_buf.end(), data, data + n);
+    }
+
+  void flush()
+    {
+    write_fd(out_buf.data(), out_buf.size());
+    out_buf.clear();
+    }
+
+  static std::size_t read_some(char* data, std::size_t n)
+    {
+    for (;;)
+      {
+      ssize_t const got = ::read(0, data, n);
+      if (got >= 0)
+        return got;
+      if (errno != EINTR)
+        throw std::runtime_error(std::string("reading input: ") + std::strerror(errno));
+      }
+    }
+
+  static void write_fd(char const* data, std::size_t n)
+    {
+    while (n > 0)
+      {
+      ssize_t const written = ::write(1, data, n);
+      if (written < 0 && errno == EINTR)
+        continue;
+      if (written < 0)
+        throw std::runtime_error(std::string("writing output: ") + std::strerror(errno));
+      data += written;
+      n -= written;
+      }
+    }
+
+  static void truncated()
+    {
+    throw std::runtime_error("input ends within a data command");
+    }
+
+  SubmoduleMap const& submodules;
+  std::vector<char> in_buf;
+  std::size_t in_begin, in_end;   // the unconsumed input in in_buf
+  bool eof;
+  bool can_splice;
+  std::vector<char> out_buf;
+  };
 
 void run()
   {
@@ -153,16 +347,20 @@ void run()
       throw std::runtime_error("repository " + options.repo_name + " not found in ruleset");
 
   SubmoduleMap submodules;
-  // Read all relevant marks files
+  std::vector<Repository*> marked;
   BOOST_FOREACH(Repository& repo, repo_store | boost::adaptors::map_values)
     {
     if (repo.submodule_in_repo == &p->second)
       {
-        read_marks_file(repo);
+        marked.push_back(&repo);
         submodules[repo.submodule_path] = &repo;
       }
     }
-  transform_import_stream(p->second, submodules);
+  // Read all relevant marks files, unless only those of the
+  // submodules the stream changes will be needed
+  if (!options.incremental)
+    read_marks_files(marked, options.jobs);
+  import_stream_rewriter(submodules).run();
   }
 } // namespace fix_submodule
 
@@ -177,12 +375,18 @@ int main(int argc, char **argv)
       "file with the conversion rules")
     ("repo-name", po::value(&options.repo_name)->value_name("IDENTIFIER")->required(),
       "name of the repository to rewrite")
+    ("jobs,j", po::value(&options.jobs)->value_name("NUMBER")->default_value(1),
+      "read the submodules' marks files on NUMBER threads")
+    ("incremental",
+      "the input only holds the commits made since the last run, so read each submodule's "
+      "marks file at its first gitlink instead of all of them up front")
     ;
   po::variables_map variables;
   store(po::command_line_parser(argc, argv)
     .options(program_options)
     .run(), variables);
   notify(variables);
+  options.incremental = variables.count("incremental");
   if (variables.count("help"))
     {
     std::cout << program_options << std::endl;
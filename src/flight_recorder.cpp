@@ -0,0 +1,178 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#include "flight_recorder.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+
+namespace flight_recorder
+{
+    namespace
+    {
+        std::size_t const ring_size = 8192;    // a power of two
+        std::size_t const text_size = 112;
+
+        struct event
+        {
+            std::uint64_t sequence;     // one more than its position, or 0
+            std::uint64_t microseconds; // since the program started
+            std::uint64_t number;
+            char const* name;
+            unsigned thread;
+            char text[text_size];       // NUL-terminated
+        };
+
+        event ring[ring_size];
+        std::atomic<std::uint64_t> recorded(0);
+        std::atomic<unsigned> threads(0);
+
+        auto const started = std::chrono::steady_clock::now();
+
+        // Where dump writes, fixed by install before any signal can
+        // need it
+        char dump_file[4096];
+
+        unsigned this_thread()
+        {
+            static thread_local unsigned const n = threads++;
+            return n;
+        }
+
+        event& begin(char const* name, std::uint64_t number)
+        {
+            std::uint64_t const sequence = ++recorded;
+            event& e = ring[(sequence - 1) & (ring_size - 1)];
+            e.sequence = sequence;
+            e.microseconds = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - started).count();
+            e.number = number;
+            e.name = name;
+            e.thread = this_thread();
+            return e;
+        }
+
+        // Copy what fits of s to dst, which has room for size more
+        // characters and a NUL, returning how many were copied
+        std::size_t copy(char* dst, char const* s, std::size_t size)
+        {
+            std::size_t n = 0;
+            for (; n < size && s[n] && s[n] != '\n'; ++n)
+                dst[n] = s[n];
+            dst[n] = '\0';
+            return n;
+        }
+
+        // The signal-safe means of writing a line of the dump
+        struct line
+        {
+            line() : size(0) {}
+            line& operator<<(char const* s)
+            {
+                while (*s && size < sizeof(buffer))
+                    buffer[size++] = *s++;
+                return *this;
+            }
+            line& operator<<(std::uint64_t n)
+            {
+                char digits[20];
+                std::size_t count = 0;
+                do
+                    digits[count++] = char('0' + n % 10);
+                while ((n /= 10) != 0);
+                while (count > 0 && size < sizeof(buffer))
+                    buffer[size++] = digits[--count];
+                return *this;
+            }
+            void write_to(int fd)
+            {
+                if (size < sizeof(buffer))
+                    buffer[size++] = '\n';
+                for (std::size_t done = 0; done < size;)
+                {
+                    ssize_t const n = ::write(fd, buffer + done, size - done);
+                    if (n <= 0)
+                        break;
+                    done += std::size_t(n);
+                }
+                size = 0;
+            }
+            char buffer[256];
+            std::size_t size;
+        };
+
+        extern "C" void dump_on_signal(int sig)
+        {
+            char const* reason = sig == SIGSEGV ? "SIGSEGV" : sig == SIGBUS ? "SIGBUS"
+                : sig == SIGFPE ? "SIGFPE" : sig == SIGILL ? "SIGILL"
+                : sig == SIGABRT ? "SIGABRT, e.g. a failed assertion"
+                : sig == SIGTERM ? "SIGTERM" : sig == SIGINT ? "SIGINT" : "a signal";
+            dump(reason);
+            // The handler was reset, so this takes the default action
+            ::raise(sig);
+        }
+    }
+
+    void note(char const* event_name, char const* text, std::uint64_t number)
+    {
+        copy(begin(event_name, number).text, text, text_size - 1);
+    }
+
+    void note(char const* event_name, char const* text1, char const* text2, std::uint64_t number)
+    {
+        event& e = begin(event_name, number);
+        std::size_t n = copy(e.text, text1, text_size - 1);
+        if (n + 1 < text_size - 1)
+        {
+            e.text[n++] = ' ';
+            copy(e.text + n, text2, text_size - 1 - n);
+        }
+    }
+
+    void install(std::string const& filename)
+    {
+        copy(dump_file, filename.c_str(), sizeof(dump_file) - 1);
+        if (filename.empty())
+            return;
+        struct sigaction action = {};
+        sigemptyset(&action.sa_mask);
+        action.sa_handler = dump_on_signal;
+        action.sa_flags = SA_RESETHAND | SA_NODEFER;
+        for (int sig : { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT, SIGTERM, SIGINT })
+            sigaction(sig, &action, nullptr);
+    }
+
+    void dump(char const* reason)
+    {
+        if (dump_file[0] == '\0')
+            return;
+        int const fd = ::open(dump_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            return;
+        std::uint64_t const last = recorded.load();
+        std::uint64_t const first = last > ring_size ? last - ring_size + 1 : 1;
+        line l;
+        (l << "svn2git stopped by " << reason << "; the last " << (last - first + 1)
+         << " of " << last << " events follow, oldest first").write_to(fd);
+        for (std::uint64_t s = first; s <= last; ++s)
+        {
+            event const& e = ring[(s - 1) & (ring_size - 1)];
+            // Overwritten meanwhile, by a thread still running
+            if (e.sequence != s || !e.name)
+                continue;
+            l << e.microseconds / 1000000 << "." ;
+            std::uint64_t const fraction = e.microseconds % 1000000;
+            for (std::uint64_t d = 100000; d > 1 && fraction < d; d /= 10)
+                l << "0";
+            (l << fraction << " [" << std::uint64_t(e.thread) << "] " << e.name << " "
+             << e.number << " " << e.text).write_to(fd);
+        }
+        ::close(fd);
+    }
+}
@@ -0,0 +1,47 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef FLIGHT_RECORDER_DWA20131202_HPP
+# define FLIGHT_RECORDER_DWA20131202_HPP
+
+# include <cstdint>
+# include <string>
+
+// The last few thousand things a conversion did, kept in a ring of
+// fixed size whatever the options, so that a run that dies hours in,
+// on an assertion, an exception or a fatal signal, leaves the file
+// named by --flight-recorder telling what led up to it, without the
+// cost of a rerun with -X.  Recording an event copies a few words and
+// at most a line's worth of text into the ring, from any thread.
+//
+// Each event is a name, which must be a string literal, one or two
+// strings, of which what fits is kept, and a number, e.g. the
+// revision.  The oldest events are written first.
+namespace flight_recorder
+{
+    void note(char const* event, char const* text, std::uint64_t number = 0);
+    void note(char const* event, char const* text1, char const* text2, std::uint64_t number = 0);
+
+    inline void note(char const* event, std::string const& text, std::uint64_t number = 0)
+    {
+        note(event, text.c_str(), number);
+    }
+
+    inline void note(
+        char const* event, std::string const& text1, std::string const& text2,
+        std::uint64_t number = 0)
+    {
+        note(event, text1.c_str(), text2.c_str(), number);
+    }
+
+    // Write the events to filename on a fatal signal or when dump is
+    // called.  Until this is called, events are recorded but never
+    // written.
+    void install(std::string const& filename);
+
+    // Write the events, after a line giving the reason, to the file
+    // given to install, if any.  Safe to call from a signal handler.
+    void dump(char const* reason);
+}
+
+#endif // FLIGHT_RECORDER_DWA20131202_HPP
@@ -0,0 +1,188 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#include "fsfs_readahead.hpp"
+#include "io_ring.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace
+{
+    // The first line of a small file under db/, if any
+    bool read_first_line(std::string const& file, std::string& line)
+    {
+        std::ifstream in(file.c_str());
+        return bool(std::getline(in, line));
+    }
+}
+
+fsfs_readahead::fsfs_readahead(
+    std::string const& repo_path, int distance, int drop_behind, io_ring* ring)
+    : db(repo_path + "/db/"), distance(distance), drop_behind(drop_behind),
+      format(0), shard_size(0), min_unpacked_rev(0),
+      current(-1), advised_through(-1), dropped_through(-1), ring(ring), manifest_shard(-1)
+{
+    std::string line;
+    if (!read_first_line(db + "fs-type", line) || line != "fsfs")
+        return;
+
+    // The format number comes first, then options such as
+    // "layout sharded 1000"; formats before 3 are always linear
+    std::ifstream format_file((db + "format").c_str());
+    if (!(format_file >> format) || format <= 0)
+    {
+        format = 0;
+        return;
+    }
+    while (std::getline(format_file, line))
+    {
+        std::istringstream words(line);
+        std::string option, layout;
+        if (words >> option >> layout && option == "layout" && layout == "sharded")
+            words >> shard_size;
+    }
+
+    if (shard_size > 0 && read_first_line(db + "min-unpacked-rev", line))
+        min_unpacked_rev = std::atoi(line.c_str());
+}
+
+std::vector<std::uint64_t> const& fsfs_readahead::manifest(int shard) const
+{
+    if (shard == manifest_shard)
+        return manifest_offsets;
+    manifest_shard = shard;
+    manifest_offsets.clear();
+
+    // Until format 7, the manifest lists the offset of each revision
+    // in the pack file, one per line.  Logically addressed packs have
+    // none, and are advised whole.
+    std::ifstream in((db + "revs/" + std::to_string(shard) + ".pack/manifest").c_str());
+    std::uint64_t offset;
+    while (in >> offset)
+        manifest_offsets.push_back(offset);
+    if (!in.eof() || manifest_offsets.size() != std::size_t(shard_size))
+        manifest_offsets.clear();
+    return manifest_offsets;
+}
+
+std::vector<fsfs_readahead::extent> fsfs_readahead::extents(int revnum) const
+{
+    std::vector<extent> result;
+    if (!enabled())
+        return result;
+
+    std::string const rev = std::to_string(revnum);
+    if (shard_size == 0)
+    {
+        result.push_back(extent{ db + "revs/" + rev, 0, 0 });
+        result.push_back(extent{ db + "revprops/" + rev, 0, 0 });
+        return result;
+    }
+
+    int const shard = revnum / shard_size;
+    std::string const dir = std::to_string(shard);
+    if (revnum >= min_unpacked_rev)
+    {
+        result.push_back(extent{ db + "revs/" + dir + "/" + rev, 0, 0 });
+    }
+    else
+    {
+        std::string const pack = db + "revs/" + dir + ".pack/pack";
+        std::vector<std::uint64_t> const& offsets = manifest(shard);
+        if (offsets.empty())
+        {
+            result.push_back(extent{ pack, 0, 0 });
+        }
+        else
+        {
+            std::size_t const i = revnum % shard_size;
+            std::uint64_t const end = i + 1 < offsets.size() ? offsets[i + 1] : offsets[i];
+            result.push_back(extent{ pack, offsets[i], end - offsets[i] });
+        }
+    }
+
+    // Packed revprops (format 6 on) are small and left alone, except
+    // that those of revision 0 are never packed
+    if (revnum >= min_unpacked_rev || format < 6 || revnum == 0)
+        result.push_back(extent{ db + "revprops/" + dir + "/" + rev, 0, 0 });
+    return result;
+}
+
+void fsfs_readahead::advise(int revnum, int advice, bool starting)
+{
+    for (extent const& e : extents(revnum))
+    {
+        // A pack file advised whole is advised once for its shard:
+        // ahead when its first revision comes up, or when starting in
+        // the middle of it, and dropped once its last is behind
+        bool const whole_pack = e.offset == 0 && e.length == 0
+            && e.file.size() > 5 && e.file.compare(e.file.size() - 5, 5, "/pack") == 0;
+        if (whole_pack && (advice == POSIX_FADV_WILLNEED
+                           ? !starting && revnum % shard_size != 0
+                           : revnum % shard_size != shard_size - 1))
+            continue;
+
+        int const fd = ::open(e.file.c_str(), O_RDONLY);
+        if (fd < 0)
+            continue;           // e.g. not yet committed
+        if (ring)
+        {
+            pending_advice const p = { fd, e.offset, e.length, advice };
+            ring->fadvise(fd, e.offset, e.length, advice, pending.size());
+            pending.push_back(p);
+            continue;
+        }
+        ::posix_fadvise(fd, off_t(e.offset), off_t(e.length), advice);
+        ::close(fd);
+    }
+}
+
+// Kernels before 5.6 don't know the operation, and reject it, so the
+// advice is then given directly
+void fsfs_readahead::complete_advice()
+{
+    if (pending.empty())
+        return;
+    for (auto const& r : ring->complete())
+    {
+        if (r.first < pending.size() && r.second == -EINVAL)
+        {
+            pending_advice const& p = pending[r.first];
+            ::posix_fadvise(p.fd, off_t(p.offset), off_t(p.length), p.advice);
+        }
+    }
+    for (auto const& p : pending)
+        ::close(p.fd);
+    pending.clear();
+}
+
+void fsfs_readahead::advance(int revnum)
+{
+    if (!enabled() || revnum <= current)
+        return;
+    bool const starting = current < 0;
+    current = revnum;
+
+    int const ahead_from = std::max(advised_through + 1, revnum);
+    for (int r = ahead_from; r <= revnum + distance; ++r)
+        advise(r, POSIX_FADV_WILLNEED, starting && r == ahead_from);
+    advised_through = std::max(advised_through, revnum + distance);
+
+    if (drop_behind > 0)
+    {
+        // Whatever was read before we started is left to the kernel
+        if (starting)
+            dropped_through = revnum - drop_behind - 1;
+        for (int r = std::max(dropped_through + 1, 0); r <= revnum - drop_behind; ++r)
+            advise(r, POSIX_FADV_DONTNEED, false);
+        dropped_through = std::max(dropped_through, revnum - drop_behind);
+    }
+    if (ring)
+        complete_advice();
+}
@@ -0,0 +1,91 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef FSFS_READAHEAD_DWA20131109_HPP
+# define FSFS_READAHEAD_DWA20131109_HPP
+
+# include <cstdint>
+# include <string>
+# include <vector>
+
+class io_ring;
+
+// Warms the page cache with the files of an FSFS repository ahead of
+// the revision being converted, so that SVN finds them in memory
+// without the whole repository being copied to a RAM disk first.
+// Each revision's rev file (or its part of a packed shard's pack
+// file) and its revprops file are advised with POSIX_FADV_WILLNEED
+// up to distance revisions ahead, and optionally those drop_behind or
+// more revisions back with POSIX_FADV_DONTNEED.  Note that a rev file
+// holds the node-revisions of everything its revision changed, which
+// later revisions keep reading until it changes again, so dropping
+// pays only when memory is short.  Given an io_ring, the advice on
+// all the files of a revision is passed in one system call.
+class fsfs_readahead
+{
+ public:
+    // A range of bytes in a file; a length of zero means through
+    // the end of the file
+    struct extent
+    {
+        std::string file;
+        std::uint64_t offset;
+        std::uint64_t length;
+    };
+
+    // Read ahead in the repository at repo_path.  A drop_behind of
+    // zero never drops anything.  If the repository isn't FSFS,
+    // enabled() is false and nothing is done.  The ring, if any, must
+    // outlive this.
+    fsfs_readahead(std::string const& repo_path, int distance, int drop_behind,
+                   io_ring* ring = nullptr);
+
+    bool enabled() const { return format > 0; }
+
+    // Note that revnum is about to be converted.  Revisions earlier
+    // than the latest noted, e.g. the sources of copies, are ignored.
+    void advance(int revnum);
+
+    // Where revnum is kept: its rev data and, unless packed, its
+    // revprops
+    std::vector<extent> extents(int revnum) const;
+
+ private:
+    // Pass advice on revnum's extents to the kernel; starting is true
+    // for the first revision advised
+    void advise(int revnum, int advice, bool starting);
+
+    // Wait for the advice queued on the ring, and close its files
+    void complete_advice();
+
+    // The offsets of the revisions in the pack file of shard, read
+    // from its manifest, or empty if the manifest can't be read
+    std::vector<std::uint64_t> const& manifest(int shard) const;
+
+    std::string const db;       // the repository's db/ directory
+    int const distance;
+    int const drop_behind;
+    int format;                 // of the filesystem; 0 if not FSFS
+    int shard_size;             // 0 for a linear layout
+    int min_unpacked_rev;       // revisions below are packed
+    int current;                // the latest revision noted; -1 at first
+    int advised_through;        // with WILLNEED
+    int dropped_through;        // with DONTNEED
+
+    // Advice queued on the ring, kept open until it completes
+    struct pending_advice
+    {
+        int fd;
+        std::uint64_t offset;
+        std::uint64_t length;
+        int advice;
+    };
+    io_ring* const ring;
+    std::vector<pending_advice> pending;
+
+    // The manifest of the last packed shard asked about
+    mutable int manifest_shard;
+    mutable std::vector<std::uint64_t> manifest_offsets;
+};
+
+#endif // FSFS_READAHEAD_DWA20131109_HPP
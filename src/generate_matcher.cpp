@@ -0,0 +1,53 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Compiles the SVN path matching of a ruleset into C++ source
+// defining generated_matcher (see compiled_matcher.hpp), to be built
+// into svn2git with COMPILED_MATCHER_RULES.
+//
+//   generate_matcher RULES OUTPUT
+
+#include "ruleset.hpp"
+#include "options.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+int main(int argc, char** argv)
+{
+    if (argc != 3)
+    {
+        std::cerr << "usage: " << argv[0] << " RULES OUTPUT" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        options.rules_file = argv[1];
+        Ruleset ruleset(options.rules_file);
+
+        // Written under another name first, so an interrupted run
+        // doesn't leave a truncated source that looks up to date
+        std::string const output = argv[2];
+        std::string const tmp = output + ".tmp";
+        {
+            std::ofstream out(tmp.c_str(), std::ios::trunc);
+            ruleset.matcher().write_compiled_matcher(out, "generated_matcher");
+            out.close();
+            if (!out)
+                throw std::runtime_error("Couldn't write " + tmp);
+        }
+        if (std::rename(tmp.c_str(), output.c_str()) != 0)
+            throw std::runtime_error("Couldn't rename " + tmp + " to " + output);
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << argv[0] << ": " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
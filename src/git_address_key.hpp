@@ -0,0 +1,124 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef GIT_ADDRESS_KEY_DWA20131122_HPP
+# define GIT_ADDRESS_KEY_DWA20131122_HPP
+
+# include <boost/iterator/iterator_facade.hpp>
+# include <boost/range/iterator_range.hpp>
+# include <cstddef>
+# include <string>
+
+// The Git address of a path in a ref, "<repository>:<ref>:<path>",
+// as patrie's reverse trie is keyed, given as the strings it's made
+// of rather than assembled into one.  It is a range of the address's
+// characters, so lookups in the trie take it as they would a string,
+// without allocating.  A subpath may be given too, for the address of
+// path/subpath.  The strings must outlive it, and its iterators
+// refer to the object itself.
+class git_address_key
+{
+    typedef boost::iterator_range<char const*> part;
+
+ public:
+    class iterator
+        : public boost::iterator_facade<
+              iterator, char const, boost::bidirectional_traversal_tag>
+    {
+     public:
+        iterator() : parts(nullptr), size(0), i(0), p(nullptr) {}
+
+     private:
+        friend class git_address_key;
+        friend class boost::iterator_core_access;
+
+        // At the first character of parts[i], or beyond, the end
+        iterator(part const* parts, std::size_t size, std::size_t i)
+            : parts(parts), size(size), i(i), p(i < size ? parts[i].begin() : nullptr)
+        {
+            skip_empty();
+        }
+
+        void skip_empty()
+        {
+            while (i < size && p == parts[i].end())
+            {
+                if (++i < size)
+                    p = parts[i].begin();
+                else
+                    p = nullptr;
+            }
+        }
+
+        char const& dereference() const { return *p; }
+
+        bool equal(iterator const& other) const
+        {
+            return i == other.i && p == other.p;
+        }
+
+        void increment()
+        {
+            ++p;
+            skip_empty();
+        }
+
+        void decrement()
+        {
+            while (i == size || p == parts[i].begin())
+            {
+                --i;
+                p = parts[i].end();
+            }
+            --p;
+        }
+
+        part const* parts;
+        std::size_t size;
+        std::size_t i;
+        char const* p;
+    };
+    typedef iterator const_iterator;
+
+    git_address_key(
+        std::string const& repo_name, std::string const& ref_name, std::string const& git_path)
+        : size(0)
+    {
+        add(repo_name);
+        add(":");
+        add(ref_name);
+        add(":");
+        add(git_path);
+    }
+
+    git_address_key(
+        std::string const& repo_name, std::string const& ref_name, std::string const& git_path,
+        std::string const& subpath)
+        : git_address_key(repo_name, ref_name, git_path)
+    {
+        if (!git_path.empty() && !subpath.empty())
+            add("/");
+        add(subpath);
+    }
+
+    iterator begin() const { return iterator(parts, size, 0); }
+    iterator end() const { return iterator(parts, size, size); }
+
+    std::string str() const { return std::string(begin(), end()); }
+
+ private:
+    void add(std::string const& s)
+    {
+        parts[size++] = part(s.data(), s.data() + s.size());
+    }
+
+    void add(char const (&separator)[2])
+    {
+        parts[size++] = part(separator, separator + 1);
+    }
+
+    part parts[7];
+    std::size_t size;
+};
+
+#endif // GIT_ADDRESS_KEY_DWA20131122_HPP
@@ -0,0 +1,124 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef GIT_DELTA_DWA20131105_HPP
+# define GIT_DELTA_DWA20131105_HPP
+
+# include <algorithm>
+# include <cstdint>
+# include <string>
+
+// Encodes a Git delta, which describes an object as a sequence of
+// copies from its base object and inserted bytes, e.g. as read from
+// an SVN text delta.  Adjacent copies and inserts are merged.
+struct git_delta
+{
+    git_delta(std::uint64_t base_size, std::uint64_t size)
+        : copy_offset(0), copy_size(0), length(0), representable(true)
+    {
+        put_size(base_size);
+        put_size(size);
+    }
+
+    // Copy size bytes from offset in the base
+    void copy(std::uint64_t offset, std::uint64_t size)
+    {
+        if (size == 0)
+            return;
+        flush_insert();
+        if (copy_size > 0 && copy_offset + copy_size == offset)
+        {
+            copy_size += size;
+        }
+        else
+        {
+            flush_copy();
+            copy_offset = offset;
+            copy_size = size;
+        }
+        length += size;
+    }
+
+    void insert(char const* data, std::size_t size)
+    {
+        flush_copy();
+        literal.append(data, size);
+        length += size;
+    }
+
+    // The number of bytes of the object described so far
+    std::uint64_t size() const { return length; }
+
+    // The encoded delta, or the empty string if it can't be encoded,
+    // because it copies from beyond the 4GB Git deltas can address
+    std::string const& str()
+    {
+        flush_copy();
+        flush_insert();
+        if (!representable)
+            encoded.clear();
+        return encoded;
+    }
+
+ private:
+    void put_size(std::uint64_t n)
+    {
+        for (; n >= 0x80; n >>= 7)
+            encoded += char(0x80 | (n & 0x7f));
+        encoded += char(n);
+    }
+
+    void flush_copy()
+    {
+        // Copies of more than 64KB can't be encoded so compactly
+        std::uint64_t const max_copy = 0x10000;
+        for (; copy_size > 0; copy_offset += max_copy)
+        {
+            std::uint64_t const n = copy_size < max_copy ? copy_size : max_copy;
+            copy_size -= n;
+            if (copy_offset + n > 0xffffffffull + 1)
+                representable = false;
+
+            // An opcode whose bits say which bytes of the offset and
+            // size follow; the rest are zero, as is a size of 64KB
+            std::size_t const op = encoded.size();
+            encoded += char(0x80);
+            for (int i = 0; i < 4; ++i)
+            {
+                if (unsigned char const byte = (unsigned char)(copy_offset >> (8 * i)))
+                {
+                    encoded[op] = char(encoded[op] | (1 << i));
+                    encoded += char(byte);
+                }
+            }
+            for (int i = 0; i < 2; ++i)
+            {
+                if (unsigned char const byte = (unsigned char)((n & 0xffff) >> (8 * i)))
+                {
+                    encoded[op] = char(encoded[op] | (0x10 << i));
+                    encoded += char(byte);
+                }
+            }
+        }
+    }
+
+    void flush_insert()
+    {
+        for (std::size_t pos = 0; pos < literal.size(); pos += 0x7f)
+        {
+            std::size_t const n = std::min<std::size_t>(literal.size() - pos, 0x7f);
+            encoded += char(n);
+            encoded.append(literal, pos, n);
+        }
+        literal.clear();
+    }
+
+    std::string encoded;
+    std::string literal;        // bytes yet to be inserted
+    std::uint64_t copy_offset;  // the copy yet to be encoded
+    std::uint64_t copy_size;
+    std::uint64_t length;
+    bool representable;
+};
+
+#endif // GIT_DELTA_DWA20131105_HPP
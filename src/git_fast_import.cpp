@@ -3,78 +3,1090 @@
 // file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
 
 #include "git_fast_import.hpp"
+#include "flight_recorder.hpp"
 #include "git_executable.hpp"
+#include "io_ring.hpp"
 #include "path.hpp"
 #include "options.hpp"
 #include "marks_file_name.hpp"
+#include "memory_report.hpp"
+#include "mock_fast_import.hpp"
+#include "probes.hpp"
+#include "profile.hpp"
 
 #include <boost/iostreams/device/file_descriptor.hpp>
+#include <boost/filesystem.hpp>
+#include <algorithm>
+#include <chrono>
 #include <numeric>
+#include <fstream>
+#include <sstream>
+#include <cassert>
+#include <stdexcept>
+#include <cerrno>
+#include <cstdio>
+#include <exception>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <zlib.h>
 
 using namespace boost::process::initializers;
 using namespace boost::process;
 namespace iostreams = boost::iostreams;
 
-git_fast_import::git_fast_import(std::string const& git_dir)
+namespace
+{
+    // Size of the command buffer
+    std::size_t const buffer_size = 1 << 20;
+
+    // Writes at least this large go straight to the pipe, together
+    // with anything buffered, in a single writev.
+    std::size_t const direct_write_size = 64 << 10;
+
+    // With --pack-threads, commands are held back while the pack they
+    // may refer to is written, until fast-import has to answer one,
+    // the pack reaches the first of these sizes, or the commands held
+    // reach the second
+    std::uint64_t const max_pack_size = 256 << 20;
+    std::size_t const max_held = 64 << 20;
+
+    // With --fast-ingest, the longest delta chain fast-import makes,
+    // instead of its default of 50
+    int const fast_ingest_depth = 10;
+
+    // Compresses the blobs packed for every repository
+    deflate_pool& shared_deflate_pool()
+    {
+        static deflate_pool pool(options.pack_threads, options.fast_ingest ? 0 : -1);
+        return pool;
+    }
+
+    // With --io-uring, the ring through which the queues of all the
+    // fast-imports are drained at once; null otherwise
+    io_ring* shared_ring()
+    {
+        static std::unique_ptr<io_ring> const ring = []
+        {
+            std::unique_ptr<io_ring> r;
+            if (options.io_uring)
+            {
+                r = io_ring::open(256);
+                if (!r)
+                    Log::warn() << "--io-uring ignored: io_uring is unavailable" << std::endl;
+            }
+            return r;
+        }();
+        return ring.get();
+    }
+
+    // Write as much of the n buffers at v as the non-blocking fd
+    // takes, returning the number of bytes written
+    std::size_t write_some(int fd, iovec* v, int n)
+    {
+        std::size_t total = 0;
+        while (n > 0)
+        {
+            ssize_t written = ::writev(fd, v, n);
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    break;
+                throw std::runtime_error(
+                    std::string("writing to git fast-import: ") + std::strerror(errno));
+            }
+            total += written;
+            for (; n > 0 && std::size_t(written) >= v->iov_len; ++v, --n)
+                written -= v->iov_len;
+            if (n > 0)
+            {
+                v->iov_base = static_cast<char*>(v->iov_base) + written;
+                v->iov_len -= written;
+            }
+        }
+        return total;
+    }
+
+    // The names of the packs in git_dir, sorted
+    std::vector<std::string> pack_files(std::string const& git_dir)
+    {
+        std::vector<std::string> packs;
+        boost::system::error_code ec;
+        for (boost::filesystem::directory_iterator p(git_dir + "/objects/pack", ec), end;
+             !ec && p != end; p.increment(ec))
+        {
+            if (p->path().extension() == ".pack")
+                packs.push_back(p->path().filename().string());
+        }
+        std::sort(packs.begin(), packs.end());
+        return packs;
+    }
+}
+
+std::vector<git_fast_import*> git_fast_import::queued_instances;
+std::recursive_mutex git_fast_import::instances_mutex;
+std::vector<git_fast_import*> git_fast_import::unacknowledged_instances;
+std::vector<git_fast_import*> git_fast_import::hosted_instances;
+
+namespace
+{
+    // The progress command request_ack sends, as fast-import echoes it
+    char const ack_echo[] = "progress svn2git-ack r";
+}
+
+// With stderr_fd other than -1, what fast-import prints to its
+// standard error goes there.  With --mock-fast-import, no process is
+// started; its ends of the pipes go to the emulator instead, and with
+// --fast-import-worker, to the thread relaying them to the worker.
+git_fast_import::process_type::process_type(
+    std::string const& git_dir, std::string const& marks_file, bool import_marks,
+    int active_branches, int stderr_fd)
     : inp(boost::process::create_pipe()),
       outp(boost::process::create_pipe()),
-      process(
-          options.dry_run ? boost::optional<boost::process::child>()
-          : boost::process::execute(
+      child([&] {
+          if (options.mock_fast_import || !fast_import_worker(git_dir).empty())
+              return boost::process::child(0);
+          std::vector<std::string> const args = arg_vector(marks_file, import_marks, active_branches);
+          iostreams::file_descriptor_sink out(inp.sink, iostreams::close_handle);
+          iostreams::file_descriptor_source in(outp.source, iostreams::close_handle);
+          // Our ends of the pipes are close-on-exec, as are those
+          // of every other fast-import's, so none is inherited
+          if (stderr_fd < 0)
+          {
+              return boost::process::execute(
+                  run_exe(git_executable()),
+                  set_env(std::vector<std::string>({"GIT_DIR="+git_dir})),
+                  set_args(args), bind_stdout(out), bind_stdin(in), throw_on_error());
+          }
+          iostreams::file_descriptor_sink err(stderr_fd, iostreams::close_handle);
+          return boost::process::execute(
               run_exe(git_executable()),
               set_env(std::vector<std::string>({"GIT_DIR="+git_dir})),
-              set_args(arg_vector(git_dir)),
-              bind_stdout(iostreams::file_descriptor_sink(inp.sink, iostreams::close_handle)),
-              bind_stdin(iostreams::file_descriptor_source(outp.source, iostreams::close_handle)),
-#if defined(BOOST_POSIX_API)
-              close_fd(outp.sink),
-              close_fd(inp.source),
-#endif
-              throw_on_error())),
-      cin(iostreams::file_descriptor_sink(outp.sink, iostreams::close_handle)),
+              set_args(args), bind_stdout(out), bind_stdin(in), bind_stderr(err),
+              throw_on_error());
+      }()),
+      command_fd(outp.sink),
       cout(iostreams::file_descriptor_source(inp.source, iostreams::close_handle))
 {
+    std::string const worker = fast_import_worker(git_dir);
+    if (options.mock_fast_import)
+    {
+        emulator = std::thread(mock_fast_import, outp.source, inp.sink, git_dir);
+    }
+    else if (!worker.empty())
+    {
+        int socket;
+        try
+        {
+            socket = connect_fast_import_worker(
+                worker, git_dir, arg_vector(marks_file, import_marks, active_branches));
+        }
+        catch (...)
+        {
+            ::close(outp.source);
+            ::close(inp.sink);
+            throw;
+        }
+        relay = std::thread(relay_fast_import, socket, outp.source, inp.sink, std::ref(relayed));
+    }
+    // Only our end: fast-import reads its end as usual
+    ::fcntl(command_fd, F_SETFL, ::fcntl(command_fd, F_GETFL) | O_NONBLOCK);
+}
+
+git_fast_import::git_fast_import(std::string const& git_dir, unsigned writer)
+    : git_dir(git_dir),
+      writer(writer),
+      marks_file(marks_file_path(git_dir) + (writer ? "." + std::to_string(writer) : "")),
+      restarting(false),
+      active_branches(0),
+      discarding(false),
+      sink(to_process),
+      buffered(0),
+      queue_start(0),
+      queued_total(0),
+      dequeued_total(0),
+      last_ack_seconds_(0),
+      committed(false),
+      unanswered(0),
+      host(nullptr),
+      last_mark(0),
+      unsaved(false),
+      bytes_since_checkpoint_(0),
+      bytes_sent_(0),
+      bytes_since_response(0),
+      spool(nullptr),
+      spool_segments(0),
+      spool_done(false)
+{
+    if (options.pack_threads > 0 && !options.dry_run)
+        packs.reset(new pack_writer(git_dir, shared_deflate_pool()));
+    select_sink();
+}
+
+void git_fast_import::select_sink()
+{
+    bool const tracing = Log::enabled(Log::Trace);
+    if (options.dry_run || discarding)
+        sink = tracing ? to_trace : to_nothing;
+    else
+        sink = tracing ? to_process_and_trace : to_process;
+}
+
+void git_fast_import::write_text_elsewhere(char const* data, std::size_t size)
+{
+    if (sink != to_nothing)
+        std::cerr.write(data, size);
+    if (sink == to_process_and_trace)
+        append(data, size);
 }
 
 git_fast_import::~git_fast_import()
 {
-    // Note: this might not be enough to avoid waiting forever for
-    // process exit if there are other subprocesses whose input
-    // streams are still open.
+    // Every child's pipes are close-on-exec, so closing ours is
+    // enough for fast-import to see the end of its input
+    try
+    {
+        close();
+    }
+    catch(std::exception const& e)
+    {
+        Log::error() << e.what() << std::endl;
+    }
+    try
+    {
+        reap();
+    }
+    catch(std::exception const& e)
+    {
+        Log::error() << e.what() << std::endl;
+    }
+    auto const p = std::find(unacknowledged_instances.begin(), unacknowledged_instances.end(), this);
+    if (p != unacknowledged_instances.end())
+        unacknowledged_instances.erase(p);
+    if (host)
+        hosted_instances.erase(std::find(hosted_instances.begin(), hosted_instances.end(), this));
+}
+
+void git_fast_import::host_in(git_fast_import& host, std::string const& ns)
+{
+    assert(!process && !this->host && buffered == 0);
+    this->host = &host;
+    // As Git nests the namespaces of a name with slashes
+    ref_prefix_.clear();
+    for (std::size_t start = 0, end; start <= ns.size(); start = end + 1)
+    {
+        end = std::min(ns.find('/', start), ns.size());
+        ref_prefix_ += "refs/namespaces/" + ns.substr(start, end - start) + "/";
+    }
+    hosted_instances.push_back(this);
+}
+
+void git_fast_import::start()
+{
+    assert(!process && !options.dry_run);
+    Log::debug() << (restarting ? "restarting" : "starting")
+                 << " git fast-import in " << git_dir
+                 << (writer ? " as writer " + std::to_string(writer) : std::string()) << std::endl;
+    int stderr_fd = -1;
+    if (options.fast_import_stats)
+    {
+        stderr_fd = ::open(stderr_file().c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+        if (stderr_fd < 0)
+            throw std::runtime_error("Couldn't create " + stderr_file() + ": " + std::strerror(errno));
+        packs_before = pack_files(git_dir);
+    }
+    // Resumed conversions refer to commits written by earlier runs,
+    // and restarted processes to those written by the last one
+    process.reset(
+        new process_type(
+            git_dir, marks_file, options.resume || restarting, active_branches, stderr_fd));
+}
+
+// With --fast-import-stats, where fast-import's standard error goes
+std::string git_fast_import::stderr_file() const
+{
+    return git_dir + "/svn2git-fast-import" + (writer ? "." + std::to_string(writer) : "") + ".err";
+}
+
+// Wait for fast-import to exit, and with --fast-import-stats, pass on
+// what it printed before its statistics, and take them in
+void git_fast_import::reap()
+{
+    if (!process)
+        return;
+    // Echoes left unread would hold up fast-import's exit once they
+    // filled its output pipe
+    for (std::string line; !pending_acks.empty() && std::getline(process->cout, line);)
+    {
+        if (captured_responses.is_open())
+            captured_responses << line << '\n' << std::flush;
+        take_ack(line);
+    }
+    pending_acks.clear();
+    unanswered = 0;
+    if (process->emulator.joinable())
+    {
+        process->emulator.join();
+    }
+    else if (process->relay.joinable())
+    {
+        process->relay.join();
+        remote_exit const relayed = process->relayed;
+        process.reset();
+        if (!relayed.error.empty())
+            throw std::runtime_error("fast-import worker for " + git_dir + ": " + relayed.error);
+        if (relayed.status != 0)
+        {
+            Log::error() << "git fast-import in " << git_dir << " exited with status "
+                         << relayed.status << " on its worker" << std::endl;
+        }
+    }
+    else
+    {
+        wait_for_exit(process->child);
+    }
+    process.reset();
+    if (!options.fast_import_stats)
+        return;
+
+    std::ifstream err(stderr_file().c_str());
+    std::string line;
+    bool in_stats = false;
+    import_stats reported;
+    while (std::getline(err, line))
+    {
+        // Older versions call themselves git-fast-import
+        if (line == "fast-import statistics:" || line == "git-fast-import statistics:")
+            in_stats = true;
+        else if (!in_stats)
+            std::cerr << line << std::endl;
+        else
+            reported.parse(line);
+    }
+    if (!in_stats)
+        return;
+
+    for (auto const& pack : pack_files(git_dir))
+    {
+        if (!std::binary_search(packs_before.begin(), packs_before.end(), pack))
+        {
+            boost::system::error_code ec;
+            auto const size = boost::filesystem::file_size(git_dir + "/objects/pack/" + pack, ec);
+            if (!ec)
+                reported.pack_bytes += size;
+        }
+    }
+    reported.processes = 1;
+    reported_stats_.add(reported);
+
+    std::ostream& os = Log::info() << "git fast-import in " << git_dir << ": "
+                                   << reported.branches << " branches, " << reported.loads << " loads";
+    if (active_branches > 0)
+        os << ", up to " << active_branches << " active";
+    os << std::endl;
+}
+
+void git_fast_import::import_stats::parse(std::string const& line)
+{
+    static char const* const kinds[object_kinds] = { "blobs", "trees", "commits", "tags" };
+    std::size_t const start = line.find_first_not_of(' ');
+    if (start == std::string::npos)
+        return;
+    char const* const p = line.c_str() + start;
+    unsigned long long n, n_duplicates, n_deltas;
+    for (int k = 0; k < object_kinds; ++k)
+    {
+        std::size_t const size = std::strlen(kinds[k]);
+        if (std::strncmp(p, kinds[k], size) == 0
+            && std::sscanf(p + size, " : %llu ( %llu duplicates %llu deltas",
+                           &n, &n_duplicates, &n_deltas) == 3)
+        {
+            objects[k] = n;
+            duplicates[k] = n_duplicates;
+            deltas[k] = n_deltas;
+            return;
+        }
+    }
+    unsigned long long n_loads;
+    if (std::sscanf(p, "Total branches: %llu ( %llu loads", &n, &n_loads) == 2)
+    {
+        branches = n;
+        loads = n_loads;
+    }
+    else if (std::sscanf(p, "Memory total: %llu KiB", &n) == 1)
+        memory_kib = n;
+}
+
+void git_fast_import::import_stats::add(import_stats const& other)
+{
+    processes += other.processes;
+    for (int k = 0; k < object_kinds; ++k)
+    {
+        objects[k] += other.objects[k];
+        duplicates[k] += other.duplicates[k];
+        deltas[k] += other.deltas[k];
+    }
+    branches = std::max(branches, other.branches);
+    loads += other.loads;
+    memory_kib = std::max(memory_kib, other.memory_kib);
+    pack_bytes += other.pack_bytes;
+}
+
+void git_fast_import::close()
+{
+    if (spooling())
+    {
+        if (spool_done)
+            return;
+        flush();
+        finish_spool_segment();
+        // Tell import-spools no more segments are coming, unless
+        // we're giving up on an error, leaving the spool to be resumed
+        if (!std::uncaught_exception())
+            std::ofstream((spool_dir() + "/done").c_str());
+        spool_done = true;
+        return;
+    }
+    // The host is closed once the whole group is
+    if (host)
+        return flush();
+    if (process ? process->command_fd < 0 : buffered == 0 && held.empty())
+        return;
+    auto close_command_fd = [this] {
+        if (process)
+        {
+            ::close(process->command_fd);
+            process->command_fd = -1;
+        }
+        if (queued_bytes() > 0)
+        {
+            queue.clear();
+            queue_start = 0;
+            revision_ends.clear();
+            queued_instances.erase(
+                std::find(queued_instances.begin(), queued_instances.end(), this));
+        }
+    };
+    try
+    {
+        flush();
+        wait_for_queue(0);
+    }
+    catch(...)
+    {
+        close_command_fd();
+        throw;
+    }
+    close_command_fd();
+}
+
+void git_fast_import::stop()
+{
+    if (spooling())
+    {
+        flush();
+        finish_spool_segment();
+        return;
+    }
+    // The host runs for the whole group
+    if (host)
+        return flush();
     close();
-    if (process)
-        wait_for_exit(*process);
+    if (!process)
+        return;
+    reap();
+    restarting = true;
+    bytes_since_checkpoint_ = 0;
+    bytes_since_response = 0;
+    std::vector<char>().swap(buffer);
 }
 
-std::vector<std::string> 
-git_fast_import::arg_vector(std::string const& git_dir)
+void git_fast_import::wait()
+{
+    reap();
+}
+
+// Write the whole of the buffer, followed by size bytes at data,
+// once any blobs they may refer to are in a finished pack, behind the
+// commands held until then
+void git_fast_import::write_out(char const* data, std::size_t size)
+{
+    if (packs && packs->pending())
+    {
+        profile::scope _("pack writes");
+        packs->finish();
+    }
+    std::vector<char> released;
+    if (!held.empty())
+    {
+        released.swap(held);
+        released.insert(released.end(), buffer.data(), buffer.data() + buffered);
+        if (size > 0)
+            released.insert(released.end(), data, data + size);
+        buffered = 0;
+        data = released.data();
+        size = released.size();
+    }
+    if (!options.capture_streams.empty())
+    {
+        if (!captured_commands.is_open())
+            open_captures();
+        captured_commands.write(&buffer[0], buffered).write(data, size);
+        if (!captured_commands)
+            throw std::runtime_error("Couldn't capture the fast-import stream of " + git_dir);
+    }
+
+    if (spooling())
+    {
+        profile::scope _("spool writes");
+        write_spool(data, size);
+        bytes_since_checkpoint_ += buffered + size;
+        bytes_sent_ += buffered + size;
+        buffered = 0;
+        return;
+    }
+
+    if (host)
+    {
+        host->write_raw(buffer.data(), buffered).write_raw(data, size);
+        host->unsaved = true;
+        bytes_since_checkpoint_ += buffered + size;
+        bytes_sent_ += buffered + size;
+        buffered = 0;
+        return;
+    }
+
+    // Time spent here is mostly spent blocked on a busy fast-import
+    profile::scope _("fast-import writes");
+    if (!process)
+    {
+        std::lock_guard<std::recursive_mutex> lock(instances_mutex);
+        start();
+    }
+    bytes_since_checkpoint_ += buffered + size;
+    bytes_sent_ += buffered + size;
+    auto const start = std::chrono::steady_clock::now();
+    send(data, size);
+    // Copying into a pipe or the queue is quick; the rest is waiting
+    stats_.write_seconds
+        += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    bytes_since_response += buffered + size;
+    profile::counter("pipe bytes", git_dir, bytes_since_response);
+    buffered = 0;
+}
+
+// Write out the buffer, followed by size bytes at data, as it fills,
+// unless blobs are still being written to a pack, when they're held
+// back with the commands before them until the pack is finished.  A
+// fast-import asked to answer anything is sent everything by flush(),
+// so the pack usually stays open until the next response is awaited.
+void git_fast_import::spill(char const* data, std::size_t size)
+{
+    if (packs && packs->pending() && packs->size() < max_pack_size
+        && held.size() + buffered + size <= max_held)
+    {
+        held.insert(held.end(), buffer.data(), buffer.data() + buffered);
+        if (size > 0)
+            held.insert(held.end(), data, data + size);
+        buffered = 0;
+        return;
+    }
+    write_out(data, size);
+}
+
+// Write the buffer, followed by size bytes at data, as far as the
+// pipe has room, queueing the rest behind whatever is queued already,
+// then wait until no more than --fast-import-queue megabytes are
+// queued
+void git_fast_import::send(char const* data, std::size_t size)
+{
+    {
+        std::lock_guard<std::recursive_mutex> lock(instances_mutex);
+        drain_queue();
+        bool const was_queued = queued_bytes() > 0;
+        std::size_t written = 0;
+        if (!was_queued)
+        {
+            iovec iov[2] = { { buffer.data(), buffered }, { const_cast<char*>(data), size } };
+            written = write_some(process->command_fd, iov, 2);
+        }
+        std::size_t const queue_size = queue.size();
+        if (written < buffered)
+        {
+            queue.insert(queue.end(), buffer.data() + written, buffer.data() + buffered);
+            written = 0;
+        }
+        else
+            written -= buffered;
+        queue.insert(queue.end(), data + written, data + size);
+        queued_total += queue.size() - queue_size;
+
+        if (!was_queued && queued_bytes() > 0)
+            queued_instances.push_back(this);
+    }
+    wait_for_queue(std::size_t(options.fast_import_queue) << 20);
+}
+
+// Write what the pipe has room for of the queue
+void git_fast_import::drain_queue()
+{
+    if (queued_bytes() == 0)
+        return;
+    iovec v = { &queue[queue_start], queued_bytes() };
+    dequeue(write_some(process->command_fd, &v, 1));
+}
+
+// Drop the first written bytes of the queue, which the pipe has taken
+void git_fast_import::dequeue(std::size_t written)
+{
+    queue_start += written;
+    dequeued_total += written;
+    if (queued_bytes() > 0)
+    {
+        // Move what's left to the front once most has been written,
+        // rather than shifting it after every write
+        if (queue_start > queue.size() / 2)
+        {
+            queue.erase(queue.begin(), queue.begin() + queue_start);
+            queue_start = 0;
+        }
+        return;
+    }
+    queue.clear();
+    queue_start = 0;
+    revision_ends.clear();
+    if (queue.capacity() > buffer_size)
+        std::vector<char>().swap(queue);
+    queued_instances.erase(std::find(queued_instances.begin(), queued_instances.end(), this));
+}
+
+// Forget the revisions whose commands the pipe has taken
+void git_fast_import::drop_finished_revisions()
+{
+    while (!revision_ends.empty() && revision_ends.front().second <= dequeued_total)
+        revision_ends.pop_front();
+}
+
+void git_fast_import::end_revision(std::size_t revnum)
+{
+    // The commits of hosted repositories are all closed now
+    for (auto w : hosted_instances)
+        w->flush();
+
+    std::vector<git_fast_import*> const committers(unacknowledged_instances);
+    unacknowledged_instances.clear();
+    for (auto w : committers)
+    {
+        if (w->committed)
+            w->request_ack(revnum);
+        w->read_acks(revnum, 0);
+        if (w->pending_acks.empty())
+            continue;
+        w->stats_.max_ack_lag = std::max(w->stats_.max_ack_lag, revnum - w->pending_acks.front().first);
+        unacknowledged_instances.push_back(w);
+    }
+
+    std::vector<git_fast_import*> const writers(queued_instances);
+    for (auto w : writers)
+    {
+        w->drop_finished_revisions();
+        if (w->revision_ends.empty() || w->revision_ends.back().second != w->queued_total)
+            w->revision_ends.emplace_back(revnum, w->queued_total);
+        w->stats_.max_lag = std::max(w->stats_.max_lag, revnum - w->revision_ends.front().first);
+    }
+    if (options.max_lag <= 0)
+        return;
+
+    // A fast-import whose queue empties leaves queued_instances,
+    // dropping its revisions
+    std::size_t const max_lag = options.max_lag;
+    for (auto w : writers)
+    {
+        if (w->revision_ends.empty() || revnum - w->revision_ends.front().first < max_lag)
+            continue;
+        profile::scope _("fast-import writes");
+        auto const start = std::chrono::steady_clock::now();
+        do
+        {
+            pump(nullptr, 0);
+            w->drop_finished_revisions();
+        }
+        while (!w->revision_ends.empty() && revnum - w->revision_ends.front().first >= max_lag);
+        w->stats_.write_seconds
+            += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Those whose pipes have taken their commands may still be
+    // importing them
+    for (auto w : unacknowledged_instances)
+    {
+        if (revnum - w->pending_acks.front().first >= max_lag)
+        {
+            profile::scope _("fast-import acknowledgments");
+            w->read_acks(revnum, max_lag);
+        }
+    }
+}
+
+// Follow the commits sent since the last revision with a progress
+// command naming revnum, for fast-import to echo once it has
+// imported them
+void git_fast_import::request_ack(std::size_t revnum)
+{
+    committed = false;
+    if (!writes_commands() || spooling())
+        return;
+    *this << ack_echo << revnum << LF;
+    spill(nullptr, 0);
+    pending_acks.emplace_back(revnum, clock::now());
+}
+
+// If line is an echo of request_ack's progress command, take it in
+// and return true
+bool git_fast_import::take_ack(std::string const& line)
+{
+    if (line.compare(0, sizeof(ack_echo) - 1, ack_echo) != 0)
+        return false;
+    std::size_t const revnum = std::strtoul(line.c_str() + sizeof(ack_echo) - 1, nullptr, 10);
+    while (!pending_acks.empty() && pending_acks.front().first <= revnum)
+    {
+        if (pending_acks.front().first == revnum)
+        {
+            last_ack_seconds_
+                = std::chrono::duration<double>(clock::now() - pending_acks.front().second).count();
+            ++stats_.acknowledgments;
+            stats_.ack_seconds += last_ack_seconds_;
+            stats_.max_ack_seconds = std::max(stats_.max_ack_seconds, last_ack_seconds_);
+        }
+        pending_acks.pop_front();
+    }
+    return true;
+}
+
+// Read the echoes fast-import has written so far, and with max_lag
+// other than zero, wait for those of any revision that many before
+// revnum.  Only while no response is awaited is all it writes an
+// echo; otherwise the echoes are read with the responses.
+void git_fast_import::read_acks(std::size_t revnum, std::size_t max_lag)
+{
+    while (process && !pending_acks.empty() && unanswered == 0)
+    {
+        if (process->cout.rdbuf()->in_avail() <= 0)
+        {
+            pollfd fd = { response_fd(), POLLIN, 0 };
+            if (max_lag > 0 && revnum - pending_acks.front().first >= max_lag)
+            {
+                // The echo awaited may be held back
+                flush();
+                await_responses(&fd, 1);
+            }
+            else if (::poll(&fd, 1, 0) <= 0)
+                return;
+        }
+        std::string const line = readline_raw();
+        if (!process->cout)
+            throw std::runtime_error("git fast-import in " + git_dir + " exited unexpectedly");
+        if (!take_ack(line))
+            Log::warn() << "Unexpected output \"" << line << "\" from git fast-import in "
+                        << git_dir << std::endl;
+    }
+}
+
+// Drain the queues of writers whose pipes poll() found writable,
+// through the shared ring if there is one: a single system call
+// writes to every pipe, taking what each has room for.
+void git_fast_import::drain_queues(std::vector<git_fast_import*> const& writers)
+{
+    io_ring* const ring = shared_ring();
+    if (!ring || writers.size() < 2)
+    {
+        for (auto w : writers)
+            w->drain_queue();
+        return;
+    }
+
+    std::vector<iovec> v(writers.size());
+    for (std::size_t i = 0; i < writers.size(); ++i)
+    {
+        git_fast_import& w = *writers[i];
+        v[i].iov_base = &w.queue[w.queue_start];
+        v[i].iov_len = w.queued_bytes();
+        ring->writev(w.process->command_fd, &v[i], 1, i);
+    }
+    for (auto const& r : ring->complete())
+    {
+        if (r.second == -EAGAIN || r.second == -EINTR)
+            continue;
+        if (r.second < 0)
+        {
+            throw std::runtime_error(
+                std::string("writing to git fast-import: ") + std::strerror(-r.second));
+        }
+        writers[r.first]->dequeue(std::size_t(r.second));
+    }
+}
+
+void git_fast_import::wait_for_queue(std::size_t max_bytes)
 {
-    return 
-    { 
-        git_executable(), "fast-import", "--quiet", "--force", 
-        "--export-marks=" + marks_file_path(git_dir) 
+    auto const over = [&] {
+        std::lock_guard<std::recursive_mutex> lock(instances_mutex);
+        return queued_bytes() > max_bytes;
     };
+    while (over())
+        pump(nullptr, 0);
 }
 
-git_fast_import& git_fast_import::write_raw(char const* data, std::size_t nbytes)
+// Wait once for any of the n descriptors of responses to be readable
+// or the pipe of any fast-import with a queue to have room, writing
+// to those that do.  Returns true iff a response is ready.
+bool git_fast_import::pump(pollfd* responses, std::size_t n)
 {
-#if 0
-    if (Log::get_level() >= Log::Trace)
+    std::vector<pollfd> fds(responses, responses + n);
+    std::vector<git_fast_import*> writers;
     {
-        std::cerr.write(data, std::min(nbytes, (std::size_t)100));
-        if (nbytes > 100)
-            std::cerr << "...";
-        std::cerr << std::endl;
+        std::lock_guard<std::recursive_mutex> lock(instances_mutex);
+        writers = queued_instances;
     }
-#endif 
-    if (!options.dry_run)
-        cin.write(data, nbytes);
+    for (auto w : writers)
+    {
+        pollfd const fd = { w->process->command_fd, POLLOUT, 0 };
+        fds.push_back(fd);
+    }
+    if (::poll(fds.data(), fds.size(), -1) < 0)
+    {
+        if (errno == EINTR)
+            return false;
+        throw std::runtime_error(
+            std::string("waiting for git fast-import: ") + std::strerror(errno));
+    }
+
+    // Errors and hangups are reported by the writes.  Another thread
+    // may have emptied a queue while this one waited.
+    std::lock_guard<std::recursive_mutex> lock(instances_mutex);
+    std::vector<git_fast_import*> ready_writers;
+    for (std::size_t i = 0; i < writers.size(); ++i)
+    {
+        if (fds[n + i].revents != 0 && writers[i]->queued_bytes() > 0)
+            ready_writers.push_back(writers[i]);
+    }
+    drain_queues(ready_writers);
+    bool ready = false;
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        responses[i].revents = fds[i].revents;
+        ready = ready || fds[i].revents != 0;
+    }
+    return ready;
+}
+
+void git_fast_import::await_responses(pollfd* responses, std::size_t n)
+{
+    while (!pump(responses, n))
+    {
+    }
+}
+
+void git_fast_import::drain_queues()
+{
+    std::lock_guard<std::recursive_mutex> lock(instances_mutex);
+    std::vector<git_fast_import*> const writers(queued_instances);
+    if (!shared_ring() || writers.size() < 2)
+    {
+        for (auto w : writers)
+            w->drain_queue();
+        return;
+    }
+
+    // The ring would wait for a full pipe, so those with room are
+    // found first
+    std::vector<pollfd> fds;
+    for (auto w : writers)
+    {
+        pollfd const fd = { w->process->command_fd, POLLOUT, 0 };
+        fds.push_back(fd);
+    }
+    if (::poll(fds.data(), fds.size(), 0) < 0)
+    {
+        if (errno == EINTR)
+            return;
+        throw std::runtime_error(
+            std::string("waiting for git fast-import: ") + std::strerror(errno));
+    }
+    std::vector<git_fast_import*> ready_writers;
+    for (std::size_t i = 0; i < writers.size(); ++i)
+    {
+        if (fds[i].revents != 0)
+            ready_writers.push_back(writers[i]);
+    }
+    drain_queues(ready_writers);
+}
+
+// The captures of a repository are named for it, with the slashes of
+// its path made underscores, in the --capture-streams directory
+void git_fast_import::open_captures()
+{
+    std::string name = git_dir;
+    std::replace(name.begin(), name.end(), '/', '_');
+    std::string const base = options.capture_streams + "/" + name;
+    captured_commands.open((base + ".stream").c_str(), std::ios::binary | std::ios::trunc);
+    captured_responses.open((base + ".responses").c_str(), std::ios::binary | std::ios::trunc);
+    if (!captured_commands || !captured_responses)
+        throw std::runtime_error("Couldn't create the captures " + base + ".*");
+}
+
+// Each repository's segments are numbered in order in a directory
+// of the spool named like its captures, alongside a file naming the
+// repository.  A segment is written under a temporary name and renamed
+// when finished, at a checkpoint, so import-spools never sees part of
+// one.
+std::string git_fast_import::spool_dir() const
+{
+    std::string name = git_dir;
+    std::replace(name.begin(), name.end(), '/', '_');
+    return options.spool + "/" + name;
+}
+
+void git_fast_import::write_spool(char const* data, std::size_t size)
+{
+    if (!spool)
+    {
+        std::string const dir = spool_dir();
+        if (spool_segments == 0)
+        {
+            boost::filesystem::create_directories(dir);
+            std::ofstream((dir + "/git-dir").c_str())
+                << boost::filesystem::absolute(git_dir).string() << '\n';
+        }
+        // Fast compression: it's the SVN side this is meant to keep busy
+        std::string const partial = dir + "/partial.gz";
+        spool = ::gzopen(partial.c_str(), "wb1");
+        if (!spool)
+            throw std::runtime_error("Couldn't create spool file " + partial);
+        ++spool_segments;
+    }
+    auto write = [this](char const* p, std::size_t n) {
+        if (n > 0 && ::gzwrite(spool, p, unsigned(n)) != int(n))
+            throw std::runtime_error("Couldn't write the spool of " + git_dir);
+    };
+    if (buffered > 0)
+        write(&buffer[0], buffered);
+    write(data, size);
+}
+
+void git_fast_import::finish_spool_segment()
+{
+    if (!spool)
+        return;
+    gzFile_s* const file = spool;
+    spool = nullptr;
+    std::string const dir = spool_dir();
+    char segment[16];
+    std::snprintf(segment, sizeof(segment), "%08u.gz", spool_segments);
+    if (::gzclose(file) != Z_OK
+        || std::rename((dir + "/partial.gz").c_str(), (dir + "/" + segment).c_str()) != 0)
+    {
+        throw std::runtime_error("Couldn't finish spool segment " + dir + "/" + segment);
+    }
+}
+
+void git_fast_import::flush()
+{
+    if (buffered > 0 || !held.empty())
+        write_out(nullptr, 0);
+}
+
+void git_fast_import::append_slow(char const* data, std::size_t size)
+{
+    if (buffer.empty())
+        buffer.resize(buffer_size);
+    // A hosted repository's buffer holds whole commits; see host_in
+    if (host)
+    {
+        buffer.resize(std::max(2 * buffer.size(), buffered + size));
+        std::memcpy(&buffer[buffered], data, size);
+        buffered += size;
+        return;
+    }
+    if (size > buffer.size())
+        return spill(data, size);
+
+    if (buffered > 0)
+        spill(nullptr, 0);
+    std::memcpy(&buffer[0], data, size);
+    buffered = size;
+}
+
+git_fast_import& git_fast_import::operator<<(path const& p)
+{
+    return *this << p.str();
+}
+
+git_fast_import& git_fast_import::operator<<(std::ostream& (*manip)(std::ostream&))
+{
+    if (manip == &LF)
+        return write_text("\n", 1);
+
+    std::ostringstream s;
+    manip(s);
+    return *this << s.str();
+}
+
+git_fast_import& git_fast_import::write_octal(unsigned long n)
+{
+    char digits[24];
+    char* const end = digits + sizeof(digits);
+    char* p = end;
+    do
+        *--p = char('0' + (n & 7));
+    while (n >>= 3);
+    return write_text(p, end - p);
+}
+
+std::vector<std::string> 
+git_fast_import::arg_vector(std::string const& marks_file, bool import_marks, int active_branches)
+{
+    std::vector<std::string> args(1, git_executable());
+    if (options.fast_ingest)
+    {
+        // Only this process is configured so; the final repack
+        // compresses by the repository's own settings
+        args.insert(args.end(), { "-c", "core.compression=0", "-c", "pack.compression=0" });
+    }
+    args.insert(
+        args.end(),
+        { "fast-import", "--quiet", "--force", "--export-marks=" + marks_file });
+    if (options.fast_ingest)
+        args.push_back("--depth=" + std::to_string(fast_ingest_depth));
+    if (active_branches > 0)
+        args.push_back("--active-branches=" + std::to_string(active_branches));
+    // After --quiet, which would turn them off
+    if (options.fast_import_stats)
+        args.push_back("--stats");
+    if (import_marks)
+        args.push_back("--import-marks-if-exists=" + marks_file);
+    return args;
+}
+
+git_fast_import& git_fast_import::write_raw(char const* data, std::size_t nbytes)
+{
+    if (!writes_commands())
+        return *this;
+    if (nbytes >= direct_write_size && !host)
+        spill(data, nbytes);
+    else
+        append(data, nbytes);
     return *this;
 }
 
 // Just writes the header.  
 git_fast_import& git_fast_import::data_hdr(std::size_t size)
 {
+    if (writes_commands())
+        stats_.inline_bytes += size;
     return *this << "data " << size << LF;
 }
 
@@ -86,48 +1098,235 @@ git_fast_import& git_fast_import::data(char const* data, std::size_t size)
 git_fast_import& git_fast_import::commit(
     std::string const& ref_name, 
     std::size_t mark, 
-    std::string const& author,
+    std::string const& committer,
     unsigned long epoch,
     std::string const& log_message)
 {
-    *this << "commit " << ref_name << LF
+    // A hosted repository's commits are acknowledged by its host
+    git_fast_import& acknowledger = host ? *host : *this;
+    if (!acknowledger.committed && writes_commands() && !spooling())
+    {
+        std::lock_guard<std::recursive_mutex> lock(instances_mutex);
+        acknowledger.committed = true;
+        auto const& u = unacknowledged_instances;
+        if (std::find(u.begin(), u.end(), &acknowledger) == u.end())
+            unacknowledged_instances.push_back(&acknowledger);
+    }
+    count(commit_command) << "commit " << ref_prefix_ << ref_name << LF
           << "mark :" << mark << LF
-          << "committer " << author << " " << epoch << " +0000" << LF;
+          << committer << epoch << " +0000" << LF;
     return data(log_message.data(), log_message.size());
 }
 
+git_fast_import& git_fast_import::note(
+    std::string const& committish, std::string const& content)
+{
+    *this << "N inline " << committish << LF;
+    return data(content.data(), content.size());
+}
+
 git_fast_import& git_fast_import::filedelete(path const& p)
 {
-    return *this << "D " << p << LF;
+    return count(delete_command) << "D " << p << LF;
+}
+
+git_fast_import& git_fast_import::merge(std::size_t mark)
+{
+    return count(merge_command) << "merge :" << mark << LF;
+}
+
+git_fast_import& git_fast_import::merge(std::string const& committish)
+{
+    return count(merge_command) << "merge " << committish << LF;
 }
 
 git_fast_import& git_fast_import::filemodify_hdr(path const& p, unsigned long mode)
 {
-    return *this << "M " << std::oct << mode << std::dec << " inline " << p << LF;
+    count(modify_command) << "M ";
+    return write_octal(mode) << " inline " << p << LF;
+}
+
+git_fast_import& git_fast_import::filemodify(
+    path const& p, unsigned long mode, std::string const& dataref)
+{
+    count(modify_command) << "M ";
+    return write_octal(mode) << " " << dataref << " " << p << LF;
 }
 
+// A hosted repository's checkpoint is its host's, made once for
+// all of the group that checkpoint together
 git_fast_import& git_fast_import::checkpoint()
 {
-    return *this << "checkpoint" << LF << LF;
+    bytes_since_checkpoint_ = 0;
+    if (host)
+    {
+        flush();
+        if (host->unsaved)
+            host->checkpoint();
+        return *this;
+    }
+    unsaved = false;
+    count(checkpoint_command) << "checkpoint" << LF << LF;
+    // The pack being written is finished with it, so that a run that
+    // stops afterwards has sent every commit before it
+    if (packs && packs->pending())
+        flush();
+    return *this;
+}
+
+std::uint64_t git_fast_import::resident_bytes() const
+{
+    return process && process->child.pid ? memory_report::resident_bytes(process->child.pid) : 0;
+}
+
+void git_fast_import::wait_for_progress(std::string const& message)
+{
+    if (!writes_commands())
+        return;
+
+    // Nothing comes back from a spool; what's been written is safe
+    // once its segment is finished
+    if (spooling())
+    {
+        flush();
+        finish_spool_segment();
+        return;
+    }
+
+    *this << "progress " << message << LF;
+    flush();
+    std::string const expected = "progress " + message;
+    if (host)
+    {
+        expect_response();
+        if (readline() != expected)
+            throw std::runtime_error("Unexpected response from git fast-import for " + git_dir);
+        return;
+    }
+    for (std::string line; (line = readline_raw()) != expected;)
+    {
+        if (!process->cout)
+            throw std::runtime_error("git fast-import exited unexpectedly");
+        take_ack(line);
+    }
 }
 
 void git_fast_import::send_ls(std::string const& dataref_opt_path)
 {
-    *this << "ls " << dataref_opt_path << LF;
-    cin << std::flush;
+    SVN2GIT_PROBE2(ls__send, git_dir.c_str(), dataref_opt_path.c_str());
+    flight_recorder::note("ls", git_dir, dataref_opt_path);
+    count(ls_command) << "ls " << dataref_opt_path << LF;
+    if (!options.dry_run)
+        flush();
+    expect_response();
+}
+
+void git_fast_import::send_get_mark(int mark)
+{
+    *this << "get-mark :" << mark << LF;
+    if (!options.dry_run)
+        flush();
+    expect_response();
 }
 
+// Note that a response to the command just sent is to be read.  A
+// hosted repository's command is sent on to fast-import at once, and
+// its response will be read in turn with those of the rest of the
+// group.
+void git_fast_import::expect_response()
+{
+    if (!writes_commands() || spooling())
+        return;
+    if (!host)
+    {
+        ++unanswered;
+        return;
+    }
+    host->flush();
+    host->awaiting.push_back(this);
+    ++host->unanswered;
+}
+
+bool git_fast_import::has_response() const
+{
+    if (!responses.empty())
+        return true;
+    git_fast_import const& reader = host ? *host : *this;
+    return reader.process && reader.process->cout.rdbuf()->in_avail() > 0;
+}
+
+// The next response, past any echoes of request_ack's progress
+// commands, which are taken in.  A hosted repository's is read from
+// its host, along with those due the others of its group before it.
 std::string git_fast_import::readline()
 {
+    if (host)
+    {
+        if (!responses.empty())
+        {
+            std::string result = std::move(responses.front());
+            responses.pop_front();
+            return result;
+        }
+        for (;;)
+        {
+            if (host->awaiting.empty())
+                throw std::runtime_error("No response awaited from git fast-import for " + git_dir);
+            git_fast_import* const w = host->awaiting.front();
+            host->awaiting.pop_front();
+            std::string result = host->readline();
+            if (w == this)
+                return result;
+            w->responses.push_back(std::move(result));
+        }
+    }
+
     std::string result;
-    std::getline(cout, result);
+    do
+        result = readline_raw();
+    while (take_ack(result));
+    if (unanswered > 0)
+        --unanswered;
+    return result;
+}
+
+std::string git_fast_import::readline_raw()
+{
+    assert(process);
+    profile::scope _("readline", &git_dir);
+    // The command being answered may still be queued
+    wait_for_queue(0);
+    std::string result;
+    auto const start = std::chrono::steady_clock::now();
+    SVN2GIT_PROBE1(readline__start, git_dir.c_str());
+    std::getline(process->cout, result);
+    SVN2GIT_PROBE1(readline__done, git_dir.c_str());
+    flight_recorder::note("response", git_dir, result);
+    stats_.readline_seconds
+        += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (captured_responses.is_open())
+        captured_responses << result << '\n' << std::flush;
+    bytes_since_response = 0;
+    profile::counter("pipe bytes", git_dir, 0);
     return result;
 }
 
 git_fast_import& git_fast_import::reset(std::string const& ref_name, int mark = -1)
 {
-    *this << "reset " << ref_name << LF;
+    count(reset_command) << "reset " << ref_prefix_ << ref_name << LF;
     if (mark >= 0)
         *this << "from :" << mark << LF;
     return *this << LF;
 }
+
+git_fast_import& git_fast_import::reset(std::string const& ref_name, std::string const& committish)
+{
+    count(reset_command) << "reset " << ref_prefix_ << ref_name << LF;
+    return *this << "from " << committish << LF << LF;
+}
+
+git_fast_import& git_fast_import::delete_ref(std::string const& ref_name)
+{
+    count(reset_command) << "reset " << ref_prefix_ << ref_name << LF;
+    return *this << "from 0000000000000000000000000000000000000000" << LF << LF;
+}
@@ -6,17 +6,29 @@
 
 # include "log.hpp"
 # include "options.hpp"
+# include "pack_writer.hpp"
+# include "remote_fast_import.hpp"
 
 # include <boost/process.hpp>
 # include <boost/iostreams/device/file_descriptor.hpp>
 # include <boost/iostreams/stream.hpp>
 # include <vector>
+# include <algorithm>
+# include <deque>
 # include <string>
+# include <chrono>
+# include <cstdint>
+# include <cstring>
+# include <fstream>
 
 # include <iostream>
-# include <boost/optional.hpp>
+# include <memory>
+# include <mutex>
+# include <thread>
 
 struct path;
+struct gzFile_s;
+struct pollfd;
 
 // I/O manipulator that sends a linefeed character with no translation
 inline std::ostream& LF (std::ostream& stream)
@@ -27,33 +39,164 @@ inline std::ostream& LF (std::ostream& stream)
 
 struct git_fast_import
 {
-    git_fast_import(std::string const& repo_dir);
+    // With --ref-writers, each fast-import writing the repository but
+    // the first is given its number, and exports its marks to a file
+    // of its own, which the next process it starts imports
+    explicit git_fast_import(std::string const& repo_dir, unsigned writer = 0);
     ~git_fast_import();
-    void close() { cin.close(); }
 
-    template <class T>
-    git_fast_import& operator<<(T const& x) 
+    // Send everything written so far and close the command stream
+    void close();
+
+    // Drop every command from now on, as with --dry-run, for a
+    // repository converted by another process or being replayed, or
+    // stop doing so.  Commands already buffered are kept.
+    void discard_commands(bool discard = true) { discarding = discard; select_sink(); }
+
+    // Decide again where commands go, once tracing has been turned
+    // on or off (see Log::set_trace_revisions)
+    void select_sink();
+
+    // With --fast-import-host, write this repository's commands to
+    // host's fast-import, which imports those of a group of small
+    // repositories into its own, instead of to a process of its own.
+    // Its refs are written as those of the Git namespace ns, in
+    // refs/namespaces/, and its marks are drawn from those of the
+    // whole group; see next_mark.  Its commands are kept until a
+    // response is awaited or the revision ends, so that the commits
+    // of the group's repositories reach host's stream whole, one
+    // after another.  Nothing else is sent to host.
+    void host_in(git_fast_import& host, std::string const& ns);
+
+    // The file fast-import exports its marks to
+    std::string const& exported_marks() const { return marks_file; }
+
+    // Where this repository's refs are in its host's repository, or
+    // empty if it isn't hosted
+    std::string const& ref_prefix() const { return ref_prefix_; }
+
+    // The mark of the next commit after the one marked last: the
+    // next, unless the marks are shared with the rest of a group
+    int next_mark(int last)
     {
-        if (Log::get_level() >= Log::Trace)
-            std::cerr << x << std::flush;
-        if (!options.dry_run)
-            this->cin << x; 
-        return *this;
+        if (!host)
+            return last + 1;
+        host->last_mark = std::max(host->last_mark, last) + 1;
+        return host->last_mark;
+    }
+
+    // The fast-import process is started only once commands are sent
+    // to it.  True iff it is running or there are commands waiting to
+    // start it, or it is hosted by one that is.
+    bool active() const
+    {
+        return process || buffered > 0 || !held.empty() || (host && host->active());
     }
 
+    // Have fast-import keep the trees of up to n branches in memory,
+    // as its --active-branches, from the next time it starts; zero
+    // leaves its default
+    void set_active_branches(int n) { active_branches = n; }
+
+    // Send everything written so far and wait for fast-import to
+    // write its marks and refs and exit, releasing its memory.  The
+    // next commands start a new process, which imports the marks.
+    void stop();
+
+    // Wait for fast-import, once its input is closed, to write its
+    // last pack, marks and refs and exit
+    void wait();
+
+    // Commands are accumulated in a buffer and written in large
+    // chunks: when it fills, when a response is awaited, and when
+    // the stream is closed.  What fast-import's pipe has no room for
+    // is queued, and written as room appears, so that a busy
+    // fast-import holds up the conversion only once
+    // --fast-import-queue megabytes are waiting for it.
+    git_fast_import& operator<<(std::string const& s) { return write_text(s.data(), s.size()); }
+    git_fast_import& operator<<(char const* s) { return write_text(s, std::strlen(s)); }
+    git_fast_import& operator<<(char c) { return write_text(&c, 1); }
+    git_fast_import& operator<<(path const& p);
+    git_fast_import& operator<<(int n) { return write_decimal(n); }
+    git_fast_import& operator<<(long n) { return write_decimal(n); }
+    git_fast_import& operator<<(long long n) { return write_decimal(n); }
+    git_fast_import& operator<<(unsigned n) { return write_decimal(n); }
+    git_fast_import& operator<<(unsigned long n) { return write_decimal(n); }
+    git_fast_import& operator<<(unsigned long long n) { return write_decimal(n); }
+    git_fast_import& operator<<(std::ostream& (*manip)(std::ostream&));
+
     git_fast_import& data(char const* data, std::size_t size);
 
+    // Write the mark zero-padded to the 40 digits of a SHA-1, standing
+    // in for the commit's SHA-1 until fix-submodule-refs replaces it
+    git_fast_import& mark_placeholder(std::size_t mark)
+    {
+        char digits[40];
+        char* p = digits + sizeof(digits);
+        do
+            *--p = char('0' + mark % 10);
+        while ((mark /= 10) && p != digits);
+        std::memset(digits, '0', p - digits);
+        return write_text(digits, sizeof(digits));
+    }
+
+    // Write the 40 hex digits of a SHA-1
+    git_fast_import& sha(char const* hex) { return write_text(hex, 40); }
+
+    // committer begins the committer line, as given by
+    // Authors::committer
     git_fast_import& commit(
         std::string const& ref_name, 
         std::size_t mark, 
-        std::string const& author,
+        std::string const& committer,
         unsigned long epoch,
         std::string const& log_message);
 
+    // In a commit to a notes ref, attach content to the commit named
+    // by committish.  fast-import spreads the notes across fanout
+    // directories itself as their number grows.
+    git_fast_import& note(std::string const& committish, std::string const& content);
+
     git_fast_import& filedelete(path const& p);
+
+    // Begin merging the commit with the given mark into the one
+    // being written
+    git_fast_import& merge(std::size_t mark);
+
+    // As above, for the commit named by committish, as by its SHA-1
+    git_fast_import& merge(std::string const& committish);
     
     git_fast_import& filemodify_hdr(path const& p, unsigned long mode = 0100644);
 
+    // Modify a file using a blob already known to fast-import
+    git_fast_import& filemodify(
+        path const& p, unsigned long mode, std::string const& dataref);
+
+    // With --pack-threads, blobs can be written to packs of the
+    // repository's own instead of being sent to fast-import.  The
+    // pack is finished before any further commands are sent, so they
+    // can refer to the blob by its SHA-1; until then they're held
+    // back, so that a pack spans the commands sent between responses
+    // (see spill).
+    bool packs_blobs() const { return bool(packs); }
+    void pack_blob(std::string const& sha, std::string contents)
+    {
+        packs->add_blob(sha, std::move(contents));
+    }
+
+    // True iff the blob named by sha is in the pack being written,
+    // so that pack_delta can store others against it
+    bool accepts_delta_base(std::string const& sha) const
+    {
+        return packs && packs->accepts_delta_base(sha);
+    }
+    void pack_delta(std::string const& sha, std::string const& base_sha, std::string delta)
+    {
+        packs->add_delta(sha, base_sha, std::move(delta));
+    }
+
+    // Write uninterpreted bytes, e.g. the body of a data command.
+    // Large writes bypass the buffer.
     git_fast_import& write_raw(char const* data, std::size_t nbytes);
 
     // Just writes the header for the 'data' command; you can write
@@ -61,23 +204,339 @@ struct git_fast_import
     git_fast_import& data_hdr(std::size_t size);
 
     git_fast_import& checkpoint();
+
+    // Bytes of commands sent to fast-import since the last checkpoint
+    // or stop
+    std::uint64_t bytes_since_checkpoint() const { return bytes_since_checkpoint_; }
+
+    // Bytes of commands sent to fast-import by this run
+    std::uint64_t bytes_sent() const { return bytes_sent_; }
+
+    // True iff a fast-import process is running
+    bool running() const { return bool(process); }
+
+    // With --spool, commands are written to compressed files for
+    // import-spools instead of to a fast-import process, which never
+    // runs.  Nothing can then be asked of fast-import.
+    static bool spooling() { return !options.spool.empty(); }
+
+    // The resident memory of the fast-import process, or zero if it
+    // isn't running or can't be determined
+    std::size_t resident_megabytes() const { return std::size_t(resident_bytes() >> 20); }
+    std::uint64_t resident_bytes() const;
+
+    // Returns once fast-import has processed every command written
+    // so far, e.g. to be sure a checkpoint is complete.
+    void wait_for_progress(std::string const& message);
     git_fast_import& reset(std::string const& ref_name, int mark);
+    git_fast_import& reset(std::string const& ref_name, std::string const& committish);
+
+    // Delete the named ref.  Older versions of fast-import, e.g. the
+    // one built with the conversion, leave the ref alone instead.
+    git_fast_import& delete_ref(std::string const& ref_name);
 
     void send_ls(std::string const& dataref_opt_path);
+
+    // Ask for the SHA-1 of a marked object; the response is a line
+    // holding it, to be read with readline()
+    void send_get_mark(int mark);
     std::string readline();
 
+    // The descriptor on which responses arrive
+    int response_fd() const { return (host ? host : this)->process->inp.source; }
+
+    // True iff a response can be read without waiting: one of a
+    // hosted repository already read by another of the group, or one
+    // already read from the pipe
+    bool has_response() const;
+
+    // Wait until one of the n descriptors of responses is readable,
+    // setting their revents as poll() does, and meanwhile write the
+    // queued commands of every fast-import as their pipes have room.
+    static void await_responses(pollfd* responses, std::size_t n);
+
+    // Write what can be written of every fast-import's queue without
+    // waiting
+    static void drain_queues();
+
+    // Called once the commands of revision revnum are all sent: note
+    // which revision the commands queued for each fast-import end,
+    // and with --max-lag, wait for any that is that many revisions
+    // behind to catch up.  The others, running ahead, are held back
+    // only by the fast-imports the commands they are sent later wait
+    // on.
+    //
+    // Each fast-import sent a commit in the revision is also sent a
+    // progress command naming it, which it echoes once it has
+    // imported everything before; the echoes are read between
+    // revisions and among the responses, and the time each took is
+    // the fast-import's latency.  A fast-import is behind by the
+    // revisions it has yet to acknowledge, and with --max-lag, is
+    // waited for until it is within that many of revnum.
+    static void end_revision(std::size_t revnum);
+
+    // The revisions whose commits fast-import has yet to acknowledge
+    // having imported
+    std::size_t unacknowledged_revisions() const { return pending_acks.size(); }
+
+    // The seconds fast-import took to acknowledge the last revision
+    // it did, or zero if none
+    double last_ack_seconds() const { return last_ack_seconds_; }
+
+    // The kinds of command counted in command_stats
+    enum command_kind
+    {
+        commit_command, modify_command, delete_command, merge_command,
+        reset_command, ls_command, checkpoint_command, command_kinds
+    };
+
+    // What was sent to fast-import, and how long was spent waiting on
+    // it: blocked writing while its pipe was full, and reading its
+    // responses.  A repository whose time is mostly spent waiting is
+    // held back by fast-import's single thread.
+    struct command_stats
+    {
+        command_stats()
+            : commands(), inline_bytes(0), write_seconds(0), readline_seconds(0), max_lag(0),
+              acknowledgments(0), ack_seconds(0), max_ack_seconds(0), max_ack_lag(0) {}
+
+        std::uint64_t commands[command_kinds];
+        std::uint64_t inline_bytes;     // of the bodies of data commands
+        double write_seconds;
+        double readline_seconds;
+        std::size_t max_lag;            // in revisions; see end_revision
+
+        // Of the revisions fast-import acknowledged: how many, the
+        // seconds they took in all and at most, and the most
+        // revisions it was behind
+        std::uint64_t acknowledgments;
+        double ack_seconds;
+        double max_ack_seconds;
+        std::size_t max_ack_lag;
+    };
+    command_stats const& stats() const { return stats_; }
+
+    // What fast-import reported of itself with --fast-import-stats,
+    // summed over the processes run for the repository, but for the
+    // branches and memory, the most any of them had
+    struct import_stats
+    {
+        enum object_kind { blobs, trees, commits, tags, object_kinds };
+
+        import_stats()
+            : processes(0), objects(), duplicates(), deltas(),
+              branches(0), loads(0), memory_kib(0), pack_bytes(0) {}
+
+        // Take in a line of the statistics one process printed
+        void parse(std::string const& line);
+
+        // Take in those of another process
+        void add(import_stats const& other);
+
+        unsigned processes;
+        std::uint64_t objects[object_kinds];
+        std::uint64_t duplicates[object_kinds];
+        std::uint64_t deltas[object_kinds];
+        std::uint64_t branches;
+        std::uint64_t loads;            // of branch trees, evicted or not
+        std::uint64_t memory_kib;
+        std::uint64_t pack_bytes;       // of the packs written meanwhile
+    };
+    import_stats const& reported_stats() const { return reported_stats_; }
+
+    // Count a command written piecemeal with operator<< rather than
+    // by one of the functions above
+    git_fast_import& count(command_kind k)
+    {
+        if (writes_commands())
+            ++stats_.commands[k];
+        return *this;
+    }
+
  private:
-    static std::vector<std::string> arg_vector(std::string const& git_dir);
-
-    boost::process::pipe inp;
-    boost::process::pipe outp;
-    boost::optional<boost::process::child> process;
-    boost::iostreams::stream<
-        boost::iostreams::file_descriptor_sink
-    > cin;
-    boost::iostreams::stream<
-        boost::iostreams::file_descriptor_source
-    > cout;
+    // A running fast-import and the pipes to and from it
+    struct process_type
+    {
+        process_type(
+            std::string const& git_dir, std::string const& marks_file, bool import_marks,
+            int active_branches, int stderr_fd);
+
+        boost::process::pipe inp;
+        boost::process::pipe outp;
+        boost::process::child child; // with --mock-fast-import or a worker, pid 0
+        std::thread emulator;       // with --mock-fast-import
+        std::thread relay;          // with --fast-import-worker
+        remote_exit relayed;        // how the worker's fast-import ended
+        int command_fd;             // -1 once closed
+        boost::iostreams::stream<
+            boost::iostreams::file_descriptor_source
+        > cout;
+    };
+
+    static std::vector<std::string> arg_vector(
+        std::string const& marks_file, bool import_marks, int active_branches);
+    void start();
+    void reap();
+    std::string stderr_file() const;
+
+    // Where commands go.  It's decided whenever --dry-run, discarding
+    // or tracing change, rather than for every piece of every command.
+    enum sink_type
+    {
+        to_process,             // the usual case
+        to_process_and_trace,   // text is also written to std::cerr
+        to_trace,               // text is only written to std::cerr
+        to_nothing
+    };
+
+    bool writes_commands() const { return sink <= to_process_and_trace; }
+
+    git_fast_import& write_text(char const* data, std::size_t size)
+    {
+        if (sink == to_process)
+            append(data, size);
+        else
+            write_text_elsewhere(data, size);
+        return *this;
+    }
+
+    void write_text_elsewhere(char const* data, std::size_t size);
+
+    template <class Integer>
+    git_fast_import& write_decimal(Integer n)
+    {
+        char digits[24];
+        char* const end = digits + sizeof(digits);
+        char* p = end;
+        bool const negative = n < 0;
+        unsigned long long u = negative ? 0ull - (unsigned long long)n : (unsigned long long)n;
+        do
+            *--p = char('0' + u % 10);
+        while (u /= 10);
+        if (negative)
+            *--p = '-';
+        return write_text(p, end - p);
+    }
+
+    git_fast_import& write_octal(unsigned long n);
+
+    void append(char const* data, std::size_t size)
+    {
+        if (size > buffer.size() - buffered)
+            return append_slow(data, size);
+        std::memcpy(&buffer[buffered], data, size);
+        buffered += size;
+    }
+
+    void append_slow(char const* data, std::size_t size);
+    void flush();
+    void write_out(char const* data, std::size_t size);
+    void spill(char const* data, std::size_t size);
+    void send(char const* data, std::size_t size);
+    void drain_queue();
+    void dequeue(std::size_t written);
+    static void drain_queues(std::vector<git_fast_import*> const& writers);
+    void wait_for_queue(std::size_t max_bytes);
+    std::size_t queued_bytes() const { return queue.size() - queue_start; }
+    static bool pump(pollfd* responses, std::size_t n);
+    void open_captures();
+    void write_spool(char const* data, std::size_t size);
+    void finish_spool_segment();
+    std::string spool_dir() const;
+
+    std::string git_dir;
+    unsigned writer;            // see the constructor
+    std::string marks_file;
+    std::unique_ptr<process_type> process;
+    std::unique_ptr<pack_writer> packs;    // null unless --pack-threads
+    bool restarting;            // true once a process has been stopped
+    int active_branches;        // 0 for fast-import's default
+    bool discarding;            // see discard_commands
+    sink_type sink;
+    std::vector<char> buffer;   // allocated when first written
+    std::size_t buffered;
+    std::vector<char> held;     // commands waiting on the pack; see spill
+
+    // Sent but not yet taken by the pipe: the bytes from queue_start
+    // on.  Every fast-import with a queue is in queued_instances.
+    std::vector<char> queue;
+    std::size_t queue_start;
+    static std::vector<git_fast_import*> queued_instances;
+
+    // With --write-threads, fast-imports are written from several
+    // threads at once, any of which may drain the queues of the
+    // others.  Guards every queue, queued_instances and
+    // unacknowledged_instances, and the starting of processes.
+    static std::recursive_mutex instances_mutex;
+
+    // The revisions with commands still queued, each with the count
+    // of bytes ever queued once its commands were, so that they have
+    // been taken by the pipe once dequeued_total reaches it
+    std::deque<std::pair<std::size_t, std::uint64_t> > revision_ends;
+    std::uint64_t queued_total;
+    std::uint64_t dequeued_total;
+    void drop_finished_revisions();
+
+    // The revisions followed by a progress command that fast-import
+    // has yet to echo, with when each was ended, oldest first; see
+    // end_revision.  Every fast-import sent a commit since its last
+    // progress command, or with one yet to be echoed, is in
+    // unacknowledged_instances.
+    typedef std::chrono::steady_clock clock;
+    std::deque<std::pair<std::size_t, clock::time_point> > pending_acks;
+    double last_ack_seconds_;
+    bool committed;             // since the last progress command
+    static std::vector<git_fast_import*> unacknowledged_instances;
+
+    // The ls and get-mark commands sent but not yet answered.  While
+    // there are none, whatever fast-import writes is an echo, and can
+    // be read without waiting for a response.
+    std::size_t unanswered;
+
+    void request_ack(std::size_t revnum);
+    bool take_ack(std::string const& line);
+    void read_acks(std::size_t revnum, std::size_t max_lag);
+    std::string readline_raw();
+    void expect_response();
+    // With --fast-import-host, of a hosted repository: the host, the
+    // prefix of its refs there, and the responses to it read by
+    // others of the group; of a host: the repositories awaiting
+    // responses, in the order they were asked for, the last mark
+    // drawn by any of them, and whether any sent commands since its
+    // last checkpoint.  Every hosted repository is in
+    // hosted_instances.
+    git_fast_import* host;
+    std::string ref_prefix_;
+    std::deque<std::string> responses;
+    std::deque<git_fast_import*> awaiting;
+    int last_mark;
+    bool unsaved;
+    static std::vector<git_fast_import*> hosted_instances;
+
+    std::uint64_t bytes_since_checkpoint_;
+    std::uint64_t bytes_sent_;
+
+    // Sent since the last response was read, and so possibly still
+    // in the pipe or being imported; traced with --trace-file
+    std::uint64_t bytes_since_response;
+
+    command_stats stats_;
+
+    // With --fast-import-stats, those of the processes reaped so far,
+    // and the packs there were before the running one started
+    import_stats reported_stats_;
+    std::vector<std::string> packs_before;
+
+    // With --capture-streams, every byte sent to fast-import, across
+    // restarts, and every line read back from it, for replay-streams
+    std::ofstream captured_commands;
+    std::ofstream captured_responses;
+
+    // With --spool, the segment being written, if any, and the number
+    // of segments begun
+    gzFile_s* spool;
+    unsigned spool_segments;
+    bool spool_done;            // true once closed
 };
 
 #endif // GIT_FAST_IMPORT_DWA2013614_HPP
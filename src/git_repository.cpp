@@ -3,47 +3,152 @@
 // file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
 
 #include "git_repository.hpp"
+#include "flight_recorder.hpp"
 #include "git_executable.hpp"
 #include "log.hpp"
 #include "flat_set_union.hpp"
+#include "state_file.hpp"
+#include "probes.hpp"
+#include "profile.hpp"
+#include "marks_file_name.hpp"
+#include "ls_response.hpp"
+#include "sha1.hpp"
 
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/algorithm/string/replace.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/iostreams/device/file_descriptor.hpp>
 #include <boost/process.hpp>
-#include <boost/range/adaptor/filtered.hpp>
+#include <algorithm>
 #include <array>
+#include <chrono>
 #include <boost/range/adaptor/map.hpp>
-#include <iomanip>
+#include <fstream>
 
-git_repository::git_repository(std::string const& git_dir)
+#include <unistd.h>
+
+git_repository::git_repository(std::string const& git_dir, role_type role, std::size_t id)
     : git_dir(git_dir),
-      created(ensure_existence(git_dir)),
+      created(role == converted && ensure_existence(git_dir)),
+      role(role),
+      id_(id),
       fast_import_(git_dir),
+      fences(0),
+      followed_revnum(0),
       super_module(nullptr),
+      has_submodules_(false),
       last_mark(0),
+      last_commit_revnum_(0),
+      notes_committer(nullptr),
+      notes_epoch(0),
+      resumed_last_mark(0),
       current_ref(nullptr),
-      prepared_to_close_commit(false)
+      prepared_to_close_commit(false),
+      pending_ls_responses(0),
+      tree_changes(0),
+      tree_known_changed(false)
+{
+    if (is_shadow())
+        fast_import_.discard_commands();
+    else if (options.blob_cache && !options.dry_run)
+        stores = object_store::with_alternates(git_dir + "/objects");
+}
+
+void git_repository::add_writers(std::size_t n)
+{
+    assert(refs.empty() && extra_writers.empty() && !is_shadow());
+    if (n < 2)
+        return;
+    for (std::size_t i = 1; i < n; ++i)
+        extra_writers.emplace_back(new git_fast_import(git_dir, unsigned(i)));
+    settled_marks.assign(n, 0);
+    unsettled_blobs.resize(n);
+    Log::info() << "writing " << git_dir << " with " << n << " fast-imports" << std::endl;
+}
+
+std::size_t git_repository::writer_for(std::string const& ref_name) const
 {
+    if (extra_writers.empty() || ref_name == "refs/heads/master")
+        return 0;
+    // FNV-1a, so that every run gives a ref the same writer
+    std::uint32_t h = 2166136261u;
+    for (char c : ref_name)
+        h = (h ^ (unsigned char)c) * 16777619u;
+    return 1 + h % extra_writers.size();
 }
 
+// Create the repository unless it exists, returning true iff it
+// didn't.  Rather than waiting on a "git init --bare" for each of what
+// may be a hundred repositories, the few files Git needs to recognize
+// a bare repository are written directly; Git fills in the rest (hooks,
+// description, info/exclude) only as conveniences.
 bool git_repository::ensure_existence(std::string const& git_dir)
 {
-    namespace process = boost::process;
     namespace fs = boost::filesystem;
-    using namespace process::initializers;
     
-    if (fs::exists(git_dir))
-        return true;
+    bool const created = !fs::exists(git_dir);
+    if (created)
+    {
+        fs::path const dir(git_dir);
+        fs::create_directories(dir / "objects" / "info");
+        fs::create_directory(dir / "objects" / "pack");
+        fs::create_directories(dir / "refs" / "heads");
+        fs::create_directory(dir / "refs" / "tags");
+        auto write = [&](char const* name, char const* content) {
+            std::ofstream out((dir / name).string().c_str());
+            out << content;
+            if (!out.flush())
+                throw std::runtime_error("Couldn't write " + (dir / name).string());
+        };
+        write("config",
+              "[core]\n"
+              "\trepositoryformatversion = 0\n"
+              "\tfilemode = true\n"
+              "\tbare = true\n");
+        // Written last, since it's what makes Git take the directory
+        // for a repository
+        write("HEAD", "ref: refs/heads/master\n");
+    }
+    if (!options.shared_objects.empty())
+        share_objects(git_dir);
+    return created;
+}
 
-    // Create the new repository
-    fs::create_directories(git_dir);
-    std::array<std::string, 4> git_args = { git_executable(), "init", "--bare", "--quiet" };
-    auto git_init = process::execute(
-        run_exe(git_executable()),
-        set_args(git_args), 
-        start_in_dir(git_dir), 
-        throw_on_error());
-    wait_for_exit(git_init);
-    return true;
+namespace
+{
+    // Append line to the alternates file at path unless it's there
+    void add_alternate(boost::filesystem::path const& path, std::string const& line)
+    {
+        boost::filesystem::create_directories(path.parent_path());
+        {
+            std::ifstream in(path.string().c_str());
+            for (std::string l; std::getline(in, l);)
+            {
+                if (l == line)
+                    return;
+            }
+        }
+        std::ofstream out(path.string().c_str(), std::ios::app);
+        out << line << '\n';
+        if (!out.flush())
+            throw std::runtime_error("Couldn't write " + path.string());
+    }
+}
+
+// For --shared-objects: the alternates of the shared object directory
+// list every repository's object directory, and each repository's
+// list the shared one, which Git follows on to all the others.  So
+// once fast-import has written a blob to any repository's pack, the
+// others can refer to it by SHA-1 instead of storing it again.  All
+// the repositories are linked before any fast-import starts, so each
+// sees the others' packs as they appear.
+void git_repository::share_objects(std::string const& git_dir)
+{
+    namespace fs = boost::filesystem;
+    fs::path const shared = fs::absolute(options.shared_objects);
+    fs::path const objects = fs::absolute(fs::path(git_dir) / "objects");
+    add_alternate(shared / "info" / "alternates", objects.string());
+    add_alternate(objects / "info" / "alternates", shared.string());
 }
 
 void git_repository::set_super_module(
@@ -60,13 +165,10 @@ void git_repository::set_super_module(
         }
         this->super_module = super_module;
         this->submodule_path = submodule_path;
+        super_module->has_submodules_ = true;
     }
 }
 
-// This is the SHA1 of an empty tree.  We can use this to detect when
-// branches are deleted.
-std::string const empty_tree_sha("4b825dc642cb6eb9a060e54bf8d69288fbee4904");
-
 void git_repository::prepare_to_close_commit()
 {
     assert(current_ref);
@@ -78,61 +180,211 @@ void git_repository::prepare_to_close_commit()
 
     auto subrefs = std::move(current_ref->stale_submodule_refs);
     subrefs |= current_ref->changed_submodule_refs;
+    subrefs |= current_ref->deferred_submodule_refs;
 
     for (auto sr : subrefs)
     {
         assert(!sr->marks.empty());
-        std::stringstream sha_prep;
-        sha_prep << std::setfill('0') << std::setw(40) 
-                 << std::prev(sr->marks.end())->second;
-        fast_import() 
-            << "M 160000 "
-            << sha_prep.str()
-            << " " << sr->repo->submodule_path << LF;
+        int const mark = sr->marks.back().second;
+        fast_import().count(git_fast_import::modify_command) << "M 160000 ";
+        bool const resolved = options.resolve_gitlinks && !options.dry_run && !is_shadow();
+        char sha[mark_sha_map::sha_length];
+        if (resolved)
+        {
+            sr->repo->commit_sha(mark, sha);
+            fast_import().sha(sha);
+        }
+        else
+        {
+            fast_import().mark_placeholder(mark);
+        }
+        fast_import() << " " << sr->repo->submodule_path << LF;
+
+        // A submodule committed in this revision, or in one whose
+        // commit here was put off, has a fresh mark.  Unresolved
+        // gitlinks are modeled by their placeholders.
+        bool const fresh = current_ref->changed_submodule_refs.count(sr) != 0
+            || current_ref->deferred_submodule_refs.count(sr) != 0;
+        if (models_tree() && !resolved)
+        {
+            std::string digits = std::to_string(mark);
+            digits.insert(0, mark_sha_map::sha_length - digits.size(), '0');
+            note_file_written(sr->repo->submodule_path, 0160000, digits, fresh);
+        }
+        else if (models_tree())
+        {
+            note_file_written(sr->repo->submodule_path, 0160000, std::string(sha, sizeof(sha)), fresh);
+        }
+        else
+        {
+            note_tree_change(fresh);
+        }
     }
 
     if (!subrefs.empty())
     {
         // Absorb any new changed submodule refs into the overall list of
         // submodule refs
+        std::size_t const known_submodules = current_ref->submodule_refs.size();
         current_ref->submodule_refs |= subrefs;
 
-        std::stringstream content;
-        for (auto sr : current_ref->submodule_refs)
+        // The contents only change along with the set of submodules
+        if (current_ref->submodule_refs.size() != known_submodules
+            || current_ref->gitmodules_sha.empty())
         {
-            content << "[submodule \"" << sr->repo->name() << "\"]\n"
-                    << "	path = " << sr->repo->submodule_path << "\n"
-                    << "	url = http://github.com/boostorg/" << sr->repo->name() << ".git\n"
-                    << "        fetchRecurseSubmodules = on-demand\n"
-                ;
+            std::stringstream content;
+            for (auto sr : current_ref->submodule_refs)
+            {
+                content << "[submodule \"" << sr->repo->name() << "\"]\n"
+                        << "	path = " << sr->repo->submodule_path << "\n"
+                        << "	url = http://github.com/boostorg/" << sr->repo->name() << ".git\n"
+                        << "        fetchRecurseSubmodules = on-demand\n"
+                    ;
+            }
+            current_ref->gitmodules = content.str();
+            current_ref->gitmodules_sha = git_blob_hasher(current_ref->gitmodules.size())
+                .update(current_ref->gitmodules).hex_digest();
         }
-        fast_import().filemodify_hdr(".gitmodules");
-        fast_import().data(content.str().data(), content.str().size());
+        write_generated_file(".gitmodules", current_ref->gitmodules, current_ref->gitmodules_sha);
     }
     
     if (current_ref->gitattributes_outdated)
     {
-        fast_import().filemodify_hdr(".gitattributes");
-        fast_import().data(options.gitattributes.data(), options.gitattributes.size());
+        static std::string const gitattributes_sha 
+            = git_blob_hasher(options.gitattributes.size()).update(options.gitattributes).hex_digest();
+        write_generated_file(".gitattributes", options.gitattributes, gitattributes_sha);
         current_ref->gitattributes_outdated = false;
     }
 
+    write_remapped_deletions();
+
+    prepared_to_close_commit = true;
+    pending_ls_responses = 0;
+    if (options.dry_run || is_shadow() || current_ref->alias_source)
+        return;
+
+    // With --tree-model, the trees are compared in close_commit
+    if (models_tree() && current_ref->head_tree_known)
+        return;
+
+    // Often we know whether the tree changed without asking: a commit
+    // that writes nothing leaves its parent's tree alone, and one
+    // that writes content never before seen in the repository must
+    // differ from it.
+    bool const has_parent = current_ref->marks.size() >= 2;
+    if (options.local_tree_check && (tree_changes == 0 ? has_parent : tree_known_changed))
+        return;
+
+    // A spool can't be asked, so there the commit is kept unless
+    // nothing was written
+    if (git_fast_import::spooling())
+        return;
+
     // Send a fast-import "ls" command to the changed repository now;
     // responses will be read in a separate close_commit() pass over
     // all changed repos.  Hopefully this will prevent us from
     // blocking for each repo when multiple repositories are changed
     // in a single SVN revision.
     fast_import().send_ls("\"\"");
-    prepared_to_close_commit = true;
+    ++pending_ls_responses;
+
+    if (current_ref->head_tree_sha_stale && has_parent)
+    {
+        fast_import().send_ls(committish(current_ref->marks.penultimate().second) + " \"\"");
+        ++pending_ls_responses;
+    }
+}
+
+// Read the response to an "ls" of the root of a commit in the named
+// ref, "040000 tree <sha>\t", and return the tree's SHA-1
+object_id git_repository::read_ls_tree_sha(std::string const& ref_name)
+{
+    profile::scope _("ls round trips", &name());
+    std::string const response = fast_import().readline();
+
+    object_id const sha = object_id::from_hex(ls_response_sha(response));
+    if (sha.is_null())
+    {
+        Log::error() << "Unrecognized response \"" << response << "\" from ls in ref " 
+                     << ref_name << std::endl;
+    }
+    return sha;
+}
+
+bool git_repository::set_commit_aside()
+{
+    // Super-modules and their submodules close their commits in step,
+    // and the responses of hosted repositories and of several writers
+    // are awaited one commit at a time
+    if (!options.pipeline_commits || !current_ref || !prepared_to_close_commit
+        || role != converted || has_submodules_ || super_module
+        || !extra_writers.empty() || !fast_import().ref_prefix().empty())
+    {
+        return false;
+    }
+
+    ref* const r = current_ref;
+    modified_refs.erase(r);
+    current_ref = nullptr;
+    if (!ready_ref())
+    {
+        modified_refs.insert(r);
+        current_ref = r;
+        return false;
+    }
+
+    Log::trace() << "repository " << git_dir
+                 << " setting aside commit in ref " << r->name << std::endl;
+    set_aside_commit const c = { r, pending_ls_responses, tree_changes, tree_known_changed };
+    set_aside.push_back(c);
+    prepared_to_close_commit = false;
+    pending_ls_responses = 0;
+    tree_changes = 0;
+    tree_known_changed = false;
+    return true;
+}
+
+bool git_repository::close_commit()
+{
+    assert(current_ref);
+    if (!current_ref->can_close())
+        return false;
+
+    // Their "ls" commands were sent first, so their responses come first
+    if (!set_aside.empty())
+    {
+        set_aside_commit const open = {
+            current_ref, pending_ls_responses, tree_changes, tree_known_changed };
+        bool const open_prepared = prepared_to_close_commit;
+        for (auto const& c : set_aside)
+        {
+            current_ref = c.r;
+            prepared_to_close_commit = true;
+            pending_ls_responses = c.pending_ls_responses;
+            tree_changes = c.tree_changes;
+            tree_known_changed = c.tree_known_changed;
+            close_open_commit();
+        }
+        set_aside.clear();
+        current_ref = open.r;
+        prepared_to_close_commit = open_prepared;
+        pending_ls_responses = open.pending_ls_responses;
+        tree_changes = open.tree_changes;
+        tree_known_changed = open.tree_known_changed;
+    }
+    return close_open_commit();
 }
 
 // Close the current ref's commit.  Return true iff there are no more
 // modified refs
-bool git_repository::close_commit()
+bool git_repository::close_open_commit()
 {
     assert(current_ref);
     if (!current_ref->can_close())
         return false;
+    profile::scope _("close commit", &name());
+    SVN2GIT_PROBE2(commit__close, name().c_str(), current_ref->name.c_str());
+    flight_recorder::note("close commit", name(), current_ref->name);
 
     // Super-modules sometimes become ready to close just after their
     // submodules have closed, so we may not have prepared them for
@@ -143,26 +395,63 @@ bool git_repository::close_commit()
     Log::trace() << "repository " << git_dir
                  << " closing commit in ref " << current_ref->name << std::endl;
 
-    std::string new_sha;
-    if (!options.dry_run)
+    read_commit_shas();
+
+    // Read the responses to the git-fast-import "ls" commands sent earlier
+    bool unchanged = false;
+    object_id new_sha;
+    if (current_ref->alias_source)
     {
-        // Read the response to the git-fast-import "ls" command sent earlier
-        std::string response = fast_import().readline();
-    
-        if (response.size() < 41)
-            Log::error() << "Unrecognized response \"" << response << "\" from ls in ref " 
-                         << current_ref->name << std::endl;
-        else
-            new_sha = response.substr(response.size() - 41, response.size() - 1);
+        // Made by open_alias, and surely kept
+        new_sha = current_ref->head_tree_sha;
+        unalias_ref(current_ref);
+    }
+    else if (pending_ls_responses > 0)
+    {
+        new_sha = read_ls_tree_sha(current_ref->name);
+        if (pending_ls_responses > 1)
+            current_ref->head_tree_sha = read_ls_tree_sha(current_ref->name);
+        unchanged = new_sha == current_ref->head_tree_sha;
+        current_ref->head_tree_sha_stale = false;
+    }
+    else if (role == followed_shadow)
+    {
+        // Decided by the process converting the repository, or the
+        // run whose state is being replayed
+        unchanged = followed_mark(*current_ref, current_ref->marks.back().first) == 0;
+        new_sha = current_ref->head_tree_sha;
+    }
+    else if (models_tree() && current_ref->head_tree_known)
+    {
+        bool const has_parent = current_ref->marks.size() >= 2;
+        unchanged = has_parent && (current_ref->tree.shares_root(current_ref->head_tree)
+                                   || current_ref->tree.sha() == current_ref->head_tree.sha());
+        new_sha = object_id(current_ref->tree.sha());
+        current_ref->head_tree_sha_stale = false;
+        Log::trace() << "Tree " << (unchanged ? "un" : "") << "changed, by the model" << std::endl;
+    }
+    else if (!options.dry_run && role == converted)
+    {
+        // Decided locally in prepare_to_close_commit
+        unchanged = tree_changes == 0 && current_ref->marks.size() >= 2;
+        Log::trace() << "Tree " << (unchanged ? "un" : "") << "changed, without ls" << std::endl;
+        current_ref->head_tree_sha_stale = current_ref->head_tree_sha_stale || !unchanged;
+        new_sha = current_ref->head_tree_sha;
     }
 
     // Dispose of the commit if it didn't change anything in the tree
-    if (!options.dry_run && new_sha == current_ref->head_tree_sha) 
+    if (unchanged)
     {
         Log::trace() << "Tree unchanged; resetting ref" << std::endl;
-        assert(current_ref->marks.size() >= 2);
-        current_ref->marks.erase(std::prev(current_ref->marks.end()));
-        fast_import().reset(current_ref->name, std::prev(current_ref->marks.end())->second);
+        assert(current_ref->marks.size() >= 2 || is_shadow());
+        current_ref->marks.pop_back();
+        if (!current_ref->marks.empty())
+            fast_import().reset(current_ref->name, committish(current_ref->marks.back().second));
+        if (options.tree_model)
+        {
+            current_ref->tree = current_ref->head_tree;
+            current_ref->tree_known = current_ref->head_tree_known;
+        }
         // Also retract the modification from the super-module
         if (auto s = current_ref->super_module_ref)
             s->changed_submodule_refs.erase(current_ref);
@@ -170,6 +459,28 @@ bool git_repository::close_commit()
     else
     {
         current_ref->head_tree_sha = std::move(new_sha);
+        if (options.tree_model)
+        {
+            current_ref->head_tree = current_ref->tree;
+            current_ref->head_tree_known = current_ref->tree_known;
+            if (current_ref->tree_known)
+                current_ref->tree_history[current_ref->marks.back().second] = current_ref->tree;
+        }
+        for (auto const& m : current_ref->open_merged_marks)
+        {
+            auto& merged_mark = current_ref->merged_marks[m.first];
+            merged_mark = std::max(merged_mark, m.second);
+        }
+        if (options.resolve_gitlinks && super_module && !options.dry_run && !is_shadow())
+        {
+            // End the commit, so that fast-import can name it, and
+            // ask for its SHA-1 now; the super-module reads the
+            // response when it writes the gitlink
+            fast_import() << LF;
+            int const mark = current_ref->marks.back().second;
+            fast_import().send_get_mark(mark);
+            requested_marks.push_back(mark);
+        }
         if (auto s = current_ref->super_module_ref)
         {
             s->submodule_refs_written += 1;
@@ -180,21 +491,34 @@ bool git_repository::close_commit()
         }
     }
 
+    current_ref->open_merged_marks.clear();
     current_ref->stale_submodule_refs.clear();
     current_ref->changed_submodule_refs.clear();
     current_ref->submodule_refs_written = 0;
+    current_ref->submodule_commit_due = false;
+    if (!current_ref->deferred_submodule_refs.empty())
+    {
+        current_ref->deferred_submodule_refs.clear();
+        deferring_refs.erase(current_ref);
+    }
 
     // Done changing this ref
     modified_refs.erase(current_ref);
     current_ref = nullptr;
     prepared_to_close_commit = false;
+    pending_ls_responses = 0;
+    tree_changes = 0;
+    tree_known_changed = false;
     Log::trace() << modified_refs.size() << " modified refs remaining." << std::endl;
+    if (modified_refs.empty())
+        looked_up_objects.clear();
     return modified_refs.empty();
 }
 
 void git_repository::write_merges()
 {
     assert(current_ref);
+    std::vector<int> merges;
     for (auto const& kv : current_ref->pending_merges)
     {
         auto src_ref = kv.first;
@@ -202,19 +526,70 @@ void git_repository::write_merges()
 
         if (src_rev > current_ref->merged_revisions[src_ref])
         {
-            auto p = src_ref->marks.upper_bound(src_rev);
-            if (p == src_ref->marks.begin())
+            ref::rev_mark_map::value_type m;
+            if (!src_ref->marks.find_at_or_before(src_rev, m))
             {
+                // A segment of the history can't record merges
+                // from before it
+                if (int(src_rev) < options.segment_start)
+                    continue;
                 Log::warn() << "No commit found at or preceding the source of merge r" 
                             << src_rev << " in Git repo " << git_dir << " ref " 
                             << src_ref->name << std::endl;
                 continue;
             }
-            fast_import() << "merge :" << (--p)->second << LF;
+            merges.push_back(int(m.second));
             current_ref->merged_revisions[src_ref] = src_rev;
+            current_ref->open_merged_marks[src_ref] = m.second;
         }
     }
     current_ref->pending_merges.clear();
+
+    if (!options.reduce_merges)
+    {
+        for (int m : merges)
+            fast_import().merge(committish(m));
+        return;
+    }
+
+    // With --reduce-merges, a source already among the ancestors of
+    // the ref's last commit or of another source is left out.  It's
+    // still counted as merged, which it is.
+    std::vector<int> parents;
+    if (current_ref->marks.size() >= 2)
+        parents.push_back(int(current_ref->marks.penultimate().second));
+    std::size_t const first_merge = parents.size();
+    for (std::size_t i = 0; i < merges.size(); ++i)
+    {
+        int const m = merges[i];
+        bool redundant = std::find(parents.begin(), parents.end(), m) != parents.end();
+        for (std::size_t j = 0; !redundant && j < merges.size(); ++j)
+        {
+            if (merges[j] != m)
+                redundant = merge_graph.reaches(merges[j], m, merge_search_limit);
+        }
+        if (!redundant && first_merge > 0)
+            redundant = merge_graph.reaches(parents.front(), m, merge_search_limit);
+        if (redundant)
+            profile::add("redundant merges", name(), 1);
+        else
+            parents.push_back(m);
+    }
+    for (std::size_t i = first_merge; i < parents.size(); ++i)
+        fast_import().merge(committish(parents[i]));
+    merge_graph.add(int(current_ref->marks.back().second), parents);
+}
+
+git_repository::ref* git_repository::ready_ref() const
+{
+    if (current_ref)
+        return current_ref;
+    for (auto p = modified_refs.rbegin(); p != modified_refs.rend(); ++p)
+    {
+        if ((*p)->can_close())
+            return *p;
+    }
+    return nullptr;
 }
 
 git_repository::ref* git_repository::open_commit(svn::revision const& rev)
@@ -222,82 +597,1294 @@ git_repository::ref* git_repository::open_commit(svn::revision const& rev)
     if (current_ref) // Commit is already open
         return current_ref;
 
-    assert(!modified_refs.empty());
-
-    current_ref = *std::prev(modified_refs.end());
+    current_ref = ready_ref();
+    assert(current_ref);
+    profile::scope _("open commit", &name());
+    SVN2GIT_PROBE2(commit__open, name().c_str(), current_ref->name.c_str());
+    flight_recorder::note("open commit", name(), current_ref->name, rev.revnum);
 
     Log::trace() << "repository " << git_dir
                  << " opening commit in ref " << current_ref->name << std::endl;
 
-    int mark = ++last_mark;
-    current_ref->marks[rev.revnum] = mark;
-    fast_import() << "# SVN revision " << rev.revnum << LF;
-    fast_import().commit(current_ref->name, mark, rev.author, rev.epoch, rev.log_message);
+    if (current_ref->alias_source
+        && (role != converted || current_ref->pending_tree_copies.size() != 1))
+    {
+        unalias_ref(current_ref);
+    }
+    if (current_ref->alias_source)
+    {
+        open_alias(rev);
+        return current_ref;
+    }
+
+    write_commit(rev.revnum, *rev.committer, rev.epoch, rev.log_message);
+    return current_ref;
+}
+
+// Begin the commit of current_ref at the given SVN revision, and
+// write the changes recorded for it before its files
+void git_repository::write_commit(
+    std::size_t revnum, std::string const& committer, unsigned int epoch,
+    std::string const& log_message)
+{
+    int mark = role == followed_shadow
+        ? followed_mark(*current_ref, revnum) : (last_mark = fast_import().next_mark(last_mark));
+    current_ref->marks.push_back(revnum, mark);
+    last_commit_revnum_ = revnum;
+    if (!extra_writers.empty())
+    {
+        if (mark_writers.size() <= std::size_t(mark))
+            mark_writers.resize(mark + 1);
+        mark_writers[mark] = (unsigned char)current_ref->writer;
+    }
+    fast_import() << "# SVN revision " << revnum << LF;
+    if (options.add_metadata)
+    {
+        // As Boost's own history marks the commits it converted
+        fast_import().commit(
+            current_ref->name, mark, committer, epoch,
+            log_message + "\n\n[SVN r" + std::to_string(revnum) + "]");
+    }
+    else
+    {
+        fast_import().commit(current_ref->name, mark, committer, epoch, log_message);
+    }
+    if (options.add_metadata_notes && !options.dry_run && role == converted)
+    {
+        pending_notes.emplace_back(mark, revnum);
+        notes_committer = &committer;
+        notes_epoch = epoch;
+    }
+
+    if (current_ref->needs_from)
+    {
+        if (current_ref->marks.size() >= 2)
+            fast_import() << "from " << committish(current_ref->marks.penultimate().second) << LF;
+        current_ref->needs_from = false;
+    }
 
     // Write any merges required in this ref
     write_merges();
 
     // Do any deletions required in this ref
-    for (auto& p : current_ref->pending_deletions)
+    write_deletions();
+
+    for (auto const& copy : current_ref->pending_tree_copies)
     {
-        fast_import().filedelete(p);
+        fast_import().count(git_fast_import::modify_command)
+            << "M " << copy.second << " " << copy.first << LF;
+        note_tree_change();
+        if (models_tree())
+        {
+            auto const o = looked_up_objects.find(copy.second);
+            if (o == looked_up_objects.end())
+                current_ref->tree_known = false;
+            else
+                current_ref->tree.set(copy.first.str(), o->second);
+        }
+    }
+    current_ref->pending_tree_copies.clear();
+}
 
-        // Make sure we rewrite the refs of all submodules caught by
-        // this delete.  The submodule repositories themselves don't
-        // (necessarily) need an update.
-        current_ref->stale_submodule_refs
-            |= current_ref->submodule_refs | boost::adaptors::filtered(
-                [&](ref const* r){ return r->repo->submodule_path.starts_with(p); });
+bool git_repository::defer_submodule_commit(svn::revision const& rev)
+{
+    if (!has_submodules_ || current_ref || role != converted || super_module
+        || (options.coalesce_submodule_revisions <= 0 && options.coalesce_submodule_seconds <= 0))
+    {
+        return false;
+    }
+    ref* const r = ready_ref();
+    if (!r || r->submodule_commit_due || r->marks.empty() || r->alias_source
+        || !r->pending_merges.empty() || r->pending_deletions.size() != 0
+        || !r->pending_tree_copies.empty() || !r->stale_submodule_refs.empty()
+        || r->gitattributes_outdated || !boost::starts_with(r->name, "refs/heads/"))
+    {
+        return false;
+    }
 
-        if (p.str().empty() && !options.gitattributes.empty())
-            current_ref->gitattributes_outdated = true;
+    // Does the window that would hold rev end before it?
+    if (!r->deferred_submodule_refs.empty())
+    {
+        if ((options.coalesce_submodule_revisions > 0
+             && rev.revnum - r->deferred_first_revnum >= std::size_t(options.coalesce_submodule_revisions))
+            || (options.coalesce_submodule_seconds > 0
+                && rev.epoch - r->deferred_first_epoch >= unsigned(options.coalesce_submodule_seconds)))
+        {
+            return false;
+        }
+    }
+    else if (!r->changed_submodule_refs.empty())
+    {
+        r->deferred_first_revnum = rev.revnum;
+        r->deferred_first_epoch = rev.epoch;
+        deferring_refs.insert(r);
     }
-    current_ref->pending_deletions.clear();
 
-    return current_ref;
+    Log::trace() << "repository " << git_dir << " putting off the commit of "
+                 << r->changed_submodule_refs.size() << " submodule refs in ref " << r->name
+                 << std::endl;
+    if (!r->changed_submodule_refs.empty())
+    {
+        r->deferred_submodule_refs |= r->changed_submodule_refs;
+        r->deferred_revnum = rev.revnum;
+        r->deferred_committer = rev.committer;
+        r->deferred_epoch = rev.epoch;
+    }
+    r->changed_submodule_refs.clear();
+    r->submodule_refs_written = 0;
+    modified_refs.erase(r);
+    return true;
 }
 
-void git_repository::record_ancestor(
-    ref* descendant, std::string const& src_ref_name, std::size_t revnum)
+std::size_t git_repository::flush_submodule_commits(svn::revision const* rev)
 {
-    // Don't bother recording merges from one branch into itself; that
-    // ancestry is already going to be represented.
-    if (src_ref_name != descendant->name)
+    assert(!current_ref);
+    std::vector<ref*> due;
+    for (ref* r : deferring_refs)
     {
-        auto src_ref = demand_ref(src_ref_name);
+        // A branch modified in rev records them in its own commit
+        if (modified_refs.count(r))
+            continue;
+        if (!rev
+            || (options.coalesce_submodule_revisions > 0
+                && rev->revnum + 1 - r->deferred_first_revnum
+                   >= std::size_t(options.coalesce_submodule_revisions))
+            || (options.coalesce_submodule_seconds > 0
+                && rev->epoch - r->deferred_first_epoch
+                   >= unsigned(options.coalesce_submodule_seconds)))
+        {
+            due.push_back(r);
+        }
+    }
+    for (ref* r : due)
+        flush_submodule_commit(r);
+    return due.size();
+}
 
-        // Update the latest source revision merged
-        auto& merged_rev = descendant->pending_merges[src_ref];
-        if (merged_rev < revnum)
-            merged_rev = revnum;
+// Make r's commit of the submodule commits put off, at the last SVN
+// revision that made one
+void git_repository::flush_submodule_commit(ref* r)
+{
+    assert(!current_ref && !modified_refs.count(r));
+    profile::scope _("coalesced submodule commit", &name());
+    std::size_t const first = r->deferred_first_revnum;
+    std::size_t const last = r->deferred_revnum;
+    Log::trace() << "repository " << git_dir << " committing the submodule refs of r"
+                 << first << " through r" << last << " in ref " << r->name << std::endl;
+
+    modified_refs.insert(r);
+    current_ref = r;
+    std::string const message = first == last
+        ? "Update submodules to SVN r" + std::to_string(last) + "\n"
+        : "Update submodules to SVN r" + std::to_string(last) + "\n\n"
+          "Records the submodule commits of SVN r" + std::to_string(first)
+          + " through r" + std::to_string(last) + ".\n";
+    write_commit(last, *r->deferred_committer, r->deferred_epoch, message);
+    prepare_to_close_commit();
+    close_commit();
+}
+
+// Make the open "commit" of the current ref, a tag copying the whole
+// of another ref, that ref's commit at the time.  Whatever would have
+// gone into a commit of its own is already in that one.
+void git_repository::open_alias(svn::revision const& rev)
+{
+    ref& source = *current_ref->alias_source;
+    int const mark = current_ref->alias_mark;
+    Log::trace() << "Tagging " << source.name << " :" << mark << " as " << current_ref->name
+                 << std::endl;
+
+    current_ref->marks.push_back(rev.revnum, mark);
+    last_commit_revnum_ = rev.revnum;
+    fast_import() << "# SVN revision " << rev.revnum << LF;
+    fast_import().reset(current_ref->name, committish(mark));
+
+    current_ref->pending_merges.clear();
+    current_ref->pending_deletions.clear();
+    current_ref->pending_tree_copies.clear();
+    current_ref->gitattributes_outdated = false;
+    current_ref->merged_marks = source.merged_marks;
+    current_ref->open_merged_marks[&source] = mark;
+    current_ref->merged_revisions = source.merged_revisions;
+
+    // The tree is the source's, if it's the one the source has now
+    bool const at_head = source.marks.back().second == std::size_t(mark);
+    current_ref->head_tree_sha = at_head ? source.head_tree_sha : object_id();
+    current_ref->head_tree_sha_stale = !at_head || source.head_tree_sha_stale;
+    if (options.tree_model)
+    {
+        auto const tree = source.tree_history.find(mark);
+        current_ref->tree_known = tree != source.tree_history.end();
+        if (current_ref->tree_known)
+            current_ref->tree = tree->second;
     }
 }
 
-git_repository::ref* git_repository::modify_ref(std::string const& name, bool allow_discovery)
+// Write a file whose content svn2git makes up, whose blob is named
+// sha, to the open commit.  The content is only sent the first time;
+// later commits refer to the blob already written.
+void git_repository::write_generated_file(
+    path const& git_path, std::string const& content, std::string const& sha)
 {
-    auto r = demand_ref(name);
-    bool already_modified = modified_refs.count(r);
-    if (!already_modified)
+    object_id const id = object_id::from_hex(sha);
+    if (!blob_shas.insert(id).second && readable_blob(sha))
     {
-        if (!allow_discovery)
-            return nullptr;
+        fast_import().filemodify(git_path, 0100644, sha);
+    }
+    else
+    {
+        fast_import().filemodify_hdr(git_path);
+        fast_import().data(content.data(), content.size());
+        sent_blob(id);
+    }
+    note_file_written(git_path, 0100644, sha);
+}
 
-        Log::trace() << "In Git repo " << this->name() << ", marking " << r->name 
-                     << " for modification" << std::endl;
+// Write the deletions pending in the current ref, and make sure we
+// rewrite the refs of all submodules caught by them.  The submodule
+// repositories themselves don't (necessarily) need an update.
+void git_repository::write_deletions()
+{
+    path_set& deletions = current_ref->pending_deletions;
+    if (deletions.size() == 0)
+        return;
 
-        modified_refs.insert(r);
+    // With the tree modeled, the deletions are made in the model alone
+    // until the commit closes; see write_remapped_deletions.  Trees
+    // copied in may not be known, so then they are made at once.
+    bool const remap = models_tree() && current_ref->pending_tree_copies.empty();
+    if (remap && current_ref->remapped.size() == 0)
+        current_ref->remap_base = current_ref->tree;
 
-        if (super_module)
+    // A path_set holds no path beneath another, so the root can only
+    // be deleted alone, and catches every submodule
+    if (deletions.begin()->str().empty() && remap)
+    {
+        current_ref->tree.clear();
+        current_ref->remapped.insert(path());
+        current_ref->stale_submodule_refs |= current_ref->submodule_refs;
+        if (!options.gitattributes.empty())
+            current_ref->gitattributes_outdated = true;
+        deletions.clear();
+        return;
+    }
+    if (deletions.begin()->str().empty())
+    {
+        fast_import() << "deleteall" << LF;
+        note_tree_change();
+        // Whatever the tree held, it's known to be empty now
+        if (options.tree_model && role == converted && !options.dry_run)
         {
-            if (auto super_module_ref = super_module->modify_ref(name, allow_discovery))
-            {
-                Log::trace() << "Marking super-module " << super_module_ref->repo->name() 
-                             << ", ref " << r->name << " for modification" << std::endl;
-                super_module_ref->changed_submodule_refs.insert(r);
-            }
+            current_ref->tree.clear();
+            current_ref->tree_known = true;
         }
+        current_ref->stale_submodule_refs |= current_ref->submodule_refs;
+        if (!options.gitattributes.empty())
+            current_ref->gitattributes_outdated = true;
+        deletions.clear();
+        return;
     }
 
-    return r;
+    for (auto const& p : deletions)
+    {
+        if (remap)
+        {
+            current_ref->remapped.insert(p);
+        }
+        else
+        {
+            fast_import().filedelete(p);
+            note_tree_change();
+        }
+        if (models_tree())
+            current_ref->tree.remove(p.str());
+    }
+
+    // With the submodules sorted by path too, one sweep over both
+    // finds the deletion, if any, that catches each submodule: the
+    // last one not sorted after it.
+    if (!current_ref->submodule_refs.empty())
+    {
+        std::vector<std::pair<path, ref const*> > submodules;
+        submodules.reserve(current_ref->submodule_refs.size());
+        for (ref const* r : current_ref->submodule_refs)
+            submodules.emplace_back(r->repo->submodule_path, r);
+        std::sort(submodules.begin(), submodules.end());
+
+        std::vector<ref const*> caught;
+        auto d = deletions.begin();
+        for (auto const& s : submodules)
+        {
+            while (std::next(d) != deletions.end() && !(s.first < *std::next(d)))
+                ++d;
+            if (s.first.starts_with(*d))
+                caught.push_back(s.second);
+        }
+        current_ref->stale_submodule_refs.insert(caught.begin(), caught.end());
+    }
+    deletions.clear();
+}
+
+// Delete whatever the open commit's put-off deletions caught that
+// hasn't been written again since, from the outermost path down, and
+// forget them
+void git_repository::write_remapped_deletions()
+{
+    if (current_ref->remapped.size() == 0)
+        return;
+
+    std::vector<std::string> missing;
+    for (auto const& p : current_ref->remapped)
+        current_ref->remap_base.missing_from(current_ref->tree, p.str(), missing);
+
+    for (auto const& p : missing)
+    {
+        fast_import().filedelete(p);
+        note_tree_change();
+    }
+    profile::add("remapped deletions", name(), missing.size());
+
+    current_ref->remapped.clear();
+    current_ref->remap_base = tree_model();
 }
 
+bool git_repository::unchanged_by_remapping(
+    path const& git_path, unsigned long mode, std::string const& sha)
+{
+    if (current_ref->remapped.size() == 0 || !current_ref->remapped.covers(git_path)
+        || !models_tree())
+    {
+        return false;
+    }
+    auto const o = current_ref->remap_base.find(git_path.str());
+    if (!o || o->subtree || o->mode != mode || o->sha != sha1::from_hex(sha.c_str()))
+        return false;
+
+    current_ref->tree.set(git_path.str(), *o);
+    profile::add("files kept by remapping", name(), 1);
+    return true;
+}
+
+std::string git_repository::lookup(
+    std::string const& ref_name, std::size_t revnum, path const& git_path,
+    std::string const& dst_ref_name)
+{
+    assert(!current_ref);
+    if (options.dry_run)
+        return std::string();
+
+    auto r = refs.find(ref_name);
+    if (r == refs.end())
+        return std::string();
+
+    ref::rev_mark_map::value_type m;
+    if (!r->second.marks.find_at_or_before(revnum, m))
+        return std::string();
+
+    // Another writer can only copy what's in the packs of the one
+    // that wrote the commit
+    std::size_t const w = writer_of_mark(m.second);
+    if (w != writer_for(dst_ref_name))
+        settle(w, m.second);
+
+    // The tree of a commit kept by this run is known
+    if (options.tree_model)
+    {
+        auto const tree = r->second.tree_history.find(m.second);
+        if (tree != r->second.tree_history.end())
+        {
+            auto const found = tree->second.find(git_path.str());
+            if (!found)
+                return std::string();
+            std::string object = found->str();
+            looked_up_objects[object] = *found;
+            return object;
+        }
+    }
+    if (git_fast_import::spooling())
+        return std::string();
+
+    read_commit_shas();
+    writer(w).send_ls(
+        ":" + std::to_string(m.second) + " "
+        + (git_path.str().empty() ? "\"\"" : git_path.str()));
+
+    // <mode> SP ('blob' | 'tree' | 'commit') SP <dataref> HT <path>
+    std::string response = writer(w).readline();
+    std::size_t mode_end = response.find(' ');
+    std::size_t type_end = response.find(' ', mode_end + 1);
+    std::size_t sha_end = response.find('\t', type_end + 1);
+    if (boost::starts_with(response, "missing ") || sha_end == std::string::npos)
+        return std::string();
+
+    return response.substr(0, mode_end) + " " 
+        + response.substr(type_end + 1, sha_end - type_end - 1);
+}
+
+void git_repository::commit_sha(int mark, char* sha)
+{
+    bool found = commit_shas.find(mark, sha);
+    if (!found && !requested_marks.empty())
+    {
+        read_commit_shas();
+        found = commit_shas.find(mark, sha);
+    }
+    if (!found && mark <= resumed_last_mark)
+    {
+        read_marks_file();
+        found = commit_shas.find(mark, sha);
+    }
+    if (!found)
+    {
+        throw std::runtime_error(
+            "No SHA-1 known for mark :" + std::to_string(mark) + " in repository " + name());
+    }
+}
+
+void git_repository::read_commit_shas()
+{
+    for (int mark : requested_marks)
+    {
+        profile::scope _("get-mark round trips", &name());
+        std::string const sha = fast_import().readline();
+        if (sha.size() != mark_sha_map::sha_length || !commit_shas.insert(mark, sha.data()))
+        {
+            throw std::runtime_error(
+                "Unrecognized response \"" + sha + "\" to get-mark in repository " + name());
+        }
+    }
+    requested_marks.clear();
+}
+
+// Learn the SHA-1s of the commits written by the run being resumed,
+// which fast-import exported at its last checkpoint
+void git_repository::read_marks_file()
+{
+    std::string const marks_path = marks_file_path(git_dir);
+    std::ifstream marks(marks_path.c_str());
+    if (!marks)
+        throw std::runtime_error("Couldn't open marks file: " + marks_path);
+
+    char colon;
+    int mark;
+    std::string sha;
+    while (marks >> colon >> mark >> sha)
+    {
+        if (colon != ':' || sha.size() != mark_sha_map::sha_length)
+            throw std::runtime_error("Malformed marks file: " + marks_path);
+        // A followed shadow reads the file again as it grows
+        if (mark <= resumed_last_mark && !commit_shas.insert(mark, sha.data())
+            && role != followed_shadow)
+            throw std::runtime_error("Malformed marks file: " + marks_path);
+    }
+    // The SHA-1s of all of them are known now
+    resumed_last_mark = 0;
+}
+
+void git_repository::record_ancestor(
+    ref* descendant, std::string const& src_ref_name, std::size_t revnum)
+{
+    // Don't bother recording merges from one branch into itself; that
+    // ancestry is already going to be represented.
+    if (src_ref_name != descendant->name)
+    {
+        auto src_ref = demand_ref(src_ref_name);
+
+        // The copy mustn't miss submodule commits put off
+        if (!src_ref->deferred_submodule_refs.empty() && src_ref->deferred_first_revnum <= revnum)
+        {
+            if (modified_refs.count(src_ref))
+                src_ref->submodule_commit_due = true;
+            else
+                flush_submodule_commit(src_ref);
+        }
+
+        // Update the latest source revision merged
+        auto& merged_rev = descendant->pending_merges[src_ref];
+        if (merged_rev < revnum)
+            merged_rev = revnum;
+    }
+}
+
+void git_repository::alias_ref(ref* tag, std::string const& src_ref_name, std::size_t revnum)
+{
+    auto const src = refs.find(src_ref_name);
+    ref::rev_mark_map::value_type m;
+    if (!tag->marks.empty() || src == refs.end() || !src->second.marks.find_at_or_before(revnum, m))
+        return;
+    tag->alias_source = &src->second;
+    tag->alias_mark = m.second;
+}
+
+git_repository::ref* git_repository::modify_ref(ref* r, bool allow_discovery)
+{
+    assert(r->repo == this);
+    bool already_modified = modified_refs.count(r);
+    if (!already_modified)
+    {
+        if (!allow_discovery)
+            return nullptr;
+
+        Log::trace() << "In Git repo " << this->name() << ", marking " << r->name 
+                     << " for modification" << std::endl;
+
+        modified_refs.insert(r);
+
+        if (super_module)
+        {
+            ref* const s = r->super_module_ref 
+                ? r->super_module_ref : super_module->demand_ref(r->name);
+            if (auto super_module_ref = super_module->modify_ref(s, allow_discovery))
+            {
+                Log::trace() << "Marking super-module " << super_module_ref->repo->name() 
+                             << ", ref " << r->name << " for modification" << std::endl;
+                super_module_ref->changed_submodule_refs.insert(r);
+            }
+        }
+    }
+
+    return r;
+}
+
+
+void git_repository::retire_ref(ref* r)
+{
+    assert(r->repo == this && !modified_refs.count(r));
+    if (has_submodules_)
+        return;
+    Log::trace() << "In Git repo " << git_dir << ", retiring " << r->name << std::endl;
+
+    // Swapped with empty containers, to free their storage
+    ref::merge_map().swap(r->merged_revisions);
+    ref::merge_map().swap(r->pending_merges);
+    ref::merge_map().swap(r->merged_marks);
+    ref::merge_map().swap(r->open_merged_marks);
+    std::vector<std::pair<path, std::string> >().swap(r->pending_tree_copies);
+    std::string().swap(r->gitmodules);
+    r->marks.shrink_to_fit();
+
+    // Copies from the ref ask fast-import for its trees instead
+    r->tree = tree_model();
+    r->head_tree = tree_model();
+    r->tree_known = r->head_tree_known = false;
+    boost::container::flat_map<int, tree_model>().swap(r->tree_history);
+}
+
+void git_repository::stop_fast_import()
+{
+    assert(!current_ref);
+    write_notes();
+    read_commit_shas();
+    for (std::size_t i = 0; i < writers(); ++i)
+        writer(i).stop();
+    settle_all();
+
+    // The next process doesn't know where the refs are, just as when
+    // resuming from a checkpoint
+    for (auto& kv : refs)
+        kv.second.needs_from = !kv.second.marks.empty();
+}
+
+void git_repository::write_notes()
+{
+    assert(!current_ref);
+    if (pending_notes.empty())
+        return;
+    profile::scope _("write notes", &name());
+
+    // The notes ref keeps its marks like any other, so that it's
+    // saved, resumed and rewound along with the commits it annotates
+    ref* const notes = demand_ref("refs/notes/svn");
+    int const mark = last_mark = fast_import().next_mark(last_mark);
+    notes->marks.push_back(pending_notes.back().second, mark);
+    fast_import().commit(
+        notes->name, mark, *notes_committer, notes_epoch,
+        "Notes on the SVN revisions of " + std::to_string(pending_notes.size()) + " commits\n");
+    if (notes->needs_from)
+    {
+        if (notes->marks.size() >= 2)
+            fast_import() << "from :" << notes->marks.penultimate().second << LF;
+        notes->needs_from = false;
+    }
+    for (auto const& n : pending_notes)
+        fast_import().note(":" + std::to_string(n.first), "[SVN r" + std::to_string(n.second) + "]\n");
+    fast_import() << LF;
+    pending_notes.clear();
+}
+
+bool git_repository::checkpoint()
+{
+    bool active = false;
+    for (std::size_t i = 0; i < writers(); ++i)
+    {
+        if (writer(i).active())
+        {
+            writer(i).checkpoint();
+            active = true;
+        }
+    }
+    return active;
+}
+
+void git_repository::wait_for_checkpoint(std::string const& progress)
+{
+    for (std::size_t i = 0; i < writers(); ++i)
+    {
+        if (writer(i).active())
+            writer(i).wait_for_progress(progress);
+    }
+    settle_all();
+}
+
+void git_repository::join_writers_marks() const
+{
+    if (extra_writers.empty())
+        return;
+    std::string const marks_path = marks_file_path(git_dir);
+    std::ofstream out(marks_path.c_str(), std::ios::app);
+    for (auto const& w : extra_writers)
+    {
+        std::ifstream in(w->exported_marks().c_str());
+        if (in.peek() != std::ifstream::traits_type::eof())
+            out << in.rdbuf();
+    }
+    if (!out.flush())
+        throw std::runtime_error("Couldn't write marks file: " + marks_path);
+    for (auto const& w : extra_writers)
+        boost::filesystem::remove(w->exported_marks());
+    Log::info() << "joined the marks of " << writers() << " fast-imports in " << git_dir
+                << ", " << fences << " of whose checkpoints settled commits for the others"
+                << std::endl;
+}
+
+std::string git_repository::committish(int mark)
+{
+    std::size_t const w = writer_of_mark(mark);
+    if (w == (current_ref ? current_ref->writer : 0))
+        return ":" + std::to_string(mark);
+
+    // Known once its writer has settled it
+    char sha[mark_sha_map::sha_length];
+    if (commit_shas.find(mark, sha))
+        return std::string(sha, sizeof(sha));
+    settle(w, mark);
+    writer(w).send_get_mark(mark);
+    std::string const response = writer(w).readline();
+    if (response.size() != mark_sha_map::sha_length || !commit_shas.insert(mark, response.data()))
+    {
+        throw std::runtime_error(
+            "Unrecognized response \"" + response + "\" to get-mark in repository " + name());
+    }
+    return response;
+}
+
+void git_repository::settle(std::size_t w, int mark)
+{
+    if (mark <= settled_marks[w])
+        return;
+    git_fast_import& f = writer(w);
+    if (f.active())
+    {
+        profile::scope _("settle writers", &name());
+        Log::debug() << "In Git repo " << git_dir << ", checkpointing writer " << w
+                     << " for :" << mark << std::endl;
+        f.checkpoint();
+        f.wait_for_progress("settle " + std::to_string(++fences));
+    }
+    settled_marks[w] = last_mark;
+    unsettled_blobs[w].clear();
+}
+
+void git_repository::settle_all()
+{
+    for (std::size_t w = 0; w < settled_marks.size(); ++w)
+    {
+        settled_marks[w] = last_mark;
+        unsettled_blobs[w].clear();
+    }
+}
+
+bool git_repository::readable_blob(std::string const& sha) const
+{
+    if (extra_writers.empty())
+        return true;
+    std::size_t const current = current_ref ? current_ref->writer : 0;
+    object_id const id = object_id::from_hex(sha);
+    for (std::size_t w = 0; w < unsettled_blobs.size(); ++w)
+    {
+        if (w != current && unsettled_blobs[w].count(id))
+            return false;
+    }
+    return true;
+}
+
+std::size_t git_repository::prune_branches()
+{
+    assert(!current_ref);
+    if (options.dry_run || is_shadow())
+        return 0;
+    read_commit_shas();
+
+    auto const master = refs.find("refs/heads/master");
+    ref const* const head = master == refs.end() ? nullptr : &master->second;
+
+    std::vector<ref*> branches;
+    for (auto& kv : refs)
+    {
+        ref& r = kv.second;
+        if (&r != head && !r.marks.empty() && boost::starts_with(r.name, "refs/heads/"))
+            branches.push_back(&r);
+    }
+    // In order, so that conversions write the same stream
+    std::sort(branches.begin(), branches.end(),
+              [](ref const* x, ref const* y) { return x->name < y->name; });
+
+    // Ask fast-import for the trees we don't know, all at once
+    std::vector<ref*> stale;
+    for (auto r : branches)
+    {
+        if (r->head_tree_sha_stale)
+        {
+            fast_import().send_ls(committish(r->marks.back().second) + " \"\"");
+            stale.push_back(r);
+        }
+    }
+    for (auto r : stale)
+    {
+        r->head_tree_sha = read_ls_tree_sha(r->name);
+        r->head_tree_sha_stale = false;
+    }
+
+    std::size_t pruned = 0;
+    for (auto r : branches)
+    {
+        bool merged = false;
+        if (head)
+        {
+            auto const m = head->merged_marks.find(r);
+            merged = m != head->merged_marks.end()
+                && m->second == r->marks.back().second;
+        }
+        if (merged || r->head_tree_sha == object_id::from_hex(empty_tree_sha))
+        {
+            Log::debug() << "In Git repo " << git_dir << ", deleting "
+                         << (merged ? "merged" : "empty") << " branch " << r->name << std::endl;
+            writer(r->writer).delete_ref(r->name);
+            ++pruned;
+        }
+    }
+    if (pruned > 0)
+        Log::info() << "deleted " << pruned << " branches from " << git_dir << std::endl;
+    return pruned;
+}
+
+void git_repository::push(std::string const& remote) const
+{
+    if (options.dry_run || is_shadow())
+        return;
+
+    profile::scope _("push", &git_dir);
+    mirror(git_dir, remote);
+}
+
+void git_repository::mirror(std::string const& git_dir, std::string const& remote)
+{
+    namespace process = boost::process;
+    using namespace process::initializers;
+    std::string const url = boost::algorithm::replace_all_copy(remote, "%n", git_dir);
+    std::array<std::string, 5> git_args = { git_executable(), "push", "--mirror", "--quiet", url };
+    auto git_push = process::execute(
+        run_exe(git_executable()),
+        set_args(git_args),
+        start_in_dir(git_dir),
+        throw_on_error());
+    int const status = wait_for_exit(git_push);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        throw std::runtime_error("git push to " + url + " failed in " + git_dir);
+}
+
+git_repository::serving_stats git_repository::repack(unsigned threads) const
+{
+    namespace process = boost::process;
+    using namespace process::initializers;
+    serving_stats stats = serving_stats();
+    if (options.dry_run || is_shadow())
+        return stats;
+
+    auto git = [this](std::vector<std::string> const& args) {
+        auto git_process = process::execute(
+            run_exe(git_executable()),
+            set_args(args),
+            start_in_dir(git_dir),
+            throw_on_error());
+        int const status = wait_for_exit(git_process);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            throw std::runtime_error("git " + args[args[1] == "-c" ? 3 : 1] + " failed in " + git_dir);
+    };
+
+    // A bare clone through upload-pack, as a remote one would be
+    // served, into a directory removed afterwards
+    auto clone_seconds = [&] {
+        namespace fs = boost::filesystem;
+        fs::path const dir = fs::temp_directory_path() / fs::unique_path("svn2git-clone-%%%%-%%%%-%%%%");
+        auto const start = std::chrono::steady_clock::now();
+        try
+        {
+            git({ git_executable(), "-c", "pack.threads=" + std::to_string(threads), "clone",
+                  "--bare", "--no-local", "-q", fs::absolute(git_dir).string(), dir.string() });
+        }
+        catch (...)
+        {
+            boost::system::error_code ec;
+            fs::remove_all(dir, ec);
+            throw;
+        }
+        double const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        fs::remove_all(dir);
+        return seconds;
+    };
+
+    std::vector<std::string> repack = {
+        git_executable(), "repack", "-a", "-d", "-l", "-q", "--threads=" + std::to_string(threads) };
+    if (options.serve_packs)
+    {
+        stats.bytes_before = pack_bytes();
+        stats.clone_seconds_before = clone_seconds();
+
+        // Kept in the repository's configuration, so that the
+        // server's own repacks go on writing bitmaps, and deltas
+        // between objects of heads and objects only tags reach,
+        // which a clone of the heads would have to undo, are never
+        // made
+        git({ git_executable(), "config", "pack.island", "refs/(heads|tags)/" });
+        git({ git_executable(), "config", "repack.writeBitmaps", "true" });
+        repack.insert(repack.end(), {
+            "-f", "--delta-islands", "--window=250", "--depth=50",
+            "--window-memory=" + std::to_string(options.serve_window_memory) + "m" });
+    }
+    // What --fast-ingest left uncompressed, with short delta chains,
+    // is all compressed and deltified afresh
+    else if (options.fast_ingest)
+        repack.push_back("-f");
+    git(repack);
+    if (options.serve_packs)
+        git({ git_executable(), "commit-graph", "write", "--reachable", "--changed-paths" });
+    else
+        git({ git_executable(), "commit-graph", "write", "--reachable" });
+
+    if (options.serve_packs)
+    {
+        stats.bytes_after = pack_bytes();
+        stats.clone_seconds_after = clone_seconds();
+    }
+    return stats;
+}
+
+std::size_t git_repository::pack_refs() const
+{
+    namespace process = boost::process;
+    using namespace process::initializers;
+    if (options.dry_run || is_shadow())
+        return 0;
+
+    std::array<std::string, 4> git_args = { git_executable(), "pack-refs", "--all", "--prune" };
+    auto git_pack_refs = process::execute(
+        run_exe(git_executable()),
+        set_args(git_args),
+        start_in_dir(git_dir),
+        throw_on_error());
+    int const status = wait_for_exit(git_pack_refs);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        throw std::runtime_error("git pack-refs failed in " + git_dir);
+
+    // Each line is a ref but the header and the peeled tags' lines,
+    // which begin with '#' and '^'
+    std::size_t count = 0;
+    std::ifstream packed((boost::filesystem::path(git_dir) / "packed-refs").c_str());
+    for (std::string line; std::getline(packed, line);)
+    {
+        if (!line.empty() && line[0] != '#' && line[0] != '^')
+            ++count;
+    }
+    return count;
+}
+
+std::uint64_t git_repository::pack_bytes() const
+{
+    namespace fs = boost::filesystem;
+    std::uint64_t result = 0;
+    boost::system::error_code ec;
+    for (fs::directory_iterator p(fs::path(git_dir) / "objects" / "pack", ec), end; p != end; p.increment(ec))
+    {
+        if (p->path().extension() != ".pack")
+            continue;
+        std::uint64_t const size = fs::file_size(p->path(), ec);
+        if (!ec)
+            result += size;
+    }
+    return result;
+}
+
+void git_repository::split_from_host(std::string const& host_dir) const
+{
+    namespace fs = boost::filesystem;
+    namespace iostreams = boost::iostreams;
+    using namespace boost::process::initializers;
+    if (options.dry_run)
+        return;
+
+    add_alternate(fs::path(git_dir) / "objects" / "info" / "alternates",
+                  fs::absolute(fs::path(host_dir) / "objects").string());
+    {
+        std::ifstream in(marks_file_path(host_dir).c_str(), std::ios::binary);
+        std::ofstream out(marks_file_path(git_dir).c_str(), std::ios::binary | std::ios::trunc);
+        if (in && !(out << in.rdbuf()))
+            throw std::runtime_error("Couldn't write " + marks_file_path(git_dir));
+    }
+
+    auto git = [](std::string const& dir, std::vector<std::string> const& args,
+                  std::string const& input, std::string const& output) {
+        iostreams::file_descriptor_source in(input);
+        iostreams::file_descriptor_sink out(output);
+        auto git_process = boost::process::execute(
+            run_exe(git_executable()),
+            set_args(args),
+            start_in_dir(dir),
+            bind_stdin(in),
+            bind_stdout(out),
+            throw_on_error());
+        int const status = wait_for_exit(git_process);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            throw std::runtime_error("git " + args[1] + " failed in " + dir);
+    };
+
+    // The refs are listed as the commands that create them here, with
+    // the namespace's components stripped from their names
+    std::string const& prefix = fast_import().ref_prefix();
+    std::string const commands = git_dir + "/svn2git-hosted-refs";
+    git(host_dir,
+        { git_executable(), "for-each-ref",
+          "--format=update %(refname:lstrip="
+          + std::to_string(std::count(prefix.begin(), prefix.end(), '/'))
+          + ") %(objectname)", prefix },
+        "/dev/null", commands);
+    git(git_dir, { git_executable(), "update-ref", "--stdin" }, commands, "/dev/null");
+    fs::remove(commands);
+}
+
+void git_repository::account_memory(memory_report::sample& bytes) const
+{
+    // Hash table nodes are reckoned at two pointers and a bucket
+    std::uint64_t const node = 3 * sizeof(void*);
+
+    std::uint64_t& refs_bytes = bytes["refs"];
+    std::uint64_t& marks_bytes = bytes["marks"];
+    for (auto const& kv : refs)
+    {
+        ref const& r = kv.second;
+        refs_bytes += node + sizeof(kv) + 2 * memory_report::heap_bytes(r.name)
+            + (r.merged_revisions.capacity() + r.merged_marks.capacity()
+               + r.open_merged_marks.capacity()) * sizeof(ref::merge_map::value_type)
+            + memory_report::heap_bytes(r.gitmodules);
+        marks_bytes += r.marks.bytes_held();
+    }
+    marks_bytes += merge_graph.bytes_held();
+    for (auto const& kv : followed_marks)
+        marks_bytes += node + sizeof(kv) + memory_report::heap_bytes(kv.first) + kv.second.bytes_held();
+    marks_bytes += commit_shas.bytes_held();
+
+    // Content keys and SHA-1s are all of about the same length
+    std::uint64_t blob_bytes = unshared_blobs.capacity() * sizeof(void*);
+    if (!blobs.empty())
+    {
+        auto const& some = *blobs.begin();
+        blob_bytes += blobs.size() * (node + sizeof(some) + memory_report::heap_bytes(some.first)
+                                      + memory_report::heap_bytes(some.second));
+        blob_bytes += blob_shas.size() * (node + sizeof(object_id));
+    }
+    bytes["blob names"] += blob_bytes;
+}
+
+void git_repository::save_state(std::size_t revnum) const
+{
+    assert(!current_ref);
+    if (options.dry_run || is_shadow())
+        return;
+
+    state_file::writer w;
+    w.word(revnum).word(last_mark).word(refs.size());
+    for (auto const& kv : refs)
+    {
+        ref const& r = kv.second;
+        w.str(r.name);
+
+        w.word(r.marks.size());
+        for (auto const& m : r.marks)
+            w.word(m.first).word(m.second);
+
+        w.word(r.merged_revisions.size());
+        for (auto const& m : r.merged_revisions)
+            w.str(m.first->name).word(m.second);
+
+        w.word(r.merged_marks.size());
+        for (auto const& m : r.merged_marks)
+            w.str(m.first->name).word(m.second);
+
+        w.str(r.head_tree_sha.is_null() ? std::string() : r.head_tree_sha.hex())
+            .word(r.head_tree_sha_stale).word(r.gitattributes_outdated);
+
+        w.word(r.submodule_refs.size());
+        for (auto const* sr : r.submodule_refs)
+            w.str(sr->repo->name()).str(sr->name);
+    }
+
+    w.word(blobs.size());
+    for (auto const& kv : blobs)
+        w.str(kv.first).str(kv.second);
+
+    w.save(state_file_path());
+}
+
+std::size_t git_repository::load_state(
+    std::function<ref*(std::string const&, std::string const&)> const& find_ref)
+{
+    if (!boost::filesystem::exists(state_file_path()))
+        return 0;
+
+    state_file::reader in(state_file_path());
+    std::size_t const revnum = in.word();
+    last_mark = in.word();
+    resumed_last_mark = last_mark;
+    for (auto n = in.word(); n > 0; --n)
+    {
+        ref& r = *demand_ref(in.str());
+
+        for (auto m = in.word(); m > 0; --m)
+        {
+            std::size_t const rev = in.word();
+            r.marks.push_back(rev, in.word());
+        }
+
+        for (auto m = in.word(); m > 0; --m)
+        {
+            ref const* src = demand_ref(in.str());
+            r.merged_revisions[src] = in.word();
+        }
+
+        for (auto m = in.word(); m > 0; --m)
+        {
+            ref const* src = demand_ref(in.str());
+            r.merged_marks[src] = in.word();
+        }
+
+        // Earlier runs kept the tab ending fast-import's "ls" response
+        std::string const head_tree_sha = in.str();
+        r.head_tree_sha = head_tree_sha.size() >= object_id::hex_size
+            ? object_id::from_hex(head_tree_sha.c_str()) : object_id();
+        r.head_tree_sha_stale = in.word();
+        // The tree written by the run being resumed isn't modeled
+        r.tree_known = r.head_tree_known = r.marks.empty();
+        r.gitattributes_outdated = in.word();
+
+        for (auto m = in.word(); m > 0; --m)
+        {
+            std::string const repo_name = in.str();
+            r.submodule_refs.insert(find_ref(repo_name, in.str()));
+        }
+
+        r.needs_from = !r.marks.empty();
+    }
+
+    for (auto n = in.word(); n > 0; --n)
+    {
+        std::string key = in.str();
+        remember_blob(std::move(key), in.str());
+    }
+
+    Log::info() << "restored " << git_dir << " as of r" << revnum << std::endl;
+    return revnum;
+}
+
+void git_repository::follow(std::size_t revnum)
+{
+    if (role != followed_shadow || followed_revnum >= revnum)
+        return;
+
+    profile::scope _("following shards", &name());
+    read_followed_state();
+    if (followed_revnum >= revnum)
+        return;
+
+    Log::info() << "waiting for r" << revnum << " in " << git_dir << std::endl;
+    do
+    {
+        ::sleep(1);
+        read_followed_state();
+    }
+    while (followed_revnum < revnum);
+}
+
+// Read the marks of the refs from the state last saved by the process
+// converting this repository; the rest is of no use to a shadow.
+void git_repository::read_followed_state()
+{
+    if (!boost::filesystem::exists(state_file_path()))
+        return;
+
+    state_file::reader in(state_file_path());
+    std::size_t const revnum = in.word();
+    if (revnum <= followed_revnum)
+        return;
+
+    followed_revnum = revnum;
+    // Commit SHA-1s up to its last mark are in its marks file
+    resumed_last_mark = in.word();
+    read_saved_marks(in, followed_marks);
+}
+
+git_repository::marks_by_ref git_repository::saved_marks(
+    std::string const& git_dir, std::size_t& revnum)
+{
+    marks_by_ref result;
+    revnum = 0;
+    if (!boost::filesystem::exists(state_file_path(git_dir)))
+        return result;
+
+    state_file::reader in(state_file_path(git_dir));
+    revnum = in.word();
+    in.word();  // last_mark
+    read_saved_marks(in, result);
+    return result;
+}
+
+// Read the refs saved by save_state, following its header, keeping
+// only the marks of their commits
+void git_repository::read_saved_marks(state_file::reader& in, marks_by_ref& marks_of)
+{
+    for (auto n = in.word(); n > 0; --n)
+    {
+        auto& marks = marks_of[in.str()];
+        marks.clear();
+        for (auto m = in.word(); m > 0; --m)
+        {
+            std::size_t const rev = in.word();
+            marks.push_back(rev, in.word());
+        }
+
+        for (int map = 0; map < 2; ++map)  // merged_revisions and merged_marks
+        {
+            for (auto m = in.word(); m > 0; --m)
+            {
+                in.str();
+                in.word();
+            }
+        }
+
+        in.str();   // head_tree_sha
+        in.word();  // head_tree_sha_stale
+        in.word();  // gitattributes_outdated
+
+        for (auto m = in.word(); m > 0; --m)
+        {
+            in.str();
+            in.str();
+        }
+    }
+}
+
+int git_repository::followed_mark(ref const& r, std::size_t revnum) const
+{
+    auto const p = followed_marks.find(r.name);
+    if (p == followed_marks.end())
+        return 0;
+    ref::rev_mark_map::value_type m;
+    if (!p->second.find_at_or_before(revnum, m) || m.first != revnum)
+        return 0;
+    return int(m.second);
+}
+
+void git_repository::adopt_followed_marks(std::size_t revnum)
+{
+    follow(revnum);
+    for (auto const& kv : followed_marks)
+    {
+        auto& marks = demand_ref(kv.first)->marks;
+        marks = kv.second;
+        marks.truncate(revnum);
+    }
+}
+
+void git_repository::rewind(std::size_t revnum)
+{
+    assert(!current_ref && role == converted);
+    pending_notes.erase(
+        std::remove_if(pending_notes.begin(), pending_notes.end(),
+                       [revnum](std::pair<int, std::size_t> const& n) { return n.second > revnum; }),
+        pending_notes.end());
+    for (auto& kv : refs)
+    {
+        ref& r = kv.second;
+        if (r.marks.empty() || r.marks.back().first <= revnum)
+            continue;
+        r.marks.truncate(revnum);
+        r.tree_history.clear();
+        r.tree = r.head_tree = tree_model();
+        r.tree_known = r.head_tree_known = r.marks.empty();
+
+        // Which of the merges were made by the commits forgotten is
+        // unknown; naming an ancestor as a parent again is harmless,
+        // unlike leaving out a merge
+        r.merged_revisions.clear();
+        r.merged_marks.clear();
+
+        if (r.marks.empty())
+        {
+            fast_import().delete_ref(r.name);
+            r.head_tree_sha = object_id();
+            r.head_tree_sha_stale = false;
+        }
+        else
+        {
+            fast_import().reset(r.name, r.marks.back().second);
+            r.head_tree_sha_stale = true;
+        }
+        r.needs_from = !r.marks.empty();
+    }
+    Log::info() << "rewound " << git_dir << " to r" << revnum << std::endl;
+}
+
+void git_repository::replay(std::size_t revnum, std::size_t saved_revnum)
+{
+    assert(!current_ref && role == converted);
+    role = followed_shadow;
+    fast_import_.discard_commands();
+    followed_revnum = saved_revnum;
+    followed_marks.clear();
+    for (auto& kv : refs)
+    {
+        auto& marks = kv.second.marks;
+        followed_marks[kv.first] = marks;
+        marks.truncate(revnum);
+    }
+    Log::info() << "replaying " << git_dir << " from r" << revnum + 1 
+                << " to r" << saved_revnum << std::endl;
+}
+
+bool git_repository::end_replay(std::size_t revnum)
+{
+    if (revnum <= followed_revnum)
+        return false;
+
+    assert(!current_ref && role == followed_shadow);
+    role = converted;
+    fast_import_.discard_commands(false);
+    for (auto& kv : followed_marks)
+    {
+        ref& r = *demand_ref(kv.first);
+        r.marks = std::move(kv.second);
+        r.needs_from = !r.marks.empty();
+        r.tree_known = r.head_tree_known = r.marks.empty();
+    }
+    followed_marks.clear();
+    return true;
+}
@@ -4,20 +4,73 @@
 #ifndef GIT_REPOSITORY_DWA2013614_HPP
 # define GIT_REPOSITORY_DWA2013614_HPP
 
+# include "commit_graph.hpp"
 # include "git_fast_import.hpp"
+# include "mark_sha_map.hpp"
+# include "memory_report.hpp"
+# include "object_id.hpp"
+# include "object_store.hpp"
 # include "path_set.hpp"
 # include "path.hpp"
+# include "rev_mark_map.hpp"
 # include "svn.hpp"
+# include "tree_model.hpp"
 # include <boost/container/flat_map.hpp>
 # include <boost/container/flat_set.hpp>
+# include <functional>
+# include <memory>
+# include <tuple>
 # include <unordered_map>
+# include <unordered_set>
+# include <vector>
+
+namespace state_file { struct reader; }
 
 struct git_repository
 {
-    explicit git_repository(std::string const& git_dir);
+    // With --shard, a repository converted by another process is a
+    // shadow here: its commits are worked out as usual, but nothing
+    // is written for them.  A followed shadow also reads the state the
+    // other process saves at its checkpoints, to learn which of those
+    // commits were kept and their marks, so that a super-module
+    // converted here can refer to them.
+    enum role_type { converted, shadow, followed_shadow };
+
+    explicit git_repository(
+        std::string const& git_dir, role_type role = converted, std::size_t id = 0);
+    bool is_shadow() const { return role != converted; }
+
+    // The repository's number, counting from 0 in the order the
+    // importer created them, by which it keeps sets of repositories
+    // as bitsets; see dense_set
+    std::size_t id() const { return id_; }
     void set_super_module(git_repository* super_module, std::string const& submodule_path);
     
-    git_fast_import& fast_import() { return fast_import_; }
+    // The fast-import writing the open commit's ref, or with none
+    // open, the repository's first
+    git_fast_import& fast_import() { return current_ref ? writer(current_ref->writer) : fast_import_; }
+    git_fast_import const& fast_import() const
+    {
+        return current_ref ? writer(current_ref->writer) : fast_import_;
+    }
+
+    // With --ref-writers, have n fast-imports write the repository at
+    // once, each a share of its refs; see writer_for.  Only callable
+    // before any ref is made.
+    void add_writers(std::size_t n);
+
+    // The fast-imports writing the repository, the first of which is
+    // the one it always has
+    std::size_t writers() const { return 1 + extra_writers.size(); }
+    git_fast_import& writer(std::size_t i) { return i == 0 ? fast_import_ : *extra_writers[i - 1]; }
+    git_fast_import const& writer(std::size_t i) const
+    {
+        return i == 0 ? fast_import_ : *extra_writers[i - 1];
+    }
+
+    // The writer of the named ref: the first for master, the busiest,
+    // and one of the rest, picked by a hash of its name, for any other
+    std::size_t writer_for(std::string const& ref_name) const;
 
     // A branch or tag
     struct ref
@@ -28,13 +81,26 @@ struct git_repository
                 repo->super_module ? repo->super_module->demand_ref(name) : nullptr
             )
             , submodule_refs_written(0)
+            , head_tree_sha_stale(false)
             , gitattributes_outdated(!options.gitattributes.empty())
+            , needs_from(false)
+            , tree_known(true)
+            , head_tree_known(true)
+            , alias_source(nullptr)
+            , alias_mark(0)
+            , submodule_commit_due(false)
+            , deferred_first_revnum(0)
+            , deferred_first_epoch(0)
+            , deferred_revnum(0)
+            , deferred_committer(nullptr)
+            , deferred_epoch(0)
+            , writer(repo->writer_for(name))
         {}
 
-        typedef boost::container::flat_map<std::size_t, std::size_t> rev_mark_map;
+        typedef ::rev_mark_map rev_mark_map;
 
         // Maps a Git ref into an SVN revision from that ref that has
-        // been merged into this ref.
+        // been merged into this ref, or into one of its marks.
         typedef boost::container::flat_map<ref const*, std::size_t> merge_map;
 
         // An open ref in a super-module can be committed only when every
@@ -50,9 +116,21 @@ struct git_repository
         rev_mark_map marks;
         merge_map merged_revisions;
         merge_map pending_merges;
+        // The last mark of each ref merged by a commit kept in this
+        // ref, and so surely among its ancestors; and those merged by
+        // the open commit, which count only if it is kept
+        merge_map merged_marks;
+        merge_map open_merged_marks;
         path_set pending_deletions;
+        // Git paths to be replaced by existing trees or blobs, each
+        // given as "<mode> <sha>", written after the deletions
+        std::vector<std::pair<path, std::string> > pending_tree_copies;
         // Submodule refs included in the previous commit
         boost::container::flat_set<ref const*> submodule_refs;
+        // The .gitmodules describing them, and its blob's SHA-1 or
+        // the empty string if it has yet to be made
+        std::string gitmodules;
+        std::string gitmodules_sha;
         // Submodule refs modified in the current commit
         boost::container::flat_set<ref const*> changed_submodule_refs;
         // How many of the changed submodule refs have been written in this commit
@@ -61,23 +139,167 @@ struct git_repository
         // itself may not have changed but the part of the
         // super-module where it lives is being rewritten.
         boost::container::flat_set<ref const*> stale_submodule_refs;
-        std::string head_tree_sha;
+        // The SHA-1 of the last commit's tree, null if unknown.
+        // Whether it was read from an ls or computed by the tree
+        // model, it is held the same way, so close_commit can compare
+        // one with the other.
+        object_id head_tree_sha;
+        // True when the last commit was kept without asking
+        // fast-import for its tree, so head_tree_sha is out of date
+        bool head_tree_sha_stale;
         bool gitattributes_outdated;
+        // True when the ref was restored from a checkpoint and its
+        // next commit must name its parent explicitly, since this
+        // fast-import process hasn't seen the ref before
+        bool needs_from;
+        // With --tree-model, the tree of the open commit, or of the
+        // last one kept if none is open, and of the last one kept;
+        // each is known unless it holds something written by an
+        // earlier run, or copied from a tree that isn't known.  The
+        // trees kept by each commit, by mark, are kept for lookup.
+        tree_model tree;
+        tree_model head_tree;
+        bool tree_known;
+        bool head_tree_known;
+        boost::container::flat_map<int, tree_model> tree_history;
+        // With --tree-model, the deletions of the open commit, which
+        // are put off until it closes, and the tree before them.  A
+        // file rewritten beneath them as it was needn't be written,
+        // and only what isn't rewritten is deleted, so moving a
+        // subtree between rules costs only what differs.
+        path_set remapped;
+        tree_model remap_base;
+        // With --lightweight-tags, the ref and mark of the commit this
+        // one is to be, if any, instead of a commit of its own
+        ref* alias_source;
+        int alias_mark;
+        // With --coalesce-submodule-revisions or -seconds, the
+        // submodule refs whose new commits this super-module branch
+        // has yet to record, the first SVN revision that made one and
+        // its time, and the last such revision, whose committer and
+        // time the commit recording them all takes.  A due commit is
+        // never put off, e.g. because the branch is being copied.
+        bool submodule_commit_due;
+        boost::container::flat_set<ref const*> deferred_submodule_refs;
+        std::size_t deferred_first_revnum;
+        unsigned int deferred_first_epoch;
+        std::size_t deferred_revnum;
+        std::string const* deferred_committer;
+        unsigned int deferred_epoch;
+        // The fast-import writing the ref; see writer_for
+        std::size_t writer;
     };
 
     ref* demand_ref(std::string const& name)
     {
-        auto p = refs.emplace(name, ref(name, this)).first;
+        auto p = refs.find(name);
+        if (p == refs.end())
+        {
+            p = refs.emplace(
+                std::piecewise_construct, 
+                std::forward_as_tuple(name), std::forward_as_tuple(name, this)).first;
+        }
         return &p->second;
     }
 
-    ref* modify_ref(std::string const& name, bool allow_discovery = true);
+    // The named ref, or null if it has yet to be made
+    ref* find_ref(std::string const& name)
+    {
+        auto p = refs.find(name);
+        return p == refs.end() ? nullptr : &p->second;
+    }
+
+    // Release what r holds only for commits of its own, once the rules
+    // will make no more: its merges, its modeled trees and their
+    // history, and for a super-module, its submodules.  Its marks,
+    // packed tight, and its last tree's SHA-1 are kept, for merges and
+    // copies from it, checkpoints and --prune-branches.  Only callable
+    // when r isn't modified, and does nothing in a super-module, whose
+    // refs its submodules' commits modify.
+    void retire_ref(ref* r);
 
-    // Begins a commit; returns the ref currently being written.
+    ref* modify_ref(std::string const& name, bool allow_discovery = true)
+    {
+        return modify_ref(demand_ref(name), allow_discovery);
+    }
+
+    // As above, for a ref of this repository already found
+    ref* modify_ref(ref* r, bool allow_discovery = true);
+
+    // A modified ref whose commit can be written now, since every
+    // submodule ref it records has been written in this revision, or
+    // null if there is none
+    ref* ready_ref() const;
+
+    // Begins a commit in ready_ref(), unless one is open already;
+    // returns the ref currently being written.
     ref* open_commit(svn::revision const& rev);
 
+    // With --coalesce-submodule-revisions or -seconds, if ready_ref()
+    // is a branch of this super-module whose commit in rev would only
+    // record new submodule commits, put the commit off, so that one
+    // commit records those of a window of revisions, and return true.
+    // The window ends at the first revision beyond either limit, at
+    // any other change to the branch, and before the branch is copied.
+    bool defer_submodule_commit(svn::revision const& rev);
+
+    // Make the commits put off by defer_submodule_commit whose window
+    // has ended by rev, or if rev is null, all of them, returning how
+    // many.  Only callable when no commit is open.
+    std::size_t flush_submodule_commits(svn::revision const* rev = nullptr);
+
+    // True iff a ref is awaiting its commit in the current revision
+    bool has_modified_refs() const { return !modified_refs.empty(); }
+
     void prepare_to_close_commit(); 
 
+    // True iff close_commit() will read the response to an "ls"
+    // already sent by prepare_to_close_commit()
+    bool awaiting_ls_response() const 
+    { 
+        for (auto const& c : set_aside)
+        {
+            if (c.pending_ls_responses > 0)
+                return true;
+        }
+        return prepared_to_close_commit && pending_ls_responses > 0; 
+    }
+
+    // With --pipeline-commits, if another ref is ready for its commit,
+    // set the open commit, prepared to close, aside for close_commit
+    // to close, and return true, so that the next can be written at
+    // once rather than after fast-import answers the "ls" of this one.
+    // The commits of a revision only refer to those of earlier ones,
+    // so none refers to a commit set aside, which may yet be dropped.
+    bool set_commit_aside();
+
+    // Record that the open commit writes something into its tree.
+    // known_to_differ means the parent commit's tree can't contain
+    // what was written.
+    void note_tree_change(bool known_to_differ = false)
+    {
+        ++tree_changes;
+        tree_known_changed |= known_to_differ;
+    }
+
+    // As above, for a blob or gitlink named sha written at git_path,
+    // which --tree-model also records
+    void note_file_written(
+        path const& git_path, unsigned long mode, std::string const& sha,
+        bool known_to_differ = false)
+    {
+        note_tree_change(known_to_differ);
+        if (models_tree())
+            current_ref->tree.set(git_path.str(), mode, sha1::from_hex(sha.c_str()));
+    }
+
+    // With --tree-model, true iff a blob or gitlink named sha is
+    // already at git_path in the open commit, as it was before the
+    // commit's deletions caught it, which are thus undone there.
+    // Nothing need be written then.
+    bool unchanged_by_remapping(path const& git_path, unsigned long mode, std::string const& sha);
+
+    // Close the commits set aside, if any, and then the open one.
     // Returns true iff there are no further commits to make in this
     // repository for this SVN revision.
     bool close_commit(); 
@@ -88,12 +310,271 @@ struct git_repository
     // ref at the given SVN revision
     void record_ancestor(ref* descendant, std::string const& src_ref_name, std::size_t revnum);
 
+    // With --lightweight-tags, make the next commit of the new ref
+    // tag, whose tree is being copied whole from the named ref at
+    // the given SVN revision, that ref's commit at the revision
+    // instead, if there is one
+    void alias_ref(ref* tag, std::string const& src_ref_name, std::size_t revnum);
+
+    // Give up making the next commit of r an alias, e.g. because
+    // files are written to it besides the copy
+    static void unalias_ref(ref* r) { r->alias_source = nullptr; r->alias_mark = 0; }
+
     git_repository* in_super_module() const { return super_module; }
 
+    bool has_submodules() const { return has_submodules_; }
+
+    // The last SVN revision in which a commit was opened in this
+    // repository by this run, or zero if there is none
+    std::size_t last_commit_revnum() const { return last_commit_revnum_; }
+
+    // Shut down the fast-import process, e.g. because it has been
+    // idle.  Only callable when no commit is open.
+    void stop_fast_import();
+
+    // Begin a checkpoint of each of the repository's fast-imports
+    // that is active, returning true iff there is one
+    bool checkpoint();
+
+    // Wait for the checkpoint begun by checkpoint() to complete, after
+    // which everything each writer wrote is in its packs, where the
+    // others can read it
+    void wait_for_checkpoint(std::string const& progress);
+
+    // With --ref-writers, once every writer has exited, add the marks
+    // the others exported to the first's marks file, which then names
+    // every commit, as a single fast-import's would
+    void join_writers_marks() const;
+
+    // With --add-metadata-notes, write the notes on the SVN revisions
+    // of the commits opened since the last call, if any, as a single
+    // commit to refs/notes/svn.  Only callable when no commit is open.
+    void write_notes();
+
+    // At the end of the conversion, delete the branches merged into
+    // master and those whose last commit has an empty tree, as "git
+    // branch -d" and "git branch -D" would, returning how many.  Only
+    // callable when no commit is open.
+    std::size_t prune_branches();
+
+    // With --push-remote, mirror the refs fast-import has written, as
+    // of its last checkpoint, to the given remote with "git push",
+    // with any "%n" in it replaced by git_dir.  Throws if the push
+    // fails.
+    void push(std::string const& remote) const;
+
+    // What push does, for the repository at git_dir, on any thread
+    static void mirror(std::string const& git_dir, std::string const& remote);
+
+    // With --serve-packs, the size of a repository's packs and the
+    // time a clone of it took, before and after repack
+    struct serving_stats
+    {
+        std::uint64_t bytes_before, bytes_after;
+        double clone_seconds_before, clone_seconds_after;
+    };
+
+    // Once fast-import has exited, consolidate the packs it wrote with
+    // "git repack -a -d -l", with -f after --fast-ingest, on up to
+    // threads threads, and write a commit-graph.  With --serve-packs,
+    // the pack is instead made for serving clones, and what that
+    // gained is returned.  Throws if any git command fails.
+    serving_stats repack(unsigned threads) const;
+
+    // With --pack-refs, move the refs fast-import has written, as of
+    // its last checkpoint, into packed-refs with "git pack-refs --all",
+    // returning how many refs the repository has.  Throws if git
+    // fails.
+    std::size_t pack_refs() const;
+
+    // The size of the repository's packs
+    std::uint64_t pack_bytes() const;
+
+    // With --fast-import-host, once the host's fast-import has exited,
+    // make this repository one of its own: give it the refs written
+    // in its namespace of the host's repository at host_dir, the
+    // host's objects through its alternates, and the host's marks,
+    // which include its own.  Throws if git fails.
+    void split_from_host(std::string const& host_dir) const;
+
+    // Create a bare repository at git_dir unless it exists, returning
+    // true iff it didn't
+    static bool ensure_existence(std::string const& git_dir);
+
+    // Writes the 40 hex digits of the SHA-1 of the commit with the
+    // given mark to sha, for --resolve-gitlinks.  The commit must have
+    // been closed by this run, or written by the run being resumed.
+    void commit_sha(int mark, char* sha);
+
+    // Read the responses to the get-mark commands sent so far.  Must
+    // be called before any later response is awaited from fast-import.
+    void read_commit_shas();
+
+    // Returns "<mode> <sha>" for the object at git_path in the last
+    // commit of the named ref at or before the given SVN revision,
+    // or an empty string if there is none, to be copied into the ref
+    // named dst_ref_name.  Only callable when no commit is open.
+    std::string lookup(
+        std::string const& ref_name, std::size_t revnum, path const& git_path,
+        std::string const& dst_ref_name);
+
+    // With --memory-csv, add estimates of the memory held by this
+    // repository's refs, marks and blob names to bytes
+    void account_memory(memory_report::sample& bytes) const;
+
+    // Write everything needed to resume the conversion after the
+    // given SVN revision.  fast-import must have completed a
+    // checkpoint for its marks file to agree.
+    void save_state(std::size_t revnum) const;
+
+    // Restore the state saved by save_state, returning the SVN
+    // revision it was saved after, or zero if there is none.
+    // find_ref locates a ref, given its repository and name.
+    std::size_t load_state(
+        std::function<ref*(std::string const&, std::string const&)> const& find_ref);
+
+    // For a followed shadow, wait until the process converting the
+    // repository has saved its state after revnum, and read it.  Does
+    // nothing for other repositories.
+    void follow(std::size_t revnum);
+
+    // For a followed shadow, take the marks of the commits kept up to
+    // revnum by the process converting it, e.g. when resuming.
+    void adopt_followed_marks(std::size_t revnum);
+
+    // The marks of the commits kept in each ref of the repository in
+    // git_dir, by SVN revision, as of the state last saved by
+    // save_state, which is returned as revnum, or zero if there's none
+    typedef std::unordered_map<std::string, ref::rev_mark_map> marks_by_ref;
+    static marks_by_ref saved_marks(std::string const& git_dir, std::size_t& revnum);
+
+    // Forget the commits made after revnum by the run being resumed,
+    // whose state load_state restored, so they are made again, e.g.
+    // under changed rules.  Their refs are reset to what's left.
+    void rewind(std::size_t revnum);
+
+    // When resuming after revnum, behind the revision saved_revnum
+    // the state restored by load_state was saved after, work out the
+    // commits of the revisions between without writing them, as a
+    // followed shadow of the restored state
+    void replay(std::size_t revnum, std::size_t saved_revnum);
+
+    // Returns true iff a replay is over before revnum, in which case
+    // the repository is converted as usual from then on
+    bool end_replay(std::size_t revnum);
+
+    // Returns the Git name of a blob already written to this
+    // repository whose content is identified by the given SVN key,
+    // or null if there is no such blob.
+    std::string const* find_blob(std::string const& svn_content_key) const
+    {
+        auto p = blobs.find(svn_content_key);
+        return p == blobs.end() || !readable_blob(p->second) ? nullptr : &p->second;
+    }
+
+    // True iff a blob with the given Git name is known to have been
+    // written to this repository
+    bool has_blob_sha(std::string const& sha) const
+    {
+        return blob_shas.count(object_id::from_hex(sha)) != 0;
+    }
+
+    // Returns true iff no blob with the given Git name was written
+    // to this repository before, as far as we know.
+    bool remember_blob(std::string svn_content_key, std::string sha)
+    {
+        object_id const id = object_id::from_hex(sha);
+        bool const new_blob = blob_shas.insert(id).second;
+        sent_blob(id);
+        auto const p = blobs.emplace(std::move(svn_content_key), std::move(sha));
+        if (p.second && !options.shared_objects.empty())
+            unshared_blobs.push_back(&*p.first);
+        return new_blob && created;
+    }
+
+    // With --blob-cache, true iff the blob with the given Git name
+    // was in this repository's object store, or one it shares with
+    // through its alternates, before it was written to by this run,
+    // so that it can be referred to without being written
+    bool stored_blob(object_id const& id) const
+    {
+        for (auto const& s : stores)
+        {
+            if (s->contains(id))
+                return true;
+        }
+        return false;
+    }
+
+    // With --shared-objects, call f(svn_content_key, sha) on each blob
+    // remembered since the last call.  Only call it once they are in
+    // a pack, which the other repositories can read.
+    template <class F>
+    void share_blobs(F const& f)
+    {
+        for (auto const* blob : unshared_blobs)
+            f(blob->first, blob->second);
+        unshared_blobs.clear();
+    }
+
  private:
     void read_logfile();
-    static bool ensure_existence(std::string const& git_dir);
+    std::string state_file_path() const { return state_file_path(git_dir); }
+    static std::string state_file_path(std::string const& git_dir) { return git_dir + "/svn2git-state"; }
+    static void share_objects(std::string const& git_dir);
     void write_merges();
+    void open_alias(svn::revision const& rev);
+    void write_commit(
+        std::size_t revnum, std::string const& committer, unsigned int epoch,
+        std::string const& log_message);
+    void flush_submodule_commit(ref* r);
+    bool close_open_commit();
+    void write_deletions();
+    void write_remapped_deletions();
+    void write_generated_file(
+        path const& git_path, std::string const& content, std::string const& sha);
+    void read_marks_file();
+    object_id read_ls_tree_sha(std::string const& ref_name);
+    void read_followed_state();
+    static void read_saved_marks(state_file::reader& in, marks_by_ref& marks_of);
+
+    // True iff --tree-model is keeping track of the open commit's tree
+    bool models_tree() const
+    {
+        return options.tree_model && role == converted && !options.dry_run
+            && current_ref && current_ref->tree_known;
+    }
+    int followed_mark(ref const& r, std::size_t revnum) const;
+
+    // With --ref-writers, what the writer of the open commit's ref,
+    // or with none open, the first, can name the commit with the
+    // given mark by: the mark, if it wrote the commit, or else its
+    // SHA-1, once the writer that did has made it readable
+    std::string committish(int mark);
+
+    // The writer of the commit with the given mark
+    std::size_t writer_of_mark(int mark) const
+    {
+        return std::size_t(mark) < mark_writers.size() ? mark_writers[mark] : 0;
+    }
+
+    // Unless what writer w has written through the given mark is
+    // known to be in its packs, checkpoint it and wait
+    void settle(std::size_t w, int mark);
+
+    // Record that everything every writer has written is in its packs
+    void settle_all();
+
+    // True iff the current writer can refer to the blob named sha:
+    // no other writer has sent it since it was last settled
+    bool readable_blob(std::string const& sha) const;
+
+    // Record that the current writer has sent the blob named id
+    void sent_blob(object_id const& id)
+    {
+        if (!extra_writers.empty())
+            unsettled_blobs[current_ref ? current_ref->writer : 0].insert(id);
+    }
 
  private: // data members
     // Relative path to the repository from the current working
@@ -102,25 +583,103 @@ struct git_repository
 
     // This is just a place to hang a constructor initializer, that
     // ensures the repository is created before the git fast-import
-    // process (next member) is started.
+    // process (next member) is started.  True iff the repository
+    // didn't exist already, so that every blob in it was written by
+    // this process.
     bool created;
 
+    role_type role;
+    std::size_t id_;
+
+    // With --blob-cache, the object stores as they were before this
+    // run wrote to them
+    std::vector<std::shared_ptr<object_store const> > stores;
+
     // The process through which we write this Git repository
     git_fast_import fast_import_;
 
+    // With --ref-writers, the others, and of each writer, including
+    // the first: the last mark through which it is settled, and the
+    // blobs it has sent since; and the writer of each commit, by mark
+    std::vector<std::unique_ptr<git_fast_import> > extra_writers;
+    std::vector<int> settled_marks;
+    std::vector<std::unordered_set<object_id> > unsettled_blobs;
+    std::vector<unsigned char> mark_writers;
+    std::size_t fences;         // checkpoints made only to settle a writer
+
+    // For a followed shadow, the marks of the commits kept in each
+    // ref, by name, as of the revision its state was saved after
+    marks_by_ref followed_marks;
+    std::size_t followed_revnum;
+
     // If this is a submodule, of whom and were?
     git_repository* super_module;
     path submodule_path;
+    bool has_submodules_;
 
     // branches and tags
     std::unordered_map<std::string, ref> refs;
     boost::container::flat_set<ref*> modified_refs; // to be written in current revision
+    boost::container::flat_set<ref*> deferring_refs; // with submodule commits put off
+
+    // Maps SVN content keys (see importer::convert_svn_file) to the
+    // Git names of the blobs already sent to fast-import
+    std::unordered_map<std::string, std::string> blobs;
+    std::vector<std::pair<std::string const, std::string> const*> unshared_blobs;
+    std::unordered_set<object_id> blob_shas;
+
+    // With --tree-model, the objects found by lookup in the trees
+    // modeled, by the "<mode> <sha>" it returned, to be copied when
+    // the commits of the revision are opened
+    std::unordered_map<std::string, tree_model::object> looked_up_objects;
 
     int last_mark;       // The last commit mark written to fast-import
+    std::size_t last_commit_revnum_;
+
+    // With --add-metadata-notes, the commits awaiting their notes, by
+    // mark, and the SVN revision each was converted from
+    std::vector<std::pair<int, std::size_t> > pending_notes;
+    std::string const* notes_committer; // of the last commit noted
+    unsigned long notes_epoch;
+
+    // With --resolve-gitlinks, the SHA-1s of this submodule's commits
+    // by mark; those awaiting a response to get-mark; and the last
+    // mark of the run being resumed, whose SHA-1s are in the marks file
+    mark_sha_map commit_shas;
+    std::vector<int> requested_marks;
+    int resumed_last_mark;
     ref* current_ref;    // The ref to which the fast-import process is currently writing
     
     // Whether or not we've sent the "ls" command to git fast-import
     bool prepared_to_close_commit;
+
+    // How many "ls" responses close_commit() must read: none if the
+    // outcome was decided locally (see --local-tree-check), one for
+    // the new tree, and another for the parent's tree if it's stale.
+    int pending_ls_responses;
+
+    // What the open commit does to its tree
+    unsigned tree_changes;
+    bool tree_known_changed;
+
+    // With --pipeline-commits, the commits written and set aside by
+    // set_commit_aside, in order, which close_commit closes before
+    // the open one: each one's ref, with what close_commit needs to
+    // decide whether to keep it
+    struct set_aside_commit
+    {
+        ref* r;
+        int pending_ls_responses;
+        unsigned tree_changes;
+        bool tree_known_changed;
+    };
+    std::vector<set_aside_commit> set_aside;
+
+    // With --reduce-merges, the parents of the commits written, and
+    // how many of them write_merges looks at to decide whether one
+    // parent is an ancestor of another
+    commit_graph merge_graph;
+    static std::size_t const merge_search_limit = 4096;
 };
 
 #endif // GIT_REPOSITORY_DWA2013614_HPP
@@ -0,0 +1,199 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#include "history_profile.hpp"
+#include "log.hpp"
+#include "rules_cache.hpp"
+#include "ruleset.hpp"
+#include "state_file.hpp"
+#include "svn.hpp"
+
+#include <boost/filesystem.hpp>
+#include <boost/range/size.hpp>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+namespace
+{
+    std::uint64_t const format = 0x3130656c69667032ull; // "2pfile01"
+
+    // Where the profile of the repository with the given UUID is
+    // kept, beside its index of changes
+    std::string profile_file(std::string const& uuid)
+    {
+        boost::filesystem::path const dir = rules_cache::directory();
+        return dir.empty() ? std::string() : (dir / (uuid + ".history")).string();
+    }
+
+    std::uint64_t cost_of(history_profile::revision_stats const& s)
+    {
+        return 1 + s.changed_paths + s.copies + s.rule_transitions + (s.text_bytes >> 16);
+    }
+}
+
+history_profile::history_profile(
+    svn const& repo, Ruleset const& ruleset, int last, unsigned threads)
+{
+    std::string const uuid = repo.uuid();
+    std::string const filename = profile_file(uuid);
+    read(filename, uuid);
+    int const stored = std::min(last, int(revisions.size()));
+    revision_stats const none = { 0, 0, 0, 0 };
+    revisions.resize(std::max(last, 0), none);
+
+    // Several slices per thread, so that the threads finish together
+    threads = std::max(threads, 1u);
+    int const slice_size = std::max(1, last / int(threads * 8));
+    int const slices = (std::max(last, 0) + slice_size - 1) / slice_size;
+    std::atomic<int> next_slice(0);
+    std::mutex mutex;
+    std::exception_ptr error;
+
+    typedef patrie<Rule, coverage>::reader rule_reader;
+    rule_reader const matcher(ruleset.matcher());
+
+    auto work = [&]
+    {
+        std::map<std::string, std::uint64_t> changes;
+        try
+        {
+            svn r(repo.repo_path, std::string());
+            rule_reader m(matcher);
+            AprPool pool(r.pool.data());
+            std::vector<svn::change> revision_changes;
+            for (int i; (i = next_slice++) < slices;)
+            {
+                int const first = 1 + i * slice_size;
+                for (int revnum = first; revnum <= std::min(last, first + slice_size - 1); ++revnum)
+                {
+                    r.changes(revnum, revision_changes);
+                    m.set_current_revision(revnum);
+                    for (auto const& c : revision_changes)
+                    {
+                        Rule const* match = m.longest_match(c.path, revnum);
+                        if (match && !match->excludes())
+                            ++changes[match->git_repo_name()];
+                    }
+                    if (revnum <= stored)
+                        continue;
+
+                    // Each revision is only written by the thread
+                    // reading it
+                    revision_stats& s = revisions[revnum - 1];
+                    s.changed_paths = revision_changes.size();
+                    AprScratch scope(pool);
+                    svn_fs_root_t* root = nullptr;
+                    for (auto const& c : revision_changes)
+                    {
+                        if (!c.copyfrom_path.empty())
+                            ++s.copies;
+                        if (c.text_mod && c.node_kind == svn_node_file
+                            && c.change_kind != svn_fs_path_change_delete)
+                        {
+                            if (!root)
+                                root = svn::call(svn_fs_revision_root, r.fs, revnum, scope);
+                            s.text_bytes += svn::call(
+                                svn_fs_file_length, root, c.path.c_str(), scope);
+                        }
+                    }
+                }
+            }
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!error)
+                error = std::current_exception();
+            next_slice = slices;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto const& kv : changes)
+            changes_by_repository[kv.first] += kv.second;
+    };
+
+    if (stored < last)
+    {
+        Log::info() << "profiling r" << stored + 1 << " to r" << last
+                    << " of the SVN history on " << threads << " threads" << std::endl;
+    }
+    std::vector<std::thread> workers;
+    for (unsigned n = threads; n > 0; --n)
+        workers.emplace_back(work);
+    for (auto& t : workers)
+        t.join();
+    if (error)
+        std::rethrow_exception(error);
+
+    if (stored < last)
+        save(filename, uuid);
+
+    // The rules say which revisions they change in, so these are
+    // never stored
+    cumulative.assign(1, 0);
+    for (int revnum = 1; revnum <= last; ++revnum)
+    {
+        revision_stats& s = revisions[revnum - 1];
+        s.rule_transitions = boost::size(ruleset.matcher().rules_in_transition(revnum));
+        cumulative.push_back(cumulative.back() + cost_of(s));
+    }
+}
+
+std::uint64_t history_profile::cost(int first, int last) const
+{
+    if (first > last)
+        return 0;
+    int const profiled = int(revisions.size());
+    std::uint64_t const beyond = last > profiled ? last - std::max(first - 1, profiled) : 0;
+    first = std::max(first, 1);
+    last = std::min(last, profiled);
+    return beyond + (first <= last ? cumulative[last] - cumulative[first - 1] : 0);
+}
+
+// Read back the revisions profiled by an earlier run, if any.  A
+// profile that can't be read is only made again.
+void history_profile::read(std::string const& filename, std::string const& uuid)
+{
+    boost::system::error_code ec;
+    if (filename.empty() || !boost::filesystem::exists(filename, ec))
+        return;
+    try
+    {
+        state_file::reader r(filename);
+        if (r.word() != format || r.str() != uuid)
+            return;
+        std::vector<revision_stats> stored(r.word());
+        for (auto& s : stored)
+        {
+            s.changed_paths = r.word();
+            s.copies = r.word();
+            s.text_bytes = r.word();
+            s.rule_transitions = 0;
+        }
+        revisions.swap(stored);
+    }
+    catch (std::exception const&) {}
+}
+
+// Failure only costs the next run profiling the history again, so it
+// is not reported
+void history_profile::save(std::string const& filename, std::string const& uuid) const
+{
+    if (filename.empty())
+        return;
+    state_file::writer w;
+    w.word(format).str(uuid).word(revisions.size());
+    for (auto const& s : revisions)
+        w.word(s.changed_paths).word(s.copies).word(s.text_bytes);
+
+    boost::system::error_code ec;
+    boost::filesystem::create_directories(boost::filesystem::path(filename).parent_path(), ec);
+    try
+    {
+        w.save(filename);
+    }
+    catch (std::exception const&) {}
+}
@@ -0,0 +1,69 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef HISTORY_PROFILE_DWA20131122_HPP
+# define HISTORY_PROFILE_DWA20131122_HPP
+
+# include <cstdint>
+# include <map>
+# include <string>
+# include <vector>
+
+class svn;
+class Ruleset;
+
+// What converting each SVN revision costs, as far as the history
+// alone tells, so that work is divided and progress judged by cost
+// rather than by counting revisions; see --history-profile.  The
+// revisions are read on several threads, from the index of changes
+// where it has them.  What is read from SVN never changes, so it is
+// kept beside the index, and later runs read only the revisions
+// committed since.  What depends on the rules is worked out afresh.
+class history_profile
+{
+ public:
+    struct revision_stats
+    {
+        std::uint64_t changed_paths;
+        std::uint64_t copies;
+        std::uint64_t text_bytes;       // the lengths of the files whose text changed
+        std::uint64_t rule_transitions; // rules becoming active or inactive
+    };
+
+    // Profile revisions 1 through last of repo on the given number of
+    // threads, attributing their changes to the repositories of ruleset
+    history_profile(svn const& repo, Ruleset const& ruleset, int last, unsigned threads);
+
+    int last_revision() const
+    {
+        return int(revisions.size());
+    }
+
+    revision_stats const& stats(int revnum) const
+    {
+        return revisions[revnum - 1];
+    }
+
+    // The estimated cost of revisions first through last: one unit
+    // for each revision, changed path, copy and rule transition, and
+    // for each 64 KiB of changed text.  Revisions beyond the profile
+    // count one unit each.
+    std::uint64_t cost(int first, int last) const;
+
+    // How many of the paths changed by the profiled revisions the
+    // rules map into each Git repository, by name
+    std::map<std::string, std::uint64_t> const& repository_changes() const
+    {
+        return changes_by_repository;
+    }
+
+ private:
+    void read(std::string const& filename, std::string const& uuid);
+    void save(std::string const& filename, std::string const& uuid) const;
+
+    std::vector<revision_stats> revisions; // r1 first
+    std::vector<std::uint64_t> cumulative; // the cost of r1 through rN at N
+    std::map<std::string, std::uint64_t> changes_by_repository;
+};
+
+#endif // HISTORY_PROFILE_DWA20131122_HPP
@@ -0,0 +1,292 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Imports the commands spooled by svn2git --spool into their
+// repositories with git fast-import, while the conversion runs or
+// afterwards.  Each repository's finished segments are imported in
+// order by one fast-import, which takes up the marks the last one
+// left, and then deleted, so a repository that falls behind holds up
+// nothing but itself.  Up to --jobs repositories are imported at a
+// time.
+#include "marks_file_name.hpp"
+#include <boost/program_options.hpp>
+#include <boost/process.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/device/file_descriptor.hpp>
+#include <boost/foreach.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace import_spools {
+
+struct Options
+  {
+  std::string spool;                // directory
+  std::string git;
+  unsigned jobs;
+  int follow_interval;              // seconds; 0 to make one pass
+  };
+
+Options options;
+
+namespace fs = boost::filesystem;
+
+// A repository's directory in the spool
+struct spooled_repository
+  {
+  fs::path dir;
+  std::string git_dir;
+  std::vector<fs::path> segments;   // finished, in order
+  bool done;                        // no more segments will come
+  };
+
+std::vector<spooled_repository> scan_spool()
+  {
+  std::vector<spooled_repository> result;
+  for (fs::directory_iterator i(options.spool), end; i != end; ++i)
+    {
+    spooled_repository r;
+    r.dir = i->path();
+    std::ifstream git_dir((r.dir / "git-dir").string().c_str());
+    if (!std::getline(git_dir, r.git_dir))
+      continue;                     // not yet begun
+    // Look for the done marker first, so no segment finished after
+    // it is missed
+    r.done = fs::exists(r.dir / "done");
+    for (fs::directory_iterator j(r.dir); j != end; ++j)
+      {
+      std::string const name = j->path().filename().string();
+      if (name.size() == 11 && name.compare(8, 3, ".gz") == 0)
+        r.segments.push_back(j->path());
+      }
+    std::sort(r.segments.begin(), r.segments.end());
+    result.push_back(std::move(r));
+    }
+  return result;
+  }
+
+void write_all(int fd, char const* data, std::size_t size)
+  {
+  while (size > 0)
+    {
+    ssize_t const written = ::write(fd, data, size);
+    if (written < 0)
+      {
+      if (errno == EINTR)
+        continue;
+      throw std::runtime_error(std::string("writing to git fast-import: ") + std::strerror(errno));
+      }
+    data += written;
+    size -= written;
+    }
+  }
+
+// Import r's finished segments with one fast-import, deleting each
+// once it has been, and return the bytes of commands imported
+std::uint64_t import(spooled_repository const& r)
+  {
+  namespace iostreams = boost::iostreams;
+  using namespace boost::process::initializers;
+
+  std::string const marks = marks_file_path(r.git_dir);
+  std::vector<std::string> const args = {
+    options.git, "fast-import", "--quiet", "--force",
+    "--export-marks=" + marks, "--import-marks-if-exists=" + marks };
+
+  // Close-on-exec, so the fast-imports started by other threads
+  // meanwhile don't hold the pipe open and keep this one from seeing
+  // its end
+  int fds[2];
+  if (::pipe2(fds, O_CLOEXEC) != 0)
+    throw std::runtime_error("Couldn't create a pipe");
+  boost::process::child child = [&]
+    {
+    iostreams::file_descriptor_source source(fds[0], iostreams::close_handle);
+    return boost::process::execute(
+      run_exe(options.git), set_args(args),
+      set_env(std::vector<std::string>({ "GIT_DIR=" + r.git_dir })),
+      bind_stdin(source), throw_on_error());
+    }();
+
+  std::uint64_t bytes = 0;
+  std::vector<char> buffer(1 << 20);
+  try
+    {
+    BOOST_FOREACH(fs::path const& segment, r.segments)
+      {
+      gzFile const file = ::gzopen(segment.string().c_str(), "rb");
+      if (!file)
+        throw std::runtime_error("Couldn't open " + segment.string());
+      int n;
+      while ((n = ::gzread(file, &buffer[0], unsigned(buffer.size()))) > 0)
+        {
+        write_all(fds[1], &buffer[0], n);
+        bytes += n;
+        }
+      ::gzclose(file);
+      if (n < 0)
+        throw std::runtime_error("Couldn't decompress " + segment.string());
+      }
+    }
+  catch (...)
+    {
+    ::close(fds[1]);
+    boost::process::wait_for_exit(child);
+    throw;
+    }
+  ::close(fds[1]);
+  int const status = boost::process::wait_for_exit(child);
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    throw std::runtime_error("git fast-import failed");
+
+  // Only now are the segments' commands safely in the repository
+  BOOST_FOREACH(fs::path const& segment, r.segments)
+    fs::remove(segment);
+  return bytes;
+  }
+
+volatile std::sig_atomic_t stop_requested = 0;
+
+extern "C" void request_stop(int)
+  {
+  stop_requested = 1;
+  }
+
+// Import the spooled segments until the conversion has written its
+// last, or once if not following it.  Return the number of
+// repositories that failed.
+std::size_t run()
+  {
+  std::size_t failures = 0;
+  std::mutex report_mutex;
+  while (true)
+    {
+    std::vector<spooled_repository> spooled = scan_spool();
+    bool const finished = std::all_of(
+      spooled.begin(), spooled.end(), [](spooled_repository const& r) { return r.done; });
+    spooled.erase(
+      std::remove_if(spooled.begin(), spooled.end(),
+        [](spooled_repository const& r) { return r.segments.empty(); }),
+      spooled.end());
+
+    std::atomic<std::size_t> next(0);
+    auto worker = [&]()
+      {
+      for (std::size_t i; (i = next++) < spooled.size();)
+        {
+        spooled_repository const& r = spooled[i];
+        auto const start = std::chrono::steady_clock::now();
+        std::string error;
+        std::uint64_t bytes = 0;
+        try
+          {
+          bytes = import(r);
+          }
+        catch (std::exception const& e)
+          {
+          error = e.what();
+          }
+        double const seconds
+          = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::lock_guard<std::mutex> lock(report_mutex);
+        if (error.empty())
+          {
+          std::printf("%-40s %3lu segments %10.1fMB %8.2fs\n", r.git_dir.c_str(),
+            (unsigned long)r.segments.size(), bytes / 1e6, seconds);
+          std::fflush(stdout);
+          }
+        else
+          {
+          ++failures;
+          std::cerr << r.git_dir << ": " << error << std::endl;
+          }
+        }
+      };
+
+    std::vector<std::thread> threads;
+    for (unsigned n = std::max(1u, std::min<unsigned>(options.jobs, spooled.size())); n > 1; --n)
+      threads.emplace_back(worker);
+    worker();
+    BOOST_FOREACH(std::thread& t, threads)
+      t.join();
+
+    // A failed repository's segments are left for another attempt
+    if (failures > 0 || options.follow_interval == 0 || (finished && spooled.empty()))
+      return failures;
+    if (!finished)
+      {
+      for (int i = options.follow_interval; i > 0 && !stop_requested; --i)
+        ::sleep(1);
+      }
+    if (stop_requested)
+      return failures;
+    }
+  }
+} // namespace import_spools
+
+int main(int argc, char **argv)
+  {
+  using import_spools::options;
+  namespace po = boost::program_options;
+  po::options_description program_options("Allowed options");
+  program_options.add_options()
+    ("help,h", "produce help message")
+    ("git", po::value(&options.git)->value_name("PATH"),
+      "the git executable to use (by default the one on the PATH)")
+    ("jobs,j", po::value(&options.jobs)->value_name("NUMBER")->default_value(8),
+      "import NUMBER repositories at a time")
+    ("follow", po::value(&options.follow_interval)->value_name("SECONDS")->default_value(0),
+      "keep importing the segments svn2git finishes, looking for more every SECONDS, "
+      "until it has finished them all")
+    ("spool", po::value(&options.spool)->value_name("DIRECTORY")->required(),
+      "the directory given to svn2git --spool")
+    ;
+  po::positional_options_description positional;
+  positional.add("spool", 1);
+
+  po::variables_map variables;
+  store(po::command_line_parser(argc, argv)
+    .options(program_options)
+    .positional(positional)
+    .run(), variables);
+  if (variables.count("help"))
+    {
+    std::cout << "Usage: " << argv[0] << " [options] SPOOL\n"
+              << program_options << std::endl;
+    return 0;
+    }
+
+  try
+    {
+    notify(variables);
+    if (options.follow_interval < 0)
+      throw std::runtime_error("--follow must not be negative");
+    if (options.git.empty())
+      options.git = boost::process::search_path("git");
+    std::signal(SIGINT, import_spools::request_stop);
+    std::signal(SIGTERM, import_spools::request_stop);
+    return import_spools::run() == 0 ? 0 : 1;
+    }
+  catch (std::exception& error)
+    {
+    std::cerr << error.what() << std::endl;
+    return -1;
+    }
+  }
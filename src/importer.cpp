@@ -2,29 +2,474 @@
 // Software License, Version 1.0. (See accompanying
 // file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
 #include "importer.hpp"
+#include "commit_index.hpp"
+#include "coverage.hpp"
+#include "flight_recorder.hpp"
+#include "git_delta.hpp"
+#include "lfs_store.hpp"
+#include "mark_sha_map.hpp"
+#include "marks_file_name.hpp"
 #include "ruleset.hpp"
 #include "svn.hpp"
 #include "log.hpp"
 #include "path.hpp"
+#include "sha1.hpp"
+#include "shard_plan.hpp"
+#include "probes.hpp"
+#include "profile.hpp"
+#include <boost/filesystem.hpp>
 #include <boost/range/adaptor/map.hpp>
 #include <boost/function_output_iterator.hpp>
 #include <boost/range/as_literal.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <poll.h>
+#include <svn_delta.h>
 #include <svn_fs.h>
 #include <apr_hash.h>
 
 using boost::adaptors::map_values;
 using boost::as_literal;
 
-importer::importer(svn const& svn_repo, Ruleset const& ruleset)
-    : svn_repository(svn_repo), ruleset(ruleset), revnum(0)
+importer::importer(
+    svn const& svn_repo, Ruleset const& ruleset, changed_revision_map const& changed_rules,
+    history_profile const* history)
+    : svn_repository(svn_repo), ruleset(&ruleset), planner(svn_repo, ruleset, true),
+      history(history), rule_refs(ruleset.rule_count()), refs_retired(0),
+      file_properties_cache("file properties", file_properties_cache_entries),
+      unpublished(repositories_by_id),
+      revnum(0), revision_in_progress(false), squashed_from(0), finished(false),
+      files_by_ref(file_plan::allocator_type(revision_arena)),
+      changed_repositories(repositories_by_id), fanned_out_bytes(0),
+      svn_directory_copies(directory_copy_map::allocator_type(revision_arena)),
+      started(std::chrono::steady_clock::now())
 {
+    if (options.reader_threads > 0 && !options.dry_run)
+    {
+        prefetcher.reset(
+            new file_prefetcher(
+                svn_repo.repo_path, options.reader_threads, 
+                std::size_t(options.read_ahead) << 20));
+    }
+
+    if (options.write_threads > 0)
+        write_workers.reset(new task_scheduler(options.write_threads, 0));
+
+    if (options.push_jobs > 0 && !options.push_remote.empty())
+        pushers.reset(new push_workers(options.push_remote, options.push_jobs, options.push_kbps));
+
+    if (!options.lfs_pattern.empty())
+        lfs_pattern.assign(options.lfs_pattern);
+
+    if (options.keep_plans)
+        plans.reset(new plan_store(svn_repo, ruleset));
+
+    if (options.blob_cache && !options.dry_run)
+        blob_cache.reset(new svn_blob_cache(svn_repo));
+
+    // Each HOST=REPOSITORY,... of --fast-import-host
+    for (auto const& group : options.fast_import_hosts)
+    {
+        std::size_t const equals = group.find('=');
+        if (equals == 0 || equals == std::string::npos || equals + 1 == group.size())
+            throw std::runtime_error("--fast-import-host expects HOST=REPOSITORY,..., not " + group);
+        std::string const host = group.substr(0, equals);
+        for (std::size_t start = equals + 1, end; start <= group.size(); start = end + 1)
+        {
+            end = std::min(group.find(',', start), group.size());
+            std::string const name = group.substr(start, end - start);
+            bool const known = std::any_of(
+                ruleset.repositories().begin(), ruleset.repositories().end(),
+                [&](Ruleset::Repository const& r) { return r.name == name; });
+            if (!known)
+                throw std::runtime_error("--fast-import-host names no repository of the rules: " + name);
+            if (!host_of.emplace(name, host).second)
+                throw std::runtime_error("--fast-import-host names " + name + " more than once");
+        }
+    }
+    for (auto const& h : host_of)
+    {
+        if (host_of.count(h.second))
+            throw std::runtime_error("--fast-import-host can't host " + h.second + " itself");
+    }
+
+    // Each REPOSITORY=NUMBER of --ref-writers
+    for (auto const& w : options.ref_writers)
+    {
+        std::size_t const equals = std::min(w.find('='), w.size());
+        std::string const name = w.substr(0, equals);
+        std::string const number = w.substr(std::min(equals + 1, w.size()));
+        int const n = number.empty() || number.size() > 2
+            || number.find_first_not_of("0123456789") != std::string::npos ? 0 : std::stoi(number);
+        if (name.empty() || n < 1 || n > 64)
+            throw std::runtime_error("--ref-writers expects REPOSITORY=NUMBER, from 1 to 64, not " + w);
+        bool const known = std::any_of(
+            ruleset.repositories().begin(), ruleset.repositories().end(),
+            [&](Ruleset::Repository const& r) { return r.name == name; });
+        if (!known)
+            throw std::runtime_error("--ref-writers names no repository of the rules: " + name);
+        if (!ref_writers.emplace(name, n).second)
+            throw std::runtime_error("--ref-writers names " + name + " more than once");
+    }
+
+    if (!options.memory_csv.empty())
+        memory.reset(new memory_report(options.memory_csv));
+
+    if (options.memory_budget > 0)
+        budget.reset(new resource_budget(std::uint64_t(options.memory_budget) << 20));
+
+    if (options.shards > 0)
+    {
+        shard_plan const plan = options.shard_plan.empty()
+            ? plan_shards(ruleset, estimated_costs(history))
+            : read_shard_plan(options.shard_plan, ruleset);
+        shard_of.insert(plan.begin(), plan.end());
+    }
+
     for(auto const& rule : ruleset.repositories())
     {
         git_repository* repo = demand_repo(rule.name);
 
-        repo->set_super_module( 
+        // Workers write no super-modules, so neither wait for them
+        // nor ask for their submodules' SHA-1s
+        if (options.shards == 0 || options.shard == 0)
+        {
+            repo->set_super_module( 
+                demand_repo(rule.submodule_in_repo), rule.submodule_path);
+        }
+    }
+
+    plan_ref_retirement();
+    size_active_branches();
+
+    if (options.resume)
+        restore_checkpoint(changed_rules);
+}
+
+// Resume from the state saved by checkpoint(), rewinding the
+// repositories whose rules have changed.  If the repositories were
+// saved at different revisions (e.g. some are new to the ruleset, or
+// were rewound), conversion resumes after the earliest, and the
+// others replay the revisions they are ahead by.
+void importer::restore_checkpoint(changed_revision_map const& changed_rules)
+{
+    auto find_ref = [this](std::string const& repo_name, std::string const& ref_name) {
+        return demand_repo(repo_name)->demand_ref(ref_name);
+    };
+
+    std::vector<std::pair<git_repository*, int> > saved_revnums;
+    for (auto& repo : repositories | map_values)
+    {
+        if (repo.is_shadow())
+            continue;
+        int saved = repo.load_state(find_ref);
+        auto const changed = changed_rules.find(repo.name());
+        if (changed != changed_rules.end() && std::size_t(saved) >= changed->second)
+        {
+            saved = int(changed->second) - 1;
+            repo.rewind(saved);
+        }
+        revnum = saved_revnums.empty() ? saved : std::min(revnum, saved);
+        saved_revnums.emplace_back(&repo, saved);
+        share_blobs(repo);
+    }
+    if (revnum > 0)
+        Log::info() << "resuming after r" << revnum << std::endl;
+
+    for (auto const& s : saved_revnums)
+    {
+        if (s.second > revnum)
+        {
+            s.first->replay(revnum, s.second);
+            replaying.push_back(s.first);
+        }
+    }
+
+    // The workers may be ahead; take their commits up to revnum only
+    if (options.shards > 0 && options.shard == 0 && revnum > 0)
+    {
+        for (auto& repo : repositories | map_values)
+        {
+            if (repo.is_shadow() && repo.in_super_module())
+                repo.adopt_followed_marks(revnum);
+        }
+    }
+}
+
+// Switch to new rules between revisions, rewinding the repositories
+// they change as restore_checkpoint does: the repositories rewound
+// reconvert from the first revision affected, and the others replay
+// the revisions they are ahead by, so the conversion goes on after
+// the earliest.  That state is checkpointed at once, so that a run
+// resumed from it needs no --previous-rules.
+int importer::reload_rules(Ruleset const& new_rules, changed_revision_map const& changed_rules)
+{
+    assert(!revision_in_progress);
+
+    // A repository's super-module is fixed once its refs exist
+    std::map<std::string, Ruleset::Repository const*> old_by_name;
+    for (auto const& rule : ruleset->repositories())
+        old_by_name[rule.name] = &rule;
+    for (auto const& rule : new_rules.repositories())
+    {
+        auto const p = repositories.find(rule.name);
+        if (p == repositories.end())
+            continue;
+        git_repository const* super_module = p->second.in_super_module();
+        auto const old = old_by_name.find(rule.name);
+        if ((super_module ? super_module->name() : std::string()) != rule.submodule_in_repo
+            || (old != old_by_name.end() && old->second->submodule_path != rule.submodule_path))
+        {
+            throw std::runtime_error(
+                "the new rules declare " + rule.name + " a submodule differently;"
+                " restart with --resume-from and --previous-rules to apply them");
+        }
+    }
+
+    ruleset = &new_rules;
+    rule_refs.assign(new_rules.rule_count(), nullptr);
+    plan_ref_retirement();
+    size_active_branches();
+    planner.set_rules(new_rules);
+    ahead.reset();
+    if (plans)
+        plans.reset(new plan_store(svn_repository, new_rules));
+    for (auto const& rule : new_rules.repositories())
+    {
+        demand_repo(rule.name)->set_super_module(
             demand_repo(rule.submodule_in_repo), rule.submodule_path);
     }
+
+    int const last_revnum = revnum;
+    std::vector<std::pair<git_repository*, int> > saved_revnums;
+    for (auto& repo : repositories | map_values)
+    {
+        if (repo.is_shadow())
+            continue;
+        int saved = last_revnum;
+        auto const changed = changed_rules.find(repo.name());
+        if (changed != changed_rules.end() && std::size_t(saved) >= changed->second)
+        {
+            saved = int(changed->second) - 1;
+            repo.rewind(saved);
+            if (!options.push_remote.empty())
+                unpublished.insert(&repo);
+        }
+        revnum = std::min(revnum, saved);
+        saved_revnums.emplace_back(&repo, saved);
+    }
+
+    for (auto const& s : saved_revnums)
+    {
+        if (s.second > revnum)
+        {
+            s.first->replay(revnum, s.second);
+            replaying.push_back(s.first);
+        }
+    }
+    checkpoint();
+    return revnum;
+}
+
+// Make sure every repository's marks and refs are on disk, and save
+// the state needed to resume the conversion after this revision.
+void importer::checkpoint()
+{
+    // The state saved is that of every commit made
+    flush_submodule_commits(nullptr);
+    if (options.dry_run)
+        return;
+
+    Log::info() << "checkpoint at r" << revnum << std::endl;
+    for (auto& repo : repositories | map_values)
+        repo.write_notes();
+
+    // A fast-import that isn't running, with nothing to send it, has
+    // already written its marks, without being started to do so
+    std::vector<git_repository*> active;
+    for (auto& repo : repositories | map_values)
+    {
+        if (repo.checkpoint())
+            active.push_back(&repo);
+    }
+
+    std::string const progress = "checkpoint r" + std::to_string(revnum);
+    for (auto repo : active)
+    {
+        repo->read_commit_shas();
+        repo->wait_for_checkpoint(progress);
+    }
+    if (options.pack_refs)
+    {
+        // Those hosted have no refs of their own until the end
+        std::vector<git_repository const*> written;
+        for (auto repo : active)
+        {
+            if (repo->fast_import().ref_prefix().empty())
+                written.push_back(repo);
+        }
+        pack_refs(written);
+    }
+    for (auto& repo : repositories | map_values)
+        share_blobs(repo);
+    for (auto& repo : repositories | map_values)
+        repo.save_state(revnum);
+    svn_repository.save_changes();
+    if (blob_cache)
+        blob_cache->save();
+}
+
+// Between revisions, shut down the fast-import processes that have
+// had no commits in the last --idle-revisions revisions, restart
+// those grown beyond --fast-import-rss, and checkpoint those sent
+// --checkpoint-megabytes since their last checkpoint.
+void importer::manage_fast_imports()
+{
+    if (budget && budget->due())
+        enforce_budget();
+
+    std::uint64_t const checkpoint_bytes = std::uint64_t(options.checkpoint_megabytes) << 20;
+    for (auto& repo : repositories | map_values)
+    {
+        git_fast_import& fast_import = repo.fast_import();
+        if (!fast_import.active())
+            continue;
+
+        std::size_t const idle = std::size_t(revnum) - repo.last_commit_revnum();
+        if (options.idle_revisions > 0 && idle >= std::size_t(options.idle_revisions))
+        {
+            repo.stop_fast_import();
+            share_blobs(repo);
+            continue;
+        }
+
+        // fast-import keeps what it has imported in memory to the
+        // end, checkpoint or not, so only a new process starts small.
+        // Its memory only grows when it is sent commits.
+        if (options.fast_import_rss > 0 && idle == 0)
+        {
+            std::size_t const rss = fast_import.resident_megabytes();
+            if (rss >= std::size_t(options.fast_import_rss))
+            {
+                Log::info() << "restarting git fast-import for " << repo.name()
+                            << " at " << rss << "MB resident" << std::endl;
+                repo.stop_fast_import();
+                share_blobs(repo);
+                continue;
+            }
+        }
+
+        // Write out the packfile, so it doesn't grow without bound
+        for (std::size_t i = 0; checkpoint_bytes > 0 && i < repo.writers(); ++i)
+        {
+            if (repo.writer(i).bytes_since_checkpoint() >= checkpoint_bytes)
+                repo.writer(i).checkpoint();
+        }
+    }
+}
+
+// With --memory-budget, size the caches and stop fast-imports as the
+// resident memory of svn2git and its fast-imports demands; see
+// resource_budget
+void importer::enforce_budget()
+{
+    profile::scope _("memory budget");
+    std::vector<std::pair<git_repository*, std::uint64_t> > running;
+    std::uint64_t resident = memory_report::resident_bytes();
+    for (auto& repo : repositories | map_values)
+    {
+        if (!repo.fast_import().running())
+            continue;
+        std::uint64_t const bytes = repo.fast_import().resident_bytes();
+        running.emplace_back(&repo, bytes);
+        resident += bytes;
+    }
+    budget->assess(resident);
+
+    double const share = budget->cache_share();
+    planner.set_listing_share(share);
+    file_properties_cache.set_max_weight(
+        std::max<std::size_t>(std::size_t(file_properties_cache_entries * share), 1024));
+
+    std::uint64_t excess = budget->excess();
+    if (excess == 0)
+        return;
+
+    // The idlest first, and of those idle as long, the largest
+    std::sort(running.begin(), running.end(),
+              [](std::pair<git_repository*, std::uint64_t> const& x,
+                 std::pair<git_repository*, std::uint64_t> const& y) {
+                  return x.first->last_commit_revnum() < y.first->last_commit_revnum()
+                      || (x.first->last_commit_revnum() == y.first->last_commit_revnum()
+                          && x.second > y.second);
+              });
+    Log::info() << "at " << (resident >> 20) << "MB resident, over the memory budget of "
+                << (budget->budget() >> 20) << "MB" << std::endl;
+    for (auto const& r : running)
+    {
+        if (excess == 0)
+            break;
+        Log::info() << "stopping git fast-import for " << r.first->name()
+                    << " at " << (r.second >> 20) << "MB resident" << std::endl;
+        r.first->stop_fast_import();
+        share_blobs(*r.first);
+        excess -= std::min(excess, r.second);
+    }
+}
+
+// With --shared-objects, make the blobs repo has written since the
+// last call, which must now be in its packs, available to the other
+// repositories
+void importer::share_blobs(git_repository& repo)
+{
+    if (options.shared_objects.empty())
+        return;
+    repo.share_blobs([this](std::string const& svn_content_key, std::string const& sha) {
+            shared_blobs.emplace(svn_content_key, sha); });
+}
+
+// Returns the Git name of a blob with the content identified by the
+// given SVN key that repo can refer to: one written to repo, or with
+// --shared-objects, to any repository.  Returns null if there's none.
+std::string const* importer::find_blob(
+    git_repository const& repo, std::string const& svn_content_key) const
+{
+    if (auto sha = repo.find_blob(svn_content_key))
+        return sha;
+    if (shared_blobs.empty())
+        return nullptr;
+    auto p = shared_blobs.find(svn_content_key);
+    return p == shared_blobs.end() ? nullptr : &p->second;
+}
+
+// With --blob-cache, the Git name an earlier run recorded for the blob
+// of the content identified by the given SVN key, if repo can refer to
+// it without its being written: it was in repo's object store, or one
+// repo shares, before this run.  Otherwise, the null id.
+object_id importer::cached_blob(
+    git_repository const& repo, std::string const& svn_content_key) const
+{
+    if (!blob_cache)
+        return object_id();
+    object_id const id = blob_cache->find(svn_content_key);
+    return !id.is_null() && repo.stored_blob(id) ? id : object_id();
 }
 
 // Return a pointer to a git_repository object having the given
@@ -40,11 +485,72 @@ importer::demand_repo(std::string const& name)
     {
         p = repositories.emplace_hint(
             p, std::piecewise_construct, 
-            std::make_tuple(name), std::make_tuple(name));
+            std::make_tuple(name), 
+            std::make_tuple(name, role_of(name), repositories_by_id.size()));
+        repositories_by_id.push_back(&p->second);
+
+        // Nothing is written with --dry-run, on as many threads as --jobs
+        auto const h = host_of.find(name);
+        if (h != host_of.end() && !p->second.is_shadow() && !options.dry_run)
+            p->second.fast_import().host_in(fast_import_host(h->second), name);
+        auto const w = ref_writers.find(name);
+        if (w != ref_writers.end() && !p->second.is_shadow() && !options.dry_run)
+            p->second.add_writers(w->second);
     }
     return &p->second;
 };
 
+// The fast-import hosting a group of repositories in git_dir, made
+// on first use
+git_fast_import& importer::fast_import_host(std::string const& git_dir)
+{
+    auto p = hosts.find(git_dir);
+    if (p == hosts.end())
+    {
+        git_repository::ensure_existence(git_dir);
+        p = hosts.emplace(
+            std::piecewise_construct, std::forward_as_tuple(git_dir), std::forward_as_tuple(git_dir)
+        ).first;
+    }
+    return p->second;
+}
+
+// With --shards, each process converts only the repositories of its
+// shard.  The others are shadows, whose commits are worked out but
+// not written, since a super-module's depend on its submodules'.  The
+// coordinator follows the workers' progress in its submodules.
+git_repository::role_type importer::role_of(std::string const& repo_name) const
+{
+    if (options.shards == 0)
+        return git_repository::converted;
+
+    auto const p = shard_of.find(repo_name);
+    int const shard = p == shard_of.end() ? 1 : p->second;
+    if (shard == options.shard)
+        return git_repository::converted;
+
+    if (options.shard == 0)
+    {
+        for (auto const& rule : ruleset->repositories())
+        {
+            if (rule.name == repo_name && !rule.submodule_in_repo.empty())
+                return git_repository::followed_shadow;
+        }
+    }
+    return git_repository::shadow;
+}
+
+// Return the ref to which match maps SVN paths.  Refs are never
+// destroyed, so it's found only once per rule, sparing the naming and
+// hashing of the ref for each file matched.
+git_repository::ref* importer::ref_of(Rule const* match)
+{
+    git_repository::ref*& r = rule_refs[match->index];
+    if (!r)
+        r = demand_repo(match->git_repo_name())->demand_ref(match->git_ref_name());
+    return r;
+}
+
 // Return the number of the last SVN revision that was successfully
 // convertd to Git
 int importer::last_valid_svn_revision()
@@ -57,387 +563,1915 @@ int importer::last_valid_svn_revision()
 // return it.  Otherwise, discover_changes will be false.
 git_repository::ref* importer::prepare_to_modify(Rule const* match, bool discover_changes)
 {
-    auto& repo = repositories.find(match->git_repo_name())->second;
+    git_repository::ref* const r = ref_of(match);
+    git_repository& repo = *r->repo;
     if (!discover_changes && changed_repositories.count(&repo) == 0)
         return nullptr;
     changed_repositories.insert(&repo);
     if (auto s = repo.in_super_module())
         changed_repositories.insert(s);
-    return repo.modify_ref(match->git_ref_name(), discover_changes);
+    return repo.modify_ref(r, discover_changes);
+}
+
+namespace
+{
+    git_address_key git_address(Rule const* match, path const& git_path)
+    {
+        return git_address_key(match->git_repo_name(), match->git_ref_name(), git_path.str());
+    }
+}
+
+// Try to express the copy of the SVN directory src_path@src_revnum to
+// dst_path as Git tree copies.  Each rule-mapped region of the
+// destination whose source region maps, through a rule of the same
+// repository, to a Git tree containing nothing else becomes a single
+// "M <mode> <sha>" of that tree.  Those regions are recorded in
+// trees_copied and skipped by per-file conversion; everything else is
+// converted file by file as usual.
+void importer::copy_svn_trees(
+    path const& dst_path, path const& src_path, std::size_t src_revnum,
+    std::vector<path> const& changed_paths, path_set& trees_copied)
+{
+    auto const& matcher = ruleset->matcher();
+
+    std::vector<Rule const*> regions;
+    if (Rule const* enclosing = converting(matcher.longest_match(dst_path.str(), revnum)))
+        regions.push_back(enclosing);
+    matcher.svn_rules_beneath(dst_path.str(), revnum, std::back_inserter(regions));
+
+    for (Rule const* dst_match : regions)
+    {
+        path const region 
+            = dst_match->svn_path().starts_with(dst_path) ? dst_match->svn_path() : dst_path;
+
+        // Other rules mapping parts of the region elsewhere would
+        // leave holes that a tree copy can't represent.
+        auto svn_rules_beneath = [&](path const& p, std::size_t rev) {
+            return finds_rules([&](boost::function_output_iterator<rule_detector> out) {
+                    matcher.svn_rules_beneath(p.str(), rev, out); });
+        };
+        if (svn_rules_beneath(region, revnum))
+            continue;
+
+        // Files changed within the region in this revision must be
+        // converted individually.
+        auto next_change = std::upper_bound(changed_paths.begin(), changed_paths.end(), region);
+        if (next_change != changed_paths.end() && next_change->starts_with(region))
+            continue;
+
+        path const src_region = src_path / region.sans_prefix(dst_path);
+        Rule const* src_match = converting(matcher.longest_match(src_region.str(), src_revnum));
+        if (!src_match 
+            || src_match->repo_rule->git_repo_name != dst_match->repo_rule->git_repo_name)
+            continue;
+        if (svn_rules_beneath(src_region, src_revnum))
+            continue;
+
+        // The Git trees must contain nothing mapped by other rules
+        path const dst_git_path = dst_match->git_path(region);
+        path const src_git_path = src_match->git_path(src_region);
+
+        auto git_rules_beneath = [&](Rule const* match, path const& git_path, std::size_t rev) {
+            return finds_rules([&](boost::function_output_iterator<rule_detector> out) {
+                    matcher.git_rules_beneath(git_address(match, git_path), rev, out); });
+        };
+        if (git_rules_beneath(dst_match, dst_git_path, revnum)
+            || git_rules_beneath(src_match, src_git_path, src_revnum))
+            continue;
+
+        // Super-module trees contain gitlinks that are refreshed
+        // separately, so they are never copied.
+        git_repository& repo = *ref_of(dst_match)->repo;
+        if (repo.has_submodules())
+            continue;
+
+        // A shadow can't look the tree up, but writes nothing anyway
+        std::string const object = repo.is_shadow() 
+            ? std::string() : repo.lookup(
+                src_match->git_ref_name(), src_revnum, src_git_path, dst_match->git_ref_name());
+        if (object.empty() && !repo.is_shadow())
+            continue;
+
+        if (Log::enabled(Log::Trace))
+        {
+            Log::trace() << "copying " << src_match->git_ref_name() << ":" << src_git_path 
+                         << "@" << src_revnum << " to " << dst_match->git_ref_name() << ":" 
+                         << dst_git_path << " in " << repo.name() << std::endl;
+        }
+
+        auto* dst_ref = prepare_to_modify(dst_match, true);
+        if (!repo.is_shadow())
+            dst_ref->pending_tree_copies.emplace_back(dst_git_path, object);
+        repo.record_ancestor(dst_ref, src_match->git_ref_name(), src_revnum);
+
+        // A new tag holding all of a ref can just name its commit
+        if (options.lightweight_tags && dst_git_path.str().empty() && src_git_path.str().empty()
+            && boost::starts_with(dst_match->git_ref_name(), "refs/tags/"))
+        {
+            repo.alias_ref(dst_ref, src_match->git_ref_name(), src_revnum);
+        }
+        trees_copied.insert(region);
+    }
+}
+
+// Empty the per-revision containers, releasing everything they hold
+// in the revision arena so that it can be reused.  clear() alone won't
+// do, since containers keep their storage for reuse.
+void importer::reset_revision_state()
+{
+    files_by_ref = file_plan(file_plan::allocator_type(revision_arena));
+    changed_repositories.clear();
+    fanned_out.clear();
+    fanned_out_bytes = 0;
+    preemitted.clear();
+    svn_directory_copies = directory_copy_map(directory_copy_map::allocator_type(revision_arena));
+    revision_arena.reset();
+}
+
+bool importer::changes_nothing(int revnum, std::vector<svn::change> const& changes) const
+{
+    return planner.changes_nothing(revnum, changes);
+}
+
+int importer::skip_revisions(int first, int last)
+{
+    profile::scope _("skip revisions");
+    std::vector<svn::change> changes;
+    int next = first;
+    for (; next <= last; ++next)
+    {
+        svn_repository.changes(next, changes);
+        if (!changes_nothing(next, changes))
+            break;
+    }
+    if (next == first)
+        return squash_revisions(next, last);
+
+    // Account for the revisions skipped as import_revision would
+    Log::debug() << "skipped r" << first << " to r" << next - 1 
+                 << ", which change nothing mapped" << std::endl;
+    planner.skipped(first, next - 1);
+    revnum = next - 1;
+    replaying.erase(
+        std::remove_if(replaying.begin(), replaying.end(), 
+                       [this](git_repository* r) { return r->end_replay(revnum); }),
+        replaying.end());
+    if (options.commit_interval > 0
+        && revnum / options.commit_interval != (first - 1) / options.commit_interval)
+    {
+        checkpoint();
+    }
+    if (status && status->due())
+        write_status();
+    return squash_revisions(next, last);
+}
+
+// The last of the burst of revisions, no later than last, that
+// starts at first and that the squash rules let be squashed: those
+// by first's author, but for any between that change nothing.  If
+// there is more than one, the burst starts at squashed_from.
+int importer::squash_revisions(int first, int last)
+{
+    squashed_from = 0;
+    if (!ruleset->squashes() || first >= last)
+        return first;
+
+    profile::scope _("find squashed revisions");
+    std::vector<svn::change> changes;
+    svn_repository.changes(first, changes);
+    std::string const author = svn_repository.revision_property(first, "svn:author");
+    if (!planner.squashes(first, author, changes))
+        return first;
+
+    int end = first;
+    for (int r = first + 1; r <= last; ++r)
+    {
+        svn_repository.changes(r, changes);
+        if (changes_nothing(r, changes))
+            continue;
+        if (svn_repository.revision_property(r, "svn:author") != author
+            || !planner.squashes(r, author, changes))
+        {
+            break;
+        }
+        end = r;
+    }
+    if (end == first)
+        return first;
+
+    Log::debug() << "squashing r" << first << " to r" << end << " by " << author << std::endl;
+    squashed_from = first;
+    return end;
+}
+
+// Make rev, the last of the revisions squashed from squashed_from,
+// stand for them all: give it a change of each path they changed,
+// from what was there before the first to what is there in rev, and
+// their log messages
+void importer::squash_changes(svn::revision& rev)
+{
+    profile::scope _("squash revisions");
+    struct squashed_change
+    {
+        svn::change change;
+        bool existed;           // before the first revision
+        bool replaced;          // deleted or replaced since
+    };
+    std::map<std::string, squashed_change> squashed;
+    std::string log_message;
+    std::vector<svn::change> changes;
+    for (int r = squashed_from; r <= rev.revnum; ++r)
+    {
+        if (r < rev.revnum)
+            svn_repository.changes(r, changes);
+        else
+            changes = rev.changes;
+        if (changes_nothing(r, changes))
+            continue;
+
+        for (auto const& c : changes)
+        {
+            auto const p = squashed.find(c.path);
+            if (p == squashed.end())
+            {
+                squashed_change const s = {
+                    c, c.change_kind != svn_fs_path_change_add,
+                    c.change_kind == svn_fs_path_change_replace };
+                squashed.emplace(c.path, s);
+                continue;
+            }
+            squashed_change& s = p->second;
+            s.replaced |= c.change_kind != svn_fs_path_change_modify;
+            s.change.text_mod |= c.text_mod;
+            if (c.change_kind != svn_fs_path_change_delete)
+                s.change.node_kind = c.node_kind;
+        }
+
+        std::string const message = r < rev.revnum
+            ? svn_repository.revision_property(r, "svn:log") : rev.log_message;
+        if (!message.empty() && log_message.find(message) == std::string::npos)
+            log_message += (log_message.empty() ? "" : "\n\n") + message;
+    }
+
+    rev.changes.clear();
+    for (auto& p : squashed)
+    {
+        squashed_change& s = p.second;
+        svn_node_kind_t const kind = svn::call(
+            svn_fs_check_path, rev.fs_root, p.first.c_str(), AprScratch(rev.scratch));
+        if (!s.existed && kind == svn_node_none)
+            continue;
+        s.change.change_kind = kind == svn_node_none ? svn_fs_path_change_delete
+            : !s.existed ? svn_fs_path_change_add
+            : s.replaced ? svn_fs_path_change_replace
+            : svn_fs_path_change_modify;
+        if (kind != svn_node_none)
+            s.change.node_kind = kind;
+        rev.changes.push_back(std::move(s.change));
+    }
+    rev.log_message = log_message;
+    planner.skipped(squashed_from, rev.revnum - 1);
+}
+
+void importer::import_revision(int revnum)
+{
+    bool const was_tracing = Log::enabled(Log::Trace);
+    Log::begin_revision(revnum);
+    if (Log::enabled(Log::Trace) != was_tracing)
+    {
+        for (auto& repo : repositories | map_values)
+        {
+            for (std::size_t i = 0; i < repo.writers(); ++i)
+                repo.writer(i).select_sink();
+        }
+    }
+    if (Log::enabled(Log::Trace))
+    {
+        Log::trace() 
+        << "################## importing revision " 
+        << revnum << " ##################" << std::endl;
+    }
+    else if (revnum % 1000 == 0)
+    {
+        Log::info() << "importing revision " << revnum << std::endl;
+    }
+
+    this->revnum = revnum;
+    revision_in_progress = true;
+    replaying.erase(
+        std::remove_if(replaying.begin(), replaying.end(), 
+                       [revnum](git_repository* r) { return r->end_replay(revnum); }),
+        replaying.end());
+    SVN2GIT_PROBE1(revision__start, revnum);
+    flight_recorder::note("revision", "", revnum);
+    auto const revision_start = std::chrono::steady_clock::now();
+    profile::begin_revision();
+    profile::scope profile_revision("import revision");
+    svn::revision rev = [&]{ 
+        profile::scope _("read revision"); 
+        return svn_repository[revnum]; }();
+    int const first_revnum = squashed_from > 0 && squashed_from < revnum ? squashed_from : revnum;
+    if (first_revnum < revnum)
+        squash_changes(rev);
+    squashed_from = 0;
+
+    // Importing an SVN revision happens in two phases.  In the first
+    // phase we discover actions to be performed: Git subtrees that
+    // must be deleted and SVN subtrees whose files must be
+    // (re-)convertd to Git.  The planner finds them from SVN and the
+    // rules alone, with --plan-ahead on a thread of its own while
+    // earlier revisions are written.  In the second phase, we
+    // actually do those deletions and translations.
+
+    //
+    // Phase I: Action Discovery.  
+    //
+    reset_revision_state();
+    ruleset->matcher().set_current_revision(revnum);
+    if (!ahead || !ahead->take(revnum, plan))
+    {
+        // A revision standing for those squashed is planned afresh,
+        // since the plan stored for it was of its changes alone
+        bool const squashed = first_revnum < revnum;
+        if (plans && !squashed
+            && [&]{ profile::scope _("read plan"); return plans->find(revnum, plan); }())
+        {
+            std::cout << plan.log;
+        }
+        else if (options.copy_trees && !options.dry_run)
+        {
+            revision_planner::tree_copier const copy_trees = [this](
+                path const& dst_path, path const& src_path, std::size_t src_revnum,
+                std::vector<path> const& changed_paths, path_set& trees_copied)
+            {
+                copy_svn_trees(dst_path, src_path, src_revnum, changed_paths, trees_copied);
+            };
+            planner.plan(rev, plan, &copy_trees);
+        }
+        else
+        {
+            planner.plan(rev, plan);
+            if (plans && !squashed)
+                plans->add(plan);
+        }
+    }
+
+    // Mark the refs the plan changes for modification, and sort the
+    // files by the ref they map into
+    for (auto const& d : plan.deletions)
+        prepare_to_modify(d.match, true)->pending_deletions.insert(d.match->git_path(d.svn_path));
+    // The plan lists the copies by destination, so each is appended to
+    // the map, which a revision of thousands of tag copies, as
+    // cvs2svn made, would otherwise fill by shifting it every time
+    svn_directory_copies.reserve(plan.directory_copies.size());
+    for (auto const& c : plan.directory_copies)
+    {
+        auto& copy = svn_directory_copies.emplace_hint(
+            svn_directory_copies.end(), c.directory, svn_directory_copy(revision_arena))->second;
+        copy.src_revision = c.src_revision;
+        copy.src_directory = c.src_directory;
+    }
+    for (auto const& m : plan.merges)
+    {
+        record_merge(
+            prepare_to_modify(m.match, true), m.src_match, svn_directory_copies.find(m.copy)->second);
+    }
+    for (auto const& m : plan.recorded_merges)
+    {
+        if (m.src_match->git_repo_name() == m.match->git_repo_name())
+        {
+            auto* target = prepare_to_modify(m.match, true);
+            target->repo->record_ancestor(target, m.src_match->git_ref_name(), m.src_revision);
+        }
+    }
+    {
+        profile::scope _("sort files");
+        for (auto const& f : plan.files)
+        {
+            auto* dst_ref = prepare_to_modify(f.match, true);
+            auto bucket = files_by_ref.find(dst_ref);
+            if (bucket == files_by_ref.end())
+            {
+                arena_allocator<planned_file> const alloc(revision_arena);
+                arena_vector<planned_file> files(alloc);
+                bucket = files_by_ref.emplace(dst_ref, std::move(files)).first;
+            }
+            planned_file const file = { f.svn_path, f.match };
+            bucket->second.push_back(file);
+        }
+        plan_fanned_out_files(rev);
+    }
+    if (prefetcher)
+    {
+        profile::scope _("queue prefetch");
+        prefetch_svn_files(rev);
+    }
+    if (prefetcher && options.preemit_blobs)
+    {
+        profile::scope _("preemit blobs");
+        preemit_blobs(rev);
+    }
+
+    //
+    // Phase II: Writing to Git
+    //
+
+    // Though it is expected to be rare, a single SVN commit can
+    // generate commits in multiple refs of the same Git repo, and the
+    // changes in a single Git ref's commit must all be sent
+    // contiguously to the fast-import process.  The commits of the
+    // revision form a graph: a super-module ref's commit depends on
+    // those of the submodule refs it records.  Each round opens, in
+    // every changed repository that has one, a commit whose
+    // dependencies have all been written, taking its files from those
+    // planned for its ref above, so every commit opened is closed in
+    // the same round, and the commits of different repositories
+    // await fast-import together.
+    if (!options.push_remote.empty())
+        unpublished.insert(changed_repositories);
+    for (int round = 0; !changed_repositories.empty(); ++round)
+    {
+        Log::trace() << "round " << round << std::endl;
+        profile::scope profile_round("round");
+
+        arena_allocator<git_repository*> const alloc(revision_arena);
+        repository_set ready(repositories_by_id);
+        arena_vector<git_repository*> closed_repositories(alloc);
+        for (auto r : changed_repositories)
+        {
+            r->follow(revnum);
+            // A super-module branch that would only record new
+            // submodule commits may record those of later revisions too
+            while (r->ready_ref() && !files_by_ref.count(r->ready_ref())
+                   && r->defer_submodule_commit(rev))
+            {
+            }
+            if (r->ready_ref())
+                ready.insert(r);
+            else if (!r->has_modified_refs())
+                closed_repositories.push_back(r);
+        }
+        if (ready.empty() && closed_repositories.empty())
+        {
+            throw std::runtime_error(
+                "In r" + std::to_string(revnum) 
+                + ", no commit is ready in any of the changed Git repositories");
+        }
+
+        for (auto r : ready)
+        {
+            if (files_by_ref.count(r->ready_ref()))
+                git_repository::unalias_ref(r->ready_ref());
+        }
+
+        // With --write-threads, the commit of each repository without
+        // submodules is written by a task of its own, reading SVN
+        // through a root of its thread's, and logging into a capture
+        // that is written out here, in order, once all are done.  The
+        // super-modules, whose commits record the others', and the
+        // shadows, which follow them, are written here after the rest.
+        auto const on_worker = [this](git_repository const* r) {
+            return write_workers && !r->has_submodules() && !r->is_shadow();
+        };
+        if (write_workers)
+        {
+            std::deque<std::string> logs;
+            for (auto r : ready)
+            {
+                if (!on_worker(r))
+                    continue;
+                logs.emplace_back();
+                std::string& log = logs.back();
+                write_workers->submit(
+                    "write commit",
+                    [this, &rev, r, &log] {
+                        Log::capture capture;
+                        try
+                        {
+                            svn::revision const thread_rev(svn_repository, rev);
+                            write_commits(thread_rev, *r);
+                        }
+                        catch (...)
+                        {
+                            log = capture.str();
+                            throw;
+                        }
+                        log = capture.str();
+                    },
+                    r);
+            }
+            std::exception_ptr error;
+            try
+            {
+                write_workers->wait();
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+            for (auto const& log : logs)
+                std::cout << log;
+            if (error)
+                std::rethrow_exception(error);
+        }
+
+        for (auto r : ready)
+        {
+            if (!on_worker(r))
+                write_files(rev, *r);
+        }
+        for (auto r : ready)
+        {
+            if (!on_worker(r))
+            {
+                r->prepare_to_close_commit();
+                pipeline_commits(rev, *r);
+            }
+            files_by_ref.erase(r->ready_ref());
+        }
+
+        {
+            profile::scope _("close commits");
+            close_commits(ready, closed_repositories);
+        }
+
+        for (auto r : closed_repositories)
+            changed_repositories.erase(r);
+    }
+
+    if (prefetcher)
+        prefetcher->finish();
+
+    if (options.coalesce_submodule_revisions > 0 || options.coalesce_submodule_seconds > 0)
+        flush_submodule_commits(&rev);
+    retire_finished_refs();
+
+    // Give the fast-imports what they have room for before the next
+    // revision is read
+    git_fast_import::drain_queues();
+    git_fast_import::end_revision(revnum);
+    warn_about_cross_repository_copies();
+    revision_in_progress = false;
+
+    if (options.add_metadata_notes && options.notes_interval > 0
+        && revnum / options.notes_interval != (first_revnum - 1) / options.notes_interval)
+    {
+        profile::scope _("write notes");
+        for (auto& repo : repositories | map_values)
+            repo.write_notes();
+    }
+    if (options.commit_interval > 0
+        && revnum / options.commit_interval != (first_revnum - 1) / options.commit_interval)
+    {
+        profile::scope _("checkpoint");
+        checkpoint();
+        if (pushers)
+            push_in_background();
+    }
+    if ((options.idle_revisions > 0 || options.fast_import_rss > 0
+         || options.checkpoint_megabytes > 0 || options.memory_budget > 0) && !options.dry_run)
+    {
+        manage_fast_imports();
+    }
+    profile::revision_done(revnum);
+    if (!options.slow_revisions.empty())
+        report_slow_revision(std::chrono::steady_clock::now() - revision_start);
+    if (memory && revnum % options.memory_interval == 0)
+        sample_memory();
+    if (status && status->due())
+        write_status();
+    SVN2GIT_PROBE1(revision__done, revnum);
+}
+
+void importer::publish()
+{
+    profile::scope _("publish");
+    checkpoint();
+    if (pushers)
+    {
+        push_in_background();
+        pushers->wait();
+        return;
+    }
+    for (auto repo : unpublished)
+        repo->push(options.push_remote);
+    unpublished.clear();
+}
+
+void importer::plan_ahead(int first, int last)
+{
+    ahead.reset();
+    if (options.plan_ahead > 0 && first <= last)
+    {
+        ahead.reset(new background_planner(
+            svn_repository.repo_path, *ruleset, first, last, options.plan_ahead, plans.get()));
+    }
+}
+
+// Hand the repositories with new commits, as of the checkpoint just
+// made, to the push workers
+void importer::push_in_background()
+{
+    for (auto repo : unpublished)
+    {
+        if (!repo->is_shadow())
+            pushers->push(repo->name());
+    }
+    unpublished.clear();
+}
+
+// Estimate the memory held by each of the importer's subsystems, and
+// measure the resident memory of svn2git and its fast-imports
+void importer::sample_memory()
+{
+    profile::scope _("sample memory");
+    memory_report::sample bytes;
+    std::uint64_t fast_import_bytes = 0;
+    for (auto& repo : repositories | map_values)
+    {
+        repo.account_memory(bytes);
+        fast_import_bytes += repo.fast_import().resident_bytes();
+    }
+
+    // Hash table nodes are reckoned at two pointers and a bucket
+    std::uint64_t const node = 3 * sizeof(void*);
+    bytes["revision arena"] = revision_arena.bytes_held();
+    bytes["directory listings"] = planner.bytes_held() + (ahead ? ahead->bytes_held() : 0);
+    bytes["file properties"] = file_properties_cache.size() 
+        * (node + sizeof(std::pair<std::string, file_properties>) + 48 + 64);
+    std::uint64_t shared = 0;
+    if (!shared_blobs.empty())
+    {
+        auto const& some = *shared_blobs.begin();
+        shared = shared_blobs.size() * (node + sizeof(some) + memory_report::heap_bytes(some.first)
+                                        + memory_report::heap_bytes(some.second));
+    }
+    bytes["shared blobs"] = shared;
+
+    std::uint64_t accounted = 0;
+    for (auto const& kv : bytes)
+        accounted += kv.second;
+    std::uint64_t const resident = memory_report::resident_bytes();
+    bytes["unaccounted"] = resident > accounted ? resident - accounted : 0;
+    bytes["svn2git resident"] = resident;
+    bytes["fast-import resident"] = fast_import_bytes;
+    memory->add(revnum, bytes);
+    memory->add_open_files(revnum, memory_report::open_files());
+}
+
+void importer::report_memory() const
+{
+    if (memory)
+        memory->report();
+}
+
+void importer::report_fast_import() const
+{
+    if (options.fast_import_stats)
+        report_fast_import_stats();
+    if (!options.profile)
+        return;
+
+    // Those waiting longest first
+    std::vector<git_repository const*> repos;
+    for (auto const& repo : repositories | map_values)
+    {
+        git_fast_import::command_stats const& s = repo.fast_import().stats();
+        if (s.commands[git_fast_import::commit_command] > 0 || s.write_seconds + s.readline_seconds > 0)
+            repos.push_back(&repo);
+    }
+    auto waiting = [](git_repository const* r) {
+        return r->fast_import().stats().write_seconds + r->fast_import().stats().readline_seconds;
+    };
+    std::sort(repos.begin(), repos.end(), 
+              [&](git_repository const* x, git_repository const* y) { return waiting(x) > waiting(y); });
+
+    static char const* const kinds[git_fast_import::command_kinds] = {
+        "commit", "M", "D", "merge", "reset", "ls", "checkpoint"
+    };
+    std::cout << "fast-import commands (times in seconds blocked writing and reading, the\n"
+              << "most revisions the commands queued for a fast-import spanned, the mean and\n"
+              << "most milliseconds it took to acknowledge importing a revision, and the\n"
+              << "most revisions it was yet to acknowledge):\n"
+              << std::setw(32) << std::left << "repository" << std::right;
+    for (char const* kind : kinds)
+        std::cout << std::setw(11) << kind;
+    std::cout << std::setw(16) << "inline bytes" << std::setw(10) << "write" 
+              << std::setw(10) << "readline" << std::setw(8) << "lag" << std::setw(10) << "ack ms"
+              << std::setw(10) << "max ms" << std::setw(8) << "behind" << '\n';
+    for (git_repository const* repo : repos)
+    {
+        git_fast_import::command_stats const& s = repo->fast_import().stats();
+        std::cout << std::setw(32) << std::left << repo->name() << std::right;
+        for (std::uint64_t n : s.commands)
+            std::cout << std::setw(11) << n;
+        std::cout << std::setw(16) << s.inline_bytes << std::fixed << std::setprecision(2)
+                  << std::setw(10) << s.write_seconds << std::setw(10) << s.readline_seconds
+                  << std::setw(8) << s.max_lag << std::setprecision(1)
+                  << std::setw(10) << (s.acknowledgments ? 1000 * s.ack_seconds / s.acknowledgments : 0)
+                  << std::setw(10) << 1000 * s.max_ack_seconds << std::setw(8) << s.max_ack_lag << '\n';
+    }
+    std::cout << std::flush;
+}
+
+// With --fast-import-stats, what the fast-imports reported of
+// themselves, by repository, and which of them imported many objects
+// they already had, or reloaded the trees of branches they had to
+// evict many times over
+void importer::report_fast_import_stats() const
+{
+    typedef git_fast_import::import_stats import_stats;
+    double const duplicate_ratio_limit = 0.1;
+    std::uint64_t const duplicates_worth_noting = 1000;
+    std::uint64_t const loads_per_branch_limit = 4;
+
+    // Most objects first
+    auto total = [](std::uint64_t const (&n)[import_stats::object_kinds]) {
+        return std::accumulate(n, n + import_stats::object_kinds, std::uint64_t(0));
+    };
+    std::vector<git_repository const*> repos;
+    import_stats all;
+    for (auto const& repo : repositories | map_values)
+    {
+        import_stats const& s = repo.fast_import().reported_stats();
+        if (s.processes == 0)
+            continue;
+        repos.push_back(&repo);
+        all.add(s);
+    }
+    if (repos.empty())
+        return;
+    std::sort(repos.begin(), repos.end(), [&](git_repository const* x, git_repository const* y) {
+            return total(x->fast_import().reported_stats().objects)
+                > total(y->fast_import().reported_stats().objects); });
+
+    auto row = [&](std::string const& name, import_stats const& s) {
+        std::uint64_t const objects = total(s.objects), duplicates = total(s.duplicates);
+        std::cout << std::setw(32) << std::left << name << std::right
+                  << std::setw(6) << s.processes;
+        for (std::uint64_t n : s.objects)
+            std::cout << std::setw(11) << n;
+        std::cout << std::setw(11) << duplicates << std::fixed << std::setprecision(1)
+                  << std::setw(7) << 100.0 * duplicates / std::max<std::uint64_t>(objects + duplicates, 1)
+                  << std::setw(11) << total(s.deltas) << std::setw(9) << s.branches
+                  << std::setw(9) << s.loads << std::setw(11) << (s.memory_kib >> 10)
+                  << std::setw(10) << (s.pack_bytes >> 20) << '\n';
+    };
+    std::cout << "fast-import statistics (summed over each repository's processes; "
+              << "branches and memory, the most of any):\n"
+              << std::setw(32) << std::left << "repository" << std::right << std::setw(6) << "runs"
+              << std::setw(11) << "blobs" << std::setw(11) << "trees" << std::setw(11) << "commits"
+              << std::setw(11) << "tags" << std::setw(11) << "duplicates" << std::setw(7) << "%"
+              << std::setw(11) << "deltas" << std::setw(9) << "branches" << std::setw(9) << "loads"
+              << std::setw(11) << "memory MB" << std::setw(10) << "pack MB" << '\n';
+    for (git_repository const* repo : repos)
+        row(repo->name(), repo->fast_import().reported_stats());
+    if (repos.size() > 1)
+        row("total", all);
+    std::cout << std::flush;
+
+    for (git_repository const* repo : repos)
+    {
+        import_stats const& s = repo->fast_import().reported_stats();
+        std::uint64_t const duplicates = total(s.duplicates);
+        double const ratio = double(duplicates) / std::max<std::uint64_t>(total(s.objects) + duplicates, 1);
+        if (duplicates >= duplicates_worth_noting && ratio >= duplicate_ratio_limit)
+        {
+            Log::warn() << "fast-import in " << repo->name() << " was sent " << duplicates
+                        << " objects it already had, " << std::fixed << std::setprecision(0)
+                        << 100 * ratio << "% of those it imported" << std::endl;
+        }
+        if (s.loads > loads_per_branch_limit * std::max<std::uint64_t>(s.branches, 1))
+        {
+            Log::warn() << "fast-import in " << repo->name() << " loaded its " << s.branches
+                        << " branches " << s.loads << " times; consider raising --active-branches"
+                        << std::endl;
+        }
+    }
+}
+
+void importer::report_status(int first_revnum, int last_revnum)
+{
+    status.reset(new status_report(options.status_file, first_revnum, last_revnum, history));
+}
+
+void importer::write_status()
+{
+    std::vector<status_report::repository> repos;
+    for (auto& repo : repositories | map_values)
+    {
+        git_fast_import const& fast_import = repo.fast_import();
+        status_report::repository const r = {
+            &repo.name(), fast_import.bytes_sent(), fast_import.running(), 
+            fast_import.resident_megabytes(), fast_import.unacknowledged_revisions(),
+            fast_import.last_ack_seconds()
+        };
+        repos.push_back(r);
+    }
+    status->write(revnum, repos);
+}
+
+// Close the commits open in repos, taking the responses to their "ls"
+// commands in the order they arrive, so that one slow fast-import
+// process doesn't hold up all the others.  Repositories having no
+// more commits to write in this revision are appended to closed.
+void importer::close_commits(
+    repository_set const& repos, arena_vector<git_repository*>& closed)
+{
+    arena_allocator<char> const alloc(revision_arena);
+    arena_vector<git_repository*> waiting(alloc);
+    arena_vector<git_repository*> others(alloc);
+    for (auto r : repos)
+        (r->awaiting_ls_response() ? waiting : others).push_back(r);
+
+    arena_vector<pollfd> fds(alloc);
+    while (!waiting.empty())
+    {
+        // A response already read, e.g. by another repository hosted
+        // by the same fast-import, needs no waiting for
+        fds.clear();
+        bool ready = false;
+        for (auto r : waiting)
+        {
+            pollfd fd = { r->fast_import().response_fd(), POLLIN, 0 };
+            if (r->fast_import().has_response())
+            {
+                fd.revents = POLLIN;
+                ready = true;
+            }
+            fds.push_back(fd);
+        }
+
+        if (!ready)
+        {
+            // Commands still queued for any fast-import, including
+            // the "ls" commands of these, are written meanwhile
+            profile::scope _("await ls responses");
+            git_fast_import::await_responses(&fds[0], fds.size());
+        }
+
+        std::size_t still_waiting = 0;
+        for (std::size_t i = 0; i < waiting.size(); ++i)
+        {
+            // Errors and hangups are reported by close_commit
+            if (fds[i].revents == 0)
+                waiting[still_waiting++] = waiting[i];
+            else if (waiting[i]->close_commit())
+                closed.push_back(waiting[i]);
+        }
+        waiting.resize(still_waiting);
+    }
+
+    for (auto r : others)
+    {
+        if (r->close_commit())
+            closed.push_back(r);
+    }
+}
+
+// Make the super-module commits put off whose window has ended by
+// rev, or if rev is null, all of them
+void importer::flush_submodule_commits(svn::revision const* rev)
+{
+    for (auto& repo : repositories | map_values)
+    {
+        if (repo.has_submodules() && repo.flush_submodule_commits(rev) > 0
+            && !options.push_remote.empty())
+        {
+            unpublished.insert(&repo);
+        }
+    }
+}
+
+// With --active-branches, give each repository's fast-import room for
+// the branch trees it may be writing in the same stretch of history:
+// as many as the rules have branches of the repository active at once,
+// each active from its first rule to its last, and two more for the
+// tags made meanwhile.  fast-import unloads the least recently used
+// tree when it runs out of room, and loads it again when the branch
+// is next written.
+void importer::size_active_branches()
+{
+    if (options.active_branches == 0)
+        return;
+
+    std::unordered_map<std::string, std::pair<std::size_t, std::size_t> > active;
+    for (Rule const& r : ruleset->matcher().all_rules())
+    {
+        if (r.excludes() || !boost::starts_with(r.git_ref_name(), "refs/heads/"))
+            continue;
+        auto const inserted = active.emplace(
+            r.git_repo_name() + '\0' + r.git_ref_name(), std::make_pair(r.min, r.max));
+        auto& span = inserted.first->second;
+        span.first = std::min(span.first, r.min);
+        span.second = std::max(span.second, r.max);
+    }
+
+    // The change in the number of active branches of each repository
+    // at each revision
+    std::map<std::string, std::map<std::size_t, int> > changes;
+    for (auto const& kv : active)
+    {
+        auto& repo_changes = changes[kv.first.substr(0, kv.first.find('\0'))];
+        ++repo_changes[kv.second.first];
+        if (kv.second.second < std::size_t(-1))
+            --repo_changes[kv.second.second + 1];
+    }
+
+    int const fast_import_default = 5;
+    for (auto& kv : repositories)
+    {
+        int most = 0, n = 0;
+        for (auto const& change : changes[kv.first])
+            most = std::max(most, n += change.second);
+        int const limit = std::min(
+            std::max(most + 2, fast_import_default), options.active_branches);
+        Log::debug() << kv.first << " has up to " << most << " active branches; letting git"
+                     << " fast-import keep " << limit << std::endl;
+        for (std::size_t i = 0; i < kv.second.writers(); ++i)
+            kv.second.writer(i).set_active_branches(limit);
+    }
+}
+
+// Find the refs whose rules all end, and the last revision each is
+// active in
+void importer::plan_ref_retirement()
+{
+    std::unordered_map<std::string, std::pair<std::size_t, Rule const*> > last_active;
+    for (Rule const& r : ruleset->matcher().all_rules())
+    {
+        auto& last = last_active[r.git_repo_name() + '\0' + r.git_ref_name()];
+        if (!last.second || r.max > last.first)
+            last = std::make_pair(r.max, &r);
+    }
+
+    ref_endings.clear();
+    for (auto const& kv : last_active)
+    {
+        if (kv.second.first < UINT_MAX)
+            ref_endings.push_back(kv.second);
+    }
+    std::sort(
+        ref_endings.begin(), ref_endings.end(),
+        [](std::pair<std::size_t, Rule const*> const& x, std::pair<std::size_t, Rule const*> const& y)
+        { return x.first < y.first || (x.first == y.first && x.second->index < y.second->index); });
+    refs_retired = 0;
+}
+
+// After the current revision, in which the rules of those ending in
+// the last one removed their files, retire the refs whose rules have
+// all ended.  Most of Boost's tags and old release branches are
+// finished long before the conversion is.
+void importer::retire_finished_refs()
+{
+    for (; refs_retired < ref_endings.size() && ref_endings[refs_retired].first < std::size_t(revnum);
+         ++refs_retired)
+    {
+        Rule const* const r = ref_endings[refs_retired].second;
+        auto const repo = repositories.find(r->git_repo_name());
+        if (repo == repositories.end())
+            continue;
+        if (auto ref = repo->second.find_ref(r->git_ref_name()))
+            repo->second.retire_ref(ref);
+    }
+}
+
+void importer::warn_about_cross_repository_copies()
+{
+    for (auto& kv: svn_directory_copies)
+    {
+        if (kv.second.crossed_repositories.empty())
+            continue;
+
+        auto& warn = Log::warn() 
+            << "In r" << revnum << ", SVN directory copy " 
+            << kv.second.src_directory << " => " << kv.first
+            << " crossed Git repositories:";
+
+        for (auto& src_dst : kv.second.crossed_repositories)
+        {
+            warn << " (" << *src_dst.first << " -> " << *src_dst.second << ")";
+        }
+
+        warn << std::endl;
+    }
+}
+
+void importer::prune_branches()
+{
+    flush_submodule_commits(nullptr);
+    std::size_t pruned = 0;
+    for (auto& repo : repositories | map_values)
+    {
+        std::size_t const n = repo.prune_branches();
+        pruned += n;
+        if (n > 0 && !options.push_remote.empty())
+            unpublished.insert(&repo);
+    }
+    Log::info() << "deleted " << pruned << " merged or empty branches" << std::endl;
+}
+
+importer::~importer()
+{
+    if (finished)
+        return;
+    try
+    {
+        // A revision abandoned part way through can't be resumed from
+        if (revnum > 0 && !revision_in_progress)
+        {
+            checkpoint();
+            if (status)
+                write_status();
+        }
+    }
+    catch(std::exception const& e)
+    {
+        Log::error() << "Couldn't save checkpoint: " << e.what() << std::endl;
+    }
+
+    // Close every fast-import's input before the repositories'
+    // destructors wait for any to exit, so that they all finish their
+    // packs at once rather than one after another.
+    for (auto& repo : repositories | map_values)
+    {
+        for (std::size_t i = 0; i < repo.writers(); ++i)
+            repo.writer(i).close();
+    }
+    for (auto& host : hosts | map_values)
+        host.close();
+}
+
+void importer::finish()
+{
+    if (revnum > 0)
+    {
+        checkpoint();
+        if (status)
+            write_status();
+    }
+    finished = true;
+    close_fast_imports();
+    if (options.pack_refs)
+    {
+        std::vector<git_repository const*> all;
+        for (auto const& repo : repositories | map_values)
+            all.push_back(&repo);
+        pack_refs(all);
+    }
+    if (options.repack_cpus == 0)
+        return;
+
+    // Ingesting fast only pays if the repack doesn't take it back
+    typedef std::chrono::steady_clock clock;
+    auto const converted = clock::now();
+    repack(options.repack_cpus);
+    Log::info() << "converted in "
+                << std::chrono::duration<double>(converted - started).count() << "s, repacked in "
+                << std::chrono::duration<double>(clock::now() - converted).count() << "s"
+                << (options.fast_ingest ? " after a fast ingest" : "") << std::endl;
+}
+
+void importer::write_commit_index(std::string const& filename) const
+{
+    std::vector<commit_index::entry> entries;
+    for (auto const& r : repositories)
+    {
+        git_repository const& repo = r.second;
+        if (repo.is_shadow())
+            continue;
+        mark_sha_map shas;
+        std::string const marks_path = marks_file_path(repo.name());
+        if (boost::filesystem::exists(marks_path))
+            shas.read_marks_file(marks_path);
+
+        std::size_t saved_revnum;
+        for (auto const& ref : git_repository::saved_marks(repo.name(), saved_revnum))
+        {
+            for (auto const& m : ref.second)
+            {
+                commit_index::entry e = { m.first, r.first, ref.first, m.second, {} };
+                char hex[mark_sha_map::sha_length];
+                if (shas.find(m.second, hex))
+                {
+                    auto const sha = sha1::from_hex(hex);
+                    std::copy(sha.begin(), sha.end(), e.sha);
+                }
+                entries.push_back(std::move(e));
+            }
+        }
+    }
+    commit_index::write(filename, entries);
+    Log::info() << "indexed " << entries.size() << " commits in " << filename << std::endl;
 }
 
-path importer::add_svn_tree_to_delete(path const& svn_path, Rule const* match)
+// Close every fast-import's input, then wait for them all at once,
+// each on a thread of its own, reporting how long each took to write
+// its last pack and marks.
+void importer::close_fast_imports()
 {
-    assert(match);
-    assert(svn_path.starts_with(match->svn_path()));
-
-    // Find the unmatched suffix of the path
-    path path_suffix = svn_path.sans_prefix(match->svn_path());
+    profile::scope _("finish fast-imports");
+    typedef std::chrono::steady_clock clock;
+    auto const start = clock::now();
+    for (auto& repo : repositories | map_values)
+    {
+        for (std::size_t i = 0; i < repo.writers(); ++i)
+            repo.writer(i).close();
+    }
+    // Once the repositories they host have written all they will
+    for (auto& host : hosts | map_values)
+        host.close();
 
-    // Access the ref for modification
-    auto* ref = prepare_to_modify(match, true);
+    // Each running fast-import, with the directory it writes
+    std::vector<std::pair<git_fast_import*, std::string const*> > running;
+    for (auto& repo : repositories | map_values)
+    {
+        for (std::size_t i = 0; i < repo.writers(); ++i)
+        {
+            if (repo.writer(i).running())
+                running.emplace_back(&repo.writer(i), &repo.name());
+        }
+    }
+    for (auto& host : hosts)
+    {
+        if (host.second.running())
+            running.emplace_back(&host.second, &host.first);
+    }
 
-    // Mark the git path to be deleted at the start of the commit
-    ref->pending_deletions.insert( match->git_path()/path_suffix );
+    std::mutex mutex;
+    std::string last;
+    double last_seconds = 0;
+    std::exception_ptr error;
+    std::vector<std::thread> waiters;
+    for (auto const& f : running)
+    {
+        waiters.emplace_back([&, f] {
+            std::exception_ptr e;
+            try
+            {
+                f.first->wait();
+            }
+            catch (...)
+            {
+                e = std::current_exception();
+            }
+            double const seconds = std::chrono::duration<double>(clock::now() - start).count();
+            std::lock_guard<std::mutex> lock(mutex);
+            Log::debug() << "fast-import finished " << *f.second
+                         << " after " << seconds << "s" << std::endl;
+            if (e && !error)
+                error = e;
+            if (seconds >= last_seconds)
+            {
+                last = *f.second;
+                last_seconds = seconds;
+            }
+        });
+    }
+    for (auto& t : waiters)
+        t.join();
+    if (!waiters.empty())
+    {
+        Log::info() << waiters.size() << " fast-imports finished in " << last_seconds
+                    << "s, the last writing " << last << std::endl;
+    }
+    if (error)
+        std::rethrow_exception(error);
+    for (auto const& repo : repositories | map_values)
+        repo.join_writers_marks();
 
-    return path_suffix;
+    // Now that the hosts have written their refs, the repositories
+    // they hosted can have theirs
+    for (auto& repo : repositories | map_values)
+    {
+        if (!repo.fast_import().ref_prefix().empty())
+            repo.split_from_host(host_of.at(repo.name()));
+    }
+    if (!hosts.empty())
+        Log::info() << "split " << host_of.size() << " hosted repositories from "
+                    << hosts.size() << " hosts" << std::endl;
 }
 
-void importer::invalidate_svn_tree(
-    svn::revision const& rev, path const& svn_path, Rule const* match)
+// Repack every converted repository with "git repack -a -d" and
+// write its commit-graph, keeping at most cpus threads busy.  The
+// largest repositories go first, each given the CPUs left over shared
+// among the repositories left to start, so the big ones get several
+// threads and the many small ones at the end get one each.
+void importer::repack(unsigned cpus)
 {
-    path path_suffix = add_svn_tree_to_delete(svn_path, match);
-
-    add_svn_tree_to_convert(rev, svn_path);
+    profile::scope _("repack");
+    typedef std::chrono::steady_clock clock;
+    auto const start = clock::now();
 
-    // Mark every svn tree that's mapped into the rule's git subtree for
-    // (re-)conversion.
+    std::vector<std::pair<std::uint64_t, git_repository const*> > queue;
+    for (auto const& repo : repositories | map_values)
+    {
+        if (!repo.is_shadow())
+            queue.emplace_back(repo.pack_bytes(), &repo);
+    }
+    std::sort(queue.begin(), queue.end(),
+              [](std::pair<std::uint64_t, git_repository const*> const& x,
+                 std::pair<std::uint64_t, git_repository const*> const& y)
+              { return x.first > y.first; });
+
+    std::vector<git_repository::serving_stats> served(queue.size());
+    std::mutex mutex;
+    std::condition_variable cpus_freed;
+    unsigned free_cpus = cpus;
+    std::size_t next = 0;
+    std::exception_ptr error;
+    auto worker = [&] {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (next < queue.size())
+        {
+            cpus_freed.wait(lock, [&] { return free_cpus > 0; });
+            if (next == queue.size())
+                break;
+            std::size_t const index = next++;
+            git_repository const& repo = *queue[index].second;
+            std::size_t const waiting = queue.size() - next + 1;
+            unsigned const threads = std::max(1u, unsigned(free_cpus / waiting));
+            free_cpus -= threads;
+            lock.unlock();
+
+            auto const repo_start = clock::now();
+            std::exception_ptr e;
+            try
+            {
+                served[index] = repo.repack(threads);
+            }
+            catch (...)
+            {
+                e = std::current_exception();
+            }
+
+            lock.lock();
+            free_cpus += threads;
+            cpus_freed.notify_all();
+            Log::debug() << "repacked " << repo.name() << " on " << threads << " threads in "
+                         << std::chrono::duration<double>(clock::now() - repo_start).count()
+                         << "s" << std::endl;
+            if (e && !error)
+                error = e;
+        }
+    };
 
-    ruleset.matcher().git_subtree_rules(
-        // FIXME: concatenating a subpath to a git address is pretty ugly!
-        match->git_address() 
-        + (match->git_path().str().empty() ? "" : "/") 
-        + path_suffix.str(), 
-        revnum,
-        boost::make_function_output_iterator(
-            [&](Rule const* r){ add_svn_tree_to_convert(rev, r->svn_path()); })
-    );
+    std::vector<std::thread> workers;
+    for (std::size_t n = std::min<std::size_t>(cpus, queue.size()); n > 0; --n)
+        workers.emplace_back(worker);
+    for (auto& t : workers)
+        t.join();
+    Log::info() << "repacked " << queue.size() << " repositories in "
+                << std::chrono::duration<double>(clock::now() - start).count() << "s" << std::endl;
+    if (error)
+        std::rethrow_exception(error);
+    if (options.serve_packs)
+        report_serving(queue, served);
 }
 
-void importer::add_svn_tree_to_convert(
-    svn::revision const& rev, path const& svn_path)
+// With --serve-packs, what repacking for serving did to the size of
+// each repository's packs and the time taken to clone it, those that
+// were largest first
+void importer::report_serving(
+    std::vector<std::pair<std::uint64_t, git_repository const*> > const& repos,
+    std::vector<git_repository::serving_stats> const& served) const
 {
-    // Mark this svn_path for conversion.  
-    auto kind = svn::call(
-        svn_fs_check_path, rev.fs_root, svn_path.c_str(), rev.pool);
-
-    if (kind != svn_node_none) {
-        Log::trace() << "adding " << svn_path << " for conversion" << std::endl;
-        svn_paths_to_convert.insert(svn_path);
+    git_repository::serving_stats all = git_repository::serving_stats();
+    auto row = [](std::string const& name, git_repository::serving_stats const& s) {
+        std::cout << std::setw(32) << std::left << name << std::right << std::fixed
+                  << std::setprecision(1)
+                  << std::setw(11) << s.bytes_before / 1048576.0
+                  << std::setw(11) << s.bytes_after / 1048576.0
+                  << std::setw(8) << 100.0 * s.bytes_after / std::max<std::uint64_t>(s.bytes_before, 1)
+                  << std::setprecision(2)
+                  << std::setw(11) << s.clone_seconds_before
+                  << std::setw(11) << s.clone_seconds_after << '\n';
+    };
+    std::cout << "packs repacked for serving:\n"
+              << std::setw(32) << std::left << "repository" << std::right
+              << std::setw(11) << "MB before" << std::setw(11) << "MB after" << std::setw(8) << "%"
+              << std::setw(11) << "clone s" << std::setw(11) << "clone s now" << '\n';
+    for (std::size_t i = 0; i < repos.size(); ++i)
+    {
+        git_repository::serving_stats const& s = served[i];
+        row(repos[i].second->name(), s);
+        all.bytes_before += s.bytes_before;
+        all.bytes_after += s.bytes_after;
+        all.clone_seconds_before += s.clone_seconds_before;
+        all.clone_seconds_after += s.clone_seconds_after;
     }
+    row("all", all);
 }
 
-// Deal with all the SVN changes in this revision.  We're not actually
-// writing any file contents (blobs or trees) to Git in this step.
-// Our job is merely to make a record of paths to be deleted in Git at
-// the beginning of the commit and SVN files/directories to
-// subsequently be traversed and converted to Git blobs and trees.
-void importer::process_svn_changes(svn::revision const& rev)
+// With --slow-revisions, report the revision just imported if it took
+// elapsed, long enough, with the paths its plan converted by rule, the
+// most first
+void importer::report_slow_revision(std::chrono::steady_clock::duration elapsed) const
 {
-    apr_hash_t *changes = svn::call(svn_fs_paths_changed2, rev.fs_root, rev.pool);
-    for (apr_hash_index_t *i = apr_hash_first(rev.pool, changes); i; i = apr_hash_next(i))
+    double const seconds = std::chrono::duration<double>(elapsed).count();
+    bool const slow = profile::end_revision(revnum, seconds, [this](std::ostream& os) {
+        std::unordered_map<Rule const*, std::size_t> paths;
+        for (auto const& f : plan.files)
+            ++paths[f.match];
+        std::vector<std::pair<std::size_t, Rule const*> > by_count;
+        for (auto const& p : paths)
+            by_count.emplace_back(p.second, p.first);
+        std::sort(by_count.begin(), by_count.end(),
+                  [](std::pair<std::size_t, Rule const*> const& x,
+                     std::pair<std::size_t, Rule const*> const& y)
+                  {
+                      return x.first > y.first
+                          || (x.first == y.first && x.second->index < y.second->index);
+                  });
+        os << "  " << plan.files.size() << " paths converted, " << plan.deletions.size()
+           << " deleted and " << plan.directory_copies.size() << " directories copied\n"
+           << "  " << std::setw(12) << "paths" << "  rule\n";
+        for (auto const& x : by_count)
+            os << "  " << std::setw(12) << x.first << "  " << *x.second << '\n';
+    });
+    if (slow)
     {
-        const char *svn_path_ = 0;
-        svn_fs_path_change2_t *change = 0;
-        apr_hash_this(i, (const void**) &svn_path_, nullptr, (void**) &change);
-        // According to the APR docs, this means the hash entry was
-        // deleted, so it should never happen
-        assert(change != nullptr); 
-
-        // Ignore changes that only edit properties
-        if (change->change_kind == svn_fs_path_change_modify && !change->text_mod)
-            continue;
-
-        path const svn_path(svn_path_);
-        
-        // We have found a path being modified in SVN.  Note: it's
-        // too early to error-out on unmapped SVN paths here: any that
-        // are problematic will be picked up later.
-        Rule const* const match = match_svn_path(svn_path, revnum, false);
-
-        // Start by marking its Git target for deletion.  
-        if (match)
-            add_svn_tree_to_delete(svn_path, match);
-
-        // If it wasn't being deleted in SVN, also convert all of its
-        // files to Git.
-        if (change->change_kind != svn_fs_path_change_delete)
-            add_svn_tree_to_convert(rev, svn_path);
-
-        // Assume it's a directory if it's not known to be a file.
-        // This is conservative, in case node_kind == svn_node_unknown.
-        if (change->node_kind != svn_node_file)
-            process_svn_directory_change(rev, change, svn_path);
+        Log::info() << "r" << revnum << " took " << seconds << "s; its breakdown is in "
+                    << options.slow_revisions << std::endl;
     }
 }
 
-void importer::process_svn_directory_change(
-    svn::revision const& rev, svn_fs_path_change2_t *change, path const& svn_path)
+// With --pack-refs, pack the refs of repos, reporting how many each
+// has, and how many they have in all
+void importer::pack_refs(std::vector<git_repository const*> const& repos) const
 {
-    // Remember directory copy sources
-    if (change->copyfrom_known && change->copyfrom_path != nullptr)
+    profile::scope _("pack refs");
+    std::size_t total = 0;
+    std::size_t packed = 0;
+    for (auto repo : repos)
     {
-        // It's OK to retain only the last source directory if
-        // this target was copied-to more than once
-        auto& copy = svn_directory_copies[svn_path];
-        copy.src_revision = change->copyfrom_rev;
-        copy.src_directory = change->copyfrom_path;
+        if (repo->is_shadow())
+            continue;
+        std::size_t const n = repo->pack_refs();
+        Log::debug() << repo->name() << " has " << n << " refs" << std::endl;
+        total += n;
+        ++packed;
     }
+    if (packed > 0)
+        Log::info() << "packed " << total << " refs in " << packed << " repositories" << std::endl;
+}
 
-    // Handle rules that map SVN subtrees of the deleted path
-     ruleset.matcher().svn_subtree_rules(
-         svn_path.str(), revnum,
-         // Mark the target Git tree for deletion, but
-         // also convert all SVN trees being mapped into a
-         // subtree of the Git tree.
-         boost::make_function_output_iterator(
-             [&](Rule const* r){ 
-                 invalidate_svn_tree(rev, r->svn_path(), r); }));
+namespace
+{
+    // The destination of file contents streamed out of SVN: the
+    // fast-import process, and the hash that will name the blob in Git
+    struct blob_sink
+    {
+        git_fast_import& fast_import;
+        git_blob_hasher hash;
+    };
 }
 
-void importer::import_revision(int revnum)
+extern "C"
 {
-    if (Log::get_level() >= Log::Trace)
+    svn_error_t *fast_import_raw_bytes(void *baton, const char *data, apr_size_t *len)
     {
-        Log::trace() 
-        << "################## importing revision " 
-        << revnum << " ##################" << std::endl;
+        auto& sink = *static_cast<blob_sink*>(baton);
+        try
+        {
+            sink.fast_import.write_raw(data, *len);
+            sink.hash.update(data, *len);
+            return SVN_NO_ERROR;
+        }
+        catch(std::exception const& e)
+        {
+            return svn_error_createf(APR_EOF, SVN_NO_ERROR, "%s", e.what());
+        }
+        catch(...)
+        {
+            return svn_error_createf(APR_EOF, SVN_NO_ERROR, "unknown error");
+        }
     }
-    else if (revnum % 1000 == 0)
+
+    svn_error_t *lfs_object_bytes(void *baton, const char *data, apr_size_t *len)
     {
-        Log::info() << "importing revision " << revnum << std::endl;
+        try
+        {
+            static_cast<lfs_object*>(baton)->write(data, *len);
+            return SVN_NO_ERROR;
+        }
+        catch(std::exception const& e)
+        {
+            return svn_error_createf(APR_EOF, SVN_NO_ERROR, "%s", e.what());
+        }
+        catch(...)
+        {
+            return svn_error_createf(APR_EOF, SVN_NO_ERROR, "unknown error");
+        }
     }
 
-    this->revnum = revnum;
-    svn::revision rev = svn_repository[revnum];
-
-    // Importing an SVN revision happens in two phases.  In the first
-    // phase we discover actions to be performed: Git subtrees that
-    // must be deleted and SVN subtrees whose files must be
-    // (re-)convertd to Git.  In the second phase, we actually do
-    // those deletions and translations.
+    svn_error_t *append_to_string(void *baton, const char *data, apr_size_t *len)
+    {
+        static_cast<std::string*>(baton)->append(data, *len);
+        return SVN_NO_ERROR;
+    }
 
-    //
-    // Phase I: Action Discovery.  
-    //
-    svn_paths_to_convert.clear();
-    changed_repositories.clear();
-    svn_directory_copies.clear();
+    // Read the whole of the given SVN file into contents
+    void read_svn_file(
+        svn_fs_root_t* fs_root, path const& svn_path, std::string& contents, apr_pool_t* pool)
+    {
+        svn_stream_t* in_stream = svn::call(
+            svn_fs_file_contents, fs_root, svn_path.c_str(), pool);
+        svn_stream_t* out_stream = svn_stream_create(&contents, pool);
+        svn_stream_set_write(out_stream, append_to_string);
+        svn::check(svn_stream_copy3, in_stream, out_stream, nullptr, nullptr, pool);
+    }
+}
 
-    // Deal with rules becoming active/inactive in this revision
-    for (Rule const* r: ruleset.matcher().rules_in_transition(revnum))
-        invalidate_svn_tree(rev, r->svn_path(), r);
+// Returns a string that identifies the contents of the given SVN
+// file: its SHA-1 checksum where the repository has recorded one,
+// and its node-revision ID otherwise.  Files with equal keys have
+// identical contents.
+static std::string svn_content_key(
+    svn_fs_root_t* fs_root, path const& svn_path, apr_pool_t* pool)
+{
+    svn_checksum_t* checksum = svn::call(
+        svn_fs_file_checksum, svn_checksum_sha1, fs_root, svn_path.c_str(), FALSE, pool);
+    if (checksum)
+        return std::string("sha1:") + svn_checksum_to_cstring(checksum, pool);
+
+    svn_fs_id_t const* id = svn::call(
+        svn_fs_node_id, fs_root, svn_path.c_str(), pool);
+    svn_string_t const* id_text = svn_fs_unparse_id(id, pool);
+    return "id:" + std::string(id_text->data, id_text->len);
+}
 
-    // Discover SVN paths that are being deleted/modified
-    process_svn_changes(rev);
+static std::string svn_content_key(
+    svn::revision const& rev, path const& svn_path, apr_pool_t* pool)
+{
+    return svn_content_key(rev.fs_root, svn_path, pool);
+}
 
-    Log::trace() 
-        << svn_paths_to_convert.size() 
-        << " SVN " 
-        << (svn_paths_to_convert.size() == 1 ? "path" : "paths")
-        << " to convert" << std::endl;
+// Returns the Git mode of the given SVN file, as its svn:executable
+// property decides, and with --normalize-text, the normalizer its
+// svn:eol-style and svn:keywords properties call for.  A
+// node-revision's properties never change, so these are cached by
+// node-revision ID across revisions, sparing SVN finding and parsing
+// the file's properties each time.
+importer::file_properties importer::svn_file_properties(
+    svn::revision const& rev, path const& svn_path, apr_pool_t* pool)
+{
+    svn_fs_id_t const* id = svn::call(svn_fs_node_id, rev.fs_root, svn_path.c_str(), pool);
+    svn_string_t const* id_text = svn_fs_unparse_id(id, pool);
+    std::string node_id(id_text->data, id_text->len);
 
-    discover_merges(rev);
+    {
+        std::lock_guard<std::mutex> lock(file_properties_mutex);
+        if (auto const cached = file_properties_cache.find(node_id))
+            return *cached;
+    }
 
-    //
-    // Phase II: Writing to Git
-    //
+    svn_string_t const* executable = svn::call(
+        svn_fs_node_prop, rev.fs_root, svn_path.c_str(), "svn:executable", pool);
+    file_properties props = { executable ? 0100755ul : 0100644ul, nullptr };
 
-    // Though it is expected to be rare, a single SVN commit can
-    // generate commits in multiple refs of the same Git repo.
-    // However, the changes in a single Git ref's commit must all be
-    // sent contiguously to the fast-import process.  Therefore, for
-    // each Git ref that must be committed during this SVN revision, a
-    // separate pass over the SVN trees to convert is required.
-    //
-    // During each pass, we map SVN paths to Git, and may discover Git
-    // repositories and refs to that need to be committed in this SVN
-    // revision.  As we handle refs and repositories, we remove them
-    // from the set of changed things.  To avoid processing them
-    // again, this discovery is only enabled in the first pass.  This
-    // explains the "discover_changes" parameters you see in many of
-    // this class' member functions.
-    int pass = 0;
-    do
-    {
-        Log::trace() << "pass " << pass << std::endl;
-        assert(pass < 500);
-
-        // Make a copy so it can be modified as we work this pass
-        auto changed_repos = changed_repositories;
-        for (auto r : changed_repos)
-            r->open_commit(rev);
-        
-        auto paths_to_convert = svn_paths_to_convert;
-        for (auto& svn_path : paths_to_convert)
-            convert_svn_tree(rev, svn_path.c_str(), pass == 0);
-
-        for (auto r : changed_repos)
-            r->prepare_to_close_commit();
-
-        std::vector<git_repository*> closed_repositories;
-        for (auto r : changed_repos)
-        {
-            if (r->close_commit())
-                closed_repositories.push_back(r);
+    if (options.normalize_text)
+    {
+        svn_string_t const* eol_style = svn::call(
+            svn_fs_node_prop, rev.fs_root, svn_path.c_str(), "svn:eol-style", pool);
+        svn_string_t const* keywords = svn::call(
+            svn_fs_node_prop, rev.fs_root, svn_path.c_str(), "svn:keywords", pool);
+        if (eol_style || keywords)
+        {
+            auto key = std::make_pair(
+                eol_style ? std::string(eol_style->data, eol_style->len) : std::string(),
+                keywords ? std::string(keywords->data, keywords->len) : std::string());
+            std::lock_guard<std::mutex> lock(file_properties_mutex);
+            auto p = normalizers.find(key);
+            if (p == normalizers.end())
+                p = normalizers.emplace(key, text_normalizer(key.first, key.second)).first;
+            if (p->second.enabled())
+                props.normalizer = &p->second;
         }
-
-        for (auto r : closed_repositories)
-            changed_repositories.erase(r);
-        
-        ++pass;
     }
-    while(!changed_repositories.empty());
 
-    warn_about_cross_repository_copies();
+    std::lock_guard<std::mutex> lock(file_properties_mutex);
+    file_properties_cache.insert(node_id, props, 1);
+    return props;
 }
 
-void importer::warn_about_cross_repository_copies()
+// Hand the prefetcher every planned file whose content its target
+// repository hasn't seen yet.  With --preemit-blobs, files offloaded
+// to LFS are left to convert_svn_file, which streams them there.
+void importer::prefetch_svn_files(svn::revision const& rev)
 {
-    for (auto& kv: svn_directory_copies)
+    std::vector<path> files;
+    for (auto const& bucket : files_by_ref)
     {
-        if (kv.second.crossed_repositories.empty())
+        if (bucket.first->repo->is_shadow())
             continue;
-
-        auto& warn = Log::warn() 
-            << "In r" << revnum << ", SVN directory copy " 
-            << kv.second.src_directory << " => " << kv.first
-            << " crossed Git repositories:";
-
-        for (auto& src_dst : kv.second.crossed_repositories)
+        for (auto const& f : bucket.second)
         {
-            warn << " (" << src_dst.first << " -> " << src_dst.second << ")";
+            AprScratch scope(rev.scratch);
+            std::string key = svn_content_key(rev, f.svn_path, scope);
+            file_properties const props = svn_file_properties(rev, f.svn_path, scope);
+            if (props.normalizer)
+                key += props.normalizer->key_suffix();
+            if (options.preemit_blobs
+                && offloads_to_lfs(rev, f.svn_path, f.match->git_path(f.svn_path), props, scope))
+            {
+                continue;
+            }
+            if (!find_blob(*bucket.first->repo, key)
+                && cached_blob(*bucket.first->repo, key).is_null())
+            {
+                files.push_back(f.svn_path);
+            }
         }
-
-        warn << std::endl;
     }
+    prefetcher->start(revnum, std::move(files));
 }
 
-importer::~importer()
+// With --preemit-blobs, write each prefetched file to the repositories
+// it is planned for as a blob, as soon as a reader thread has it, so
+// that no read waits on those before it.  Blobs may precede the commit
+// using them, which then names them by SHA-1 in convert_svn_file.
+void importer::preemit_blobs(svn::revision const& rev)
 {
-    // Apparently there's at least some ordering constraint that is
-    // violated by simply closing and waiting for the death of each
-    // process, in sequence.  If we don't close all the input streams
-    // here, we hang waiting for the first process to exit after
-    // closing its stream.
-    for (auto& repo : repositories | map_values)
-        repo.fast_import().close();
-}
+    // The repositories each prefetched file goes to, but for those
+    // that offload it to LFS
+    std::unordered_map<std::string, std::vector<git_repository*> > destinations;
+    for (auto const& bucket : files_by_ref)
+    {
+        git_repository* repo = bucket.first->repo;
+        if (repo->is_shadow())
+            continue;
+        for (auto const& f : bucket.second)
+        {
+            AprScratch scope(rev.scratch);
+            if (offloads_to_lfs(
+                    rev, f.svn_path, f.match->git_path(f.svn_path),
+                    svn_file_properties(rev, f.svn_path, scope), scope))
+            {
+                continue;
+            }
+            auto& repos = destinations[f.svn_path.str()];
+            if (std::find(repos.begin(), repos.end(), repo) == repos.end())
+                repos.push_back(repo);
+        }
+    }
 
-template <class F>
-void for_each_svn_file(
-    svn::revision const& rev, path const& svn_path, F const& f, AprPool* pool_ = 0)
-{
-    if (boost::contains(svn_path.str(), "/CVSROOT/"))
-        return;
+    path svn_path;
+    std::string contents;
+    while (prefetcher->take_next(svn_path, contents))
+    {
+        AprScratch scope(rev.scratch);
+        std::string content_key = svn_content_key(rev, svn_path, scope);
+        file_properties const props = svn_file_properties(rev, svn_path, scope);
+        if (props.normalizer)
+        {
+            content_key += props.normalizer->key_suffix();
+            props.normalizer->apply(contents);
+        }
 
-    auto& pool = pool_ ? *pool_ : rev.pool;
+        std::string const sha = git_blob_hasher(contents.size()).update(contents).hex_digest();
+        for (auto repo : destinations[svn_path.str()])
+        {
+            if (find_blob(*repo, content_key) || !cached_blob(*repo, content_key).is_null())
+                continue;
+            if (blob_cache)
+                blob_cache->add(content_key, sha);
+            bool const known = repo->has_blob_sha(sha);
+            if (repo->remember_blob(content_key, sha))
+                preemitted.emplace(repo, sha);
+            if (known)
+                continue;
+            profile::add("bytes preemitted", repo->name(), contents.size());
+            auto& fast_import = repo->fast_import();
+            fast_import << "blob" << LF;
+            fast_import.data(contents.data(), contents.size());
+        }
+    }
+}
 
-    switch( svn::call(svn_fs_check_path, rev.fs_root, svn_path.c_str(), pool) )
+// Note the contents planned for more than one repository in this
+// revision, e.g. a file the rules map into one repository copied to a
+// path they map into another, so that convert_svn_file reads them
+// from SVN only once.  Within one repository, the blob written for
+// the first destination is reused anyway.
+void importer::plan_fanned_out_files(svn::revision const& rev)
+{
+    git_repository const* some_repo = nullptr;
+    bool several_repos = false;
+    for (auto const& bucket : files_by_ref)
     {
-    case svn_node_none: // If it turns out there's nothing here, there's nothing to do.
-        Log::error() << svn_path << " doesn't exist!" << std::endl;
-        assert(!"We added a non-existent path to convert somehow?!");
-        return;
-
-    case svn_node_unknown:
-        Log::error() << svn_path << " has unknown type!" << std::endl;
-        assert(!"SVN should know the type of every node in its filesystem?!");
+        if (bucket.first->repo->is_shadow() || bucket.first->repo == some_repo)
+            continue;
+        several_repos = some_repo != nullptr;
+        some_repo = bucket.first->repo;
+        if (several_repos)
+            break;
+    }
+    if (!several_repos)
         return;
 
-    case svn_node_file:
-        f(svn_path);
-        break;
-
-    case svn_node_dir:
-        AprPool dir_pool = pool.make_subpool();
-        apr_hash_t *entries = svn::call(svn_fs_dir_entries, rev.fs_root, svn_path.c_str(), dir_pool);
-        for (apr_hash_index_t *i = apr_hash_first(dir_pool, entries); i; i = apr_hash_next(i))
+    // How many destinations each content has, and their repository,
+    // or null if they have several
+    std::unordered_map<std::string, std::pair<int, git_repository const*> > destinations;
+    for (auto const& bucket : files_by_ref)
+    {
+        git_repository const* repo = bucket.first->repo;
+        if (repo->is_shadow())
+            continue;
+        for (auto const& f : bucket.second)
         {
-            char const* subpath;
-            void* value;
-            apr_hash_this(i, (void const **)&subpath, nullptr, nullptr);
-            for_each_svn_file(rev, svn_path/subpath, f, &dir_pool);
+            AprScratch scope(rev.scratch);
+            auto& d = destinations.emplace(
+                svn_content_key(rev, f.svn_path, scope), std::make_pair(0, repo)).first->second;
+            ++d.first;
+            if (d.second != repo)
+                d.second = nullptr;
         }
-        break;
-    };
+    }
+    for (auto& d : destinations)
+    {
+        if (d.second.second == nullptr)
+        {
+            fanned_out_content c = { d.second.first, false, std::string() };
+            fanned_out.emplace(d.first, std::move(c));
+        }
+    }
+}
+
+// Open the commit of r's ready ref, and write the files planned for
+// it, unless r is a shadow
+// Write the commit ready in r and prepare to close it, then with
+// --pipeline-commits, those of its other refs, one by one; see
+// pipeline_commits
+void importer::write_commits(svn::revision const& rev, git_repository& r)
+{
+    write_files(rev, r);
+    r.prepare_to_close_commit();
+    pipeline_commits(rev, r);
 }
 
-void importer::discover_merges(svn::revision const& rev)
+// With --pipeline-commits, while another ref of r is ready for its
+// commit, set aside the one prepared to close, whose "ls" is sent, and
+// write the next, so that a revision changing many refs of r awaits
+// fast-import once rather than once a ref.  close_commits closes them
+// all.  The refs written are left in files_by_ref, since write_files
+// may be looking it up on other threads.
+void importer::pipeline_commits(svn::revision const& rev, git_repository& r)
 {
-    for (auto& kv : svn_directory_copies)
+    while (r.set_commit_aside())
     {
-        for_each_svn_file(
-            rev, kv.first,
-            [=](path const& file_path) 
-            {
-                if (Rule const* const match = match_svn_path(file_path, revnum))
-                {
-                    auto* dst_ref = prepare_to_modify(match, true);
-                    record_merges(dst_ref, file_path, match);
-                }
-            });
+        if (files_by_ref.count(r.ready_ref()))
+            git_repository::unalias_ref(r.ready_ref());
+        write_files(rev, r);
+        r.prepare_to_close_commit();
     }
 }
 
-void importer::convert_svn_tree(
-    svn::revision const& rev, path const& svn_path, bool discover_changes)
+void importer::write_files(svn::revision const& rev, git_repository& r)
 {
-    for_each_svn_file(
-        rev, svn_path, 
-        [=,&rev](path const& file_path) {
-            convert_svn_file(rev, file_path, discover_changes); 
-        });
+    profile::scope _("write files", &r.name());
+    auto* dst_ref = r.open_commit(rev);
+    auto const files = files_by_ref.find(dst_ref);
+    if (files == files_by_ref.end() || r.is_shadow())
+        return;
+    for (auto const& f : files->second)
+    {
+        SVN2GIT_PROBE1(convert_file__start, f.svn_path.c_str());
+        flight_recorder::note("file", f.svn_path.str(), f.match->git_address(), revnum);
+        typedef std::chrono::steady_clock clock;
+        auto const start = options.coverage ? clock::now() : clock::time_point();
+        std::uint64_t const bytes = convert_svn_file(rev, f.svn_path, f.match, dst_ref);
+        SVN2GIT_PROBE1(convert_file__done, f.svn_path.c_str());
+        if (options.coverage)
+        {
+            coverage::convert(
+                *f.match, f.svn_path.str(), revnum, bytes,
+                std::chrono::duration<double>(clock::now() - start).count());
+        }
+    }
 }
 
-extern "C"
+// Write the given file, which the given rule maps into dst_ref, in
+// the commit currently open on dst_ref, returning the bytes of its
+// contents written, for --coverage.
+std::uint64_t importer::convert_svn_file(
+    svn::revision const& rev, path const& svn_path, 
+    Rule const* match, git_repository::ref* dst_ref)
 {
-    svn_error_t *fast_import_raw_bytes(void *baton, const char *data, apr_size_t *len)
+    auto& fast_import = dst_ref->repo->fast_import();
+
+    AprScratch scope(rev.scratch);
+    path const git_path = match->git_path(svn_path);
+    file_properties const props = svn_file_properties(rev, svn_path, scope);
+    unsigned long const mode = props.mode;
+
+    // If this content has been sent to the repository before, just
+    // refer to the existing blob.  Normalized contents are told apart
+    // from the same contents as SVN has them.
+    std::string content_key = svn_content_key(rev, svn_path, scope);
+
+    // Contents with destinations in other repositories are read by
+    // the first of them and held for the rest, which the last takes
+    // over; see plan_fanned_out_files.  With --write-threads, those
+    // destinations may be written at once, so what is held is only
+    // looked at under fanned_out_mutex.
+    std::string contents;
+    bool in_hand = false;
+    std::string fanout_key;     // empty unless held for the rest
     {
-        auto& fast_import = *static_cast<git_fast_import*>(baton);
-        try
+        std::lock_guard<std::mutex> lock(fanned_out_mutex);
+        auto const fanout = fanned_out.find(content_key);
+        if (fanout != fanned_out.end() && --fanout->second.destinations == 0)
         {
-            fast_import.write_raw(data, *len);
-            return SVN_NO_ERROR;
+            if (fanout->second.read)
+            {
+                contents = std::move(fanout->second.contents);
+                fanned_out_bytes -= contents.size();
+                in_hand = true;
+            }
+            fanned_out.erase(fanout);
         }
-        catch(std::exception const& e)
+        else if (fanout != fanned_out.end())
+            fanout_key = content_key;
+    }
+
+    if (props.normalizer)
+        content_key += props.normalizer->key_suffix();
+    bool const offload = offloads_to_lfs(rev, svn_path, git_path, props, scope);
+    if (offload)
+        content_key += "|lfs";
+    if (auto sha = dst_ref->repo->find_blob(content_key))
+    {
+        bool const fresh = preemitted.erase(std::make_pair(dst_ref->repo, *sha)) != 0;
+        if (!fresh)
+            profile::add("reused blobs", dst_ref->repo->name(), 0);
+        if (!dst_ref->repo->unchanged_by_remapping(git_path, mode, *sha))
         {
-            return svn_error_createf(APR_EOF, SVN_NO_ERROR, "%s", e.what());
+            fast_import.filemodify(git_path, mode, *sha);
+            dst_ref->repo->note_file_written(git_path, mode, *sha, fresh);
         }
-        catch(...)
+        return 0;
+    }
+
+    // With --shared-objects, another repository may have written it.
+    // A pointer it wrote refers to its own LFS store, unless that's
+    // shared too.
+    std::string const* shared = offload && options.lfs_store.empty()
+        ? nullptr : find_blob(*dst_ref->repo, content_key);
+    if (shared)
+    {
+        profile::add("shared blobs", dst_ref->repo->name(), 0);
+        std::string const sha = *shared;
+        bool const fresh = dst_ref->repo->remember_blob(std::move(content_key), sha);
+        if (!dst_ref->repo->unchanged_by_remapping(git_path, mode, sha))
         {
-            return svn_error_createf(APR_EOF, SVN_NO_ERROR, "unknown error");
+            fast_import.filemodify(git_path, mode, sha);
+            dst_ref->repo->note_file_written(git_path, mode, sha, fresh);
         }
+        return 0;
     }
-}
 
-void importer::convert_svn_file(
-    svn::revision const& rev, path const& svn_path, bool discover_changes)
-{
-    Rule const* const match = match_svn_path(svn_path, revnum);
-    if (!match) return;
+    // With --blob-cache, an earlier run may have written it, to this
+    // repository or one it shares objects with, and noted its name
+    object_id const cached = cached_blob(*dst_ref->repo, content_key);
+    if (!cached.is_null())
+    {
+        profile::add("cached blobs", dst_ref->repo->name(), 0);
+        std::string const sha = cached.hex();
+        bool const fresh = dst_ref->repo->remember_blob(std::move(content_key), sha);
+        if (!dst_ref->repo->unchanged_by_remapping(git_path, mode, sha))
+        {
+            fast_import.filemodify(git_path, mode, sha);
+            dst_ref->repo->note_file_written(git_path, mode, sha, fresh);
+        }
+        return 0;
+    }
 
-    // There are two reasons we might skip processing this file in
-    // this pass and come back for it in a later one:
-    //
-    // 1. the target repository and/or ref has already been fully
-    // processed for this revision in an earlier pass over the
-    // invalidated SVN trees
-    auto* dst_ref = prepare_to_modify(match, discover_changes);
-    if (dst_ref == nullptr)
-        return;
+    profile::scope profile_stream("stream contents", &dst_ref->repo->name(), false);
+    std::size_t held_bytes = 0;
+    if (!fanout_key.empty())
+    {
+        std::lock_guard<std::mutex> lock(fanned_out_mutex);
+        auto const fanout = fanned_out.find(fanout_key);
+        if (fanout != fanned_out.end() && fanout->second.read)
+        {
+            contents = fanout->second.contents;
+            in_hand = true;
+        }
+        if (fanout == fanned_out.end() || fanout->second.read)
+            fanout_key.clear();
+        held_bytes = fanned_out_bytes;
+    }
+    if (in_hand)
+        profile::add("fanned-out bytes", dst_ref->repo->name(), contents.size());
+    else if (prefetcher)
+        in_hand = prefetcher->take(svn_path, contents);
+
+    // Contents to be held for later destinations are read whole
+    if (!fanout_key.empty())
+    {
+        if (!in_hand
+            && held_bytes + svn::call(
+                svn_fs_file_length, rev.fs_root, svn_path.c_str(), scope) <= fanned_out_bytes_limit)
+        {
+            read_svn_file(rev.fs_root, svn_path, contents, scope);
+            in_hand = true;
+        }
+        std::lock_guard<std::mutex> lock(fanned_out_mutex);
+        auto const fanout = fanned_out.find(fanout_key);
+        if (in_hand && fanout != fanned_out.end() && !fanout->second.read
+            && fanned_out_bytes + contents.size() <= fanned_out_bytes_limit)
+        {
+            fanout->second.contents = contents;
+            fanout->second.read = true;
+            fanned_out_bytes += contents.size();
+        }
+    }
 
-    // Mark the repository as having changes that will need to be written
-    changed_repositories.insert(dst_ref->repo);
+    // With --lfs-threshold, Git is only given a pointer to the
+    // contents, which go to the LFS store instead
+    if (offload)
+    {
+        std::string const pointer = write_lfs_object(
+            rev, svn_path, *dst_ref->repo, in_hand ? &contents : nullptr, scope);
+        std::string const sha = git_blob_hasher(pointer.size()).update(pointer).hex_digest();
+        bool const fresh = dst_ref->repo->remember_blob(std::move(content_key), sha);
+        if (dst_ref->repo->unchanged_by_remapping(git_path, mode, sha))
+            return 0;
+        if (fast_import.packs_blobs())
+        {
+            if (!dst_ref->repo->has_blob_sha(sha))
+                fast_import.pack_blob(sha, pointer);
+            fast_import.filemodify(git_path, mode, sha);
+        }
+        else
+        {
+            fast_import.filemodify_hdr(git_path, mode);
+            fast_import.data(pointer.data(), pointer.size());
+        }
+        dst_ref->repo->note_file_written(git_path, mode, sha, fresh);
+        return 0;
+    }
 
-    // 2. A different target ref is currently being written in this
-    // repository.
-    if (dst_ref->repo->open_commit(rev) != dst_ref)
-        return;
+    // With --pack-threads, the blob goes into a pack of our own, and
+    // fast-import is only given its name.  Normalized files are read
+    // whole, too, since their length is only known afterwards.
+    if (fast_import.packs_blobs() || props.normalizer)
+    {
+        if (!in_hand)
+            read_svn_file(rev.fs_root, svn_path, contents, scope);
+        if (props.normalizer)
+            props.normalizer->apply(contents);
+    }
 
-    auto& fast_import = dst_ref->repo->fast_import();
+    if (fast_import.packs_blobs())
+    {
+        profile::add("bytes packed", dst_ref->repo->name(), contents.size());
+        profile_stream.trace_file(svn_path.str(), contents.size());
+        std::uint64_t const bytes = contents.size();
+        SVN2GIT_PROBE2(file__contents, svn_path.c_str(), bytes);
+        std::string sha = git_blob_hasher(contents.size()).update(contents).hex_digest();
+        if (blob_cache)
+            blob_cache->add(content_key, sha);
+        bool const fresh = dst_ref->repo->remember_blob(std::move(content_key), sha);
+        if (dst_ref->repo->unchanged_by_remapping(git_path, mode, sha))
+            return bytes;
+        if (!dst_ref->repo->has_blob_sha(sha)
+            && !(options.svn_deltas && !props.normalizer
+                 && pack_svn_delta(rev, svn_path, *dst_ref->repo, sha, contents, scope)))
+        {
+            fast_import.pack_blob(sha, std::move(contents));
+        }
+        fast_import.filemodify(git_path, mode, sha);
+        dst_ref->repo->note_file_written(git_path, mode, sha, fresh);
+        return bytes;
+    }
 
-    auto propvalue = svn::call(
-        svn_fs_node_prop, rev.fs_root, svn_path.c_str(), "svn:executable", rev.pool);
+    // Contents in hand are hashed first, in case they needn't be sent
+    if (in_hand || props.normalizer)
+    {
+        std::string const sha = git_blob_hasher(contents.size()).update(contents).hex_digest();
+        if (blob_cache)
+            blob_cache->add(content_key, sha);
+        bool const fresh = dst_ref->repo->remember_blob(std::move(content_key), sha);
+        if (dst_ref->repo->unchanged_by_remapping(git_path, mode, sha))
+            return 0;
+        profile::add("bytes streamed", dst_ref->repo->name(), contents.size());
+        profile_stream.trace_file(svn_path.str(), contents.size());
+        SVN2GIT_PROBE2(file__contents, svn_path.c_str(), std::uint64_t(contents.size()));
+        fast_import.filemodify_hdr(git_path, mode);
+        fast_import.data_hdr(contents.size());
+        fast_import.write_raw(contents.data(), contents.size());
+        fast_import << LF;
+        dst_ref->repo->note_file_written(git_path, mode, sha, fresh);
+        return contents.size();
+    }
 
-    fast_import.filemodify_hdr(
-        match->git_path()/svn_path.sans_prefix(match->svn_path()), 
-        propvalue ? 0100755 : 0100644 );
+    fast_import.filemodify_hdr(git_path, mode);
 
     auto file_length = svn::call(
-        svn_fs_file_length, rev.fs_root, svn_path.c_str(), rev.pool);
+        svn_fs_file_length, rev.fs_root, svn_path.c_str(), scope);
 
-    AprPool scope = rev.pool.make_subpool();
     svn_stream_t* in_stream = svn::call(
         svn_fs_file_contents, rev.fs_root, svn_path.c_str(), scope);
 
@@ -447,34 +2481,148 @@ void importer::convert_svn_file(
       svn_fs_node_prop, rev.fs_root, svn_path.c_str(), "svn:special", scope);
     */
 
+    profile::add("bytes streamed", dst_ref->repo->name(), file_length);
+    profile_stream.trace_file(svn_path.str(), file_length);
+    SVN2GIT_PROBE2(file__contents, svn_path.c_str(), std::uint64_t(file_length));
     fast_import.data_hdr(file_length);
-    svn_stream_t* out_stream = svn_stream_create(&fast_import, scope);
+    blob_sink sink = { fast_import, git_blob_hasher(file_length) };
+    svn_stream_t* out_stream = svn_stream_create(&sink, scope);
     svn_stream_set_write(out_stream, fast_import_raw_bytes);
-    check_svn(svn_stream_copy3(in_stream, out_stream, nullptr, nullptr, scope));
+    svn::check(svn_stream_copy3, in_stream, out_stream, nullptr, nullptr, scope);
     fast_import << LF;
+
+    std::string const sha = sink.hash.hex_digest();
+    if (blob_cache)
+        blob_cache->add(content_key, sha);
+    dst_ref->repo->note_file_written(
+        git_path, mode, sha, dst_ref->repo->remember_blob(std::move(content_key), sha));
+    return file_length;
 }
 
-// Given the SVN path of a file being converted to Git, try to find an
-// SVN directory copy that caused this file to be converted, and from
-// that, extract Git merge information
-void importer::record_merges(git_repository::ref* target, path const& dst_svn_path, Rule const* match)
+// True iff --lfs-threshold offloads the given file, mapped to
+// git_path, to the LFS store: a regular file no smaller than the
+// threshold, and where --lfs-pattern is given, at a Git path it
+// matches.  Normalized files are never offloaded, since git-lfs
+// would check them out as SVN has them.
+bool importer::offloads_to_lfs(
+    svn::revision const& rev, path const& svn_path, path const& git_path,
+    file_properties const& props, apr_pool_t* pool) const
 {
-    // Look for an svn directory copy whose target contains svn_path
-    auto p = svn_directory_copies.lower_bound(dst_svn_path);
-    if (p == svn_directory_copies.begin())
-        return;
-    if (!dst_svn_path.starts_with((--p)->first))
-        return;
+    if (options.lfs_threshold <= 0 || props.normalizer
+        || (props.mode != 0100644 && props.mode != 0100755))
+    {
+        return false;
+    }
+    if (!options.lfs_pattern.empty() && !boost::regex_search(git_path.str(), lfs_pattern))
+        return false;
+    return svn::call(svn_fs_file_length, rev.fs_root, svn_path.c_str(), pool)
+        >= options.lfs_threshold;
+}
+
+// Stream the contents of svn_path, or those already read, into the
+// LFS store of repo, or the one --lfs-store names, and return the
+// pointer file standing for them
+std::string importer::write_lfs_object(
+    svn::revision const& rev, path const& svn_path, git_repository const& repo,
+    std::string const* prefetched, apr_pool_t* pool)
+{
+    profile::scope _("write LFS objects", &repo.name());
+    lfs_object object(options.lfs_store.empty() ? repo.name() + "/lfs/objects" : options.lfs_store);
+    if (prefetched)
+    {
+        object.write(prefetched->data(), prefetched->size());
+    }
+    else
+    {
+        svn_stream_t* in_stream = svn::call(
+            svn_fs_file_contents, rev.fs_root, svn_path.c_str(), pool);
+        svn_stream_t* out_stream = svn_stream_create(&object, pool);
+        svn_stream_set_write(out_stream, lfs_object_bytes);
+        svn::check(svn_stream_copy3, in_stream, out_stream, nullptr, nullptr, pool);
+    }
+    std::string pointer = object.finish();
+    profile::add("LFS pointers", repo.name(), pointer.size());
+    return pointer;
+}
 
-    // compute the path and revision in SVN corresponding to the
-    // source of this file in that directory copy
-    auto src_revnum = p->second.src_revision;
-    auto src_svn_path = p->second.src_directory / dst_svn_path.sans_prefix(p->first);
+// With --svn-deltas, try to pack the given new contents of svn_path,
+// named sha, as a Git delta against its contents in the previous
+// revision, translated from the SVN delta between the two.  That
+// works only if those contents are in the pack being written, which
+// stays open across revisions only while fast-import isn't asked
+// anything; hence --svn-deltas needs --tree-model or
+// --local-tree-check.  Returns true iff the delta was packed.
+bool importer::pack_svn_delta(
+    svn::revision const& rev, path const& svn_path, git_repository& repo,
+    std::string const& sha, std::string const& contents, apr_pool_t* pool)
+{
+    if (rev.revnum <= 1)
+        return false;
+    profile::scope _("svn deltas", &repo.name());
+
+    svn_fs_root_t* base_root = svn::call(
+        svn_fs_revision_root, svn_repository.fs, rev.revnum - 1, pool);
+    if (svn::call(svn_fs_check_path, base_root, svn_path.c_str(), pool) != svn_node_file)
+        return false;
+    auto base_sha = repo.find_blob(svn_content_key(base_root, svn_path, pool));
+    if (!base_sha || !repo.fast_import().accepts_delta_base(*base_sha))
+        return false;
+
+    auto base_length = svn::call(svn_fs_file_length, base_root, svn_path.c_str(), pool);
+    svn_txdelta_stream_t* deltas = svn::call(
+        svn_fs_get_file_delta_stream, base_root, svn_path.c_str(),
+        rev.fs_root, svn_path.c_str(), pool);
+
+    // Copies within the target become inserts of what they copy
+    git_delta delta(base_length, contents.size());
+    AprPool window_pool(pool);
+    for (;;)
+    {
+        window_pool.clear();
+        svn_txdelta_window_t* window = svn::call(svn_txdelta_next_window, deltas, window_pool);
+        if (!window)
+            break;
+        std::uint64_t const target_offset = delta.size();
+        for (int i = 0; i < window->num_ops; ++i)
+        {
+            svn_txdelta_op_t const& op = window->ops[i];
+            switch (op.action_code)
+            {
+            case svn_txdelta_source:
+                delta.copy(window->sview_offset + op.offset, op.length);
+                break;
+            case svn_txdelta_target:
+                if (target_offset + op.offset + op.length > contents.size())
+                    return false;
+                delta.insert(contents.data() + target_offset + op.offset, op.length);
+                break;
+            case svn_txdelta_new:
+                delta.insert(window->new_data->data + op.offset, op.length);
+                break;
+            }
+        }
+    }
+
+    // Like git pack-objects, keep only deltas much smaller than the
+    // contents
+    std::string const& encoded = delta.str();
+    if (delta.size() != contents.size() || encoded.empty()
+        || encoded.size() >= contents.size() / 2)
+    {
+        return false;
+    }
+    profile::add("bytes delta-packed", repo.name(), contents.size());
+    repo.fast_import().pack_delta(sha, *base_sha, encoded);
+    return true;
+}
+
+// Extract the Git merge information from an SVN directory copy of
+// files matched by src_match into the target ref
+void importer::record_merge(
+    git_repository::ref* target, Rule const* src_match, svn_directory_copy& copy)
+{
+    auto const src_revnum = copy.src_revision;
 
-    // Find out where that path landed in Git
-    Rule const* const src_match = match_svn_path(src_svn_path, src_revnum);
-    if (!src_match) return;
-    
     // If in a different repository, there's nothing to be done but warn
     auto const& src_repo_name = src_match->repo_rule->git_repo_name;
 
@@ -493,20 +2641,9 @@ void importer::record_merges(git_repository::ref* target, path const& dst_svn_pa
         // annotation in the repository grammar would work better.
         if (target->repo->name() != "sandbox")
         {
-            p->second.crossed_repositories.insert(
-                std::make_pair(src_repo_name, target->repo->name()));
+            copy.crossed_repositories.insert(
+                std::make_pair(&src_repo_name, &target->repo->name()));
         }
     }
 }
 
-Rule const* importer::match_svn_path(path const& svn_path, std::size_t revnum, bool require_match)
-{
-    Rule const* match = ruleset.matcher().longest_match(svn_path.str(), revnum);
-    if (require_match && match == nullptr)
-    {
-        Log::error() << "Unmatched svn path " << svn_path 
-                     << " in r" << revnum << std::endl;
-        assert(!"unmatched SVN path");
-    }
-    return match;
-}
@@ -6,73 +6,338 @@
 
 # include "git_repository.hpp"
 # include "path_set.hpp"
+# include "plan_store.hpp"
+# include "svn_blob_cache.hpp"
 # include "svn.hpp"
 # include "path.hpp"
 # include "ruleset.hpp"
+# include "file_prefetcher.hpp"
+# include "task_scheduler.hpp"
+# include "revision_planner.hpp"
+# include "arena.hpp"
+# include "dense_set.hpp"
+# include "rules_diff.hpp"
+# include "history_profile.hpp"
+# include "status_report.hpp"
+# include "memory_report.hpp"
+# include "push_workers.hpp"
+# include "resource_budget.hpp"
+# include "lru_cache.hpp"
+# include "text_normalizer.hpp"
 
 # include <boost/container/flat_set.hpp>
 # include <boost/container/flat_map.hpp>
+# include <boost/regex.hpp>
+# include <chrono>
 # include <map>
+# include <memory>
+# include <mutex>
+# include <set>
+# include <unordered_map>
 
 struct Rule;
 struct Ruleset;
-struct svn_fs_path_change2_t;
 
 struct importer
 {
-    importer(svn const& svn_repo, Ruleset const& rules);
+    // When resuming, the repositories in changed_rules are rewound to
+    // reconvert them from the revisions given; see --previous-rules.
+    // With a profile of the history, --shards are dealt repositories
+    // by the changes they take, unless by --shard-costs or
+    // --shard-plan, and --status-file judges its ETA by cost; see
+    // --history-profile.
+    importer(svn const& svn_repo, Ruleset const& rules, 
+             changed_revision_map const& changed_rules = changed_revision_map(),
+             history_profile const* history = nullptr);
     ~importer();
 
     int last_valid_svn_revision();
     void import_revision(int revnum);
 
+    // Pass over the revisions from first to last that import_revision
+    // would find change nothing in Git, reading only the paths they
+    // change, and return the first that would change something, or
+    // last + 1.  With squash rules, if that revision starts a burst
+    // the rules let be squashed, the burst is passed over too, and
+    // the last of it returned, which import_revision then imports as
+    // one revision making the changes of all.
+    int skip_revisions(int first, int last);
+
+    // With --plan-ahead, plan the revisions first to last on a
+    // background thread, ahead of their import
+    void plan_ahead(int first, int last);
+
+    // Delete the branches left merged or empty by the conversion; see
+    // git_repository::prune_branches
+    void prune_branches();
+
+    // Checkpoint, so that everything converted so far is on disk and
+    // the conversion can be resumed from the last revision imported,
+    // then with --push-remote push each repository that has had
+    // commits since the last call; see --follow
+    void publish();
+
+    // With --follow, convert by new_rules from now on, having first
+    // reconverted the repositories in changed_rules from the
+    // revisions given.  Returns the revision after which conversion
+    // goes on.  The rules must outlive the importer.  Throws,
+    // changing nothing, if the rules declare a repository already
+    // converted the submodule of another super-module.
+    int reload_rules(Ruleset const& new_rules, changed_revision_map const& changed_rules);
+
+    // Checkpoint, close every fast-import and wait for them all to
+    // finish, then with --repack-cpus consolidate each repository's
+    // packs.  Called at the end of a successful conversion; otherwise
+    // the destructor checkpoints and closes the fast-imports alone.
+    void finish();
+
+    // Write the --commit-index of the commits kept in each ref of
+    // every repository converted, once finish has had fast-import
+    // export their marks
+    void write_commit_index(std::string const& filename) const;
+
+    // With --memory-csv, print the high-water marks of memory use
+    void report_memory() const;
+
+    // With --profile, print the commands sent to each repository's
+    // fast-import and the time spent waiting on it, and with
+    // --fast-import-stats, what the fast-imports reported as they exited
+    void report_fast_import() const;
+
+    // Keep the --status-file up to date while revisions first_revnum
+    // to last_revnum are imported
+    void report_status(int first_revnum, int last_revnum);
+
  private: // helpers
+    void write_status();
+    void sample_memory();
+    void report_fast_import_stats() const;
     git_repository* demand_repo(std::string const& name);
+    git_repository::role_type role_of(std::string const& repo_name) const;
+    git_fast_import& fast_import_host(std::string const& git_dir);
+    git_repository::ref* ref_of(Rule const* match);
+    void share_blobs(git_repository& repo);
+    std::string const* find_blob(
+        git_repository const& repo, std::string const& svn_content_key) const;
+    object_id cached_blob(
+        git_repository const& repo, std::string const& svn_content_key) const;
     git_repository::ref* prepare_to_modify(Rule const* match, bool discover_changes);
-    void process_svn_changes(svn::revision const& rev);
-    void process_svn_directory_change(
-        svn::revision const& rev, svn_fs_path_change2_t *change, path const& svn_path);
-    path add_svn_tree_to_delete(path const& svn_path, Rule const* match);
-    void invalidate_svn_tree(
-        svn::revision const& rev, path const& svn_path, Rule const* match);
-    void add_svn_tree_to_convert(
-        svn::revision const& rev, path const& svn_path);
-    void convert_svn_tree(
-        svn::revision const& rev, path const& svn_path, bool discover_changes);
-    void convert_svn_file(
-        svn::revision const& rev, path const& svn_path, bool discover_changes);
-    void discover_merges(svn::revision const& rev);
-    void record_merges(git_repository::ref*, path const& svn_path, Rule const* match);
+    void write_commits(svn::revision const& rev, git_repository& r);
+    void pipeline_commits(svn::revision const& rev, git_repository& r);
+    void write_files(svn::revision const& rev, git_repository& r);
+    std::uint64_t convert_svn_file(
+        svn::revision const& rev, path const& svn_path, 
+        Rule const* match, git_repository::ref* dst_ref);
+    void copy_svn_trees(
+        path const& dst_path, path const& src_path, std::size_t src_revnum,
+        std::vector<path> const& changed_paths, path_set& trees_copied);
+    void prefetch_svn_files(svn::revision const& rev);
+    void preemit_blobs(svn::revision const& rev);
+    void plan_fanned_out_files(svn::revision const& rev);
+    struct file_properties
+    {
+        unsigned long mode;
+        text_normalizer const* normalizer; // null unless --normalize-text applies
+    };
+    file_properties svn_file_properties(
+        svn::revision const& rev, path const& svn_path, apr_pool_t* pool);
+    bool offloads_to_lfs(
+        svn::revision const& rev, path const& svn_path, path const& git_path,
+        file_properties const& props, apr_pool_t* pool) const;
+    std::string write_lfs_object(
+        svn::revision const& rev, path const& svn_path, git_repository const& repo,
+        std::string const* prefetched, apr_pool_t* pool);
+    bool pack_svn_delta(
+        svn::revision const& rev, path const& svn_path, git_repository& repo,
+        std::string const& sha, std::string const& contents, apr_pool_t* pool);
+
+    typedef dense_set<git_repository> repository_set;
+
+    bool changes_nothing(int revnum, std::vector<svn::change> const& changes) const;
+    int squash_revisions(int first, int last);
+    void squash_changes(svn::revision& rev);
+    void reset_revision_state();
+    void close_commits(repository_set const& repos, arena_vector<git_repository*>& closed);
+    void flush_submodule_commits(svn::revision const* rev);
+    void plan_ref_retirement();
+    void size_active_branches();
+    void retire_finished_refs();
+
+    void restore_checkpoint(changed_revision_map const& changed_rules);
+    void checkpoint();
+    void manage_fast_imports();
+    void enforce_budget();
 
     void warn_about_cross_repository_copies();
-    Rule const* match_svn_path(path const& svn_path, std::size_t revnum, bool require_match = true);
+    void close_fast_imports();
+    void report_slow_revision(std::chrono::steady_clock::duration elapsed) const;
+    void repack(unsigned cpus);
+    void report_serving(
+        std::vector<std::pair<std::uint64_t, git_repository const*> > const& repos,
+        std::vector<git_repository::serving_stats> const& served) const;
+    void pack_refs(std::vector<git_repository const*> const& repos) const;
 
  private: // persistent members
+    // With --fast-import-host, the fast-imports hosting groups of
+    // repositories, by the host's directory, and the host of each
+    // repository in a group, by name.  The hosts outlive the
+    // repositories, which write to them to the last.
+    std::map<std::string, git_fast_import> hosts;
+    std::unordered_map<std::string, std::string> host_of;
+
+    // With --ref-writers, the number of fast-imports writing each
+    // repository given, by name
+    std::unordered_map<std::string, std::size_t> ref_writers;
+
     std::map<std::string, git_repository> repositories;
+    // The same, by git_repository::id
+    std::vector<git_repository*> repositories_by_id;
     svn const& svn_repository;
-    Ruleset const& ruleset;
+    Ruleset const* ruleset;     // replaced by reload_rules
+    std::unique_ptr<file_prefetcher> prefetcher; // null unless --reader-threads
+    std::unique_ptr<task_scheduler> write_workers; // null unless --write-threads
+    revision_planner planner;
+    std::unique_ptr<plan_store> plans;           // null unless --keep-plans
+    std::unique_ptr<svn_blob_cache> blob_cache;  // null unless --blob-cache
+    std::unique_ptr<background_planner> ahead;   // null unless --plan-ahead
+    std::unique_ptr<status_report> status;       // null unless --status-file
+    history_profile const* history;              // null unless --history-profile
+    std::unique_ptr<memory_report> memory;       // null unless --memory-csv
+    std::unique_ptr<resource_budget> budget;     // null unless --memory-budget
+
+    // Repositories catching up with the state they were restored
+    // from; see git_repository::replay
+    std::vector<git_repository*> replaying;
+
+    // With --shards, the shard converting each repository, by name
+    std::unordered_map<std::string, int> shard_of;
+
+    // The ref each rule maps to, by Rule::index, found on first use
+    std::vector<git_repository::ref*> rule_refs;
+
+    // A rule of each ref whose rules all end, with the last revision
+    // any of them is active in, in increasing order of it, and how
+    // many of those refs have been retired; see retire_finished_refs
+    std::vector<std::pair<std::size_t, Rule const*> > ref_endings;
+    std::size_t refs_retired;
+
+    // With --shared-objects, the Git names of the blobs in the packs
+    // of any repository, by SVN content key; see share_blobs
+    std::unordered_map<std::string, std::string> shared_blobs;
+
+    // What the properties of SVN files make of them, by node-revision
+    // ID; see svn_file_properties
+    static std::size_t const file_properties_cache_entries = 1 << 18;
+    lru_cache<std::string, file_properties> file_properties_cache;
+
+    // With --push-remote, the repositories with commits not yet pushed
+    repository_set unpublished;
+
+    // With --push-jobs, what pushes them while the conversion goes on
+    std::unique_ptr<push_workers> pushers;
+    void push_in_background();
+
+    // With --normalize-text, one normalizer for each pair of
+    // svn:eol-style and svn:keywords values seen
+    std::map<std::pair<std::string, std::string>, text_normalizer> normalizers;
+
+    // Guards file_properties_cache and normalizers, which with
+    // --write-threads are shared by the threads writing files
+    std::mutex file_properties_mutex;
+
+    // With --lfs-pattern, the Git paths of the files --lfs-threshold
+    // may offload
+    boost::regex lfs_pattern;
 
  private: // members used per SVN revision
     int revnum;
-    path_set svn_paths_to_convert;
-    boost::container::flat_set<git_repository*> changed_repositories;
+    bool revision_in_progress;
+    // The first of the revisions squashed into the next imported, or
+    // zero if it is imported alone; see skip_revisions
+    int squashed_from;
+    bool finished;              // see finish()
+
+    // Backs the containers below; see reset_revision_state
+    arena revision_arena;
+
+    // What the first phase of the import found; see revision_planner
+    revision_plan plan;
+
+    // The files to be written to each ref, sorted from the plan
+    struct planned_file
+    {
+        path svn_path;
+        Rule const* match;
+    };
+    typedef std::unordered_map<
+        git_repository::ref*, arena_vector<planned_file>,
+        std::hash<git_repository::ref*>, std::equal_to<git_repository::ref*>,
+        arena_allocator<std::pair<git_repository::ref* const, arena_vector<planned_file> > >
+    > file_plan;
+    file_plan files_by_ref;
+    repository_set changed_repositories;
+
+    // Contents planned for more than one repository, by SVN content
+    // key: how many of their destinations are yet to be written, and
+    // once the first has read them, the contents themselves, held for
+    // the rest within fanned_out_bytes_limit; see plan_fanned_out_files
+    struct fanned_out_content
+    {
+        int destinations;
+        bool read;
+        std::string contents;
+    };
+    static std::size_t const fanned_out_bytes_limit = std::size_t(256) << 20;
+    std::unordered_map<std::string, fanned_out_content> fanned_out;
+    std::size_t fanned_out_bytes;
+    std::mutex fanned_out_mutex; // guards the two above in Phase II
+
+    // With --preemit-blobs, the blobs of this revision first written
+    // to each repository, which the files naming them change its tree
+    std::set<std::pair<git_repository const*, std::string> > preemitted;
+
+    // Orders pairs of repository names by the names themselves
+    struct repository_names_less
+    {
+        typedef std::pair<std::string const*, std::string const*> value_type;
+        bool operator()(value_type const& x, value_type const& y) const
+        {
+            return *x.first < *y.first || (*x.first == *y.first && *x.second < *y.second);
+        }
+    };
 
     struct svn_directory_copy
     {
+        explicit svn_directory_copy(arena& a) 
+            : src_revision(0), crossed_repositories(arena_allocator<char>(a)) {}
+
         std::size_t src_revision;
         path src_directory;
 
         // For the sake of issuing useful and not-overly-verbose
         // warnings, each time this copy causes a file/revision that
         // was directed to one Git repo to be copied into a distinc
-        // Git repo, we remember that pair.
+        // Git repo, we remember that pair.  The names are those held
+        // by the ruleset and repositories, which outlive the copy.
         boost::container::flat_set<
-            std::pair<std::string, std::string> 
+            repository_names_less::value_type, repository_names_less,
+            arena_allocator<repository_names_less::value_type>
         > crossed_repositories;
     };
 
     // A map from destination directory to (source revision, directory) pairs
-    boost::container::flat_map<path, svn_directory_copy> svn_directory_copies;
+    typedef boost::container::flat_map<
+        path, svn_directory_copy, std::less<path>, 
+        arena_allocator<std::pair<path, svn_directory_copy> >
+    > directory_copy_map;
+    directory_copy_map svn_directory_copies;
+
+    void record_merge(
+        git_repository::ref* target, Rule const* src_match, svn_directory_copy& copy);
+
+ private:
+    // When the importer was made, for the phases finish() reports
+    std::chrono::steady_clock::time_point started;
 };
 
 #endif // IMPORTER_DWA2013614_HPP
@@ -0,0 +1,199 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#include "io_ring.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#ifdef SVN2GIT_HAVE_IO_URING
+# include <linux/io_uring.h>
+# include <sys/mman.h>
+# include <sys/syscall.h>
+# include <sys/uio.h>
+# include <unistd.h>
+
+namespace
+{
+    template <class T>
+    T* at(void* base, unsigned offset)
+    {
+        return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+    }
+}
+
+std::unique_ptr<io_ring> io_ring::open(unsigned entries)
+{
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    int const fd = int(::syscall(__NR_io_uring_setup, entries, &params));
+    if (fd < 0)
+        return nullptr;
+
+    std::unique_ptr<io_ring> ring(new io_ring);
+    ring->fd = fd;
+    ring->entries = params.sq_entries;
+    ring->sq_ring = ring->cq_ring = ring->sqes = nullptr;
+    ring->queued = ring->in_flight = 0;
+
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool const single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap)
+        ring->sq_ring_size = ring->cq_ring_size = std::max(ring->sq_ring_size, ring->cq_ring_size);
+    ring->sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+
+    void* sq = ::mmap(nullptr, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sq == MAP_FAILED)
+        return nullptr;
+    ring->sq_ring = sq;
+    void* cq = single_mmap ? sq : ::mmap(nullptr, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+                                         MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if (cq == MAP_FAILED)
+        return nullptr;
+    ring->cq_ring = cq;
+    void* sqes = ::mmap(nullptr, ring->sqes_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+        return nullptr;
+    ring->sqes = static_cast<io_uring_sqe*>(sqes);
+
+    ring->sq_tail = at<unsigned>(sq, params.sq_off.tail);
+    ring->sq_mask = at<unsigned>(sq, params.sq_off.ring_mask);
+    ring->sq_array = at<unsigned>(sq, params.sq_off.array);
+    ring->cq_head = at<unsigned>(cq, params.cq_off.head);
+    ring->cq_tail = at<unsigned>(cq, params.cq_off.tail);
+    ring->cq_mask = at<unsigned>(cq, params.cq_off.ring_mask);
+    ring->cqes = at<io_uring_cqe>(cq, params.cq_off.cqes);
+    return ring;
+}
+
+io_ring::~io_ring()
+{
+    if (sqes)
+        ::munmap(sqes, sqes_size);
+    if (cq_ring && cq_ring != sq_ring)
+        ::munmap(cq_ring, cq_ring_size);
+    if (sq_ring)
+        ::munmap(sq_ring, sq_ring_size);
+    ::close(fd);
+}
+
+// The next free submission entry, cleared, and placed at the tail of
+// the submission queue.  With the ring full, what's queued is
+// submitted first, and a completion awaited.
+io_uring_sqe* io_ring::next_entry()
+{
+    if (queued + in_flight == entries)
+    {
+        enter(queued, 1);
+        reap();
+    }
+    unsigned const tail = *sq_tail;
+    unsigned const index = tail & *sq_mask;
+    io_uring_sqe* sqe = &sqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sq_array[index] = index;
+    ++queued;
+    // Visible to the kernel once submitted
+    __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+    return sqe;
+}
+
+void io_ring::writev(int fd, iovec const* v, unsigned n, std::uint64_t tag)
+{
+    io_uring_sqe* sqe = next_entry();
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<std::uint64_t>(v);
+    sqe->len = n;
+    sqe->user_data = tag;
+}
+
+void io_ring::fadvise(
+    int fd, std::uint64_t offset, std::uint64_t length, int advice, std::uint64_t tag)
+{
+    io_uring_sqe* sqe = next_entry();
+    sqe->opcode = IORING_OP_FADVISE;
+    sqe->fd = fd;
+    sqe->off = offset;
+    sqe->len = length >> 32 ? 0 : std::uint32_t(length);
+    sqe->fadvise_advice = std::uint32_t(advice);
+    sqe->user_data = tag;
+}
+
+// Submit to_submit of the queued entries, and wait until at least
+// min_complete operations have completed
+void io_ring::enter(unsigned to_submit, unsigned min_complete)
+{
+    for (;;)
+    {
+        int const submitted = int(::syscall(
+            __NR_io_uring_enter, fd, to_submit, min_complete,
+            min_complete ? IORING_ENTER_GETEVENTS : 0, nullptr, 0));
+        if (submitted >= 0)
+        {
+            queued -= submitted;
+            in_flight += submitted;
+            return;
+        }
+        if (errno != EINTR)
+            throw std::runtime_error(std::string("io_uring_enter: ") + std::strerror(errno));
+    }
+}
+
+void io_ring::reap()
+{
+    unsigned head = *cq_head;
+    unsigned const tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head, --in_flight)
+    {
+        io_uring_cqe const& cqe = cqes[head & *cq_mask];
+        results.emplace_back(cqe.user_data, cqe.res);
+    }
+    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+}
+
+std::vector<std::pair<std::uint64_t, int> > const& io_ring::complete()
+{
+    done.clear();
+    if (queued > 0)
+        enter(queued, 0);
+    while (in_flight > 0)
+    {
+        enter(0, 1);
+        reap();
+    }
+    done.swap(results);
+    return done;
+}
+
+#else // no io_uring
+
+std::unique_ptr<io_ring> io_ring::open(unsigned)
+{
+    return nullptr;
+}
+
+io_ring::~io_ring() {}
+
+void io_ring::writev(int, iovec const*, unsigned, std::uint64_t)
+{
+    throw std::logic_error("io_uring is unavailable");
+}
+
+void io_ring::fadvise(int, std::uint64_t, std::uint64_t, int, std::uint64_t)
+{
+    throw std::logic_error("io_uring is unavailable");
+}
+
+std::vector<std::pair<std::uint64_t, int> > const& io_ring::complete()
+{
+    return done;
+}
+
+#endif
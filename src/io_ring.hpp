@@ -0,0 +1,78 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef IO_RING_DWA20131122_HPP
+# define IO_RING_DWA20131122_HPP
+
+# include <cstddef>
+# include <cstdint>
+# include <memory>
+# include <utility>
+# include <vector>
+
+struct iovec;
+
+// Batches of system calls submitted to Linux's io_uring at once, so
+// that writing to a hundred fast-import pipes, or advising the kernel
+// of a hundred FSFS files, takes one system call rather than a
+// hundred; see --io-uring.  Operations are queued, then all submitted
+// and waited for by complete(), which hands back each one's tag and
+// result: what the system call would have returned, or minus its
+// errno.  The ring is driven through the raw system calls, so it
+// needs no liburing.
+class io_ring
+{
+ public:
+    // A ring of the given number of entries, or null if the kernel
+    // has no io_uring, or won't let this process use it
+    static std::unique_ptr<io_ring> open(unsigned entries);
+
+    ~io_ring();
+
+    // Queue a writev of the n buffers at v to fd, which must all
+    // stay put until complete() returns.  The kernel waits for a pipe
+    // with no room, even a non-blocking one, so only pipes that poll()
+    // finds writable should be written.
+    void writev(int fd, iovec const* v, unsigned n, std::uint64_t tag);
+
+    // Queue posix_fadvise(fd, offset, length, advice); lengths
+    // beyond 4 GiB are advised up to the end of the file
+    void fadvise(int fd, std::uint64_t offset, std::uint64_t length, int advice, std::uint64_t tag);
+
+    // Submit whatever is queued, wait for all of it, and return the
+    // tag and result of each operation, in the order they completed
+    std::vector<std::pair<std::uint64_t, int> > const& complete();
+
+ private:
+    io_ring() {}
+    io_ring(io_ring const&);
+    io_ring& operator=(io_ring const&);
+
+    struct io_uring_sqe* next_entry();
+    void enter(unsigned to_submit, unsigned min_complete);
+    void reap();
+
+    int fd;
+    unsigned entries;
+    void* sq_ring;
+    std::size_t sq_ring_size;
+    void* cq_ring;              // sq_ring if mapped together
+    std::size_t cq_ring_size;
+    struct io_uring_sqe* sqes;
+    std::size_t sqes_size;
+
+    unsigned* sq_tail;
+    unsigned const* sq_mask;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned const* cq_tail;
+    unsigned const* cq_mask;
+    struct io_uring_cqe const* cqes;
+
+    unsigned queued;            // not yet submitted
+    unsigned in_flight;         // submitted but not yet reaped
+    std::vector<std::pair<std::uint64_t, int> > results; // reaped since complete()
+    std::vector<std::pair<std::uint64_t, int> > done;    // returned by complete()
+};
+
+#endif // IO_RING_DWA20131122_HPP
@@ -0,0 +1,67 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#include "lfs_store.hpp"
+
+#include <boost/filesystem.hpp>
+#include <stdexcept>
+
+namespace fs = boost::filesystem;
+
+lfs_object::lfs_object(std::string const& store)
+    : store(store), size(0)
+{
+    fs::path const tmp = fs::path(store) / "tmp";
+    fs::create_directories(tmp);
+    temp_path = (tmp / fs::unique_path("%%%%%%%%%%%%%%%%")).string();
+    out.open(temp_path.c_str(), std::ios::binary | std::ios::trunc);
+    if (!out)
+        throw std::runtime_error("Couldn't create LFS object file " + temp_path);
+}
+
+lfs_object::~lfs_object()
+{
+    if (!temp_path.empty())
+    {
+        out.close();
+        boost::system::error_code ignored;
+        fs::remove(temp_path, ignored);
+    }
+}
+
+void lfs_object::write(char const* data, std::size_t size)
+{
+    if (!out.write(data, size))
+        throw std::runtime_error("Couldn't write LFS object file " + temp_path);
+    hash.update(data, size);
+    this->size += size;
+}
+
+std::string lfs_object::finish()
+{
+    out.close();
+    if (!out)
+        throw std::runtime_error("Couldn't write LFS object file " + temp_path);
+
+    std::string const oid = hash.hex_digest();
+    fs::path const dir = fs::path(store) / oid.substr(0, 2) / oid.substr(2, 2);
+    fs::path const object = dir / oid;
+    if (fs::exists(object))
+    {
+        fs::remove(temp_path);
+    }
+    else
+    {
+        fs::create_directories(dir);
+        fs::rename(temp_path, object);
+    }
+    temp_path.clear();
+    return pointer(oid, size);
+}
+
+std::string lfs_object::pointer(std::string const& oid, std::uint64_t size)
+{
+    return "version https://git-lfs.github.com/spec/v1\n"
+        "oid sha256:" + oid + "\n"
+        "size " + std::to_string(size) + "\n";
+}
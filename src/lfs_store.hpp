@@ -0,0 +1,50 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef LFS_STORE_DWA20131121_HPP
+# define LFS_STORE_DWA20131121_HPP
+
+# include "sha256.hpp"
+
+# include <cstdint>
+# include <fstream>
+# include <string>
+
+// The contents of a file --lfs-threshold offloads, being written to a
+// Git LFS object store as they are hashed.  Objects are named by the
+// SHA-256 of their contents, and kept in the store as git-lfs keeps
+// them beneath .git/lfs/objects: e.g. ab/cd/abcd... for abcd....
+// Each is written to a temporary file first, and renamed into place,
+// so a store shared between processes never holds part of an object.
+class lfs_object
+{
+ public:
+    // Begin an object in the store at the given directory
+    explicit lfs_object(std::string const& store);
+
+    // Removes the temporary file, unless finished
+    ~lfs_object();
+
+    void write(char const* data, std::size_t size);
+
+    // Put the object in the store, unless it's there already, and
+    // return the contents of the pointer file that stands for it in
+    // Git
+    std::string finish();
+
+    // The pointer file for the object of the given size whose
+    // SHA-256 is oid, in hex
+    static std::string pointer(std::string const& oid, std::uint64_t size);
+
+ private:
+    lfs_object(lfs_object const&);
+    lfs_object& operator=(lfs_object const&);
+
+    std::string store;
+    std::string temp_path;
+    std::ofstream out;
+    sha256 hash;
+    std::uint64_t size;
+};
+
+#endif // LFS_STORE_DWA20131121_HPP
@@ -16,31 +16,195 @@
  */
 
 #include "log.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cerrno>
+#include <chrono>
+#include <mutex>
 #include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
 
 namespace Log
 {
 
-static Level level = Log::Info;
+namespace detail
+  {
+  Level level = Log::Info;
+  std::ostream dummy(0);
+  }
+
+static Level untraced_level = Log::Info;
+static std::size_t trace_first = 1, trace_last = 0;
 
 static std::size_t revision;
 static std::size_t revision_reported;
-static std::ostream dummy(0);
-static std::size_t num_errors = 0;
+static std::atomic<std::size_t> num_errors(0);
 
-Level get_level()
-  {
-  return level;
-  }
+// The calling thread's capture, if it has one
+static thread_local std::ostream* captured = 0;
 
-void set_level(Level value)
+namespace
   {
-  level = value;
+  // What has been written to std::cout, as runs of bytes bound for
+  // each descriptor, and the thread that writes it out.
+  class flusher
+    {
+  public:
+    flusher() : stopping(false), thread(&flusher::work, this) {}
+
+    ~flusher()
+      {
+        {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        }
+      wake.notify_one();
+      thread.join();
+      write_out(pending);
+      }
+
+    void append(int fd, char const* data, std::size_t size)
+      {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (pending.empty() || pending.back().first != fd)
+        pending.push_back(std::make_pair(fd, std::string()));
+      pending.back().second.append(data, size);
+      }
+
+    // Write out everything appended so far before returning
+    void flush()
+      {
+      std::lock_guard<std::mutex> writing(write_mutex);
+      std::vector<std::pair<int, std::string> > runs;
+        {
+        std::lock_guard<std::mutex> lock(mutex);
+        runs.swap(pending);
+        }
+      write_out(runs);
+      }
+
+  private:
+    void work()
+      {
+      std::unique_lock<std::mutex> lock(mutex);
+      while (!stopping)
+        {
+        wake.wait_for(lock, std::chrono::milliseconds(20));
+        lock.unlock();
+        flush();
+        lock.lock();
+        }
+      }
+
+    static void write_out(std::vector<std::pair<int, std::string> > const& runs)
+      {
+      for (std::size_t i = 0; i < runs.size(); ++i)
+        {
+        char const* p = runs[i].second.data();
+        std::size_t left = runs[i].second.size();
+        while (left > 0)
+          {
+          ssize_t const n = ::write(runs[i].first, p, left);
+          if (n < 0 && errno == EINTR)
+            continue;
+          if (n <= 0)
+            break;
+          p += n;
+          left -= n;
+          }
+        }
+      }
+
+    std::mutex mutex;             // guards pending and stopping
+    std::mutex write_mutex;       // keeps the runs written in order
+    std::condition_variable wake;
+    std::vector<std::pair<int, std::string> > pending;
+    bool stopping;
+    std::thread thread;
+    };
+
+  // A streambuf that collects what is written to it and hands it to
+  // the flusher whenever its stream is flushed, instead of making a
+  // system call.  It is installed in place of std::cout's own buffer
+  // for the life of the program.  std::cerr keeps its own, so that
+  // errors are written at once, and aren't lost if the program dies
+  // of a signal or an assertion before the flusher gets to them.
+  class async_buffer : public std::streambuf
+    {
+  public:
+    async_buffer(flusher& sink, int fd, std::ostream& stream)
+      : sink(sink), fd(fd), stream(stream), original(stream.rdbuf(this))
+      {
+      setp(chunk, chunk + sizeof(chunk));
+      }
+
+    ~async_buffer()
+      {
+      sync();
+      stream.rdbuf(original);
+      }
+
+  protected:
+    int overflow(int c)
+      {
+      sync();
+      if (c != traits_type::eof())
+        {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+        }
+      return traits_type::not_eof(c);
+      }
+
+    int sync()
+      {
+      if (pptr() != pbase())
+        sink.append(fd, pbase(), pptr() - pbase());
+      setp(chunk, chunk + sizeof(chunk));
+      return 0;
+      }
+
+  private:
+    flusher& sink;
+    int fd;
+    std::ostream& stream;
+    std::streambuf* original;
+    char chunk[4096];
+    };
+
+  // Constructed after <iostream>'s initializer above, so destroyed
+  // (writing out what remains) before the standard streams are.
+  struct async_output
+    {
+    async_output()
+      : out(sink, 1, std::cout)
+      {}
+
+    void flush()
+      {
+      std::cout.flush();
+      sink.flush();
+      std::cerr.flush();
+      }
+
+    flusher sink;
+    async_buffer out;
+    };
+
+  async_output output;
   }
 
+// What a capture holds is written by the thread that made it, after
+// whatever heading of the revision the text belongs to is written
 static void check_revision()
   {
-  if (revision == revision_reported)
+  if (captured || revision == revision_reported)
     {
     return;
     }
@@ -48,60 +212,76 @@ static void check_revision()
   revision_reported = revision;
   }
 
-void set_revision(std::size_t rev)
+std::ostream& detail::out()
   {
-  if ((revision % 1000) == 0)
-    {
-    check_revision();
-    }
-  revision = rev;
+  check_revision();
+  return captured ? *captured : std::cout;
   }
 
-std::ostream& error()
+capture::capture()
+  : outer(captured)
   {
-  ++num_errors;
-  //if (num_errors > 100)
-  //  {
-  //  throw std::runtime_error("Too many errors, skipping.");
-  //  }
-  check_revision();
-  return std::cerr << "++ ERROR: ";
+  captured = &text;
   }
 
-std::ostream& trace()
+capture::~capture()
   {
-  if (level < Log::Trace)
-    {
-    return dummy;
-    }
-  check_revision();
-  return std::cout << "-- ";
+  captured = outer;
   }
 
-std::ostream& debug()
+void set_level(Level value)
+  {
+  untraced_level = detail::level = value;
+  }
+
+void set_trace_revisions(std::size_t first, std::size_t last)
   {
-  if (level < Log::Debug)
+  trace_first = first;
+  trace_last = last;
+  }
+
+void begin_revision(std::size_t revnum)
+  {
+  if (trace_first <= trace_last)
     {
-    return dummy;
+    detail::level = trace_first <= revnum && revnum <= trace_last
+      ? Log::Trace : untraced_level;
     }
-  check_revision();
-  return std::cout << "-- ";
   }
 
-std::ostream& info()
+void flush()
   {
-  if (level < Log::Info)
+  output.flush();
+  }
+
+void set_revision(std::size_t rev)
+  {
+  if ((revision % 1000) == 0)
     {
-    return dummy;
+    check_revision();
     }
+  revision = rev;
+  }
+
+std::ostream& error()
+  {
+  ++num_errors;
+  //if (num_errors > 100)
+  //  {
+  //  throw std::runtime_error("Too many errors, skipping.");
+  //  }
   check_revision();
-  return std::cout << "-- ";
+  if (captured)
+    return *captured << "++ ERROR: ";
+  // After what was logged before it
+  output.flush();
+  return std::cerr << "++ ERROR: ";
   }
 
 std::ostream& warn()
   {
   check_revision();
-  return std::cout << "++ WARNING: ";
+  return (captured ? *captured : std::cout) << "++ WARNING: ";
   }
 
 int result()
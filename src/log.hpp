@@ -18,7 +18,10 @@
 #ifndef LOG_HPP
 #define LOG_HPP
 
+#include <cstddef>
 #include <iostream>
+#include <sstream>
+#include <string>
 
 namespace Log
 {
@@ -31,16 +34,81 @@ enum Level
   Trace
   };
 
-Level get_level();
+namespace detail
+  {
+  extern Level level;
+  extern std::ostream dummy;
+  std::ostream& out();
+  }
+
+// True iff messages of the given level are written.  Checking it
+// first avoids composing messages that would be discarded.
+inline bool enabled(Level l)
+  {
+  return l <= detail::level;
+  }
+
+inline Level get_level()
+  {
+  return detail::level;
+  }
+
 void set_level(Level value);
 void set_revision(std::size_t value);
 
+// Use Trace level only while importing SVN revisions first..last
+void set_trace_revisions(std::size_t first, std::size_t last);
+
+// Called as each SVN revision's import begins
+void begin_revision(std::size_t revnum);
+
+// Write out everything logged so far.  Output to std::cout is
+// otherwise written by a background thread, every few milliseconds,
+// so that logging doesn't wait on the terminal.  Output to std::cerr,
+// including every error, is written at once, after what was written
+// to std::cout before it.
+void flush();
+
+// While a capture exists, everything the thread that made it logs is
+// kept in the capture instead of being written out, so that threads
+// doing parts of one job can have their reports written in order.
+class capture
+  {
+public:
+  capture();
+  ~capture();
+
+  capture(capture const&) = delete;
+  void operator=(capture const&) = delete;
+
+  std::string str() const
+    {
+    return text.str();
+    }
+
+private:
+  std::ostringstream text;
+  std::ostream* outer;
+  };
+
 std::ostream& error();
-std::ostream& trace();
-std::ostream& debug();
-std::ostream& info();
 std::ostream& warn();
 
+inline std::ostream& trace()
+  {
+  return enabled(Trace) ? detail::out() << "-- " : detail::dummy;
+  }
+
+inline std::ostream& debug()
+  {
+  return enabled(Debug) ? detail::out() << "-- " : detail::dummy;
+  }
+
+inline std::ostream& info()
+  {
+  return enabled(Info) ? detail::out() << "-- " : detail::dummy;
+  }
+
 int result();
 
 } // namespace Log
@@ -0,0 +1,295 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef LRU_CACHE_DWA20131127_HPP
+# define LRU_CACHE_DWA20131127_HPP
+
+# include <algorithm>
+# include <cstddef>
+# include <cstdint>
+# include <functional>
+# include <iomanip>
+# include <list>
+# include <map>
+# include <memory>
+# include <mutex>
+# include <ostream>
+# include <string>
+# include <unordered_map>
+# include <utility>
+# include <vector>
+
+// What a cache has done, for --profile
+struct cache_stats
+{
+    cache_stats() : hits(0), misses(0), insertions(0), evictions(0), entries(0), weight(0) {}
+
+    std::uint64_t hits;
+    std::uint64_t misses;
+    std::uint64_t insertions;
+    std::uint64_t evictions;
+    std::uint64_t entries;      // held now
+    std::uint64_t weight;       // held now, in the cache's own unit
+
+    cache_stats& operator+=(cache_stats const& x)
+    {
+        hits += x.hits;
+        misses += x.misses;
+        insertions += x.insertions;
+        evictions += x.evictions;
+        entries += x.entries;
+        weight += x.weight;
+        return *this;
+    }
+};
+
+// Every lru_cache alive, and the counts of those gone, by name, so
+// that --profile can report them all together
+class cache_registry
+{
+ public:
+    typedef std::function<cache_stats()> source;
+
+    static void add(void const* cache, char const* name, source stats)
+    {
+        std::lock_guard<std::mutex> lock(instance().mutex);
+        instance().live[cache] = std::make_pair(name, std::move(stats));
+    }
+
+    // Forget cache, keeping its counts, but not what it held
+    static void remove(void const* cache)
+    {
+        registry& r = instance();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        auto const p = r.live.find(cache);
+        if (p == r.live.end())
+            return;
+        cache_stats s = p->second.second();
+        s.entries = s.weight = 0;
+        r.retired[p->second.first] += s;
+        r.live.erase(p);
+    }
+
+    // The counts of every cache, live or gone, summed by name
+    static std::map<std::string, cache_stats> totals()
+    {
+        registry& r = instance();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        std::map<std::string, cache_stats> result = r.retired;
+        for (auto const& c : r.live)
+            result[c.second.first] += c.second.second();
+        return result;
+    }
+
+    static void report(std::ostream& os)
+    {
+        auto const all = totals();
+        if (all.empty())
+            return;
+        os << "Caches:\n" << std::setw(24) << std::left << "cache" << std::right
+           << std::setw(14) << "hits" << std::setw(14) << "misses" << std::setw(8) << "hit %"
+           << std::setw(14) << "evictions" << std::setw(12) << "entries" << std::setw(14) << "weight"
+           << '\n';
+        for (auto const& c : all)
+        {
+            cache_stats const& s = c.second;
+            std::uint64_t const lookups = s.hits + s.misses;
+            os << std::setw(24) << std::left << c.first << std::right
+               << std::setw(14) << s.hits << std::setw(14) << s.misses
+               << std::fixed << std::setprecision(1) << std::setw(8)
+               << (lookups ? 100.0 * s.hits / lookups : 0.0)
+               << std::setw(14) << s.evictions << std::setw(12) << s.entries
+               << std::setw(14) << s.weight << '\n';
+        }
+        os << std::flush;
+    }
+
+ private:
+    struct registry
+    {
+        std::mutex mutex;
+        std::map<void const*, std::pair<char const*, source> > live;
+        std::map<std::string, cache_stats> retired;
+    };
+    static registry& instance()
+    {
+        static registry r;
+        return r;
+    }
+};
+
+// Stands in for a mutex where a cache is used from one thread only
+struct no_mutex
+{
+    void lock() {}
+    void unlock() {}
+};
+
+// A bounded, least-recently-used cache, the common part of svn2git's
+// caches.  Each value is inserted with a weight, in whatever unit the
+// cache is bounded by (bytes, entries, directory entries...), and the
+// least recently used are evicted once the weights exceed the limit.
+// Values are handed out as shared pointers, so that one evicted while
+// in use stays alive until its user is done.
+//
+// The keys are spread over the given number of shards by Hash, each
+// with its own list, index and share of the limit, so that with
+// Mutex = std::mutex, threads using different shards don't contend.
+// Every cache is counted under its name in cache_registry.
+template <class Key, class Value, class Hash = std::hash<Key>, class Mutex = no_mutex>
+class lru_cache
+{
+ public:
+    lru_cache(char const* name, std::size_t max_weight, std::size_t shard_count = 1)
+        : shards(std::max<std::size_t>(shard_count, 1))
+    {
+        set_max_weight(max_weight);
+        cache_registry::add(this, name, [this] { return stats(); });
+    }
+
+    ~lru_cache()
+    {
+        cache_registry::remove(this);
+    }
+
+    lru_cache(lru_cache const&) = delete;
+    void operator=(lru_cache const&) = delete;
+
+    // The value stored for key, or null if there is none
+    std::shared_ptr<Value const> find(Key const& key)
+    {
+        shard& s = shard_of(key);
+        std::lock_guard<Mutex> lock(s.mutex);
+        auto p = s.index.find(key);
+        if (p == s.index.end())
+        {
+            ++s.counts.misses;
+            return nullptr;
+        }
+        ++s.counts.hits;
+        s.lru.splice(s.lru.begin(), s.lru, p->second);
+        return p->second->value;
+    }
+
+    // Store value for key with the given weight, returning it for the
+    // caller's use.  A value heavier than its shard's whole share of
+    // the limit, or whose key is already stored, is returned unstored.
+    std::shared_ptr<Value const> insert(Key const& key, Value value, std::size_t weight)
+    {
+        std::shared_ptr<Value const> result(new Value(std::move(value)));
+        shard& s = shard_of(key);
+        std::lock_guard<Mutex> lock(s.mutex);
+        if (weight > s.max_weight || s.index.count(key))
+            return result;
+
+        node n = { key, result, weight };
+        s.lru.push_front(std::move(n));
+        s.index[key] = s.lru.begin();
+        s.weight += weight;
+        ++s.counts.insertions;
+        s.evict();
+        return result;
+    }
+
+    // Hold at most max_weight from now on, evicting what is beyond it
+    void set_max_weight(std::size_t max_weight)
+    {
+        for (auto& s : shards)
+        {
+            std::lock_guard<Mutex> lock(s.mutex);
+            s.max_weight = max_weight / shards.size();
+            s.evict();
+        }
+    }
+
+    void clear()
+    {
+        for (auto& s : shards)
+        {
+            std::lock_guard<Mutex> lock(s.mutex);
+            s.counts.evictions += s.lru.size();
+            s.lru.clear();
+            s.index.clear();
+            s.weight = 0;
+        }
+    }
+
+    // The total weight held
+    std::size_t weight() const
+    {
+        std::size_t result = 0;
+        for (auto& s : shards)
+        {
+            std::lock_guard<Mutex> lock(s.mutex);
+            result += s.weight;
+        }
+        return result;
+    }
+
+    // The number of values held
+    std::size_t size() const
+    {
+        std::size_t result = 0;
+        for (auto& s : shards)
+        {
+            std::lock_guard<Mutex> lock(s.mutex);
+            result += s.index.size();
+        }
+        return result;
+    }
+
+    cache_stats stats() const
+    {
+        cache_stats result;
+        for (auto& s : shards)
+        {
+            std::lock_guard<Mutex> lock(s.mutex);
+            cache_stats c = s.counts;
+            c.entries = s.index.size();
+            c.weight = s.weight;
+            result += c;
+        }
+        return result;
+    }
+
+ private:
+    struct node
+    {
+        Key key;
+        std::shared_ptr<Value const> value;
+        std::size_t weight;
+    };
+    typedef std::list<node> lru_list;
+
+    struct shard
+    {
+        shard() : max_weight(0), weight(0) {}
+
+        void evict()
+        {
+            while (weight > max_weight)
+            {
+                weight -= lru.back().weight;
+                index.erase(lru.back().key);
+                lru.pop_back();
+                ++counts.evictions;
+            }
+        }
+
+        mutable Mutex mutex;
+        std::size_t max_weight;
+        std::size_t weight;
+        lru_list lru;                 // most recently used first
+        std::unordered_map<Key, typename lru_list::iterator, Hash> index;
+        cache_stats counts;           // but for entries and weight
+    };
+
+    shard& shard_of(Key const& key)
+    {
+        return shards.size() == 1 ? shards[0] : shards[Hash()(key) % shards.size()];
+    }
+
+    std::vector<shard> shards;
+};
+
+#endif // LRU_CACHE_DWA20131127_HPP
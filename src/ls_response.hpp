@@ -0,0 +1,24 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef LS_RESPONSE_DWA20131024_HPP
+# define LS_RESPONSE_DWA20131024_HPP
+
+# include <string>
+
+// The SHA-1 of an empty tree.  A branch whose last commit has it is
+// empty, e.g. because everything in it was deleted.
+char const empty_tree_sha[] = "4b825dc642cb6eb9a060e54bf8d69288fbee4904";
+
+// The SHA-1 of the object named by fast-import's response to an "ls",
+// "<mode> <type> <sha>\t<path>", or the empty string if the response
+// names none, e.g. "missing <path>".
+inline std::string ls_response_sha(std::string const& response)
+{
+    std::size_t const tab = response.find('\t');
+    if (tab == std::string::npos || tab < 41 || response[tab - 41] != ' ')
+        return std::string();
+    return response.substr(tab - 40, 40);
+}
+
+#endif // LS_RESPONSE_DWA20131024_HPP
@@ -16,23 +16,294 @@
  */
 
 #include <boost/program_options.hpp>
+#include <boost/filesystem.hpp>
 #include <boost/foreach.hpp>
 
 #include <fstream>
+#include <sstream>
 #include <limits.h>
+#include <signal.h>
 #include <stdio.h>
+#include <unistd.h>
 
 #include "ruleset.hpp"
+#include "rules_diff.hpp"
 #include "git_repository.hpp"
 #include "svn.hpp"
 #include "log.hpp"
 #include "importer.hpp"
 #include "git_executable.hpp"
+#include "profile.hpp"
+#include "explain_revisions.hpp"
+#include "svn_read_bench.hpp"
+#include "matcher_stats.hpp"
+#include "validate_rules.hpp"
+#include "verify_conversion.hpp"
+#include "snapshot.hpp"
+#include "rule_queries.hpp"
+#include "svn_mirror.hpp"
+#include "svn_dump_loader.hpp"
+#include "history_profile.hpp"
+#include "shard_plan.hpp"
+#include "mock_fast_import.hpp"
+#include "flight_recorder.hpp"
 
 #include <utility>
 #include <numeric>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
-Options options;
+// With --follow, set by SIGUSR1, which a post-commit hook can send to
+// have its revision converted without waiting for the next poll, and
+// by SIGINT or SIGTERM, which end the run once the revisions being
+// converted are published
+static volatile sig_atomic_t follow_woken = 0;
+static volatile sig_atomic_t follow_stopped = 0;
+
+extern "C" void wake_follower(int) { follow_woken = 1; }
+extern "C" void stop_follower(int) { follow_stopped = 1; }
+
+// With --follow, have the importer convert by the rules now in the
+// rules file instead of by current_rules, reconverting the
+// repositories whose conversion they change, and keep them in
+// rulesets.  Rules that can't be loaded or applied are reported, and
+// conversion goes on by current_rules.  Returns the revision after
+// which conversion goes on.
+static int reload_rules(
+    importer& imp, Ruleset const& current_rules,
+    std::vector<std::unique_ptr<Ruleset const> >& rulesets, int last_rev)
+{
+    std::unique_ptr<Ruleset const> new_rules;
+    try
+    {
+        new_rules.reset(new Ruleset(options.rules_file));
+        changed_revision_map const changed_rules = diff_rules(current_rules, *new_rules);
+        for (auto const& kv : changed_rules)
+        {
+            Log::info() << "rules changed for " << kv.first
+                        << " from r" << kv.second << std::endl;
+        }
+        last_rev = imp.reload_rules(*new_rules, changed_rules);
+    }
+    catch (std::exception const& e)
+    {
+        Log::warn() << "keeping the rules in use: " << e.what() << std::endl;
+        return last_rev;
+    }
+    Log::info() << "reloaded " << options.rules_file << " (" << new_rules->rule_count()
+                << " rules); converting from r" << last_rev + 1 << std::endl;
+    rulesets.push_back(std::move(new_rules));
+    return last_rev;
+}
+
+// Having imported every revision before next_rev, keep converting
+// the revisions committed to SVN as they appear, polling for them
+// every --follow seconds, and mirroring them first from svn_url if
+// it isn't empty.  The importer, with its repositories and
+// fast-import processes, lives on between them, and publishes each
+// batch as soon as it is converted.  When the rules file changes,
+// the new rules are used from then on; see reload_rules.
+static void follow_svn(
+    svn& svn_repo, importer& imp, Ruleset const& ruleset, int next_rev, std::string const& svn_url)
+{
+    struct sigaction action = {};
+    sigemptyset(&action.sa_mask);
+    action.sa_handler = wake_follower;
+    sigaction(SIGUSR1, &action, nullptr);
+    action.sa_handler = stop_follower;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    imp.publish();
+    Log::info() << "following SVN from r" << next_rev << std::endl;
+
+    // Every ruleset loaded is kept, as main keeps the first: what the
+    // importer or a --rule-server has found in one may point into it
+    std::vector<std::unique_ptr<Ruleset const> > rulesets;
+    boost::system::error_code ec;
+    std::time_t rules_time = boost::filesystem::last_write_time(options.rules_file, ec);
+    while (!follow_stopped)
+    {
+        std::time_t const t = boost::filesystem::last_write_time(options.rules_file, ec);
+        if (!ec && t != rules_time)
+        {
+            rules_time = t;
+            next_rev = reload_rules(
+                imp, rulesets.empty() ? ruleset : *rulesets.back(), rulesets, next_rev - 1) + 1;
+        }
+
+        int const latest = svn_url.empty()
+            ? svn_repo.latest_revision() : mirror_svn(svn_url, options.svn_mirror);
+        if (latest < next_rev)
+        {
+            // Without SA_RESTART, a signal cuts the sleep short
+            if (!follow_woken)
+                sleep(options.follow_interval);
+            follow_woken = 0;
+            continue;
+        }
+
+        if (options.prefetch_revisions > 0)
+            svn_repo.prefetch(next_rev, latest, options.prefetch_revisions);
+        imp.plan_ahead(next_rev, latest);
+        int const first = next_rev;
+        for (next_rev = imp.skip_revisions(next_rev, latest); next_rev <= latest && !follow_stopped;
+             next_rev = imp.skip_revisions(next_rev + 1, latest))
+            imp.import_revision(next_rev);
+        imp.publish();
+        Log::info() << "converted r" << first << " to r" << next_rev - 1 << std::endl;
+    }
+    Log::info() << "stopped following SVN after r" << next_rev - 1 << std::endl;
+}
+
+// The revisions of a comma-separated list of N and FIRST:LAST[:STEP]
+static std::vector<int> parse_revisions(std::string const& list)
+{
+    std::vector<int> result;
+    std::istringstream in(list);
+    for (std::string item; std::getline(in, item, ',');)
+    {
+        int first = 0, last = 0, step = 1;
+        char colon = 0;
+        std::istringstream item_in(item);
+        bool ok = bool(item_in >> first);
+        last = first;
+        if (ok && item_in >> colon)
+        {
+            ok = colon == ':' && item_in >> last;
+            if (ok && item_in >> colon)
+                ok = colon == ':' && item_in >> step;
+            ok = ok && item_in.eof();
+        }
+        if (!ok || first < 1 || first > last || step < 1)
+            throw std::runtime_error("--verify expects a list of N and FIRST:LAST[:STEP], not " + list);
+        for (int r = first; r <= last; r += step)
+            result.push_back(r);
+    }
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+// A dry run over revisions first..last on the given number of
+// threads.  No Git state is written, so revisions can be analyzed in
+// any order: the range is cut into consecutive slices, each imported
+// by a fresh importer on a thread with its own svn handle and copy of
+// the ruleset.  What each slice logs is written out in revision
+// order, and the coverage counters are shared.  A slice knows nothing
+// of the revisions before it, which only matters to the warnings
+// about copies from earlier history.
+static void analyze_in_parallel(
+    std::string const& svn_path, std::string const& authors_file,
+    Ruleset const& ruleset, int first, int last, unsigned jobs,
+    history_profile const* history)
+{
+    struct slice
+    {
+        int first, last;
+        bool done;
+        std::string log;
+        std::exception_ptr error;
+    };
+
+    // Several slices per thread, so that the threads finish together,
+    // of equal cost if the history has been profiled
+    std::vector<slice> slices;
+    if (history)
+    {
+        std::uint64_t const slice_cost = std::max<std::uint64_t>(
+            1, history->cost(first, last) / (jobs * 8));
+        for (int r = first, end = first; r <= last; r = ++end)
+        {
+            for (std::uint64_t cost = history->cost(r, r); end < last && cost < slice_cost;)
+            {
+                ++end;
+                cost += history->cost(end, end);
+            }
+            slices.push_back(slice{r, end, false, std::string(), nullptr});
+        }
+    }
+    else
+    {
+        int const revisions = last - first + 1;
+        int const slice_size = std::max(1, revisions / int(jobs * 8));
+        for (int r = first; r <= last; r += slice_size)
+            slices.push_back(slice{r, std::min(last, r + slice_size - 1), false, std::string(), nullptr});
+    }
+
+    ruleset.matcher().freeze();
+    std::atomic<std::size_t> next_slice(0);
+    std::mutex mutex;
+    std::condition_variable slice_done;
+
+    auto work = [&]
+    {
+        std::unique_ptr<svn> svn_repo;
+        std::unique_ptr<Ruleset> rules;
+        for (std::size_t i; (i = next_slice++) < slices.size();)
+        {
+            slice& s = slices[i];
+            std::string log;
+            std::exception_ptr error;
+            {
+                Log::capture capture;
+                try
+                {
+                    if (!svn_repo)
+                    {
+                        svn_repo.reset(new svn(svn_path, authors_file));
+                        rules.reset(new Ruleset(ruleset));
+                    }
+                    importer imp(*svn_repo, *rules);
+                    for (int r = imp.skip_revisions(s.first, s.last); r <= s.last;
+                         r = imp.skip_revisions(r + 1, s.last))
+                        imp.import_revision(r);
+                }
+                catch (...)
+                {
+                    error = std::current_exception();
+                }
+                log = capture.str();
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            s.log.swap(log);
+            s.error = error;
+            s.done = true;
+            slice_done.notify_all();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned n = std::min<std::size_t>(jobs, slices.size()); n > 0; --n)
+        threads.emplace_back(work);
+
+    // Write out each slice's log in turn, stopping at the first failure
+    std::exception_ptr error;
+    for (std::size_t i = 0; i < slices.size() && !error; ++i)
+    {
+        std::string log;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            slice_done.wait(lock, [&]{ return slices[i].done; });
+            log.swap(slices[i].log);
+            error = slices[i].error;
+        }
+        std::cout << log;
+        if (error)
+            next_slice = slices.size();
+    }
+    for (auto& t : threads)
+        t.join();
+    if (error)
+        std::rethrow_exception(error);
+}
 
 int main(int argc, char **argv)
 {
@@ -41,10 +312,25 @@ int main(int argc, char **argv)
     std::string gitattributes_path;
     std::string svn_path;
     int resume_from = 0;
+    int start_at = 0;
+    std::string previous_rules_file;
     int max_rev = 0;
+    unsigned jobs = 1;
     bool dump_rules = false;
+    bool matcher_stats = false;
+    bool validate = false;
+    bool profile_history = false;
     std::string match_path;
     int match_rev = 0;
+    bool match_stdin = false;
+    std::string rule_server;
+    std::string lookups_file;
+    std::string trace_revs;
+    std::string verify_revs;
+    std::string explain_revs;
+    std::string bench_svn_read_revs;
+    std::string plan_shards_file;
+    int snapshot_rev = 0;
     try
     {
         namespace po = boost::program_options;
@@ -56,23 +342,123 @@ int main(int argc, char **argv)
             ("quiet,q", "be quiet")
             ("verbose,V", "be verbose")
             ("extra-verbose,X", "be even more verbose")
+            ("trace-revs", po::value(&trace_revs)->value_name("FIRST:LAST"), "be even more verbose, but only while importing svn revisions FIRST through LAST")
             ("exit-success", "exit with 0, even if errors occured")
             ("authors", po::value(&authors_file)->value_name("FILENAME"), "map between svn username and email")
-            ("svnrepo", po::value(&svn_path)->value_name("PATH")->required(), "path to svn repository")
+            ("svnrepo", po::value(&svn_path)->value_name("PATH")->required(), "path to svn repository, or with --svn-mirror, its URL")
+            ("svn-mirror", po::value(&options.svn_mirror)->value_name("PATH"), "convert the repository at the URL given as svnrepo from the local repository at PATH, first bringing it up to date by replaying the revisions committed since the last run; with --follow, before each poll")
+            ("svn-dump", po::value(&options.svn_dump)->value_name("FILE"), "load the svnadmin dump or svnrdump stream FILE, or standard input for -, decompressing it with gzip, bzip2, xz or zstd if its name ends in .gz, .bz2, .xz or .zst, into the repository svnrepo names, created if need be, converting each revision as soon as it's loaded; the revisions the repository has already are skipped")
             ("rules", po::value(&options.rules_file)->value_name("FILENAME")->required(), "file with the conversion rules")
+            ("only-repo", po::value(&options.only_repo)->value_name("NAME"), "convert only the repository NAME, for debugging its rules: the paths the other repositories' rules match are excluded, so the revisions that change only those are skipped, as the index of changes tells without reading them")
+            ("only-repo-gitlinks", "with --only-repo, also convert its super-module, but with nothing in it besides the gitlinks to the repository's commits")
             ("gitattributes,a", po::value(&gitattributes_path)->value_name("PATH"), "A file whose contents to inject as .gitattributes in every Git repository")
             ("dry-run", "Write no Git repositories")
-            ("coverage", "Dump an analysis of rule coverage")
+            ("coverage", "Dump an analysis of rule coverage, and rank the rules, the SVN path prefixes and the files by what converting them cost")
+            ("jobs,j", po::value(&jobs)->value_name("NUMBER")->default_value(1), "with --dry-run, analyze NUMBER ranges of revisions at a time; with --verify, check NUMBER revisions or refs at a time; with --bench-svn-read, also read on NUMBER threads")
             ("add-metadata", "if passed, each git commit will have svn commit info")
             ("add-metadata-notes", "if passed, each git commit will have notes with svn commit info")
-            ("resume-from", po::value(&resume_from)->value_name("REVISION"), "start importing at svn revision number")
+            ("notes-interval", po::value(&options.notes_interval)->value_name("NUMBER")->default_value(1000), "with --add-metadata-notes, write the notes on the commits of NUMBER revisions to each repository as one commit, besides at every checkpoint")
+            ("resume-from", po::value(&resume_from)->value_name("REVISION"), "start importing after svn revision number, restoring the state saved by the last run")
+            ("start-at", po::value(&start_at)->value_name("REVISION"), "convert only the history from REVISION on, starting each ref with the whole tree its rules map there; unlike --segment-start, the conversion can be resumed, by giving --start-at again with --resume-from, so a mirror needing only recent history is converted much faster")
+            ("previous-rules", po::value(&previous_rules_file)->value_name("FILENAME"), "with --resume-from, the rules the last run used: reconvert only the repositories whose conversion the changes to the rules since affect, each from the first revision affected")
             ("max-rev", po::value(&max_rev)->value_name("REVISION"), "stop importing at svn revision number")
             ("debug-rules", "print what rule is being used for each file")
-            ("commit-interval", po::value(&options.commit_interval)->value_name("NUMBER")->default_value(10000), "if passed the cache will be flushed to git every NUMBER of commits")
+            ("commit-interval", po::value(&options.commit_interval)->value_name("NUMBER")->default_value(10000), "write a checkpoint, from which the conversion can be resumed, every NUMBER of revisions")
             ("svn-branches", "Use the contents of SVN when creating branches, Note: SVN tags are branches as well")
+            ("copy-trees", "Write SVN directory copies that map onto existing Git trees as tree copies")
+            ("lightweight-tags", "with --copy-trees, make a tag that copies the whole of a ref, changing nothing, point at the ref's commit instead of a commit of its own")
+            ("walk-threads", po::value(&options.walk_threads)->value_name("NUMBER")->default_value(0), "list the directories of the SVN trees to convert on NUMBER background threads, each stealing work from the others when idle, so that walking a huge tree made anew isn't bound by one thread's reads")
+            ("reader-threads", po::value(&options.reader_threads)->value_name("NUMBER")->default_value(0), "read SVN file contents on NUMBER background threads")
+            ("preemit-blobs", "with --reader-threads, send the contents of each revision's files to fast-import as blobs in the order the reader threads finish them, before the revision's commits, which then only name them")
+            ("read-ahead", po::value(&options.read_ahead)->value_name("MEGABYTES")->default_value(256), "limit on file contents held by the reader threads")
+            ("write-threads", po::value(&options.write_threads)->value_name("NUMBER")->default_value(0), "write the commits of the Git repositories a revision changes on NUMBER threads, each reading SVN through a revision root of its own, leaving only the super-modules, whose commits record the others', to the main thread once the rest are written")
+            ("pack-threads", po::value(&options.pack_threads)->value_name("NUMBER")->default_value(0), "compress file contents into packfiles on NUMBER threads, instead of sending them to git fast-import")
+            ("svn-deltas", "With --pack-threads, and --tree-model or --local-tree-check, pack changed files as Git deltas translated from SVN's, where their previous contents are in the same pack.  A pack stays open until git fast-import is asked anything, so the deltas are fewest with --resolve-gitlinks, which asks after every submodule commit")
+            ("traversal-order", po::value(&options.traversal_order)->value_name("ORDER")->default_value("hash"), "visit the files of each SVN tree to convert in ORDER: \"hash\", the order SVN lists directories in; \"name\", for fast-import streams that are the same from run to run; or \"offset\", the order of their node-revisions in the FSFS revision files, for reading the files mostly forwards")
+            ("replay-changes", "Find the changes of each revision by replaying it, which names the sources of all copies, even in repositories whose format doesn't record them")
+            ("svn-mergeinfo", "Record the merges noted in the svn:mergeinfo of the directories mapped to whole refs as merges in Git, reading each revision's mergeinfo changes once and keeping them beside the rules cache for later runs")
+            ("reduce-merges", "leave out of each commit the merge parents that are already ancestors of another of its parents, as far as the commits written by this run tell, so that copies from several merged sources don't make commits with many redundant parents")
+            ("normalize-text", "Convert the line endings of files with svn:eol-style to LF, and contract the keywords svn:keywords names, as SVN keeps them")
+            ("lfs-threshold", po::value(&options.lfs_threshold)->value_name("BYTES")->default_value(0), "write the contents of files of at least BYTES to a Git LFS object store, each repository's lfs/objects unless --lfs-store is given, as they are read from SVN, and commit LFS pointer files in their place; give .gitattributes to match with --gitattributes")
+            ("lfs-pattern", po::value(&options.lfs_pattern)->value_name("REGEX"), "with --lfs-threshold, offload only the files whose Git paths REGEX matches part of")
+            ("lfs-store", po::value(&options.lfs_store)->value_name("DIRECTORY"), "with --lfs-threshold, write the LFS objects of every repository to DIRECTORY")
+            ("local-tree-check", "Decide whether commits change their tree without asking git fast-import where possible")
+            ("pipeline-commits", "when an SVN revision changes several branches or tags of a repository, write each one's commit as soon as git fast-import has been asked for the tree of the last, and read its answers once all are written, rather than awaiting each; not done in super-modules, their submodules, repositories sharing a --fast-import-host or written with --ref-writers")
+            ("tree-model", "Keep a model of every commit's tree in memory, sharing what the trees have in common, so that whether a commit changes its tree, and the objects SVN copies refer to, are found without asking git fast-import")
+            ("shared-objects", po::value(&options.shared_objects)->value_name("PATH"), "Link the object stores of all Git repositories through the alternates of the object directory PATH, so that a blob already written to one is never written to another; run post-conversion to make each self-contained again")
+            ("shards", po::value(&options.shards)->value_name("NUMBER")->default_value(0), "split the conversion between NUMBER worker processes, each converting a share of the repositories other than super-modules, and a coordinator converting the super-modules; run one process for each --shard, with the same options, in the same directory")
+            ("shard", po::value(&options.shard)->value_name("NUMBER")->default_value(0), "with --shards, the share of the conversion done by this process: 1 to the number of shards for a worker, or 0 for the coordinator, which follows the workers' checkpoints")
+            ("shard-costs", po::value(&options.shard_costs)->value_name("FILENAME"), "with --shards, deal the repositories out to the workers by the time an earlier conversion given --profile spent on each, as its --profile-csv FILENAME has it, rather than by --history-profile's changes: the costliest first, each to the worker with the least time so far")
+            ("plan-shards", po::value(&plan_shards_file)->value_name("FILENAME"), "Write nothing, but deal the repositories out to --shards, by --shard-costs or --history-profile if given, and write which shard converts each to FILENAME, for --shard-plan, with the cost of each and the total each shard is predicted to take")
+            ("shard-plan", po::value(&options.shard_plan)->value_name("FILENAME"), "with --shards, convert the repositories of the shard FILENAME, written by --plan-shards and perhaps edited since, deals out to this process.  Give every shard the same plan")
+            ("segment-start", po::value(&options.segment_start)->value_name("REVISION")->default_value(0), "convert only the history from REVISION on, starting each ref with the whole tree its rules map there; with --max-rev, segments of the history can be converted in separate directories at once, then joined by stitch-segments")
+            ("follow", po::value(&options.follow_interval)->value_name("SECONDS")->default_value(0), "after converting the latest revision, keep running, converting the revisions committed to SVN as they appear: poll for them every SECONDS, or at once on SIGUSR1, as from a post-commit hook, and checkpoint after each batch; a change to the rules file takes effect at the next poll, reconverting only the repositories it affects; SIGINT or SIGTERM ends the run")
+            ("push-remote", po::value(&options.push_remote)->value_name("REMOTE"), "once the conversion is done, and with --follow after each checkpoint, mirror each repository with new commits to its REMOTE, a remote name or URL in which %n stands for the repository's name")
+            ("push-jobs", po::value(&options.push_jobs)->value_name("NUMBER")->default_value(0), "with --push-remote, also push the repositories with new commits at every --commit-interval checkpoint, on NUMBER background threads while the conversion goes on, so that once it's done only what it converted since is left to upload")
+            ("push-kbps", po::value(&options.push_kbps)->value_name("KILOBYTES")->default_value(0), "with --push-jobs, hold the pushes back to upload no more than KILOBYTES a second on average, judged by how much each repository's packs have grown since it was last pushed")
+            ("coalesce-submodule-revisions", po::value(&options.coalesce_submodule_revisions)->value_name("NUMBER")->default_value(0), "make a super-module branch record the submodule commits of up to NUMBER revisions in one commit, unless the branch changes otherwise or is copied meanwhile")
+            ("coalesce-submodule-seconds", po::value(&options.coalesce_submodule_seconds)->value_name("SECONDS")->default_value(0), "as --coalesce-submodule-revisions, for the revisions committed to SVN within SECONDS of the first")
+            ("resolve-gitlinks", "Write the SHA-1s of submodule commits into super-modules, asking git fast-import with get-mark, instead of leaving marks for fix-submodule-refs")
+            ("prune-branches", "At the end of the run, delete the branches merged into master and those left empty")
+            ("idle-revisions", po::value(&options.idle_revisions)->value_name("NUMBER")->default_value(0), "stop a repository's git fast-import after NUMBER revisions without commits to it, starting it again when needed")
+            ("checkpoint-megabytes", po::value(&options.checkpoint_megabytes)->value_name("NUMBER")->default_value(0), "checkpoint a repository's git fast-import, writing out its packfile, after every NUMBER megabytes of commands sent to it")
+            ("repack-cpus", po::value(&options.repack_cpus)->value_name("NUMBER")->default_value(0), "once the conversion is done and every fast-import has exited, consolidate each repository's packs with git repack and write its commit-graph, several repositories at a time, using NUMBER CPUs in all")
+            ("serve-packs", "with --repack-cpus, repack each repository for serving clones: its deltas found afresh over a window of 250 objects, kept within delta islands that part what heads reach from what only tags reach, with a reachability bitmap and a commit-graph with changed-path filters.  The islands and bitmaps are configured in the repository, for later repacks to keep.  Each repository is cloned before and after, and the sizes and clone times are reported")
+            ("serve-window-memory", po::value(&options.serve_window_memory)->value_name("MEGABYTES")->default_value(256), "with --serve-packs, the memory each thread of a repack may give its delta window")
+            ("pack-refs", "at each checkpoint, and once every fast-import has exited, move each repository's refs into its packed-refs file with git pack-refs, rather than leaving thousands of them in files of their own, and report how many each has")
+            ("fast-ingest", "have git fast-import, and --pack-threads, write objects without compressing them, and fast-import only make deltas up to 10 deep, leaving --repack-cpus, which this requires, to compress and deltify them all afresh with git repack -f once the conversion is done.  The time taken by each phase is reported")
+            ("fast-import-queue", po::value(&options.fast_import_queue)->value_name("MEGABYTES")->default_value(16), "when a git fast-import can't keep up, queue up to MEGABYTES of its commands in memory, going on with the other repositories meanwhile, before waiting for it")
+            ("max-lag", po::value(&options.max_lag)->value_name("REVISIONS")->default_value(0), "let the fast-imports that can't keep up fall at most REVISIONS revisions behind, in the commands they have taken and in those they have acknowledged importing, while the others run ahead, within --fast-import-queue; 0 bounds them by --fast-import-queue alone")
+            ("fast-import-host", po::value(&options.fast_import_hosts)->value_name("HOST=REPOSITORY,..."), "import the listed repositories, typically small ones, with a single git fast-import in the repository HOST, which holds the refs of each in the Git namespace named for it and numbers their marks as one; once the conversion is done, each is made a repository of its own, sharing HOST's objects through its alternates.  May be given for several groups")
+            ("fast-import-worker", po::value(&options.fast_import_workers)->value_name("HOST:PORT"), "run git fast-import not here but on the machine HOST, through the fast-import-worker listening at PORT, relaying the commands and fast-import's answers over TCP, compressed.  The repositories stay where they are, so the machine must reach them at the same paths, e.g. on shared storage.  May be given for several workers, among which the repositories are dealt out, always alike")
+            ("ref-writers", po::value(&options.ref_writers)->value_name("REPOSITORY=NUMBER"), "write the refs of REPOSITORY, typically one of the largest, with NUMBER git fast-imports at once instead of one: master with the first, and each other ref with one of the rest, always the same.  Each keeps marks and packs of its own; a commit one names that another wrote, e.g. a merge parent, is named by the SHA-1 the other exported for it, once that has checkpointed, and once they have all exited their marks are joined into the repository's marks file.  May be given for several repositories")
+            ("io-uring", "on Linux, write to the git fast-imports whose pipes have room, and pass --fsfs-readahead's advice to the kernel, through an io_uring, in one system call for all of them rather than one each.  Where io_uring is unavailable, the usual system calls are made")
+            ("fast-import-rss", po::value(&options.fast_import_rss)->value_name("MEGABYTES")->default_value(0), "restart a repository's git fast-import once its resident memory reaches MEGABYTES")
+            ("memory-budget", po::value(&options.memory_budget)->value_name("MEGABYTES")->default_value(0), "keep the resident memory of svn2git and its git fast-imports together within MEGABYTES: shrink svn2git's caches as it nears it, and stop the idlest fast-imports beyond it")
+            ("active-branches", po::value(&options.active_branches)->value_name("NUMBER")->default_value(0), "give each repository's git fast-import room for as many branch trees as the rules have branches of the repository active at once, with two more for tags, but at least git's default of 5 and at most NUMBER, so that it doesn't keep unloading and reloading them")
+            ("fast-import-stats", "report the statistics of each git fast-import as it exits, among them how often it loaded branch trees, and at the end of the run, those of each repository's processes together, noting repositories sent many duplicate objects or reloading branches often; what else fast-import prints comes out as it exits too")
+            ("mock-fast-import", "instead of starting git fast-import, answer svn2git's commands as it would on a thread of svn2git's own, keeping each branch's tree in memory but writing nothing, so as to profile the importer alone.  Unlike --dry-run, every command is written and every question asked of fast-import awaits its answer")
+            ("mock-latency", po::value(&options.mock_latency)->value_name("[REPOSITORY=]MILLISECONDS[,KBPS[,STALLS,STALL_MILLISECONDS]]"), "with --mock-fast-import, have the mock fast-import of REPOSITORY, or of every repository the option doesn't name, wait MILLISECONDS before each answer, read no more than KBPS kilobytes of commands a second, and stall for STALL_MILLISECONDS after STALLS of every thousand commits, chosen the same way on every run; may be repeated")
+            ("prefetch-revisions", po::value(&options.prefetch_revisions)->value_name("NUMBER")->default_value(0), "read up to NUMBER revisions ahead on a background thread")
+            ("plan-ahead", po::value(&options.plan_ahead)->value_name("NUMBER")->default_value(0), "find what each SVN revision changes in Git, walking the SVN trees to convert and matching their files, up to NUMBER revisions ahead on a background thread, while the commits of earlier ones are written")
+            ("keep-plans", "keep what each SVN revision changes in Git, as found by planning it, in the cache directory, keyed by the rules, for later runs with the same rules, and other processes running alongside, to read instead of planning it again")
+            ("blob-cache", "keep the Git name of the blob made of each SVN file content, by the SHA-1 SVN keeps of the content, in the cache directory, so that later runs converting the same history, e.g. after the rules are fixed, refer to blobs already in a repository's object store, or with --shared-objects in any, without reading them from SVN")
+            ("svn-cache-megabytes", po::value(&options.svn_cache_megabytes)->value_name("NUMBER")->default_value(0), "size libsvn_fs's in-memory cache, shared by all the threads reading SVN, to NUMBER megabytes instead of Subversion's default")
+            ("svn-file-handles", po::value(&options.svn_file_handles)->value_name("NUMBER")->default_value(0), "let libsvn_fs keep up to NUMBER files of the repository open")
+            ("svn-cache-fulltexts", "have libsvn_fs cache the full texts of the files it reads")
+            ("svn-cache-deltas", "have libsvn_fs cache the deltas it reads the files' texts from")
+            ("svn-latency", po::value(&options.svn_latency)->value_name("MICROSECONDS")->default_value(0), "wait MICROSECONDS before every call to libsvn, as if SVN were read from a slow disk, to benchmark how well reading SVN is overlapped with the rest")
+            ("flight-recorder", po::value(&options.flight_recorder)->value_name("FILE")->default_value("svn2git-flight.log"), "if the run dies of an exception, a failed assertion or a signal, write the last few thousand things it did, such as the revisions, files, commits and fast-import commands and responses, which are always kept in memory, to FILE; an empty FILE writes nothing")
+            ("svn-call-stats", "Report how many times each libsvn function was called, and the distribution of the calls' latencies, to show which SVN operations are worth caching")
+            ("fsfs-readahead", po::value(&options.fsfs_readahead)->value_name("NUMBER")->default_value(0), "have the kernel read the FSFS files of the next NUMBER revisions into the page cache, instead of copying the SVN repository to a RAM disk")
+            ("fsfs-drop-behind", po::value(&options.fsfs_drop_behind)->value_name("NUMBER")->default_value(0), "with --fsfs-readahead, let the kernel drop the FSFS files of revisions NUMBER behind from the page cache")
+            ("profile", "Report the time spent in each phase of the conversion, and the hit rates of its caches")
+            ("profile-csv", po::value(&options.profile_csv)->value_name("FILENAME"), "with --profile, append running totals to FILENAME as CSV")
+            ("memory-csv", po::value(&options.memory_csv)->value_name("FILENAME"), "sample the memory held by each part of svn2git, and the resident memory of svn2git and its git fast-imports, and append the high-water marks of every --profile-interval revisions to FILENAME as CSV")
+            ("memory-interval", po::value(&options.memory_interval)->value_name("NUMBER")->default_value(10), "with --memory-csv, sample every NUMBER of revisions")
+            ("capture-streams", po::value(&options.capture_streams)->value_name("DIRECTORY"), "write each repository's fast-import stream, and fast-import's responses, to files in DIRECTORY, which replay-streams can import again to benchmark fast-import alone")
+            ("spool", po::value(&options.spool)->value_name("DIRECTORY"), "write each repository's commands to compressed files in DIRECTORY, for import-spools to import meanwhile or afterwards, instead of to git fast-import.  Whether a commit changes its tree is decided without asking fast-import, so a commit that only rewrites files with the contents they had is kept")
+            ("profile-interval", po::value(&options.profile_interval)->value_name("NUMBER")->default_value(1000), "write the CSV totals of --profile-csv and --memory-csv every NUMBER of revisions")
+            ("trace-file", po::value(&options.trace_file)->value_name("FILENAME"), "Write a timeline of the conversion to FILENAME in Chrome's Trace Event Format, for viewing in Perfetto")
+            ("slow-revisions", po::value(&options.slow_revisions)->value_name("FILENAME"), "append to FILENAME a breakdown of each revision that takes at least --slow-revision-seconds: the time spent in each of its phases and the bytes written to each repository, its rounds, its waits for ls responses, the cache lookups it missed, and the paths it converted by rule.  Only the wall clock is read, so revisions that aren't slow cost next to nothing")
+            ("slow-revision-seconds", po::value(&options.slow_revision_seconds)->value_name("SECONDS")->default_value(60), "the time a revision must take to be reported by --slow-revisions")
+            ("trace-min-file-size", po::value(&options.trace_min_file_size)->value_name("BYTES")->default_value(1 << 20), "with --trace-file, show the writing of files of at least BYTES")
+            ("history-profile", "before converting or analyzing, find the cost of each SVN revision to --max-rev on as many threads as there are CPUs, or --jobs: the paths it changes, the copies it makes, the bytes of text it changes and the rules it activates or retires.  What is read from SVN is kept beside the index of changes, for later runs to extend.  The --jobs of a dry run then analyze ranges of equal cost, the repositories are dealt to --shards by how many changes the rules map into them, and --status-file judges its ETA by cost")
+            ("commit-index", po::value(&options.commit_index)->value_name("FILENAME"), "once the conversion is done, write to FILENAME an index of the commits kept in each ref of every repository by the SVN revision each was made in, with its mark and SHA-1, for find-commits to look up by revision, by ref and revision, or by SHA-1")
+            ("status-file", po::value(&options.status_file)->value_name("FILENAME"), "Keep FILENAME up to date with the progress of the conversion, its throughput and ETA, and the memory in use, as metrics in the Prometheus text format")
+            ("status-interval", po::value(&options.status_interval)->value_name("SECONDS")->default_value(10), "rewrite the --status-file every SECONDS")
+            ("record-lookups", po::value(&lookups_file)->value_name("FILENAME"), "write every rule lookup to FILENAME, for replay by patrie_bench")
             ("dump-rules", "Dump the contents of the rule trie and exit")
+            ("matcher-stats", "Write nothing, but report what the matcher of the rules is made of and costs, for its SVN and Git tries alike: the nodes at each depth, by number of children and by number of rules, and the bytes of the nodes, labels, rule vectors, flattened tries, rules and transitions; the time taken to build it; and how many nodes lookups enter on average, of the paths changed by a thousand revisions spread over the history to --max-rev and the Git addresses they map to")
+            ("explain", po::value(&explain_revs)->value_name("FIRST[:LAST]"), "Write nothing, but report what converting svn revisions FIRST through LAST, or FIRST alone, would cost: for each revision, the files the rules would have converted and the bytes of their contents, the deletions, copies, rule transitions, commits and fast-import \"ls\" round trips, then the totals of each repository, and the costliest revisions")
+            ("bench-svn-read", po::value(&bench_svn_read_revs)->value_name("FIRST[:LAST]"), "Write nothing, but measure how fast SVN gives up the file contents converting svn revisions FIRST through LAST, or FIRST alone, would read, as planned by the rules: read them all, discarding them, on one thread, on --jobs threads, and on one thread again with libsvn_fs's caches warm, reporting the MB/s and files/s of each, to tell whether the conversion is held back by SVN or by Git.  Compare runs with and without --svn-cache-megabytes, --svn-cache-fulltexts and --svn-cache-deltas")
+            ("validate-rules", "Report the SVN files that no rule matches, much faster than a dry run, by matching only the directories of the files each revision changes; these are indexed once per SVN repository and cached")
+            ("verify", po::value(&verify_revs)->value_name("REVISIONS"), "Check the Git repositories of a finished conversion against SVN and exit: at each of REVISIONS, a comma-separated list of N and FIRST:LAST[:STEP], the tree of each branch must hold the modes and blob SHA-1s of exactly the files the rules map to it, and so must the tree of each tag made then")
+            ("snapshot-at", po::value(&snapshot_rev)->value_name("REVISION"), "Write no history, but only what each Git repository would hold at REVISION, and exit: a parentless commit for each branch and tag the rules give it then, the repositories written on --jobs threads.  Snapshots are written to new repositories and replace earlier snapshots, never a conversion")
             ("match-path", po::value(&match_path)->value_name("PATH"), "Path to match in a quick ruleset test")
             ("match-rev", po::value(&match_rev)->value_name("REVISION"), "Optional revision to match in a quick ruleset test")
+            ("match-stdin", "Answer ruleset queries read from standard input, one per line in the format of --record-lookups, and exit")
+            ("rule-server", po::value(&rule_server)->value_name("SOCKET"), "Answer ruleset queries in the format of --match-stdin from clients of a Unix domain socket at SOCKET, keeping the ruleset loaded until killed")
             ;
         po::variables_map variables;
         store(po::command_line_parser(argc, argv)
@@ -104,22 +490,347 @@ int main(int argc, char **argv)
         {
             exit_success = true;
         }
+        flight_recorder::install(options.flight_recorder);
 
         dump_rules = variables.count("dump-rules") > 0;
+        matcher_stats = variables.count("matcher-stats") > 0;
+        match_stdin = variables.count("match-stdin") > 0;
+        validate = variables.count("validate-rules") > 0;
+        profile_history = variables.count("history-profile") > 0;
         options.add_metadata = variables.count("add-metadata");
         options.add_metadata_notes = variables.count("add-metadata-notes");
         options.dry_run = variables.count("dry-run");
         options.coverage = variables.count("coverage");
         options.debug_rules = variables.count("debug-rules");
         options.svn_branches = variables.count("svn-branches");
+        options.copy_trees = variables.count("copy-trees");
+        options.keep_plans = variables.count("keep-plans");
+        options.blob_cache = variables.count("blob-cache");
+        options.lightweight_tags = variables.count("lightweight-tags");
+        options.local_tree_check = variables.count("local-tree-check");
+        options.pipeline_commits = variables.count("pipeline-commits");
+        options.tree_model = variables.count("tree-model");
+        options.svn_deltas = variables.count("svn-deltas");
+        options.preemit_blobs = variables.count("preemit-blobs");
+        options.normalize_text = variables.count("normalize-text");
+        options.replay_changes = variables.count("replay-changes");
+        options.svn_mergeinfo = variables.count("svn-mergeinfo");
+        options.reduce_merges = variables.count("reduce-merges");
+        options.resolve_gitlinks = variables.count("resolve-gitlinks");
+        options.prune_branches = variables.count("prune-branches");
+        options.resume = variables.count("resume-from");
+        options.profile = variables.count("profile");
+        options.svn_cache_fulltexts = variables.count("svn-cache-fulltexts");
+        options.svn_cache_deltas = variables.count("svn-cache-deltas");
+        options.svn_call_stats = variables.count("svn-call-stats");
+        options.io_uring = variables.count("io-uring");
+        options.fast_ingest = variables.count("fast-ingest");
+        options.pack_refs = variables.count("pack-refs");
+        options.fast_import_stats = variables.count("fast-import-stats");
+        options.mock_fast_import = variables.count("mock-fast-import");
+        options.serve_packs = variables.count("serve-packs");
+        options.only_repo_gitlinks = variables.count("only-repo-gitlinks");
         notify(variables);
 
+        if (!trace_revs.empty())
+        {
+            unsigned first = 0, last = 0;
+            char colon = 0;
+            std::istringstream in(trace_revs);
+            if (!(in >> first >> colon >> last) || colon != ':' || first > last)
+                throw std::runtime_error("--trace-revs expects FIRST:LAST, not " + trace_revs);
+            Log::set_trace_revisions(first, last);
+        }
+
+        if (jobs > 1)
+        {
+            if (!options.dry_run && verify_revs.empty() && snapshot_rev == 0
+                && bench_svn_read_revs.empty())
+            {
+                throw std::runtime_error(
+                    "--jobs only applies to --dry-run, --verify, --snapshot-at and --bench-svn-read");
+            }
+            if (options.profile || !options.trace_file.empty() || options.resume 
+                || !trace_revs.empty() || !lookups_file.empty() || !options.slow_revisions.empty())
+            {
+                throw std::runtime_error(
+                    "--jobs can't be combined with --profile, --trace-file, --resume-from, "
+                    "--trace-revs, --record-lookups or --slow-revisions");
+            }
+        }
+
+        if (options.traversal_order != "hash" && options.traversal_order != "name"
+            && options.traversal_order != "offset")
+        {
+            throw std::runtime_error(
+                "--traversal-order must be hash, name or offset, not " + options.traversal_order);
+        }
+
+        if (options.shards < 0 || options.shard < 0 || options.shard > options.shards)
+            throw std::runtime_error("--shard must be from 0 to the number of --shards");
+        if (options.shards > 0 && (options.dry_run || jobs > 1))
+            throw std::runtime_error("--shards can't be combined with --dry-run or --jobs");
+        if (options.shards == 0
+            && (!options.shard_costs.empty() || !plan_shards_file.empty() || !options.shard_plan.empty()))
+        {
+            throw std::runtime_error("--shard-costs, --plan-shards and --shard-plan only apply with --shards");
+        }
+        // The plan already says what the costs would
+        if (!options.shard_plan.empty() && (!options.shard_costs.empty() || !plan_shards_file.empty()))
+            throw std::runtime_error("--shard-plan can't be combined with --shard-costs or --plan-shards");
+        if (options.segment_start < 0)
+            throw std::runtime_error("--segment-start must be a revision");
+        // The submodule commits recorded by --resolve-gitlinks, like
+        // those annotated by --add-metadata-notes, would be those of
+        // the segment, which stitching replaces
+        if (options.segment_start > 0
+            && (options.resume || options.shards > 0 || jobs > 1 || options.resolve_gitlinks
+                || options.add_metadata_notes))
+        {
+            throw std::runtime_error(
+                "--segment-start can't be combined with --resume-from, --shards, --jobs, "
+                "--resolve-gitlinks or --add-metadata-notes");
+        }
+        // A shallow start is a --segment-start never stitched, so it
+        // can be resumed and record gitlinks and notes, but a rewind
+        // for changed rules can't go back before it
+        if (start_at < 0)
+            throw std::runtime_error("--start-at must be a revision");
+        if (start_at > 0)
+        {
+            if (options.segment_start > 0 || options.shards > 0 || jobs > 1
+                || !previous_rules_file.empty() || options.follow_interval > 0)
+            {
+                throw std::runtime_error(
+                    "--start-at can't be combined with --segment-start, --shards, --jobs, "
+                    "--previous-rules or --follow");
+            }
+            options.segment_start = start_at;
+        }
+        if (options.coalesce_submodule_revisions < 0 || options.coalesce_submodule_seconds < 0)
+            throw std::runtime_error("--coalesce-submodule-revisions and -seconds must not be negative");
+        if (options.lfs_threshold < 0)
+            throw std::runtime_error("--lfs-threshold must not be negative");
+        if (options.lfs_threshold == 0 && (!options.lfs_pattern.empty() || !options.lfs_store.empty()))
+            throw std::runtime_error("--lfs-pattern and --lfs-store only apply with --lfs-threshold");
+        if (options.notes_interval < 0)
+            throw std::runtime_error("--notes-interval must not be negative");
+        if (!options.memory_csv.empty() && options.memory_interval <= 0)
+            throw std::runtime_error("--memory-interval must be positive");
+        // The captured streams must hold everything fast-import is
+        // given, so its blobs can't come from elsewhere
+        if (!options.capture_streams.empty()
+            && (options.dry_run || options.resume || options.pack_threads > 0
+                || !options.shared_objects.empty()))
+        {
+            throw std::runtime_error(
+                "--capture-streams can't be combined with --dry-run, --resume-from, "
+                "--pack-threads or --shared-objects");
+        }
+        if (!options.capture_streams.empty())
+            boost::filesystem::create_directories(options.capture_streams);
+        // A spool is read by nobody until the conversion is done
+        // with it, so svn2git can't depend on what fast-import knows
+        if (!options.spool.empty())
+        {
+            if (options.dry_run || options.resume || options.pack_threads > 0
+                || !options.shared_objects.empty() || options.resolve_gitlinks
+                || options.prune_branches || !options.capture_streams.empty()
+                || !options.push_remote.empty())
+            {
+                throw std::runtime_error(
+                    "--spool can't be combined with --dry-run, --resume-from, --pack-threads, "
+                    "--shared-objects, --resolve-gitlinks, --prune-branches, --capture-streams "
+                    "or --push-remote");
+            }
+            if (boost::filesystem::exists(options.spool) && !boost::filesystem::is_empty(options.spool))
+                throw std::runtime_error("The --spool directory " + options.spool + " isn't empty");
+            boost::filesystem::create_directories(options.spool);
+        }
+        if (options.repack_cpus < 0)
+            throw std::runtime_error("--repack-cpus must not be negative");
+        if (options.repack_cpus > 0 && (options.dry_run || !options.spool.empty()))
+            throw std::runtime_error("--repack-cpus can't be combined with --dry-run or --spool");
+        if (options.pack_refs && (options.dry_run || !options.spool.empty() || options.mock_fast_import))
+            throw std::runtime_error("--pack-refs can't be combined with --dry-run, --spool or --mock-fast-import");
+        if (options.serve_packs && options.repack_cpus == 0)
+            throw std::runtime_error("--serve-packs needs --repack-cpus to repack with");
+        if (options.serve_window_memory <= 0)
+            throw std::runtime_error("--serve-window-memory must be positive");
+        if (options.fast_ingest && options.repack_cpus == 0)
+            throw std::runtime_error("--fast-ingest needs --repack-cpus to compress what it writes");
+        if (options.preemit_blobs && (options.reader_threads == 0 || options.pack_threads > 0))
+            throw std::runtime_error("--preemit-blobs needs --reader-threads, and can't be combined with --pack-threads");
+        // A delta's base must be in the pack being written, and asking
+        // fast-import whether each commit changed its tree finishes
+        // that pack with every commit, before the next revision could
+        // refer to its blobs
+        if (options.svn_deltas
+            && (options.pack_threads == 0 || !(options.tree_model || options.local_tree_check)))
+        {
+            throw std::runtime_error("--svn-deltas needs --pack-threads, and --tree-model or --local-tree-check");
+        }
+        if (options.active_branches < 0)
+            throw std::runtime_error("--active-branches must not be negative");
+        if (options.max_lag < 0)
+            throw std::runtime_error("--max-lag must not be negative");
+        // What a hosted repository writes reaches Git only through
+        // its host, and isn't a repository of its own until the end
+        if (!options.fast_import_hosts.empty()
+            && (options.resume || options.shards > 0 || !options.spool.empty()
+                || !options.capture_streams.empty() || options.pack_threads > 0
+                || !options.shared_objects.empty() || options.resolve_gitlinks
+                || options.fast_ingest || options.follow_interval > 0
+                || !options.push_remote.empty()))
+        {
+            throw std::runtime_error(
+                "--fast-import-host can't be combined with --resume-from, --shards, --spool, "
+                "--capture-streams, --pack-threads, --shared-objects, --resolve-gitlinks, "
+                "--fast-ingest, --follow or --push-remote");
+        }
+        // Each writer only reads what the others wrote once it's in
+        // their packs, and refers to it by SHA-1
+        if (!options.ref_writers.empty()
+            && (options.resume || options.shards > 0 || !options.spool.empty()
+                || !options.capture_streams.empty() || options.pack_threads > 0
+                || !options.shared_objects.empty() || options.resolve_gitlinks
+                || options.add_metadata_notes || options.preemit_blobs
+                || options.follow_interval > 0 || options.mock_fast_import
+                || !options.fast_import_hosts.empty()))
+        {
+            throw std::runtime_error(
+                "--ref-writers can't be combined with --resume-from, --shards, --spool, "
+                "--capture-streams, --pack-threads, --shared-objects, --resolve-gitlinks, "
+                "--add-metadata-notes, --preemit-blobs, --follow, --mock-fast-import "
+                "or --fast-import-host");
+        }
+        // A worker's fast-import runs, and prints what it has to say,
+        // where svn2git can neither measure nor read it
+        if (!options.fast_import_workers.empty()
+            && (options.mock_fast_import || options.fast_import_stats || options.fast_import_rss > 0))
+        {
+            throw std::runtime_error(
+                "--fast-import-worker can't be combined with --mock-fast-import, "
+                "--fast-import-stats or --fast-import-rss");
+        }
+        if (options.write_threads < 0)
+            throw std::runtime_error("--write-threads must not be negative");
+        // The profile and the coverage are gathered, and packs, LFS
+        // objects and hosts' streams written, by one thread at a time
+        if (options.write_threads > 0
+            && (options.profile || !options.trace_file.empty() || !options.slow_revisions.empty()
+                || options.coverage || options.pack_threads > 0 || options.preemit_blobs
+                || options.lfs_threshold > 0 || !options.fast_import_hosts.empty()))
+        {
+            throw std::runtime_error(
+                "--write-threads can't be combined with --profile, --trace-file, --slow-revisions, "
+                "--coverage, --pack-threads, --preemit-blobs, --lfs-threshold "
+                "or --fast-import-host");
+        }
+        if (options.memory_budget < 0)
+            throw std::runtime_error("--memory-budget must not be negative");
+        if (!options.commit_index.empty()
+            && (options.dry_run || !options.spool.empty() || options.mock_fast_import))
+        {
+            throw std::runtime_error(
+                "--commit-index can't be combined with --dry-run, --spool or --mock-fast-import");
+        }
+        if (options.mock_fast_import
+            && (options.dry_run || !options.spool.empty() || options.resume || options.pack_threads > 0
+                || options.repack_cpus > 0 || options.fast_import_stats || options.prune_branches
+                || !options.push_remote.empty()))
+        {
+            throw std::runtime_error(
+                "--mock-fast-import can't be combined with --dry-run, --spool, --resume-from, "
+                "--pack-threads, --repack-cpus, --fast-import-stats, --prune-branches or --push-remote");
+        }
+        if (options.svn_latency < 0)
+            throw std::runtime_error("--svn-latency must not be negative");
+        if (!options.mock_latency.empty() && !options.mock_fast_import)
+            throw std::runtime_error("--mock-latency only applies with --mock-fast-import");
+        for (auto const& spec : options.mock_latency)
+        {
+            mock_delays d;
+            mock_delays::parse(spec, d);
+        }
+        if (options.slow_revision_seconds < 0)
+            throw std::runtime_error("--slow-revision-seconds must not be negative");
+        if (options.follow_interval < 0)
+            throw std::runtime_error("--follow must not be negative");
+        if (options.follow_interval > 0
+            && (options.dry_run || max_rev > 0 || options.shards > 0 || options.segment_start > 0))
+        {
+            throw std::runtime_error(
+                "--follow can't be combined with --dry-run, --max-rev, --shards or --segment-start");
+        }
+        if (options.push_jobs < 0 || options.push_kbps < 0)
+            throw std::runtime_error("--push-jobs and --push-kbps must not be negative");
+        if (options.push_remote.empty() && (options.push_jobs > 0 || options.push_kbps > 0))
+            throw std::runtime_error("--push-jobs and --push-kbps only apply with --push-remote");
+        if (!options.push_remote.empty() && options.dry_run)
+            throw std::runtime_error("--push-remote can't be combined with --dry-run");
+        if (options.only_repo_gitlinks && options.only_repo.empty())
+            throw std::runtime_error("--only-repo-gitlinks only applies with --only-repo");
+        if (!options.only_repo.empty() && options.shards > 0)
+            throw std::runtime_error("--only-repo can't be combined with --shards");
+        // The last revision to convert isn't known until the dump is loaded
+        if (!options.svn_dump.empty()
+            && (!options.svn_mirror.empty() || options.follow_interval > 0
+                || options.prefetch_revisions > 0 || options.plan_ahead > 0
+                || !options.status_file.empty()))
+        {
+            throw std::runtime_error(
+                "--svn-dump can't be combined with --svn-mirror, --follow, --prefetch-revisions, "
+                "--plan-ahead or --status-file");
+        }
+        if (options.plan_ahead < 0)
+            throw std::runtime_error("--plan-ahead must not be negative");
+        // Tree copies ask Git about the trees they copy while the
+        // revision is planned, and the revisions traced are those
+        // being written
+        if (options.plan_ahead > 0 && (options.copy_trees || !trace_revs.empty()))
+            throw std::runtime_error("--plan-ahead can't be combined with --copy-trees or --trace-revs");
+        // A plan with tree copies depends on what is in Git
+        if (options.keep_plans && options.copy_trees)
+            throw std::runtime_error("--keep-plans can't be combined with --copy-trees");
+        // Every shard must deal out the repositories alike
+        if (profile_history && options.shards > 0 && max_rev < 1)
+            throw std::runtime_error("--history-profile with --shards needs --max-rev");
+        if (profile_history && !options.svn_dump.empty())
+            throw std::runtime_error("--history-profile can't be combined with --svn-dump");
 
         // Load the configuration
         Log::info() << "reading ruleset..." << std::endl;
 
         Ruleset ruleset(options.rules_file);
-        Log::info() << "done reading ruleset." << std::endl;
+        Log::info() << "done reading ruleset: " << ruleset.rule_count() << " rules, matched by tries built in "
+                    << ruleset.build_seconds() << "s" << std::endl;
+        // Revisions planned ahead are planned by their own changes, not
+        // those of the revisions squashed with them
+        if (ruleset.squashes() && options.plan_ahead > 0)
+            throw std::runtime_error(options.rules_file + " has squash rules, which --plan-ahead can't be combined with");
+        if (!options.only_repo.empty())
+        {
+            Log::info() << "converting only " << options.only_repo
+                        << (ruleset.repositories().size() > 1 ? " and the gitlinks of its super-module" : "")
+                        << std::endl;
+        }
+#ifdef SVN2GIT_COMPILED_MATCHER
+        if (!ruleset.matcher().use_compiled_matcher(&generated_matcher))
+        {
+            Log::warn() << "the matcher compiled into svn2git is for other rules than "
+                        << options.rules_file << "; they will be interpreted" << std::endl;
+        }
+#endif
+
+        std::ofstream lookups;
+        if (!lookups_file.empty())
+        {
+            lookups.open(lookups_file.c_str(), std::ios::trunc);
+            if (!lookups)
+                throw std::runtime_error("Couldn't open lookup record file: " + lookups_file);
+            ruleset.matcher().record_lookups(&lookups);
+        }
 
         if (dump_rules)
         {
@@ -130,13 +841,149 @@ int main(int argc, char **argv)
         if (match_path.size() > 0)
         {
             Rule const* r = ruleset.matcher().longest_match(match_path, match_rev);
+            if (r && r->excludes())
+            {
+                std::cout << "The path was excluded by " << *r << std::endl;
+                exit(1);
+            }
             std::cout <<  "The path " << (r ? "was" : "wasn't") << " matched" << std::endl;
             exit(r ? 0 : 1);
         }
 
+        if (match_stdin)
+        {
+            answer_rule_queries(ruleset, std::cin, std::cout);
+            exit(0);
+        }
+
+        if (!rule_server.empty())
+            serve_rule_queries(ruleset, rule_server);
+
+        // A remote repository is converted from its local mirror
+        std::string svn_url;
+        if (is_svn_url(svn_path))
+        {
+            if (options.svn_mirror.empty())
+                throw std::runtime_error("converting " + svn_path + " needs --svn-mirror");
+            svn_url = svn_path;
+            mirror_svn(svn_url, options.svn_mirror);
+            svn_path = options.svn_mirror;
+        }
+        else if (!options.svn_mirror.empty())
+            throw std::runtime_error("--svn-mirror only applies to a repository URL");
+
+        // Only the conversion itself goes on while a dump is loaded
+        std::unique_ptr<svn_dump_loader> loader;
+        if (!options.svn_dump.empty())
+        {
+            loader.reset(new svn_dump_loader(options.svn_dump, svn_path));
+            if (!verify_revs.empty() || snapshot_rev != 0 || jobs > 1 || validate)
+                loader->finish();
+            // A new repository takes the dump's UUID, which names its
+            // index of changes, by the time its first revision is loaded
+            else
+                loader->wait_for(1);
+        }
+
+        if (!verify_revs.empty())
+        {
+            verify_conversion(svn_path, authors_file, ruleset, parse_revisions(verify_revs), jobs);
+            coverage::report();
+            svn_call_stats::report();
+            return exit_success ? EXIT_SUCCESS : Log::result();
+        }
+
+        if (snapshot_rev != 0)
+        {
+            if (snapshot_rev < 1 || snapshot_rev > svn(svn_path, authors_file).latest_revision())
+                throw std::runtime_error("--snapshot-at expects one of the SVN revisions");
+            write_snapshots(svn_path, authors_file, ruleset, snapshot_rev, jobs);
+            coverage::report();
+            svn_call_stats::report();
+            return exit_success ? EXIT_SUCCESS : Log::result();
+        }
+
+        if (jobs > 1 && bench_svn_read_revs.empty())
+        {
+            svn const svn_repo(svn_path, authors_file);
+            int const last = max_rev < 1 ? svn_repo.latest_revision() : max_rev;
+            std::unique_ptr<history_profile> history;
+            if (profile_history)
+                history.reset(new history_profile(svn_repo, ruleset, last, jobs));
+            analyze_in_parallel(svn_path, authors_file, ruleset, 1, last, jobs, history.get());
+            coverage::report();
+            svn_call_stats::report();
+            return exit_success ? EXIT_SUCCESS : Log::result();
+        }
+
         Log::info() << "Opening SVN repository at " << svn_path << std::endl;
         svn svn_repo(svn_path, authors_file);
 
+        // The revisions FIRST[:LAST] of the named option
+        auto const revision_range = [&](std::string const& option, std::string const& revs)
+        {
+            int first = 0, last = 0;
+            char colon = 0;
+            std::istringstream in(revs);
+            bool ok = bool(in >> first);
+            last = first;
+            if (ok && in >> colon)
+                ok = colon == ':' && in >> last && in.eof();
+            if (!ok || first < 1 || first > last || last > svn_repo.latest_revision())
+                throw std::runtime_error("--" + option + " expects FIRST[:LAST] of the SVN revisions, not " + revs);
+            return std::make_pair(first, last);
+        };
+
+        if (!explain_revs.empty())
+        {
+            auto const range = revision_range("explain", explain_revs);
+            explain_revisions(svn_repo, ruleset, range.first, range.second);
+            svn_repo.save_changes();
+            coverage::report();
+            svn_call_stats::report();
+            return exit_success ? EXIT_SUCCESS : Log::result();
+        }
+
+        if (matcher_stats)
+        {
+            report_matcher_stats(
+                svn_repo, ruleset, max_rev < 1 ? svn_repo.latest_revision() : max_rev);
+            svn_repo.save_changes();
+            return exit_success ? EXIT_SUCCESS : Log::result();
+        }
+
+        if (!plan_shards_file.empty())
+        {
+            std::unique_ptr<history_profile> history;
+            if (profile_history)
+            {
+                history.reset(new history_profile(
+                    svn_repo, ruleset, max_rev < 1 ? svn_repo.latest_revision() : max_rev,
+                    std::max(1u, std::thread::hardware_concurrency())));
+            }
+            repository_costs const costs = estimated_costs(history.get());
+            write_shard_plan(plan_shards_file, plan_shards(ruleset, costs), costs);
+            return exit_success ? EXIT_SUCCESS : Log::result();
+        }
+
+        if (!bench_svn_read_revs.empty())
+        {
+            auto const range = revision_range("bench-svn-read", bench_svn_read_revs);
+            bench_svn_read(svn_repo, ruleset, range.first, range.second, jobs);
+            svn_repo.save_changes();
+            svn_call_stats::report();
+            return exit_success ? EXIT_SUCCESS : Log::result();
+        }
+
+        if (validate)
+        {
+            validate_rules(svn_repo, ruleset, max_rev < 1 ? svn_repo.latest_revision() : max_rev);
+            svn_repo.save_changes();
+            coverage::report();
+            svn_call_stats::report();
+            return exit_success ? EXIT_SUCCESS : Log::result();
+        }
+
         if (!gitattributes_path.empty())
         {
             std::ifstream ifs(gitattributes_path);
@@ -149,23 +996,97 @@ int main(int argc, char **argv)
             ifs.read(&options.gitattributes[0], options.gitattributes.size());
         }
 
+        changed_revision_map changed_rules;
+        if (!previous_rules_file.empty())
+        {
+            if (!options.resume)
+                throw std::runtime_error("--previous-rules only applies with --resume-from");
+            Ruleset const previous_rules(previous_rules_file);
+            changed_rules = diff_rules(previous_rules, ruleset);
+            for (auto const& kv : changed_rules)
+            {
+                Log::info() << "rules changed for " << kv.first 
+                            << " from r" << kv.second << std::endl;
+            }
+        }
+
+        std::unique_ptr<history_profile> history;
+        if (profile_history)
+        {
+            history.reset(new history_profile(
+                svn_repo, ruleset, max_rev < 1 ? svn_repo.latest_revision() : max_rev,
+                std::max(1u, std::thread::hardware_concurrency())));
+        }
+
         Log::info() << "preparing repositories and import processes..." << std::endl;
-        importer imp(svn_repo, ruleset);
+        importer imp(svn_repo, ruleset, changed_rules, history.get());
         Log::info() << "done preparing repositories and import processes." << std::endl;
 
-        if (max_rev < 1)
+        if (max_rev < 1 && !loader)
             max_rev = svn_repo.latest_revision();
 
         Log::info() << "Using git executable: " << git_executable() << std::endl;
 
-        for (int i = std::max(resume_from, imp.last_valid_svn_revision()); ++i <= max_rev;)
-            imp.import_revision(i);
+        // Repositories rewound for changed rules go back further
+        int const first_rev = options.segment_start > 0 && !options.resume ? options.segment_start
+            : (previous_rules_file.empty() 
+               ? std::max(resume_from, imp.last_valid_svn_revision()) 
+               : imp.last_valid_svn_revision()) + 1;
+        if (options.prefetch_revisions > 0)
+            svn_repo.prefetch(first_rev, max_rev, options.prefetch_revisions);
+        if (!loader)
+            imp.plan_ahead(first_rev, max_rev);
+        if (options.fsfs_readahead > 0)
+            svn_repo.read_ahead(options.fsfs_readahead, options.fsfs_drop_behind);
+        if (!options.status_file.empty())
+            imp.report_status(first_rev, max_rev);
+
+        if (loader)
+        {
+            // Convert the revisions loaded while the last were converted
+            int const last = max_rev < 1 ? INT_MAX : max_rev;
+            for (int next = first_rev; next <= last;)
+            {
+                int const loaded = std::min(loader->wait_for(next), last);
+                if (loaded < next)
+                    break;
+                for (int i = imp.skip_revisions(next, loaded); i <= loaded;
+                     i = imp.skip_revisions(i + 1, loaded))
+                    imp.import_revision(i);
+                next = loaded + 1;
+            }
+        }
+        else
+        {
+            for (int i = imp.skip_revisions(first_rev, max_rev); i <= max_rev;
+                 i = imp.skip_revisions(i + 1, max_rev))
+                imp.import_revision(i);
+        }
+        if (options.follow_interval > 0)
+            follow_svn(svn_repo, imp, ruleset, std::max(first_rev, max_rev + 1), svn_url);
+        svn_repo.save_changes();
+
+        if (options.prune_branches)
+            imp.prune_branches();
+        if (!options.push_remote.empty())
+            imp.publish();
+        imp.finish();
+        if (!options.commit_index.empty())
+            imp.write_commit_index(options.commit_index);
 
         coverage::report();
+        profile::report();
+        imp.report_fast_import();
+        imp.report_memory();
+        if (options.profile)
+            svn::report_cache();
+        svn_call_stats::report();
     }
     catch (std::exception const& error)
     {
         Log::error() << error.what() << "\n\n";
+        flight_recorder::note("exception", error.what());
+        flight_recorder::dump("an exception");
         return EXIT_FAILURE;
     }
     int result = Log::result();
@@ -4,30 +4,139 @@
 #ifndef MARK_SHA_MAP_DWA2013515_HPP
 # define MARK_SHA_MAP_DWA2013515_HPP
 
+# include "object_id.hpp"
+
 # include <algorithm>
-# include <vector>
+# include <cstddef>
+# include <cstdlib>
+# include <cstring>
+# include <fstream>
+# include <stdexcept>
 # include <string>
+# include <vector>
 
-typedef std::vector<std::pair<unsigned long, std::string> > mark_sha_map;
-
-struct compare_marks
+// The SHA-1s of a repository's marks, in a table indexed by mark.
+// Fast-import numbers marks densely from 1, so the table is hardly
+// larger than the binary SHA-1s it holds, and a lookup is a single
+// index.  An all-zero entry marks an unmapped mark.
+class mark_sha_map
   {
-  bool operator()(mark_sha_map::const_reference lhs, unsigned long rhs) const
+public:
+  static std::size_t const sha_length = object_id::hex_size;
+  static std::size_t const sha_size = object_id::size;
+
+  // Map mark to the 40 hex digits at sha.  Return false if it was
+  // already mapped.
+  bool insert(unsigned long mark, char const* sha)
     {
-    return lhs.first < rhs;
+    if (mark >= size())
+      bytes.resize((mark + 1) * sha_size, 0);
+    unsigned char* const slot = &bytes[mark * sha_size];
+    if (mapped(slot))
+      return false;
+    unsigned char value[sha_size];
+    if (!object_id::decode_hex(sha, value))
+      return false;
+    std::memcpy(slot, value, sha_size);
+    return true;
     }
-  };
 
-inline mark_sha_map::iterator
-find_sha_pos(mark_sha_map& m, unsigned long mark)
-  {
-  return std::lower_bound(m.begin(), m.end(), mark, compare_marks());
-  }
+  // Write the 40 hex digits of mark's SHA-1 to hex, returning false if
+  // it is unmapped
+  bool find(unsigned long mark, char* hex) const
+    {
+    if (mark >= size())
+      return false;
+    unsigned char const* const slot = &bytes[mark * sha_size];
+    if (!mapped(slot))
+      return false;
+    object_id::encode_hex(slot, hex);
+    return true;
+    }
 
-inline mark_sha_map::const_iterator
-find_sha_pos(mark_sha_map const& m, unsigned long mark)
-  {
-  return std::lower_bound(m.begin(), m.end(), mark, compare_marks());
-  }
+  // Add the ":<mark> <sha>" lines of the marks file at path, in one
+  // pass over it read in large blocks
+  void read_marks_file(std::string const& marks_path)
+    {
+    std::ifstream file(marks_path.c_str(), std::ios::binary);
+    if (!file)
+      throw std::runtime_error("Couldn't open marks file: " + marks_path);
+    reserve_for_last_mark(file);
+
+    std::vector<char> buffer(1 << 20);
+    std::size_t held = 0;    // the start of a line, at the front of buffer
+    while (file.read(&buffer[held], buffer.size() - held), file.gcount() > 0)
+      {
+      char const* p = &buffer[0];
+      char const* const end = p + held + file.gcount();
+      while (char const* lf = static_cast<char const*>(std::memchr(p, '\n', end - p)))
+        {
+        read_line(p, lf, marks_path);
+        p = lf + 1;
+        }
+      held = end - p;
+      if (held == buffer.size())
+        malformed(marks_path);
+      std::memmove(&buffer[0], p, held);
+      }
+    if (held != 0)
+      malformed(marks_path);
+    }
+
+  // The heap memory held, for --memory-csv
+  std::size_t bytes_held() const { return bytes.capacity(); }
+
+private:
+  std::size_t size() const { return bytes.size() / sha_size; }
+
+  static bool mapped(unsigned char const* slot)
+    {
+    for (std::size_t i = 0; i < sha_size; ++i)
+      {
+      if (slot[i])
+        return true;
+      }
+    return false;
+    }
+
+  // Marks are written in increasing order, so the last line of the
+  // marks file gives the table's size
+  void reserve_for_last_mark(std::ifstream& file)
+    {
+    std::streamoff const size = file.seekg(0, std::ios::end).tellg();
+    std::streamoff const tail_size = std::min<std::streamoff>(size, 128);
+    std::string tail(std::size_t(tail_size), '\0');
+    file.seekg(size - tail_size).read(&tail[0], tail_size);
+    file.clear();
+    file.seekg(0);
+
+    std::size_t const start = tail.rfind('\n', tail.size() - 2);
+    std::size_t const colon = start == std::string::npos ? 0 : start + 1;
+    if (colon < tail.size() && tail[colon] == ':')
+      bytes.reserve((std::strtoul(tail.c_str() + colon + 1, 0, 10) + 1) * sha_size);
+    }
+
+  // Add the mapping on the line [p, lf)
+  void read_line(char const* p, char const* lf, std::string const& marks_path)
+    {
+    if (*p++ != ':')
+      malformed(marks_path);
+    unsigned long mark = 0;
+    char const* const digits = p;
+    for (; *p >= '0' && *p <= '9'; ++p)
+      mark = mark * 10 + (*p - '0');
+    if (p == digits || *p != ' ' || lf - (p + 1) != std::ptrdiff_t(sha_length))
+      malformed(marks_path);
+    if (!insert(mark, p + 1))
+      throw std::runtime_error("Duplicate or malformed mark mapping in " + marks_path);
+    }
+
+  static void malformed(std::string const& marks_path)
+    {
+    throw std::runtime_error("Malformed marks file: " + marks_path);
+    }
+
+  std::vector<unsigned char> bytes;
+  };
 
 #endif // MARK_SHA_MAP_DWA2013515_HPP
@@ -0,0 +1,151 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// See svn.cpp
+#define SVN_DEPRECATED
+
+#include "matcher_stats.hpp"
+#include "git_address_key.hpp"
+#include "ruleset.hpp"
+#include "svn.hpp"
+#include "path.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace
+{
+    // The most revisions whose changed paths are looked up, and the
+    // most paths
+    int const sample_revisions = 1000;
+    std::size_t const sample_paths = 100000;
+
+    typedef patrie<Rule, coverage>::trie_stats trie_stats;
+
+    // Print counts, of which counts[i] is that of i, in buckets of
+    // powers of two beyond 2
+    void print_histogram(char const* title, std::vector<std::size_t> const& counts)
+    {
+        std::cout << "  " << title << ":";
+        for (std::size_t low = 0; low < counts.size(); low = low < 2 ? low + 1 : low * 2 - 1)
+        {
+            std::size_t const high = std::min(low < 2 ? low : low * 2 - 2, counts.size() - 1);
+            std::size_t n = 0;
+            for (std::size_t i = low; i <= high; ++i)
+                n += counts[i];
+            if (n == 0)
+                continue;
+            std::cout << ' ' << low;
+            if (high > low)
+                std::cout << '-' << high;
+            std::cout << ':' << n;
+        }
+        std::cout << '\n';
+    }
+
+    // Print the stats of a trie and of the lookups of keys in it
+    template <class Keys>
+    void print_trie(
+        char const* name, trie_stats const& s, patrie<Rule, coverage> const& matcher,
+        Keys const& keys, bool git)
+    {
+        std::size_t nodes = 0;
+        for (std::size_t n : s.depths)
+            nodes += n;
+        std::size_t rules = 0;
+        for (std::size_t i = 0; i < s.rule_counts.size(); ++i)
+            rules += i * s.rule_counts[i];
+
+        std::cout << name << " trie: " << nodes << " nodes, holding " << rules << " rules\n";
+        print_histogram("nodes by depth", s.depths);
+        print_histogram("nodes by children", s.fan_outs);
+        print_histogram("nodes by rules", s.rule_counts);
+        std::cout << "  bytes: " << s.node_bytes << " nodes, " << s.label_bytes << " labels, "
+                  << s.rule_vector_bytes << " rule vectors, " << s.flat_bytes << " flattened; "
+                  << s.node_bytes + s.label_bytes + s.rule_vector_bytes + s.flat_bytes
+                  << " in all\n";
+
+        std::size_t entered = 0, deepest = 0;
+        for (auto const& key : keys)
+        {
+            std::size_t const depth = matcher.lookup_depth(key, git);
+            entered += depth;
+            deepest = std::max(deepest, depth);
+        }
+        std::cout << "  lookups of " << keys.size() << " sampled keys enter " << std::fixed
+                  << std::setprecision(2) << (keys.empty() ? 0.0 : double(entered) / keys.size())
+                  << " nodes on average, at most " << deepest << '\n';
+    }
+}
+
+void report_matcher_stats(svn const& svn_repo, Ruleset const& ruleset, int last)
+{
+    auto const& matcher = ruleset.matcher();
+
+    // The paths changed by revisions spread evenly over the history,
+    // each with the revision it was changed in, and the Git
+    // addresses the rules map them to there
+    std::vector<std::pair<std::string, int> > svn_keys;
+    std::vector<std::string> git_keys;
+    std::unordered_set<std::string> seen;
+    std::vector<svn::change> changes;
+    int const step = std::max(1, last / sample_revisions);
+    for (int revnum = step; revnum <= last && svn_keys.size() < sample_paths; revnum += step)
+    {
+        svn_repo.changes(revnum, changes);
+        for (auto const& change : changes)
+        {
+            std::string const svn_path = path(change.path).str();
+            if (svn_keys.size() == sample_paths || !seen.insert(svn_path).second)
+                continue;
+            svn_keys.emplace_back(svn_path, revnum);
+            Rule const* const match = matcher.longest_match(svn_path, revnum);
+            if (!match || match->excludes())
+                continue;
+            git_keys.push_back(
+                git_address_key(
+                    match->git_repo_name(), match->git_ref_name(),
+                    match->git_path(path(svn_path)).str())
+                .str());
+        }
+    }
+    std::vector<std::string> svn_paths;
+    svn_paths.reserve(svn_keys.size());
+    for (auto const& k : svn_keys)
+        svn_paths.push_back(k.first);
+
+    // The time longest_match takes over the sample, as converting
+    // them would look them up
+    auto const start = std::chrono::steady_clock::now();
+    std::size_t matched = 0;
+    for (auto const& k : svn_keys)
+        matched += matcher.longest_match(k.first, k.second) != nullptr;
+    double const lookup_seconds
+        = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::size_t rule_string_bytes = 0;
+    for (auto const& r : matcher.all_rules())
+    {
+        if (r.git_address().capacity() > std::string().capacity())
+            rule_string_bytes += r.git_address().capacity() + 1;
+    }
+
+    std::cout << "Matcher of " << ruleset.rule_count() << " rules, built in " << std::fixed
+              << std::setprecision(3) << ruleset.build_seconds() << "s\n"
+              << "  rules: " << matcher.rule_bytes() << " bytes, and " << rule_string_bytes
+              << " of their Git addresses; transitions: " << matcher.transition_bytes()
+              << " bytes\n";
+    print_trie("SVN", matcher.stats(false), matcher, svn_paths, false);
+    print_trie("Git", matcher.stats(true), matcher, git_keys, true);
+    std::cout << "Longest matches of the " << svn_keys.size() << " sampled paths: " << matched
+              << " found, " << std::setprecision(0)
+              << (svn_keys.empty() ? 0.0 : lookup_seconds * 1e9 / svn_keys.size())
+              << "ns each" << std::endl;
+}
@@ -0,0 +1,22 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef MATCHER_STATS_DWA20131205_HPP
+# define MATCHER_STATS_DWA20131205_HPP
+
+class svn;
+class Ruleset;
+
+// Report to std::cout what the matcher of ruleset is made of and what
+// it costs, so that the effect of refactoring the rules or changing
+// the matcher can be seen: for both the SVN trie and the Git trie,
+// the nodes at each depth, how many have each number of children and
+// of rules, and the bytes of their nodes, labels, vectors of rules
+// and flattened copy; the bytes of the rules and their transitions;
+// the time the tries took to build; and the nodes each lookup enters,
+// over the paths changed by up to a thousand revisions spread over
+// revisions 1 through last, and the Git addresses they map to.  See
+// --matcher-stats.
+void report_matcher_stats(svn const& svn_repo, Ruleset const& ruleset, int last);
+
+#endif // MATCHER_STATS_DWA20131205_HPP
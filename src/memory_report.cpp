@@ -0,0 +1,94 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#include "memory_report.hpp"
+#include "options.hpp"
+
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <dirent.h>
+#include <unistd.h>
+
+memory_report::memory_report(std::string const& csv_path)
+    : csv(csv_path.c_str(), std::ios::trunc)
+{
+    files.bytes = 0;
+    files.revnum = 0;
+    if (!csv)
+        throw std::runtime_error("Couldn't open memory report " + csv_path);
+    csv << "revision,subsystem,bytes,high_water_bytes,high_water_revision\n";
+}
+
+void memory_report::add(int revnum, sample const& bytes)
+{
+    last = bytes;
+    for (auto const& kv : bytes)
+    {
+        for (auto* highs : { &window, &run })
+        {
+            auto p = highs->find(kv.first);
+            if (p == highs->end())
+                highs->emplace(kv.first, high_water{ kv.second, revnum });
+            else if (kv.second > p->second.bytes)
+                p->second = high_water{ kv.second, revnum };
+        }
+    }
+    if (options.profile_interval > 0 && revnum % options.profile_interval == 0)
+        end_window(revnum);
+}
+
+void memory_report::add_open_files(int revnum, std::uint64_t n)
+{
+    if (n > files.bytes)
+        files = high_water{ n, revnum };
+}
+
+void memory_report::end_window(int revnum)
+{
+    for (auto const& kv : window)
+    {
+        auto const p = last.find(kv.first);
+        csv << revnum << ',' << kv.first << ',' << (p == last.end() ? 0 : p->second) << ','
+            << kv.second.bytes << ',' << kv.second.revnum << '\n';
+    }
+    csv.flush();
+    window.clear();
+}
+
+void memory_report::report() const
+{
+    std::cout << "Memory high-water marks (MB; subsystems are estimates):\n";
+    for (auto const& kv : run)
+    {
+        std::cout << std::setw(32) << std::left << kv.first << std::right
+                  << std::setw(12) << (kv.second.bytes >> 20) << "  after r" << kv.second.revnum << '\n';
+    }
+    if (files.bytes > 0)
+        std::cout << "Open files high-water mark: " << files.bytes << "  after r" << files.revnum << '\n';
+    std::cout << std::flush;
+}
+
+std::uint64_t memory_report::resident_bytes(int pid)
+{
+    std::ifstream statm(pid ? "/proc/" + std::to_string(pid) + "/statm" : "/proc/self/statm");
+    std::uint64_t pages = 0, resident = 0;
+    if (!(statm >> pages >> resident))
+        return 0;
+    return resident * ::sysconf(_SC_PAGESIZE);
+}
+
+std::uint64_t memory_report::open_files()
+{
+    DIR* const fds = ::opendir("/proc/self/fd");
+    if (!fds)
+        return 0;
+    std::uint64_t n = 0;
+    while (dirent const* e = ::readdir(fds))
+    {
+        if (e->d_name[0] != '.')
+            ++n;
+    }
+    ::closedir(fds);
+    return n > 0 ? n - 1 : 0;   // not counting fds itself
+}
@@ -0,0 +1,70 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef MEMORY_REPORT_DWA20131116_HPP
+# define MEMORY_REPORT_DWA20131116_HPP
+
+# include <cstdint>
+# include <fstream>
+# include <map>
+# include <string>
+
+// With --memory-csv, where the conversion's memory goes.  The
+// importer samples the bytes held by each of its subsystems every
+// --memory-interval revisions, along with the resident memory of
+// svn2git and of the fast-import processes, and this keeps the
+// high-water mark of each, writing them to the CSV file at the end of
+// every window of --profile-interval revisions.  The subsystems'
+// sizes are estimates from their element counts and capacities; what
+// svn2git holds beyond them, in APR pools, the rules and the heap's
+// own overhead, is reported as "unaccounted".
+class memory_report
+{
+ public:
+    // Bytes, by subsystem
+    typedef std::map<std::string, std::uint64_t> sample;
+
+    explicit memory_report(std::string const& csv_path);
+
+    // Record what each subsystem held after revnum
+    void add(int revnum, sample const& bytes);
+
+    // Record the number of files svn2git had open after revnum, of
+    // which each fast-import's pipes are two
+    void add_open_files(int revnum, std::uint64_t files);
+
+    // Print the high-water mark of each subsystem over the whole run,
+    // and the revision after which it was reached
+    void report() const;
+
+    // The heap memory a string holds beyond its own object, ignoring
+    // the allocator's overhead
+    static std::uint64_t heap_bytes(std::string const& s)
+    {
+        return s.capacity() > 15 ? s.capacity() + 1 : 0;
+    }
+
+    // The resident memory of the process pid, or of svn2git itself if
+    // pid is zero, or zero if it can't be determined
+    static std::uint64_t resident_bytes(int pid = 0);
+
+    // The number of files svn2git has open, or zero if it can't be
+    // determined
+    static std::uint64_t open_files();
+
+ private:
+    struct high_water
+    {
+        std::uint64_t bytes;
+        int revnum;
+    };
+    void end_window(int revnum);
+
+    std::ofstream csv;
+    sample last;                                // the latest sample
+    std::map<std::string, high_water> window;   // since the last window ended
+    std::map<std::string, high_water> run;
+    high_water files;   // of open files over the whole run, counted in bytes
+};
+
+#endif // MEMORY_REPORT_DWA20131116_HPP
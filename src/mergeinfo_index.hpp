@@ -0,0 +1,45 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef MERGEINFO_INDEX_DWA20131125_HPP
+# define MERGEINFO_INDEX_DWA20131125_HPP
+
+# include "revision_index.hpp"
+# include <cstdint>
+# include <string>
+# include <utility>
+
+// How the merges of a revision_index are stored
+template <class Merge>
+struct merge_format
+{
+    static std::uint64_t const format = 0x3230736772656d32ull; // "2mergs02"
+
+    static void write(state_file::writer& w, Merge const& x)
+    {
+        w.str(x.path).str(x.source).word(std::uint64_t(x.revision));
+    }
+
+    static void read(state_file::reader& r, Merge& m)
+    {
+        m.path = r.str();
+        m.source = r.str();
+        m.revision = static_cast<decltype(m.revision)>(r.word());
+    }
+};
+
+// The merges each SVN revision records by adding to the svn:mergeinfo
+// of directories, parsed once and indexed for every later run.
+//
+// Merge is svn::merge, or anything with the same members.
+template <class Merge>
+struct mergeinfo_index : revision_index<Merge, merge_format<Merge> >
+{
+    mergeinfo_index(
+        std::string const& filename, std::string const& uuid,
+        revision_date_function date_of)
+        : revision_index<Merge, merge_format<Merge> >(filename, uuid, std::move(date_of))
+    {}
+};
+
+#endif // MERGEINFO_INDEX_DWA20131125_HPP
@@ -0,0 +1,412 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#include "mock_fast_import.hpp"
+#include "log.hpp"
+#include "options.hpp"
+#include "sha1.hpp"
+#include "tree_model.hpp"
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <unistd.h>
+
+namespace
+{
+    typedef std::chrono::steady_clock clock;
+
+    // Buffered reads of the command stream, at no more than kbps
+    // kilobytes a second unless it's 0
+    struct command_reader
+    {
+        command_reader(int fd, int kbps)
+            : fd(fd), buffer(1 << 16), begin(0), end(0), kbps(kbps), bytes_read(0),
+              start(clock::now())
+        {}
+
+        bool getline(std::string& line)
+        {
+            line.clear();
+            for (;;)
+            {
+                if (begin == end && !fill())
+                    return !line.empty();
+                char const* const start = &buffer[begin];
+                auto const* nl = static_cast<char const*>(std::memchr(start, '\n', end - begin));
+                if (nl)
+                {
+                    line.append(start, nl);
+                    begin += nl - start + 1;
+                    return true;
+                }
+                line.append(start, end - begin);
+                begin = end;
+            }
+        }
+
+        // Pass the next n bytes to f, a piece at a time
+        template <class F>
+        void read(std::size_t n, F const& f)
+        {
+            while (n > 0)
+            {
+                if (begin == end && !fill())
+                    throw std::runtime_error("mock fast-import: the stream ends within data");
+                std::size_t const piece = std::min(n, end - begin);
+                f(&buffer[begin], piece);
+                begin += piece;
+                n -= piece;
+            }
+        }
+
+        // Skip the LF that may end data
+        void skip_newline()
+        {
+            if ((begin < end || fill()) && buffer[begin] == '\n')
+                ++begin;
+        }
+
+     private:
+        bool fill()
+        {
+            for (;;)
+            {
+                ssize_t const n = ::read(fd, &buffer[0], buffer.size());
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n < 0)
+                    throw std::runtime_error(std::string("mock fast-import: ") + std::strerror(errno));
+                begin = 0;
+                end = std::size_t(n);
+                if (kbps > 0 && n > 0)
+                    throttle(std::size_t(n));
+                return n > 0;
+            }
+        }
+
+        // Wait until reading n more bytes keeps within kbps since the
+        // start
+        void throttle(std::size_t n)
+        {
+            bytes_read += n;
+            std::this_thread::sleep_until(
+                start + std::chrono::microseconds(bytes_read * 1000000 / (std::uint64_t(kbps) << 10)));
+        }
+
+        int fd;
+        std::vector<char> buffer;
+        std::size_t begin, end;
+        int kbps;
+        std::uint64_t bytes_read;
+        clock::time_point start;
+    };
+
+    // A path as fast-import accepts it: as is, or quoted as in C
+    std::string unquote(std::string const& p)
+    {
+        if (p.empty() || p[0] != '"')
+            return p;
+        std::string result;
+        for (std::size_t i = 1; i < p.size() && p[i] != '"'; ++i)
+        {
+            if (p[i] != '\\' || i + 1 == p.size())
+            {
+                result += p[i];
+                continue;
+            }
+            char const c = p[++i];
+            if (c >= '0' && c <= '7')
+            {
+                result += char(std::strtoul(p.substr(i, 3).c_str(), nullptr, 8));
+                i += 2;
+            }
+            else
+                result += c == 'n' ? '\n' : c == 't' ? '\t' : c;
+        }
+        return result;
+    }
+
+    class emulator
+    {
+     public:
+        emulator(int in_fd, int out_fd, mock_delays const& delays, unsigned seed)
+            : in(in_fd, delays.kbps), out_fd(out_fd), delays(delays), stalls(seed),
+              current(nullptr), mark(0)
+        {}
+
+        void run()
+        {
+            std::string line;
+            while (in.getline(line))
+            {
+                command(line);
+                flush();
+            }
+        }
+
+     private:
+        void command(std::string const& line)
+        {
+            if (boost::starts_with(line, "M "))
+                modify(line);
+            else if (boost::starts_with(line, "D "))
+                current->remove(unquote(line.substr(2)));
+            else if (line == "deleteall")
+                current->clear();
+            else if (boost::starts_with(line, "data "))
+                skip_data(line);
+            else if (boost::starts_with(line, "mark :"))
+                mark = std::strtoul(line.c_str() + 6, nullptr, 10);
+            else if (boost::starts_with(line, "from "))
+                from(line.substr(5));
+            else if (boost::starts_with(line, "ls "))
+                ls(line.substr(3));
+            else if (boost::starts_with(line, "commit "))
+            {
+                finish_commit();
+                ref_name = line.substr(7);
+                current = &refs[ref_name];
+                if (delays.stalls_per_thousand > 0
+                    && int(stalls() % 1000) < delays.stalls_per_thousand)
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(delays.stall_ms));
+                }
+            }
+            else if (boost::starts_with(line, "reset "))
+            {
+                finish_commit();
+                ref_name = line.substr(6);
+                current = &refs[ref_name];
+                current->clear();
+            }
+            else if (boost::starts_with(line, "get-mark :"))
+            {
+                std::string const name = commit_name(std::strtoul(line.c_str() + 10, nullptr, 10));
+                respond(name);
+            }
+            else if (boost::starts_with(line, "progress "))
+            {
+                finish_commit();
+                respond(line);
+            }
+            else if (line.empty() || line == "checkpoint" || line == "done")
+                finish_commit();
+            // author, committer, merge, N, feature and option change
+            // nothing modeled here
+        }
+
+        // M <mode> <dataref> <path>, where the data of an inline blob
+        // follows
+        void modify(std::string const& line)
+        {
+            std::size_t const mode_end = line.find(' ', 2);
+            std::size_t const ref_end = line.find(' ', mode_end + 1);
+            unsigned long const mode = std::strtoul(line.c_str() + 2, nullptr, 8);
+            std::string const dataref = line.substr(mode_end + 1, ref_end - mode_end - 1);
+            std::string const p = unquote(line.substr(ref_end + 1));
+
+            if (dataref == "inline")
+            {
+                std::string header;
+                in.getline(header);
+                std::size_t const size = std::strtoull(header.c_str() + 5, nullptr, 10);
+                git_blob_hasher h(size);
+                in.read(size, [&h](char const* data, std::size_t n) { h.update(data, n); });
+                in.skip_newline();
+                current->set(p, mode, h.digest());
+                return;
+            }
+            if (mode == 040000)
+            {
+                auto const t = trees.find(dataref);
+                if (t != trees.end())
+                {
+                    current->set(p, t->second);
+                    return;
+                }
+            }
+            current->set(p, mode, sha1::from_hex(dataref.c_str()));
+        }
+
+        void skip_data(std::string const& header)
+        {
+            in.read(std::strtoull(header.c_str() + 5, nullptr, 10), [](char const*, std::size_t) {});
+            in.skip_newline();
+        }
+
+        void from(std::string const& committish)
+        {
+            if (committish[0] == ':')
+            {
+                auto const m = marks.find(std::strtoul(committish.c_str() + 1, nullptr, 10));
+                if (m != marks.end())
+                    *current = m->second;
+            }
+            else if (committish.find_first_not_of('0') == std::string::npos)
+            {
+                refs.erase(ref_name);
+                current = nullptr;
+            }
+        }
+
+        // ls [<dataref> ]<path>, where without a dataref the path is
+        // in the commit being written
+        void ls(std::string const& args)
+        {
+            tree_model const* tree = current;
+            std::string p = args;
+            if (args[0] == ':')
+            {
+                std::size_t const space = args.find(' ');
+                std::size_t const m = std::strtoul(args.c_str() + 1, nullptr, 10);
+                auto const found = marks.find(m);
+                tree = m == mark && current ? current : found == marks.end() ? nullptr : &found->second;
+                p = args.substr(space + 1);
+            }
+            p = unquote(p);
+
+            std::unique_ptr<tree_model::object> const o = tree ? tree->find(p) : nullptr;
+            if (!o)
+            {
+                respond("missing " + p);
+                return;
+            }
+            std::string const object = o->str();
+            std::string const name = object.substr(object.find(' ') + 1);
+            if (o->subtree)
+                trees.emplace(name, *o);
+            char const* const type = o->mode == 040000 ? "tree" : o->mode == 0160000 ? "commit" : "blob";
+            respond(object.substr(0, object.find(' ')) + " " + type + " " + name + "\t" + p);
+        }
+
+        void finish_commit()
+        {
+            if (current && mark)
+                marks[mark] = *current;
+            mark = 0;
+        }
+
+        // The made-up name of the marked commit
+        static std::string commit_name(std::size_t m)
+        {
+            std::string const s = "mock commit :" + std::to_string(m);
+            return git_object_hasher("commit", s.size()).update(s).hex_digest();
+        }
+
+        void respond(std::string const& line)
+        {
+            responses += line;
+            responses += '\n';
+        }
+
+        void flush()
+        {
+            if (!responses.empty() && delays.response_ms > 0)
+                std::this_thread::sleep_for(std::chrono::milliseconds(delays.response_ms));
+            for (std::size_t written = 0; written < responses.size();)
+            {
+                ssize_t const n = ::write(out_fd, responses.data() + written, responses.size() - written);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n < 0)
+                    throw std::runtime_error(std::string("mock fast-import: ") + std::strerror(errno));
+                written += std::size_t(n);
+            }
+            responses.clear();
+        }
+
+        command_reader in;
+        int out_fd;
+        std::string responses;  // not yet written
+        mock_delays const delays;
+        std::minstd_rand stalls;
+
+        std::unordered_map<std::string, tree_model> refs;
+        std::unordered_map<std::size_t, tree_model> marks;
+        std::unordered_map<std::string, tree_model::object> trees; // listed, by SHA-1
+        std::string ref_name;
+        tree_model* current;    // the tree of ref_name
+        std::size_t mark;       // of the commit being written, or 0
+    };
+}
+
+std::string mock_delays::parse(std::string const& spec, mock_delays& d)
+{
+    std::size_t const equals = spec.find('=');
+    std::string const repository = equals == std::string::npos ? std::string() : spec.substr(0, equals);
+    std::vector<int> fields;
+    bool numbers = true;
+    for (std::size_t start = equals == std::string::npos ? 0 : equals + 1, end;
+         numbers && start <= spec.size(); start = end + 1)
+    {
+        end = std::min(spec.find(',', start), spec.size());
+        std::string const field = spec.substr(start, end - start);
+        numbers = !field.empty() && field.size() <= 9
+            && field.find_first_not_of("0123456789") == std::string::npos;
+        fields.push_back(std::atoi(field.c_str()));
+    }
+    if (!numbers || (equals != std::string::npos && repository.empty())
+        || (fields.size() != 1 && fields.size() != 2 && fields.size() != 4)
+        || (fields.size() == 4 && fields[2] > 1000))
+    {
+        throw std::runtime_error(
+            "--mock-latency expects [REPOSITORY=]MILLISECONDS[,KBPS[,STALLS,STALL_MILLISECONDS]], "
+            "with at most 1000 STALLS, not " + spec);
+    }
+    d = mock_delays();
+    d.response_ms = fields[0];
+    if (fields.size() > 1)
+        d.kbps = fields[1];
+    if (fields.size() > 3)
+    {
+        d.stalls_per_thousand = fields[2];
+        d.stall_ms = fields[3];
+    }
+    return repository;
+}
+
+// Those given for the repository itself win over those given for all
+mock_delays mock_delays::of(std::string const& git_dir)
+{
+    mock_delays result;
+    for (auto const& spec : options.mock_latency)
+    {
+        mock_delays d;
+        std::string const repository = parse(spec, d);
+        if (repository == git_dir)
+            return d;
+        if (repository.empty())
+            result = d;
+    }
+    return result;
+}
+
+void mock_fast_import(int in_fd, int out_fd, std::string const& git_dir)
+{
+    // FNV-1a, the same from run to run
+    unsigned seed = 2166136261u;
+    for (char c : git_dir)
+        seed = (seed ^ (unsigned char)c) * 16777619u;
+    try
+    {
+        emulator(in_fd, out_fd, mock_delays::of(git_dir), seed).run();
+    }
+    catch (std::exception const& e)
+    {
+        Log::error() << e.what() << std::endl;
+    }
+    ::close(in_fd);
+    ::close(out_fd);
+}
@@ -0,0 +1,52 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef MOCK_FAST_IMPORT_DWA20131125_HPP
+# define MOCK_FAST_IMPORT_DWA20131125_HPP
+
+# include <string>
+
+// Stands in for git fast-import with --mock-fast-import, so that the
+// importer can be profiled and benchmarked without the work of a
+// hundred child processes in the way.  It runs on a thread of its
+// own, at the other ends of the same pipes a fast-import would have,
+// so everything svn2git does to write commands and await responses
+// is done just as in a real run.
+//
+// Nothing is written to the repository.  The tree of each ref and of
+// each marked commit is kept as a tree_model, in which blobs have the
+// names Git would give them and trees are hashed only when asked for,
+// so the responses to "ls" are those fast-import would give.  A tree
+// copied by name that was never listed is kept whole without knowing
+// its contents.  The commits' names are made up from their marks, so
+// "get-mark" is answered too.
+//
+// With --mock-latency, it stands in for a slow fast-import instead:
+// one that is late to answer, reads its commands no faster than a
+// given rate, so that the pipe fills behind it, and now and then
+// stalls after a commit.  The stalls are drawn from a generator
+// seeded with the repository's name, so that a run can be repeated.
+struct mock_delays
+{
+    mock_delays() : response_ms(0), kbps(0), stalls_per_thousand(0), stall_ms(0) {}
+
+    int response_ms;            // before each response is written
+    int kbps;                   // the most read a second, or 0
+    int stalls_per_thousand;    // of the commits followed by a stall
+    int stall_ms;               // the length of each stall
+
+    // Parse an argument of --mock-latency, of the form
+    // [REPOSITORY=]MILLISECONDS[,KBPS[,STALLS,STALL_MILLISECONDS]],
+    // into d, returning the repository it names, or the empty string
+    // if it names none and so applies to every repository.
+    static std::string parse(std::string const& spec, mock_delays& d);
+
+    // The delays --mock-latency gives the repository of git_dir
+    static mock_delays of(std::string const& git_dir);
+};
+
+// Reads commands for the repository of git_dir from in_fd until it
+// ends, answering on out_fd, then closes both.
+void mock_fast_import(int in_fd, int out_fd, std::string const& git_dir);
+
+#endif // MOCK_FAST_IMPORT_DWA20131125_HPP
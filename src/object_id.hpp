@@ -0,0 +1,170 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef OBJECT_ID_DWA20131126_HPP
+# define OBJECT_ID_DWA20131126_HPP
+
+# include <array>
+# include <cstddef>
+# include <cstdint>
+# include <cstring>
+# include <functional>
+# include <string>
+
+# if defined(__SSSE3__)
+#  include <tmmintrin.h>
+# endif
+
+// The name of a Git object: a SHA-1 held as its 20 bytes rather than
+// as 40 hex digits on the heap, so that it is a fifth of the size of
+// a std::string holding them, and compared and hashed as a few words.
+// The all-zero name, which Git never gives an object, stands for none.
+//
+// The hex codec below is what everything converting between the two
+// forms uses.  Where the compiler targets SSSE3 (e.g. -march=native;
+// see SVN2GIT_NATIVE_ARCH) it converts 16 bytes at a time.
+struct object_id
+{
+    static std::size_t const size = 20;
+    static std::size_t const hex_size = 40;
+    typedef std::array<unsigned char, size> bytes_type;
+
+    object_id() : bytes() {}
+    explicit object_id(bytes_type const& b) : bytes(b) {}
+
+    // The id named by the 40 hex digits at hex, in either case, or
+    // the null id if they aren't
+    static object_id from_hex(char const* hex)
+    {
+        object_id id;
+        if (!decode_hex(hex, id.bytes.data()))
+            id.bytes.fill(0);
+        return id;
+    }
+    static object_id from_hex(std::string const& hex)
+    {
+        return hex.size() == hex_size ? from_hex(hex.data()) : object_id();
+    }
+
+    std::string hex() const
+    {
+        std::string result(hex_size, '0');
+        encode_hex(bytes.data(), &result[0]);
+        return result;
+    }
+
+    bool is_null() const
+    {
+        return *this == object_id();
+    }
+
+    unsigned char const* data() const { return bytes.data(); }
+
+    friend bool operator==(object_id const& x, object_id const& y)
+    {
+        return std::memcmp(x.bytes.data(), y.bytes.data(), size) == 0;
+    }
+    friend bool operator!=(object_id const& x, object_id const& y)
+    {
+        return !(x == y);
+    }
+    friend bool operator<(object_id const& x, object_id const& y)
+    {
+        return std::memcmp(x.bytes.data(), y.bytes.data(), size) < 0;
+    }
+
+    // Write the 40 lowercase hex digits of the 20 bytes at id to hex
+    static void encode_hex(unsigned char const* id, char* hex)
+    {
+        static char const digits[] = "0123456789abcdef";
+        std::size_t i = 0;
+# if defined(__SSSE3__)
+        __m128i const table = _mm_loadu_si128(reinterpret_cast<__m128i const*>(digits));
+        __m128i const low_nibble = _mm_set1_epi8(0x0F);
+        __m128i const v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(id));
+        __m128i const high = _mm_shuffle_epi8(table, _mm_and_si128(_mm_srli_epi16(v, 4), low_nibble));
+        __m128i const low = _mm_shuffle_epi8(table, _mm_and_si128(v, low_nibble));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(hex), _mm_unpacklo_epi8(high, low));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(hex + 16), _mm_unpackhi_epi8(high, low));
+        i = 16;
+# endif
+        for (; i < size; ++i)
+        {
+            hex[2 * i] = digits[id[i] >> 4];
+            hex[2 * i + 1] = digits[id[i] & 0xF];
+        }
+    }
+
+    // Write the 20 bytes named by the 40 hex digits at hex, in either
+    // case, to id, returning false if they aren't all hex digits
+    static bool decode_hex(char const* hex, unsigned char* id)
+    {
+        std::size_t i = 0;
+        bool valid = true;
+# if defined(__SSSE3__)
+        for (; i < 16; i += 8)
+        {
+            __m128i const c = _mm_loadu_si128(reinterpret_cast<__m128i const*>(hex + 2 * i));
+            // Digits are '0'-'9'; letters, folded to lowercase, 'a'-'f'
+            __m128i const lower = _mm_or_si128(c, _mm_set1_epi8(0x20));
+            __m128i const digit = _mm_and_si128(
+                _mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(c, _mm_set1_epi8('9' + 1)));
+            __m128i const letter = _mm_and_si128(
+                _mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+            valid &= _mm_movemask_epi8(_mm_or_si128(digit, letter)) == 0xFFFF;
+            // A letter's low nibble is one more than 9 less its value
+            __m128i const nibbles = _mm_add_epi8(
+                _mm_and_si128(c, _mm_set1_epi8(0x0F)), _mm_and_si128(letter, _mm_set1_epi8(9)));
+            // Each pair of nibbles, high first, into a byte
+            __m128i const pairs = _mm_maddubs_epi16(nibbles, _mm_set1_epi16(0x0110));
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(id + i), _mm_packus_epi16(pairs, pairs));
+        }
+# endif
+        for (; i < size; ++i)
+        {
+            int const high = hex_value(hex[2 * i]), low = hex_value(hex[2 * i + 1]);
+            valid &= (high | low) >= 0;
+            id[i] = static_cast<unsigned char>((high & 0xF) << 4 | (low & 0xF));
+        }
+        return valid;
+    }
+
+ private:
+    // A table lookup, since branching on random hex digits mispredicts
+    static int hex_value(char c)
+    {
+        struct table
+        {
+            table()
+            {
+                std::memset(values, -1, sizeof(values));
+                for (int i = 0; i < 10; ++i)
+                    values['0' + i] = static_cast<signed char>(i);
+                for (int i = 0; i < 6; ++i)
+                    values['a' + i] = values['A' + i] = static_cast<signed char>(10 + i);
+            }
+            signed char values[256];
+        };
+        static table const t;
+        return t.values[static_cast<unsigned char>(c)];
+    }
+
+    bytes_type bytes;
+};
+
+namespace std
+{
+    template <>
+    struct hash<object_id>
+    {
+        // The bytes of a SHA-1 are already uniformly distributed
+        std::size_t operator()(object_id const& id) const
+        {
+            std::size_t h;
+            std::memcpy(&h, id.data(), sizeof(h));
+            return h;
+        }
+    };
+}
+
+#endif // OBJECT_ID_DWA20131126_HPP
@@ -0,0 +1,119 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#include "object_store.hpp"
+#include "log.hpp"
+
+#include <boost/filesystem.hpp>
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <set>
+
+namespace
+{
+    std::uint32_t get32(unsigned char const* p)
+    {
+        return std::uint32_t(p[0]) << 24 | std::uint32_t(p[1]) << 16
+            | std::uint32_t(p[2]) << 8 | p[3];
+    }
+
+    // The stores opened so far, by the absolute path of their
+    // directory, so that repositories sharing objects through their
+    // alternates map each index once
+    std::mutex opened_mutex;
+    std::map<std::string, std::shared_ptr<object_store const> > opened;
+}
+
+object_store::object_store(std::string const& dir)
+    : dir(dir)
+{
+    namespace fs = boost::filesystem;
+    boost::system::error_code ec;
+    for (fs::directory_iterator i(fs::path(dir) / "pack", ec), end; !ec && i != end; i.increment(ec))
+    {
+        if (i->path().extension() != ".idx")
+            continue;
+        try
+        {
+            std::unique_ptr<pack_index> p(new pack_index);
+            p->file.open(i->path().string());
+            unsigned char const* data = reinterpret_cast<unsigned char const*>(p->file.data());
+            std::size_t const header = 8 + 256 * 4;
+            if (p->file.size() < header || std::memcmp(data, "\377tOc", 4) != 0 || get32(data + 4) != 2)
+                continue;
+            p->fanout = data + 8;
+            p->count = get32(p->fanout + 255 * 4);
+            p->names = data + header;
+            if (p->file.size() < header + std::size_t(p->count) * object_id::size)
+                continue;
+            packs.push_back(std::move(p));
+        }
+        catch (std::exception const& e)
+        {
+            Log::warn() << "Couldn't read " << i->path().string() << ": " << e.what() << std::endl;
+        }
+    }
+}
+
+bool object_store::contains(object_id const& id) const
+{
+    unsigned char const* const name = id.data();
+    for (auto const& p : packs)
+    {
+        std::uint32_t lo = name[0] == 0 ? 0 : get32(p->fanout + (name[0] - 1) * 4);
+        std::uint32_t hi = get32(p->fanout + name[0] * 4);
+        while (lo < hi)
+        {
+            std::uint32_t const mid = lo + (hi - lo) / 2;
+            int const c = std::memcmp(p->names + std::size_t(mid) * object_id::size, name, object_id::size);
+            if (c == 0)
+                return true;
+            if (c < 0)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+    }
+    std::string const hex = id.hex();
+    boost::system::error_code ec;
+    return boost::filesystem::exists(
+        boost::filesystem::path(dir) / hex.substr(0, 2) / hex.substr(2), ec);
+}
+
+std::vector<std::shared_ptr<object_store const> > object_store::with_alternates(
+    std::string const& dir)
+{
+    namespace fs = boost::filesystem;
+    std::vector<std::shared_ptr<object_store const> > result;
+    std::set<std::string> seen;
+    std::vector<fs::path> pending(1, fs::absolute(dir));
+    while (!pending.empty())
+    {
+        boost::system::error_code ec;
+        fs::path d = fs::canonical(pending.back(), ec);
+        if (ec)
+            d = pending.back();
+        pending.pop_back();
+        if (!seen.insert(d.string()).second)
+            continue;
+        {
+            std::lock_guard<std::mutex> lock(opened_mutex);
+            auto& store = opened[d.string()];
+            if (!store)
+                store = std::make_shared<object_store>(d.string());
+            result.push_back(store);
+        }
+        // Relative alternates are relative to the object directory
+        std::ifstream in((d / "info" / "alternates").string().c_str());
+        for (std::string line; std::getline(in, line);)
+        {
+            if (!line.empty() && line[0] != '#')
+                pending.push_back(fs::absolute(line, d));
+        }
+    }
+    return result;
+}
@@ -0,0 +1,47 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef OBJECT_STORE_DWA20131201_HPP
+# define OBJECT_STORE_DWA20131201_HPP
+
+# include "object_id.hpp"
+
+# include <boost/iostreams/device/mapped_file.hpp>
+# include <cstdint>
+# include <memory>
+# include <string>
+# include <vector>
+
+// The objects a Git object directory held when it was opened: those
+// in the packs whose version 2 indexes were there then, looked up in
+// place from memory mappings of the indexes, and loose ones, which
+// are looked for on demand.  Packs written since are not seen, so
+// whatever is found was complete before this process wrote anything.
+class object_store
+{
+ public:
+    // The stores of the object directory dir and of every directory
+    // its info/alternates lead to, each opened only once however many
+    // object directories lead to it
+    static std::vector<std::shared_ptr<object_store const> > with_alternates(
+        std::string const& dir);
+
+    explicit object_store(std::string const& dir);
+
+    // True iff the object named id is stored here
+    bool contains(object_id const& id) const;
+
+ private:
+    struct pack_index
+    {
+        boost::iostreams::mapped_file_source file;
+        std::uint32_t count;
+        unsigned char const* fanout; // 256 big-endian 32-bit counts
+        unsigned char const* names;  // count sorted 20-byte names
+    };
+
+    std::string dir;
+    std::vector<std::unique_ptr<pack_index> > packs;
+};
+
+#endif // OBJECT_STORE_DWA20131201_HPP
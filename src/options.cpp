@@ -0,0 +1,8 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#include "options.hpp"
+
+// Set by svn2git's command line, or by the program embedding
+// libsvn2git before it uses the library
+Options options;
@@ -19,19 +19,106 @@
 #define OPTIONS_HPP
 
 #include <string>
+#include <vector>
 
 struct Options
   {
   bool add_metadata;
   bool add_metadata_notes;
+  int notes_interval;
   bool dry_run;
   bool debug_rules;
   bool coverage;
   int commit_interval;
   bool svn_branches;
+  bool copy_trees;
+  bool lightweight_tags;
+  int reader_threads;
+  bool preemit_blobs;
+  int read_ahead;
+  int walk_threads;
+  int pack_threads;
+  int write_threads;
+  bool svn_deltas;
+  bool normalize_text;
+  int lfs_threshold;
+  std::string lfs_pattern;
+  std::string lfs_store;
+  bool replay_changes;
+  bool svn_mergeinfo;
+  std::string traversal_order;
+  int prefetch_revisions;
+  int plan_ahead;
+  bool keep_plans;
+  bool blob_cache;
+  bool pipeline_commits;
+  bool reduce_merges;
+  std::string flight_recorder;
+  int fsfs_readahead;
+  int fsfs_drop_behind;
+  int svn_cache_megabytes;
+  int svn_file_handles;
+  bool svn_cache_fulltexts;
+  bool svn_cache_deltas;
+  bool svn_call_stats;
+  int svn_latency;
+  int idle_revisions;
+  int checkpoint_megabytes;
+  int fast_import_rss;
+  int memory_budget;
+  int fast_import_queue;
+  int max_lag;
+  std::vector<std::string> fast_import_hosts;
+  std::vector<std::string> fast_import_workers;
+  std::vector<std::string> ref_writers;
+  int active_branches;
+  bool fast_import_stats;
+  bool mock_fast_import;
+  std::vector<std::string> mock_latency;
+  bool io_uring;
+  int repack_cpus;
+  bool serve_packs;
+  int serve_window_memory;
+  bool pack_refs;
+  bool fast_ingest;
+  int shards;
+  int shard;
+  std::string shard_plan;
+  std::string shard_costs;
+  int segment_start;
+  int follow_interval;
+  std::string push_remote;
+  int push_jobs;
+  int push_kbps;
+  bool local_tree_check;
+  bool tree_model;
+  bool resolve_gitlinks;
+  int coalesce_submodule_revisions;
+  int coalesce_submodule_seconds;
+  bool prune_branches;
+  bool resume;
+  bool profile;
+  int profile_interval;
+  std::string profile_csv;
+  std::string memory_csv;
+  int memory_interval;
+  std::string trace_file;
+  std::string slow_revisions;
+  int slow_revision_seconds;
+  std::string capture_streams;
+  std::string spool;
+  int trace_min_file_size;
+  std::string status_file;
+  std::string commit_index;
+  int status_interval;
   std::string rules_file;
+  std::string only_repo;
+  bool only_repo_gitlinks;
   std::string git_executable;
   std::string gitattributes;
+  std::string shared_objects;
+  std::string svn_mirror;
+  std::string svn_dump;
   };
 
 extern Options options;
@@ -0,0 +1,546 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "pack_writer.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <unordered_set>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace
+{
+    // Contents of blobs waiting to be written to a pack are held in
+    // memory up to this limit, past which add_blob waits on them.
+    std::size_t const max_in_flight = 64 << 20;
+
+    // Longer chains of deltas make the blobs at their ends slow to
+    // read; git pack-objects has the same default limit.
+    unsigned const max_delta_depth = 50;
+
+    // Each pack finished is merged, with the others of its size, into
+    // one this many times as large, so that a pack finished for every
+    // commit leaves a number of packs that grows only logarithmically
+    std::size_t const merge_width = 16;
+
+    std::size_t const blob_type = 3;
+    std::size_t const ref_delta_type = 7;
+
+    std::runtime_error system_error(std::string const& what, std::string const& file)
+    {
+        return std::runtime_error(what + " " + file + ": " + std::strerror(errno));
+    }
+
+    void put32(std::string& s, std::uint32_t n)
+    {
+        for (int shift = 24; shift >= 0; shift -= 8)
+            s += char(n >> shift);
+    }
+
+    void put64(std::string& s, std::uint64_t n)
+    {
+        put32(s, std::uint32_t(n >> 32));
+        put32(s, std::uint32_t(n));
+    }
+
+    sha1::digest_type from_hex(std::string const& hex)
+    {
+        auto nibble = [](char c) { return c <= '9' ? c - '0' : c - 'a' + 10; };
+        sha1::digest_type result;
+        for (std::size_t i = 0; i < result.size(); ++i)
+            result[i] = (unsigned char)(nibble(hex[2 * i]) << 4 | nibble(hex[2 * i + 1]));
+        return result;
+    }
+
+    // Compresses one object into a pack entry
+    struct deflate_task
+    {
+        deflate_task(std::size_t type, std::string base, std::string data, int level)
+            : type(type), base(std::move(base)), data(std::move(data)), level(level) {}
+
+        std::string operator()() const
+        {
+            // The header gives the type, then the size in 7-bit
+            // groups, least significant first, after 4 bits of it.
+            // A delta's base follows.
+            std::string result;
+            std::size_t size = data.size();
+            unsigned char c = (unsigned char)(type << 4 | (size & 15));
+            for (size >>= 4; size != 0; size >>= 7)
+            {
+                result += char(c | 0x80);
+                c = (unsigned char)(size & 0x7f);
+            }
+            result += char(c);
+            result += base;
+
+            std::size_t const header = result.size();
+            uLongf length = compressBound(data.size());
+            result.resize(header + length);
+            int const status = compress2(
+                reinterpret_cast<Bytef*>(&result[header]), &length,
+                reinterpret_cast<Bytef const*>(data.data()), data.size(), level);
+            if (status != Z_OK)
+                throw std::runtime_error("zlib compression failed");
+            result.resize(header + length);
+            return result;
+        }
+
+        std::size_t type;
+        std::string base;
+        std::string data;
+        int level;
+    };
+}
+
+deflate_pool::deflate_pool(unsigned nthreads, int level)
+    : stopping(false), level(level)
+{
+    for (unsigned i = 0; i < std::max(1u, nthreads); ++i)
+        threads.emplace_back(&deflate_pool::work, this);
+}
+
+deflate_pool::~deflate_pool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work_ready.notify_all();
+    for (auto& t : threads)
+        t.join();
+}
+
+template <class Task>
+std::future<std::string> deflate_pool::submit(Task task_function)
+{
+    std::packaged_task<std::string()> task(std::move(task_function));
+    std::future<std::string> result = task.get_future();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push_back(std::move(task));
+    }
+    work_ready.notify_one();
+    return result;
+}
+
+std::future<std::string> deflate_pool::deflate_blob(std::string contents)
+{
+    return submit(deflate_task(blob_type, std::string(), std::move(contents), level));
+}
+
+std::future<std::string> deflate_pool::deflate_delta(
+    sha1::digest_type const& base, std::string delta)
+{
+    return submit(
+        deflate_task(
+            ref_delta_type, std::string(base.begin(), base.end()), std::move(delta), level));
+}
+
+void deflate_pool::work()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;)
+    {
+        work_ready.wait(lock, [this]{ return stopping || !queue.empty(); });
+        if (stopping)
+            return;
+        std::packaged_task<std::string()> task = std::move(queue.front());
+        queue.pop_front();
+        lock.unlock();
+        task();                 // exceptions go to the future
+        lock.lock();
+    }
+}
+
+pack_writer::pack_writer(std::string const& git_dir, deflate_pool& deflater)
+    : pack_dir(git_dir + "/objects/pack"),
+      deflater(deflater),
+      fd(-1),
+      offset(0),
+      in_flight(0)
+{
+}
+
+pack_writer::~pack_writer()
+{
+    discard();
+}
+
+// Give up on the pack being written, if any
+void pack_writer::discard()
+{
+    for (auto& q : queue)
+    {
+        if (q.entry.valid())
+            q.entry.wait();
+    }
+    queue.clear();
+    objects.clear();
+    depths.clear();
+    in_flight = 0;
+    if (fd >= 0)
+    {
+        ::close(fd);
+        fd = -1;
+        std::remove(tmp_path.c_str());
+    }
+}
+
+void pack_writer::open()
+{
+    std::string path = pack_dir + "/tmp_pack_XXXXXX";
+    fd = ::mkstemp(&path[0]);
+    if (fd < 0)
+        throw system_error("creating", path);
+    tmp_path = std::move(path);
+
+    // The object count is filled in by finish()
+    std::string header("PACK");
+    put32(header, 2);
+    put32(header, 0);
+    offset = 0;
+    write_all(header.data(), header.size());
+}
+
+void pack_writer::add_blob(std::string const& sha, std::string contents)
+{
+    if (!depths.emplace(sha, 0).second)
+        return;
+    std::size_t const size = contents.size();
+    enqueue(sha, size, deflater.deflate_blob(std::move(contents)));
+}
+
+bool pack_writer::accepts_delta_base(std::string const& sha) const
+{
+    auto p = depths.find(sha);
+    return p != depths.end() && p->second < max_delta_depth;
+}
+
+void pack_writer::add_delta(
+    std::string const& sha, std::string const& base_sha, std::string delta)
+{
+    assert(accepts_delta_base(base_sha));
+    if (!depths.emplace(sha, depths[base_sha] + 1).second)
+        return;
+    std::size_t const size = delta.size();
+    enqueue(sha, size, deflater.deflate_delta(from_hex(base_sha), std::move(delta)));
+}
+
+void pack_writer::enqueue(
+    std::string const& sha, std::size_t size, std::future<std::string> entry)
+{
+    if (fd < 0)
+        open();
+
+    queued q;
+    q.name = from_hex(sha);
+    q.size = size;
+    q.entry = std::move(entry);
+    in_flight += size;
+    queue.push_back(std::move(q));
+    write_entries(max_in_flight);
+}
+
+// Write the entries at the front of the queue that are ready, and
+// wait for more until no more than budget bytes of contents remain
+void pack_writer::write_entries(std::size_t budget)
+{
+    while (!queue.empty())
+    {
+        queued& q = queue.front();
+        if (in_flight <= budget
+            && q.entry.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        {
+            return;
+        }
+        std::string const entry = q.entry.get();
+
+        written w;
+        w.name = q.name;
+        w.crc = crc32(0, reinterpret_cast<Bytef const*>(entry.data()), entry.size());
+        w.offset = offset;
+        write_all(entry.data(), entry.size());
+        objects.push_back(w);
+        in_flight -= q.size;
+        queue.pop_front();
+    }
+}
+
+void pack_writer::write_all(char const* data, std::size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t const n = ::write(fd, data, size);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            throw system_error("writing", tmp_path);
+        }
+        data += n;
+        size -= n;
+        offset += n;
+    }
+}
+
+void pack_writer::finish()
+{
+    if (fd < 0)
+        return;
+    std::string base;
+    try
+    {
+        write_entries(0);
+        base = seal();
+    }
+    catch(...)
+    {
+        discard();
+        throw;
+    }
+    objects.clear();
+    depths.clear();
+
+    // Merge each merge_width packs of a level into one of the next
+    unmerged.emplace_back(std::move(base), 0);
+    for (;;)
+    {
+        unsigned const level = unmerged.back().second;
+        std::size_t first = unmerged.size();
+        while (first > 0 && unmerged[first - 1].second == level)
+            --first;
+        if (unmerged.size() - first < merge_width)
+            return;
+        merge(first);
+    }
+}
+
+// Fill in the count of the pack being written, then checksum the
+// whole file, as git fast-import does, and put it and its index in
+// place.  Returns its path, without the extension.
+std::string pack_writer::seal()
+{
+    std::string count;
+    put32(count, std::uint32_t(objects.size()));
+    if (::pwrite(fd, count.data(), count.size(), 8) != ssize_t(count.size()))
+        throw system_error("writing", tmp_path);
+
+    sha1 checksum;
+    std::vector<char> buffer(1 << 20);
+    for (std::uint64_t pos = 0; pos < offset;)
+    {
+        ssize_t const n = ::pread(fd, &buffer[0], buffer.size(), pos);
+        if (n <= 0)
+        {
+            if (n < 0 && errno == EINTR)
+                continue;
+            throw system_error("reading", tmp_path);
+        }
+        checksum.update(&buffer[0], n);
+        pos += n;
+    }
+    sha1::digest_type const pack_checksum = checksum.digest();
+    write_all(reinterpret_cast<char const*>(pack_checksum.data()), pack_checksum.size());
+    if (::fchmod(fd, 0444) != 0)
+        throw system_error("changing the mode of", tmp_path);
+    if (::close(fd) != 0)
+    {
+        fd = -1;
+        throw system_error("closing", tmp_path);
+    }
+    fd = -1;
+
+    // Git looks for packs by their indexes, so the pack must be in
+    // place before its index
+    std::string const base = pack_dir + "/pack-" + sha1::to_hex(pack_checksum);
+    if (std::rename(tmp_path.c_str(), (base + ".pack").c_str()) != 0)
+        throw system_error("renaming", tmp_path);
+    write_index(base + ".idx", pack_checksum);
+    return base;
+}
+
+// Copy the entries of the packs from unmerged[first] on into one,
+// leaving out any object already copied, and replace them with it.
+// Their deltas all refer to their bases by name, so the copies stay
+// valid wherever they land.  The merged pack is in place before the
+// others go, so a fast-import that misses an object in one of them
+// finds it there when it looks again.
+void pack_writer::merge(std::size_t first)
+{
+    assert(fd < 0 && objects.empty());
+    unsigned const level = unmerged.back().second + 1;
+    std::string base;
+    try
+    {
+        open();
+        std::unordered_set<std::string> names;
+        std::vector<char> buffer(1 << 20);
+        for (std::size_t i = first; i < unmerged.size(); ++i)
+        {
+            std::vector<written> entries = read_index(unmerged[i].first + ".idx");
+            std::sort(entries.begin(), entries.end(),
+                      [](written const& x, written const& y) { return x.offset < y.offset; });
+            std::string const file = unmerged[i].first + ".pack";
+            int const in = ::open(file.c_str(), O_RDONLY);
+            if (in < 0)
+                throw system_error("opening", file);
+            struct stat st;
+            if (::fstat(in, &st) != 0)
+            {
+                ::close(in);
+                throw system_error("examining", file);
+            }
+
+            // Each entry runs to the next, and the last to the checksum
+            for (std::size_t e = 0; e < entries.size(); ++e)
+            {
+                if (!names.emplace(entries[e].name.begin(), entries[e].name.end()).second)
+                    continue;
+                written w = entries[e];
+                w.offset = offset;
+                objects.push_back(w);
+                std::uint64_t const end
+                    = e + 1 < entries.size() ? entries[e + 1].offset : std::uint64_t(st.st_size) - 20;
+                for (std::uint64_t pos = entries[e].offset; pos < end;)
+                {
+                    ssize_t const n = ::pread(
+                        in, &buffer[0], std::size_t(std::min<std::uint64_t>(buffer.size(), end - pos)), pos);
+                    if (n <= 0)
+                    {
+                        if (n < 0 && errno == EINTR)
+                            continue;
+                        ::close(in);
+                        throw system_error("reading", file);
+                    }
+                    write_all(&buffer[0], n);
+                    pos += n;
+                }
+            }
+            ::close(in);
+        }
+        base = seal();
+    }
+    catch(...)
+    {
+        discard();
+        throw;
+    }
+    objects.clear();
+
+    for (std::size_t i = first; i < unmerged.size(); ++i)
+    {
+        if (unmerged[i].first == base)
+            continue;
+        std::remove((unmerged[i].first + ".idx").c_str());
+        std::remove((unmerged[i].first + ".pack").c_str());
+    }
+    unmerged.resize(first);
+    unmerged.emplace_back(std::move(base), level);
+}
+
+// The objects listed by the version 2 pack index file
+std::vector<pack_writer::written> pack_writer::read_index(std::string const& file)
+{
+    std::ifstream in(file.c_str(), std::ios::binary);
+    if (!in)
+        throw std::runtime_error("Couldn't open the pack index " + file);
+    std::string index((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    auto get32 = [&](std::size_t pos) {
+        std::uint32_t n = 0;
+        for (std::size_t i = 0; i < 4; ++i)
+            n = n << 8 | (unsigned char)index[pos + i];
+        return n;
+    };
+    std::size_t const fan_out = 8, names = fan_out + 256 * 4;
+    if (index.size() < names || index.compare(0, 4, "\377tOc") != 0 || get32(4) != 2)
+        throw std::runtime_error("Couldn't read the pack index " + file);
+    std::size_t const n = get32(names - 4);
+    std::size_t const crcs = names + 20 * n, offsets = crcs + 4 * n, large = offsets + 4 * n;
+    if (index.size() < large + 40)
+        throw std::runtime_error("Couldn't read the pack index " + file);
+
+    std::vector<written> result(n);
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        std::copy(&index[names + 20 * i], &index[names + 20 * (i + 1)], result[i].name.begin());
+        result[i].crc = get32(crcs + 4 * i);
+        std::uint32_t const o = get32(offsets + 4 * i);
+        if (o & 0x80000000u)
+        {
+            std::size_t const pos = large + 8 * (o & 0x7fffffffu);
+            if (index.size() < pos + 8 + 40)
+                throw std::runtime_error("Couldn't read the pack index " + file);
+            result[i].offset = std::uint64_t(get32(pos)) << 32 | get32(pos + 4);
+        }
+        else
+            result[i].offset = o;
+    }
+    return result;
+}
+
+// Write a version 2 pack index for the objects written
+void pack_writer::write_index(std::string const& file, sha1::digest_type const& pack_checksum)
+{
+    std::sort(objects.begin(), objects.end(),
+              [](written const& x, written const& y) { return x.name < y.name; });
+
+    std::string index("\377tOc");
+    put32(index, 2);
+    std::size_t n = 0;
+    for (int first_byte = 0; first_byte < 256; ++first_byte)
+    {
+        while (n < objects.size() && objects[n].name[0] == first_byte)
+            ++n;
+        put32(index, std::uint32_t(n));
+    }
+    for (auto const& o : objects)
+        index.append(reinterpret_cast<char const*>(o.name.data()), o.name.size());
+    for (auto const& o : objects)
+        put32(index, o.crc);
+
+    // Offsets that don't fit in 31 bits go in a table of 64-bit ones
+    std::string large_offsets;
+    std::uint32_t large_count = 0;
+    for (auto const& o : objects)
+    {
+        if (o.offset < 0x80000000u)
+            put32(index, std::uint32_t(o.offset));
+        else
+        {
+            put32(index, 0x80000000u | large_count++);
+            put64(large_offsets, o.offset);
+        }
+    }
+    index += large_offsets;
+    index.append(reinterpret_cast<char const*>(pack_checksum.data()), pack_checksum.size());
+    sha1::digest_type const index_checksum = sha1().update(index).digest();
+    index.append(reinterpret_cast<char const*>(index_checksum.data()), index_checksum.size());
+
+    std::string path = pack_dir + "/tmp_idx_XXXXXX";
+    fd = ::mkstemp(&path[0]);
+    if (fd < 0)
+        throw system_error("creating", path);
+    tmp_path = std::move(path);
+    offset = 0;
+    write_all(index.data(), index.size());
+    if (::fchmod(fd, 0444) != 0)
+        throw system_error("changing the mode of", tmp_path);
+    int const status = ::close(fd);
+    fd = -1;
+    if (status != 0)
+        throw system_error("closing", tmp_path);
+    if (std::rename(tmp_path.c_str(), file.c_str()) != 0)
+        throw system_error("renaming", tmp_path);
+}
@@ -0,0 +1,126 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef PACK_WRITER_DWA20131104_HPP
+# define PACK_WRITER_DWA20131104_HPP
+
+# include "sha1.hpp"
+
+# include <condition_variable>
+# include <cstdint>
+# include <deque>
+# include <future>
+# include <mutex>
+# include <string>
+# include <thread>
+# include <unordered_map>
+# include <utility>
+# include <vector>
+
+// Deflates Git objects on a pool of threads, shared by the
+// pack_writers of every repository, at the given zlib level: -1 for
+// zlib's default, or 0 (no compression) to 9.
+struct deflate_pool
+{
+    explicit deflate_pool(unsigned threads, int level = -1);
+    ~deflate_pool();
+
+    // Returns the pack entry for a blob with the given contents: its
+    // type and size header, followed by the zlib-compressed contents.
+    std::future<std::string> deflate_blob(std::string contents);
+
+    // Returns the pack entry for an object given as a Git delta
+    // against the base with the given name
+    std::future<std::string> deflate_delta(
+        sha1::digest_type const& base, std::string delta);
+
+ private:
+    template <class Task>
+    std::future<std::string> submit(Task task);
+    void work();
+
+    std::mutex mutex;
+    std::condition_variable work_ready;
+    std::deque<std::packaged_task<std::string()> > queue;
+    bool stopping;
+    int const level;
+    std::vector<std::thread> threads;
+};
+
+// Writes blobs into packfiles of a repository's own, so that they
+// are compressed on a deflate_pool rather than by the single thread
+// of git fast-import, which is then given their SHA-1s.  Each pack is
+// written as blobs are added, and becomes visible to Git, complete
+// with its index, only on finish().  The packs finished are merged as
+// they accumulate, so that finishing one often doesn't leave the
+// repository with a pack for each.
+struct pack_writer
+{
+    pack_writer(std::string const& git_dir, deflate_pool& deflater);
+    ~pack_writer();
+
+    // Add a blob, whose name Git would give as the 40 hex digits of
+    // sha, to the pack being written
+    void add_blob(std::string const& sha, std::string contents);
+
+    // True iff the blob named by sha is in the pack being written,
+    // so that others may be added as deltas against it
+    bool accepts_delta_base(std::string const& sha) const;
+
+    // Add a blob given as a Git delta against a base blob for which
+    // accepts_delta_base is true
+    void add_delta(std::string const& sha, std::string const& base_sha, std::string delta);
+
+    // True iff blobs have been added since the last finish()
+    bool pending() const { return fd >= 0; }
+
+    // The bytes written so far to the pack being written
+    std::uint64_t size() const { return offset; }
+
+    // Write the pack holding every blob added so far, and its index,
+    // to the repository, merging it into a larger one with the others
+    // finished since if there are enough of them
+    void finish();
+
+ private:
+    struct queued
+    {
+        sha1::digest_type name;
+        std::size_t size;
+        std::future<std::string> entry;
+    };
+
+    struct written
+    {
+        sha1::digest_type name;
+        std::uint32_t crc;
+        std::uint64_t offset;
+    };
+
+    void open();
+    void enqueue(std::string const& sha, std::size_t size, std::future<std::string> entry);
+    void write_entries(std::size_t budget);
+    void write_all(char const* data, std::size_t size);
+    std::string seal();
+    void merge(std::size_t first);
+    void write_index(std::string const& file, sha1::digest_type const& pack_checksum);
+    static std::vector<written> read_index(std::string const& file);
+    void discard();
+
+    std::string const pack_dir;
+    deflate_pool& deflater;
+    std::string tmp_path;       // of the pack being written
+    int fd;                     // -1 unless a pack is being written
+    std::uint64_t offset;       // where the next entry goes
+    std::size_t in_flight;      // bytes of contents not yet written
+    std::deque<queued> queue;
+    std::vector<written> objects;
+    // The names of the blobs in the pack, and the length of the
+    // chain of deltas each is stored as, zero for whole blobs
+    std::unordered_map<std::string, unsigned> depths;
+    // The packs finished that haven't been merged, as paths without
+    // their extensions, each with the number of merges that made it
+    std::vector<std::pair<std::string, unsigned> > unmerged;
+};
+
+#endif // PACK_WRITER_DWA20131104_HPP
@@ -2,148 +2,405 @@
 // Software License, Version 1.0. (See accompanying
 // file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
 #include "parse_rules.hpp"
+#include "rules_cache.hpp"
+#include "sha1.hpp"
 
-#include <boost/spirit/home/qi.hpp>
-#include <fstream>
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <algorithm>
+#include <climits>
+#include <cstring>
 #include <iomanip>
+#include <sstream>
 #include <stdexcept>
-#include <boost/spirit/include/qi.hpp>
-#include <boost/spirit/include/support_multi_pass.hpp>
-#include <boost/spirit/include/classic_position_iterator.hpp>
-#include <boost/spirit/repository/include/qi_confix.hpp>
-#include <boost/spirit/repository/include/qi_iter_pos.hpp>
-#include <boost/spirit/home/phoenix/bind/bind_function.hpp>
-#include <boost/algorithm/string/predicate.hpp>
-
-namespace qi = boost::spirit::qi;
-namespace ascii = boost::spirit::ascii;
-namespace classic = boost::spirit::classic;
-namespace phoenix = boost::phoenix;
-
-namespace boost2git
-{
 
-typedef std::istreambuf_iterator<char> BaseIterator;
-typedef boost::spirit::multi_pass<BaseIterator> ForwardIterator;
-typedef classic::position_iterator2<ForwardIterator> PosIterator;
+using namespace boost2git;
 
-static void get_line(int& line, PosIterator const& iterator)
-  {
-  line = iterator.get_position().line;
-  }
-static void set_git_ref_qualifier(boost2git::BranchRule& branch, char const* qualifier)
+namespace
+{
+
+// A recursive-descent parser of the grammar parse_rules_spirit.cpp
+// gives to Spirit, which reads the text in place, counting lines as
+// it goes:
+//
+//   [abstract] repository NAME [: BASE, ...] {
+//     [submodule of STRING : STRING ;]
+//     [minrev N ;] [maxrev N ;]
+//     [content { STRING [: STRING] ; ... }]
+//     [branches { [[MIN] : [MAX]] STRING : STRING ; ... }]
+//     [tags { [[MIN] : [MAX]] STRING : STRING ; ... }]
+//     [exclude { STRING ; ... }]
+//     [squash { (author | path) STRING ; ... }]
+//   }
+//
+// A STRING is an identifier or anything but a '"' between '"'s.
+// Whitespace and C and C++ comments may come between any two tokens.
+// The line recorded for a repository is that of its name, and for a
+// rule within it, that of the ';' ending the rule.
+class rules_parser
   {
-  branch.git_ref_qualifier = qualifier;
-  }
-} // namespace boost2git
+public:
+  rules_parser(char const* first, char const* last, std::string const& filename)
+    : p(first), end(last), line_start(first), line(1), filename(filename)
+    {
+    }
 
-using namespace boost2git;
-using boost::spirit::make_default_multi_pass;
+  AST parse()
+    {
+    AST ast;
+    do
+      {
+      ast.insert(repository());
+      skip();
+      }
+    while (p != end);
+    return ast;
+    }
 
-template<typename Iterator, typename Skipper>
-struct RepositoryGrammar: qi::grammar<Iterator, RepoRule(), Skipper>
-  {
-  RepositoryGrammar() : RepositoryGrammar::base_type(repository_)
-    {
-    repository_
-     %= (qi::matches["abstract"] >> "repository")
-      > line_number_
-      > string_
-      > -(':' > string_ % ',')
-      > '{'
-      > -(qi::lit("submodule") > qi::lit("of") > string_ > ':' > string_ > ';')
-      > (("minrev" > qi::uint_ > ';') | qi::attr(0))
-      > (("maxrev" > qi::uint_ > ';') | qi::attr(UINT_MAX))
-      > -content_
-      > -branches_
-      > -tags_
-      > '}'
-      ;
-    content_
-     %= qi::lit("content")
-      > '{'
-      > +(string_ > -(':' > string_) > line_number_ > ';')
-      > '}'
-      ;
-    branches_
-     %= qi::lit("branches")
-      > '{'
-      > +(branch_[phoenix::bind(set_git_ref_qualifier, qi::_1, "refs/heads/")])
-      > '}'
-      ;
-    tags_
-     %= qi::lit("tags")
-      > '{'
-      > +branch_[phoenix::bind(set_git_ref_qualifier, qi::_1, "refs/tags/")]
-      > '}'
-      ;
-    branch_
-     %= '['
-      > (qi::uint_ | qi::attr(0))
-      > ':'
-      > (qi::uint_ | qi::attr(UINT_MAX))
-      > ']'
-      > string_
-      > ':'
-      > string_
-      > line_number_
-      > ';'
-      ;
-    string_
-     %= qi::char_("a-zA-Z_") >> *qi::char_("-a-zA-Z_0-9")
-      | qi::lexeme['"' >> +(qi::char_ - '"') >> '"']
-      ;
-    line_number_ = boost::spirit::repository::qi::iter_pos
-      [
-      phoenix::bind(get_line, qi::_val, qi::_1)
-      ];
-    }
-  qi::rule<Iterator, RepoRule(), Skipper> repository_;
-  qi::rule<Iterator, std::vector<ContentRule>(), Skipper> content_;
-  qi::rule<Iterator, std::vector<BranchRule>(), Skipper> branches_, tags_;
-  qi::rule<Iterator, BranchRule(), Skipper> branch_;
-  qi::rule<Iterator, std::string(), Skipper> string_;
-  qi::rule<Iterator, int(), Skipper> line_number_;
-  };
+private:
+  RepoRule repository()
+    {
+    RepoRule rule;
+    rule.is_abstract = lit("abstract");
+    expect("repository");
+    rule.line = line_number();
+    rule.git_repo_name = expect_string();
+    if (lit(':'))
+      {
+      do
+        {
+        rule.bases.push_back(expect_string());
+        }
+      while (lit(','));
+      }
+    expect('{');
+    if (lit("submodule"))
+      {
+      expect("of");
+      rule.submodule_info.push_back(expect_string());
+      expect(':');
+      rule.submodule_info.push_back(expect_string());
+      expect(';');
+      }
+    rule.minrev = 0;
+    if (lit("minrev"))
+      {
+      rule.minrev = expect_uint();
+      expect(';');
+      }
+    rule.maxrev = UINT_MAX;
+    if (lit("maxrev"))
+      {
+      rule.maxrev = expect_uint();
+      expect(';');
+      }
+    if (lit("content"))
+      {
+      expect('{');
+      do
+        {
+        ContentRule content;
+        content.svn_path = expect_string();
+        if (lit(':'))
+          {
+          content.git_path = expect_string();
+          }
+        content.line = line_number();
+        expect(';');
+        rule.content_rules.push_back(content);
+        }
+      while (!lit('}'));
+      }
+    if (lit("branches"))
+      {
+      branches(rule.branch_rules, "refs/heads/");
+      }
+    if (lit("tags"))
+      {
+      branches(rule.tag_rules, "refs/tags/");
+      }
+    if (lit("exclude"))
+      {
+      expect('{');
+      do
+        {
+        ExcludeRule exclusion;
+        exclusion.svn_path = expect_string();
+        exclusion.line = line_number();
+        expect(';');
+        rule.exclusions.push_back(exclusion);
+        }
+      while (!lit('}'));
+      }
+    if (lit("squash"))
+      {
+      expect('{');
+      do
+        {
+        SquashRule squash;
+        if (lit("author"))
+          {
+          squash.kind = "author";
+          }
+        else
+          {
+          expect("path");
+          squash.kind = "path";
+          }
+        squash.value = expect_string();
+        squash.line = line_number();
+        expect(';');
+        rule.squash_rules.push_back(squash);
+        }
+      while (!lit('}'));
+      }
+    expect('}');
+    return rule;
+    }
 
-AST parse_rules_file(std::string filename)
-  {
-  AST ast;
-  
-  std::ifstream file(filename.c_str());
-  if (!file)
+  void branches(std::vector<BranchRule>& rules, char const* qualifier)
     {
-    throw std::runtime_error("cannot read ruleset: " + filename);
+    expect('{');
+    do
+      {
+      BranchRule branch;
+      expect('[');
+      branch.min = uint(0);
+      expect(':');
+      branch.max = uint(UINT_MAX);
+      expect(']');
+      branch.svn_path = expect_string();
+      expect(':');
+      branch.git_branch_or_tag_name = expect_string();
+      branch.line = line_number();
+      expect(';');
+      branch.git_ref_qualifier = qualifier;
+      rules.push_back(branch);
+      }
+    while (!lit('}'));
+    }
+
+  // Skip whitespace and comments.  A comment left open to the end of
+  // the text isn't skipped, and so is a parse error.
+  void skip()
+    {
+    while (p != end)
+      {
+      if (*p == '\n')
+        {
+        line_start = ++p;
+        ++line;
+        }
+      else if (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\f' || *p == '\v')
+        {
+        ++p;
+        }
+      else if (*p == '/' && end - p > 1 && p[1] == '*')
+        {
+        char const* close = p + 2;
+        while (end - close > 1 && !(close[0] == '*' && close[1] == '/'))
+          {
+          ++close;
+          }
+        if (end - close < 2)
+          {
+          return;
+          }
+        advance(close + 2);
+        }
+      else if (*p == '/' && end - p > 1 && p[1] == '/')
+        {
+        char const* eol = static_cast<char const*>(std::memchr(p, '\n', end - p));
+        p = eol ? eol : end;
+        }
+      else
+        {
+        return;
+        }
+      }
+    }
+
+  // Move to q, counting the lines passed
+  void advance(char const* q)
+    {
+    for (char const* nl; (nl = static_cast<char const*>(std::memchr(p, '\n', q - p))); p = nl + 1)
+      {
+      line_start = nl + 1;
+      ++line;
+      }
+    p = q;
+    }
+
+  // Consume the literal text s if it comes next
+  bool lit(char const* s)
+    {
+    skip();
+    std::size_t const n = std::strlen(s);
+    if (std::size_t(end - p) < n || std::memcmp(p, s, n) != 0)
+      {
+      return false;
+      }
+    p += n;
+    return true;
+    }
+
+  bool lit(char c)
+    {
+    skip();
+    if (p == end || *p != c)
+      {
+      return false;
+      }
+    ++p;
+    return true;
+    }
+
+  template <class Literal>
+  void expect(Literal x)
+    {
+    if (!lit(x))
+      {
+      error();
+      }
+    }
+
+  int line_number()
+    {
+    skip();
+    return line;
+    }
+
+  static bool is_identifier_start(char c)
+    {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+    }
+
+  static bool is_identifier_char(char c)
+    {
+    return is_identifier_start(c) || (c >= '0' && c <= '9') || c == '-';
     }
 
-  BaseIterator in_begin(file);
-  ForwardIterator fwd_begin = make_default_multi_pass(in_begin), fwd_end;
-  PosIterator begin(fwd_begin, fwd_end), end;
+  std::string expect_string()
+    {
+    skip();
+    char const* const start = p;
+    if (p != end && is_identifier_start(*p))
+      {
+      while (++p != end && is_identifier_char(*p))
+        {
+        }
+      return std::string(start, p);
+      }
+    if (p != end && *p == '"')
+      {
+      char const* close = static_cast<char const*>(std::memchr(p + 1, '"', end - p - 1));
+      if (close && close != p + 1)
+        {
+        advance(close + 1);
+        return std::string(start + 1, close);
+        }
+      }
+    error();
+    return std::string();
+    }
+
+  // The unsigned number that comes next, or if there is none, absent
+  std::size_t uint(std::size_t absent)
+    {
+    skip();
+    if (p == end || *p < '0' || *p > '9')
+      {
+      return absent;
+      }
+    return expect_uint();
+    }
 
-  BOOST_AUTO(comment
-    , ascii::space
-    | boost::spirit::repository::confix("/*", "*/")[*(qi::char_ - "*/")]
-    | boost::spirit::repository::confix("//", qi::eol)[*(qi::char_ - qi::eol)]
-    );
-  RepositoryGrammar<PosIterator, BOOST_TYPEOF(comment)> grammar;
-  try
+  std::size_t expect_uint()
     {
-    qi::phrase_parse(begin, end, qi::eps > +grammar, comment, ast);
+    skip();
+    char const* const start = p;
+    std::size_t n = 0;
+    for (; p != end && *p >= '0' && *p <= '9'; ++p)
+      {
+      n = n * 10 + (*p - '0');
+      if (n > UINT_MAX)
+        {
+        p = start;
+        error();
+        }
+      }
+    if (p == start)
+      {
+      error();
+      }
+    return n;
     }
-  catch (const qi::expectation_failure<PosIterator>& error)
+
+  // Report a parse error at p, in the form Spirit's position_iterator
+  // gave: columns count from 1, with tabs stopping every 4
+  void error() const
     {
-    typedef classic::file_position_base<std::string> Position;
-    const Position& pos = error.first.get_position();
+    int column = 1;
+    for (char const* c = line_start; c != p; ++c)
+      {
+      column += *c == '\t' ? 4 - (column - 1) % 4 : 1;
+      }
+    char const* const eol = std::find(line_start, end, '\n');
     std::stringstream msg;
     msg << "parse error at file " << filename
-        << " line " << pos.line
-        << " column " << pos.column << std::endl
-        << "'" << error.first.get_currentline() << "'" << std::endl
-        << std::setw(pos.column) << " " << "^- here"
+        << " line " << line
+        << " column " << column << std::endl
+        << "'" << std::string(line_start, eol) << "'" << std::endl
+        << std::setw(column) << " " << "^- here"
       ;
     throw std::runtime_error(msg.str());
     }
-  return ast;
+
+  char const* p;
+  char const* const end;
+  char const* line_start;
+  int line;
+  std::string const& filename;
+  };
+
+} // namespace
+
+AST parse_rules_text(char const* first, char const* last, std::string const& filename)
+  {
+  return rules_parser(first, last, filename).parse();
   }
 
+AST parse_rules_file(std::string filename)
+  {
+  AST ast;
 
+  // The rules are parsed where they're mapped, without being copied;
+  // an empty file can't be mapped, but has no rules to parse anyway
+  boost::system::error_code ec;
+  boost::uintmax_t const size = boost::filesystem::file_size(filename, ec);
+  if (ec)
+    {
+    throw std::runtime_error("cannot read ruleset: " + filename);
+    }
+  boost::iostreams::mapped_file_source file;
+  if (size > 0)
+    {
+    file.open(filename);
+    }
+  char const* const text = file.is_open() ? file.data() : "";
+  char const* const text_end = text + (file.is_open() ? file.size() : 0);
+
+  std::string const text_sha1 = sha1().update(text, text_end - text).hex_digest();
+  std::string const cache_file = rules_cache::file_name(text_sha1);
+  if (!cache_file.empty() && rules_cache::load(cache_file, text_sha1, ast))
+    {
+    return ast;
+    }
+
+  ast = parse_rules_text(text, text_end, filename);
+  if (!cache_file.empty())
+    {
+    rules_cache::save(cache_file, text_sha1, ast);
+    }
+  return ast;
+  }
@@ -9,4 +9,12 @@
 
 boost2git::AST parse_rules_file(std::string filename);
 
+// Parse the rules in [first, last), read from filename, which is
+// used only in reporting errors.  parse_rules_file uses this once it
+// has mapped the file into memory and found no cached AST for it.
+boost2git::AST parse_rules_text(char const* first, char const* last, std::string const& filename);
+
+// The same, with the Spirit grammar of parse_rules_spirit.cpp
+boost2git::AST parse_rules_text_spirit(char const* first, char const* last, std::string const& filename);
+
 #endif // PARSE_RULES_DWA2013516_HPP
@@ -0,0 +1,72 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Times parsing a rules file with the hand-written parser of
+// parse_rules.cpp and with the Spirit grammar it replaced, so that
+// changes to either can be measured.  The file is read once; only
+// the parsing is timed, not the mapping or the rules cache.
+//
+//   parse_rules_bench RULES [REPEAT]
+
+#include "parse_rules.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+
+int main(int argc, char** argv)
+{
+    if (argc < 2 || argc > 3)
+    {
+        std::cerr << "usage: " << argv[0] << " RULES [REPEAT]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        std::ifstream in(argv[1], std::ios::binary);
+        if (!in)
+            throw std::runtime_error(std::string("cannot read ruleset: ") + argv[1]);
+        std::string const text(
+            (std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        int const repeat = argc > 2 ? std::atoi(argv[2]) : 20;
+
+        std::cout << std::setw(16) << std::left << "parser" << std::right
+                  << std::setw(12) << "repos" << std::setw(12) << "ms/parse"
+                  << std::setw(12) << "MB/s" << std::endl;
+
+        typedef boost2git::AST (*parser)(char const*, char const*, std::string const&);
+        auto run = [&](char const* name, parser parse) -> double
+        {
+            std::size_t const repos = parse(text.data(), text.data() + text.size(), argv[1]).size();
+
+            auto const start = std::chrono::steady_clock::now();
+            for (int i = 0; i < repeat; ++i)
+                parse(text.data(), text.data() + text.size(), argv[1]);
+            double const ms = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count() / repeat;
+
+            std::cout << std::setw(16) << std::left << name << std::right
+                      << std::setw(12) << repos << std::fixed << std::setprecision(2)
+                      << std::setw(12) << ms
+                      << std::setw(12) << text.size() / ms / 1000 << std::endl;
+            return ms;
+        };
+
+        double const hand_written_ms = run("hand-written", parse_rules_text);
+        double const spirit_ms = run("spirit", parse_rules_text_spirit);
+        std::cout << "hand-written is " << std::setprecision(1)
+                  << spirit_ms / hand_written_ms << "x as fast" << std::endl;
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << argv[0] << ": " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,166 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// The Spirit grammar the rules were parsed with before parse_rules.cpp
+// was written, kept to check the hand-written parser's results
+// against and to measure it by; see parse_rules_bench.cpp.
+
+#include "parse_rules.hpp"
+
+#include <boost/spirit/home/qi.hpp>
+#include <boost/proto/deep_copy.hpp>
+#include <climits>
+#include <iomanip>
+#include <iterator>
+#include <stdexcept>
+#include <boost/spirit/include/qi.hpp>
+#include <boost/spirit/include/classic_position_iterator.hpp>
+#include <boost/spirit/repository/include/qi_confix.hpp>
+#include <boost/spirit/repository/include/qi_iter_pos.hpp>
+#include <boost/phoenix/bind/bind_function.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+
+namespace qi = boost::spirit::qi;
+namespace ascii = boost::spirit::ascii;
+namespace classic = boost::spirit::classic;
+namespace phoenix = boost::phoenix;
+
+namespace boost2git
+{
+
+typedef char const* BaseIterator;
+typedef classic::position_iterator2<BaseIterator> PosIterator;
+
+static void get_line(int& line, PosIterator const& iterator)
+  {
+  line = iterator.get_position().line;
+  }
+// phoenix::bind would copy a string literal into the grammar, which
+// the rules parsed mustn't point into, so it's given a pointer instead
+static char const* qualifier(char const* literal)
+  {
+  return literal;
+  }
+static void set_git_ref_qualifier(boost2git::BranchRule& branch, char const* qualifier)
+  {
+  branch.git_ref_qualifier = qualifier;
+  }
+} // namespace boost2git
+
+using namespace boost2git;
+
+template<typename Iterator, typename Skipper>
+struct RepositoryGrammar: qi::grammar<Iterator, RepoRule(), Skipper>
+  {
+  RepositoryGrammar() : RepositoryGrammar::base_type(repository_)
+    {
+    repository_
+     %= (qi::matches["abstract"] >> "repository")
+      > line_number_
+      > string_
+      > -(':' > string_ % ',')
+      > '{'
+      > -(qi::lit("submodule") > qi::lit("of") > string_ > ':' > string_ > ';')
+      > (("minrev" > qi::uint_ > ';') | qi::attr(0))
+      > (("maxrev" > qi::uint_ > ';') | qi::attr(UINT_MAX))
+      > -content_
+      > -branches_
+      > -tags_
+      > -exclusions_
+      > -squashes_
+      > '}'
+      ;
+    content_
+     %= qi::lit("content")
+      > '{'
+      > +(string_ > -(':' > string_) > line_number_ > ';')
+      > '}'
+      ;
+    exclusions_
+     %= qi::lit("exclude")
+      > '{'
+      > +(string_ > line_number_ > ';')
+      > '}'
+      ;
+    squashes_
+     %= qi::lit("squash")
+      > '{'
+      > +((qi::string("author") | qi::string("path")) > string_ > line_number_ > ';')
+      > '}'
+      ;
+    branches_
+     %= qi::lit("branches")
+      > '{'
+      > +(branch_[phoenix::bind(set_git_ref_qualifier, qi::_1, qualifier("refs/heads/"))])
+      > '}'
+      ;
+    tags_
+     %= qi::lit("tags")
+      > '{'
+      > +branch_[phoenix::bind(set_git_ref_qualifier, qi::_1, qualifier("refs/tags/"))]
+      > '}'
+      ;
+    branch_
+     %= '['
+      > (qi::uint_ | qi::attr(0))
+      > ':'
+      > (qi::uint_ | qi::attr(UINT_MAX))
+      > ']'
+      > string_
+      > ':'
+      > string_
+      > line_number_
+      > ';'
+      ;
+    string_
+     %= qi::char_("a-zA-Z_") >> *qi::char_("-a-zA-Z_0-9")
+      | qi::lexeme['"' >> +(qi::char_ - '"') >> '"']
+      ;
+    line_number_ = boost::spirit::repository::qi::iter_pos
+      [
+      phoenix::bind(get_line, qi::_val, qi::_1)
+      ];
+    }
+  qi::rule<Iterator, RepoRule(), Skipper> repository_;
+  qi::rule<Iterator, std::vector<ContentRule>(), Skipper> content_;
+  qi::rule<Iterator, std::vector<ExcludeRule>(), Skipper> exclusions_;
+  qi::rule<Iterator, std::vector<SquashRule>(), Skipper> squashes_;
+  qi::rule<Iterator, std::vector<BranchRule>(), Skipper> branches_, tags_;
+  qi::rule<Iterator, BranchRule(), Skipper> branch_;
+  qi::rule<Iterator, std::string(), Skipper> string_;
+  qi::rule<Iterator, int(), Skipper> line_number_;
+  };
+
+AST parse_rules_text_spirit(char const* first, char const* last, std::string const& filename)
+  {
+  AST ast;
+  PosIterator begin(first, last), end;
+
+  // deep_copy, or the skipper refers to temporaries gone by the time
+  // it's used, which optimized builds crash on
+  BOOST_AUTO(comment, boost::proto::deep_copy(
+      ascii::space
+    | boost::spirit::repository::confix("/*", "*/")[*(qi::char_ - "*/")]
+    | boost::spirit::repository::confix("//", qi::eol)[*(qi::char_ - qi::eol)]
+    ));
+  RepositoryGrammar<PosIterator, BOOST_TYPEOF(comment)> grammar;
+  try
+    {
+    qi::phrase_parse(begin, end, qi::eps > +grammar, comment, ast);
+    }
+  catch (const qi::expectation_failure<PosIterator>& error)
+    {
+    typedef classic::file_position_base<std::string> Position;
+    const Position& pos = error.first.get_position();
+    std::stringstream msg;
+    msg << "parse error at file " << filename
+        << " line " << pos.line
+        << " column " << pos.column << std::endl
+        << "'" << error.first.get_currentline() << "'" << std::endl
+        << std::setw(pos.column) << " " << "^- here"
+      ;
+    throw std::runtime_error(msg.str());
+    }
+  return ast;
+  }
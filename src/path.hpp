@@ -7,11 +7,13 @@
 # include <boost/algorithm/string/trim.hpp>
 # include <boost/algorithm/string/predicate.hpp>
 # include <boost/operators.hpp>
-# include <boost/range/iterator_range.hpp>
-# include <boost/iterator/iterator_facade.hpp>
-# include <utility>
-# include <ostream>
 # include <algorithm>
+# include <cassert>
+# include <mutex>
+# include <ostream>
+# include <string>
+# include <unordered_map>
+# include <utility>
 
 // A wrapper for Git/SVN path strings.  Boost.Filesystem's path is
 // inappropriate for this purpose because of
@@ -19,64 +21,22 @@
 // 
 // Additionally, we normalize by stripping leading and trailing
 // slashes, which is perfectly fine for this application
+//
+// Paths are interned: each distinct path string is stored once, in
+// a node that also knows its parent directory, and a path is just a
+// pointer to its node.  Copying and equality are therefore O(1),
+// and prefix tests and ordering walk parent pointers instead of
+// scanning characters.  Nodes live as long as the program.
 struct path : boost::totally_ordered<path>
 {
-    typedef boost::iterator_range<std::string::const_iterator> component;
-
-    struct component_iterator
-      : public boost::iterator_facade<
-            component_iterator
-          , component
-          , std::input_iterator_tag
-          , component
-        >
-    {
-        component_iterator() {}
-
-        component_iterator(path const& p)
-            : first(p.str().begin())
-            , last(p.str().end())
-            , mid(std::find(first, last, '/'))
-        {}
-
-        component_iterator(std::string::const_iterator i)
-            : first(i)
-            , last(i)
-            , mid(i)
-        {}
-
-     private:
-        friend class boost::iterator_core_access;
-
-        void increment()
-        {
-            first = mid;
-            if (first != last)
-                ++first;
-            mid = std::find(first, last, '/');
-        }
-        
-        component dereference() const
-        {
-            return boost::make_iterator_range(first, mid);
-        }
-
-        bool equal(component_iterator const& rhs) const
-        {
-            return first == rhs.first;
-        }
-
-        std::string::const_iterator first, last, mid;
-    };
-
-    path() {}
+    path() : n(&root()) {}
 
     path(char const* x)
-        : text(path::trim(std::string(x)))
+        : n(&intern(path::trim(std::string(x))))
     {}
 
     path(std::string x)
-        : text(path::trim(std::move(x)))
+        : n(&intern(path::trim(std::move(x))))
     {}
 
     path(path const&) = default;
@@ -86,60 +46,162 @@ struct path : boost::totally_ordered<path>
 
     bool starts_with(path const& prefix) const
     {
-        return boost::starts_with(text, prefix.text) && (
-            text.size() == prefix.text.size() 
-            || text[prefix.text.size()] == '/'
-            || prefix.str().empty()
-        );
+        node const* p = n;
+        while (p->depth > prefix.n->depth)
+            p = p->parent;
+        return p == prefix.n;
     }
 
     std::string sans_prefix(path const& prefix) const
     {
         assert(starts_with(prefix));
-        return text.substr(prefix.text.size());
+        return str().substr(prefix.str().size());
+    }
+
+    // The directory containing this path; the root is its own parent.
+    path parent() const
+    {
+        return path(n->parent ? n->parent : n);
+    }
+
+    // The number of components in this path
+    std::size_t depth() const
+    {
+        return n->depth;
     }
 
     friend bool operator==(path const& p0, path const& p1)
     {
-        return p0.text == p1.text;
+        return p0.n == p1.n;
     }
 
+    // Orders paths component by component, so "a/b" < "a.txt"
     friend bool operator<(path const& p0, path const& p1)
     {
+        node const* a = p0.n;
+        node const* b = p1.n;
+        if (a == b)
+            return false;
+
+        // Bring both to the same depth; if one path then turns out to
+        // be a prefix of the other, it's the lesser.
+        while (a->depth > b->depth)
+            a = a->parent;
+        if (a == b)
+            return false;
+        while (b->depth > a->depth)
+            b = b->parent;
+        if (a == b)
+            return true;
+
+        // Compare the components just beneath the common ancestor
+        while (a->parent != b->parent)
+        {
+            a = a->parent;
+            b = b->parent;
+        }
         return std::lexicographical_compare(
-            component_iterator(p0), component_iterator(p0.str().end()),
-            component_iterator(p1), component_iterator(p1.str().end()));
+            a->name_begin(), a->text->end(), b->name_begin(), b->text->end());
     }
 
     friend void swap(path& p0, path& p1)
     {
         using std::swap;
-        swap(p0.text, p1.text);
+        swap(p0.n, p1.n);
     }
 
     friend std::ostream& operator<<(std::ostream& os, path const& p)
     {
-        return os << p.text;
+        return os << p.str();
     }
 
     char const* c_str() const
     {
-        return text.c_str();
+        return n->text->c_str();
     }
 
     std::string const& str() const
     {
-        return text;
+        return *n->text;
     }
 
-    friend path operator/(path lhs, path const& rhs)
+    friend path operator/(path const& lhs, path const& rhs)
     {
-        if (!lhs.str().empty() && !rhs.str().empty())
-            lhs.text.push_back('/');
-        lhs.text += rhs.text;
-        return lhs;
+        if (rhs.str().empty())
+            return lhs;
+        if (lhs.str().empty())
+            return rhs;
+        return path(&intern(lhs.str() + '/' + rhs.str()));
     }
+
  private:
+    struct node
+    {
+        std::string const* text;  // the whole path, owned by the table
+        node const* parent;       // null only for the root
+        std::size_t depth;
+        std::size_t name_pos;     // where the last component begins in text
+
+        std::string::const_iterator name_begin() const
+        {
+            return text->begin() + name_pos;
+        }
+    };
+
+    explicit path(node const* n) : n(n) {}
+
+    typedef std::unordered_map<std::string, node> table_type;
+
+    static table_type& table()
+    {
+        static table_type t;
+        return t;
+    }
+
+    static node const& root()
+    {
+        static node const& r = intern(std::string());
+        return r;
+    }
+
+    // Return the node for the trimmed path text, creating it and its
+    // ancestors as necessary.  The file prefetcher's threads hold
+    // paths too, so the table is guarded.
+    static node const& intern(std::string const& text)
+    {
+        static std::mutex mutex;
+        std::lock_guard<std::mutex> lock(mutex);
+        return intern_locked(text);
+    }
+
+    static node const& intern_locked(std::string const& text)
+    {
+        table_type& t = table();
+        auto found = t.find(text);
+        if (found != t.end())
+            return found->second;
+
+        node n;
+        if (text.empty())
+        {
+            n.parent = nullptr;
+            n.depth = 0;
+            n.name_pos = 0;
+        }
+        else
+        {
+            std::size_t const slash = text.rfind('/');
+            n.parent = &intern_locked(
+                slash == std::string::npos ? std::string() : text.substr(0, slash));
+            n.depth = n.parent->depth + 1;
+            n.name_pos = slash == std::string::npos ? 0 : slash + 1;
+        }
+
+        auto inserted = t.insert(table_type::value_type(text, n)).first;
+        inserted->second.text = &inserted->first;
+        return inserted->second;
+    }
+
     static std::string trim(std::string x) 
     { 
         boost::algorithm::trim_if(x, boost::is_any_of("/"));
@@ -147,7 +209,7 @@ struct path : boost::totally_ordered<path>
     }
 
  private:
-    std::string text;
+    node const* n;
 };
 
 #endif // PATH_DWA2013618_HPP
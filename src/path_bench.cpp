@@ -0,0 +1,239 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Times the operations on path, path_set and flat_set_union's |=
+// that every revision's conversion makes many of, so that other
+// implementations of them can be compared.  Each benchmark is run
+// for at least MIN_SECONDS (by default 0.5), doubling its iterations
+// until it has, and reported in nanoseconds per operation.
+//
+// The paths are those of PATHS, one per line, such as the output of
+// "svnlook tree --full-paths" on the Boost repository, or if it isn't
+// given, a synthetic tree of that shape: trunk and a few branches,
+// each with boost/ headers and libs/ of many libraries, whose
+// directories hold many siblings several levels deep.
+//
+//   path_bench [PATHS [MIN_SECONDS [FILTER]]]
+//
+// Only benchmarks whose names contain FILTER are run.
+
+#include "path.hpp"
+#include "path_set.hpp"
+#include "flat_set_union.hpp"
+
+#include <boost/container/flat_set.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+static std::size_t sink;
+
+static std::vector<std::string> synthetic_paths()
+{
+    static char const* const libs[] = {
+        "accumulators", "algorithm", "any", "array", "asio", "bind", "chrono", "config",
+        "container", "date_time", "filesystem", "function", "fusion", "graph", "interprocess",
+        "iostreams", "iterator", "lexical_cast", "math", "mpl", "multi_index", "numeric",
+        "optional", "phoenix", "preprocessor", "program_options", "proto", "python", "random",
+        "range", "regex", "serialization", "smart_ptr", "spirit", "system", "test", "thread",
+        "tuple", "type_traits", "unordered", "utility", "variant", "wave", "xpressive"
+    };
+    static char const* const lib_dirs[] = { "doc", "example", "src", "test", "build", "doc/html" };
+    static char const* const roots[] = {
+        "trunk", "branches/release", "branches/sandbox/refactor", "tags/release/Boost_1_55_0"
+    };
+
+    std::vector<std::string> result;
+    for (char const* root : roots)
+    {
+        for (char const* lib : libs)
+        {
+            std::string const headers = std::string(root) + "/boost/" + lib;
+            result.push_back(std::string(root) + "/boost/" + lib + ".hpp");
+            for (int i = 0; i < 20; ++i)
+                result.push_back(headers + "/header" + std::to_string(i) + ".hpp");
+            for (int i = 0; i < 10; ++i)
+                result.push_back(headers + "/detail/impl/part" + std::to_string(i) + ".ipp");
+
+            std::string const sources = std::string(root) + "/libs/" + lib;
+            for (char const* dir : lib_dirs)
+            {
+                for (int i = 0; i < 8; ++i)
+                    result.push_back(sources + "/" + dir + "/file" + std::to_string(i) + ".cpp");
+            }
+        }
+    }
+    return result;
+}
+
+static std::vector<std::string> read_paths(std::string const& filename)
+{
+    std::ifstream in(filename.c_str());
+    if (!in)
+        throw std::runtime_error("Couldn't open path list: " + filename);
+    std::vector<std::string> result;
+    for (std::string line; std::getline(in, line);)
+    {
+        if (!line.empty())
+            result.push_back(line);
+    }
+    return result;
+}
+
+struct benchmark
+{
+    char const* name;
+    // Do some operations, returning how many
+    std::function<std::size_t()> run;
+};
+
+// Run b until it has taken min_seconds, and report its time per
+// operation
+static void measure(benchmark const& b, double min_seconds)
+{
+    std::size_t ops = b.run(); // warm up
+    double seconds = 0;
+    for (std::size_t iterations = 1;; iterations *= 2)
+    {
+        ops = 0;
+        auto const start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < iterations; ++i)
+            ops += b.run();
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (seconds >= min_seconds || ops == 0)
+            break;
+    }
+    std::cout << std::setw(32) << std::left << b.name << std::right
+              << std::setw(14) << ops << std::fixed << std::setprecision(1)
+              << std::setw(12) << (ops ? seconds * 1e9 / ops : 0.0) << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 4)
+    {
+        std::cerr << "usage: " << argv[0] << " [PATHS [MIN_SECONDS [FILTER]]]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        std::vector<std::string> const texts
+            = argc > 1 && *argv[1] ? read_paths(argv[1]) : synthetic_paths();
+        double const min_seconds = argc > 2 ? std::atof(argv[2]) : 0.5;
+        std::string const filter = argc > 3 ? argv[3] : "";
+
+        std::vector<path> paths(texts.begin(), texts.end());
+        std::vector<path> dirs;
+        for (auto const& p : paths)
+            dirs.push_back(p.parent());
+
+        // Pairs of paths compared as sorting would, nearby ones
+        // sharing long prefixes, and shuffled ones sharing few
+        std::mt19937 random(42);
+        std::vector<path> shuffled(paths);
+        std::shuffle(shuffled.begin(), shuffled.end(), random);
+
+        // Sets like a super-module's submodule refs
+        typedef boost::container::flat_set<void const*> pointer_set;
+        std::vector<void const*> pointers;
+        for (auto const& p : paths)
+            pointers.push_back(p.c_str());
+        std::shuffle(pointers.begin(), pointers.end(), random);
+        std::size_t const set_size = std::min<std::size_t>(pointers.size() / 2, 200);
+        pointer_set const half(pointers.begin(), pointers.begin() + set_size);
+        std::vector<void const*> const other(
+            pointers.begin() + set_size / 2, pointers.begin() + set_size * 3 / 2);
+
+        path_set half_the_dirs;
+        for (std::size_t i = 0; i < dirs.size(); i += 2)
+            half_the_dirs.insert(dirs[i]);
+
+        std::cout << paths.size() << " paths" << std::endl
+                  << std::setw(32) << std::left << "benchmark" << std::right
+                  << std::setw(14) << "operations" << std::setw(12) << "ns/op" << std::endl;
+
+        benchmark const benchmarks[] = {
+            { "path/intern", [&] {
+                    for (auto const& t : texts)
+                        sink += path(t).depth();
+                    return texts.size(); } },
+            { "path/less_sorted", [&] {
+                    for (std::size_t i = 1; i < paths.size(); ++i)
+                        sink += paths[i - 1] < paths[i];
+                    return paths.size() - 1; } },
+            { "path/less_shuffled", [&] {
+                    for (std::size_t i = 1; i < shuffled.size(); ++i)
+                        sink += shuffled[i - 1] < shuffled[i];
+                    return shuffled.size() - 1; } },
+            { "path/sort", [&] {
+                    std::vector<path> v(shuffled);
+                    std::sort(v.begin(), v.end());
+                    sink += v.front().depth();
+                    return v.size(); } },
+            { "path/starts_with_parent", [&] {
+                    for (std::size_t i = 0; i < paths.size(); ++i)
+                        sink += paths[i].starts_with(dirs[i]);
+                    return paths.size(); } },
+            { "path/starts_with_other", [&] {
+                    for (std::size_t i = 0; i < paths.size(); ++i)
+                        sink += shuffled[i].starts_with(dirs[i]);
+                    return paths.size(); } },
+            { "path/sans_prefix", [&] {
+                    for (std::size_t i = 0; i < paths.size(); ++i)
+                        sink += paths[i].sans_prefix(dirs[i]).size();
+                    return paths.size(); } },
+            { "path/join", [&] {
+                    for (std::size_t i = 0; i < paths.size(); ++i)
+                        sink += (dirs[i] / "extra").depth();
+                    return paths.size(); } },
+            { "path_set/insert", [&] {
+                    path_set s;
+                    for (auto const& p : shuffled)
+                        sink += s.insert(p);
+                    return shuffled.size(); } },
+            { "path_set/insert_dirs", [&] {
+                    path_set s;
+                    for (auto const& p : paths)
+                        s.insert(p);
+                    for (auto const& d : dirs)
+                        sink += s.insert(d);
+                    return paths.size() + dirs.size(); } },
+            { "path_set/covers", [&] {
+                    for (auto const& p : shuffled)
+                        sink += half_the_dirs.covers(p);
+                    return shuffled.size(); } },
+            { "flat_set_union/pointers", [&] {
+                    pointer_set s(half);
+                    s |= other;
+                    sink += s.size();
+                    return other.size(); } },
+            { "flat_set_union/paths", [&] {
+                    boost::container::flat_set<path> s(dirs.begin(), dirs.begin() + dirs.size() / 2);
+                    s |= std::vector<path>(dirs.begin() + dirs.size() / 4, dirs.end());
+                    sink += s.size();
+                    return dirs.size() - dirs.size() / 4; } }
+        };
+
+        for (auto const& b : benchmarks)
+        {
+            if (std::string(b.name).find(filter) != std::string::npos)
+                measure(b, min_seconds);
+        }
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << argv[0] << ": " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return sink == std::size_t(-1); // never true; keeps sink alive
+}
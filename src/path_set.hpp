@@ -5,65 +5,187 @@
 # define PATH_SET_DWA2013615_HPP
 
 #include "path.hpp"
-#include <boost/algorithm/string/predicate.hpp>
+#include <boost/container/map.hpp>
 #include <algorithm>
+#include <initializer_list>
+#include <iterator>
+#include <utility>
 #include <vector>
 
+// A set of paths, none beneath another: inserting a path beneath one
+// already in the set does nothing, and inserting one above others
+// replaces them.  The paths are kept in a trie of their components,
+// so that an insertion costs time proportional to the path's depth
+// (plus that of pruning what it replaces) however many paths the set
+// holds.  Every leaf of the trie is a path in the set, and every path
+// in the set is a leaf, so iterating over the leaves in order visits
+// the paths in path order.
 class path_set
 {
-    typedef std::vector<path> storage;
- public:
+    // Each node is keyed by its whole path, whose last component
+    // orders it among its siblings.  boost::container::map allows
+    // the recursion.
+    struct node;
+    typedef boost::container::map<path, node> children_type;
+    struct node
+    {
+        node() : terminal(false) {}
+        bool terminal;
+        children_type children;
+    };
 
-    path_set() {}
+ public:
+    path_set() : count(0) {}
 
     path_set(std::initializer_list<path> const& x)
-        : paths(x)
-    {}
+        : count(0)
+    {
+        for (auto const& p : x)
+            insert(p);
+    }
 
-    void clear() { paths.clear(); }
+    void clear()
+    {
+        top.clear();
+        count = 0;
+    }
 
     friend bool operator==(path_set const& lhs, path_set const& rhs)
-    { return lhs.paths == rhs.paths; }
-
-    typedef storage::value_type value_type;
-    typedef storage::const_iterator const_iterator;
-    typedef const_iterator iterator;
-
-    std::size_t size() const { return paths.size(); }
-    const_iterator begin() const { return paths.begin(); }
-    const_iterator end() const { return paths.end(); }
-
-    const_iterator insert(const_iterator _, path p)
     {
-        return insert(std::move(p));
+        return lhs.size() == rhs.size() && std::equal(lhs.begin(), lhs.end(), rhs.begin());
     }
 
-    const_iterator insert(path p)
+    typedef path value_type;
+
+    // Visits the leaves of the trie in order
+    class const_iterator
     {
-        auto start = std::lower_bound(paths.begin(), paths.end(), p);
+     public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef path value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef path const* pointer;
+        typedef path const& reference;
 
-        // See if a parent path is already in the set
-        if (start != paths.begin() && p.starts_with(*std::prev(start)))
-            return start;  // if so, we're done
+        const_iterator() {}
 
-        // Find the range of paths in the set that p subsumes
-        auto finish = start;
-        while (finish != paths.end() && finish->starts_with(p))
-            ++finish;
+        path const& operator*() const { return stack.back().first->first; }
+        path const* operator->() const { return &**this; }
 
-        if (start == finish)
+        const_iterator& operator++()
         {
-            return paths.insert(start, p);
+            while (!stack.empty() && ++stack.back().first == stack.back().second)
+                stack.pop_back();
+            descend();
+            return *this;
         }
-        else if (*start != p) // don't bother if we already have the path
+
+        const_iterator operator++(int)
+        {
+            const_iterator old = *this;
+            ++*this;
+            return old;
+        }
+
+        friend bool operator==(const_iterator const& x, const_iterator const& y)
         {
-            *start = std::move(p);
-            paths.erase(std::next(start), finish);
+            return x.stack.empty() ? y.stack.empty()
+                : !y.stack.empty() && x.stack.back().first == y.stack.back().first;
         }
-        return start;
+
+        friend bool operator!=(const_iterator const& x, const_iterator const& y)
+        {
+            return !(x == y);
+        }
+
+     private:
+        friend class path_set;
+        explicit const_iterator(children_type const& top)
+        {
+            if (!top.empty())
+            {
+                stack.emplace_back(top.begin(), top.end());
+                descend();
+            }
+        }
+
+        // Move down to the first leaf at or beneath the current node
+        void descend()
+        {
+            if (stack.empty())
+                return;
+            for (children_type const* c; !(c = &stack.back().first->second.children)->empty();)
+                stack.emplace_back(c->begin(), c->end());
+        }
+
+        std::vector<std::pair<children_type::const_iterator, children_type::const_iterator> > stack;
+    };
+    typedef const_iterator iterator;
+
+    std::size_t size() const { return count; }
+    const_iterator begin() const { return const_iterator(top); }
+    const_iterator end() const { return const_iterator(); }
+
+    // Returns true iff p or one of its ancestors is in the set
+    bool covers(path const& p) const
+    {
+        children_type const* c = &top;
+        for (path const& a : lineage(p))
+        {
+            auto const found = c->find(a);
+            if (found == c->end())
+                return false;
+            if (found->second.terminal)
+                return true;
+            c = &found->second.children;
+        }
+        return false;
+    }
+
+    // Add p to the set unless one of its ancestors is there already,
+    // removing any paths beneath it.  Returns true iff p was added.
+    bool insert(path const& p)
+    {
+        node* n = nullptr;
+        children_type* c = &top;
+        for (path const& a : lineage(p))
+        {
+            n = &(*c)[a];
+            if (n->terminal)
+                return false;
+            c = &n->children;
+        }
+        count -= leaves(n->children);
+        n->children.clear();
+        n->terminal = true;
+        ++count;
+        return true;
     }
+
  private:
-    storage paths;
+    // p and its ancestors, from the root down
+    std::vector<path> const& lineage(path const& p) const
+    {
+        scratch.resize(p.depth() + 1);
+        path a = p;
+        for (std::size_t i = scratch.size(); i-- > 0; a = a.parent())
+            scratch[i] = a;
+        return scratch;
+    }
+
+    static std::size_t leaves(children_type const& c)
+    {
+        std::size_t n = 0;
+        for (auto const& kv : c)
+            n += kv.second.terminal ? 1 : leaves(kv.second.children);
+        return n;
+    }
+
+    children_type top;      // holds the root path, if anything
+    std::size_t count;
+
+    // Space for lineage, kept to spare allocations
+    mutable std::vector<path> scratch;
 };
 
 #endif // PATH_SET_DWA2013615_HPP
@@ -6,6 +6,9 @@
 
 # include "to_string.hpp"
 # include "options.hpp"
+# include "byte_search.hpp"
+# include "compiled_matcher.hpp"
+# include "probes.hpp"
 # include <deque>
 # include <boost/variant.hpp>
 # include <vector>
@@ -15,7 +18,11 @@
 # include <boost/range.hpp>
 # include <boost/range/iterator_range.hpp>
 # include <ostream>
+# include <iterator>
 # include <climits>
+# include <cstdint>
+# include <string>
+# include <unordered_map>
 
 namespace patrie_ {
 //using boost::container::vector;
@@ -73,6 +80,9 @@ struct patrie
 
     void insert(Rule rule_)
     {
+        current = snapshot_state(); // invalidate the snapshot
+        frozen = false;
+        compiled = nullptr;
         rules.push_back(std::move(rule_));
         Rule const& rule = rules.back();
 
@@ -90,38 +100,449 @@ struct patrie
             traverse(&this->trie, svn_path.begin(), svn_path.end(), v);
         }
 
+        // Rules that map nothing into Git have no Git address
+        std::string const& git_address = rule.git_address();
+        if (!git_address.empty())
         {
             insert_visitor v(&rules.back(), true);
-            std::string git_address = rule.git_address();
             traverse(&this->rtrie, git_address.begin(), git_address.end(), v);
         }
     }
 
+    // Insert every rule of new_rules, in order, leaving the same
+    // tries as inserting them one at a time would, but built in one
+    // pass over the rules sorted by key, instead of splitting nodes
+    // and inserting into the middle of vectors for each rule.  Rules
+    // are only bulk loaded into an empty patrie; otherwise they are
+    // inserted one by one.  A deque of rules is taken over as it is,
+    // rather than copied, so a Ruleset's rules are never held twice.
+    void insert_all(std::vector<Rule> new_rules)
+    {
+        insert_all(std::deque<Rule>(
+            std::make_move_iterator(new_rules.begin()), std::make_move_iterator(new_rules.end())));
+    }
+
+    void insert_all(std::deque<Rule> new_rules)
+    {
+        if (!rules.empty())
+        {
+            for (auto& r : new_rules)
+                insert(std::move(r));
+            return;
+        }
+        current = snapshot_state();
+        frozen = false;
+        compiled = nullptr;
+
+        rules.swap(new_rules);
+        std::vector<std::pair<std::size_t, Rule const*> > changes;
+        std::vector<keyed_rule> svn_keys, git_keys;
+        svn_keys.reserve(rules.size());
+        git_keys.reserve(rules.size());
+        std::size_t position = 0;
+        for (Rule const& rule : rules)
+        {
+            ++position;
+            if (rule.min > 1)
+                changes.emplace_back(rule.min, &rule);
+            if (rule.max < UINT_MAX)
+                changes.emplace_back(rule.max + 1, &rule);
+
+            coverage.declare(rule);
+
+            keyed_rule k = { &rule.svn_path().str(), &rule, position };
+            assert((*k.key)[0] != '/');
+            svn_keys.push_back(k);
+            std::string const& git_address = rule.git_address();
+            if (!git_address.empty())
+            {
+                keyed_rule g = { &git_address, &rule, position };
+                git_keys.push_back(g);
+            }
+        }
+
+        // In each revision's transitions, the rules stay in the order
+        // they were given
+        std::stable_sort(
+            changes.begin(), changes.end(),
+            [](std::pair<std::size_t, Rule const*> const& x, std::pair<std::size_t, Rule const*> const& y)
+            { return x.first < y.first; });
+        for (auto const& c : changes)
+        {
+            if (transition_map.empty() || transition_map.back().first != c.first)
+                transition_map.push_back(rev_rules(c.first, {}));
+            transition_map.back().second.push_back(c.second);
+        }
+
+        build(trie, svn_keys, false);
+        build(rtrie, git_keys, true);
+    }
+
+    // Every rule inserted, in order
+    std::deque<Rule> const& all_rules() const
+    {
+        return rules;
+    }
+
+    // Build the read-only representation used for lookups.  Lookups
+    // do this on demand, but it's better done once all the rules are
+    // inserted.
+    void freeze() const
+    {
+        if (frozen)
+            return;
+        flat_svn.build(trie);
+        flat_git.build(rtrie);
+        frozen = true;
+    }
+
+    // The shape and size of one of the tries; see --matcher-stats
+    struct trie_stats
+    {
+        trie_stats() : node_bytes(0), label_bytes(0), rule_vector_bytes(0), flat_bytes(0) {}
+
+        std::vector<std::size_t> depths;      // nodes at each depth, the root's 0
+        std::vector<std::size_t> fan_outs;    // nodes with each number of children
+        std::vector<std::size_t> rule_counts; // nodes with each number of rules
+        std::size_t node_bytes;        // the nodes, with the slack of the vectors holding them
+        std::size_t label_bytes;       // their text, where too long to be held within them
+        std::size_t rule_vector_bytes; // their vectors of rules
+        std::size_t flat_bytes;        // the read-only copy lookups use; see freeze
+    };
+
+    // Those of the SVN trie, or with git, the Git trie
+    trie_stats stats(bool git) const
+    {
+        freeze();
+        trie_stats s;
+        s.node_bytes = sizeof(node); // the root
+        add_stats(git ? rtrie : trie, 0, s);
+        s.flat_bytes = (git ? flat_git : flat_svn).bytes();
+        return s;
+    }
+
+    // How many nodes of the SVN trie, or with git, the Git trie, a
+    // lookup of key enters, the root included
+    template <class Range>
+    std::size_t lookup_depth(Range const& key, bool git) const
+    {
+        depth_visitor v;
+        traverse(git ? &rtrie : &trie, boost::begin(key), boost::end(key), v);
+        return v.nodes;
+    }
+
+    // The bytes of the rules, but for the strings they refer to
+    std::size_t rule_bytes() const
+    {
+        return rules.size() * sizeof(Rule);
+    }
+
+    // The bytes of the rules' transitions, by revision
+    std::size_t transition_bytes() const
+    {
+        std::size_t bytes = transition_map.capacity() * sizeof(rev_rules);
+        for (auto const& t : transition_map)
+            bytes += t.second.capacity() * sizeof(Rule const*);
+        return bytes;
+    }
+
+    // Prepare for matches at the given revision, which will be
+    // fast as long as they're made between the same two rule
+    // transitions.  Only does any work when a transition was crossed.
+    void set_current_revision(std::size_t revision) const
+    {
+        record('r', std::string(), revision);
+        update_snapshot(current, revision);
+    }
+
     template <class Range>
     Rule const* longest_match(Range const& r, std::size_t revision) const
     {
-        search_visitor v(revision);
-        traverse(&this->trie, boost::begin(r), boost::end(r), v);
-        if (v.found_rule)
-            coverage.match(*v.found_rule, revision);
-        return v.found_rule;
+        record('m', r, revision);
+        freeze();
+        SVN2GIT_PROBE2(rule_match__start, std::size_t(boost::size(r)), revision);
+        Rule const* const found_rule = find(current, r, revision);
+        SVN2GIT_PROBE1(rule_match__done, found_rule != nullptr);
+        if (found_rule)
+            coverage.match(*found_rule, revision);
+        return found_rule;
+    }
+
+    // The same, also setting [first, last] to the revisions around
+    // revision at which the key has the same match, so that a caller
+    // can reuse it until a transition that concerns the key.  Only the
+    // rules along the key's path in the trie bound the interval: the
+    // match's own, and any deeper one that would take over from it.
+    template <class Range>
+    Rule const* longest_match(
+        Range const& r, std::size_t revision, std::size_t& first, std::size_t& last) const
+    {
+        record('m', r, revision);
+        freeze();
+        SVN2GIT_PROBE2(rule_match__start, std::size_t(boost::size(r)), revision);
+        Rule const* const found_rule = flat_svn.longest_match(
+            key_begin(r), key_end(r), revision, first, last);
+        SVN2GIT_PROBE1(rule_match__done, found_rule != nullptr);
+        if (found_rule)
+            coverage.match(*found_rule, revision);
+        return found_rule;
     }
   
     template <class Range, class OutputIterator>
     void git_subtree_rules(Range const& git_address, std::size_t revision, OutputIterator out) const
     {
-        subtree_search_visitor<OutputIterator> v(revision, out);
-        traverse(&this->rtrie, boost::begin(git_address), boost::end(git_address), v);
+        record('g', git_address, revision);
+        freeze();
+        flat_git.subtree_rules(key_begin(git_address), key_end(git_address), revision, out);
     }
 
     template <class Range, class OutputIterator>
     void svn_subtree_rules(Range const& svn_path, std::size_t revision, OutputIterator out) const
     {
-        subtree_search_visitor<OutputIterator> v(revision, out);
-        traverse(&this->rtrie, boost::begin(svn_path), boost::end(svn_path), v);
+        record('s', svn_path, revision);
+        freeze();
+        flat_git.subtree_rules(key_begin(svn_path), key_end(svn_path), revision, out);
+    }
+
+    // Writes every rule active at the given revision whose SVN path
+    // lies strictly beneath svn_path.
+    template <class Range, class OutputIterator>
+    void svn_rules_beneath(Range const& svn_path, std::size_t revision, OutputIterator out) const
+    {
+        record('b', svn_path, revision);
+        freeze();
+        flat_svn.rules_beneath(key_begin(svn_path), key_end(svn_path), revision, out);
+    }
+
+    // Writes every rule active at the given revision whose Git
+    // address lies strictly beneath git_address.
+    template <class Range, class OutputIterator>
+    void git_rules_beneath(Range const& git_address, std::size_t revision, OutputIterator out) const
+    {
+        record('B', git_address, revision);
+        freeze();
+        flat_git.rules_beneath(key_begin(git_address), key_end(git_address), revision, out);
+    }
+
+    // See below
+    class reader;
+    class cursor;
+
+    // A longest_match at the given revision whose key is given a
+    // piece at a time; see cursor
+    cursor match_cursor(std::size_t revision) const
+    {
+        freeze();
+        return cursor(*this, revision);
+    }
+
+    // Write a line to os describing each subsequent lookup, so that
+    // a conversion's lookups can be replayed by patrie_bench.  Each
+    // line is "<kind> <revision> <key>", where kind is the first
+    // letter of the lookup function (B for git_rules_beneath), or r
+    // for set_current_revision.  Pass null to stop recording.
+    void record_lookups(std::ostream* os) const
+    {
+        lookup_log = os;
+    }
+
+    // A hash of everything longest_match depends on: the SVN path,
+    // revision range and position of each rule
+    std::uint64_t digest() const
+    {
+        std::uint64_t h = 14695981039346656037ull; // FNV-1a
+        auto hash = [&h](std::string const& s)
+        {
+            for (char c : s)
+                h = (h ^ (unsigned char)c) * 1099511628211ull;
+            h = (h ^ 0xff) * 1099511628211ull;
+        };
+        for (Rule const& r : rules)
+        {
+            hash(r.svn_path().str());
+            hash(to_string(r.min));
+            hash(to_string(r.max));
+        }
+        return h;
+    }
+
+    // Answer longest_match with m, whose digest must be this one's,
+    // for keys held in strings.  Returns false, leaving lookups as
+    // they were, if m was compiled from other rules.  Pass null to
+    // stop; inserting a rule stops too.
+    bool use_compiled_matcher(compiled_matcher const* m) const
+    {
+        if (m && m->digest != digest())
+            return false;
+        compiled = m;
+        return true;
+    }
+
+    // Write C++ source defining a compiled_matcher called name that
+    // agrees with longest_match.  The SVN trie is unrolled into a
+    // function per node, which compares the rest of the node's text
+    // with memcmp, tests the revision against the node's rules'
+    // ranges as constants, and picks the child to continue with by a
+    // switch on the next character.
+    void write_compiled_matcher(std::ostream& os, std::string const& name) const
+    {
+        std::unordered_map<Rule const*, std::size_t> positions;
+        for (std::size_t i = 0; i < rules.size(); ++i)
+            positions[&rules[i]] = i + 1;
+
+        // Numbered breadth first, from the root
+        std::vector<node const*> nodes(1, &trie);
+        for (std::size_t i = 0; i < nodes.size(); ++i)
+        {
+            for (auto const& n1 : nodes[i]->next)
+                nodes.push_back(&n1);
+        }
+        std::unordered_map<node const*, std::size_t> numbers;
+        for (std::size_t i = 0; i < nodes.size(); ++i)
+            numbers[nodes[i]] = i;
+
+        os << "// Generated by patrie::write_compiled_matcher from " << rules.size()
+           << " rules; do not edit\n"
+           << "#include \"compiled_matcher.hpp\"\n"
+           << "#include <cstring>\n\n"
+           << "namespace {\n\n";
+        for (std::size_t i = 0; i < nodes.size(); ++i)
+            os << "std::size_t n" << i << "(char const*, char const*, std::size_t, std::size_t);\n";
+
+        for (std::size_t i = 0; i < nodes.size(); ++i)
+        {
+            node const& n = *nodes[i];
+            os << "\n// ";
+            write_literal(os, n.text);
+            os << "\nstd::size_t n" << i
+               << "(char const* s, char const* e, std::size_t r, std::size_t found)\n{\n";
+
+            // The parent has matched the first character already
+            std::size_t const length = n.text.size();
+            if (length > 1)
+            {
+                os << "    if (std::size_t(e - s) < " << length << " || std::memcmp(s + 1, ";
+                write_literal(os, n.text.substr(1));
+                os << ", " << length - 1 << ") != 0)\n        return found;\n";
+            }
+            if (length > 0)
+                os << "    s += " << length << ";\n";
+
+            if (!n.rules.empty())
+            {
+                // Only on a directory boundary, except at the root
+                std::string const indent = length > 0 ? "        " : "    ";
+                if (length > 0)
+                    os << "    if (s == e || *s == '/')\n    {\n";
+                char const* keyword = "if";
+                for (Rule const* rule : n.rules)
+                {
+                    bool const from_start = rule->min == 0;
+                    bool const to_end = std::size_t(rule->max) >= std::size_t(UINT_MAX);
+                    os << indent;
+                    if (!from_start || !to_end)
+                    {
+                        os << keyword << " (";
+                        if (!from_start)
+                            os << "r >= " << rule->min << (to_end ? "" : " && ");
+                        if (!to_end)
+                            os << "r <= " << rule->max;
+                        os << ")\n" << indent << "    ";
+                    }
+                    os << "found = " << positions[rule] << ";\n";
+                    keyword = "else if";
+                    if (from_start && to_end)
+                        break;
+                }
+                if (length > 0)
+                    os << "    }\n";
+            }
+
+            if (!n.next.empty())
+            {
+                os << "    if (s == e)\n        return found;\n"
+                   << "    switch ((unsigned char)*s)\n    {\n";
+                for (auto const& n1 : n.next)
+                {
+                    os << "    case " << unsigned((unsigned char)n1.text[0]) << ": return n"
+                       << numbers[&n1] << "(s, e, r, found);\n";
+                }
+                os << "    }\n";
+            }
+            os << "    return found;\n}\n";
+        }
+
+        os << "\nstd::size_t longest_match(char const* key, std::size_t size, std::size_t revision)\n"
+           << "{\n    return n0(key, key + size, revision, 0);\n}\n\n"
+           << "}\n\n"
+           << "extern compiled_matcher const " << name << ";\n"
+           << "compiled_matcher const " << name << " = { " << digest() << "ull, &longest_match };\n";
     }
   
  private:
+    template <class Range>
+    void record(char kind, Range const& key, std::size_t revision) const
+    {
+        if (!lookup_log)
+            return;
+        *lookup_log << kind << ' ' << revision << ' ';
+        std::copy(boost::begin(key), boost::end(key), std::ostreambuf_iterator<char>(*lookup_log));
+        *lookup_log << '\n';
+    }
+
+    // The bounds of a lookup key, as pointers when its characters
+    // are contiguous, so that the flat tries can compare them a
+    // block at a time
+    template <class Range>
+    static typename boost::range_iterator<Range const>::type key_begin(Range const& r)
+    {
+        return boost::begin(r);
+    }
+
+    template <class Range>
+    static typename boost::range_iterator<Range const>::type key_end(Range const& r)
+    {
+        return boost::end(r);
+    }
+
+    static char const* key_begin(std::string const& s) { return s.data(); }
+    static char const* key_end(std::string const& s) { return s.data() + s.size(); }
+
+    // Sets found to what the compiled matcher, if any, finds for the
+    // key.  Only keys held in strings can be passed to it.
+    template <class Range>
+    bool compiled_match(Range const&, std::size_t, Rule const*&) const
+    {
+        return false;
+    }
+
+    bool compiled_match(std::string const& key, std::size_t revision, Rule const*& found) const
+    {
+        if (!compiled)
+            return false;
+        std::size_t const position = compiled->longest_match(key.data(), key.size(), revision);
+        found = position ? &rules[position - 1] : 0;
+        return true;
+    }
+
+    // Write s as a string literal, escaping everything but letters,
+    // digits and the punctuation common in paths
+    static void write_literal(std::ostream& os, std::string const& s)
+    {
+        static char const octal[] = "01234567";
+        os << '"';
+        for (char c : s)
+        {
+            unsigned char const u = c;
+            if ((u >= 'a' && u <= 'z') || (u >= 'A' && u <= 'Z') || (u >= '0' && u <= '9')
+                || u == '/' || u == '.' || u == '-' || u == '_' || u == '+' || u == ' ')
+                os << c;
+            else
+                os << '\\' << octal[u >> 6] << octal[(u >> 3) & 7] << octal[u & 7];
+        }
+        os << '"';
+    }
+
     struct node
     {
         node(std::string const& text = std::string(), Rule const* rule = 0)
@@ -172,6 +593,42 @@ struct patrie
         }
     };
 
+    // Counts the nodes a traverse enters
+    struct depth_visitor
+    {
+        depth_visitor() : nodes(0) {}
+
+        template <class Iterator>
+        void full_match(node const&, Iterator, Iterator) { ++nodes; }
+
+        template <class Nodes, class NodeIterator, class Iterator>
+        void nomatch(Nodes const&, NodeIterator, Iterator, Iterator) {}
+
+        template <class Iterator>
+        void partial_match(node const&, std::string::const_iterator, Iterator, Iterator) {}
+
+        std::size_t nodes;
+    };
+
+    static void add_stats(node const& n, std::size_t depth, trie_stats& s)
+    {
+        auto const count = [](std::vector<std::size_t>& counts, std::size_t i)
+        {
+            if (counts.size() <= i)
+                counts.resize(i + 1);
+            ++counts[i];
+        };
+        count(s.depths, depth);
+        count(s.fan_outs, n.next.size());
+        count(s.rule_counts, n.rules.size());
+        s.node_bytes += n.next.capacity() * sizeof(node);
+        if (n.text.capacity() > std::string().capacity())
+            s.label_bytes += n.text.capacity() + 1;
+        s.rule_vector_bytes += n.rules.capacity() * sizeof(Rule const*);
+        for (auto const& c : n.next)
+            add_stats(c, depth + 1, s);
+    }
+
     struct rule_rev_comparator
     {
         bool operator()(Rule const* r, std::size_t revision) const
@@ -252,90 +709,196 @@ struct patrie
         bool allow_overlap;
     };
 
-    struct search_visitor_base
+    // A rule and the key under which it goes in a trie, for
+    // insert_all.  position is the order in which it was given.  The
+    // key is the rule's own SVN path or Git address, which it
+    // outlives, rather than a copy, since there are two for each of
+    // what may be a million rules; so git_address() must return a
+    // reference to the rule's own.
+    struct keyed_rule
     {
-        search_visitor_base(std::size_t revision)
-            : revision(revision) {}
+        std::string const* key;
+        Rule const* rule;
+        std::size_t position;
+    };
 
-        // No match for *start was found in nodes
-        template <class Iterator>
-        void nomatch(
-            vector<node> const& nodes, typename vector<node>::const_iterator pos,
-            Iterator start, Iterator finish)
+    // Build the trie, which is empty, from the given keys.  Once they
+    // are sorted, those sharing a prefix are contiguous, so each node
+    // is made once, with the text the keys beneath it share.  Each
+    // node's rules are in order of their max revision, and, as insert
+    // leaves them, those with the same max latest given first.
+    static void build(node& trie, std::vector<keyed_rule>& keys, bool allow_overlap)
+    {
+        // Characters compare as node_comparator compares them
+        std::sort(
+            keys.begin(), keys.end(),
+            [](keyed_rule const& x, keyed_rule const& y)
+            {
+                if (*x.key != *y.key)
+                    return std::lexicographical_compare(
+                        x.key->begin(), x.key->end(), y.key->begin(), y.key->end());
+                if (x.rule->max != y.rule->max)
+                    return x.rule->max < y.rule->max;
+                return x.position > y.position;
+            });
+        build_node(trie, keys.begin(), keys.end(), 0, allow_overlap);
+    }
+
+    // Fill in node n, whose text ends depth characters into each of
+    // the keys [start, finish)
+    typedef typename std::vector<keyed_rule>::const_iterator keyed_rule_iterator;
+    static void build_node(
+        node& n, keyed_rule_iterator start, keyed_rule_iterator finish, std::size_t depth,
+        bool allow_overlap)
+    {
+        keyed_rule_iterator p = start;
+        for (; p != finish && p->key->size() == depth; ++p)
         {
+            // Sorted by max, rules overlap only if neighbors do
+            if (!allow_overlap && p != start && p->rule->min <= std::prev(p)->rule->max)
+            {
+                keyed_rule const* earlier = &*std::prev(p);
+                keyed_rule const* later = &*p;
+                if (earlier->position > later->position)
+                    std::swap(earlier, later);
+                report_overlap(earlier->rule, later->rule);
+            }
+            n.rules.push_back(p->rule);
         }
 
-        // We matched up through position c in node n
-        template <class Iterator>
-        void partial_match(
-            node const &n, std::string::const_iterator c, 
-            Iterator start, Iterator finish)
+        while (p != finish)
         {
+            char const c = (*p->key)[depth];
+            keyed_rule_iterator q = p;
+            while (q != finish && (*q->key)[depth] == c)
+                ++q;
+
+            // The keys from p to q share a prefix as long as the
+            // first and last do
+            std::string const& first = *p->key;
+            std::string const& last = *std::prev(q)->key;
+            std::size_t end = depth + 1;
+            while (end < first.size() && end < last.size() && first[end] == last[end])
+                ++end;
+
+            n.next.push_back(node(first.begin() + depth, first.begin() + end));
+            build_node(n.next.back(), p, q, end, allow_overlap);
+            p = q;
         }
+    }
 
-        std::size_t revision;
+    struct node_comparator
+    {
+        template <class Node>
+        bool operator()(Node const& lhs, char rhs) const
+        {
+            return lhs.text[0] < rhs;
+        }
     };
-  
-    struct search_visitor : search_visitor_base
+
+    // The SVN trie as of one revision: each node holds the rule
+    // active there, if any, and subtrees without active rules are
+    // dropped.
+    struct snapshot_node
     {
-        search_visitor(std::size_t revision)
-            : search_visitor_base(revision), found_rule(0) {}
+        snapshot_node() : rule(0) {}
 
-        // We matched all of node n
-        template <class Iterator>
-        void full_match(node const& n, Iterator start, Iterator finish)
+        std::string text;
+        vector<snapshot_node> next;
+        Rule const* rule;
+    };
+
+    // A snapshot, and the revisions [begin, end) it holds for
+    struct snapshot_state
+    {
+        snapshot_state() : begin(0), end(0) {}
+
+        snapshot_node root;
+        std::size_t begin;
+        std::size_t end;
+    };
+
+    // Bring s up to date for matches at the given revision, doing
+    // nothing unless a transition was crossed
+    void update_snapshot(snapshot_state& s, std::size_t revision) const
+    {
+        if (revision >= s.begin && revision < s.end)
+            return;
+
+        auto next = std::upper_bound(
+            transition_map.begin(), transition_map.end(), revision,
+            [](std::size_t lhs, rev_rules const& rhs) { return lhs < rhs.first; });
+
+        // Rules starting at revision 1 have no transition, so the
+        // first interval can't include revision 0.
+        s.begin = next == transition_map.begin() ? 1 : std::prev(next)->first;
+        s.end = next == transition_map.end() ? std::size_t(-1) : next->first;
+        if (revision < s.begin)
         {
-            // Only record the found rule if our match occurred on a directory boundary
-            if (start == finish || *start == '/' || n.text.empty())
-            {
-                if (auto p = n.find_rule(this->revision))
-                    found_rule = p;
-            }
+            s.begin = s.end = 0;
+            return;
         }
 
-        Rule const* found_rule;
-    };
-  
-    // Finds all Rules at paths beneath the prefix being sought
-    template <class OutputIterator>
-    struct subtree_search_visitor : search_visitor_base
+        s.root = snapshot_node();
+        build_snapshot(this->trie, revision, s.root);
+    }
+
+    // The longest match, found in s if it holds the revision, and
+    // otherwise in the frozen trie.  Changes nothing.
+    template <class Range>
+    Rule const* find(snapshot_state const& s, Range const& r, std::size_t revision) const
     {
-        subtree_search_visitor(std::size_t revision, OutputIterator out)
-            : search_visitor_base(revision), out(out) {}
+        Rule const* found_rule;
+        if (compiled_match(r, revision, found_rule))
+            return found_rule;
+        if (revision >= s.begin && revision < s.end)
+            return snapshot_match(s.root, boost::begin(r), boost::end(r));
+        return flat_svn.longest_match(key_begin(r), key_end(r), revision);
+    }
 
-        // We matched all of node n
-        template <class Iterator>
-        void full_match(node const& n, Iterator start, Iterator finish, bool slash_required = true)
+    // Returns true iff s contains any rules
+    static bool build_snapshot(node const& n, std::size_t revision, snapshot_node& s)
+    {
+        s.text = n.text;
+        s.rule = n.find_rule(revision);
+        for (auto const& n1 : n.next)
         {
-            // If we used up the entire input, continue to explore
-            // rules to find anything that maps into a subtree
-            if (start == finish)
-            {
-                if (auto r = n.find_rule(this->revision))
-                    *out++ = r;
-                
-                // Make sure we're only finding subtrees by requiring
-                // a slash at the boundary between the full match and
-                // everything else.
-                slash_required = slash_required && n.text[n.text.size() - 1] != '/';
-                for (auto const& n1 : n.next)
-                {
-                    if (!slash_required || n1.text[0] == '/')
-                        full_match(n1, start, finish, false);
-                }
-            }
+            s.next.push_back(snapshot_node());
+            if (!build_snapshot(n1, revision, s.next.back()))
+                s.next.pop_back();
         }
+        return s.rule || !s.next.empty();
+    }
 
-        OutputIterator out;
-    };
-  
-    struct node_comparator
+    // Equivalent to traversing the trie with a search_visitor at a
+    // revision in the snapshot's interval
+    template <class Iterator>
+    static Rule const* snapshot_match(snapshot_node const& root, Iterator start, Iterator finish)
     {
-        bool operator()(node const& lhs, char rhs) const
+        snapshot_node const* n = &root;
+        Rule const* found = n->rule;
+        while (start != finish)
         {
-            return lhs.text[0] < rhs;
+            auto p = std::lower_bound(n->next.begin(), n->next.end(), *start, node_comparator());
+            if (p == n->next.end() || p->text[0] != *start)
+                break;
+
+            std::string::const_iterator c = p->text.begin(), e = p->text.end();
+            while (c != e && start != finish && *c == *start)
+            {
+                ++c;
+                ++start;
+            }
+            if (c != e)
+                break;
+
+            // Only on a directory boundary
+            if (p->rule && (start == finish || *start == '/'))
+                found = p->rule;
+            n = &*p;
         }
-    };
+        return found;
+    }
   
     friend std::ostream& operator<<(std::ostream& os, patrie const& data)
     {
@@ -351,6 +914,417 @@ struct patrie
         return os;
     }
   
+    // A read-only copy of a trie, laid out so that lookups touch few
+    // cache lines: node labels share one buffer, the children of
+    // each node are contiguous in one array, with their first
+    // characters in a parallel array searched to pick an edge, and
+    // the rules of all nodes are packed into one array.  The rules
+    // are in depth-first order, so that those of a node's whole
+    // subtree are contiguous too, and queries for the rules beneath
+    // a node scan a range instead of visiting every descendant.
+    struct flat_trie
+    {
+        struct flat_node
+        {
+            std::uint32_t text_begin, text_end;  // in labels
+            std::uint32_t next_begin, next_end;  // in nodes
+            std::uint32_t rules_begin, rules_end; // in rules: the node's own
+            std::uint32_t subtree_end;            // in rules: the end of its subtree's
+            std::size_t subtree_min, subtree_max; // the revisions of its subtree's rules
+        };
+
+        void build(node const& root)
+        {
+            labels.clear();
+            nodes.clear();
+            first_chars.clear();
+            rules.clear();
+            run_ends.clear();
+
+            // Breadth-first, so that each node's children are adjacent
+            std::vector<node const*> sources(1, &root);
+            nodes.push_back(make_node(root));
+            first_chars.push_back('\0');
+            for (std::size_t i = 0; i < sources.size(); ++i)
+            {
+                nodes[i].next_begin = std::uint32_t(nodes.size());
+                for (auto const& n1 : sources[i]->next)
+                {
+                    sources.push_back(&n1);
+                    nodes.push_back(make_node(n1));
+                    first_chars.push_back(n1.text[0]);
+                }
+                nodes[i].next_end = std::uint32_t(nodes.size());
+            }
+            place_rules(0, sources);
+        }
+
+        // The bytes this copy takes, but for the rules it points to
+        std::size_t bytes() const
+        {
+            return labels.capacity() + nodes.capacity() * sizeof(flat_node)
+                + first_chars.capacity() + rules.capacity() * sizeof(Rule const*)
+                + run_ends.capacity() * sizeof(std::uint32_t);
+        }
+
+        // Equivalent to a search of the original trie for the
+        // longest match on a directory boundary.
+        template <class Iterator>
+        Rule const* longest_match(Iterator start, Iterator finish, std::size_t revision) const
+        {
+            flat_node const* n = &nodes[0];
+            Rule const* found = find_rule(*n, revision);
+            while (start != finish)
+            {
+                n = match_edge(*n, start, finish);
+                if (!n)
+                    break;
+                if (start == finish || *start == '/' || n->text_begin == n->text_end)
+                {
+                    if (auto r = find_rule(*n, revision))
+                        found = r;
+                }
+            }
+            return found;
+        }
+
+        // The same, also setting [first, last] to the revisions over
+        // which it finds the same rule.  The nodes met are those of
+        // the key's path from the root down, so each node with a rule
+        // at revision restarts the interval at that rule's range, and
+        // each without narrows it to the gap between its rules.
+        template <class Iterator>
+        Rule const* longest_match(
+            Iterator start, Iterator finish, std::size_t revision,
+            std::size_t& first, std::size_t& last) const
+        {
+            flat_node const* n = &nodes[0];
+            first = 0;
+            last = std::size_t(-1);
+            Rule const* found = nullptr;
+            auto visit = [&](flat_node const& m)
+            {
+                std::size_t lo, hi;
+                if (Rule const* r = find_rule(m, revision, lo, hi))
+                {
+                    found = r;
+                    first = lo;
+                    last = hi;
+                }
+                else
+                {
+                    first = std::max(first, lo);
+                    last = std::min(last, hi);
+                }
+            };
+            visit(*n);
+            while (start != finish)
+            {
+                n = match_edge(*n, start, finish);
+                if (!n)
+                    break;
+                if (start == finish || *start == '/' || n->text_begin == n->text_end)
+                    visit(*n);
+            }
+            return found;
+        }
+
+        // Writes the rules at the node matching the whole key and at
+        // nodes beneath it across a '/' boundary
+        template <class Iterator, class OutputIterator>
+        void subtree_rules(
+            Iterator start, Iterator finish, std::size_t revision, OutputIterator& out) const
+        {
+            flat_node const* n = &nodes[0];
+            while (start != finish)
+            {
+                n = match_edge(*n, start, finish);
+                if (!n)
+                    return;
+            }
+            subtree(*n, revision, out, true);
+        }
+
+        // Unlike subtree_rules, this also finds keys that continue in
+        // the middle of a node's text, and treats both '/' and ':'
+        // (the separators in Git addresses) as boundaries.
+        template <class Iterator, class OutputIterator>
+        void rules_beneath(
+            Iterator start, Iterator finish, std::size_t revision, OutputIterator& out) const
+        {
+            auto at_boundary = [](char c) { return c == '/' || c == ':'; };
+            bool boundary = start == finish || at_boundary(*std::prev(finish));
+
+            flat_node const* n = &nodes[0];
+            while (start != finish)
+            {
+                flat_node const* p = child(*n, *start);
+                if (!p)
+                    return;
+
+                char const* c = &labels[0] + p->text_begin;
+                char const* const e = &labels[0] + p->text_end;
+                while (c != e && start != finish && *c == *start)
+                {
+                    ++c;
+                    ++start;
+                }
+
+                if (c != e)
+                {
+                    // Either the key diverges from this node's text or it
+                    // ends within it.
+                    if (start == finish && (boundary || *c == '/'))
+                        all_rules(*p, revision, out);
+                    return;
+                }
+                n = p;
+            }
+
+            for (std::uint32_t i = n->next_begin; i != n->next_end; ++i)
+            {
+                if (boundary || first_chars[i] == '/')
+                    all_rules(nodes[i], revision, out);
+            }
+        }
+
+        // How far a longest_match has got with a key given a piece at
+        // a time.  A rule is only matched on a directory boundary, so
+        // the match at a node ending where the key ends so far is kept
+        // apart until the next character shows whether one follows.
+        struct position
+        {
+            std::uint32_t node;     // the last node entered
+            std::uint32_t matched;  // of its text, or diverged
+            Rule const* found;      // the longest match before a '/' of the key
+            Rule const* at_end;     // the match where the key ends, if any
+        };
+        static std::uint32_t const diverged = std::uint32_t(-1);
+
+        position start(std::size_t revision) const
+        {
+            Rule const* const r = find_rule(nodes[0], revision);
+            position p = { 0, 0, r, r };
+            return p;
+        }
+
+        // Extend the key of p by [start, finish), as longest_match
+        // would find it
+        template <class Iterator>
+        void advance(position& p, Iterator start, Iterator finish, std::size_t revision) const
+        {
+            for (; start != finish && p.matched != diverged; ++start)
+            {
+                char const c = *start;
+                if (c == '/' && p.at_end)
+                    p.found = p.at_end;
+                p.at_end = nullptr;
+
+                flat_node const& n = nodes[p.node];
+                if (p.matched == n.text_end - n.text_begin)
+                {
+                    flat_node const* const next = child(n, c);
+                    if (!next)
+                    {
+                        p.matched = diverged;
+                        break;
+                    }
+                    p.node = std::uint32_t(next - &nodes[0]);
+                    p.matched = 1;
+                }
+                else if (labels[n.text_begin + p.matched] == c)
+                {
+                    ++p.matched;
+                }
+                else
+                {
+                    p.matched = diverged;
+                    break;
+                }
+
+                flat_node const& m = nodes[p.node];
+                if (p.matched == m.text_end - m.text_begin)
+                    p.at_end = find_rule(m, revision);
+            }
+        }
+
+        static Rule const* match(position const& p)
+        {
+            return p.at_end ? p.at_end : p.found;
+        }
+
+     private:
+        flat_node make_node(node const& n)
+        {
+            flat_node f;
+            f.text_begin = std::uint32_t(labels.size());
+            labels += n.text;
+            f.text_end = std::uint32_t(labels.size());
+            f.next_begin = f.next_end = 0;
+            f.rules_begin = f.rules_end = f.subtree_end = 0; // see place_rules
+            f.subtree_min = f.subtree_max = 0;
+            return f;
+        }
+
+        // The child of n whose text begins with c, if any.  Siblings'
+        // first characters are distinct, so a search for an equal
+        // byte, which compares a whole block of them at once, finds it.
+        flat_node const* child(flat_node const& n, char c) const
+        {
+            char const* const first = first_chars.data() + n.next_begin;
+            char const* const last = first_chars.data() + n.next_end;
+            char const* p = byte_search::find(first, last, c);
+            return p != last ? &nodes[p - first_chars.data()] : nullptr;
+        }
+
+        // If [start, finish) begins with the whole text of a child of
+        // n, advance start past it and return the child; otherwise
+        // return null.
+        template <class Iterator>
+        flat_node const* match_edge(flat_node const& n, Iterator& start, Iterator finish) const
+        {
+            flat_node const* p = child(n, *start);
+            if (!p)
+                return nullptr;
+            for (std::uint32_t c = p->text_begin; c != p->text_end; ++c, ++start)
+            {
+                if (start == finish || labels[c] != *start)
+                    return nullptr;
+            }
+            return p;
+        }
+
+        // The same, for keys held contiguously, comparing the edge's
+        // text a block at a time
+        flat_node const* match_edge(flat_node const& n, char const*& start, char const* finish) const
+        {
+            flat_node const* p = child(n, *start);
+            if (!p)
+                return nullptr;
+            std::size_t const length = p->text_end - p->text_begin;
+            if (std::size_t(finish - start) < length
+                || byte_search::common_prefix(&labels[0] + p->text_begin, start, length) != length)
+                return nullptr;
+            start += length;
+            return p;
+        }
+
+        Rule const* find_rule(flat_node const& n, std::size_t revnum) const
+        {
+            auto first = rules.begin() + n.rules_begin, last = rules.begin() + n.rules_end;
+            auto p = std::lower_bound(first, last, revnum, rule_rev_comparator());
+            return (p != last && (*p)->min <= revnum) ? *p : 0;
+        }
+
+        // The same, also setting [lo, hi] to the range of the rule
+        // found, or if there is none, to the gap between n's rules
+        // around revnum
+        Rule const* find_rule(
+            flat_node const& n, std::size_t revnum, std::size_t& lo, std::size_t& hi) const
+        {
+            auto first = rules.begin() + n.rules_begin, last = rules.begin() + n.rules_end;
+            auto p = std::lower_bound(first, last, revnum, rule_rev_comparator());
+            if (p != last && (*p)->min <= revnum)
+            {
+                lo = (*p)->min;
+                hi = (*p)->max;
+                return *p;
+            }
+            lo = p == first ? 0 : (*std::prev(p))->max + 1;
+            hi = p == last ? std::size_t(-1) : (*p)->min - 1;
+            return 0;
+        }
+
+        template <class OutputIterator>
+        void subtree(
+            flat_node const& n, std::size_t revision, OutputIterator& out, bool slash_required) const
+        {
+            if (auto r = find_rule(n, revision))
+                *out++ = r;
+
+            // Make sure we're only finding subtrees by requiring a
+            // slash at the boundary between the full match and
+            // everything else.
+            slash_required = slash_required 
+                && (n.text_begin == n.text_end || labels[n.text_end - 1] != '/');
+            if (!slash_required)
+            {
+                scan(n.rules_end, n.subtree_end, revision, out);
+            }
+            else if (flat_node const* p = child(n, '/'))
+            {
+                if (in_envelope(*p, revision))
+                    scan(p->rules_begin, p->subtree_end, revision, out);
+            }
+        }
+
+        template <class OutputIterator>
+        void all_rules(flat_node const& n, std::size_t revision, OutputIterator& out) const
+        {
+            if (in_envelope(n, revision))
+                scan(n.rules_begin, n.subtree_end, revision, out);
+        }
+
+        static bool in_envelope(flat_node const& n, std::size_t revision)
+        {
+            return n.subtree_min <= revision && revision <= n.subtree_max;
+        }
+
+        // Writes, in depth-first order, the rule each node whose
+        // rules lie in [first, last) has at the given revision, as
+        // find_rule would
+        template <class OutputIterator>
+        void scan(std::uint32_t first, std::uint32_t last, std::size_t revision, OutputIterator& out) const
+        {
+            while (first != last)
+            {
+                std::uint32_t const end = run_ends[first];
+                auto const p = std::lower_bound(
+                    rules.begin() + first, rules.begin() + end, revision, rule_rev_comparator());
+                if (p != rules.begin() + end && (*p)->min <= revision)
+                    *out++ = *p;
+                first = end;
+            }
+        }
+
+        // Lay out the rules of the subtree of nodes[i], whose source
+        // is sources[i], in depth-first order
+        void place_rules(std::uint32_t i, std::vector<node const*> const& sources)
+        {
+            std::vector<Rule const*> const& own = sources[i]->rules;
+            std::uint32_t const begin = std::uint32_t(rules.size());
+            std::uint32_t const end = begin + std::uint32_t(own.size());
+            rules.insert(rules.end(), own.begin(), own.end());
+            run_ends.insert(run_ends.end(), own.size(), end);
+
+            flat_node& n = nodes[i];
+            n.rules_begin = begin;
+            n.rules_end = end;
+            n.subtree_min = std::size_t(-1);
+            n.subtree_max = 0;
+            for (Rule const* r : own)
+            {
+                n.subtree_min = std::min<std::size_t>(n.subtree_min, r->min);
+                n.subtree_max = std::max<std::size_t>(n.subtree_max, r->max);
+            }
+            for (std::uint32_t c = n.next_begin; c != n.next_end; ++c)
+            {
+                place_rules(c, sources);
+                n.subtree_min = std::min(n.subtree_min, nodes[c].subtree_min);
+                n.subtree_max = std::max(n.subtree_max, nodes[c].subtree_max);
+            }
+            n.subtree_end = std::uint32_t(rules.size());
+        }
+
+        std::string labels;
+        std::vector<flat_node> nodes;  // nodes[0] is the root
+        std::string first_chars;       // the first character of each node's text
+        std::vector<Rule const*> rules;
+
+        // For each rule, the end of the rules of the node it belongs to
+        std::vector<std::uint32_t> run_ends;
+    };
+
     template <class Trie, class Iterator, class Visitor>
     static void traverse(Trie* trie, Iterator start, Iterator finish, Visitor& visitor)
     {
@@ -400,7 +1374,133 @@ struct patrie
     node rtrie;
     mutable Coverage coverage;
     std::vector<rev_rules> transition_map;
+
+    mutable snapshot_state current; // see set_current_revision
+
+    mutable std::ostream* lookup_log = nullptr; // see record_lookups
+    mutable compiled_matcher const* compiled = nullptr; // see use_compiled_matcher
+
+    // See freeze
+    mutable flat_trie flat_svn;
+    mutable flat_trie flat_git;
+    mutable bool frozen = false;
 };
+
+// A view of a patrie for lookups on one thread.  Any number of readers
+// may look up rules at once, each on a thread of its own, while the
+// patrie is left unchanged: a reader keeps a snapshot of its own for
+// set_current_revision, records nothing for record_lookups, and
+// leaves the caller to count the rules it returns toward coverage.
+// The first reader made freezes the patrie, so make them before
+// starting the threads, or freeze it first.
+template <class Rule, class Coverage>
+class patrie<Rule, Coverage>::reader
+{
+ public:
+    explicit reader(patrie const& trie) : trie(&trie)
+    {
+        trie.freeze();
+    }
+
+    void set_current_revision(std::size_t revision)
+    {
+        trie->update_snapshot(snapshot, revision);
+    }
+
+    template <class Range>
+    Rule const* longest_match(Range const& r, std::size_t revision) const
+    {
+        return trie->find(snapshot, r, revision);
+    }
+
+    template <class Range>
+    Rule const* longest_match(
+        Range const& r, std::size_t revision, std::size_t& first, std::size_t& last) const
+    {
+        return trie->flat_svn.longest_match(key_begin(r), key_end(r), revision, first, last);
+    }
+
+    template <class Range, class OutputIterator>
+    void git_subtree_rules(Range const& git_address, std::size_t revision, OutputIterator out) const
+    {
+        trie->flat_git.subtree_rules(key_begin(git_address), key_end(git_address), revision, out);
+    }
+
+    template <class Range, class OutputIterator>
+    void svn_rules_beneath(Range const& svn_path, std::size_t revision, OutputIterator out) const
+    {
+        trie->flat_svn.rules_beneath(key_begin(svn_path), key_end(svn_path), revision, out);
+    }
+
+    template <class Range, class OutputIterator>
+    void git_rules_beneath(Range const& git_address, std::size_t revision, OutputIterator out) const
+    {
+        trie->flat_git.rules_beneath(key_begin(git_address), key_end(git_address), revision, out);
+    }
+
+ private:
+    patrie const* trie;
+    snapshot_state snapshot;
+};
+
+// A longest_match whose key grows a piece at a time, such as the path
+// of a walk down the SVN tree: the cursor of each directory is copied
+// and advanced by the name of each entry, so the trie is walked once
+// for the path they share rather than once for every path beneath.
+// Cursors are cheap to copy, count their matches toward coverage as
+// longest_match does, record nothing for record_lookups, and are
+// invalidated by inserting rules.
+template <class Rule, class Coverage>
+class patrie<Rule, Coverage>::cursor
+{
+ public:
+    // Extend the key by r
+    template <class Range>
+    cursor& advance(Range const& r)
+    {
+        auto const first = key_begin(r);
+        auto const last = key_end(r);
+        if (first != last)
+            empty = false;
+        trie->flat_svn.advance(position, first, last, revision);
+        return *this;
+    }
+
+    // Extend the key by "/" and r, or only by r while the key is empty
+    template <class Range>
+    cursor& descend(Range const& r)
+    {
+        if (!empty)
+            trie->flat_svn.advance(position, slash, slash + 1, revision);
+        return advance(r);
+    }
+
+    // The longest match of the key so far
+    Rule const* match() const
+    {
+        Rule const* const r = flat_trie::match(position);
+        if (r)
+            trie->coverage.match(*r, revision);
+        return r;
+    }
+
+ private:
+    friend struct patrie;
+    cursor(patrie const& trie, std::size_t revision)
+        : trie(&trie), revision(revision), empty(true),
+          position(trie.flat_svn.start(revision))
+    {}
+
+    static char const slash[1];
+
+    patrie const* trie;
+    std::size_t revision;
+    bool empty;                 // see descend
+    typename flat_trie::position position;
+};
+
+template <class Rule, class Coverage>
+char const patrie<Rule, Coverage>::cursor::slash[1] = { '/' };
 }
 using patrie_::patrie;
 
@@ -0,0 +1,246 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Replays the rule lookups recorded by svn2git --record-lookups
+// against a ruleset, reporting the time and (where the kernel allows)
+// cache misses per lookup, so changes to the trie can be measured.
+// longest_match is also timed against a component_trie of the same
+// rules, and, if patrie_bench is built with a compiled matcher (see
+// COMPILED_MATCHER_RULES) for them, against that.
+//
+//   patrie_bench RULES LOOKUPS [REPEAT]
+
+#include "ruleset.hpp"
+#include "component_trie.hpp"
+#include "options.hpp"
+
+#include <boost/function_output_iterator.hpp>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+# include <linux/perf_event.h>
+# include <sys/ioctl.h>
+# include <sys/syscall.h>
+# include <unistd.h>
+#endif
+
+struct lookup
+{
+    char kind;
+    std::size_t revision;
+    std::string key;
+};
+
+static std::vector<lookup> read_lookups(std::string const& filename)
+{
+    std::ifstream in(filename.c_str());
+    if (!in)
+        throw std::runtime_error("Couldn't open lookup record file: " + filename);
+
+    std::vector<lookup> result;
+    std::string line;
+    while (std::getline(in, line))
+    {
+        std::size_t const space = line.find(' ', 2);
+        if (line.size() < 3 || line[1] != ' ' || space == std::string::npos)
+            throw std::runtime_error("Malformed lookup record: " + line);
+        lookup l = {
+            line[0], std::strtoul(line.c_str() + 2, nullptr, 10), line.substr(space + 1) };
+        result.push_back(std::move(l));
+    }
+    return result;
+}
+
+// Counts the hardware cache misses of this process, if it may
+struct cache_miss_counter
+{
+    cache_miss_counter() : fd(-1)
+    {
+#ifdef __linux__
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+    }
+
+    ~cache_miss_counter()
+    {
+#ifdef __linux__
+        if (fd >= 0)
+            close(fd);
+#endif
+    }
+
+    bool available() const { return fd >= 0; }
+
+    void start()
+    {
+#ifdef __linux__
+        if (fd < 0)
+            return;
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+    }
+
+    std::uint64_t stop()
+    {
+        std::uint64_t count = 0;
+#ifdef __linux__
+        if (fd < 0)
+            return 0;
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd, &count, sizeof(count)) != sizeof(count))
+            count = 0;
+#endif
+        return count;
+    }
+
+ private:
+    int fd;
+};
+
+// Use the results of each lookup, so it can't be optimized away
+static std::size_t sink;
+
+// Perform the recorded lookups of the given kind (or all, if kind is
+// 0), along with all the revision changes, returning the number of
+// lookups made.
+static std::size_t replay(
+    patrie<Rule,coverage> const& matcher, std::vector<lookup> const& lookups, char kind)
+{
+    auto const count = boost::make_function_output_iterator([](Rule const* r){ sink += r != 0; });
+    std::size_t n = 0;
+    for (auto const& l : lookups)
+    {
+        if (l.kind == 'r')
+        {
+            matcher.set_current_revision(l.revision);
+            continue;
+        }
+        if (kind && l.kind != kind)
+            continue;
+        ++n;
+        switch (l.kind)
+        {
+        case 'm': sink += matcher.longest_match(l.key, l.revision) != 0; break;
+        case 'g': matcher.git_subtree_rules(l.key, l.revision, count); break;
+        case 's': matcher.svn_subtree_rules(l.key, l.revision, count); break;
+        case 'b': matcher.svn_rules_beneath(l.key, l.revision, count); break;
+        case 'B': matcher.git_rules_beneath(l.key, l.revision, count); break;
+        default:
+            throw std::runtime_error(std::string("Unknown lookup kind: ") + l.kind);
+        }
+    }
+    return n;
+}
+
+// The same, for the longest_match lookups only, made by a component_trie
+static std::size_t replay_components(
+    component_trie<Rule> const& matcher, std::vector<lookup> const& lookups)
+{
+    std::size_t n = 0;
+    for (auto const& l : lookups)
+    {
+        if (l.kind != 'm')
+            continue;
+        ++n;
+        sink += matcher.longest_match(l.key, l.revision) != 0;
+    }
+    return n;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3 || argc > 4)
+    {
+        std::cerr << "usage: " << argv[0] << " RULES LOOKUPS [REPEAT]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        Ruleset ruleset(argv[1]);
+        std::vector<lookup> const lookups = read_lookups(argv[2]);
+        int const repeat = argc > 3 ? std::atoi(argv[3]) : 10;
+
+        cache_miss_counter misses;
+        std::cout << std::setw(20) << std::left << "lookup" << std::right
+                  << std::setw(12) << "count" << std::setw(12) << "ns/lookup"
+                  << std::setw(16) << "misses/lookup" << std::endl;
+
+        struct { char kind; char const* name; } const kinds[] = {
+            { 0, "all" },
+            { 'm', "longest_match" },
+            { 'g', "git_subtree_rules" },
+            { 's', "svn_subtree_rules" },
+            { 'b', "svn_rules_beneath" },
+            { 'B', "git_rules_beneath" }
+        };
+
+        component_trie<Rule> components;
+        for (Rule const& r : ruleset.matcher().all_rules())
+            components.insert(r);
+
+        // Time the lookups made by replay_lookups(), which returns
+        // how many it made
+        auto run = [&](char const* name, std::function<std::size_t()> const& replay_lookups)
+        {
+            std::size_t n = replay_lookups(); // warm up
+            if (n == 0)
+                return;
+
+            misses.start();
+            auto const start = std::chrono::steady_clock::now();
+            for (int i = 0; i < repeat; ++i)
+                replay_lookups();
+            auto const elapsed = std::chrono::steady_clock::now() - start;
+            std::uint64_t const miss_count = misses.stop();
+
+            double const total = double(n) * repeat;
+            std::cout << std::setw(20) << std::left << name << std::right
+                      << std::setw(12) << n << std::fixed << std::setprecision(1)
+                      << std::setw(12)
+                      << std::chrono::duration<double, std::nano>(elapsed).count() / total;
+            if (misses.available())
+                std::cout << std::setw(16) << miss_count / total;
+            else
+                std::cout << std::setw(16) << "n/a";
+            std::cout << std::endl;
+        };
+
+        for (auto const& k : kinds)
+            run(k.name, [&]{ return replay(ruleset.matcher(), lookups, k.kind); });
+        run("component_match", [&]{ return replay_components(components, lookups); });
+
+#ifdef SVN2GIT_COMPILED_MATCHER
+        if (ruleset.matcher().use_compiled_matcher(&generated_matcher))
+            run("compiled_match", [&]{ return replay(ruleset.matcher(), lookups, 'm'); });
+        else
+            std::cout << "(the compiled matcher is for other rules)" << std::endl;
+#endif
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << argv[0] << ": " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return sink == std::size_t(-1); // never true; keeps sink alive
+}
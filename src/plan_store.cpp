@@ -0,0 +1,249 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#include "plan_store.hpp"
+#include "log.hpp"
+#include "options.hpp"
+#include "rules_cache.hpp"
+#include "sha1.hpp"
+
+#include <boost/filesystem.hpp>
+#include <exception>
+
+namespace
+{
+    // What each image of the file holds: the first, what its plans
+    // were made by, and each of the rest, a revision's plan
+    std::uint64_t const header_format = 0x3130686e616c7032ull; // "2planh01"
+    std::uint64_t const plan_format = 0x3130736e616c7032ull;   // "2plans01"
+
+    std::uint64_t const no_rule = ~std::uint64_t(0);
+
+    // The offset within an image of its size, after the magic word
+    // and the format
+    std::size_t const image_start = 2 * sizeof(std::uint64_t);
+
+    // Begin an image of the given format, whose size is filled in by
+    // finish_image
+    state_file::writer& begin_image(state_file::writer& w, std::uint64_t format)
+    {
+        return w.word(format).word(0);
+    }
+
+    void finish_image(state_file::writer& w)
+    {
+        // What follows the size, through the complement of the size
+        // that ends the image
+        std::uint64_t const size = w.size() - image_start;
+        w.word(~size).word_at(image_start, size);
+    }
+
+    // What planning depends on but SVN's history, which never
+    // changes: the rules, and the options that change the plans
+    std::string fingerprint_of(std::string const& uuid, Ruleset const& rules)
+    {
+        sha1 h;
+        h.update(uuid).update(options.traversal_order)
+            .update(options.svn_mergeinfo ? "+mergeinfo" : "-mergeinfo")
+            .update(std::to_string(options.segment_start));
+        for (Rule const& r : rules.matcher().all_rules())
+        {
+            h.update('\n' + std::to_string(r.index) + ' ' + std::to_string(r.min) + ' '
+                     + std::to_string(r.max) + (r.excludes() ? " - " : " + "))
+                .update(r.svn_path().str()).update(" ").update(r.git_address());
+        }
+        return h.hex_digest();
+    }
+}
+
+plan_store::plan_store(svn const& repo, Ruleset const& rules)
+    : rules_by_index(rules.rule_count()), scanned(0), failed(false)
+{
+    std::string const uuid = repo.uuid();
+    fingerprint = fingerprint_of(uuid, rules);
+    boost::filesystem::path const dir = rules_cache::directory();
+    if (dir.empty())
+        return;
+    filename_ = (dir / (fingerprint + ".plans")).string();
+
+    for (Rule const& r : rules.matcher().all_rules())
+    {
+        if (r.index < rules_by_index.size())
+            rules_by_index[r.index] = &r;
+    }
+
+    boost::system::error_code ec;
+    if (boost::filesystem::exists(filename_, ec))
+        return;
+    try
+    {
+        boost::filesystem::create_directories(dir);
+        state_file::writer w;
+        begin_image(w, header_format).str(fingerprint).str(uuid);
+        finish_image(w);
+        w.append_to(filename_);
+    }
+    catch (std::exception const& e)
+    {
+        Log::warn() << "Couldn't keep revision plans: " << e.what() << std::endl;
+        failed = true;
+    }
+}
+
+bool plan_store::find(int revnum, revision_plan& plan)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (filename_.empty())
+        return false;
+    auto p = offsets.find(revnum);
+    if (p == offsets.end())
+    {
+        refresh();
+        p = offsets.find(revnum);
+        if (p == offsets.end())
+            return false;
+    }
+    try
+    {
+        read(p->second, plan);
+        return true;
+    }
+    catch (std::exception const&)
+    {
+        return false;
+    }
+}
+
+void plan_store::add(revision_plan const& plan)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (filename_.empty() || failed || offsets.count(plan.revnum))
+        return;
+
+    auto index = [](Rule const* r) { return r ? std::uint64_t(r->index) : no_rule; };
+    state_file::writer w;
+    begin_image(w, plan_format).word(plan.revnum).str(plan.log);
+    w.word(plan.deletions.size());
+    for (auto const& d : plan.deletions)
+        w.str(d.svn_path.str()).word(index(d.match));
+    w.word(plan.directory_copies.size());
+    for (auto const& c : plan.directory_copies)
+        w.str(c.directory.str()).str(c.src_directory.str()).word(c.src_revision);
+    w.word(plan.merges.size());
+    for (auto const& m : plan.merges)
+        w.word(index(m.match)).word(index(m.src_match)).str(m.copy.str());
+    w.word(plan.recorded_merges.size());
+    for (auto const& m : plan.recorded_merges)
+        w.word(index(m.match)).word(index(m.src_match)).word(m.src_revision);
+    w.word(plan.files.size());
+    for (auto const& f : plan.files)
+        w.str(f.svn_path.str()).word(index(f.match));
+    finish_image(w);
+
+    try
+    {
+        w.append_to(filename_);
+    }
+    catch (std::exception const& e)
+    {
+        Log::warn() << "Couldn't keep revision plans: " << e.what() << std::endl;
+        failed = true;
+    }
+}
+
+// Find the plans appended since the file was last read
+void plan_store::refresh()
+{
+    boost::system::error_code ec;
+    std::size_t const size = boost::filesystem::file_size(filename_, ec);
+    if (ec || size <= scanned || (file && size == file->size()))
+        return;
+    try
+    {
+        file.reset(new state_file::reader(filename_));
+        while (scanned + image_start + 2 * sizeof(std::uint64_t) <= file->size())
+        {
+            file->seek(scanned);
+            if (file->word() != state_file::magic)
+                break;
+            std::uint64_t const format = file->word();
+            std::uint64_t const image_size = file->word();
+            std::size_t const body = file->tell();
+            if (image_size < sizeof(std::uint64_t) || image_size % sizeof(std::uint64_t) != 0
+                || image_size > file->size() - body)
+            {
+                break;
+            }
+            std::size_t const end = body + image_size;
+            file->seek(end - sizeof(std::uint64_t));
+            if (file->word() != ~image_size)
+                break;
+
+            file->seek(body);
+            if (format == plan_format)
+                offsets.emplace(int(file->word()), scanned);
+            else if (format != header_format)
+                break;
+            else if (file->str() != fingerprint)
+            {
+                // Not what the name promises; leave it be
+                failed = true;
+                offsets.clear();
+                break;
+            }
+            scanned = end;
+        }
+    }
+    catch (std::exception const&) {}
+}
+
+// Read the plan whose image begins at offset
+void plan_store::read(std::size_t offset, revision_plan& plan)
+{
+    file->seek(offset + image_start + sizeof(std::uint64_t));
+    plan.clear();
+    plan.revnum = int(file->word());
+    plan.log = file->str();
+    plan.deletions.resize(file->word());
+    for (auto& d : plan.deletions)
+    {
+        d.svn_path = file->str();
+        d.match = rule(file->word());
+    }
+    plan.directory_copies.resize(file->word());
+    for (auto& c : plan.directory_copies)
+    {
+        c.directory = file->str();
+        c.src_directory = file->str();
+        c.src_revision = file->word();
+    }
+    plan.merges.resize(file->word());
+    for (auto& m : plan.merges)
+    {
+        m.match = rule(file->word());
+        m.src_match = rule(file->word());
+        m.copy = file->str();
+    }
+    plan.recorded_merges.resize(file->word());
+    for (auto& m : plan.recorded_merges)
+    {
+        m.match = rule(file->word());
+        m.src_match = rule(file->word());
+        m.src_revision = file->word();
+    }
+    plan.files.resize(file->word());
+    for (auto& f : plan.files)
+    {
+        f.svn_path = file->str();
+        f.match = rule(file->word());
+    }
+}
+
+Rule const* plan_store::rule(std::uint64_t index) const
+{
+    if (index == no_rule)
+        return nullptr;
+    if (index >= rules_by_index.size() || !rules_by_index[index])
+        throw std::runtime_error("a plan in " + filename_ + " names an unknown rule");
+    return rules_by_index[index];
+}
@@ -0,0 +1,68 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef PLAN_STORE_DWA20131129_HPP
+# define PLAN_STORE_DWA20131129_HPP
+
+# include "revision_planner.hpp"
+# include "state_file.hpp"
+
+# include <cstddef>
+# include <memory>
+# include <mutex>
+# include <string>
+# include <unordered_map>
+# include <vector>
+
+// With --keep-plans, the plan of each revision converted, kept so that
+// later runs with the same rules read it instead of planning the
+// revision again, and so that other processes converting the same
+// revisions with them, e.g. resuming or replaying, can read what one
+// has planned as it goes.
+//
+// The plans are kept in the cache directory, beside the SVN changes
+// index, in a file named for a SHA-1 of the repository's UUID, the
+// rules and the options that affect planning, so that a plan is only
+// ever read back by a run that would have planned the same.  Each plan
+// is appended as it is made, as a state_file image of its own: the
+// format, the size of the rest, the revision, the plan, with each
+// rule as its Rule::index, and the revision's complement, which marks
+// the plan complete.  A plan cut short, e.g. by a crash, ends the
+// plans read.
+class plan_store
+{
+ public:
+    plan_store(svn const& repo, Ruleset const& rules);
+
+    // If the plan of revnum is stored, set plan to it and return true.
+    // Plans appended since the last lookup, by this or another
+    // process, are found.
+    bool find(int revnum, revision_plan& plan);
+
+    // Store plan, unless its revision's is stored already.  Failure
+    // only costs a later run planning the revision again, so it is
+    // logged, and storing is given up.
+    void add(revision_plan const& plan);
+
+    std::string const& filename() const { return filename_; }
+
+ private:
+    plan_store(plan_store const&);
+    plan_store& operator=(plan_store const&);
+
+    void refresh();
+    void read(std::size_t offset, revision_plan& plan);
+    Rule const* rule(std::uint64_t index) const;
+
+    std::string filename_;
+    std::string fingerprint;
+    std::vector<Rule const*> rules_by_index;
+
+    std::mutex mutex;           // guards everything below
+    std::unique_ptr<state_file::reader> file;  // null until there is one
+    std::size_t scanned;        // the end of the last whole plan found
+    std::unordered_map<int, std::size_t> offsets; // of each plan found
+    bool failed;                // true once storing is given up
+};
+
+#endif // PLAN_STORE_DWA20131129_HPP
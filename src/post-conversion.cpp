@@ -0,0 +1,365 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Prunes, garbage-collects and pushes the converted repositories,
+// several at a time.
+#include "AST.hpp"
+#include "parse_rules.hpp"
+#include <boost/program_options.hpp>
+#include <boost/process.hpp>
+#include <boost/iostreams/device/file_descriptor.hpp>
+#include <boost/iostreams/stream.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/foreach.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace post_conversion {
+
+struct Options
+  {
+  std::string rules_file;
+  std::string git;
+  std::vector<std::string> directories;   // NAME=PATH
+  std::vector<std::string> only;
+  unsigned jobs;
+  bool push;
+  };
+
+Options options;
+
+// The SHA-1 of the tree with no entries
+char const empty_tree_sha[] = "4b825dc642cb6eb9a060e54bf8d69288fbee4904";
+
+// GitHub does not accept files bigger than 100MB, so the sandbox is
+// pushed to Bitbucket only.
+char const* const remotes[] = { "git@bitbucket.org:boostorg/", "git@github.com:boostorg/" };
+
+struct Repository
+  {
+  std::string name;
+  std::string dir;
+  };
+
+struct Result
+  {
+  double cleanup_seconds;
+  double push_seconds;
+  std::string error;
+  };
+
+struct git_failure : std::runtime_error
+  {
+  git_failure(std::vector<std::string> const& args, std::string const& output)
+    : std::runtime_error(describe(args, output)) {}
+
+  static std::string describe(std::vector<std::string> const& args, std::string const& output)
+    {
+    std::string message = "git";
+    for (std::size_t i = 1; i < args.size(); ++i)
+      message += " " + args[i];
+    return message + " failed" + (output.empty() ? "" : ":\n" + output);
+    }
+  };
+
+// Run git with args in dir and return what it wrote to its standard
+// output, and to its standard error too if with_stderr is set.  Throw
+// git_failure if it exits unsuccessfully.
+std::string git(std::string const& dir, std::vector<std::string> args, bool with_stderr = true)
+  {
+  namespace iostreams = boost::iostreams;
+  using namespace boost::process::initializers;
+  args.insert(args.begin(), options.git);
+
+  // Close-on-exec, so the children started by other threads meanwhile
+  // don't hold the pipe open and keep us from seeing its end
+  int fds[2];
+  if (::pipe2(fds, O_CLOEXEC) != 0)
+    throw std::runtime_error("Couldn't create a pipe");
+  iostreams::file_descriptor_source source(fds[0], iostreams::close_handle);
+
+  boost::process::child child = [&]
+    {
+    iostreams::file_descriptor_sink sink(fds[1], iostreams::close_handle);
+    if (with_stderr)
+      return boost::process::execute(
+        run_exe(options.git), set_args(args), start_in_dir(dir),
+        bind_stdout(sink), bind_stderr(sink), throw_on_error());
+    return boost::process::execute(
+      run_exe(options.git), set_args(args), start_in_dir(dir),
+      bind_stdout(sink), throw_on_error());
+    }();
+
+  iostreams::stream<iostreams::file_descriptor_source> output_stream(source);
+  std::string const output(
+    (std::istreambuf_iterator<char>(output_stream)), std::istreambuf_iterator<char>());
+  int const status = boost::process::wait_for_exit(child);
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    throw git_failure(args, output);
+  return output;
+  }
+
+std::vector<std::string> lines(std::string const& text)
+  {
+  std::vector<std::string> result;
+  std::istringstream in(text);
+  for (std::string line; std::getline(in, line);)
+    result.push_back(line);
+  return result;
+  }
+
+// A repository converted with --shared-objects borrows the blobs
+// written to the others through objects/info/alternates.  Copy them
+// into a pack of its own and drop the link, so that cleaning up the
+// others can't take them away.
+void dissociate(Repository const& repo)
+  {
+  std::string const alternates = repo.dir + "/objects/info/alternates";
+  if (!std::ifstream(alternates.c_str()))
+    return;
+  git(repo.dir, { "repack", "-a", "-d", "--quiet" });
+  if (std::remove(alternates.c_str()) != 0)
+    throw std::runtime_error("Couldn't remove " + alternates);
+  }
+
+// Delete the branches merged into HEAD, and those whose tree is empty,
+// each set with a single git process, then collect garbage if needed
+void cleanup(Repository const& repo)
+  {
+  std::vector<std::string> merged = { "branch", "-d" };
+  BOOST_FOREACH(std::string const& line, lines(git(repo.dir, { "branch", "--merged" }, false)))
+    {
+    if (line.size() > 2 && line[0] != '*')
+      merged.push_back(line.substr(2));
+    }
+  if (merged.size() > 2)
+    git(repo.dir, merged);
+
+  std::vector<std::string> empty = { "branch", "-D" };
+  std::vector<std::string> const heads = lines(git(
+    repo.dir, { "for-each-ref", "--format=%(tree) %(refname:short)", "refs/heads" }, false));
+  BOOST_FOREACH(std::string const& line, heads)
+    {
+    if (boost::starts_with(line, empty_tree_sha) && line.size() > sizeof(empty_tree_sha))
+      empty.push_back(line.substr(sizeof(empty_tree_sha)));
+    }
+  if (empty.size() > 2)
+    git(repo.dir, empty);
+
+  git(repo.dir, { "gc", "--auto", "--quiet" });
+
+  // allow pushing bigger files
+  git(repo.dir, { "config", "http.postBuffer", "524288000" });
+  }
+
+void push(Repository const& repo)
+  {
+  for (std::size_t i = 0; i < sizeof(remotes) / sizeof(*remotes); ++i)
+    {
+    if (i != 0 && repo.name == "sandbox")
+      break;
+    std::vector<std::string> const args = {
+      "push", "--quiet", "--mirror", remotes[i] + repo.name + ".git" };
+    try
+      {
+      git(repo.dir, args);
+      }
+    catch (git_failure const&)
+      {
+      // try again
+      git(repo.dir, args);
+      }
+    }
+  }
+
+Result process(Repository const& repo)
+  {
+  typedef std::chrono::steady_clock clock;
+  auto seconds = [](clock::time_point start)
+    {
+    return std::chrono::duration<double>(clock::now() - start).count();
+    };
+
+  Result result = { 0, 0, std::string() };
+  double* step_seconds = &result.cleanup_seconds;
+  clock::time_point start = clock::now();
+  try
+    {
+    // don't bother with the sandbox
+    if (repo.name != "sandbox")
+      cleanup(repo);
+    result.cleanup_seconds = seconds(start);
+    step_seconds = &result.push_seconds;
+    start = clock::now();
+    if (options.push)
+      push(repo);
+    result.push_seconds = seconds(start);
+    }
+  catch (std::exception const& error)
+    {
+    *step_seconds = seconds(start);
+    result.error = error.what();
+    }
+  return result;
+  }
+
+// The non-abstract repositories of the ruleset, in the current
+// directory unless placed elsewhere with --dir, restricted to those
+// named on the command line if any are
+std::vector<Repository> repositories()
+  {
+  std::map<std::string, std::string> dirs;
+  BOOST_FOREACH(std::string const& d, options.directories)
+    {
+    std::string::size_type const eq = d.find('=');
+    if (eq == std::string::npos)
+      throw std::runtime_error("--dir expects NAME=PATH, not " + d);
+    dirs[d.substr(0, eq)] = d.substr(eq + 1);
+    }
+
+  std::set<std::string> const only(options.only.begin(), options.only.end());
+  std::vector<Repository> result;
+  BOOST_FOREACH(boost2git::RepoRule const& rule, parse_rules_file(options.rules_file))
+    {
+    if (rule.is_abstract || (!only.empty() && !only.count(rule.git_repo_name)))
+      continue;
+    auto const d = dirs.find(rule.git_repo_name);
+    Repository repo = { rule.git_repo_name, d == dirs.end() ? rule.git_repo_name : d->second };
+    result.push_back(repo);
+    }
+  return result;
+  }
+
+// Call f(i) for every index i of repos, on up to options.jobs threads
+template <class F>
+void for_each_in_parallel(std::vector<Repository> const& repos, F const& f)
+  {
+  std::atomic<std::size_t> next(0);
+  auto worker = [&]()
+    {
+    for (std::size_t i; (i = next++) < repos.size();)
+      f(i);
+    };
+
+  std::vector<std::thread> threads;
+  for (unsigned n = std::max(1u, std::min<unsigned>(options.jobs, repos.size())); n > 1; --n)
+    threads.emplace_back(worker);
+  worker();
+  BOOST_FOREACH(std::thread& t, threads)
+    t.join();
+  }
+
+// Process every repository on up to options.jobs threads, reporting
+// each one's times as it finishes.  Return the number that failed.
+std::size_t run()
+  {
+  std::vector<Repository> const repos = repositories();
+  std::vector<Result> results(repos.size());
+  std::mutex report_mutex;
+  auto const start = std::chrono::steady_clock::now();
+
+  // Every repository must have its own copy of the objects it
+  // borrows before any is cleaned up
+  for_each_in_parallel(repos, [&](std::size_t i)
+    {
+    try
+      {
+      dissociate(repos[i]);
+      }
+    catch (std::exception const& error)
+      {
+      results[i].error = error.what();
+      }
+    });
+
+  for_each_in_parallel(repos, [&](std::size_t i)
+    {
+    if (results[i].error.empty())
+      results[i] = process(repos[i]);
+    std::lock_guard<std::mutex> lock(report_mutex);
+    std::printf("%-24s cleanup %8.2fs  push %8.2fs%s\n", repos[i].name.c_str(),
+      results[i].cleanup_seconds, results[i].push_seconds,
+      results[i].error.empty() ? "" : "  FAILED");
+    std::fflush(stdout);
+    });
+
+  std::size_t failures = 0;
+  for (std::size_t i = 0; i < repos.size(); ++i)
+    {
+    if (!results[i].error.empty())
+      {
+      ++failures;
+      std::cerr << repos[i].name << ": " << results[i].error << std::endl;
+      }
+    }
+  std::printf("%lu repositories in %.2fs, %lu failed\n", (unsigned long)repos.size(),
+    std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(),
+    (unsigned long)failures);
+  return failures;
+  }
+} // namespace post_conversion
+
+int main(int argc, char **argv)
+  {
+  using post_conversion::options;
+  namespace po = boost::program_options;
+  po::options_description program_options("Allowed options");
+  program_options.add_options()
+    ("help,h", "produce help message")
+    ("rules", po::value(&options.rules_file)->value_name("FILENAME")->required(),
+      "file with the conversion rules")
+    ("git", po::value(&options.git)->value_name("PATH"),
+      "the git executable to use (by default the one on the PATH)")
+    ("dir", po::value(&options.directories)->value_name("NAME=PATH"),
+      "the repository NAME is at PATH, not in the directory of the same name")
+    ("jobs,j", po::value(&options.jobs)->value_name("NUMBER")->default_value(8),
+      "process NUMBER repositories at a time")
+    ("push", po::bool_switch(&options.push), "push each repository after cleaning it up")
+    ("repository", po::value(&options.only)->value_name("NAME"),
+      "process only the named repositories")
+    ;
+  po::positional_options_description positional;
+  positional.add("repository", -1);
+
+  po::variables_map variables;
+  store(po::command_line_parser(argc, argv)
+    .options(program_options)
+    .positional(positional)
+    .run(), variables);
+  if (variables.count("help"))
+    {
+    std::cout << "Usage: " << argv[0] << " [options] [NAME...]\n"
+              << program_options << std::endl;
+    return 0;
+    }
+  notify(variables);
+
+  try
+    {
+    if (options.git.empty())
+      options.git = boost::process::search_path("git");
+    return post_conversion::run() == 0 ? 0 : 1;
+    }
+  catch (std::exception& error)
+    {
+    std::cerr << error.what() << std::endl;
+    return -1;
+    }
+  }
@@ -0,0 +1,38 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef PROBES_DWA20131201_HPP
+# define PROBES_DWA20131201_HPP
+
+// Static tracepoints, USDT probes of the provider svn2git, for
+// bpftrace, perf or SystemTap to attach to a running conversion, e.g.
+//
+//   bpftrace -e 'usdt:./svn2git:svn2git:revision__start { @s = nsecs }
+//                usdt:./svn2git:svn2git:revision__done { @ms = hist((nsecs - @s) / 1000000) }'
+//
+// A probe not attached to is a single no-op instruction, but its
+// arguments are still computed, so they are kept to what is at hand.
+// Where <sys/sdt.h> is missing, the probes, and their arguments, are
+// compiled out.
+//
+//   revision__start, revision__done  (int revnum)
+//   convert_file__start, convert_file__done  (char const* svn_path)
+//   file__contents  (char const* svn_path, std::uint64_t bytes), when
+//       the contents of a file converted are written
+//   commit__open, commit__close  (char const* repository, char const* ref)
+//   ls__send  (char const* git_dir, char const* dataref_path)
+//   readline__start, readline__done  (char const* git_dir)
+//   rule_match__start  (std::size_t key_size, std::size_t revision)
+//   rule_match__done  (bool found)
+# ifdef SVN2GIT_HAVE_SDT
+#  include <sys/sdt.h>
+#  define SVN2GIT_PROBE0(name) DTRACE_PROBE(svn2git, name)
+#  define SVN2GIT_PROBE1(name, a) DTRACE_PROBE1(svn2git, name, a)
+#  define SVN2GIT_PROBE2(name, a, b) DTRACE_PROBE2(svn2git, name, a, b)
+# else
+#  define SVN2GIT_PROBE0(name) ((void)0)
+#  define SVN2GIT_PROBE1(name, a) ((void)0)
+#  define SVN2GIT_PROBE2(name, a, b) ((void)0)
+# endif
+
+#endif // PROBES_DWA20131201_HPP
@@ -0,0 +1,380 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#include "profile.hpp"
+#include "options.hpp"
+#include "lru_cache.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <time.h>
+#include <unistd.h>
+
+struct profile_stats
+{
+    profile_stats() : calls(0), wall(0), cpu(0), bytes(0) {}
+
+    std::uint64_t calls;
+    double wall;                // seconds
+    double cpu;                 // seconds
+    std::uint64_t bytes;
+};
+
+namespace
+{
+    std::string const no_repository;
+
+    // Keyed by identity; names are only compared when reporting
+    typedef std::map<std::pair<char const*, std::string const*>, profile_stats> stats_map;
+    stats_map all_stats;
+
+    // With --slow-revisions, those of the revision being imported,
+    // timed by the wall clock alone, and the caches' counts as it
+    // began.  Entries are zeroed rather than erased, since scopes may
+    // hold them.
+    stats_map revision_stats;
+    std::map<std::string, cache_stats> revision_caches;
+
+    // Those of the tasks run on other threads, by phase, and the lock
+    // they and the trace are written under
+    std::map<char const*, profile_stats> task_stats;
+    std::mutex shared;
+
+    profile_stats& stats_for(char const* phase, std::string const* repo, stats_map& stats = all_stats)
+    {
+        return stats[std::make_pair(phase, repo ? repo : &no_repository)];
+    }
+
+    // Write s as a JSON string
+    void write_json(std::ostream& os, std::string const& s)
+    {
+        os << '"';
+        for (char c : s)
+        {
+            if (c == '"' || c == '\\')
+                os << '\\' << c;
+            else if ((unsigned char)c < 0x20)
+            {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                os << escaped;
+            }
+            else
+                os << c;
+        }
+        os << '"';
+    }
+
+    // The --trace-file: a JSON array of events, which the viewers
+    // accept unterminated, should the conversion die part way
+    struct trace_writer
+    {
+        trace_writer() : start(std::chrono::steady_clock::now()), pid(::getpid()) {}
+
+        ~trace_writer()
+        {
+            if (out.is_open())
+                out << "\n]\n";
+        }
+
+        // Begin an event at time t, in the track of repo, or in the
+        // importer's if repo is null, leaving its fields open.
+        std::ostream& begin_event(
+            char const* type, std::string const& name, std::string const* repo,
+            std::chrono::steady_clock::time_point t)
+        {
+            if (!out.is_open())
+            {
+                out.open(options.trace_file.c_str(), std::ios::trunc);
+                if (!out)
+                    throw std::runtime_error("Couldn't open trace file " + options.trace_file);
+                out << "[";
+                name_track(1, "importer");
+            }
+
+            int tid = 1;
+            if (repo)
+            {
+                auto p = tracks.find(*repo);
+                if (p == tracks.end())
+                {
+                    p = tracks.emplace(*repo, int(tracks.size()) + 2).first;
+                    name_track(p->second, *repo);
+                }
+                tid = p->second;
+            }
+
+            out << ",\n{\"ph\":\"" << type << "\",\"name\":";
+            write_json(out, name);
+            return out << ",\"pid\":" << pid << ",\"tid\":" << tid << ",\"ts\":" 
+                       << std::fixed << std::setprecision(1) << microseconds(t);
+        }
+
+        double microseconds(std::chrono::steady_clock::time_point t) const
+        {
+            return std::chrono::duration<double, std::micro>(t - start).count();
+        }
+
+        std::ofstream out;
+        std::chrono::steady_clock::time_point const start;
+        int const pid;
+        std::map<std::string, int> tracks;    // by repository name
+
+     private:
+        void name_track(int tid, std::string const& name)
+        {
+            out << (tid == 1 ? "\n" : ",\n") << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":" 
+                << pid << ",\"tid\":" << tid << ",\"args\":{\"name\":";
+            write_json(out, name);
+            out << "}}";
+        }
+    };
+    trace_writer trace;
+
+    double thread_cpu_seconds()
+    {
+        timespec t;
+        ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+        return t.tv_sec + t.tv_nsec * 1e-9;
+    }
+
+    typedef std::map<std::pair<std::string, std::string>, profile_stats> sorted_stats_map;
+
+    void merge_into(sorted_stats_map& result, std::string const& phase, std::string const& repo,
+                    profile_stats const& x)
+    {
+        profile_stats& s = result[std::make_pair(phase, repo)];
+        s.calls += x.calls;
+        s.wall += x.wall;
+        s.cpu += x.cpu;
+        s.bytes += x.bytes;
+    }
+
+    // The totals of stats, by phase and then repository name.  The
+    // same phase name may appear at different addresses in different
+    // translation units, so they're merged here.
+    sorted_stats_map sorted(stats_map const& stats)
+    {
+        sorted_stats_map result;
+        for (auto const& kv : stats)
+            merge_into(result, kv.first.first, *kv.first.second, kv.second);
+        return result;
+    }
+
+    // The totals, with those of the tasks
+    sorted_stats_map sorted_stats()
+    {
+        sorted_stats_map result = sorted(all_stats);
+        std::lock_guard<std::mutex> lock(shared);
+        for (auto const& kv : task_stats)
+            merge_into(result, kv.first, "(tasks)", kv.second);
+        return result;
+    }
+}
+
+profile::scope::scope(char const* phase, std::string const* repo, bool traced)
+    : phase(phase), repo(repo),
+      s(options.profile ? &stats_for(phase, repo) : nullptr),
+      r(options.slow_revisions.empty() ? nullptr : &stats_for(phase, repo, revision_stats)),
+      traced(traced && !options.trace_file.empty()),
+      bytes(0)
+{
+    if (!s && !r && options.trace_file.empty())
+        return;
+    wall_start = std::chrono::steady_clock::now();
+    cpu_start = s ? thread_cpu_seconds() : 0;
+}
+
+void profile::scope::trace_file(std::string const& svn_path, std::uint64_t bytes)
+{
+    if (options.trace_file.empty() || bytes < std::uint64_t(options.trace_min_file_size))
+        return;
+    traced = true;
+    detail = svn_path;
+    this->bytes = bytes;
+}
+
+profile::scope::~scope()
+{
+    if (!s && !r && !traced)
+        return;
+    auto const wall_end = std::chrono::steady_clock::now();
+    double const wall = std::chrono::duration<double>(wall_end - wall_start).count();
+    if (s)
+    {
+        ++s->calls;
+        s->wall += wall;
+        s->cpu += thread_cpu_seconds() - cpu_start;
+    }
+    if (r)
+    {
+        ++r->calls;
+        r->wall += wall;
+    }
+    if (traced)
+    {
+        std::lock_guard<std::mutex> lock(shared);
+        std::ostream& os = trace.begin_event("X", phase, repo, wall_start);
+        os << ",\"dur\":" << trace.microseconds(wall_end) - trace.microseconds(wall_start);
+        if (!detail.empty())
+        {
+            os << ",\"args\":{\"path\":";
+            write_json(os, detail);
+            os << ",\"bytes\":" << bytes << "}";
+        }
+        os << "}";
+    }
+}
+
+void profile::add(char const* phase, std::string const& repo, std::uint64_t bytes)
+{
+    for (stats_map* stats : { options.profile ? &all_stats : nullptr,
+                              options.slow_revisions.empty() ? nullptr : &revision_stats })
+    {
+        if (!stats)
+            continue;
+        profile_stats& s = stats_for(phase, &repo, *stats);
+        ++s.calls;
+        s.bytes += bytes;
+    }
+}
+
+void profile::task(
+    char const* phase, unsigned worker, std::chrono::steady_clock::time_point start,
+    std::chrono::steady_clock::time_point end, double cpu_seconds)
+{
+    if (!options.profile && options.trace_file.empty())
+        return;
+    std::lock_guard<std::mutex> lock(shared);
+    if (options.profile)
+    {
+        profile_stats& s = task_stats[phase];
+        ++s.calls;
+        s.wall += std::chrono::duration<double>(end - start).count();
+        s.cpu += cpu_seconds;
+    }
+    if (!options.trace_file.empty())
+    {
+        std::string const track = "worker " + std::to_string(worker);
+        trace.begin_event("X", phase, &track, start)
+            << ",\"dur\":" << trace.microseconds(end) - trace.microseconds(start) << "}";
+    }
+}
+
+void profile::counter(char const* name, std::string const& repo, std::uint64_t value)
+{
+    if (options.trace_file.empty())
+        return;
+    // Viewers group counters by name alone
+    std::lock_guard<std::mutex> lock(shared);
+    trace.begin_event("C", std::string(name) + " " + repo, nullptr, std::chrono::steady_clock::now())
+        << ",\"args\":{\"bytes\":" << value << "}}";
+}
+
+void profile::revision_done(int revnum)
+{
+    if (!options.profile || options.profile_csv.empty() 
+        || options.profile_interval <= 0 || revnum % options.profile_interval != 0)
+        return;
+
+    static std::ofstream csv;
+    if (!csv.is_open())
+    {
+        csv.open(options.profile_csv.c_str(), std::ios::trunc);
+        if (!csv)
+            throw std::runtime_error("Couldn't open profile file " + options.profile_csv);
+        csv << "revision,phase,repository,calls,wall_seconds,cpu_seconds,bytes\n";
+    }
+
+    for (auto const& x : sorted_stats())
+    {
+        csv << revnum << ',' << x.first.first << ',' << x.first.second << ',' 
+            << x.second.calls << ',' << x.second.wall << ',' << x.second.cpu << ',' 
+            << x.second.bytes << '\n';
+    }
+    csv.flush();
+}
+
+void profile::begin_revision()
+{
+    if (options.slow_revisions.empty())
+        return;
+    for (auto& kv : revision_stats)
+        kv.second = profile_stats();
+    revision_caches = cache_registry::totals();
+}
+
+bool profile::end_revision(
+    int revnum, double seconds, std::function<void(std::ostream&)> const& details)
+{
+    if (options.slow_revisions.empty() || seconds < options.slow_revision_seconds)
+        return false;
+
+    static std::ofstream report;
+    if (!report.is_open())
+    {
+        report.open(options.slow_revisions.c_str(), std::ios::app);
+        if (!report)
+            throw std::runtime_error("Couldn't open slow revisions file " + options.slow_revisions);
+    }
+
+    report << "r" << revnum << " took " << std::fixed << std::setprecision(3) << seconds << "s\n"
+           << "  " << std::setw(24) << std::left << "phase" << std::setw(32) << "repository"
+           << std::right << std::setw(12) << "calls" << std::setw(12) << "wall"
+           << std::setw(16) << "bytes" << '\n';
+    for (auto const& x : sorted(revision_stats))
+    {
+        if (x.second.calls == 0)
+            continue;
+        report << "  " << std::setw(24) << std::left << x.first.first
+               << std::setw(32) << x.first.second << std::right
+               << std::setw(12) << x.second.calls << std::setw(12) << x.second.wall
+               << std::setw(16) << x.second.bytes << '\n';
+    }
+
+    report << "  " << std::setw(24) << std::left << "cache" << std::right
+           << std::setw(14) << "hits" << std::setw(14) << "misses" << '\n';
+    for (auto const& c : cache_registry::totals())
+    {
+        cache_stats const& before = revision_caches[c.first];
+        std::uint64_t const hits = c.second.hits - before.hits;
+        std::uint64_t const misses = c.second.misses - before.misses;
+        if (hits + misses == 0)
+            continue;
+        report << "  " << std::setw(24) << std::left << c.first << std::right
+               << std::setw(14) << hits << std::setw(14) << misses << '\n';
+    }
+
+    details(report);
+    report << std::endl;
+    return true;
+}
+
+void profile::report()
+{
+    if (!options.profile)
+        return;
+
+    std::cout << "Profile (times in seconds; nested phases are included in their parents):\n"
+              << std::setw(24) << std::left << "phase" << std::setw(32) << "repository"
+              << std::right << std::setw(12) << "calls" << std::setw(12) << "wall" 
+              << std::setw(12) << "cpu" << std::setw(16) << "bytes" << '\n';
+
+    for (auto const& x : sorted_stats())
+    {
+        std::cout << std::setw(24) << std::left << x.first.first 
+                  << std::setw(32) << x.first.second << std::right
+                  << std::setw(12) << x.second.calls 
+                  << std::fixed << std::setprecision(3)
+                  << std::setw(12) << x.second.wall << std::setw(12) << x.second.cpu 
+                  << std::setw(16) << x.second.bytes << '\n';
+    }
+    std::cout << std::flush;
+    cache_registry::report(std::cout);
+}
@@ -0,0 +1,97 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef PROFILE_DWA20131026_HPP
+# define PROFILE_DWA20131026_HPP
+
+# include <chrono>
+# include <cstdint>
+# include <functional>
+# include <ostream>
+# include <string>
+
+struct profile_stats;
+
+// Where the conversion spends its time, enabled by --profile.  Each
+// phase of import_revision accumulates call counts, wall-clock time
+// and main-thread CPU time, optionally per Git repository.  Phases
+// may nest, in which case the outer phase's times include the inner
+// one's.  Everything here is meant to be used from the main thread,
+// except profile::task.
+//
+// With --trace-file, each phase is also written as a span of a
+// timeline in Chrome's Trace Event Format, which Perfetto and
+// chrome://tracing display.  Phases charged to a repository appear
+// in a track of their own for it.
+//
+// With --slow-revisions, each phase's calls, wall-clock time and
+// bytes are also counted for the revision being imported, and a
+// revision that takes at least --slow-revision-seconds has them
+// reported.
+struct profile
+{
+    // Charges the time until destruction to the given phase and, if
+    // repo is non-null, repository.  repo must outlive the program's
+    // report, as repository names do.  Unless traced is false, the
+    // phase is written to the trace too.
+    struct scope
+    {
+        explicit scope(char const* phase, std::string const* repo = nullptr, bool traced = true);
+        ~scope();
+
+        // Trace this phase as the writing of the file at svn_path,
+        // holding the given number of bytes, if it is at least
+        // --trace-min-file-size
+        void trace_file(std::string const& svn_path, std::uint64_t bytes);
+
+        scope(scope const&) = delete;
+        void operator=(scope const&) = delete;
+
+     private:
+        char const* phase;
+        std::string const* repo;
+        profile_stats* s;        // null unless profiling
+        profile_stats* r;        // the revision's; null without --slow-revisions
+        bool traced;
+        std::chrono::steady_clock::time_point wall_start;
+        double cpu_start;
+        std::string detail;      // the traced file's path
+        std::uint64_t bytes;
+    };
+
+    // Count one event of the given phase, involving the given number
+    // of bytes
+    static void add(char const* phase, std::string const& repo, std::uint64_t bytes);
+
+    // Charge a task run by a task_scheduler to the given phase, and
+    // with --trace-file, trace it in a track for its worker.  Unlike
+    // the rest, this may be called from any thread; it is the
+    // schedulers' timer.
+    static void task(
+        char const* phase, unsigned worker, std::chrono::steady_clock::time_point start,
+        std::chrono::steady_clock::time_point end, double cpu_seconds);
+
+    // With --trace-file, record the value of the named counter for
+    // repo
+    static void counter(char const* name, std::string const& repo, std::uint64_t value);
+
+    // Called after each revision; appends the running totals to the
+    // CSV file every --profile-interval revisions.
+    static void revision_done(int revnum);
+
+    // With --slow-revisions, start counting a revision's phases
+    // afresh, and note the caches' counts as it begins
+    static void begin_revision();
+
+    // With --slow-revisions, if the revision begun last took seconds,
+    // at least --slow-revision-seconds, append its phases, its cache
+    // lookups, and whatever details writes, to the report.  Returns
+    // true iff it did.
+    static bool end_revision(
+        int revnum, double seconds, std::function<void(std::ostream&)> const& details);
+
+    // Print the totals
+    static void report();
+};
+
+#endif // PROFILE_DWA20131026_HPP
@@ -0,0 +1,151 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#include "push_workers.hpp"
+#include "git_repository.hpp"
+#include "log.hpp"
+
+#include <boost/filesystem.hpp>
+#include <algorithm>
+#include <stdexcept>
+
+push_workers::push_workers(std::string const& remote, unsigned threads, int kilobytes_per_second)
+    : remote(remote), bytes_per_second(kilobytes_per_second * 1024.0),
+      next_start(std::chrono::steady_clock::now()), stopping(false)
+{
+    for (unsigned n = std::max(threads, 1u); n > 0; --n)
+        this->threads.emplace_back([this] { work(); });
+}
+
+push_workers::~push_workers()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        queue.clear();
+    }
+    wake.notify_all();
+    for (auto& t : threads)
+        t.join();
+}
+
+void push_workers::push(std::string const& git_dir)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        retry_failed();
+        enqueue(git_dir);
+    }
+    wake.notify_all();
+}
+
+void push_workers::enqueue(std::string const& git_dir)
+{
+    if (std::find(queue.begin(), queue.end(), git_dir) == queue.end())
+        queue.push_back(git_dir);
+}
+
+void push_workers::retry_failed()
+{
+    for (auto const& git_dir : failed)
+        enqueue(git_dir);
+    failed.clear();
+}
+
+void push_workers::wait()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    retry_failed();
+    wake.notify_all();
+    idle.wait(lock, [this] { return queue.empty() && pushing.empty(); });
+    if (failed.empty())
+        return;
+
+    std::string dirs;
+    for (auto const& git_dir : failed)
+        dirs += (dirs.empty() ? "" : ", ") + git_dir;
+    throw std::runtime_error("git push to " + remote + " failed in " + dirs);
+}
+
+std::uint64_t push_workers::pack_bytes(std::string const& git_dir)
+{
+    namespace fs = boost::filesystem;
+    boost::system::error_code ec;
+    std::uint64_t total = 0;
+    for (fs::directory_iterator i(fs::path(git_dir) / "objects" / "pack", ec), end;
+         !ec && i != end; i.increment(ec))
+    {
+        if (i->path().extension() == ".pack")
+        {
+            std::uint64_t const size = fs::file_size(i->path(), ec);
+            if (!ec)
+                total += size;
+            ec.clear();
+        }
+    }
+    return total;
+}
+
+void push_workers::work()
+{
+    typedef std::chrono::steady_clock clock;
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;)
+    {
+        // A repository being pushed waits for that push to finish
+        auto next = queue.end();
+        wake.wait(lock, [&] {
+            next = std::find_if(queue.begin(), queue.end(), [this](std::string const& d) {
+                return !pushing.count(d);
+            });
+            return stopping || next != queue.end();
+        });
+        if (stopping)
+            return;
+        std::string const git_dir = *next;
+        queue.erase(next);
+        pushing.insert(git_dir);
+
+        // Each push takes its share of the bandwidth before it starts
+        std::uint64_t bytes = 0;
+        if (bytes_per_second > 0)
+        {
+            lock.unlock();
+            bytes = pack_bytes(git_dir);
+            lock.lock();
+            std::uint64_t const before = pushed_pack_bytes[git_dir];
+            auto const start = std::max(next_start, clock::now());
+            next_start = start + std::chrono::duration_cast<clock::duration>(
+                std::chrono::duration<double>((bytes > before ? bytes - before : 0) / bytes_per_second));
+            if (wake.wait_until(lock, start, [this] { return stopping; }))
+                return;
+        }
+
+        lock.unlock();
+        bool pushed = true;
+        try
+        {
+            git_repository::mirror(git_dir, remote);
+        }
+        catch (std::exception const& e)
+        {
+            Log::warn() << e.what() << "; retrying with the next push" << std::endl;
+            pushed = false;
+        }
+        lock.lock();
+
+        pushing.erase(git_dir);
+        if (pushed)
+        {
+            failed.erase(git_dir);
+            if (bytes > 0)
+                pushed_pack_bytes[git_dir] = bytes;
+        }
+        else
+        {
+            failed.insert(git_dir);
+        }
+        idle.notify_all();
+        wake.notify_all();
+    }
+}
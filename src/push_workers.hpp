@@ -0,0 +1,73 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef PUSH_WORKERS_DWA20131123_HPP
+# define PUSH_WORKERS_DWA20131123_HPP
+
+# include <chrono>
+# include <condition_variable>
+# include <cstdint>
+# include <deque>
+# include <map>
+# include <mutex>
+# include <set>
+# include <string>
+# include <thread>
+# include <vector>
+
+// Mirrors repositories to a remote on background threads while the
+// conversion goes on, so that by the time it ends only what was
+// converted since the last checkpoint is left to upload; see
+// --push-jobs.  The bytes a push sends are estimated by how much the
+// repository's packs have grown since it was last pushed, and pushes
+// are held back so that, on average, no more than the bandwidth
+// limit is used.
+class push_workers
+{
+ public:
+    // Push on the given number of threads, together sending no more
+    // than kilobytes_per_second, or as fast as they can if it's zero
+    push_workers(std::string const& remote, unsigned threads, int kilobytes_per_second);
+
+    // Waits for the pushes under way, abandoning those not begun
+    ~push_workers();
+
+    // Have git_dir pushed, as of its last checkpoint, along with any
+    // whose pushes failed.  A repository already waiting is pushed
+    // only once; one being pushed is pushed again afterwards.
+    void push(std::string const& git_dir);
+
+    // Wait for every repository given to push() to be pushed.  Those
+    // whose pushes failed before are tried again first, and if any
+    // fails again, this throws.
+    void wait();
+
+ private:
+    push_workers(push_workers const&);
+    push_workers& operator=(push_workers const&);
+
+    void work();
+
+    // With the mutex held
+    void enqueue(std::string const& git_dir);
+    void retry_failed();
+
+    // The size of the packs of git_dir
+    static std::uint64_t pack_bytes(std::string const& git_dir);
+
+    std::string const remote;
+    double const bytes_per_second;   // 0 for no limit
+
+    std::mutex mutex;
+    std::condition_variable wake;    // something to push, or stopping
+    std::condition_variable idle;    // a push finished
+    std::deque<std::string> queue;
+    std::set<std::string> pushing;
+    std::set<std::string> failed;    // since they were last pushed
+    std::map<std::string, std::uint64_t> pushed_pack_bytes;
+    std::chrono::steady_clock::time_point next_start; // allowed by the limit
+    bool stopping;
+    std::vector<std::thread> threads;
+};
+
+#endif // PUSH_WORKERS_DWA20131123_HPP
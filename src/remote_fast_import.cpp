@@ -0,0 +1,449 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// The protocol: the client sends a header of lines,
+//
+//   svn2git-fast-import 1
+//   <GIT_DIR>
+//   <the number of arguments>
+//   <each argument to git after the executable, one to a line>
+//
+// and the worker answers "ok" once fast-import is started, or else
+// "error <why>" before closing the connection.  Then each side sends
+// what it relays as a single zlib stream, flushed whenever what has
+// arrived is sent, so that a command the importer awaits the response
+// to isn't held back, and finished when it ends.  Once fast-import has
+// exited, the worker follows its stream with "exit <status>".
+#include "remote_fast_import.hpp"
+#include "options.hpp"
+#include "log.hpp"
+
+#include <boost/process.hpp>
+#include <boost/iostreams/device/file_descriptor.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace
+{
+    char const protocol_line[] = "svn2git-fast-import 1";
+
+    // Header lines and arguments longer than this are refused
+    std::size_t const max_line = 1 << 16;
+
+    std::size_t const buffer_size = 1 << 16;
+
+    // Read what there is of size bytes at fd, returning 0 at its end
+    std::size_t read_some(int fd, char* data, std::size_t size, char const* what)
+    {
+        for (;;)
+        {
+            ssize_t const n = ::read(fd, data, size);
+            if (n >= 0)
+                return n;
+            if (errno != EINTR)
+                throw std::runtime_error(std::string("Couldn't read ") + what + ": " + std::strerror(errno));
+        }
+    }
+
+    // Write size bytes at data to fd, a socket if is_socket, so that
+    // a peer gone away is an error rather than SIGPIPE
+    void write_all(int fd, char const* data, std::size_t size, bool is_socket, char const* what)
+    {
+        while (size > 0)
+        {
+            ssize_t const n = is_socket
+                ? ::send(fd, data, size, MSG_NOSIGNAL) : ::write(fd, data, size);
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                throw std::runtime_error(std::string("Couldn't write ") + what + ": " + std::strerror(errno));
+            }
+            data += n;
+            size -= n;
+        }
+    }
+
+    void send_line(int socket, std::string line)
+    {
+        line += '\n';
+        write_all(socket, line.data(), line.size(), true, "to the connection");
+    }
+
+    // Read a line from socket a byte at a time, so that nothing after
+    // it is taken from the stream that follows
+    std::string receive_line(int socket)
+    {
+        std::string line;
+        for (char c; ; line += c)
+        {
+            if (read_some(socket, &c, 1, "from the connection") == 0)
+                throw std::runtime_error("Connection closed unexpectedly");
+            if (c == '\n')
+                return line;
+            if (line.size() >= max_line)
+                throw std::runtime_error("Line too long from the connection");
+        }
+    }
+
+    struct deflater : z_stream
+    {
+        deflater() : z_stream()
+        {
+            if (::deflateInit(this, Z_BEST_SPEED) != Z_OK)
+                throw std::runtime_error("Couldn't initialize zlib");
+        }
+        ~deflater() { ::deflateEnd(this); }
+    };
+
+    struct inflater : z_stream
+    {
+        inflater() : z_stream()
+        {
+            if (::inflateInit(this) != Z_OK)
+                throw std::runtime_error("Couldn't initialize zlib");
+        }
+        ~inflater() { ::inflateEnd(this); }
+    };
+
+    // Send what is read from in_fd until its end to socket, as a zlib
+    // stream flushed after each read
+    void send_stream(int in_fd, int socket, char const* what)
+    {
+        deflater z;
+        std::vector<char> in(buffer_size), out(buffer_size);
+        std::size_t n;
+        do
+        {
+            n = read_some(in_fd, in.data(), in.size(), what);
+            z.next_in = reinterpret_cast<Bytef*>(in.data());
+            z.avail_in = unsigned(n);
+            do
+            {
+                z.next_out = reinterpret_cast<Bytef*>(out.data());
+                z.avail_out = unsigned(out.size());
+                if (::deflate(&z, n ? Z_SYNC_FLUSH : Z_FINISH) == Z_STREAM_ERROR)
+                    throw std::runtime_error("Couldn't compress");
+                write_all(socket, out.data(), out.size() - z.avail_out, true, "to the connection");
+            }
+            while (z.avail_out == 0);
+        }
+        while (n > 0);
+    }
+
+    // Write the zlib stream read from socket to out_fd, returning
+    // what was read past its end
+    std::string receive_stream(int socket, int out_fd, char const* what)
+    {
+        inflater z;
+        std::vector<char> in(buffer_size), out(buffer_size);
+        for (;;)
+        {
+            std::size_t const n = read_some(socket, in.data(), in.size(), "from the connection");
+            if (n == 0)
+                throw std::runtime_error("Connection closed unexpectedly");
+            z.next_in = reinterpret_cast<Bytef*>(in.data());
+            z.avail_in = unsigned(n);
+            int result;
+            do
+            {
+                z.next_out = reinterpret_cast<Bytef*>(out.data());
+                z.avail_out = unsigned(out.size());
+                result = ::inflate(&z, Z_NO_FLUSH);
+                if (result != Z_OK && result != Z_STREAM_END && result != Z_BUF_ERROR)
+                    throw std::runtime_error("Corrupt stream from the connection");
+                write_all(out_fd, out.data(), out.size() - z.avail_out, false, what);
+            }
+            while (result != Z_STREAM_END && z.avail_out == 0);
+            if (result == Z_STREAM_END)
+                return std::string(reinterpret_cast<char*>(z.next_in), z.avail_in);
+        }
+    }
+
+    // Responses to "ls" and progress echoes are awaited one at a time,
+    // so none may wait for more to fill a packet
+    void set_nodelay(int socket)
+    {
+        int const on = 1;
+        ::setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+
+    // True iff path is absolute, beneath root, and has no ".."
+    bool beneath(std::string const& root, std::string const& path)
+    {
+        std::string const prefix = root.empty() || root.back() != '/' ? root + '/' : root;
+        return path.compare(0, prefix.size(), prefix) == 0
+            && path.size() > prefix.size()
+            && ("/" + path + "/").find("/../") == std::string::npos;
+    }
+
+    // Throw unless args run fast-import on files beneath root, with no
+    // configuration but the compression --fast-ingest sets
+    void check_args(std::vector<std::string> const& args, std::string const& root)
+    {
+        auto const command = std::find(args.begin(), args.end(), "fast-import");
+        if (command == args.end())
+            throw std::runtime_error("not a fast-import");
+        for (auto a = args.begin() + 1; a != command; ++a)
+        {
+            if (*a != "-c" && a->compare(0, 17, "core.compression=") != 0
+                && a->compare(0, 17, "pack.compression=") != 0)
+            {
+                throw std::runtime_error("option not allowed: " + *a);
+            }
+        }
+        for (auto a = command + 1; a != args.end(); ++a)
+        {
+            if (a->compare(0, 2, "--") != 0)
+                throw std::runtime_error("argument not allowed: " + *a);
+            std::size_t const eq = a->find('=');
+            std::string const name = a->substr(0, eq);
+            if ((name == "--export-marks" || name == "--import-marks"
+                 || name == "--import-marks-if-exists")
+                && !beneath(root, a->substr(eq + 1)))
+            {
+                throw std::runtime_error("marks file not beneath " + root + ": " + *a);
+            }
+            if (name == "--cat-blob-fd")
+                throw std::runtime_error("option not allowed: " + *a);
+        }
+    }
+}
+
+std::string fast_import_worker(std::string const& git_dir)
+{
+    if (options.fast_import_workers.empty())
+        return std::string();
+    // FNV-1a, so that every run gives a repository the same worker
+    std::uint32_t h = 2166136261u;
+    for (char c : git_dir)
+        h = (h ^ (unsigned char)c) * 16777619u;
+    return options.fast_import_workers[h % options.fast_import_workers.size()];
+}
+
+int connect_fast_import_worker(
+    std::string const& address, std::string const& git_dir, std::vector<std::string> const& args)
+{
+    std::size_t const colon = address.rfind(':');
+    if (colon == std::string::npos)
+        throw std::runtime_error("Expected HOST:PORT for --fast-import-worker: " + address);
+    std::string host = address.substr(0, colon);
+    if (host.size() > 1 && host.front() == '[' && host.back() == ']')
+        host = host.substr(1, host.size() - 2);
+    std::string const port = address.substr(colon + 1);
+
+    addrinfo hints = addrinfo();
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* found;
+    if (int const e = ::getaddrinfo(host.c_str(), port.c_str(), &hints, &found))
+        throw std::runtime_error("Couldn't look up " + address + ": " + ::gai_strerror(e));
+    int socket = -1;
+    int connect_errno = 0;
+    for (addrinfo* a = found; a && socket < 0; a = a->ai_next)
+    {
+        socket = ::socket(a->ai_family, a->ai_socktype | SOCK_CLOEXEC, a->ai_protocol);
+        if (socket >= 0 && ::connect(socket, a->ai_addr, a->ai_addrlen) != 0)
+        {
+            connect_errno = errno;
+            ::close(socket);
+            socket = -1;
+        }
+    }
+    ::freeaddrinfo(found);
+    if (socket < 0)
+    {
+        throw std::runtime_error(
+            "Couldn't connect to fast-import worker " + address + ": " + std::strerror(connect_errno));
+    }
+    set_nodelay(socket);
+
+    try
+    {
+        std::string header = std::string(protocol_line) + '\n' + git_dir + '\n'
+            + std::to_string(args.size() - 1) + '\n';
+        for (auto a = args.begin() + 1; a != args.end(); ++a)
+            header += *a + '\n';
+        write_all(socket, header.data(), header.size(), true, "to the connection");
+        std::string const answer = receive_line(socket);
+        if (answer != "ok")
+            throw std::runtime_error(answer.compare(0, 6, "error ") == 0 ? answer.substr(6) : answer);
+    }
+    catch (std::exception const& e)
+    {
+        ::close(socket);
+        throw std::runtime_error(
+            "fast-import worker " + address + " couldn't import into " + git_dir + ": " + e.what());
+    }
+    return socket;
+}
+
+void relay_fast_import(int socket, int in_fd, int out_fd, remote_exit& result)
+{
+    std::string send_error;
+    std::thread sender(
+        [&]
+        {
+            try
+            {
+                send_stream(in_fd, socket, "git fast-import commands");
+                ::shutdown(socket, SHUT_WR);
+            }
+            catch (std::exception const& e)
+            {
+                send_error = e.what();
+                ::shutdown(socket, SHUT_RDWR);
+                // The importer writes on, until it finds no responses
+                std::vector<char> discard(buffer_size);
+                try
+                {
+                    while (read_some(in_fd, discard.data(), discard.size(), "commands") > 0)
+                    {
+                    }
+                }
+                catch (std::exception const&)
+                {
+                }
+            }
+            ::close(in_fd);
+        });
+
+    try
+    {
+        std::string trailer = receive_stream(socket, out_fd, "git fast-import responses");
+        for (char c; trailer.find('\n') == std::string::npos; trailer += c)
+        {
+            if (read_some(socket, &c, 1, "from the connection") == 0)
+                throw std::runtime_error("Connection closed unexpectedly");
+        }
+        trailer.resize(trailer.find('\n'));
+        if (trailer.compare(0, 5, "exit ") != 0)
+            throw std::runtime_error(trailer);
+        result.status = std::atoi(trailer.c_str() + 5);
+    }
+    catch (std::exception const& e)
+    {
+        result.error = e.what();
+        ::shutdown(socket, SHUT_RDWR);
+    }
+    // Only now, so that the importer, seeing the responses end, finds
+    // the exit status already here
+    ::close(out_fd);
+    sender.join();
+    ::close(socket);
+    if (result.error.empty())
+        result.error = send_error;
+}
+
+void serve_fast_import(int socket, std::string const& root, std::string const& git)
+{
+    namespace iostreams = boost::iostreams;
+    using namespace boost::process::initializers;
+
+    set_nodelay(socket);
+    std::string git_dir;
+    int stdin_fds[2] = { -1, -1 }, stdout_fds[2] = { -1, -1 };
+    boost::process::child child(0);
+    try
+    {
+        try
+        {
+            if (receive_line(socket) != protocol_line)
+                throw std::runtime_error("unknown protocol");
+            git_dir = receive_line(socket);
+            if (!beneath(root, git_dir))
+                throw std::runtime_error("repository not beneath " + root + ": " + git_dir);
+            std::size_t const count = std::strtoul(receive_line(socket).c_str(), nullptr, 10);
+            if (count > 64)
+                throw std::runtime_error("too many arguments");
+            std::vector<std::string> args(1, git);
+            for (std::size_t i = 0; i < count; ++i)
+                args.push_back(receive_line(socket));
+            check_args(args, root);
+
+            // Close-on-exec, so that the fast-imports started for
+            // other connections meanwhile don't hold them open
+            if (::pipe2(stdin_fds, O_CLOEXEC) != 0 || ::pipe2(stdout_fds, O_CLOEXEC) != 0)
+                throw std::runtime_error(std::string("Couldn't create a pipe: ") + std::strerror(errno));
+            iostreams::file_descriptor_source in(stdin_fds[0], iostreams::close_handle);
+            iostreams::file_descriptor_sink out(stdout_fds[1], iostreams::close_handle);
+            stdin_fds[0] = stdout_fds[1] = -1;
+            child = boost::process::execute(
+                run_exe(git), set_args(args),
+                set_env(std::vector<std::string>({ "GIT_DIR=" + git_dir })),
+                bind_stdin(in), bind_stdout(out), throw_on_error());
+        }
+        catch (std::exception const& e)
+        {
+            send_line(socket, std::string("error ") + e.what());
+            throw;
+        }
+        send_line(socket, "ok");
+        Log::info() << "importing into " << git_dir << std::endl;
+
+        // fast-import's input ends when the client's stream does, or
+        // when the connection fails
+        std::thread receiver(
+            [&]
+            {
+                try
+                {
+                    receive_stream(socket, stdin_fds[1], "to git fast-import");
+                }
+                catch (std::exception const& e)
+                {
+                    Log::error() << git_dir << ": " << e.what() << std::endl;
+                }
+                ::close(stdin_fds[1]);
+                stdin_fds[1] = -1;
+            });
+        try
+        {
+            send_stream(stdout_fds[0], socket, "git fast-import responses");
+        }
+        catch (std::exception const& e)
+        {
+            // Keep reading fast-import's responses, so it can exit
+            Log::error() << git_dir << ": " << e.what() << std::endl;
+            ::shutdown(socket, SHUT_RDWR);
+            std::vector<char> discard(buffer_size);
+            while (read_some(stdout_fds[0], discard.data(), discard.size(), "responses") > 0)
+            {
+            }
+        }
+        receiver.join();
+        ::close(stdout_fds[0]);
+        stdout_fds[0] = -1;
+        int const status = boost::process::wait_for_exit(child);
+        child = boost::process::child(0);
+        Log::info() << "finished importing into " << git_dir << std::endl;
+        send_line(socket, "exit " + std::to_string(status));
+    }
+    catch (std::exception const& e)
+    {
+        Log::error() << (git_dir.empty() ? std::string("connection") : git_dir) << ": "
+                     << e.what() << std::endl;
+        for (int fd : { stdin_fds[0], stdin_fds[1], stdout_fds[0], stdout_fds[1] })
+        {
+            if (fd >= 0)
+                ::close(fd);
+        }
+        if (child.pid > 0)
+            boost::process::wait_for_exit(child);
+    }
+    ::close(socket);
+}
@@ -0,0 +1,61 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef REMOTE_FAST_IMPORT_DWA20131203_HPP
+# define REMOTE_FAST_IMPORT_DWA20131203_HPP
+
+# include <string>
+# include <vector>
+
+// With --fast-import-worker, the fast-imports run on other machines,
+// each started by a fast-import-worker there, so that one host needn't
+// hold them all besides the importer.  The repositories stay where
+// they are, on storage the importer and the workers share: svn2git
+// still creates them, reads their marks and finishes them itself.
+//
+// For each fast-import, a thread relays the commands from the pipe
+// fast-import would have read, compressed, over TCP to the worker,
+// and fast-import's responses back to the pipe it would have written,
+// so the importer writes commands and awaits responses just as it
+// does with a local fast-import.  The relay reads from the pipe only
+// as fast as the worker takes what it sends, so a worker falling
+// behind fills the pipe, and the importer queues its commands, just
+// as it does for a slow local fast-import.
+
+// The worker, of those given with --fast-import-worker, that runs the
+// fast-import of the repository at git_dir, or the empty string if
+// none are given.  Each repository always goes to the same worker.
+std::string fast_import_worker(std::string const& git_dir);
+
+// Connect to the worker at address, of the form HOST:PORT, and have it
+// start git with args, but for args[0], which is its own git, for the
+// repository at git_dir.  Returns the socket, ready for
+// relay_fast_import, or throws if the worker can't be reached or
+// refuses.
+int connect_fast_import_worker(
+    std::string const& address, std::string const& git_dir, std::vector<std::string> const& args);
+
+// How a remote fast-import ended
+struct remote_exit
+{
+    remote_exit() : status(-1) {}
+
+    int status;                 // as waitpid gives it, on the worker
+    std::string error;          // why the relay failed, if it did
+};
+
+// Relay commands from in_fd to the worker at the other end of socket,
+// and its responses to out_fd, until fast-import exits, then close
+// all three, leaving how it ended in result.  If the connection
+// fails, whatever more is written to in_fd is read and thrown away,
+// so the importer sees fast-import's responses end rather than a
+// broken pipe.
+void relay_fast_import(int socket, int in_fd, int out_fd, remote_exit& result);
+
+// The worker's side of a connection on socket: start git fast-import,
+// with the git executable git, for the repository the client names,
+// which must be beneath root, and relay commands to it and its
+// responses back until it exits.  Closes socket.
+void serve_fast_import(int socket, std::string const& root, std::string const& git);
+
+#endif // REMOTE_FAST_IMPORT_DWA20131203_HPP
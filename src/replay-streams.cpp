@@ -0,0 +1,240 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Imports the fast-import streams captured by svn2git
+// --capture-streams into fresh repositories, several at a time,
+// reporting each one's import throughput.  The Git side of a
+// conversion can so be measured, with whatever fast-import options,
+// without reading SVN again.  What fast-import answers is compared
+// with what it answered during the conversion, which it must match
+// for the replay to be the same import.
+#include <boost/program_options.hpp>
+#include <boost/process.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/device/file_descriptor.hpp>
+#include <boost/iostreams/stream.hpp>
+#include <boost/foreach.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace replay_streams {
+
+struct Options
+  {
+  std::string captures;             // directory
+  std::string output;               // directory
+  std::string git;
+  std::vector<std::string> fast_import_options;
+  unsigned jobs;
+  };
+
+Options options;
+
+// Run git with args in dir, its standard input read from input_file,
+// and return what it wrote to its standard output.  Throw if it exits
+// unsuccessfully.
+std::string git(std::string const& dir, std::vector<std::string> args,
+                std::string const& input_file = "/dev/null")
+  {
+  namespace iostreams = boost::iostreams;
+  using namespace boost::process::initializers;
+  args.insert(args.begin(), options.git);
+
+  // Close-on-exec, so the children started by other threads meanwhile
+  // don't hold the pipe open and keep us from seeing its end
+  int fds[2];
+  if (::pipe2(fds, O_CLOEXEC) != 0)
+    throw std::runtime_error("Couldn't create a pipe");
+  iostreams::file_descriptor_source source(fds[0], iostreams::close_handle);
+
+  int const input = ::open(input_file.c_str(), O_RDONLY | O_CLOEXEC);
+  if (input < 0)
+    throw std::runtime_error("Couldn't open " + input_file);
+  iostreams::file_descriptor_source stdin_source(input, iostreams::close_handle);
+
+  boost::process::child child = [&]
+    {
+    iostreams::file_descriptor_sink sink(fds[1], iostreams::close_handle);
+    return boost::process::execute(
+      run_exe(options.git), set_args(args), start_in_dir(dir), bind_stdin(stdin_source),
+      bind_stdout(sink), throw_on_error());
+    }();
+
+  iostreams::stream<iostreams::file_descriptor_source> output_stream(source);
+  std::string const output(
+    (std::istreambuf_iterator<char>(output_stream)), std::istreambuf_iterator<char>());
+  int const status = boost::process::wait_for_exit(child);
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+    std::string command = "git";
+    for (std::size_t i = 1; i < args.size(); ++i)
+      command += " " + args[i];
+    throw std::runtime_error(command + " failed");
+    }
+  return output;
+  }
+
+std::string read_file(std::string const& path)
+  {
+  std::ifstream in(path.c_str(), std::ios::binary);
+  return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  }
+
+// The captured streams, by the name of the repository each is
+// replayed into
+std::vector<std::string> captured_repositories()
+  {
+  namespace fs = boost::filesystem;
+  std::vector<std::string> result;
+  for (fs::directory_iterator i(options.captures), end; i != end; ++i)
+    {
+    if (i->path().extension() == ".stream")
+      result.push_back(i->path().stem().string());
+    }
+  std::sort(result.begin(), result.end());
+  return result;
+  }
+
+// Import the stream captured for name into a new repository of that
+// name, returning the bytes imported
+std::uintmax_t replay(std::string const& name)
+  {
+  namespace fs = boost::filesystem;
+  std::string const stream = options.captures + "/" + name + ".stream";
+  std::string const git_dir = options.output + "/" + name;
+  if (fs::exists(git_dir))
+    throw std::runtime_error(git_dir + " already exists");
+  fs::create_directories(git_dir);
+  git(git_dir, { "init", "--bare", "--quiet" });
+
+  std::vector<std::string> args = { "fast-import", "--quiet", "--force" };
+  args.insert(args.end(), options.fast_import_options.begin(), options.fast_import_options.end());
+  std::string const responses = git(git_dir, args, stream);
+
+  std::string const expected_path = options.captures + "/" + name + ".responses";
+  if (fs::exists(expected_path) && responses != read_file(expected_path))
+    throw std::runtime_error("fast-import's responses differ from those captured");
+  return fs::file_size(stream);
+  }
+
+// Replay every captured stream on up to options.jobs threads,
+// reporting each one's throughput as it finishes.  Return the number
+// that failed.
+std::size_t run()
+  {
+  std::vector<std::string> const repos = captured_repositories();
+  std::vector<std::string> errors(repos.size());
+  std::mutex report_mutex;
+  std::uintmax_t total_bytes = 0;
+  auto const start = std::chrono::steady_clock::now();
+
+  std::atomic<std::size_t> next(0);
+  auto worker = [&]()
+    {
+    for (std::size_t i; (i = next++) < repos.size();)
+      {
+      auto const repo_start = std::chrono::steady_clock::now();
+      std::uintmax_t bytes = 0;
+      try
+        {
+        bytes = replay(repos[i]);
+        }
+      catch (std::exception const& error)
+        {
+        errors[i] = error.what();
+        }
+      double const seconds
+        = std::chrono::duration<double>(std::chrono::steady_clock::now() - repo_start).count();
+      std::lock_guard<std::mutex> lock(report_mutex);
+      total_bytes += bytes;
+      std::printf("%-32s %12.1fMB %8.2fs %8.1fMB/s%s\n", repos[i].c_str(), bytes / 1e6,
+        seconds, seconds > 0 ? bytes / 1e6 / seconds : 0.0, errors[i].empty() ? "" : "  FAILED");
+      std::fflush(stdout);
+      }
+    };
+
+  std::vector<std::thread> threads;
+  for (unsigned n = std::max(1u, std::min<unsigned>(options.jobs, repos.size())); n > 1; --n)
+    threads.emplace_back(worker);
+  worker();
+  BOOST_FOREACH(std::thread& t, threads)
+    t.join();
+
+  std::size_t failures = 0;
+  for (std::size_t i = 0; i < repos.size(); ++i)
+    {
+    if (!errors[i].empty())
+      {
+      ++failures;
+      std::cerr << repos[i] << ": " << errors[i] << std::endl;
+      }
+    }
+  double const seconds
+    = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::printf("%lu repositories, %.1fMB in %.2fs (%.1fMB/s), %lu failed\n",
+    (unsigned long)repos.size(), total_bytes / 1e6, seconds,
+    seconds > 0 ? total_bytes / 1e6 / seconds : 0.0, (unsigned long)failures);
+  return failures;
+  }
+} // namespace replay_streams
+
+int main(int argc, char **argv)
+  {
+  using replay_streams::options;
+  namespace po = boost::program_options;
+  po::options_description program_options("Allowed options");
+  program_options.add_options()
+    ("help,h", "produce help message")
+    ("git", po::value(&options.git)->value_name("PATH"),
+      "the git executable to use (by default the one on the PATH)")
+    ("jobs,j", po::value(&options.jobs)->value_name("NUMBER")->default_value(8),
+      "import NUMBER repositories at a time")
+    ("fast-import-option", po::value(&options.fast_import_options)->value_name("OPTION"),
+      "pass OPTION to git fast-import; may be repeated")
+    ("captures", po::value(&options.captures)->value_name("DIRECTORY")->required(),
+      "the directory of the streams captured by svn2git --capture-streams")
+    ("output", po::value(&options.output)->value_name("DIRECTORY")->required(),
+      "the directory in which to create the repositories")
+    ;
+  po::positional_options_description positional;
+  positional.add("captures", 1).add("output", 1);
+
+  po::variables_map variables;
+  store(po::command_line_parser(argc, argv)
+    .options(program_options)
+    .positional(positional)
+    .run(), variables);
+  if (variables.count("help"))
+    {
+    std::cout << "Usage: " << argv[0] << " [options] CAPTURES OUTPUT\n"
+              << program_options << std::endl;
+    return 0;
+    }
+
+  try
+    {
+    notify(variables);
+    if (options.git.empty())
+      options.git = boost::process::search_path("git");
+    return replay_streams::run() == 0 ? 0 : 1;
+    }
+  catch (std::exception& error)
+    {
+    std::cerr << error.what() << std::endl;
+    return -1;
+    }
+  }
@@ -0,0 +1,69 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef RESOURCE_BUDGET_DWA20131127_HPP
+# define RESOURCE_BUDGET_DWA20131127_HPP
+
+# include <algorithm>
+# include <chrono>
+# include <cstdint>
+
+// With --memory-budget, what keeps the resident memory of the whole
+// conversion, svn2git and its fast-imports together, within a budget.
+// The importer measures it between revisions, at most once a second,
+// and passes it to assess, then acts on the verdict:
+//
+//  - as the total nears the budget, the caches svn2git can refill
+//    (the directory listings and file properties) are halved, down
+//    to a floor, and grown back an eighth at a time once there is
+//    room again;
+//
+//  - past the budget, fast-imports are stopped, the idlest first,
+//    until what they held would bring the total back under the
+//    point where the caches start shrinking.  Each is restarted by
+//    its repository's next commit, importing its marks.
+class resource_budget
+{
+ public:
+    explicit resource_budget(std::uint64_t bytes)
+        : bytes(bytes), share(1), excess_(0), last_check() {}
+
+    // True iff a second has passed since the last assessment
+    bool due() const
+    {
+        return std::chrono::steady_clock::now() - last_check >= std::chrono::seconds(1);
+    }
+
+    // Take the conversion's resident memory into account
+    void assess(std::uint64_t resident)
+    {
+        last_check = std::chrono::steady_clock::now();
+        std::uint64_t const tight = bytes / 100 * tight_percent;
+        std::uint64_t const roomy = bytes / 100 * roomy_percent;
+        if (resident >= tight)
+            share = std::max(share / 2, 1.0 / 64);
+        else if (resident < roomy)
+            share = std::min(share + 1.0 / 8, 1.0);
+        excess_ = resident > bytes ? resident - tight : 0;
+    }
+
+    // The share of their usual size that the caches may have
+    double cache_share() const { return share; }
+
+    // The bytes to be freed by stopping fast-imports, or zero if the
+    // conversion is within its budget
+    std::uint64_t excess() const { return excess_; }
+
+    std::uint64_t budget() const { return bytes; }
+
+ private:
+    static unsigned const tight_percent = 85;
+    static unsigned const roomy_percent = 70;
+
+    std::uint64_t const bytes;
+    double share;
+    std::uint64_t excess_;
+    std::chrono::steady_clock::time_point last_check;
+};
+
+#endif // RESOURCE_BUDGET_DWA20131127_HPP
@@ -0,0 +1,289 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef REV_MARK_MAP_DWA20131107_HPP
+# define REV_MARK_MAP_DWA20131107_HPP
+
+# include <algorithm>
+# include <cassert>
+# include <cstddef>
+# include <cstdint>
+# include <iterator>
+# include <utility>
+# include <vector>
+
+// The marks of the commits kept in a ref, by the SVN revision each
+// was made in, in increasing order of revision.  Every ref of every
+// repository has one, and a ref may have tens of thousands of
+// commits, so entries are delta-coded: each block of entries_per_block
+// starts with an entry kept whole in a small index, and the others are
+// stored as variable-length differences from their predecessors,
+// typically two bytes per entry.  Entries are only ever added or
+// removed at the end.
+class rev_mark_map
+{
+ public:
+    // An SVN revision and the mark of the commit made in it
+    typedef std::pair<std::size_t, std::size_t> value_type;
+
+    static std::size_t const entries_per_block = 32;
+
+    rev_mark_map() : count(0), last(0, 0) {}
+
+    bool empty() const { return count == 0; }
+    std::size_t size() const { return count; }
+
+    // The heap memory held, for --memory-csv
+    std::size_t bytes_held() const
+    {
+        return index.capacity() * sizeof(block) + bytes.capacity();
+    }
+
+    // The entry of the latest revision
+    value_type const& back() const
+    {
+        assert(!empty());
+        return last;
+    }
+
+    // The entry before back()
+    value_type penultimate() const
+    {
+        assert(count >= 2);
+        return nth(count - 2);
+    }
+
+    // Add an entry later than every other
+    void push_back(std::size_t revnum, std::size_t mark)
+    {
+        assert(empty() || revnum > last.first);
+        if (count % entries_per_block == 0)
+        {
+            block const b = { std::uint32_t(revnum), std::uint32_t(mark), std::uint32_t(bytes.size()) };
+            index.push_back(b);
+        }
+        else
+        {
+            put(revnum - last.first);
+            std::size_t const diff = mark >= last.second
+                ? (mark - last.second) << 1 : (last.second - mark) << 1 | 1;
+            put(diff);
+        }
+        last = value_type(revnum, mark);
+        ++count;
+    }
+
+    void pop_back()
+    {
+        assert(!empty());
+        if (count == 1)
+            clear();
+        else
+            truncate(last.first - 1);
+    }
+
+    void clear()
+    {
+        index.clear();
+        bytes.clear();
+        count = 0;
+    }
+
+    // Release the memory held beyond the entries, e.g. once no more
+    // are expected
+    void shrink_to_fit()
+    {
+        index.shrink_to_fit();
+        bytes.shrink_to_fit();
+    }
+
+    // Find the entry of the latest revision at or before revnum,
+    // returning false if there is none
+    bool find_at_or_before(std::size_t revnum, value_type& found) const
+    {
+        if (empty() || revnum < index.front().revnum)
+            return false;
+        if (revnum >= last.first)
+        {
+            found = last;
+            return true;
+        }
+        std::size_t const b = block_at_or_before(revnum);
+        scan(b, [&](value_type const& e, std::size_t) {
+                if (e.first > revnum)
+                    return false;
+                found = e;
+                return true; });
+        return true;
+    }
+
+    // Forget the entries after revnum
+    void truncate(std::size_t revnum)
+    {
+        if (empty() || revnum >= last.first)
+            return;
+        if (revnum < index.front().revnum)
+            return clear();
+
+        std::size_t const b = block_at_or_before(revnum);
+        std::size_t kept = 0, end = 0;
+        scan(b, [&](value_type const& e, std::size_t next) {
+                if (e.first > revnum)
+                    return false;
+                last = e;
+                ++kept;
+                end = next;
+                return true; });
+        index.resize(b + 1);
+        bytes.resize(end);
+        count = b * entries_per_block + kept;
+    }
+
+    class const_iterator
+    {
+     public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef rev_mark_map::value_type value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef value_type const* pointer;
+        typedef value_type const& reference;
+
+        const_iterator() : map(0), i(0), value(0, 0), pos(0) {}
+
+        value_type const& operator*() const { return value; }
+        value_type const* operator->() const { return &value; }
+
+        const_iterator& operator++()
+        {
+            if (++i < map->count)
+            {
+                if (i % entries_per_block == 0)
+                {
+                    block const& b = map->index[i / entries_per_block];
+                    value = value_type(b.revnum, b.mark);
+                    pos = b.offset;
+                }
+                else
+                    map->step(value, pos);
+            }
+            return *this;
+        }
+
+        const_iterator operator++(int)
+        {
+            const_iterator old = *this;
+            ++*this;
+            return old;
+        }
+
+        friend bool operator==(const_iterator const& x, const_iterator const& y)
+        {
+            return x.i == y.i;
+        }
+
+        friend bool operator!=(const_iterator const& x, const_iterator const& y)
+        {
+            return x.i != y.i;
+        }
+
+     private:
+        friend class rev_mark_map;
+        const_iterator(rev_mark_map const* map, std::size_t i)
+            : map(map), i(i), value(0, 0), pos(0)
+        {
+            if (i < map->count)
+                value = value_type(map->index[0].revnum, map->index[0].mark);
+        }
+
+        rev_mark_map const* map;
+        std::size_t i;
+        value_type value;
+        std::size_t pos;       // of the next entry's encoding
+    };
+
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, count); }
+
+ private:
+    // The first entry of a block, and where the rest are encoded.
+    // SVN revisions and fast-import marks fit in 32 bits.
+    struct block
+    {
+        std::uint32_t revnum;
+        std::uint32_t mark;
+        std::uint32_t offset;
+    };
+
+    void put(std::size_t n)
+    {
+        for (; n >= 0x80; n >>= 7)
+            bytes.push_back((unsigned char)(n | 0x80));
+        bytes.push_back((unsigned char)n);
+    }
+
+    std::size_t get(std::size_t& pos) const
+    {
+        std::size_t n = 0;
+        for (int shift = 0;; shift += 7)
+        {
+            unsigned char const c = bytes[pos++];
+            n |= std::size_t(c & 0x7F) << shift;
+            if (c < 0x80)
+                return n;
+        }
+    }
+
+    // Decode the entry following e, encoded at pos
+    void step(value_type& e, std::size_t& pos) const
+    {
+        e.first += get(pos);
+        std::size_t const diff = get(pos);
+        e.second = diff & 1 ? e.second - (diff >> 1) : e.second + (diff >> 1);
+    }
+
+    // The block holding the latest entry at or before revnum, which
+    // must be no earlier than the first
+    std::size_t block_at_or_before(std::size_t revnum) const
+    {
+        auto const p = std::upper_bound(
+            index.begin(), index.end(), revnum,
+            [](std::size_t r, block const& b) { return r < b.revnum; });
+        return p - index.begin() - 1;
+    }
+
+    // Call f(entry, end) on the entries of block b in order, where end
+    // is the offset just past the entry's encoding, until it returns
+    // false
+    template <class F>
+    void scan(std::size_t b, F const& f) const
+    {
+        value_type e(index[b].revnum, index[b].mark);
+        std::size_t pos = index[b].offset;
+        std::size_t const rest = count - b * entries_per_block;
+        std::size_t const n = rest < entries_per_block ? rest : entries_per_block;
+        for (std::size_t k = 0; k < n; ++k)
+        {
+            if (k > 0)
+                step(e, pos);
+            if (!f(e, pos))
+                return;
+        }
+    }
+
+    value_type nth(std::size_t i) const
+    {
+        value_type result;
+        std::size_t k = 0;
+        scan(i / entries_per_block, [&](value_type const& e, std::size_t) {
+                result = e;
+                return k++ < i % entries_per_block; });
+        return result;
+    }
+
+    std::vector<block> index;
+    std::vector<unsigned char> bytes;
+    std::size_t count;
+    value_type last;
+};
+
+#endif // REV_MARK_MAP_DWA20131107_HPP
@@ -0,0 +1,193 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef REVISION_INDEX_DWA20131125_HPP
+# define REVISION_INDEX_DWA20131125_HPP
+
+# include "state_file.hpp"
+# include <boost/filesystem.hpp>
+# include <cstdint>
+# include <exception>
+# include <functional>
+# include <memory>
+# include <mutex>
+# include <string>
+# include <utility>
+# include <vector>
+
+// The svn:date of the given revision of a repository, or the empty
+// string if it has no such revision
+typedef std::function<std::string(int)> revision_date_function;
+
+// Records of what each SVN revision holds, read from SVN once and
+// kept in a state_file, since SVN history never changes; later runs
+// map the file into memory and read a revision at a time.  The file
+// holds Format::format, the repository's UUID, the number of revisions
+// indexed, the svn:date of some of them and the offset of each one's
+// records, followed by the records themselves, which Format::write and
+// Format::read store and load.
+//
+// A repository reloaded from a dump keeps its UUID, even if the dump
+// was filtered or edited, so the dates are checked too: those of the
+// last revision indexed and of revisions spread evenly before it.
+// Renumbered, dropped or added revisions, or a reload of another
+// history, show up as a date that differs, and the index is rebuilt.
+template <class Record, class Format>
+struct revision_index
+{
+    // Use the index of the SVN repository with the given UUID stored
+    // in filename, if there is one and the repository's revisions
+    // have the dates date_of gives when the index was saved.  An
+    // empty filename keeps the index in memory only.
+    revision_index(
+        std::string const& filename, std::string const& uuid, revision_date_function date_of)
+        : filename(filename), uuid(uuid), date_of(std::move(date_of)), stored_revisions(0)
+    {
+        boost::system::error_code ec;
+        if (filename.empty() || !boost::filesystem::exists(filename, ec))
+            return;
+        try
+        {
+            std::unique_ptr<state_file::reader> r(new state_file::reader(filename));
+            if (r->word() != Format::format || r->str() != uuid)
+                return;
+            std::uint64_t const n = r->word();
+            for (auto k = r->word(); k > 0; --k)
+            {
+                int const revnum = int(r->word());
+                if (r->str() != this->date_of(revnum))
+                    return;
+            }
+            offsets_start = r->tell();
+            r->seek(offsets_start + n * sizeof(std::uint64_t));
+            stored.swap(r);
+            stored_revisions = int(n);
+        }
+        catch (std::exception const&) {}
+    }
+
+    // Revisions 1 through last_revision() are indexed
+    int last_revision() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stored_revisions + int(added.size());
+    }
+
+    // If revnum is indexed, set records to its records and return true
+    bool find(int revnum, std::vector<Record>& records) const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (revnum < 1 || revnum > stored_revisions + int(added.size()))
+            return false;
+        if (revnum > stored_revisions)
+        {
+            records = added[revnum - stored_revisions - 1];
+            return true;
+        }
+        return read_stored(revnum, records);
+    }
+
+    // Index the records of revnum, if it is the revision after
+    // last_revision()
+    void add(int revnum, std::vector<Record> const& records)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (revnum == stored_revisions + int(added.size()) + 1)
+            added.push_back(records);
+    }
+
+    // Write out the index, if revisions have been added to it, and
+    // read it back from the file from then on.  Failure only costs the
+    // next run reading the records from SVN, so it is not reported.
+    void save()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (filename.empty() || added.empty())
+            return;
+
+        int const n = stored_revisions + int(added.size());
+        state_file::writer w;
+        w.word(Format::format).str(uuid).word(n);
+        std::vector<int> const dated = dated_revisions(n);
+        w.word(dated.size());
+        for (int revnum : dated)
+            w.word(revnum).str(date_of(revnum));
+        std::size_t const offsets = w.size();
+        for (int i = 0; i < n; ++i)
+            w.word(0);
+
+        std::vector<Record> records;
+        for (int revnum = 1; revnum <= n; ++revnum)
+        {
+            w.word_at(offsets + (revnum - 1) * sizeof(std::uint64_t), w.size());
+            std::vector<Record> const* c = &records;
+            if (revnum > stored_revisions)
+                c = &added[revnum - stored_revisions - 1];
+            else if (!read_stored(revnum, records))
+                return;
+            w.word(c->size());
+            for (auto const& x : *c)
+                Format::write(w, x);
+        }
+
+        boost::system::error_code ec;
+        boost::filesystem::create_directories(
+            boost::filesystem::path(filename).parent_path(), ec);
+        try
+        {
+            w.save(filename);
+            stored.reset(new state_file::reader(filename));
+            offsets_start = offsets;
+            stored_revisions = n;
+            added.clear();
+        }
+        catch (std::exception const&) {}
+    }
+
+ private:
+    // The revisions of an index of revisions 1 through n whose dates
+    // are kept: n itself and up to 63 spread evenly before it
+    static std::vector<int> dated_revisions(int n)
+    {
+        int const samples = 64;
+        std::vector<int> result;
+        for (int i = 1; i <= samples; ++i)
+        {
+            int const revnum = int(std::int64_t(n) * i / samples);
+            if (revnum > 0 && (result.empty() || revnum != result.back()))
+                result.push_back(revnum);
+        }
+        return result;
+    }
+
+    // Read the records of revnum from the file, returning false if
+    // it turns out to be truncated
+    bool read_stored(int revnum, std::vector<Record>& records) const
+    {
+        try
+        {
+            stored->seek(offsets_start + (revnum - 1) * sizeof(std::uint64_t));
+            stored->seek(stored->word());
+            records.resize(stored->word());
+            for (auto& x : records)
+                Format::read(*stored, x);
+            return true;
+        }
+        catch (std::exception const&)
+        {
+            return false;
+        }
+    }
+
+    std::string const filename;
+    std::string const uuid;
+    revision_date_function const date_of;
+
+    mutable std::mutex mutex; // guards everything below
+    std::unique_ptr<state_file::reader> stored;  // null unless there's a file
+    std::size_t offsets_start;
+    int stored_revisions;
+    std::vector<std::vector<Record> > added;     // after the stored revisions
+};
+
+#endif // REVISION_INDEX_DWA20131125_HPP
@@ -0,0 +1,795 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#include "revision_planner.hpp"
+#include "flight_recorder.hpp"
+#include "plan_store.hpp"
+#include "log.hpp"
+#include "options.hpp"
+#include "profile.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+
+namespace
+{
+    // A phase of planning, profiled if the planner is
+    struct phase
+    {
+        phase(bool profiled, char const* name)
+            : scope(profiled ? new profile::scope(name) : nullptr) {}
+        std::unique_ptr<profile::scope> scope;
+    };
+}
+
+namespace
+{
+    // Calls f(path, cursor) on every file beneath the directory at
+    // svn_path, whose node-revision ID is node_id, skipping any file
+    // or subtree for which prune(path, is_dir) returns true.  The
+    // cursor, at for svn_path, is carried down the walk and descended
+    // into each entry, so that f gets one already advanced through
+    // the file's path.  The kinds and IDs
+    // recorded in directory entries save asking SVN about each node
+    // we visit.  The directories being walked are kept on a stack of
+    // their own, so deep trees don't run the walk out of stack.  With
+    // --walk-threads, walker lists the directories first, and the
+    // files are visited in the same order from its listings.
+    //
+    // By --traversal-order, each directory's entries are visited in
+    // SVN's hash order, or by name, or the files are gathered and
+    // visited in the order of their node-revisions in the FSFS
+    // revision files, for reading their contents mostly forwards.
+    template <class F, class Prune, class Cursor>
+    void for_each_svn_file_in(
+        svn::revision const& rev, path const& svn_path, std::string const& node_id,
+        Cursor const& at, F const& f, Prune const& prune, directory_cache& cache,
+        tree_walker* walker)
+    {
+        typedef directory_cache::entry entry;
+        bool const by_name = options.traversal_order == "name";
+        bool const by_location = options.traversal_order == "offset";
+
+        // A directory being visited: its listing, and the order of
+        // its entries
+        struct directory
+        {
+            path svn_path;
+            std::shared_ptr<directory_cache::listing const> listing;
+            std::vector<entry const*> entries;
+            std::size_t next;
+            std::size_t walked;         // its index in what walker found
+            Cursor cursor;
+        };
+
+        struct located_file
+        {
+            std::uint64_t location;
+            path svn_path;
+            Cursor cursor;
+        };
+
+        std::deque<tree_walker::directory> walked;
+        if (walker)
+        {
+            std::function<bool(path const&, bool)> const prune_entry = 
+                [&prune](path const& p, bool is_dir) { return prune(p, is_dir); };
+            walked = walker->walk(rev.revnum, svn_path, node_id, prune_entry, cache);
+        }
+
+        std::vector<directory> stack;
+        auto enter = [&](path const& p, std::string const& id, std::size_t walked_index,
+                         Cursor const& c)
+        {
+            directory d = { 
+                p, walker ? walked[walked_index].listing : svn::list_directory(rev, p.c_str(), id, cache), 
+                {}, 0, walked_index, c };
+            d.entries.reserve(d.listing->size());
+            for (auto const& e : *d.listing)
+                d.entries.push_back(&e);
+            if (by_name)
+            {
+                std::sort(
+                    d.entries.begin(), d.entries.end(),
+                    [](entry const* a, entry const* b) { return a->name < b->name; });
+            }
+            stack.push_back(std::move(d));
+        };
+
+        std::vector<located_file> located_files;
+        enter(svn_path, node_id, 0, at);
+        while (!stack.empty())
+        {
+            directory& d = stack.back();
+            if (d.next == d.entries.size())
+            {
+                stack.pop_back();
+                continue;
+            }
+            entry const& e = *d.entries[d.next++];
+            path const subpath = d.svn_path/e.name;
+            int walked_entry = 0;
+            if (walker)
+            {
+                // Pruned by walker already
+                walked_entry = walked[d.walked].entries[&e - d.listing->data()];
+                if (walked_entry == tree_walker::pruned)
+                    continue;
+            }
+            else if (prune(subpath, e.is_dir))
+                continue;
+            Cursor c = d.cursor;
+            c.descend(e.name);
+            if (e.is_dir)
+            {
+                enter(subpath, e.node_id, walked_entry, c); // invalidates d
+            }
+            else if (by_location)
+            {
+                located_file const file = { e.location, subpath, c };
+                located_files.push_back(file);
+            }
+            else
+                f(subpath, c);
+        }
+
+        std::stable_sort(
+            located_files.begin(), located_files.end(),
+            [](located_file const& a, located_file const& b) { return a.location < b.location; });
+        for (auto const& file : located_files)
+            f(file.svn_path, file.cursor);
+    }
+}
+
+revision_planner::revision_planner(svn const& repo, Ruleset const& rules, bool profiled)
+    : repo(repo), rules(&rules), profiled(profiled), listings(directory_cache_entries),
+      revnum(0), result(nullptr), directory_matches_revnum(-1)
+{
+    if (options.walk_threads > 0)
+        walker.reset(new tree_walker(repo.repo_path, options.walk_threads));
+}
+
+void revision_planner::set_rules(Ruleset const& rules)
+{
+    this->rules = &rules;
+    directory_matches.clear();
+    directory_matches_revnum = -1;
+}
+
+// True iff importing revnum, which makes the given changes, would
+// change nothing in Git: no rule becomes active or inactive in it, and
+// every path it changes is only having its properties edited, or lies
+// where nothing is mapped and no rule lies beneath it.  Paths added
+// or modified must also be excluded, since importing reports files
+// that no rule matches.
+bool revision_planner::changes_nothing(int revnum, std::vector<svn::change> const& changes) const
+{
+    auto const& matcher = rules->matcher();
+    if (revnum == options.segment_start || !matcher.rules_in_transition(revnum).empty())
+        return false;
+
+    for (auto const& change : changes)
+    {
+        if (change.change_kind == svn_fs_path_change_modify && !change.text_mod)
+            continue;
+
+        path const svn_path(change.path);
+        Rule const* const match = matcher.longest_match(svn_path.str(), revnum);
+        if (match ? !match->excludes() : change.change_kind != svn_fs_path_change_delete)
+            return false;
+        if (finds_rules([&](boost::function_output_iterator<rule_detector> out) {
+                    matcher.svn_rules_beneath(svn_path.str(), revnum, out); }))
+            return false;
+        if (change.node_kind != svn_node_file
+            && finds_rules([&](boost::function_output_iterator<rule_detector> out) {
+                    matcher.svn_subtree_rules(svn_path.str(), revnum, out); }))
+            return false;
+    }
+    return true;
+}
+
+// True iff revnum, which the SVN user author made with the given
+// changes, may be squashed into one commit with the revisions around
+// it: no rule becomes active or inactive in it, it copies nothing,
+// no rule lies beneath a path it changes, and every path it changes
+// that is mapped is mapped into a repository whose squash rules name
+// author, or a path within the branch containing it.
+bool revision_planner::squashes(
+    int revnum, std::string const& author, std::vector<svn::change> const& changes) const
+{
+    auto const& matcher = rules->matcher();
+    if (revnum == options.segment_start || !matcher.rules_in_transition(revnum).empty())
+        return false;
+
+    for (auto const& change : changes)
+    {
+        if (!change.copyfrom_path.empty())
+            return false;
+        if (change.change_kind == svn_fs_path_change_modify && !change.text_mod)
+            continue;
+
+        path const svn_path(change.path);
+        if (finds_rules([&](boost::function_output_iterator<rule_detector> out) {
+                    matcher.svn_rules_beneath(svn_path.str(), revnum, out); }))
+            return false;
+        Rule const* const match = matcher.longest_match(svn_path.str(), revnum);
+        if (!match || match->excludes())
+            continue;
+
+        auto const& squash_rules = rules->squash_rules(match->repo_rule);
+        if (std::none_of(
+                squash_rules.begin(), squash_rules.end(), [&](boost2git::SquashRule const* s) {
+                    return s->kind == "author" ? s->value == author
+                        : svn_path.starts_with(match->branch_rule->svn_path / path(s->value));
+                }))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The directory matches found in the revision before first hold
+// through the revisions skipped
+void revision_planner::skipped(int first, int last)
+{
+    if (directory_matches_revnum == first - 1)
+        directory_matches_revnum = last;
+}
+
+// Importing an SVN revision happens in two phases.  In the first
+// phase we discover actions to be performed: Git subtrees that must
+// be deleted and SVN subtrees whose files must be (re-)converted to
+// Git.  In the second phase, the importer actually does those
+// deletions and translations.
+void revision_planner::plan(svn::revision const& rev, revision_plan& plan, tree_copier const* copy_trees)
+{
+    revnum = rev.revnum;
+    plan.clear();
+    plan.revnum = revnum;
+    result = &plan;
+    paths_to_convert.clear();
+    trees_copied.clear();
+    copies.clear();
+
+    // Deal with rules becoming active/inactive in this revision
+    auto const& matcher = rules->matcher();
+    matcher.set_current_revision(revnum);
+    if (revnum != directory_matches_revnum + 1)
+        directory_matches.clear();
+    else if (!matcher.rules_in_transition(revnum).empty())
+        forget_directory_matches(matcher.rules_in_transition(revnum));
+    directory_matches_revnum = revnum;
+
+    for (Rule const* r: matcher.rules_in_transition(revnum))
+        invalidate_tree(rev, r->svn_path(), r);
+
+    // A --segment-start conversion has none of the history before its
+    // first revision, so there every active rule is treated as newly
+    // active, starting its ref with the whole tree it maps
+    if (revnum == options.segment_start)
+    {
+        std::vector<Rule const*> active;
+        matcher.svn_rules_beneath(std::string(), revnum, std::back_inserter(active));
+        for (Rule const* r: active)
+        {
+            if (!r->excludes())
+                invalidate_tree(rev, r->svn_path(), r);
+        }
+    }
+
+    // Discover SVN paths that are being deleted/modified
+    {
+        phase _(profiled, "process changes");
+        process_changes(rev, copy_trees);
+    }
+
+    Log::trace() 
+        << paths_to_convert.size() 
+        << " SVN " 
+        << (paths_to_convert.size() == 1 ? "path" : "paths")
+        << " to convert" << std::endl;
+
+    {
+        phase _(profiled, "discover merges");
+        discover_merges(rev);
+        if (options.svn_mergeinfo)
+            discover_recorded_merges();
+    }
+    {
+        phase _(profiled, "plan files");
+        plan_files(rev);
+    }
+
+    for (auto const& c : copies)
+        plan.directory_copies.push_back(c.second);
+    result = nullptr;
+}
+
+void revision_planner::add_tree_to_delete(path const& svn_path, Rule const* match)
+{
+    assert(match);
+    assert(svn_path.starts_with(match->svn_path()));
+
+    // Mark the git path to be deleted at the start of the commit
+    revision_plan::mapped_path const d = { svn_path, match };
+    result->deletions.push_back(d);
+}
+
+void revision_planner::invalidate_tree(
+    svn::revision const& rev, path const& svn_path, Rule const* match)
+{
+    add_tree_to_delete(svn_path, match);
+
+    add_tree_to_convert(rev, svn_path);
+
+    // Mark every svn tree that's mapped into the rule's git subtree for
+    // (re-)conversion.
+
+    // Find the unmatched suffix of the path
+    path path_suffix = svn_path.sans_prefix(match->svn_path());
+    rules->matcher().git_subtree_rules(
+        git_address_key(
+            match->git_repo_name(), match->git_ref_name(), match->git_path().str(),
+            path_suffix.str()),
+        revnum,
+        boost::make_function_output_iterator(
+            [&](Rule const* r){ add_tree_to_convert(rev, r->svn_path()); })
+    );
+}
+
+void revision_planner::add_tree_to_convert(
+    svn::revision const& rev, path const& svn_path, bool known_to_exist)
+{
+    // Mark this svn_path for conversion.  
+    if (known_to_exist 
+        || svn::call(svn_fs_check_path, rev.fs_root, svn_path.c_str(), AprScratch(rev.scratch)) != svn_node_none)
+    {
+        Log::trace() << "adding " << svn_path << " for conversion" << std::endl;
+        paths_to_convert.insert(svn_path);
+    }
+}
+
+// Deal with all the SVN changes in this revision.  We're not actually
+// writing any file contents (blobs or trees) to Git in this step.
+// Our job is merely to make a record of paths to be deleted in Git at
+// the beginning of the commit and SVN files/directories to
+// subsequently be traversed and converted to Git blobs and trees.
+void revision_planner::process_changes(svn::revision const& rev, tree_copier const* copy_trees)
+{
+    // Tree copies need to know whether anything else changed within
+    // the copied directory.
+    std::vector<path> changed_paths;
+    if (copy_trees)
+    {
+        for (auto const& change : rev.changes)
+            changed_paths.push_back(change.path);
+        std::sort(changed_paths.begin(), changed_paths.end());
+    }
+
+    for (auto const& change : rev.changes)
+    {
+        // Ignore changes that only edit properties
+        if (change.change_kind == svn_fs_path_change_modify && !change.text_mod)
+            continue;
+
+        path const svn_path(change.path);
+        
+        // We have found a path being modified in SVN.  Note: it's
+        // too early to error-out on unmapped SVN paths here: any that
+        // are problematic will be picked up later.
+        Rule const* const match = match_path(svn_path, revnum, false);
+
+        // Start by marking its Git target for deletion.  
+        if (match)
+            add_tree_to_delete(svn_path, match);
+
+        // If it wasn't being deleted in SVN, also convert all of its
+        // files to Git.  Then it exists, without asking SVN.
+        if (change.change_kind != svn_fs_path_change_delete)
+            add_tree_to_convert(rev, svn_path, true);
+
+        // Assume it's a directory if it's not known to be a file.
+        // This is conservative, in case node_kind == svn_node_unknown.
+        if (change.node_kind != svn_node_file)
+        {
+            process_directory_change(rev, change, svn_path);
+
+            if (copy_trees && !change.copyfrom_path.empty())
+            {
+                (*copy_trees)(
+                    svn_path, change.copyfrom_path, change.copyfrom_rev, changed_paths,
+                    trees_copied);
+            }
+        }
+    }
+}
+
+void revision_planner::process_directory_change(
+    svn::revision const& rev, svn::change const& change, path const& svn_path)
+{
+    // Remember directory copy sources.  It's OK to retain only the
+    // last source directory if this target was copied-to more than
+    // once
+    if (!change.copyfrom_path.empty())
+    {
+        revision_plan::directory_copy const copy
+            = { svn_path, change.copyfrom_path, std::size_t(change.copyfrom_rev) };
+        copies[svn_path] = copy;
+    }
+
+    // Handle rules that map SVN subtrees of the deleted path
+     rules->matcher().svn_subtree_rules(
+         svn_path.str(), revnum,
+         // Mark the target Git tree for deletion, but
+         // also convert all SVN trees being mapped into a
+         // subtree of the Git tree.
+         boost::make_function_output_iterator(
+             [&](Rule const* r){ 
+                 invalidate_tree(rev, r->svn_path(), r); }));
+}
+
+// Calls f(path, cursor) on every file at or beneath svn_path,
+// skipping any file or subtree for which prune(path, is_dir) returns
+// true.  The cursor has matched the file's path at rev.
+template <class F, class Prune>
+void revision_planner::for_each_file(
+    svn::revision const& rev, path const& svn_path, F const& f, Prune const& prune)
+{
+    rule_cursor at = rules->matcher().match_cursor(rev.revnum);
+    at.advance(svn_path.str());
+    switch( svn::call(svn_fs_check_path, rev.fs_root, svn_path.c_str(), AprScratch(rev.scratch)) )
+    {
+    case svn_node_none: // If it turns out there's nothing here, there's nothing to do.
+        Log::error() << svn_path << " doesn't exist!" << std::endl;
+        assert(!"We added a non-existent path to convert somehow?!");
+        return;
+
+    case svn_node_unknown:
+        Log::error() << svn_path << " has unknown type!" << std::endl;
+        assert(!"SVN should know the type of every node in its filesystem?!");
+        return;
+
+    case svn_node_file:
+        if (!prune(svn_path, false))
+            f(svn_path, at);
+        break;
+
+    case svn_node_dir:
+        if (!prune(svn_path, true))
+        {
+            for_each_svn_file_in(
+                rev, svn_path, svn::node_id(rev, svn_path.c_str()), at, f, prune,
+                listings, walker.get());
+        }
+        break;
+    };
+}
+
+void revision_planner::discover_merges(svn::revision const& rev)
+{
+    for (auto p = copies.begin(); p != copies.end(); ++p)
+    {
+        // Merges into copied trees were recorded by the tree copier
+        if (excluded(p->first)
+            || (trees_copied.size() != 0 && trees_copied.covers(p->first)))
+            continue;
+        discover_merges_in(rev, p, p->first, svn::node_id(rev, p->first.c_str()));
+    }
+}
+
+// Record the merges made by the directory copy into dst_path, a
+// directory at or beneath the copy's destination.  Merges are recorded
+// per pair of refs, and unless a rule boundary lies beneath dst_path
+// or its source, every file within maps from the same source ref into
+// the same destination ref.  So the files are visited only where a
+// boundary does lie within, or another copy landed inside.
+void revision_planner::discover_merges_in(
+    svn::revision const& rev, copy_map::const_iterator copy, 
+    path const& dst_path, std::string const& node_id)
+{
+    auto const listing = svn::list_directory(rev, dst_path.c_str(), node_id, listings);
+    if (listing->empty())
+        return;
+
+    auto const& matcher = rules->matcher();
+    std::size_t const src_revnum = copy->second.src_revision;
+    path const src_path = copy->second.src_directory / dst_path.sans_prefix(copy->first);
+    auto merge = [&](Rule const* match, Rule const* src_match)
+    {
+        revision_plan::merge const m = { match, src_match, copy->first };
+        result->merges.push_back(m);
+    };
+
+    auto const next_copy = copies.upper_bound(dst_path);
+    bool const holds_copies 
+        = next_copy != copies.end() && next_copy->first.starts_with(dst_path);
+    if (!holds_copies)
+    {
+        Rule const* const match = converting(matcher.longest_match(dst_path.str(), revnum));
+        Rule const* const src_match
+            = converting(matcher.longest_match(src_path.str(), src_revnum));
+        if (match && src_match
+            && !finds_rules([&](boost::function_output_iterator<rule_detector> out) {
+                    matcher.svn_rules_beneath(dst_path.str(), revnum, out); })
+            && !finds_rules([&](boost::function_output_iterator<rule_detector> out) {
+                    matcher.svn_rules_beneath(src_path.str(), src_revnum, out); }))
+        {
+            merge(match, src_match);
+            return;
+        }
+    }
+
+    for (auto const& e : *listing)
+    {
+        path const subpath = dst_path/e.name;
+        if ((e.is_dir && excluded(subpath))
+            || (trees_copied.size() != 0 && trees_copied.covers(subpath)))
+            continue;
+
+        if (e.is_dir)
+        {
+            // A copy nested within this one has its merges discovered
+            // on its own
+            if (!holds_copies || copies.count(subpath) == 0)
+                discover_merges_in(rev, copy, subpath, e.node_id);
+        }
+        else if (Rule const* const match = match_path(subpath, revnum))
+        {
+            if (Rule const* const src_match = match_path(src_path/e.name, src_revnum))
+                merge(match, src_match);
+        }
+    }
+}
+
+// The merges recorded in svn:mergeinfo, where both the directory
+// merged into and the source are the roots of what their rules map:
+// Git can only say that a whole ref was merged into another.
+void revision_planner::discover_recorded_merges()
+{
+    repo.merges(revnum, recorded);
+    for (auto const& m : recorded)
+    {
+        path const svn_path(m.path);
+        path const src_path(m.source);
+        Rule const* const match = match_path(svn_path, revnum, false);
+        Rule const* const src_match = match_path(src_path, m.revision, false);
+        if (!match || !src_match || match->svn_path() != svn_path
+            || src_match->svn_path() != src_path
+            || match->git_ref_name() == src_match->git_ref_name())
+            continue;
+
+        Log::trace() << "r" << revnum << " records merging " << src_path << "@" << m.revision
+                     << " into " << svn_path << std::endl;
+        revision_plan::recorded_merge const merge = { match, src_match, std::size_t(m.revision) };
+        result->recorded_merges.push_back(merge);
+    }
+}
+
+// Walk the SVN trees to convert once, listing their files with the
+// rules that map them.  This discovers every ref to be committed in
+// this revision before any commit is opened.
+void revision_planner::plan_files(svn::revision const& rev)
+{
+    for (auto& svn_path : paths_to_convert)
+    {
+        for_each_file(
+            rev, svn_path, 
+            [&](path const& file_path, rule_cursor const& at) 
+            {
+                if (Rule const* const match = match_path(file_path, at))
+                {
+                    revision_plan::mapped_path const f = { file_path, match };
+                    result->files.push_back(f);
+                }
+            },
+            [this](path const& p, bool is_dir) { 
+                return (trees_copied.size() != 0 && trees_copied.covers(p))
+                    || (is_dir && excluded(p)); });
+    }
+}
+
+// The rule matching the directory dir at the current revision, and
+// whether it matches everything beneath
+revision_planner::directory_match const& revision_planner::match_directory(std::string dir)
+{
+    auto p = directory_matches.find(dir);
+    if (p == directory_matches.end())
+    {
+        auto const& matcher = rules->matcher();
+        directory_match m;
+        m.rule = matcher.longest_match(dir, revnum, m.first, m.last);
+        m.covers_files = !finds_rules(
+            [&](boost::function_output_iterator<rule_detector> out) {
+                matcher.svn_rules_beneath(dir, revnum, out); });
+        p = directory_matches.emplace(std::move(dir), m).first;
+    }
+    return p->second;
+}
+
+// Drop the directory matches that rules coming or going at the
+// current revision change: those whose match doesn't hold through it,
+// and those of the directories above each rule, which may no longer
+// match everything beneath them, or now do.
+void revision_planner::forget_directory_matches(
+    boost::iterator_range<Rule const* const*> const& transitions)
+{
+    std::size_t const r = revnum;
+    for (auto p = directory_matches.begin(); p != directory_matches.end();)
+    {
+        if (r < p->second.first || r > p->second.last)
+            p = directory_matches.erase(p);
+        else
+            ++p;
+    }
+    for (Rule const* rule : transitions)
+    {
+        std::string dir = rule->svn_path().str();
+        for (;;)
+        {
+            directory_matches.erase(dir);
+            if (dir.empty())
+                break;
+            std::size_t const slash = dir.rfind('/');
+            dir.resize(slash == std::string::npos ? 0 : slash);
+        }
+    }
+}
+
+// Find the rule matching svn_path at the current revision.  Unless
+// some rule lies beneath svn_path's directory, that's the rule
+// matching the directory itself, so all of its files can share one
+// lookup.
+Rule const* revision_planner::match_in_current_revision(path const& svn_path)
+{
+    auto const& matcher = rules->matcher();
+    std::string const& text = svn_path.str();
+    std::size_t const slash = text.rfind('/');
+    if (slash == std::string::npos)
+        return matcher.longest_match(text, revnum);
+
+    directory_match const& m = match_directory(std::string(text, 0, slash));
+    return m.covers_files ? m.rule : matcher.longest_match(text, revnum);
+}
+
+// True iff the directory at svn_path is excluded from the conversion
+// at the current revision, with everything beneath it, so that walks
+// over the SVN tree can skip it without listing it.
+bool revision_planner::excluded(path const& svn_path)
+{
+    directory_match const& m = match_directory(svn_path.str());
+    return m.covers_files && m.rule && m.rule->excludes();
+}
+
+Rule const* revision_planner::match_path(path const& svn_path, std::size_t revnum, bool require_match)
+{
+    Rule const* match = revnum == std::size_t(this->revnum)
+        ? match_in_current_revision(svn_path)
+        : rules->matcher().longest_match(svn_path.str(), revnum);
+    if (match && match->excludes())
+        return nullptr;
+    if (require_match && match == nullptr)
+    {
+        Log::error() << "Unmatched svn path " << svn_path 
+                     << " in r" << revnum << std::endl;
+        flight_recorder::note("unmatched", svn_path.str(), revnum);
+        assert(!"unmatched SVN path");
+    }
+    return match;
+}
+
+// The same, at the current revision, for a path a cursor has matched
+// already
+Rule const* revision_planner::match_path(path const& svn_path, rule_cursor const& at)
+{
+    Rule const* const match = at.match();
+    if (match == nullptr)
+    {
+        Log::error() << "Unmatched svn path " << svn_path 
+                     << " in r" << revnum << std::endl;
+        flight_recorder::note("unmatched", svn_path.str(), revnum);
+        assert(!"unmatched SVN path");
+    }
+    return match && match->excludes() ? nullptr : match;
+}
+
+background_planner::background_planner(
+    std::string const& repo_path, Ruleset const& rules, int first, int last, unsigned depth,
+    plan_store* plans)
+    : repo(repo_path, std::string()), rules(rules), planner(repo, this->rules, false), plans(plans),
+      planned(first - 1), last(last), depth(depth), stopping(false), listing_bytes(0),
+      thread(&background_planner::work, this)
+{}
+
+background_planner::~background_planner()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    space_ready.notify_all();
+    thread.join();
+    repo.save_changes();
+}
+
+bool background_planner::take(int revnum, revision_plan& plan)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;)
+    {
+        while (!ready.empty() && ready.front().revnum < revnum)
+        {
+            ready.pop_front();
+            space_ready.notify_all();
+        }
+        if (!ready.empty() || planned >= revnum || planned >= last || !error.empty())
+            break;
+        plan_ready.wait(lock);
+    }
+    if (!error.empty())
+        throw std::runtime_error(error);
+    if (ready.empty() || ready.front().revnum != revnum)
+        return false;
+
+    std::swap(plan, ready.front());
+    ready.pop_front();
+    lock.unlock();
+    space_ready.notify_all();
+
+    // What the planner logged comes out as if the importer had
+    std::cout << plan.log;
+    return true;
+}
+
+void background_planner::work()
+{
+    std::vector<svn::change> changes;
+    revision_plan plan;
+    for (int revnum = planned + 1; revnum <= last; ++revnum)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            space_ready.wait(lock, [this]{ return stopping || ready.size() < depth; });
+            if (stopping)
+                return;
+        }
+
+        bool skip = false;
+        try
+        {
+            repo.changes(revnum, changes);
+            skip = planner.changes_nothing(revnum, changes);
+            if (skip)
+            {
+                planner.skipped(revnum, revnum);
+            }
+            else if (!plans || !plans->find(revnum, plan))
+            {
+                Log::capture capture;
+                planner.plan(repo[revnum], plan);
+                plan.log = capture.str();
+                if (plans)
+                    plans->add(plan);
+            }
+        }
+        catch (std::exception const& e)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            error = e.what();
+            plan_ready.notify_all();
+            return;
+        }
+        listing_bytes = planner.bytes_held();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!skip)
+                ready.push_back(std::move(plan));
+            planned = revnum;
+        }
+        plan_ready.notify_all();
+    }
+}
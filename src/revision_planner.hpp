@@ -0,0 +1,282 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef REVISION_PLANNER_DWA20131124_HPP
+# define REVISION_PLANNER_DWA20131124_HPP
+
+# include "directory_cache.hpp"
+# include "path.hpp"
+# include "path_set.hpp"
+# include "ruleset.hpp"
+# include "svn.hpp"
+# include "tree_walker.hpp"
+
+# include <boost/function_output_iterator.hpp>
+# include <boost/range/iterator_range.hpp>
+# include <algorithm>
+# include <atomic>
+# include <condition_variable>
+# include <cstddef>
+# include <deque>
+# include <functional>
+# include <map>
+# include <memory>
+# include <mutex>
+# include <string>
+# include <thread>
+# include <unordered_map>
+# include <vector>
+
+class plan_store;
+
+// Receives the rules found by a query of the matcher, noting that
+// there are any
+struct rule_detector
+{
+    explicit rule_detector(bool& found) : found(found) {}
+    void operator()(Rule const*) const { found = true; }
+    bool& found;
+};
+
+// True iff the query, given an output iterator of rule_detectors,
+// finds any rules
+template <class Query>
+bool finds_rules(Query const& query)
+{
+    bool found = false;
+    query(boost::make_function_output_iterator(rule_detector(found)));
+    return found;
+}
+
+// The rule match, unless it excludes what it matches from the
+// conversion
+inline Rule const* converting(Rule const* match)
+{
+    return match && match->excludes() ? nullptr : match;
+}
+
+// What the first phase of importing an SVN revision discovers from
+// SVN and the rules alone: the Git subtrees to delete, the directory
+// copies and the merges they make, and the files to convert, each
+// with the rule mapping it.  The importer's second phase writes the
+// commits it calls for.
+struct revision_plan
+{
+    struct mapped_path
+    {
+        path svn_path;
+        Rule const* match;
+    };
+
+    struct directory_copy
+    {
+        path directory;             // the destination
+        path src_directory;
+        std::size_t src_revision;
+    };
+
+    struct merge
+    {
+        Rule const* match;          // the rule mapping the destination
+        Rule const* src_match;      // the rule mapping the source
+        path copy;                  // the destination of the copy making it
+    };
+
+    // A merge recorded in svn:mergeinfo, with --svn-mergeinfo
+    struct recorded_merge
+    {
+        Rule const* match;          // the rule mapping the destination
+        Rule const* src_match;      // the rule mapping the source
+        std::size_t src_revision;   // the last merged
+    };
+
+    int revnum;
+    std::vector<mapped_path> deletions;
+    std::vector<directory_copy> directory_copies; // by destination
+    std::vector<merge> merges;
+    std::vector<recorded_merge> recorded_merges;
+    std::vector<mapped_path> files; // in the order they're to be written
+
+    // What was logged while planning on another thread
+    std::string log;
+
+    void clear()
+    {
+        deletions.clear();
+        directory_copies.clear();
+        merges.clear();
+        recorded_merges.clear();
+        files.clear();
+        log.clear();
+    }
+};
+
+// Phase I of importing SVN revisions: action discovery.  A planner
+// keeps what it has learned about the SVN trees and the rules from
+// one revision to the next, and may be used on any one thread.
+class revision_planner
+{
+ public:
+    // With --copy-trees, called for each SVN directory copy, given
+    // its destination, source and source revision, and the sorted
+    // paths the revision changes, to write what it can as Git tree
+    // copies at once, adding the SVN trees so written to trees_copied
+    typedef std::function<
+        void(path const& dst_path, path const& src_path, std::size_t src_revnum,
+             std::vector<path> const& changed_paths, path_set& trees_copied)
+    > tree_copier;
+
+    // Planning the revisions of repo with rules, and with
+    // --walk-threads, listing its directories on threads of its own.
+    // With profiled, the phases of planning are profiled, so it must
+    // be used on the main thread.
+    revision_planner(svn const& repo, Ruleset const& rules, bool profiled);
+
+    // Plan by new rules from now on
+    void set_rules(Ruleset const& rules);
+
+    // True iff importing revnum, which makes the given changes, would
+    // change nothing in Git; see importer::skip_revisions
+    bool changes_nothing(int revnum, std::vector<svn::change> const& changes) const;
+
+    // True iff revnum, made by the SVN user author with the given
+    // changes, may be squashed with the revisions by author around it
+    // by the squash rules; see importer::skip_revisions
+    bool squashes(
+        int revnum, std::string const& author, std::vector<svn::change> const& changes) const;
+
+    // Note that the revisions first to last were skipped, changing
+    // nothing
+    void skipped(int first, int last);
+
+    // Plan the import of rev into plan, with copy_trees, if given,
+    // writing SVN directory copies as tree copies
+    void plan(svn::revision const& rev, revision_plan& plan, tree_copier const* copy_trees = nullptr);
+
+    // An estimate of the memory held by the directory listings cached
+    std::size_t bytes_held() const
+    {
+        return listings.bytes_held();
+    }
+
+    // Let the directory listings cached take the given share of
+    // their usual room; see resource_budget
+    void set_listing_share(double share)
+    {
+        listings.set_max_entries(std::max<std::size_t>(std::size_t(directory_cache_entries * share), 1024));
+    }
+
+    typedef patrie<Rule, coverage>::cursor rule_cursor;
+
+ private:
+    revision_planner(revision_planner const&);
+    revision_planner& operator=(revision_planner const&);
+
+    void process_changes(svn::revision const& rev, tree_copier const* copy_trees);
+    void process_directory_change(
+        svn::revision const& rev, svn::change const& change, path const& svn_path);
+    void add_tree_to_delete(path const& svn_path, Rule const* match);
+    void invalidate_tree(svn::revision const& rev, path const& svn_path, Rule const* match);
+    void add_tree_to_convert(
+        svn::revision const& rev, path const& svn_path, bool known_to_exist = false);
+    void discover_merges(svn::revision const& rev);
+    typedef std::map<path, revision_plan::directory_copy> copy_map;
+    void discover_merges_in(
+        svn::revision const& rev, copy_map::const_iterator copy,
+        path const& dst_path, std::string const& node_id);
+    void discover_recorded_merges();
+    void plan_files(svn::revision const& rev);
+    template <class F, class Prune>
+    void for_each_file(
+        svn::revision const& rev, path const& svn_path, F const& f, Prune const& prune);
+
+    Rule const* match_path(path const& svn_path, std::size_t revnum, bool require_match = true);
+    Rule const* match_path(path const& svn_path, rule_cursor const& at);
+    Rule const* match_in_current_revision(path const& svn_path);
+    bool excluded(path const& svn_path);
+
+    svn const& repo;
+    Ruleset const* rules;
+    bool const profiled;
+    std::unique_ptr<tree_walker> walker;   // null unless --walk-threads
+
+    // SVN directory listings, shared by every walk over the trees
+    static std::size_t const directory_cache_entries = 1 << 20;
+    directory_cache listings;
+
+    // The revision being planned, and what's found so far
+    int revnum;
+    revision_plan* result;
+    path_set paths_to_convert;
+    path_set trees_copied;      // written as Git tree copies
+    copy_map copies;
+    std::vector<svn::merge> recorded;
+
+    // The rule matching each directory, and whether it matches
+    // everything beneath.  Each is kept across transitions while the
+    // revision stays within the interval its match holds over, and no
+    // rule beneath the directory comes or goes.
+    struct directory_match
+    {
+        Rule const* rule;       // the directory's own match
+        bool covers_files;      // no rule lies beneath the directory
+        std::size_t first, last; // the revisions over which rule holds
+    };
+    directory_match const& match_directory(std::string dir);
+    void forget_directory_matches(boost::iterator_range<Rule const* const*> const& transitions);
+    std::unordered_map<std::string, directory_match> directory_matches;
+    int directory_matches_revnum; // the revision in which they were last valid
+};
+
+// Plans revisions first to last on a background thread, at most depth
+// ahead of those the importer takes, with views of SVN and the rules
+// of its own, so that the first phase of importing a revision goes on
+// while the second phase of an earlier one is writing to Git; see
+// --plan-ahead.  Revisions that change nothing are skipped as
+// importer::skip_revisions would.  With plans, those it holds are read
+// rather than made, and those made are added to it.
+class background_planner
+{
+ public:
+    background_planner(
+        std::string const& repo_path, Ruleset const& rules, int first, int last, unsigned depth,
+        plan_store* plans = nullptr);
+    ~background_planner();
+
+    // If revnum has been planned, or is to be, wait for its plan,
+    // swap it into plan and return true.  Plans of the revisions
+    // before it are dropped.
+    bool take(int revnum, revision_plan& plan);
+
+    // An estimate of the memory held by the planner's listings
+    std::size_t bytes_held() const
+    {
+        return listing_bytes;
+    }
+
+ private:
+    background_planner(background_planner const&);
+    background_planner& operator=(background_planner const&);
+
+    void work();
+
+    svn repo;
+    Ruleset const rules;
+    revision_planner planner;
+    plan_store* const plans;    // may be null
+
+    std::mutex mutex;
+    std::condition_variable plan_ready;
+    std::condition_variable space_ready;
+    std::deque<revision_plan> ready;
+    int planned;                // the last revision planned or skipped
+    int const last;
+    std::size_t const depth;
+    bool stopping;
+    std::string error;
+    std::atomic<std::size_t> listing_bytes;
+
+    std::thread thread;         // last, so it starts when all else is ready
+};
+
+#endif // REVISION_PLANNER_DWA20131124_HPP
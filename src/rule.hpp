@@ -6,66 +6,134 @@
 
 # include <string>
 # include <ostream>
+# include <cassert>
 # include <climits>
 # include "AST.hpp"
+# include "path.hpp"
+# include "git_address_key.hpp"
 # include <boost/algorithm/string/predicate.hpp>
 
 struct Rule
 {
+    // An exclude_rule makes a rule that excludes its path within
+    // the branch from the conversion.  It applies throughout the
+    // branch's revisions, whichever repository declares it, so the
+    // repositories sharing a branch share its exclusions.
     Rule(
         boost2git::RepoRule const* repo_rule,
         boost2git::BranchRule const* branch_rule,
-        boost2git::ContentRule const* content_rule
+        boost2git::ContentRule const* content_rule,
+        boost2git::ExcludeRule const* exclude_rule = 0
     )
         : repo_rule(repo_rule),
           branch_rule(branch_rule),
           content_rule(content_rule),
-          min(std::max(branch_rule->min, repo_rule->minrev)),
-          max(std::min(branch_rule->max, repo_rule->maxrev))
+          exclude_rule(exclude_rule),
+          min(exclude_rule ? branch_rule->min : std::max(branch_rule->min, repo_rule->minrev)),
+          max(exclude_rule ? branch_rule->max : std::min(branch_rule->max, repo_rule->maxrev)),
+          index(0),
+          coverage_index(0),
+          svn_prefix(
+              exclude_rule ? branch_rule->svn_path / exclude_rule->svn_path
+              : content_rule ? branch_rule->svn_path / content_rule->svn_path 
+              : branch_rule->svn_path),
+          git_prefix(content_rule ? content_rule->git_path : path()),
+          git_ref(boost2git::git_ref_name(branch_rule)),
+          address(exclude_rule ? std::string()
+                  : git_address_key(git_repo_name(), git_ref.str(), git_prefix.str()).str())
     {}
 
     // Constituent rules in the AST
     boost2git::RepoRule const* repo_rule;       // never 0
     boost2git::BranchRule const* branch_rule;   // never 0
     boost2git::ContentRule const* content_rule; // can be 0
+    boost2git::ExcludeRule const* exclude_rule; // can be 0
   
     std::size_t min, max;
 
+    // This rule's position among those of its Ruleset, numbered
+    // densely from 0, so per-rule state can be kept in a vector
+    std::size_t index;
+
+    // This rule's counters in coverage; assigned by coverage::declare
+    mutable std::size_t coverage_index;
+
     friend bool operator==(Rule const& lhs, Rule const& rhs)
     {
         return lhs.repo_rule == rhs.repo_rule
             && lhs.branch_rule == rhs.branch_rule
             && lhs.content_rule == rhs.content_rule
+            && lhs.exclude_rule == rhs.exclude_rule
             && lhs.min == rhs.min
             && lhs.max == rhs.max;
     }
 
-    path svn_path() const
+    path const& svn_path() const
+    {
+        return svn_prefix;
+    }
+
+    // True iff the paths this rule matches are converted nowhere
+    bool excludes() const
     {
-        return content_rule
-            ? branch_rule->svn_path / content_rule->svn_path
-            : branch_rule->svn_path;
+        return exclude_rule != 0;
     }
 
-    std::string git_address() const
+    // Where this rule maps its SVN path in Git, or the empty string
+    // if it excludes it
+    std::string const& git_address() const
     {
-        return git_repo_name() +  ":" + git_ref_name() + ":" + git_path().str();
+        return address;
     }
 
-    std::string git_repo_name() const
+    std::string const& git_repo_name() const
     {
         return repo_rule->git_repo_name;
     }
 
-    path git_path() const
+    path const& git_path() const
     {
-        return content_rule ? content_rule->git_path : path();
+        return git_prefix;
     }
 
-    std::string git_ref_name() const
+    // The Git path to which this rule maps svn_path, which must lie
+    // within svn_path(): the rest of svn_path, found by its length,
+    // appended to git_path() in a single string.
+    path git_path(path const& svn_path) const
     {
-        return boost2git::git_ref_name(branch_rule);
+        assert(svn_path.starts_with(svn_prefix));
+        std::string const& s = svn_path.str();
+        std::size_t start = svn_prefix.str().size();
+        if (start < s.size() && s[start] == '/')
+            ++start;
+        if (start == s.size())
+            return git_prefix;
+
+        std::string const& prefix = git_prefix.str();
+        std::string result;
+        result.reserve(prefix.size() + 1 + s.size() - start);
+        if (!prefix.empty())
+            result.append(prefix).append(1, '/');
+        result.append(s, start, std::string::npos);
+        return path(std::move(result));
     }
+
+    std::string const& git_ref_name() const
+    {
+        return git_ref.str();
+    }
+
+ private:
+    // Built once, when the Ruleset is constructed, since a path is
+    // translated for every file converted
+    path svn_prefix;
+    path git_prefix;
+    // Likewise, since the reverse trie is searched by Git address.
+    // The ref is interned as a path, like the SVN and Git paths, so
+    // that the rules of a branch many repositories share, e.g. from a
+    // common base, each hold a pointer to one copy of its name.
+    path git_ref;
+    std::string address;
 };
 
 void report_overlap(Rule const* rule0, Rule const* rule1);
@@ -81,7 +149,10 @@ inline std::ostream& operator<<(std::ostream& os, Rule const& r)
             os << r.max;
         os << "] ";
     }
-    os << r.git_address();
+    if (r.excludes())
+        os << "exclude " << r.svn_path().str();
+    else
+        os << r.git_address();
     return os;
 }
 
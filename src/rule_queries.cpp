@@ -0,0 +1,164 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#include "rule_queries.hpp"
+#include "ruleset.hpp"
+#include "log.hpp"
+
+#include <boost/function_output_iterator.hpp>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+void answer_rule_query(Ruleset const& ruleset, std::string const& query, std::string& answer)
+{
+    std::size_t const space = query.find(' ', 2);
+    if (query.size() < 3 || query[1] != ' ' || space == std::string::npos)
+    {
+        answer += "error: malformed query: " + query + "\n\n";
+        return;
+    }
+    std::size_t const revision = std::strtoul(query.c_str() + 2, nullptr, 10);
+    std::string const key = query.substr(space + 1);
+
+    std::ostringstream found;
+    auto out = boost::make_function_output_iterator(
+        [&](Rule const* r){ found << *r << '\n'; });
+    auto const& matcher = ruleset.matcher();
+    switch (query[0])
+    {
+    case 'm':
+        if (Rule const* r = matcher.longest_match(key, revision))
+            *out = r;
+        break;
+    case 'g': matcher.git_subtree_rules(key, revision, out); break;
+    case 's': matcher.svn_subtree_rules(key, revision, out); break;
+    case 'b': matcher.svn_rules_beneath(key, revision, out); break;
+    case 'B': matcher.git_rules_beneath(key, revision, out); break;
+    default:
+        answer += std::string("error: unknown query kind: ") + query[0] + "\n\n";
+        return;
+    }
+    answer += found.str();
+    answer += '\n';
+}
+
+void answer_rule_queries(Ruleset const& ruleset, std::istream& in, std::ostream& out)
+{
+    std::string answer;
+    for (std::string query; std::getline(in, query);)
+    {
+        answer.clear();
+        answer_rule_query(ruleset, query, answer);
+        out << answer << std::flush;
+    }
+}
+
+namespace
+{
+    void check_socket_call(int result, std::string const& what)
+    {
+        if (result < 0)
+            throw std::runtime_error(what + ": " + std::strerror(errno));
+    }
+
+    // Returns false iff the client went away
+    bool send_all(int fd, std::string const& data)
+    {
+        for (std::size_t sent = 0; sent < data.size();)
+        {
+            ssize_t const n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            sent += n;
+        }
+        return true;
+    }
+}
+
+void serve_rule_queries(Ruleset const& ruleset, std::string const& socket_path)
+{
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path))
+        throw std::runtime_error("Socket path too long: " + socket_path);
+    std::strcpy(address.sun_path, socket_path.c_str());
+
+    int const listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    check_socket_call(listener, "Couldn't create a socket");
+    ::unlink(socket_path.c_str());
+    check_socket_call(
+        ::bind(listener, reinterpret_cast<sockaddr const*>(&address), sizeof(address)),
+        "Couldn't bind " + socket_path);
+    check_socket_call(::listen(listener, SOMAXCONN), "Couldn't listen at " + socket_path);
+    Log::info() << "answering rule queries at " << socket_path << std::endl;
+
+    // The listener comes first, then the clients, each with the start
+    // of a query it hasn't finished sending
+    std::vector<pollfd> fds(1);
+    fds[0].fd = listener;
+    fds[0].events = POLLIN;
+    std::vector<std::string> unanswered(1);
+
+    std::string answer;
+    std::vector<char> buffer(1 << 16);
+    for (;;)
+    {
+        if (::poll(fds.data(), fds.size(), -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            check_socket_call(-1, "poll failed");
+        }
+
+        for (std::size_t i = fds.size(); i-- > 1;)
+        {
+            if (fds[i].revents == 0)
+                continue;
+            ssize_t const n = ::read(fds[i].fd, buffer.data(), buffer.size());
+            bool done = n <= 0 && !(n < 0 && errno == EINTR);
+            if (n > 0)
+            {
+                std::string& input = unanswered[i];
+                input.append(buffer.data(), n);
+                answer.clear();
+                std::size_t start = 0;
+                for (std::size_t end; (end = input.find('\n', start)) != std::string::npos; start = end + 1)
+                    answer_rule_query(ruleset, input.substr(start, end - start), answer);
+                input.erase(0, start);
+                done = !send_all(fds[i].fd, answer);
+            }
+            if (done)
+            {
+                ::close(fds[i].fd);
+                fds.erase(fds.begin() + i);
+                unanswered.erase(unanswered.begin() + i);
+            }
+        }
+
+        if (fds[0].revents & POLLIN)
+        {
+            int const client = ::accept(listener, nullptr, nullptr);
+            if (client >= 0)
+            {
+                pollfd p;
+                p.fd = client;
+                p.events = POLLIN;
+                p.revents = 0;
+                fds.push_back(p);
+                unanswered.emplace_back();
+            }
+        }
+    }
+}
@@ -0,0 +1,39 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef RULE_QUERIES_DWA20131110_HPP
+# define RULE_QUERIES_DWA20131110_HPP
+
+# include <iosfwd>
+# include <string>
+
+class Ruleset;
+
+// Answering many questions about a ruleset from one process, which
+// parses and compiles it once.  Queries are lines in the format
+// written by --record-lookups:
+//
+//   KIND REVISION KEY
+//
+// where KIND is m (longest_match of the SVN path KEY), g or s
+// (git_subtree_rules or svn_subtree_rules of KEY), or b or B
+// (svn_rules_beneath or git_rules_beneath of KEY).  Git addresses
+// are written REPOSITORY:REF:PATH.  Each answer is the rules found,
+// one per line as --dump-rules writes them, followed by an empty
+// line; a malformed query is answered by a line starting "error: "
+// and an empty line.
+
+// Append the answer to query, a line without its newline, to answer
+void answer_rule_query(Ruleset const& ruleset, std::string const& query, std::string& answer);
+
+// Answer each query read from in on out, flushing after each answer,
+// until in is exhausted
+void answer_rule_queries(Ruleset const& ruleset, std::istream& in, std::ostream& out);
+
+// Answer the queries of clients connecting to a Unix domain socket
+// at socket_path, replacing any socket already there, until killed.
+// Clients are served one query at a time, in turn, so a client may
+// keep its connection open for any number of queries.
+void serve_rule_queries(Ruleset const& ruleset, std::string const& socket_path);
+
+#endif // RULE_QUERIES_DWA20131110_HPP
@@ -0,0 +1,199 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef RULES_CACHE_DWA20131028_HPP
+# define RULES_CACHE_DWA20131028_HPP
+
+# include "AST.hpp"
+# include "sha1.hpp"
+# include "state_file.hpp"
+# include <boost/filesystem.hpp>
+# include <cstdint>
+# include <cstdlib>
+# include <cstring>
+# include <exception>
+# include <string>
+# include <vector>
+
+// Reading back a parsed ruleset is much faster than parsing
+// repositories.txt again, which svn2git does at startup and
+// fix-submodule-refs on every push.  So the AST of each ruleset
+// parsed is kept in a state_file named for the SHA-1 of the rules'
+// text, under $XDG_CACHE_HOME/svn2git (by default ~/.cache/svn2git).
+// A ruleset that has changed has a different name, and so is parsed
+// afresh.
+namespace rules_cache
+{
+    std::uint64_t const format = 0x3330736575727332ull; // "2rules03"
+
+    // The directory svn2git keeps its caches in, or the empty path if
+    // there is none
+    inline boost::filesystem::path directory()
+    {
+        if (char const* xdg = std::getenv("XDG_CACHE_HOME"))
+            return boost::filesystem::path(xdg) / "svn2git";
+        if (char const* home = std::getenv("HOME"))
+            return boost::filesystem::path(home) / ".cache" / "svn2git";
+        return boost::filesystem::path();
+    }
+
+    // The cache file for rules whose text has the given SHA-1, or
+    // the empty string if there is no cache directory
+    inline std::string file_name(std::string const& rules_sha1)
+    {
+        boost::filesystem::path const dir = directory();
+        return dir.empty() ? std::string() : (dir / (rules_sha1 + ".rules")).string();
+    }
+
+    namespace detail
+    {
+        inline void write_strings(state_file::writer& w, std::vector<std::string> const& v)
+        {
+            w.word(v.size());
+            for (auto const& s : v)
+                w.str(s);
+        }
+
+        inline std::vector<std::string> read_strings(state_file::reader& r)
+        {
+            std::vector<std::string> result(r.word());
+            for (auto& s : result)
+                s = r.str();
+            return result;
+        }
+
+        inline void write_branches(
+            state_file::writer& w, std::vector<boost2git::BranchRule> const& v)
+        {
+            w.word(v.size());
+            for (auto const& b : v)
+            {
+                w.word(b.min).word(b.max).str(b.svn_path.str())
+                    .str(b.git_branch_or_tag_name).word(b.line).str(b.git_ref_qualifier);
+            }
+        }
+
+        // The parser points each branch's qualifier at one of these
+        inline char const* ref_qualifier(std::string const& s)
+        {
+            if (s == "refs/heads/")
+                return "refs/heads/";
+            if (s == "refs/tags/")
+                return "refs/tags/";
+            throw std::runtime_error("unknown ref qualifier " + s);
+        }
+
+        inline std::vector<boost2git::BranchRule> read_branches(state_file::reader& r)
+        {
+            std::vector<boost2git::BranchRule> result(r.word());
+            for (auto& b : result)
+            {
+                b.min = r.word();
+                b.max = r.word();
+                b.svn_path = path(r.str());
+                b.git_branch_or_tag_name = r.str();
+                b.line = int(r.word());
+                b.git_ref_qualifier = ref_qualifier(r.str());
+            }
+            return result;
+        }
+    }
+
+    // Store ast as the parse of rules with the given SHA-1.  Failure
+    // only costs the next run a parse, so it is not reported.
+    inline void save(std::string const& filename, std::string const& rules_sha1,
+                     boost2git::AST const& ast)
+    {
+        using namespace detail;
+        state_file::writer w;
+        w.word(format).str(rules_sha1).word(ast.size());
+        for (auto const& repo : ast)
+        {
+            w.word(repo.is_abstract).word(repo.line).str(repo.git_repo_name);
+            write_strings(w, repo.bases);
+            write_strings(w, repo.submodule_info);
+            w.word(repo.minrev).word(repo.maxrev);
+            w.word(repo.content_rules.size());
+            for (auto const& c : repo.content_rules)
+                w.str(c.svn_path.str()).str(c.git_path.str()).word(c.line);
+            write_branches(w, repo.branch_rules);
+            write_branches(w, repo.tag_rules);
+            w.word(repo.exclusions.size());
+            for (auto const& x : repo.exclusions)
+                w.str(x.svn_path.str()).word(x.line);
+            w.word(repo.squash_rules.size());
+            for (auto const& q : repo.squash_rules)
+                w.str(q.kind).str(q.value).word(q.line);
+        }
+
+        boost::system::error_code ec;
+        boost::filesystem::create_directories(
+            boost::filesystem::path(filename).parent_path(), ec);
+        try
+        {
+            w.save(filename);
+        }
+        catch (std::exception const&) {}
+    }
+
+    // If filename holds the parse of rules with the given SHA-1, read
+    // it into ast and return true; otherwise return false.
+    inline bool load(std::string const& filename, std::string const& rules_sha1,
+                     boost2git::AST& ast)
+    {
+        using namespace detail;
+        boost::system::error_code ec;
+        if (!boost::filesystem::exists(filename, ec))
+            return false;
+        try
+        {
+            state_file::reader r(filename);
+            if (r.word() != format || r.str() != rules_sha1)
+                return false;
+
+            boost2git::AST result;
+            for (std::uint64_t n = r.word(); n != 0; --n)
+            {
+                boost2git::RepoRule repo;
+                repo.is_abstract = r.word() != 0;
+                repo.line = int(r.word());
+                repo.git_repo_name = r.str();
+                repo.bases = read_strings(r);
+                repo.submodule_info = read_strings(r);
+                repo.minrev = r.word();
+                repo.maxrev = r.word();
+                repo.content_rules.resize(r.word());
+                for (auto& c : repo.content_rules)
+                {
+                    c.svn_path = path(r.str());
+                    c.git_path = path(r.str());
+                    c.line = int(r.word());
+                }
+                repo.branch_rules = read_branches(r);
+                repo.tag_rules = read_branches(r);
+                repo.exclusions.resize(r.word());
+                for (auto& x : repo.exclusions)
+                {
+                    x.svn_path = path(r.str());
+                    x.line = int(r.word());
+                }
+                repo.squash_rules.resize(r.word());
+                for (auto& q : repo.squash_rules)
+                {
+                    q.kind = r.str();
+                    q.value = r.str();
+                    q.line = int(r.word());
+                }
+                result.insert(result.end(), std::move(repo));
+            }
+            ast.swap(result);
+            return true;
+        }
+        catch (std::exception const&)
+        {
+            return false;
+        }
+    }
+}
+
+#endif // RULES_CACHE_DWA20131028_HPP
@@ -0,0 +1,182 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef RULES_DIFF_DWA20131106_HPP
+# define RULES_DIFF_DWA20131106_HPP
+
+# include "rule.hpp"
+# include "ruleset.hpp"
+# include <algorithm>
+# include <initializer_list>
+# include <map>
+# include <string>
+# include <tuple>
+# include <utility>
+# include <vector>
+
+// The first SVN revision whose conversion may differ, by the name of
+// each Git repository affected by a change to the rules
+typedef std::map<std::string, std::size_t> changed_revision_map;
+
+namespace rules_diff_
+{
+    // A rule without its revision range.  Rules with the same
+    // address map the same SVN paths to the same place in Git.  An
+    // exclusion belongs to no repository; a change to it affects
+    // those of the rules enclosing its path.
+    typedef std::tuple<std::string, std::string, std::string, std::string> address;
+    typedef std::vector<std::pair<std::size_t, std::size_t> > ranges;
+
+    inline address address_of(Rule const& r)
+    {
+        if (r.excludes())
+            return address(std::string(), std::string(), r.svn_path().str(), std::string());
+        return address(r.git_repo_name(), r.git_ref_name(), r.svn_path().str(), r.git_path().str());
+    }
+
+    // The repository into which r converts, if any
+    inline std::string const& converted_repo(Rule const& r)
+    {
+        static std::string const none;
+        return r.excludes() ? none : r.git_repo_name();
+    }
+
+    inline bool covers(ranges const& rs, std::size_t revnum)
+    {
+        for (auto const& r : rs)
+        {
+            if (r.first <= revnum && revnum <= r.second)
+                return true;
+        }
+        return false;
+    }
+
+    // The first revision in which one of old_ranges and new_ranges
+    // applies and the other doesn't, or zero if there is none.  Which
+    // ranges apply only changes where one of them begins or ends.
+    inline std::size_t first_difference(ranges const& old_ranges, ranges const& new_ranges)
+    {
+        std::vector<std::size_t> bounds;
+        for (auto const* rs : { &old_ranges, &new_ranges })
+        {
+            for (auto const& r : *rs)
+            {
+                bounds.push_back(std::max<std::size_t>(r.first, 1));
+                if (r.second + 1 > r.second)
+                    bounds.push_back(r.second + 1);
+            }
+        }
+        std::sort(bounds.begin(), bounds.end());
+        for (std::size_t revnum : bounds)
+        {
+            if (covers(old_ranges, revnum) != covers(new_ranges, revnum))
+                return revnum;
+        }
+        return 0;
+    }
+
+    inline void note_change(changed_revision_map& changes, std::string const& repo, std::size_t revnum)
+    {
+        if (repo.empty())
+            return;
+        auto const p = changes.emplace(repo, revnum);
+        if (!p.second)
+            p.first->second = std::min(p.first->second, revnum);
+    }
+}
+
+// Compare the rules of two rulesets, given as their rules and
+// repositories, and return the repositories whose conversion may
+// differ between them, each with the first revision affected.  A
+// changed rule affects its own repository, and that of any rule
+// enclosing its SVN path, which matched or comes to match what the
+// changed rule didn't or no longer does.  A repository declared a
+// submodule differently is affected throughout, as are its old and
+// new super-modules, and every super-module is affected from the
+// first revision its submodules are, since its gitlinks name their
+// commits.
+template <class OldRules, class NewRules>
+changed_revision_map diff_rules(
+    OldRules const& old_rules, std::vector<Ruleset::Repository> const& old_repos,
+    NewRules const& new_rules, std::vector<Ruleset::Repository> const& new_repos)
+{
+    using namespace rules_diff_;
+
+    std::map<address, std::pair<ranges, ranges> > rules_by_address;
+    for (Rule const& r : old_rules)
+        rules_by_address[address_of(r)].first.emplace_back(r.min, r.max);
+    for (Rule const& r : new_rules)
+        rules_by_address[address_of(r)].second.emplace_back(r.min, r.max);
+
+    changed_revision_map changes;
+    auto note_enclosing = [&](path const& svn_path, std::size_t revnum, Rule const& r) {
+        if (!(r.svn_path() == svn_path) && svn_path.starts_with(r.svn_path()) && r.max >= revnum)
+            note_change(changes, converted_repo(r), std::max(revnum, r.min));
+    };
+    for (auto const& kv : rules_by_address)
+    {
+        std::size_t const revnum = first_difference(kv.second.first, kv.second.second);
+        if (revnum == 0)
+            continue;
+        note_change(changes, std::get<0>(kv.first), revnum);
+
+        path const svn_path(std::get<2>(kv.first));
+        for (Rule const& r : old_rules)
+            note_enclosing(svn_path, revnum, r);
+        for (Rule const& r : new_rules)
+            note_enclosing(svn_path, revnum, r);
+    }
+
+    // Submodule declarations
+    std::map<std::string, std::size_t> first_revisions;
+    for (Rule const& r : old_rules)
+        note_change(first_revisions, converted_repo(r), std::max<std::size_t>(r.min, 1));
+    for (Rule const& r : new_rules)
+        note_change(first_revisions, converted_repo(r), std::max<std::size_t>(r.min, 1));
+
+    std::map<std::string, Ruleset::Repository const*> old_by_name;
+    for (auto const& repo : old_repos)
+        old_by_name[repo.name] = &repo;
+    for (auto const& repo : new_repos)
+    {
+        auto const old = old_by_name.find(repo.name);
+        if (old != old_by_name.end()
+            && old->second->submodule_in_repo == repo.submodule_in_repo
+            && old->second->submodule_path == repo.submodule_path)
+            continue;
+        auto const first = first_revisions.find(repo.name);
+        std::size_t const revnum = first == first_revisions.end() ? 1 : first->second;
+        note_change(changes, repo.name, revnum);
+        note_change(changes, repo.submodule_in_repo, revnum);
+        if (old != old_by_name.end())
+            note_change(changes, old->second->submodule_in_repo, revnum);
+    }
+
+    // Super-modules, nested or not
+    for (bool propagated = true; propagated;)
+    {
+        propagated = false;
+        for (auto const& repo : new_repos)
+        {
+            auto const c = changes.find(repo.name);
+            if (c == changes.end() || repo.submodule_in_repo.empty())
+                continue;
+            auto const s = changes.find(repo.submodule_in_repo);
+            if (s == changes.end() || s->second > c->second)
+            {
+                note_change(changes, repo.submodule_in_repo, c->second);
+                propagated = true;
+            }
+        }
+    }
+    return changes;
+}
+
+inline changed_revision_map diff_rules(Ruleset const& old_rules, Ruleset const& new_rules)
+{
+    return diff_rules(
+        old_rules.matcher().all_rules(), old_rules.repositories(),
+        new_rules.matcher().all_rules(), new_rules.repositories());
+}
+
+#endif // RULES_DIFF_DWA20131106_HPP
@@ -19,7 +19,10 @@
 #include "to_string.hpp"
 
 #include <boost/foreach.hpp>
+#include <chrono>
+#include <map>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <boost/fusion/include/make_vector.hpp>
@@ -33,14 +36,37 @@ void append_addresses(Seq1& target, Seq2 const& source)
     target.push_back(&x);
   }
           
-static void
+// The rules a repository rule has of its own and from its bases
+struct RuleComponents
+  {
+  std::vector<boost2git::BranchRule const*> branches;
+  std::vector<boost2git::BranchRule const*> tags;
+  std::vector<boost2git::ContentRule const*> content;
+  std::vector<boost2git::ExcludeRule const*> exclusions;
+  std::vector<boost2git::SquashRule const*> squashes;
+  };
+
+template <class T>
+void append(std::vector<T>& target, std::vector<T> const& source)
+  {
+  target.insert(target.end(), source.begin(), source.end());
+  }
+
+// Collect the components of repo_rule, those of each base rule being
+// collected only once however many rules derive from it
+static RuleComponents const&
 collect_rule_components(
     AST const& ast,
     boost2git::RepoRule const& repo_rule,
-    std::vector<boost2git::BranchRule const*>& branches,
-    std::vector<boost2git::BranchRule const*>& tags,
-    std::vector<boost2git::ContentRule const*>& content)
+    std::map<boost2git::RepoRule const*, RuleComponents>& collected)
   {
+  auto const known = collected.find(&repo_rule);
+  if (known != collected.end())
+    {
+    return known->second;
+    }
+
+  RuleComponents result;
   boost2git::RepoRule search_target;
 
   BOOST_FOREACH(std::string const& base_name, repo_rule.bases)
@@ -57,18 +83,67 @@ collect_rule_components(
     
     for (AST::iterator p = base_range.first; p != base_range.second; ++p)
       {
-      collect_rule_components(ast, *p, branches, tags, content);
+      RuleComponents const& base = collect_rule_components(ast, *p, collected);
+      append(result.branches, base.branches);
+      append(result.tags, base.tags);
+      append(result.content, base.content);
+      append(result.exclusions, base.exclusions);
+      append(result.squashes, base.squashes);
       }
     }
 
-  append_addresses(branches, repo_rule.branch_rules);
-  append_addresses(tags, repo_rule.tag_rules);
-  append_addresses(content, repo_rule.content_rules);
+  append_addresses(result.branches, repo_rule.branch_rules);
+  append_addresses(result.tags, repo_rule.tag_rules);
+  append_addresses(result.content, repo_rule.content_rules);
+  append_addresses(result.exclusions, repo_rule.exclusions);
+  append_addresses(result.squashes, repo_rule.squash_rules);
+  return collected[&repo_rule] = std::move(result);
   }
 
 Ruleset::Ruleset(std::string const& filename)
-    : ast_(parse_rules_file(filename))
+    : rule_count_(0), build_seconds_(0), ast_(parse_rules_file(filename))
   {
+  // Repositories sharing a branch, e.g. through a common base, also
+  // share its exclusions, which are inserted only once
+  std::set<std::pair<BranchRule const*, ExcludeRule const*> > exclusions_inserted;
+  std::map<RepoRule const*, RuleComponents> collected;
+
+  // With --only-repo, the rules of the other repositories exclude
+  // what they would map, so the paths they match are still accounted
+  // for, and the revisions changing only those are skipped.  Its
+  // super-module is converted too with --only-repo-gitlinks, but gets
+  // nothing but the gitlinks.
+  std::set<std::string> converted;
+  if (!options.only_repo.empty())
+    {
+    BOOST_FOREACH(RepoRule const& repo_rule, ast_)
+      {
+      if (repo_rule.is_abstract || repo_rule.git_repo_name != options.only_repo)
+        {
+        continue;
+        }
+      converted.insert(repo_rule.git_repo_name);
+      if (options.only_repo_gitlinks && !repo_rule.submodule_info.empty())
+        {
+        converted.insert(repo_rule.submodule_info[0]);
+        }
+      }
+    if (converted.empty())
+      {
+      throw std::runtime_error(
+          "--only-repo: " + options.rules_file + " has no repository " + options.only_repo);
+      }
+    }
+
+  // The rules are gathered, then loaded into the matcher at once.
+  // A deque grows without moving them, and the matcher takes it over.
+  std::deque<Match> matches;
+  auto insert = [&](Match match)
+    {
+    match.index = rule_count_++;
+    matches.push_back(match);
+    };
+
   BOOST_FOREACH(RepoRule const& repo_rule, ast_)
     {  
     if (repo_rule.is_abstract)
@@ -77,14 +152,21 @@ Ruleset::Ruleset(std::string const& filename)
       }
 
     typedef std::vector<BranchRule const*> BranchRules;
-    BranchRules branches;
-    BranchRules tags;
-    std::vector<ContentRule const*> content;
-    collect_rule_components(ast_, repo_rule, branches, tags, content);
+    RuleComponents const& components = collect_rule_components(ast_, repo_rule, collected);
+    BranchRules const& branches = components.branches;
+    BranchRules const& tags = components.tags;
+    std::vector<ContentRule const*> const& content = components.content;
+    std::vector<ExcludeRule const*> const& exclusions = components.exclusions;
+    bool const mapped = options.only_repo.empty() || repo_rule.git_repo_name == options.only_repo;
+    if (!components.squashes.empty())
+      {
+      squashes_[&repo_rule] = components.squashes;
+      }
     
     Repository repo;
     repo.name = repo_rule.git_repo_name;
-    if (!repo_rule.submodule_info.empty())
+    if (!repo_rule.submodule_info.empty()
+        && (converted.empty() || converted.count(repo_rule.submodule_info[0])))
       {
       assert(repo_rule.submodule_info.size() == 2);
       repo.submodule_in_repo = repo_rule.submodule_info[0];
@@ -97,6 +179,23 @@ Ruleset::Ruleset(std::string const& filename)
       {
       BOOST_FOREACH(BranchRule const* branch_rule, *rules)
         {
+        auto add_mapping = [&](ContentRule const* content_rule)
+          {
+          if (mapped)
+            {
+            insert(Match(&repo_rule, branch_rule, content_rule));
+            return;
+            }
+          ExcludeRule excluded;
+          excluded.svn_path = content_rule ? content_rule->svn_path : path();
+          excluded.line = content_rule ? content_rule->line : branch_rule->line;
+          unmapped_.push_back(excluded);
+          Match match(&repo_rule, branch_rule, 0, &unmapped_.back());
+          match.min = std::max(branch_rule->min, repo_rule.minrev);
+          match.max = std::min(branch_rule->max, repo_rule.maxrev);
+          insert(match);
+          };
+
         assert(std::strcmp(branch_rule->git_ref_qualifier, "refs/heads/") == 0
               || std::strcmp(branch_rule->git_ref_qualifier, "refs/tags/") == 0);
         
@@ -111,22 +210,45 @@ Ruleset::Ruleset(std::string const& filename)
 
         if (repo_rule.content_rules.empty())
           {
-          matcher_.insert(Match(&repo_rule, branch_rule, 0));
+          add_mapping(0);
           }
         else
           {
           BOOST_FOREACH(ContentRule const* content_rule, content)
             {
-            matcher_.insert(
-                Match(&repo_rule, branch_rule, content_rule));
+            add_mapping(content_rule);
+            }
+          }
+
+        BOOST_FOREACH(ExcludeRule const* exclude_rule, exclusions)
+          {
+          if (exclusions_inserted.insert(std::make_pair(branch_rule, exclude_rule)).second)
+            {
+            insert(Match(&repo_rule, branch_rule, 0, exclude_rule));
             }
           }
         }
       }
-    repositories_.push_back(repo);
+    if (converted.empty() || converted.count(repo.name))
+      {
+      repositories_.push_back(repo);
+      }
     }
+
+  auto const start = std::chrono::steady_clock::now();
+  matcher_.insert_all(std::move(matches));
+  matcher_.freeze();
+  build_seconds_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
   }
 
+// The line declaring the content or exclusion a rule adds to its
+// branch, or the branch's own if there is none
+static int fragment_line(Rule const* r)
+{
+    return r->exclude_rule ? r->exclude_rule->line
+        : r->content_rule ? r->content_rule->line : r->branch_rule->line;
+}
+
 void report_overlap(Rule const* rule0, Rule const* rule1)
 {
     throw std::runtime_error(
@@ -135,13 +257,13 @@ void report_overlap(Rule const* rule0, Rule const* rule1)
         + options.rules_file + ":" + to_string(rule1->branch_rule->line)
         + ": error: duplicate rule branch fragment\n"
           
-        + options.rules_file + ":" + to_string(rule1->content_rule->line)
+        + options.rules_file + ":" + to_string(fragment_line(rule1))
         + ": error: duplicate rule content fragment\nerror: see earlier definition:\n"
           
         + options.rules_file + ":" + to_string(rule0->branch_rule->line)
         + ": error: previous branch fragment\n"
           
-        + options.rules_file + ":" + to_string(rule0->content_rule->line)
+        + options.rules_file + ":" + to_string(fragment_line(rule0))
         + ": error: previous content fragment");
 }
 
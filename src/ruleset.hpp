@@ -18,6 +18,8 @@
 #ifndef RULESET_HPP
 #define RULESET_HPP
 
+#include <deque>
+#include <map>
 #include <set>
 #include <string>
 #include <vector>
@@ -43,6 +45,12 @@ class Ruleset
     };
  public:
     Ruleset(std::string const& filename);
+
+    // A copy matches against the original's rules, which must
+    // outlive it, but keeps lookup state of its own, so the two can
+    // be used on different threads at once.  Freeze the original's
+    // matcher first, so the copies don't each build its tables.
+    Ruleset(Ruleset const&) = default;
  public:
     patrie<Rule,coverage> const& matcher() const
     {
@@ -56,9 +64,39 @@ class Ruleset
     {
         return ast_;
     }
+    // The number of rules, one more than the greatest Rule::index
+    std::size_t rule_count() const
+    {
+        return rule_count_;
+    }
+    // The squash rules of the repository declared by repo_rule, its
+    // own and its bases'
+    std::vector<boost2git::SquashRule const*> const& squash_rules(
+        boost2git::RepoRule const* repo_rule) const
+    {
+        static std::vector<boost2git::SquashRule const*> const none;
+        auto const p = squashes_.find(repo_rule);
+        return p == squashes_.end() ? none : p->second;
+    }
+    // True iff any repository has squash rules
+    bool squashes() const
+    {
+        return !squashes_.empty();
+    }
+    // The time taken to build the matcher's tries from the rules
+    double build_seconds() const
+    {
+        return build_seconds_;
+    }
  private:
+    std::size_t rule_count_;
+    double build_seconds_;
     patrie<Rule,coverage> matcher_;
     std::vector<Repository> repositories_;
+    std::map<boost2git::RepoRule const*, std::vector<boost2git::SquashRule const*> > squashes_;
+    // The exclusions standing in for the rules of the repositories
+    // --only-repo leaves out
+    std::deque<boost2git::ExcludeRule> unmapped_;
     boost2git::AST ast_;
 };
 
@@ -0,0 +1,305 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Measures how the Ruleset scales with the number of rules, for
+// rulesets far larger than repositories.txt.
+//
+//   ruleset_bench --generate RULES FILE
+//
+// writes a synthetic rules file of at least RULES rules, shaped like
+// repositories.txt: abstract base repositories holding the branches
+// and tags, most of them bounded by revisions, one with exclusions; and
+// repositories deriving from them whose content rules lie deep in the
+// SVN tree, some with a minrev, branches and tags of their own, or a
+// super-module.  The same RULES always gives the same file.
+//
+//   ruleset_bench FILE [LOOKUPS [REPEAT]]
+//
+// reports the time and resident memory taken to parse FILE and build
+// the Ruleset's matcher, and to build a component_trie of the same
+// rules, then times LOOKUPS longest_match lookups of paths beneath
+// random rules, REPEAT times: at the last revision, which the patrie
+// answers from its snapshot of the current revision, and at random
+// revisions within the rules' bounds, which it answers from its flat
+// trie, each against the component_trie too.  See "make
+// bench_rulesets" for a run over 10k, 100k and 1M rules.
+
+#include "ruleset.hpp"
+#include "component_trie.hpp"
+#include "memory_report.hpp"
+#include "options.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// The newest revision the generated rules mention
+static std::size_t const last_revision = 400000;
+
+// Use the results of each lookup, so it can't be optimized away
+static std::size_t sink;
+
+// The bounds of a revision-bounded rule, written "[min:max]", with
+// either omitted when unbounded
+static std::string bounds(std::size_t min, std::size_t max)
+{
+    return "[" + (min ? std::to_string(min) : std::string()) + ":"
+        + (max != last_revision ? std::to_string(max) : std::string()) + "]";
+}
+
+// Writes a rules file of at least target rules to out, returning the
+// number of rules it makes
+static std::size_t generate_rules(std::ostream& out, std::size_t target)
+{
+    std::mt19937 random(target);
+    auto uniform = [&](std::size_t lo, std::size_t hi)
+    {
+        return std::uniform_int_distribution<std::size_t>(lo, hi)(random);
+    };
+
+    // Each family of repositories shares the refs of an abstract base
+    std::size_t const families = 4, branches = 30, tags = 60;
+    std::size_t const base_refs = 2 + branches + tags;
+
+    out << "// Generated by ruleset_bench --generate " << target << "\n";
+    for (std::size_t f = 0; f < families; ++f)
+    {
+        // trunk moved when the projects were merged into one tree
+        std::size_t const merged = uniform(1000, 50000);
+        out << "\nabstract repository family" << f << "\n{\n  branches\n  {\n"
+            << "    " << bounds(0, merged) << " \"/trunk/family" << f << "/\" : \"master\";\n"
+            << "    " << bounds(merged + 1, last_revision) << " \"/trunk/\" : \"master\";\n";
+        for (std::size_t b = 0; b < branches; ++b)
+        {
+            // Most branches live for a while; a few never die
+            std::size_t const min = uniform(merged + 1, last_revision - 1000);
+            std::size_t const max = b % 3 ? std::min(min + uniform(100, 20000), last_revision) : last_revision;
+            if (b % 4 == 0)
+                out << "    " << bounds(min, max) << " \"/branches/people/user" << b % 17
+                    << "/family" << f << "/topic" << b << "/\" : \"user" << b % 17 << "/topic" << b << "\";\n";
+            else
+                out << "    " << bounds(min, max) << " \"/branches/family" << f << "/topic" << b
+                    << "/\" : \"topic" << b << "\";\n";
+        }
+        out << "  }\n  tags\n  {\n";
+        for (std::size_t t = 0; t < tags; ++t)
+        {
+            // A tag is made in one revision and often never changed
+            std::size_t const made = uniform(merged + 1, last_revision);
+            std::string const version = "Version_1_" + std::to_string(t / 3) + "_" + std::to_string(t % 3);
+            out << "    " << bounds(made, t % 2 ? made : last_revision) << " \"/tags/release/"
+                << version << "/family" << f << "/\" : \"release/" << version << "\";\n";
+        }
+        out << "  }\n";
+        // Exclusions apply to the whole branch, so only one family
+        // whose branches overlap the others' may have them
+        if (f == 0)
+            out << "  exclude\n  {\n    \"CVSROOT/\";\n  }\n";
+        out << "}\n";
+    }
+
+    // A super-module holding many of the repositories as submodules
+    out << "\nrepository super : family0\n{\n  content\n  {\n    \"index/\";\n  }\n}\n";
+    std::size_t rules = base_refs;
+
+    for (std::size_t i = 0; rules < target; ++i)
+    {
+        std::string const lib = "lib" + std::to_string(i);
+        std::string const area = "area" + std::to_string(i % 37);
+        std::string const sub = "sub" + std::to_string(i % 11);
+        out << "\nrepository " << lib << " : family" << i % families << "\n{\n";
+        if (i % 5 == 0)
+            out << "  submodule of \"super\" : \"libs/" << lib << "\";\n";
+        if (i % 10 == 3)
+            out << "  minrev " << uniform(1, last_revision / 2) << ";\n";
+        out << "  content\n  {\n"
+            << "    \"" << area << "/" << lib << "/\";\n"
+            << "    \"include/" << area << "/" << lib << "/\" : \"include/" << lib << "/\";\n"
+            << "    \"include/" << area << "/" << lib << ".hpp\" : \"include/" << lib << ".hpp\";\n"
+            << "    \"projects/" << area << "/" << sub << "/" << lib << "/src/\" : \"src/\";\n";
+        std::size_t content = 4;
+        if (i % 3 == 0)
+        {
+            out << "    \"tools/" << area << "/build/" << lib << "/\" : \"build/\";\n";
+            ++content;
+        }
+        out << "  }\n";
+
+        std::size_t refs = base_refs;
+        if (i % 7 == 0)
+        {
+            std::size_t const min = uniform(1, last_revision - 1000);
+            out << "  branches\n  {\n"
+                << "    " << bounds(min, min + uniform(10, 1000)) << " \"/sandbox/" << area << "/" << lib
+                << "/trunk/\" : \"sandbox\";\n"
+                << "    [:] \"/branches/" << lib << "-maintenance/\" : \"maintenance\";\n"
+                << "  }\n  tags\n  {\n"
+                << "    [:] \"/tags/" << lib << "/first-release/\" : \"first-release\";\n"
+                << "  }\n";
+            refs += 3;
+        }
+        out << "}\n";
+        rules += content * refs;
+    }
+    return rules;
+}
+
+struct lookup
+{
+    std::size_t revision;
+    std::string key;
+};
+
+// count lookups of files beneath random rules, at revision if it is
+// nonzero and otherwise within the rules' bounds; a tenth are of
+// paths no rule maps
+static std::vector<lookup> make_lookups(std::deque<Rule> const& rules, std::size_t count, std::size_t revision)
+{
+    std::vector<Rule const*> candidates;
+    for (Rule const& r : rules)
+    {
+        if (!r.exclude_rule && (revision == 0 || (r.min <= revision && revision <= r.max)))
+            candidates.push_back(&r);
+    }
+    if (candidates.empty())
+        throw std::runtime_error("No rules to look up");
+
+    static char const* const files[] = { "README", "detail/impl.hpp", "test/Jamfile.v2", "doc/html/index.html" };
+    std::mt19937 random(count);
+    std::vector<lookup> result;
+    result.reserve(count);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        Rule const& r = *candidates[random() % candidates.size()];
+        std::size_t const rev = revision ? revision
+            : std::uniform_int_distribution<std::size_t>(r.min, std::min<std::size_t>(r.max, last_revision))(random);
+        std::string key = (i % 10 == 9 ? "unmapped/" : "") + r.svn_path().str();
+        if (key.size() < 4 || key.compare(key.size() - 4, 4, ".hpp") != 0)
+            key += std::string("/") + files[i % 4];
+        result.push_back(lookup{ rev, std::move(key) });
+    }
+    return result;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc == 4 && std::strcmp(argv[1], "--generate") == 0)
+    {
+        std::ofstream out(argv[3]);
+        std::size_t const rules = generate_rules(out, std::strtoul(argv[2], nullptr, 10));
+        out.close();
+        if (!out)
+        {
+            std::cerr << argv[0] << ": couldn't write " << argv[3] << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::cout << "Wrote " << rules << " rules to " << argv[3] << std::endl;
+        return EXIT_SUCCESS;
+    }
+    if (argc < 2 || argc > 4 || argv[1][0] == '-')
+    {
+        std::cerr << "usage: " << argv[0] << " --generate RULES FILE\n"
+                  << "       " << argv[0] << " FILE [LOOKUPS [REPEAT]]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        std::size_t const lookup_count = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000000;
+        int const repeat = argc > 3 ? std::atoi(argv[3]) : 5;
+        double const mb = 1024 * 1024;
+
+        std::uint64_t const before = memory_report::resident_bytes();
+        auto const start = std::chrono::steady_clock::now();
+        Ruleset const ruleset(argv[1]);
+        double const load_seconds
+            = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::uint64_t const after_ruleset = memory_report::resident_bytes();
+
+        auto const components_start = std::chrono::steady_clock::now();
+        component_trie<Rule> components;
+        for (Rule const& r : ruleset.matcher().all_rules())
+            components.insert(r);
+        double const components_seconds
+            = std::chrono::duration<double>(std::chrono::steady_clock::now() - components_start).count();
+        std::uint64_t const after_components = memory_report::resident_bytes();
+
+        std::cout << ruleset.rule_count() << " rules in " << ruleset.repositories().size()
+                  << " repositories\n"
+                  << std::fixed << std::setprecision(3)
+                  << std::setw(20) << std::left << "build" << std::right
+                  << std::setw(12) << "seconds" << std::setw(12) << "MB" << "\n"
+                  << std::setw(20) << std::left << "Ruleset" << std::right
+                  << std::setw(12) << load_seconds << std::setw(12) << (after_ruleset - before) / mb << "\n"
+                  << std::setw(20) << std::left << "  patrie" << std::right
+                  << std::setw(12) << ruleset.build_seconds() << std::setw(12) << "" << "\n"
+                  << std::setw(20) << std::left << "component_trie" << std::right
+                  << std::setw(12) << components_seconds
+                  << std::setw(12) << (after_components - after_ruleset) / mb << "\n\n";
+
+        std::vector<lookup> const at_head = make_lookups(
+            ruleset.matcher().all_rules(), lookup_count, last_revision);
+        std::vector<lookup> const historical = make_lookups(
+            ruleset.matcher().all_rules(), lookup_count, 0);
+
+        std::cout << std::setw(32) << std::left << "lookup" << std::right
+                  << std::setw(12) << "count" << std::setw(12) << "ns/lookup"
+                  << std::setw(16) << "lookups/s" << std::endl;
+
+        // Time the lookups made by replay_lookups()
+        auto run = [&](char const* name, std::size_t n, std::function<void()> const& replay_lookups)
+        {
+            replay_lookups(); // warm up
+            auto const start = std::chrono::steady_clock::now();
+            for (int i = 0; i < repeat; ++i)
+                replay_lookups();
+            double const seconds
+                = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            double const total = double(n) * repeat;
+            std::cout << std::setw(32) << std::left << name << std::right
+                      << std::setw(12) << n << std::fixed << std::setprecision(1)
+                      << std::setw(12) << seconds * 1e9 / total
+                      << std::setw(16) << std::setprecision(0) << total / seconds << std::endl;
+        };
+
+        auto patrie_lookups = [&](std::vector<lookup> const& lookups)
+        {
+            return [&]
+            {
+                for (auto const& l : lookups)
+                    sink += ruleset.matcher().longest_match(l.key, l.revision) != 0;
+            };
+        };
+        auto component_lookups = [&](std::vector<lookup> const& lookups)
+        {
+            return [&]
+            {
+                for (auto const& l : lookups)
+                    sink += components.longest_match(l.key, l.revision) != 0;
+            };
+        };
+
+        ruleset.matcher().set_current_revision(last_revision);
+        run("patrie, current revision", at_head.size(), patrie_lookups(at_head));
+        run("component_trie, current revision", at_head.size(), component_lookups(at_head));
+        run("patrie, any revision", historical.size(), patrie_lookups(historical));
+        run("component_trie, any revision", historical.size(), component_lookups(historical));
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << argv[0] << ": " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return sink == std::size_t(-1); // never true; keeps sink alive
+}
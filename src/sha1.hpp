@@ -0,0 +1,285 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef SHA1_DWA2013102_HPP
+# define SHA1_DWA2013102_HPP
+
+# include "object_id.hpp"
+
+# include <array>
+# include <string>
+# include <cstring>
+# include <cstdint>
+# include <algorithm>
+# include <type_traits>
+# include <vector>
+
+# if defined(__SHA__) && defined(__SSE4_1__)
+#  include <immintrin.h>
+# endif
+
+// A minimal streaming SHA-1, sufficient to compute Git object names
+// without asking git fast-import.  Where the compiler targets the SHA
+// extensions (e.g. -msha -msse4.1, or -march=native on a CPU that has
+// them; see SVN2GIT_NATIVE_ARCH) blocks are compressed with them,
+// several times as fast.
+struct sha1
+{
+    typedef std::array<unsigned char, 20> digest_type;
+
+    sha1() : length(0), buffered(0)
+    {
+        h[0] = 0x67452301;
+        h[1] = 0xEFCDAB89;
+        h[2] = 0x98BADCFE;
+        h[3] = 0x10325476;
+        h[4] = 0xC3D2E1F0;
+    }
+
+    sha1& update(void const* data, std::size_t size)
+    {
+        unsigned char const* p = static_cast<unsigned char const*>(data);
+        length += size;
+
+        if (buffered)
+        {
+            std::size_t n = std::min(size, sizeof(block) - buffered);
+            std::memcpy(block + buffered, p, n);
+            buffered += n;
+            p += n;
+            size -= n;
+            if (buffered < sizeof(block))
+                return *this;
+            compress(block);
+            buffered = 0;
+        }
+
+        for (; size >= sizeof(block); p += sizeof(block), size -= sizeof(block))
+            compress(p);
+
+        std::memcpy(block, p, size);
+        buffered = size;
+        return *this;
+    }
+
+    sha1& update(std::string const& s)
+    {
+        return update(s.data(), s.size());
+    }
+
+    digest_type digest()
+    {
+        std::uint64_t const bits = length * 8;
+        unsigned char const pad = 0x80;
+        update(&pad, 1);
+        unsigned char const zero = 0;
+        while (buffered != 56)
+            update(&zero, 1);
+
+        unsigned char size_be[8];
+        for (int i = 0; i < 8; ++i)
+            size_be[i] = static_cast<unsigned char>(bits >> (56 - 8 * i));
+        update(size_be, 8);
+
+        digest_type result;
+        for (int i = 0; i < 5; ++i)
+            for (int j = 0; j < 4; ++j)
+                result[4 * i + j] = static_cast<unsigned char>(h[i] >> (24 - 8 * j));
+        return result;
+    }
+
+    std::string hex_digest()
+    {
+        return to_hex(digest());
+    }
+
+    static std::string to_hex(digest_type const& d)
+    {
+        return object_id(d).hex();
+    }
+
+    // The digest named by 40 hex digits
+    static digest_type from_hex(char const* hex)
+    {
+        digest_type result;
+        object_id::decode_hex(hex, result.data());
+        return result;
+    }
+
+ private:
+    static std::uint32_t rotl(std::uint32_t x, int n)
+    {
+        return (x << n) | (x >> (32 - n));
+    }
+
+# if defined(__SHA__) && defined(__SSE4_1__)
+    // The four words of message schedule being worked on, and the two
+    // E values alternately fed to and taken from each group of rounds
+    struct sha_ni_state
+    {
+        __m128i abcd, e[2], msg[4];
+    };
+
+    // Four rounds, following Intel's reference code.  Each group
+    // computes the next E and the schedule words needed by later
+    // groups, until none are.
+    template <int I>
+    static void rounds(sha_ni_state& s, std::integral_constant<int, I>)
+    {
+        __m128i& e = s.e[I & 1];
+        __m128i const& w = s.msg[I & 3];
+        e = I == 0 ? _mm_add_epi32(e, w) : _mm_sha1nexte_epu32(e, w);
+        s.e[~I & 1] = s.abcd;
+        if (I >= 3 && I < 19)
+            s.msg[(I + 1) & 3] = _mm_sha1msg2_epu32(s.msg[(I + 1) & 3], w);
+        s.abcd = _mm_sha1rnds4_epu32(s.abcd, e, I / 5);
+        if (I >= 1 && I < 17)
+            s.msg[(I + 3) & 3] = _mm_sha1msg1_epu32(s.msg[(I + 3) & 3], w);
+        if (I >= 2 && I < 18)
+            s.msg[(I + 2) & 3] = _mm_xor_si128(s.msg[(I + 2) & 3], w);
+        rounds(s, std::integral_constant<int, I + 1>());
+    }
+
+    static void rounds(sha_ni_state&, std::integral_constant<int, 20>) {}
+
+    void compress(unsigned char const* p)
+    {
+        __m128i const byte_swap = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+        __m128i const abcd = _mm_shuffle_epi32(
+            _mm_loadu_si128(reinterpret_cast<__m128i const*>(h)), 0x1B);
+        __m128i const e = _mm_set_epi32(int(h[4]), 0, 0, 0);
+
+        sha_ni_state s;
+        s.abcd = abcd;
+        s.e[0] = e;
+        for (int i = 0; i < 4; ++i)
+        {
+            s.msg[i] = _mm_shuffle_epi8(
+                _mm_loadu_si128(reinterpret_cast<__m128i const*>(p + 16 * i)), byte_swap);
+        }
+        rounds(s, std::integral_constant<int, 0>());
+
+        // The last group leaves its successor's E in e[0]
+        s.e[0] = _mm_sha1nexte_epu32(s.e[0], e);
+        s.abcd = _mm_add_epi32(s.abcd, abcd);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(h), _mm_shuffle_epi32(s.abcd, 0x1B));
+        h[4] = std::uint32_t(_mm_extract_epi32(s.e[0], 3));
+    }
+# else
+    void compress(unsigned char const* p)
+    {
+        std::uint32_t w[80];
+        for (int i = 0; i < 16; ++i)
+        {
+            w[i] = std::uint32_t(p[4 * i]) << 24 | std::uint32_t(p[4 * i + 1]) << 16
+                 | std::uint32_t(p[4 * i + 2]) << 8 | std::uint32_t(p[4 * i + 3]);
+        }
+        for (int i = 16; i < 80; ++i)
+            w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+        std::uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; ++i)
+        {
+            std::uint32_t f, k;
+            if (i < 20)      { f = (b & c) | (~b & d);           k = 0x5A827999; }
+            else if (i < 40) { f = b ^ c ^ d;                    k = 0x6ED9EBA1; }
+            else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; }
+            else             { f = b ^ c ^ d;                    k = 0xCA62C1D6; }
+
+            std::uint32_t t = rotl(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = rotl(b, 30);
+            b = a;
+            a = t;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+# endif
+
+    std::uint32_t h[5];
+    std::uint64_t length;
+    unsigned char block[64];
+    std::size_t buffered;
+};
+
+// Computes the name Git gives to an object of the given type and
+// size, as its contents are fed in.
+struct git_object_hasher : sha1
+{
+    git_object_hasher(char const* type, std::size_t size)
+    {
+        std::string const header = type + (" " + std::to_string(size));
+        update(header.c_str(), header.size() + 1); // include the NUL
+    }
+};
+
+struct git_blob_hasher : git_object_hasher
+{
+    explicit git_blob_hasher(std::size_t size) : git_object_hasher("blob", size) {}
+};
+
+// An entry of a tree, naming a blob, tree or gitlinked commit by the
+// 20 bytes of its SHA-1
+struct git_tree_entry
+{
+    unsigned long mode;
+    std::string name;
+    sha1::digest_type sha;
+
+    bool is_tree() const { return mode == 040000; }
+
+    // Git's order, in which a tree sorts as if its name ended in '/'
+    friend bool operator<(git_tree_entry const& x, git_tree_entry const& y)
+    {
+        std::size_t const n = std::min(x.name.size(), y.name.size());
+        int const c = x.name.compare(0, n, y.name, 0, n);
+        if (c != 0)
+            return c < 0;
+        unsigned char const xc = x.name.size() > n ? x.name[n] : x.is_tree() ? '/' : 0;
+        unsigned char const yc = y.name.size() > n ? y.name[n] : y.is_tree() ? '/' : 0;
+        return xc < yc;
+    }
+};
+
+// The name Git gives to the tree of the given entries, in any order
+inline sha1::digest_type git_tree_sha(std::vector<git_tree_entry> entries)
+{
+    std::sort(entries.begin(), entries.end());
+    std::string contents;
+    for (auto const& e : entries)
+    {
+        char mode[8];
+        char* p = mode + sizeof(mode);
+        unsigned long m = e.mode;
+        do
+            *--p = char('0' + (m & 7));
+        while (m >>= 3);
+        contents.append(p, mode + sizeof(mode));
+        contents += ' ';
+        contents += e.name;
+        contents += '\0';
+        contents.append(reinterpret_cast<char const*>(e.sha.data()), e.sha.size());
+    }
+    return git_object_hasher("tree", contents.size()).update(contents).digest();
+}
+
+// The name Git gives to a commit of the tree, with the parents, whose
+// author and committer are given as fast-import's committer command
+// is, e.g. "A U Thor <author@example.com> 1380000000 +0000"
+inline std::string git_commit_sha(
+    std::string const& tree_hex, std::vector<std::string> const& parent_hexes,
+    std::string const& author, std::string const& committer, std::string const& message)
+{
+    std::string contents = "tree " + tree_hex + "\n";
+    for (auto const& parent : parent_hexes)
+        contents += "parent " + parent + "\n";
+    contents += "author " + author + "\ncommitter " + committer + "\n\n" + message;
+    return git_object_hasher("commit", contents.size()).update(contents).hex_digest();
+}
+
+#endif // SHA1_DWA2013102_HPP
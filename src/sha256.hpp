@@ -0,0 +1,159 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef SHA256_DWA20131121_HPP
+# define SHA256_DWA20131121_HPP
+
+# include <algorithm>
+# include <array>
+# include <cstdint>
+# include <cstring>
+# include <string>
+
+// A minimal streaming SHA-256, sufficient to name Git LFS objects.
+// Only the files --lfs-threshold offloads are hashed with it, so it
+// is written for clarity rather than speed.
+struct sha256
+{
+    typedef std::array<unsigned char, 32> digest_type;
+
+    sha256() : length(0), buffered(0)
+    {
+        static std::uint32_t const initial[8] = {
+            0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+            0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+        std::copy(initial, initial + 8, h);
+    }
+
+    sha256& update(void const* data, std::size_t size)
+    {
+        unsigned char const* p = static_cast<unsigned char const*>(data);
+        length += size;
+
+        if (buffered)
+        {
+            std::size_t n = std::min(size, sizeof(block) - buffered);
+            std::memcpy(block + buffered, p, n);
+            buffered += n;
+            p += n;
+            size -= n;
+            if (buffered < sizeof(block))
+                return *this;
+            compress(block);
+            buffered = 0;
+        }
+
+        for (; size >= sizeof(block); p += sizeof(block), size -= sizeof(block))
+            compress(p);
+
+        std::memcpy(block, p, size);
+        buffered = size;
+        return *this;
+    }
+
+    sha256& update(std::string const& s)
+    {
+        return update(s.data(), s.size());
+    }
+
+    digest_type digest()
+    {
+        std::uint64_t const bits = length * 8;
+        unsigned char const pad = 0x80;
+        update(&pad, 1);
+        unsigned char const zero = 0;
+        while (buffered != 56)
+            update(&zero, 1);
+
+        unsigned char size_be[8];
+        for (int i = 0; i < 8; ++i)
+            size_be[i] = static_cast<unsigned char>(bits >> (56 - 8 * i));
+        update(size_be, 8);
+
+        digest_type result;
+        for (int i = 0; i < 8; ++i)
+            for (int j = 0; j < 4; ++j)
+                result[4 * i + j] = static_cast<unsigned char>(h[i] >> (24 - 8 * j));
+        return result;
+    }
+
+    std::string hex_digest()
+    {
+        static char const digits[] = "0123456789abcdef";
+        digest_type const d = digest();
+        std::string result(64, '0');
+        for (std::size_t i = 0; i < d.size(); ++i)
+        {
+            result[2 * i] = digits[d[i] >> 4];
+            result[2 * i + 1] = digits[d[i] & 0xF];
+        }
+        return result;
+    }
+
+ private:
+    static std::uint32_t rotr(std::uint32_t x, int n)
+    {
+        return (x >> n) | (x << (32 - n));
+    }
+
+    void compress(unsigned char const* p)
+    {
+        static std::uint32_t const k[64] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2 };
+
+        std::uint32_t w[64];
+        for (int i = 0; i < 16; ++i)
+        {
+            w[i] = std::uint32_t(p[4 * i]) << 24 | std::uint32_t(p[4 * i + 1]) << 16
+                 | std::uint32_t(p[4 * i + 2]) << 8 | std::uint32_t(p[4 * i + 3]);
+        }
+        for (int i = 16; i < 64; ++i)
+        {
+            std::uint32_t const s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            std::uint32_t const s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        std::uint32_t a = h[0], b = h[1], c = h[2], d = h[3];
+        std::uint32_t e = h[4], f = h[5], g = h[6], hh = h[7];
+        for (int i = 0; i < 64; ++i)
+        {
+            std::uint32_t const s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+            std::uint32_t const ch = (e & f) ^ (~e & g);
+            std::uint32_t const t1 = hh + s1 + ch + k[i] + w[i];
+            std::uint32_t const s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+            std::uint32_t const maj = (a & b) ^ (a & c) ^ (b & c);
+            std::uint32_t const t2 = s0 + maj;
+            hh = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+        h[5] += f;
+        h[6] += g;
+        h[7] += hh;
+    }
+
+    std::uint32_t h[8];
+    std::uint64_t length;
+    unsigned char block[64];
+    std::size_t buffered;
+};
+
+#endif // SHA256_DWA20131121_HPP
@@ -0,0 +1,213 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#include "shard_plan.hpp"
+#include "history_profile.hpp"
+#include "ruleset.hpp"
+#include "options.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+repository_costs profile_costs(std::string const& filename)
+{
+    std::ifstream in(filename.c_str());
+    if (!in)
+        throw std::runtime_error("Couldn't open profile " + filename);
+    std::string line;
+    if (!std::getline(in, line) || line.compare(0, 15, "revision,phase,") != 0)
+        throw std::runtime_error(filename + " isn't a --profile-csv file");
+
+    // Each row holds the totals so far, so the last of each phase and
+    // repository holds them all
+    std::map<std::pair<std::string, std::string>, double> seconds;
+    for (int line_number = 2; std::getline(in, line); ++line_number)
+    {
+        // revision,phase,repository,calls,wall_seconds,cpu_seconds,bytes,
+        // with commas only in the repository's name, if anywhere
+        std::size_t const phase = line.find(',');
+        std::size_t const repo = phase == std::string::npos ? phase : line.find(',', phase + 1);
+        std::size_t end = line.size();
+        for (int fields = 0; fields < 4 && end != std::string::npos && end > 0; ++fields)
+            end = line.rfind(',', end - 1);
+        if (repo == std::string::npos || end == std::string::npos || end < repo)
+        {
+            throw std::runtime_error(
+                filename + ":" + std::to_string(line_number) + ": malformed line: " + line);
+        }
+        std::string const repo_name = line.substr(repo + 1, end - repo - 1);
+        if (repo_name.empty())
+            continue;
+        std::size_t const wall = line.find(',', end + 1) + 1;
+        seconds[std::make_pair(line.substr(phase + 1, repo - phase - 1), repo_name)]
+            = std::strtod(line.c_str() + wall, nullptr);
+    }
+
+    repository_costs costs;
+    for (auto const& s : seconds)
+        costs[s.first.second] += std::uint64_t(s.second * 1000);
+    return costs;
+}
+
+repository_costs estimated_costs(history_profile const* history)
+{
+    if (!options.shard_costs.empty())
+        return profile_costs(options.shard_costs);
+    if (history)
+        return history->repository_changes();
+    return repository_costs();
+}
+
+shard_plan plan_shards(Ruleset const& ruleset, repository_costs const& costs)
+{
+    shard_plan plan;
+    for (auto const& rule : ruleset.repositories())
+    {
+        if (!rule.submodule_in_repo.empty())
+            plan[rule.submodule_in_repo] = 0;
+    }
+    if (!costs.empty())
+    {
+        std::vector<std::pair<std::uint64_t, std::string> > by_cost;
+        for (auto const& rule : ruleset.repositories())
+        {
+            if (!plan.count(rule.name))
+            {
+                auto const p = costs.find(rule.name);
+                by_cost.emplace_back(p == costs.end() ? 0 : p->second, rule.name);
+            }
+        }
+        std::sort(by_cost.begin(), by_cost.end(),
+                  [](std::pair<std::uint64_t, std::string> const& x,
+                     std::pair<std::uint64_t, std::string> const& y)
+                  { return x.first > y.first || (x.first == y.first && x.second < y.second); });
+        std::vector<std::uint64_t> load(options.shards);
+        for (auto const& r : by_cost)
+        {
+            if (plan.count(r.second))
+                continue;
+            auto const lightest = std::min_element(load.begin(), load.end());
+            *lightest += r.first;
+            plan[r.second] = 1 + int(lightest - load.begin());
+        }
+    }
+    int n = 0;
+    for (auto const& rule : ruleset.repositories())
+    {
+        if (plan.emplace(rule.name, 1 + n % options.shards).second)
+            ++n;
+    }
+    return plan;
+}
+
+shard_plan read_shard_plan(std::string const& filename, Ruleset const& ruleset)
+{
+    std::ifstream in(filename.c_str());
+    if (!in)
+        throw std::runtime_error("Couldn't open shard plan " + filename);
+    shard_plan plan;
+    std::string line;
+    for (int line_number = 1; std::getline(in, line); ++line_number)
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+        // SHARD<TAB>COST<TAB>REPOSITORY
+        std::istringstream fields(line);
+        int shard;
+        std::uint64_t cost;
+        std::string name;
+        if (!(fields >> shard >> cost) || fields.get() != '\t' || !std::getline(fields, name)
+            || name.empty() || !plan.emplace(name, shard).second)
+        {
+            throw std::runtime_error(
+                filename + ":" + std::to_string(line_number) + ": malformed line: " + line);
+        }
+    }
+
+    for (auto const& rule : ruleset.repositories())
+    {
+        auto const p = plan.find(rule.name);
+        if (p == plan.end())
+            throw std::runtime_error("shard plan " + filename + " doesn't deal out " + rule.name);
+        if (p->second < 0 || p->second > options.shards)
+        {
+            throw std::runtime_error(
+                "shard plan " + filename + " deals " + rule.name + " to shard "
+                + std::to_string(p->second) + " of " + std::to_string(options.shards));
+        }
+        if (!rule.submodule_in_repo.empty() && plan.count(rule.submodule_in_repo)
+            && plan.at(rule.submodule_in_repo) != 0)
+        {
+            throw std::runtime_error(
+                "shard plan " + filename + " deals the super-module " + rule.submodule_in_repo
+                + " to a worker, not the coordinator");
+        }
+    }
+    for (auto const& p : plan)
+    {
+        bool const known = std::any_of(
+            ruleset.repositories().begin(), ruleset.repositories().end(),
+            [&](Ruleset::Repository const& r) { return r.name == p.first; });
+        if (!known)
+            throw std::runtime_error("shard plan " + filename + " names no repository of the rules: " + p.first);
+        bool const super_module = std::any_of(
+            ruleset.repositories().begin(), ruleset.repositories().end(),
+            [&](Ruleset::Repository const& r) { return r.submodule_in_repo == p.first; });
+        if (p.second == 0 && !super_module)
+        {
+            throw std::runtime_error(
+                "shard plan " + filename + " deals " + p.first + " to the coordinator, "
+                "which converts only super-modules");
+        }
+    }
+    return plan;
+}
+
+void write_shard_plan(
+    std::string const& filename, shard_plan const& plan, repository_costs const& costs)
+{
+    auto const cost = [&](std::string const& name)
+    {
+        auto const p = costs.find(name);
+        return p == costs.end() ? std::uint64_t(0) : p->second;
+    };
+    std::vector<std::uint64_t> load(options.shards + 1);
+    std::vector<std::size_t> repositories(options.shards + 1);
+    for (auto const& p : plan)
+    {
+        load[p.second] += cost(p.first);
+        ++repositories[p.second];
+    }
+
+    std::ofstream out(filename.c_str(), std::ios::trunc);
+    if (!out)
+        throw std::runtime_error("Couldn't create shard plan " + filename);
+    out << "# Repositories dealt out to " << options.shards << " shards by "
+        << (!options.shard_costs.empty() ? "the milliseconds of " + options.shard_costs
+            : costs.empty() ? std::string("turns") : std::string("the changes of the history"))
+        << "; see --shard-plan\n";
+    for (int shard = 0; shard <= options.shards; ++shard)
+    {
+        out << "# shard " << shard << (shard == 0 ? " (coordinator)" : "") << ": "
+            << repositories[shard] << " repositories costing " << load[shard] << '\n';
+        Log::info() << "shard " << shard << (shard == 0 ? " (coordinator)" : "") << ": "
+                    << repositories[shard] << " repositories costing " << load[shard] << std::endl;
+    }
+    out << "# shard\tcost\trepository\n";
+    for (int shard = 0; shard <= options.shards; ++shard)
+    {
+        for (auto const& p : plan)
+        {
+            if (p.second == shard)
+                out << shard << '\t' << cost(p.first) << '\t' << p.first << '\n';
+        }
+    }
+    if (!out.flush())
+        throw std::runtime_error("Couldn't write shard plan " + filename);
+}
@@ -0,0 +1,53 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef SHARD_PLAN_DWA20131204_HPP
+# define SHARD_PLAN_DWA20131204_HPP
+
+# include <cstdint>
+# include <map>
+# include <string>
+
+class Ruleset;
+class history_profile;
+
+// The shard of --shards converting each repository, by name.  The
+// coordinator, shard 0, converts the super-modules, since their
+// commits wait on those of all their submodules, and follows the
+// workers, shards 1 and up, which convert the rest.
+typedef std::map<std::string, int> shard_plan;
+
+// The cost of converting each repository, by name, in units of
+// whatever measured it
+typedef std::map<std::string, std::uint64_t> repository_costs;
+
+// The milliseconds an earlier run given --profile and --profile-csv
+// spent on each repository, as of the last revision it wrote to the
+// file filename: the wall-clock time of every phase charged to it,
+// added up.
+repository_costs profile_costs(std::string const& filename);
+
+// What the repositories would cost, by --shard-costs if given, or
+// else the changes history maps into them if it isn't null, or else
+// nothing, when they are taken to cost alike
+repository_costs estimated_costs(history_profile const* history);
+
+// Deal the repositories of ruleset out to --shards.  With costs, the
+// costliest are dealt first, each to the worker with the least cost
+// so far, so that the workers finish together and the coordinator,
+// which can't finish a super-module commit before all its submodules
+// are written, waits on none for long.  Without, they are dealt in
+// turn, in the order of the rules.
+shard_plan plan_shards(Ruleset const& ruleset, repository_costs const& costs);
+
+// The plan written by write_shard_plan to filename, checked against
+// ruleset: every repository dealt out, the super-modules to the
+// coordinator and the rest to one of --shards.  See --shard-plan.
+shard_plan read_shard_plan(std::string const& filename, Ruleset const& ruleset);
+
+// Write plan to filename, with each repository's cost and the total
+// predicted for each shard, and report the totals.  See --plan-shards.
+void write_shard_plan(
+    std::string const& filename, shard_plan const& plan, repository_costs const& costs);
+
+#endif // SHARD_PLAN_DWA20131204_HPP
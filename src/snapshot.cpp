@@ -0,0 +1,464 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// See svn.cpp
+#define SVN_DEPRECATED
+
+#include "snapshot.hpp"
+#include "AST.hpp"
+#include "coverage.hpp"
+#include "directory_cache.hpp"
+#include "git_executable.hpp"
+#include "lfs_store.hpp"
+#include "log.hpp"
+#include "options.hpp"
+#include "path.hpp"
+#include "ruleset.hpp"
+#include "svn.hpp"
+#include "text_normalizer.hpp"
+#include <boost/filesystem.hpp>
+#include <boost/function_output_iterator.hpp>
+#include <boost/iostreams/device/file_descriptor.hpp>
+#include <boost/iostreams/stream.hpp>
+#include <boost/process.hpp>
+#include <boost/regex.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <svn_checksum.h>
+#include <svn_fs.h>
+
+namespace
+{
+    std::size_t const directory_cache_entries = 1 << 20;
+
+    // Written in each snapshot's repository, naming its revision, so
+    // that a snapshot is never taken for a conversion
+    char const snapshot_marker[] = "svn2git-snapshot";
+
+    typedef patrie<Rule, coverage>::reader rule_reader;
+
+    struct rule_detector
+    {
+        explicit rule_detector(bool& found) : found(found) {}
+        void operator()(Rule const*) const { found = true; }
+        bool& found;
+    };
+
+    bool svn_rules_beneath(rule_reader const& matcher, std::string const& svn_path, int revnum)
+    {
+        bool found = false;
+        matcher.svn_rules_beneath(
+            svn_path, revnum, boost::make_function_output_iterator(rule_detector(found)));
+        return found;
+    }
+
+    svn_error_t* append_to_string(void* baton, char const* data, apr_size_t* len)
+    {
+        static_cast<std::string*>(baton)->append(data, *len);
+        return SVN_NO_ERROR;
+    }
+
+    // A file of a snapshot, and where in SVN it comes from
+    struct snapshot_file
+    {
+        std::string git_path;
+        std::string svn_path;
+    };
+
+    // A repository's snapshot: the directories of SVN each of its refs
+    // is made from, then the files the rules map to each
+    struct repository_snapshot
+    {
+        std::string name;
+        std::map<std::string, std::vector<std::string> > ref_roots;    // by ref name
+        std::map<std::string, std::vector<snapshot_file> > files;      // likewise
+    };
+
+    // The repositories of the rules, with the refs each has at revnum
+    std::vector<repository_snapshot> snapshots_at(Ruleset const& ruleset, int revnum)
+    {
+        std::vector<repository_snapshot> result;
+        for (Ruleset::Repository const& r : ruleset.repositories())
+        {
+            boost2git::RepoRule key;
+            key.git_repo_name = r.name;
+            boost2git::RepoRule const& repo_rule = *ruleset.getAST().find(key);
+
+            repository_snapshot s;
+            s.name = r.name;
+            for (boost2git::BranchRule const* b : r.branches)
+            {
+                std::size_t const min = std::max(b->min, repo_rule.minrev);
+                std::size_t const max = std::min(b->max, repo_rule.maxrev);
+                if (std::size_t(revnum) >= min && std::size_t(revnum) <= max)
+                    s.ref_roots[boost2git::git_ref_name(b)].push_back(path(b->svn_path.str()).str());
+            }
+            if (!s.ref_roots.empty())
+                result.push_back(std::move(s));
+        }
+        return result;
+    }
+
+    // Run git in git_dir with args, its standard input read from
+    // input, and throw unless it succeeds
+    void run_git(
+        std::string const& git_dir, std::vector<std::string> args,
+        boost::iostreams::file_descriptor_source const& input)
+    {
+        using namespace boost::process::initializers;
+        args.insert(args.begin(), git_executable());
+        boost::process::child child = boost::process::execute(
+            run_exe(git_executable()), set_args(args), start_in_dir(git_dir),
+            bind_stdin(input), throw_on_error());
+        int const status = boost::process::wait_for_exit(child);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            throw std::runtime_error("git " + args[1] + " failed in " + git_dir);
+    }
+
+    // Make git_dir ready for a snapshot: a new repository, or one
+    // holding an earlier snapshot, whose refs are dropped
+    void prepare_repository(std::string const& git_dir)
+    {
+        namespace fs = boost::filesystem;
+        if (!fs::exists(git_dir))
+        {
+            fs::create_directories(git_dir);
+            int const null = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+            run_git(git_dir, { "init", "--bare", "--quiet" },
+                    boost::iostreams::file_descriptor_source(null, boost::iostreams::close_handle));
+            return;
+        }
+        if (!fs::exists(fs::path(git_dir) / snapshot_marker))
+            throw std::runtime_error(git_dir + " exists, and doesn't hold a snapshot");
+        fs::remove(fs::path(git_dir) / "packed-refs");
+        for (char const* refs : { "refs/heads", "refs/tags" })
+        {
+            fs::remove_all(fs::path(git_dir) / refs);
+            fs::create_directories(fs::path(git_dir) / refs);
+        }
+    }
+
+    // One thread's view of SVN at the revision, writing the snapshots
+    // of the repositories it's given
+    class snapshot_writer
+    {
+     public:
+        snapshot_writer(
+            std::string const& svn_path, std::string const& authors_file,
+            Ruleset const& rules, int revnum)
+            : svn_path(svn_path), repo(svn_path, authors_file), rev(repo[revnum]),
+              matcher(rules.matcher()),
+              cache(directory_cache_entries)
+        {
+            if (!options.lfs_pattern.empty())
+                lfs_pattern.assign(options.lfs_pattern);
+        }
+
+        void write(repository_snapshot& snapshot)
+        {
+            find_files(snapshot);
+            prepare_repository(snapshot.name);
+
+            int fds[2];
+            if (::pipe2(fds, O_CLOEXEC) != 0)
+                throw std::runtime_error("Couldn't create a pipe");
+            boost::iostreams::file_descriptor_sink sink(fds[1], boost::iostreams::close_handle);
+            std::exception_ptr error;
+            std::thread fast_import([&] {
+                try
+                {
+                    run_git(snapshot.name, { "fast-import", "--quiet", "--force" },
+                            boost::iostreams::file_descriptor_source(fds[0], boost::iostreams::close_handle));
+                }
+                catch (...)
+                {
+                    error = std::current_exception();
+                }
+            });
+            try
+            {
+                boost::iostreams::stream<boost::iostreams::file_descriptor_sink> out(sink);
+                write_stream(snapshot, out);
+                out.close();
+                sink.close();
+            }
+            catch (...)
+            {
+                sink.close();
+                fast_import.join();
+                throw;
+            }
+            fast_import.join();
+            if (error)
+                std::rethrow_exception(error);
+
+            std::ofstream marker((snapshot.name + "/" + snapshot_marker).c_str());
+            marker << "r" << rev.revnum << '\n';
+            if (!marker.flush())
+                throw std::runtime_error("Couldn't write " + snapshot.name + "/" + snapshot_marker);
+        }
+
+     private:
+        Rule const* match(std::string const& svn_path) const
+        {
+            Rule const* const m = matcher.longest_match(svn_path, rev.revnum);
+            if (m)
+                coverage::match(*m, rev.revnum);
+            return m && m->excludes() ? nullptr : m;
+        }
+
+        // Find the files of each of snapshot's refs
+        void find_files(repository_snapshot& snapshot)
+        {
+            std::vector<std::string> roots;
+            for (auto const& kv : snapshot.ref_roots)
+                roots.insert(roots.end(), kv.second.begin(), kv.second.end());
+            std::sort(roots.begin(), roots.end());
+            roots.erase(std::unique(roots.begin(), roots.end()), roots.end());
+
+            for (std::size_t i = 0; i < roots.size(); ++i)
+            {
+                std::string const& root = roots[i];
+                // A root beneath another is visited with it
+                if (i > 0 && path(root).starts_with(path(roots[i - 1])))
+                {
+                    roots.erase(roots.begin() + i--);
+                    continue;
+                }
+                switch (svn::call(svn_fs_check_path, rev.fs_root, root.c_str(), AprScratch(rev.scratch)))
+                {
+                case svn_node_dir:
+                    visit_directory(root, svn::node_id(rev, root.c_str()), snapshot);
+                    break;
+                case svn_node_file:
+                    add_file(root, match(root), snapshot);
+                    break;
+                default:
+                    break;
+                }
+            }
+        }
+
+        // Visit the files beneath dir.  Where no rule lies beneath a
+        // directory, its files all match the rule it matches, as in
+        // the importer, so a directory the snapshot doesn't take is
+        // skipped.
+        void visit_directory(
+            std::string const& dir, std::string const& node_id, repository_snapshot& snapshot,
+            Rule const* covering = nullptr)
+        {
+            if (!covering && !svn_rules_beneath(matcher, dir, rev.revnum))
+            {
+                covering = match(dir);
+                if (!covering || covering->git_repo_name() != snapshot.name
+                    || !snapshot.ref_roots.count(covering->git_ref_name()))
+                    return;
+            }
+
+            auto const listing = svn::list_directory(rev, dir.c_str(), node_id, cache);
+            for (auto const& e : *listing)
+            {
+                std::string const svn_path = dir.empty() ? e.name : dir + "/" + e.name;
+                if (e.is_dir)
+                    visit_directory(svn_path, e.node_id, snapshot, covering);
+                else
+                    add_file(svn_path, covering ? covering : match(svn_path), snapshot);
+            }
+        }
+
+        void add_file(std::string const& svn_path, Rule const* rule, repository_snapshot& snapshot)
+        {
+            if (!rule || rule->git_repo_name() != snapshot.name
+                || !snapshot.ref_roots.count(rule->git_ref_name()))
+                return;
+            snapshot_file const f = { rule->git_path(path(svn_path)).str(), svn_path };
+            snapshot.files[rule->git_ref_name()].push_back(f);
+        }
+
+        // The fast-import stream of snapshot: each distinct content
+        // once, as a blob, then a commit of each ref
+        void write_stream(repository_snapshot const& snapshot, std::ostream& out)
+        {
+            std::map<std::string, std::size_t> marks;     // by content key
+            std::size_t next_mark = 1;
+            std::string const message =
+                "Snapshot of r" + std::to_string(rev.revnum) + " of " + svn_path + "\n";
+
+            for (auto const& ref : snapshot.files)
+            {
+                // The mode and blob mark of each file
+                std::vector<std::pair<unsigned long, std::size_t> > blobs;
+                for (snapshot_file const& f : ref.second)
+                {
+                    AprScratch scope(rev.scratch);
+                    std::string contents, key;
+                    unsigned long const mode = file(f, scope, key, contents);
+                    std::size_t& mark = marks[key];
+                    if (key.empty() || mark == 0)
+                    {
+                        if (!key.empty())
+                            read_contents(f, scope, contents);
+                        mark = next_mark++;
+                        out << "blob\nmark :" << mark << "\ndata " << contents.size() << '\n';
+                        out.write(contents.data(), contents.size());
+                        out << '\n';
+                    }
+                    blobs.emplace_back(mode, mark);
+                }
+
+                out << "commit " << ref.first << "\nmark :" << next_mark++ << '\n'
+                    << *rev.committer << rev.epoch << " +0000\n"
+                    << "data " << message.size() << '\n' << message;
+                for (std::size_t i = 0; i < ref.second.size(); ++i)
+                {
+                    char mode[8];
+                    std::snprintf(mode, sizeof(mode), "%06lo", blobs[i].first);
+                    out << "M " << mode << " :" << blobs[i].second << " " << ref.second[i].git_path << '\n';
+                }
+                out << '\n';
+            }
+        }
+
+        // The mode the importer gives f, setting key to what identifies
+        // its contents as written, as convert_svn_file does, or leaving
+        // it empty and reading the contents where SVN has no checksum
+        unsigned long file(
+            snapshot_file const& f, apr_pool_t* scope, std::string& key, std::string& contents)
+        {
+            char const* const p = f.svn_path.c_str();
+            unsigned long const mode = svn::call(svn_fs_node_prop, rev.fs_root, p, "svn:executable", scope)
+                ? 0100755ul : 0100644ul;
+
+            normalizer = nullptr;
+            if (options.normalize_text)
+            {
+                svn_string_t const* eol_style = svn::call(
+                    svn_fs_node_prop, rev.fs_root, p, "svn:eol-style", scope);
+                svn_string_t const* keywords = svn::call(
+                    svn_fs_node_prop, rev.fs_root, p, "svn:keywords", scope);
+                auto k = std::make_pair(
+                    eol_style ? std::string(eol_style->data, eol_style->len) : std::string(),
+                    keywords ? std::string(keywords->data, keywords->len) : std::string());
+                auto n = normalizers.find(k);
+                if (n == normalizers.end())
+                    n = normalizers.emplace(k, text_normalizer(k.first, k.second)).first;
+                if (n->second.enabled())
+                    normalizer = &n->second;
+            }
+
+            // Files --lfs-threshold offloads are committed as pointers
+            lfs = options.lfs_threshold > 0 && !normalizer
+                && (options.lfs_pattern.empty() || boost::regex_search(f.git_path, lfs_pattern))
+                && svn::call(svn_fs_file_length, rev.fs_root, p, scope) >= options.lfs_threshold;
+
+            svn_checksum_t* checksum = svn::call(
+                svn_fs_file_checksum, svn_checksum_sha1, rev.fs_root, p, FALSE, scope);
+            if (checksum)
+            {
+                key = std::string("sha1:") + svn_checksum_to_cstring(checksum, scope);
+                if (normalizer)
+                    key += normalizer->key_suffix();
+                if (lfs)
+                    key += "|lfs";
+            }
+            else
+                read_contents(f, scope, contents);
+            return mode;
+        }
+
+        // Read f's contents as the importer writes them, as file last
+        // found them to be
+        void read_contents(snapshot_file const& f, apr_pool_t* scope, std::string& contents)
+        {
+            svn_stream_t* in_stream = svn::call(svn_fs_file_contents, rev.fs_root, f.svn_path.c_str(), scope);
+            svn_stream_t* out_stream = svn_stream_create(&contents, scope);
+            svn_stream_set_write(out_stream, append_to_string);
+            svn::check(svn_stream_copy3, in_stream, out_stream, nullptr, nullptr, scope);
+            if (normalizer)
+                normalizer->apply(contents);
+            if (lfs)
+            {
+                contents = lfs_object::pointer(
+                    sha256().update(contents).hex_digest(), contents.size());
+            }
+        }
+
+        std::string const svn_path;
+        svn repo;
+        svn::revision const rev;
+        rule_reader matcher;    // shared by every thread
+        directory_cache cache;
+        std::map<std::pair<std::string, std::string>, text_normalizer> normalizers;
+        boost::regex lfs_pattern;
+
+        // What file found of the file at hand
+        text_normalizer const* normalizer;
+        bool lfs;
+    };
+}
+
+void write_snapshots(
+    std::string const& svn_path, std::string const& authors_file,
+    Ruleset const& ruleset, int revnum, unsigned jobs)
+{
+    std::vector<repository_snapshot> snapshots = snapshots_at(ruleset, revnum);
+    ruleset.matcher().freeze();
+
+    // The repositories are shared out between the threads, the first
+    // to fail stopping the rest
+    std::atomic<std::size_t> next(0);
+    std::mutex mutex;
+    std::exception_ptr error;
+    std::size_t refs = 0, files = 0;
+    auto work = [&] {
+        std::unique_ptr<snapshot_writer> writer;
+        for (std::size_t i; (i = next++) < snapshots.size();)
+        {
+            try
+            {
+                if (!writer)
+                    writer.reset(new snapshot_writer(svn_path, authors_file, ruleset, revnum));
+                writer->write(snapshots[i]);
+                std::lock_guard<std::mutex> lock(mutex);
+                refs += snapshots[i].files.size();
+                for (auto const& kv : snapshots[i].files)
+                    files += kv.second.size();
+                Log::info() << "wrote the snapshot of " << snapshots[i].name << std::endl;
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error)
+                    error = std::current_exception();
+                next = snapshots.size();
+            }
+            // Only the files' paths were needed
+            snapshots[i].files.clear();
+        }
+    };
+    std::vector<std::thread> threads;
+    for (unsigned n = std::max(jobs, 1u); n > 1; --n)
+        threads.emplace_back(work);
+    work();
+    for (auto& t : threads)
+        t.join();
+    if (error)
+        std::rethrow_exception(error);
+
+    Log::info() << "wrote " << refs << " refs of " << snapshots.size() << " repositories, with "
+                << files << " files, as of r" << revnum << std::endl;
+}
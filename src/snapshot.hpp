@@ -0,0 +1,27 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef SNAPSHOT_DWA20131128_HPP
+# define SNAPSHOT_DWA20131128_HPP
+
+# include <string>
+
+class Ruleset;
+
+// Write, in the current directory, what each Git repository of the
+// rules holds at SVN revision revnum, without its history: one
+// parentless commit for each branch or tag the rules give it then,
+// holding the files they map to it, with the modes and contents the
+// conversion would give them.  The SVN tree is walked once, each
+// repository's part of it on one of jobs threads, each streaming to a
+// git fast-import of its own, so a ruleset's effect can be checked in
+// minutes by comparing the trees with what is expected.
+//
+// Each repository is made if it doesn't exist, and a snapshot
+// replaces an earlier one, but a repository that isn't a snapshot is
+// never written to.  Submodules' gitlinks aren't written.
+void write_snapshots(
+    std::string const& svn_path, std::string const& authors_file,
+    Ruleset const& ruleset, int revnum, unsigned jobs);
+
+#endif // SNAPSHOT_DWA20131128_HPP
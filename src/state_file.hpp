@@ -0,0 +1,157 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef STATE_FILE_DWA20131023_HPP
+# define STATE_FILE_DWA20131023_HPP
+
+# include <boost/iostreams/device/mapped_file.hpp>
+# include <boost/filesystem.hpp>
+# include <cassert>
+# include <cstdint>
+# include <cstring>
+# include <fstream>
+# include <stdexcept>
+# include <string>
+
+# include <fcntl.h>
+# include <unistd.h>
+
+// The checkpoint files that let a conversion be resumed are a
+// sequence of native 64-bit words.  Strings are a length word
+// followed by their bytes, padded to a word boundary, so every
+// number can be read in place from a memory mapping.
+namespace state_file
+{
+    std::uint64_t const magic = 0x3130657461747332ull; // "2state01"
+
+    struct writer
+    {
+        writer() { word(magic); }
+
+        writer& word(std::uint64_t x)
+        {
+            buffer.append(reinterpret_cast<char const*>(&x), sizeof(x));
+            return *this;
+        }
+
+        writer& str(std::string const& s)
+        {
+            word(s.size());
+            buffer += s;
+            buffer.append((sizeof(std::uint64_t) - s.size() % sizeof(std::uint64_t))
+                          % sizeof(std::uint64_t), '\0');
+            return *this;
+        }
+
+        // The number of bytes written so far, which is the offset of
+        // whatever is written next
+        std::size_t size() const { return buffer.size(); }
+
+        // Overwrite the word written at offset
+        writer& word_at(std::size_t offset, std::uint64_t x)
+        {
+            assert(offset % sizeof(x) == 0 && offset + sizeof(x) <= buffer.size());
+            std::memcpy(&buffer[offset], &x, sizeof(x));
+            return *this;
+        }
+
+        // Replace filename atomically, so an interrupted save leaves
+        // the previous checkpoint intact.  The temporary file is the
+        // process's own, since others may save the same file, e.g.
+        // the SVN changes index, or read it, e.g. with --shard.
+        void save(std::string const& filename) const
+        {
+            std::string const tmp = filename + ".tmp" + std::to_string(::getpid());
+            {
+                std::ofstream out(tmp.c_str(), std::ios::binary | std::ios::trunc);
+                out.write(buffer.data(), buffer.size());
+                out.close();
+                if (!out)
+                    throw std::runtime_error("Couldn't write " + tmp);
+            }
+            boost::filesystem::rename(tmp, filename);
+        }
+
+        // Append to filename, creating it if need be, in a single
+        // write, so that the images appended by processes sharing
+        // the file don't interleave.  A file of such images is read
+        // with one reader, each image beginning with the magic word.
+        void append_to(std::string const& filename) const
+        {
+            int const fd = ::open(filename.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0666);
+            if (fd < 0)
+                throw std::runtime_error("Couldn't open " + filename);
+            ssize_t const written = ::write(fd, buffer.data(), buffer.size());
+            ::close(fd);
+            if (written != ssize_t(buffer.size()))
+                throw std::runtime_error("Couldn't append to " + filename);
+        }
+
+     private:
+        std::string buffer;
+    };
+
+    struct reader
+    {
+        explicit reader(std::string const& filename)
+            : filename(filename), file(filename),
+              pos(file.data()), end(file.data() + file.size())
+        {
+            if (word() != magic)
+                throw std::runtime_error(filename + " is not a checkpoint file");
+        }
+
+        std::uint64_t word()
+        {
+            std::uint64_t const* p = reinterpret_cast<std::uint64_t const*>(take(sizeof(std::uint64_t)));
+            return *p;
+        }
+
+        std::string str()
+        {
+            std::uint64_t const size = word();
+            std::uint64_t const padded = (size + sizeof(std::uint64_t) - 1)
+                / sizeof(std::uint64_t) * sizeof(std::uint64_t);
+            if (padded < size || padded > std::uint64_t(end - pos))
+                truncated();
+            return std::string(take(padded), size);
+        }
+
+        // The offset of what is read next
+        std::size_t tell() const { return pos - file.data(); }
+
+        // The size of the file as it was when opened
+        std::size_t size() const { return file.size(); }
+
+        // Continue reading at offset, as returned by tell() or by
+        // writer::size() when the file was written
+        void seek(std::size_t offset)
+        {
+            if (offset % sizeof(std::uint64_t) != 0 || offset > file.size())
+                truncated();
+            pos = file.data() + offset;
+        }
+
+     private:
+        char const* take(std::size_t n)
+        {
+            if (n > std::size_t(end - pos))
+                truncated();
+            char const* p = pos;
+            pos += n;
+            return p;
+        }
+
+        void truncated() const
+        {
+            throw std::runtime_error("Checkpoint file " + filename + " is truncated");
+        }
+
+        std::string filename;
+        boost::iostreams::mapped_file_source file;
+        char const* pos;
+        char const* end;
+    };
+}
+
+#endif // STATE_FILE_DWA20131023_HPP
@@ -0,0 +1,226 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#include "status_report.hpp"
+#include "history_profile.hpp"
+#include "lru_cache.hpp"
+#include "options.hpp"
+
+#include <boost/filesystem.hpp>
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace
+{
+    // The sliding windows over which rates are reported
+    struct window
+    {
+        char const* label;
+        std::chrono::seconds length;
+    };
+    window const windows[] = {
+        { "1m", std::chrono::seconds(60) },
+        { "10m", std::chrono::seconds(600) },
+        { "1h", std::chrono::seconds(3600) }
+    };
+
+    // The resident memory of this process in megabytes, or zero if it
+    // can't be determined
+    std::size_t own_resident_megabytes()
+    {
+        std::ifstream statm("/proc/self/statm");
+        std::size_t pages = 0, resident = 0;
+        if (!(statm >> pages >> resident))
+            return 0;
+        return resident * ::sysconf(_SC_PAGESIZE) >> 20;
+    }
+
+    // Write name as a Prometheus label value
+    void write_label(std::ostream& os, std::string const& name)
+    {
+        os << '"';
+        for (char c : name)
+        {
+            if (c == '"' || c == '\\')
+                os << '\\' << c;
+            else if (c == '\n')
+                os << "\\n";
+            else
+                os << c;
+        }
+        os << '"';
+    }
+}
+
+status_report::status_report(
+    std::string const& filename, int first_revnum, int last_revnum,
+    history_profile const* history)
+    : filename(filename), first_revnum(first_revnum), last_revnum(last_revnum),
+      history(history), start(clock::now()), next_write(start)
+{}
+
+status_report::sample const& status_report::sample_before(std::chrono::seconds window) const
+{
+    clock::time_point const cutoff = samples.back().time - window;
+    for (auto p = samples.rbegin(); p != samples.rend(); ++p)
+    {
+        if (p->time <= cutoff)
+            return *p;
+    }
+    return samples.front();
+}
+
+void status_report::write(int revnum, std::vector<repository> const& repos)
+{
+    clock::time_point const now = clock::now();
+    next_write = now + std::chrono::seconds(std::max(options.status_interval, 1));
+
+    sample s = { now, revnum, std::vector<std::uint64_t>() };
+    for (auto const& r : repos)
+        s.bytes_sent.push_back(r.bytes_sent);
+    samples.push_back(std::move(s));
+    while (samples.size() > 2 && now - samples[1].time >= windows[2].length)
+        samples.pop_front();
+
+    auto seconds_since = [&](sample const& then) {
+        return std::chrono::duration<double>(now - then.time).count();
+    };
+    std::string const tmp = filename + ".tmp" + std::to_string(::getpid());
+    std::ofstream out(tmp.c_str(), std::ios::trunc);
+
+    out << "# HELP svn2git_revision The last SVN revision converted\n"
+        << "# TYPE svn2git_revision gauge\n"
+        << "svn2git_revision " << revnum << '\n'
+        << "# HELP svn2git_first_revision The first SVN revision converted by this run\n"
+        << "# TYPE svn2git_first_revision gauge\n"
+        << "svn2git_first_revision " << first_revnum << '\n'
+        << "# HELP svn2git_last_revision The SVN revision at which this run stops\n"
+        << "# TYPE svn2git_last_revision gauge\n"
+        << "svn2git_last_revision " << last_revnum << '\n'
+        << "# HELP svn2git_uptime_seconds How long this run has been converting\n"
+        << "# TYPE svn2git_uptime_seconds gauge\n"
+        << "svn2git_uptime_seconds " << std::chrono::duration<double>(now - start).count() << '\n';
+
+    out << "# HELP svn2git_revisions_per_second Revisions converted per second over a sliding window\n"
+        << "# TYPE svn2git_revisions_per_second gauge\n";
+    for (auto const& w : windows)
+    {
+        sample const& then = sample_before(w.length);
+        double const seconds = seconds_since(then);
+        double const rate = seconds > 0 ? (revnum - then.revnum) / seconds : 0;
+        out << "svn2git_revisions_per_second{window=\"" << w.label << "\"} " << rate << '\n';
+    }
+
+    // The rate of the last 10 minutes, and the work left, in
+    // revisions or, with a profile of the history, in cost
+    double recent_rate = 0, left = 0;
+    {
+        sample const& then = sample_before(windows[1].length);
+        double const seconds = seconds_since(then);
+        double const done = history ? double(history->cost(then.revnum + 1, revnum))
+            : revnum - then.revnum;
+        left = history ? double(history->cost(revnum + 1, last_revnum)) : last_revnum - revnum;
+        recent_rate = seconds > 0 ? done / seconds : 0;
+    }
+    out << "# HELP svn2git_eta_seconds Time left until the last revision, at the rate of the last 10 minutes\n"
+        << "# TYPE svn2git_eta_seconds gauge\n";
+    if (recent_rate > 0)
+        out << "svn2git_eta_seconds " << left / recent_rate << '\n';
+    else
+        out << "svn2git_eta_seconds NaN\n";
+
+    out << "# HELP svn2git_fast_import_bytes_total Bytes of commands sent to each git fast-import\n"
+        << "# TYPE svn2git_fast_import_bytes_total counter\n";
+    for (auto const& r : repos)
+    {
+        out << "svn2git_fast_import_bytes_total{repository=";
+        write_label(out, *r.name);
+        out << "} " << r.bytes_sent << '\n';
+    }
+
+    out << "# HELP svn2git_fast_import_bytes_per_second Bytes sent to each git fast-import per second over the last minute\n"
+        << "# TYPE svn2git_fast_import_bytes_per_second gauge\n";
+    {
+        sample const& then = sample_before(windows[0].length);
+        double const seconds = seconds_since(then);
+        for (std::size_t i = 0; i < repos.size(); ++i)
+        {
+            std::uint64_t const before = i < then.bytes_sent.size() ? then.bytes_sent[i] : 0;
+            out << "svn2git_fast_import_bytes_per_second{repository=";
+            write_label(out, *repos[i].name);
+            out << "} " << (seconds > 0 ? (repos[i].bytes_sent - before) / seconds : 0) << '\n';
+        }
+    }
+
+    out << "# HELP svn2git_fast_import_revisions_behind Revisions each git fast-import has yet to acknowledge importing\n"
+        << "# TYPE svn2git_fast_import_revisions_behind gauge\n";
+    for (auto const& r : repos)
+    {
+        out << "svn2git_fast_import_revisions_behind{repository=";
+        write_label(out, *r.name);
+        out << "} " << r.revisions_behind << '\n';
+    }
+    out << "# HELP svn2git_fast_import_ack_seconds Time each git fast-import took to acknowledge the latest revision it did\n"
+        << "# TYPE svn2git_fast_import_ack_seconds gauge\n";
+    for (auto const& r : repos)
+    {
+        out << "svn2git_fast_import_ack_seconds{repository=";
+        write_label(out, *r.name);
+        out << "} " << r.ack_seconds << '\n';
+    }
+
+    std::size_t running = 0, children_megabytes = 0;
+    for (auto const& r : repos)
+    {
+        running += r.running;
+        children_megabytes += r.resident_megabytes;
+    }
+    out << "# HELP svn2git_fast_import_processes The git fast-import processes running\n"
+        << "# TYPE svn2git_fast_import_processes gauge\n"
+        << "svn2git_fast_import_processes " << running << '\n'
+        << "# HELP svn2git_resident_megabytes Resident memory of svn2git and of its git fast-import children\n"
+        << "# TYPE svn2git_resident_megabytes gauge\n"
+        << "svn2git_resident_megabytes{process=\"svn2git\"} " << own_resident_megabytes() << '\n'
+        << "svn2git_resident_megabytes{process=\"fast-import\"} " << children_megabytes << '\n';
+
+    auto const caches = cache_registry::totals();
+    out << "# HELP svn2git_cache_hits_total Lookups that found their value in each cache\n"
+        << "# TYPE svn2git_cache_hits_total counter\n";
+    for (auto const& c : caches)
+    {
+        out << "svn2git_cache_hits_total{cache=";
+        write_label(out, c.first);
+        out << "} " << c.second.hits << '\n';
+    }
+    out << "# HELP svn2git_cache_misses_total Lookups that didn't find their value in each cache\n"
+        << "# TYPE svn2git_cache_misses_total counter\n";
+    for (auto const& c : caches)
+    {
+        out << "svn2git_cache_misses_total{cache=";
+        write_label(out, c.first);
+        out << "} " << c.second.misses << '\n';
+    }
+    out << "# HELP svn2git_cache_evictions_total Values each cache dropped to stay within its limit\n"
+        << "# TYPE svn2git_cache_evictions_total counter\n";
+    for (auto const& c : caches)
+    {
+        out << "svn2git_cache_evictions_total{cache=";
+        write_label(out, c.first);
+        out << "} " << c.second.evictions << '\n';
+    }
+    out << "# HELP svn2git_cache_weight What each cache holds, in the unit it is bounded by\n"
+        << "# TYPE svn2git_cache_weight gauge\n";
+    for (auto const& c : caches)
+    {
+        out << "svn2git_cache_weight{cache=";
+        write_label(out, c.first);
+        out << "} " << c.second.weight << '\n';
+    }
+
+    out.close();
+    if (!out)
+        throw std::runtime_error("Couldn't write " + tmp);
+    boost::filesystem::rename(tmp, filename);
+}
@@ -0,0 +1,78 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef STATUS_REPORT_DWA20131108_HPP
+# define STATUS_REPORT_DWA20131108_HPP
+
+# include <chrono>
+# include <cstdint>
+# include <deque>
+# include <string>
+# include <vector>
+
+class history_profile;
+
+// The progress of a long conversion, enabled by --status-file.  Every
+// --status-interval seconds the file is replaced with metrics in the
+// Prometheus text format, e.g. for node_exporter's textfile
+// collector: the revision reached, revisions per second over sliding
+// windows, the bytes sent to each git fast-import process and their
+// rate, how many revisions each has yet to acknowledge importing and
+// how long its latest acknowledgment took, the live fast-import
+// processes, the resident memory of this process and of its children,
+// and the time left until the last revision, judging by the recent
+// rate, of revisions or, given a profile of the history, of their
+// cost.
+struct status_report
+{
+    // What is known of one Git repository's fast-import process
+    struct repository
+    {
+        std::string const* name;
+        std::uint64_t bytes_sent;     // since the conversion started
+        bool running;
+        std::size_t resident_megabytes;
+        std::size_t revisions_behind; // not yet acknowledged by fast-import
+        double ack_seconds;           // the latest acknowledgment took
+    };
+
+    // Report on the conversion of revisions first_revnum to
+    // last_revnum to filename
+    status_report(
+        std::string const& filename, int first_revnum, int last_revnum,
+        history_profile const* history = nullptr);
+
+    // True iff the report is due to be written
+    bool due() const
+    {
+        return std::chrono::steady_clock::now() >= next_write;
+    }
+
+    // Rewrite the report, once revnum has been converted
+    void write(int revnum, std::vector<repository> const& repos);
+
+ private:
+    typedef std::chrono::steady_clock clock;
+
+    // What had been done at some moment
+    struct sample
+    {
+        clock::time_point time;
+        int revnum;
+        std::vector<std::uint64_t> bytes_sent;    // by repository
+    };
+
+    // The latest sample taken at least window seconds before the
+    // newest, or the oldest sample if none is that old
+    sample const& sample_before(std::chrono::seconds window) const;
+
+    std::string const filename;
+    int const first_revnum;
+    int const last_revnum;
+    history_profile const* const history; // may be null
+    clock::time_point const start;
+    clock::time_point next_write;
+    std::deque<sample> samples;   // oldest first, going back an hour
+};
+
+#endif // STATUS_REPORT_DWA20131108_HPP
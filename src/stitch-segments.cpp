@@ -0,0 +1,335 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Joins the segments of a conversion made by svn2git --segment-start,
+// each in a directory of its own, into the repositories of the first.
+// Every ref of a later segment starts with a commit holding the whole
+// tree its rules map, with no parent.  Each segment's commits are
+// replayed with fast-import on top of those already joined, that
+// first commit taking the ref's commit from the previous segments as
+// its parent.  The blobs aren't copied through the stream: they are
+// borrowed through objects/info/alternates until everything has been
+// repacked.
+#include "AST.hpp"
+#include "parse_rules.hpp"
+#include <boost/program_options.hpp>
+#include <boost/process.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/device/file_descriptor.hpp>
+#include <boost/iostreams/stream.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/foreach.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace stitch_segments {
+
+struct Options
+  {
+  std::string rules_file;
+  std::string git;
+  std::vector<std::string> segments;   // directories, in order of revision
+  unsigned jobs;
+  };
+
+Options options;
+
+struct git_failure : std::runtime_error
+  {
+  git_failure(std::vector<std::string> const& args, std::string const& output)
+    : std::runtime_error(describe(args, output)) {}
+
+  static std::string describe(std::vector<std::string> const& args, std::string const& output)
+    {
+    std::string message = "git";
+    for (std::size_t i = 1; i < args.size(); ++i)
+      message += " " + args[i];
+    return message + " failed" + (output.empty() ? "" : ":\n" + output);
+    }
+  };
+
+// Run git with args in dir, its standard input read from input_file
+// unless that's empty, and return what it wrote to its standard
+// output, and to its standard error too if with_stderr is set.  Throw
+// git_failure if it exits unsuccessfully.
+std::string git(std::string const& dir, std::vector<std::string> args,
+                bool with_stderr = true, std::string const& input_file = std::string())
+  {
+  namespace iostreams = boost::iostreams;
+  using namespace boost::process::initializers;
+  args.insert(args.begin(), options.git);
+
+  // Close-on-exec, so the children started by other threads meanwhile
+  // don't hold the pipe open and keep us from seeing its end
+  int fds[2];
+  if (::pipe2(fds, O_CLOEXEC) != 0)
+    throw std::runtime_error("Couldn't create a pipe");
+  iostreams::file_descriptor_source source(fds[0], iostreams::close_handle);
+
+  int const input = ::open(input_file.empty() ? "/dev/null" : input_file.c_str(), O_RDONLY | O_CLOEXEC);
+  if (input < 0)
+    throw std::runtime_error("Couldn't open " + input_file);
+  iostreams::file_descriptor_source stdin_source(input, iostreams::close_handle);
+
+  boost::process::child child = [&]
+    {
+    iostreams::file_descriptor_sink sink(fds[1], iostreams::close_handle);
+    if (with_stderr)
+      return boost::process::execute(
+        run_exe(options.git), set_args(args), start_in_dir(dir), bind_stdin(stdin_source),
+        bind_stdout(sink), bind_stderr(sink), throw_on_error());
+    return boost::process::execute(
+      run_exe(options.git), set_args(args), start_in_dir(dir), bind_stdin(stdin_source),
+      bind_stdout(sink), throw_on_error());
+    }();
+
+  iostreams::stream<iostreams::file_descriptor_source> output_stream(source);
+  std::string const output(
+    (std::istreambuf_iterator<char>(output_stream)), std::istreambuf_iterator<char>());
+  int const status = boost::process::wait_for_exit(child);
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    throw git_failure(args, output);
+  return output;
+  }
+
+std::vector<std::string> lines(std::string const& text)
+  {
+  std::vector<std::string> result;
+  std::istringstream in(text);
+  for (std::string line; std::getline(in, line);)
+    result.push_back(line);
+  return result;
+  }
+
+// Rewrite a stream written by git fast-export --no-data so that the
+// first commit of each ref in joined, if it has no parent, continues
+// the ref's history there instead: it takes the ref's commit as its
+// parent and, since the stream gives it the whole tree as additions,
+// starts from an empty tree.
+std::string stitch(std::string const& stream, std::set<std::string> const& joined)
+  {
+  std::string result;
+  result.reserve(stream.size() + (joined.size() << 6));
+  std::set<std::string> seen;
+  bool reparent = false;
+  std::string ref;
+  for (std::size_t pos = 0; pos < stream.size();)
+    {
+    std::size_t end = stream.find('\n', pos);
+    end = end == std::string::npos ? stream.size() : end + 1;
+    std::string const line = stream.substr(pos, end - pos);
+    result += line;
+    pos = end;
+
+    if (boost::starts_with(line, "commit "))
+      {
+      ref = line.substr(7, line.size() - 8);
+      reparent = seen.insert(ref).second && joined.count(ref);
+      }
+    else if (boost::starts_with(line, "data "))
+      {
+      std::size_t const length = std::strtoul(line.c_str() + 5, nullptr, 10);
+      if (length > stream.size() - pos)
+        throw std::runtime_error("Truncated fast-export stream");
+      result.append(stream, pos, length);
+      pos += length;
+      if (pos < stream.size() && stream[pos] == '\n')
+        result += stream[pos++];
+      if (reparent && !boost::starts_with(stream.c_str() + pos, "from "))
+        result += "from " + ref + "^0\ndeleteall\n";
+      reparent = false;
+      }
+    }
+  return result;
+  }
+
+// Append a segment's copy of repository name to the first's
+void join(std::string const& name, std::string const& segment)
+  {
+  namespace fs = boost::filesystem;
+  std::string const dst = (fs::path(options.segments[0]) / name).string();
+  std::string const src = (fs::path(segment) / name).string();
+  if (!fs::exists(dst))
+    git(options.segments[0], { "init", "--bare", "--quiet", name });
+
+  std::string const alternates = dst + "/objects/info/alternates";
+  std::ofstream(alternates.c_str(), std::ios::app)
+    << fs::absolute(fs::path(src) / "objects").string() << '\n';
+
+  std::set<std::string> joined;
+  BOOST_FOREACH(std::string const& r, lines(git(dst, { "for-each-ref", "--format=%(refname)" }, false)))
+    joined.insert(r);
+
+  std::string const stream_file = dst + "/stitch-segments.fi";
+  {
+    std::ofstream out(stream_file.c_str(), std::ios::binary | std::ios::trunc);
+    out << stitch(git(src, { "fast-export", "--all", "--no-data", "--signed-tags=verbatim" }, false), joined);
+    if (!out.flush())
+      throw std::runtime_error("Couldn't write " + stream_file);
+  }
+  git(dst, { "fast-import", "--force", "--quiet" }, true, stream_file);
+  std::remove(stream_file.c_str());
+  }
+
+// Join the segments of repository name, then copy what it borrowed
+// from them into a pack of its own
+void process(std::string const& name)
+  {
+  namespace fs = boost::filesystem;
+  std::string const dst = (fs::path(options.segments[0]) / name).string();
+  std::string const alternates = dst + "/objects/info/alternates";
+  bool const had_alternates = fs::exists(alternates);
+  std::string original;
+  if (had_alternates)
+    {
+    std::ifstream in(alternates.c_str());
+    original.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+  bool joined_any = false;
+  for (std::size_t i = 1; i < options.segments.size(); ++i)
+    {
+    if (!fs::exists(fs::path(options.segments[i]) / name))
+      continue;
+    join(name, options.segments[i]);
+    joined_any = true;
+    }
+  if (!joined_any)
+    return;
+
+  git(dst, { "repack", "-a", "-d", "--quiet" });
+  if (had_alternates)
+    std::ofstream(alternates.c_str(), std::ios::trunc) << original;
+  else
+    fs::remove(alternates);
+  }
+
+// The non-abstract repositories of the ruleset
+std::vector<std::string> repositories()
+  {
+  std::vector<std::string> result;
+  BOOST_FOREACH(boost2git::RepoRule const& rule, parse_rules_file(options.rules_file))
+    {
+    if (!rule.is_abstract)
+      result.push_back(rule.git_repo_name);
+    }
+  return result;
+  }
+
+// Join every repository on up to options.jobs threads, reporting each
+// one's time as it finishes.  Return the number that failed.
+std::size_t run()
+  {
+  std::vector<std::string> const repos = repositories();
+  std::vector<std::string> errors(repos.size());
+  std::mutex report_mutex;
+  auto const start = std::chrono::steady_clock::now();
+
+  std::atomic<std::size_t> next(0);
+  auto worker = [&]()
+    {
+    for (std::size_t i; (i = next++) < repos.size();)
+      {
+      auto const repo_start = std::chrono::steady_clock::now();
+      try
+        {
+        process(repos[i]);
+        }
+      catch (std::exception const& error)
+        {
+        errors[i] = error.what();
+        }
+      std::lock_guard<std::mutex> lock(report_mutex);
+      std::printf("%-24s stitched %8.2fs%s\n", repos[i].c_str(),
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - repo_start).count(),
+        errors[i].empty() ? "" : "  FAILED");
+      std::fflush(stdout);
+      }
+    };
+
+  std::vector<std::thread> threads;
+  for (unsigned n = std::max(1u, std::min<unsigned>(options.jobs, repos.size())); n > 1; --n)
+    threads.emplace_back(worker);
+  worker();
+  BOOST_FOREACH(std::thread& t, threads)
+    t.join();
+
+  std::size_t failures = 0;
+  for (std::size_t i = 0; i < repos.size(); ++i)
+    {
+    if (!errors[i].empty())
+      {
+      ++failures;
+      std::cerr << repos[i] << ": " << errors[i] << std::endl;
+      }
+    }
+  std::printf("%lu repositories in %.2fs, %lu failed\n", (unsigned long)repos.size(),
+    std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(),
+    (unsigned long)failures);
+  return failures;
+  }
+} // namespace stitch_segments
+
+int main(int argc, char **argv)
+  {
+  using stitch_segments::options;
+  namespace po = boost::program_options;
+  po::options_description program_options("Allowed options");
+  program_options.add_options()
+    ("help,h", "produce help message")
+    ("rules", po::value(&options.rules_file)->value_name("FILENAME")->required(),
+      "file with the conversion rules")
+    ("git", po::value(&options.git)->value_name("PATH"),
+      "the git executable to use (by default the one on the PATH)")
+    ("jobs,j", po::value(&options.jobs)->value_name("NUMBER")->default_value(8),
+      "join NUMBER repositories at a time")
+    ("segment", po::value(&options.segments)->value_name("DIRECTORY"),
+      "the directories of the segments, earliest first; the others are joined into the first")
+    ;
+  po::positional_options_description positional;
+  positional.add("segment", -1);
+
+  po::variables_map variables;
+  store(po::command_line_parser(argc, argv)
+    .options(program_options)
+    .positional(positional)
+    .run(), variables);
+  if (variables.count("help"))
+    {
+    std::cout << "Usage: " << argv[0] << " [options] DIRECTORY...\n"
+              << program_options << std::endl;
+    return 0;
+    }
+  notify(variables);
+
+  try
+    {
+    if (options.segments.size() < 2)
+      throw std::runtime_error("At least two segment directories are needed");
+    if (options.git.empty())
+      options.git = boost::process::search_path("git");
+    return stitch_segments::run() == 0 ? 0 : 1;
+    }
+  catch (std::exception& error)
+    {
+    std::cerr << error.what() << std::endl;
+    return -1;
+    }
+  }
@@ -22,36 +22,157 @@
  */
 
 // Apparently some builds of libsvn_repos/libsvn_ra_local (like the
-// one that comes with MacOS 10.8) don't have svn_repos_open2, so we
-// use the deprecated svn_repos_open instead.
+// one that comes with MacOS 10.8) don't have svn_repos_open2, so
+// before Subversion 1.7, which needs it to pass the FS configuration,
+// we use the deprecated svn_repos_open instead.
 #define SVN_DEPRECATED
 
 #include "svn.hpp"
 #include "svn_error.hpp"
+#include "svn_handle.hpp"
 #include "apr_init.hpp"
 #include "apr_pool.hpp"
+#include "svn_date.hpp"
+#include "rules_cache.hpp"
+#include "log.hpp"
+#include "options.hpp"
 
-#include <boost/date_time/posix_time/time_parsers.hpp>
-#include <boost/date_time/posix_time/posix_time_io.hpp>
+#include <svn_version.h>
+#if SVN_VER_MAJOR == 1 && SVN_VER_MINOR < 7
+# define SVN2GIT_SVN_REPOS_OPEN2 0
+#else
+# define SVN2GIT_SVN_REPOS_OPEN2 1
+# include <svn_cache_config.h>
+# include <apr_hash.h>
+#endif
+// Subversion 1.10 can hand out a revision's changes one by one
+#if SVN_VER_MAJOR == 1 && SVN_VER_MINOR < 10
+# define SVN2GIT_SVN_PATHS_CHANGED3 0
+#else
+# define SVN2GIT_SVN_PATHS_CHANGED3 1
+#endif
+// The statistics of the cache are only in Subversion's private API,
+// whose headers some installations have (see src/CMakeLists.txt)
+#if SVN2GIT_HAVE_SVN_CACHE_INFO && SVN_VER_MAJOR == 1 && SVN_VER_MINOR >= 9
+# include <private/svn_cache.h>
+#else
+# undef SVN2GIT_HAVE_SVN_CACHE_INFO
+#endif
+
+#include <svn_delta.h>
+#include <svn_mergeinfo.h>
+
+#include <algorithm>
+#include <cassert>
+#include <condition_variable>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
 
 AprInit apr_init;
-AprPool svn::global_pool;
+
+static std::string repository_uuid(svn_fs_t* fs, apr_pool_t* pool)
+{
+    AprPool scope(pool);
+    char const* uuid;
+    check_svn(svn_fs_get_uuid(fs, &uuid, scope));
+    return uuid;
+}
+
+// Where the index of the repository with the given UUID with the
+// given extension is kept, beside the rules cache
+static std::string index_file(std::string const& uuid, char const* extension)
+{
+    boost::filesystem::path const dir = rules_cache::directory();
+    return dir.empty() ? std::string() : (dir / (uuid + extension)).string();
+}
 
 svn::svn(
     std::string const& repo_path,
     std::string const& authors_file_path)
-    : repos(call(svn_repos_open, repo_path.c_str(), global_pool)),
+    : revision_pools(pool),
+      repo_path(repo_path),
+      repos(open_repository(repo_path, pool)),
       fs(svn_repos_fs(repos)),
-      authors(authors_file_path)
+      authors(authors_file_path),
+      indexed_changes(
+          index_file(repository_uuid(fs, pool), ".changes"), repository_uuid(fs, pool),
+          [this](int revnum) { return revision_date(revnum); }),
+      indexed_merges(
+          index_file(repository_uuid(fs, pool), ".mergeinfo"), repository_uuid(fs, pool),
+          [this](int revnum) { return revision_date(revnum); })
 {
 }
 
 svn::~svn()
 {}
 
+// libsvn_fs's membuffer cache is shared by every repository opened in
+// the process, so it's sized once, before the first is opened.  Its
+// segments are sized from the total by Subversion itself.
+static void configure_cache()
+{
+#if SVN2GIT_SVN_REPOS_OPEN2
+    svn_cache_config_t config = *svn_cache_config_get();
+    if (options.svn_cache_megabytes > 0)
+        config.cache_size = apr_uint64_t(options.svn_cache_megabytes) << 20;
+    if (options.svn_file_handles > 0)
+        config.file_handle_count = options.svn_file_handles;
+    config.single_threaded = FALSE; // the prefetchers read on threads of their own
+    svn_cache_config_set(&config);
+#endif
+}
+
+svn_repos_t* svn::open_repository(std::string const& repo_path, apr_pool_t* pool)
+{
+    static std::once_flag configured;
+    std::call_once(configured, configure_cache);
+#if SVN2GIT_SVN_REPOS_OPEN2
+    apr_hash_t* fs_config = apr_hash_make(pool);
+    if (options.svn_cache_fulltexts)
+        apr_hash_set(fs_config, SVN_FS_CONFIG_FSFS_CACHE_FULLTEXTS, APR_HASH_KEY_STRING, "1");
+    if (options.svn_cache_deltas)
+        apr_hash_set(fs_config, SVN_FS_CONFIG_FSFS_CACHE_DELTAS, APR_HASH_KEY_STRING, "1");
+    return call(svn_repos_open2, repo_path.c_str(), fs_config, pool);
+#else
+    return call(svn_repos_open, repo_path.c_str(), pool);
+#endif
+}
+
+void svn::report_cache()
+{
+#if SVN2GIT_SVN_REPOS_OPEN2
+    std::cout << "SVN cache: " << (svn_cache_config_get()->cache_size >> 20) << " MB";
+# ifdef SVN2GIT_HAVE_SVN_CACHE_INFO
+    AprPool scope;
+    svn_cache__info_t const* info = svn_cache__membuffer_get_global_info(scope.data());
+    std::cout << ", " << (info->used_size >> 20) << " MB used; "
+              << info->hits << " hits of " << info->gets << " gets";
+    if (info->gets > 0)
+        std::cout << " (" << std::fixed << std::setprecision(1)
+                  << 100.0 * info->hits / info->gets << "%)";
+    std::cout << ", " << info->sets << " sets, " << info->failures << " failed\n";
+# else
+    std::cout << " (hit rates need the private headers of Subversion 1.9 or later)\n";
+# endif
+    std::cout << std::flush;
+#endif
+    std::cout << "APR pools of revisions: " << AprPoolRecycler::created() << " created, "
+              << AprPoolRecycler::reused() << " reused" << std::endl;
+}
+
+std::string svn::uuid() const
+{
+    return repository_uuid(fs, pool);
+}
+
 int svn::latest_revision() const
 {
-    return call(svn_fs_youngest_rev, fs, global_pool);
+    return call(svn_fs_youngest_rev, fs, pool);
 }
 
 static std::string get_string(apr_hash_t *revprops, char const *key)
@@ -65,29 +186,553 @@ static std::string get_string(apr_hash_t *revprops, char const *key)
     return result;
 }
 
+// The svn:date of revnum, which tells a history reloaded from a
+// filtered or edited dump, with the same UUID, from the one an index
+// was made of.  Used while the indexes are constructed, so only fs
+// and revision_pools may be touched.
+std::string svn::revision_date(int revnum) const
+{
+    if (revnum < 1 || revnum > latest_revision())
+        return std::string();
+    return revision_property(revnum, "svn:date");
+}
+
+std::string svn::revision_property(int revnum, char const* name) const
+{
+    AprPool pool = revision_pools.take();
+    svn_string_t const* const value = call(svn_fs_revision_prop, fs, revnum, name, pool);
+    return value ? std::string(value->data, value->len) : std::string();
+}
+
+// With --replay-changes, the changes of a revision are those
+// svn_repos_replay2 drives an editor through, rather than those
+// svn_fs_paths_changed2 reports.  The editor names the source of every
+// copy as it adds the copy, where the older repository formats don't
+// record copy sources with the changed paths, leaving the copies to
+// be converted as new trees and the merges they make undiscovered.
+namespace replay
+{
+  struct recorder
+  {
+      std::map<std::string, svn::change> changes;
+
+      svn::change& record(char const* path, svn_fs_path_change_kind_t kind, svn_node_kind_t node_kind)
+      {
+          svn::change& c = changes[std::string("/") + path];
+          if (c.path.empty())
+          {
+              c.path = std::string("/") + path;
+              c.change_kind = kind;
+              c.text_mod = false;
+              c.copyfrom_rev = -1;
+          }
+          // Added after being deleted in the same revision
+          else if (c.change_kind == svn_fs_path_change_delete && kind == svn_fs_path_change_add)
+              c.change_kind = svn_fs_path_change_replace;
+          c.node_kind = node_kind;
+          return c;
+      }
+  };
+
+  // The baton of a directory or file the edit visits: its change, if
+  // it has been found to have one
+  struct node
+  {
+      recorder* changes;
+      char const* path;
+      svn_node_kind_t kind;
+      svn::change* change;
+  };
+
+  void* visit(recorder* r, char const* path, svn_node_kind_t kind, svn::change* c, apr_pool_t* pool)
+  {
+      node* n = static_cast<node*>(apr_palloc(pool, sizeof(node)));
+      n->changes = r;
+      n->path = apr_pstrdup(pool, path);
+      n->kind = kind;
+      n->change = c;
+      return n;
+  }
+
+  // A visited node, which is changed if it wasn't added
+  svn::change& modified(void* baton)
+  {
+      node* n = static_cast<node*>(baton);
+      if (!n->change)
+          n->change = &n->changes->record(n->path, svn_fs_path_change_modify, n->kind);
+      return *n->change;
+  }
+
+  svn_error_t* open_root(void* edit_baton, svn_revnum_t, apr_pool_t* pool, void** root_baton)
+  {
+      *root_baton = visit(static_cast<recorder*>(edit_baton), "", svn_node_dir, nullptr, pool);
+      return SVN_NO_ERROR;
+  }
+
+  svn_error_t* delete_entry(char const* path, svn_revnum_t, void* parent_baton, apr_pool_t*)
+  {
+      // What was deleted isn't known without looking at the
+      // revision before, which the importer doesn't need
+      static_cast<node*>(parent_baton)->changes->record(
+          path, svn_fs_path_change_delete, svn_node_unknown);
+      return SVN_NO_ERROR;
+  }
+
+  svn_error_t* add_node(
+      char const* path, void* parent_baton, char const* copyfrom_path,
+      svn_revnum_t copyfrom_revision, svn_node_kind_t kind, apr_pool_t* pool, void** baton)
+  {
+      recorder* r = static_cast<node*>(parent_baton)->changes;
+      svn::change& c = r->record(path, svn_fs_path_change_add, kind);
+      if (copyfrom_path)
+      {
+          c.copyfrom_path = copyfrom_path;
+          c.copyfrom_rev = copyfrom_revision;
+      }
+      *baton = visit(r, path, kind, &c, pool);
+      return SVN_NO_ERROR;
+  }
+
+  svn_error_t* add_directory(
+      char const* path, void* parent_baton, char const* copyfrom_path,
+      svn_revnum_t copyfrom_revision, apr_pool_t* pool, void** child_baton)
+  {
+      return add_node(
+          path, parent_baton, copyfrom_path, copyfrom_revision, svn_node_dir, pool, child_baton);
+  }
+
+  svn_error_t* add_file(
+      char const* path, void* parent_baton, char const* copyfrom_path,
+      svn_revnum_t copyfrom_revision, apr_pool_t* pool, void** file_baton)
+  {
+      return add_node(
+          path, parent_baton, copyfrom_path, copyfrom_revision, svn_node_file, pool, file_baton);
+  }
+
+  svn_error_t* open_directory(
+      char const* path, void* parent_baton, svn_revnum_t, apr_pool_t* pool, void** child_baton)
+  {
+      *child_baton = visit(
+          static_cast<node*>(parent_baton)->changes, path, svn_node_dir, nullptr, pool);
+      return SVN_NO_ERROR;
+  }
+
+  svn_error_t* open_file(
+      char const* path, void* parent_baton, svn_revnum_t, apr_pool_t* pool, void** file_baton)
+  {
+      *file_baton = visit(
+          static_cast<node*>(parent_baton)->changes, path, svn_node_file, nullptr, pool);
+      return SVN_NO_ERROR;
+  }
+
+  svn_error_t* change_prop(void* baton, char const*, svn_string_t const*, apr_pool_t*)
+  {
+      modified(baton);
+      return SVN_NO_ERROR;
+  }
+
+  // Without deltas, the replay still announces each change of text
+  svn_error_t* apply_textdelta(
+      void* file_baton, char const*, apr_pool_t*,
+      svn_txdelta_window_handler_t* handler, void** handler_baton)
+  {
+      modified(file_baton).text_mod = true;
+      *handler = svn_delta_noop_window_handler;
+      *handler_baton = nullptr;
+      return SVN_NO_ERROR;
+  }
+
+  void changes(svn_fs_root_t* fs_root, apr_pool_t* pool, std::vector<svn::change>& changes)
+  {
+      svn_delta_editor_t* editor = svn_delta_default_editor(pool);
+      editor->open_root = open_root;
+      editor->delete_entry = delete_entry;
+      editor->add_directory = add_directory;
+      editor->open_directory = open_directory;
+      editor->change_dir_prop = change_prop;
+      editor->add_file = add_file;
+      editor->open_file = open_file;
+      editor->apply_textdelta = apply_textdelta;
+      editor->change_file_prop = change_prop;
+
+      recorder r;
+      svn::check(svn_repos_replay2, fs_root, "", 0, FALSE, editor, &r, nullptr, nullptr, pool);
+      check_svn(editor->close_edit(&r, pool));
+
+      changes.clear();
+      changes.reserve(r.changes.size());
+      for (auto& kv : r.changes)
+          changes.push_back(std::move(kv.second));
+  }
+}
+
+// Fill in the paths changed by revnum, from the index if it has them
+static void read_changes(
+    svn const& repo, svn_fs_root_t* fs_root, int revnum, apr_pool_t* pool,
+    std::vector<svn::change>& result)
+{
+    if (repo.indexed_changes.find(revnum, result))
+        return;
+
+    if (options.replay_changes)
+    {
+        replay::changes(fs_root, pool, result);
+        repo.indexed_changes.add(revnum, result);
+        return;
+    }
+
+    result.clear();
+#if SVN2GIT_SVN_PATHS_CHANGED3
+    // Iterated rather than gathered into a hash first, which for the
+    // largest revisions, e.g. an initial import or a mass tagging by
+    // cvs2svn, takes hundreds of megabytes.  Each change is copied
+    // out as it comes, and the iterator's pool freed at once.
+    {
+        AprPool changes_pool(pool);
+        AprPool scratch(pool);
+        svn_fs_path_change_iterator_t* changes = svn::call(
+            svn_fs_paths_changed3, fs_root, changes_pool.data(), scratch.data());
+        while (svn_fs_path_change3_t* change = svn::call(svn_fs_path_change_get, changes))
+        {
+            svn::change c;
+            c.path.assign(change->path.data, change->path.len);
+            c.change_kind = change->change_kind;
+            c.node_kind = change->node_kind;
+            c.text_mod = change->text_mod;
+            if (change->copyfrom_known && change->copyfrom_path != nullptr)
+                c.copyfrom_path = change->copyfrom_path;
+            c.copyfrom_rev = change->copyfrom_rev;
+            result.push_back(std::move(c));
+        }
+    }
+#else
+    apr_hash_t *changes = svn::call(svn_fs_paths_changed2, fs_root, pool);
+    result.reserve(apr_hash_count(changes));
+    for (apr_hash_index_t *i = apr_hash_first(pool, changes); i; i = apr_hash_next(i))
+    {
+        const char *path = 0;
+        svn_fs_path_change2_t *change = 0;
+        apr_hash_this(i, (const void**) &path, nullptr, (void**) &change);
+        // According to the APR docs, this means the hash entry was
+        // deleted, so it should never happen
+        assert(change != nullptr); 
+
+        svn::change c;
+        c.path = path;
+        c.change_kind = change->change_kind;
+        c.node_kind = change->node_kind;
+        c.text_mod = change->text_mod;
+        if (change->copyfrom_known && change->copyfrom_path != nullptr)
+            c.copyfrom_path = change->copyfrom_path;
+        c.copyfrom_rev = change->copyfrom_rev;
+        result.push_back(std::move(c));
+    }
+#endif
+    std::sort(
+        result.begin(), result.end(), 
+        [](svn::change const& x, svn::change const& y) { return x.path < y.path; });
+    repo.indexed_changes.add(revnum, result);
+}
+
+// Fill in everything about revnum that doesn't need to outlive pool
+static void read_revision_info(
+    svn const& repo, svn_fs_t* fs, svn_fs_root_t* fs_root, int revnum,
+    apr_pool_t* pool, svn::revision_info& info)
+{
+    apr_hash_t *revprops = svn::call(svn_fs_revision_proplist, fs, revnum, pool);
+
+    info.committer = &repo.authors.committer(get_string(revprops, "svn:author"));
+
+    std::string const svndate = get_string(revprops, "svn:date");
+    info.epoch = svndate.empty() ? 0 : svn_date_epoch(svndate);
+
+    info.log_message = get_string(revprops, "svn:log");
+    if (info.log_message.empty())
+        info.log_message = "** empty log message **";
+
+    read_changes(repo, fs_root, revnum, pool, info.changes);
+}
+
+// Reads revisions ahead of the importer through the svn_handle of its
+// own thread, since APR pools and svn_fs objects can't be shared
+// between threads.  Besides the revision_info it hands over, this
+// warms the caches the importer's own reads will hit.
+struct svn::revision_prefetcher
+{
+    revision_prefetcher(svn const& repo, int first, int last, unsigned depth)
+        : repo(repo), next(first), last(last), depth(depth), stopping(false),
+          thread(&revision_prefetcher::work, this)
+    {}
+
+    ~revision_prefetcher()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        space_ready.notify_all();
+        thread.join();
+    }
+
+    // If revnum is the next revision to be read ahead, or one after
+    // it, the importer having skipped those between, wait for it,
+    // move it into info and return true.
+    bool take(int revnum, revision_info& info)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (revnum < next || revnum > last)
+            return false;
+
+        entry e;
+        while (next <= revnum)
+        {
+            info_ready.wait(lock, [this]{ return !ready.empty(); });
+            e = std::move(ready.front());
+            ready.pop_front();
+            ++next;
+            space_ready.notify_all();
+        }
+        lock.unlock();
+
+        if (!e.error.empty())
+            throw std::runtime_error(e.error);
+        info = std::move(e.info);
+        return true;
+    }
+
+ private:
+    struct entry
+    {
+        revision_info info;
+        std::string error;
+    };
+
+    void work()
+    {
+        int const first = next;
+        AprPool rev_pool;
+        for (int revnum = first; revnum <= last; ++revnum)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                space_ready.wait(
+                    lock, [this]{ return stopping || ready.size() < depth; });
+                if (stopping)
+                    return;
+            }
+
+            entry e;
+            try
+            {
+                // Each revision is read once, so its root isn't
+                // worth the handle's keeping
+                svn_fs_t* const fs = svn_handle::of_thread(repo.repo_path).fs();
+                AprScratch scope(rev_pool);
+                svn_fs_root_t* fs_root = call(svn_fs_revision_root, fs, revnum, scope);
+                read_revision_info(repo, fs, fs_root, revnum, scope, e.info);
+            }
+            catch(std::exception const& x)
+            {
+                e.error = x.what();
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                ready.push_back(std::move(e));
+            }
+            info_ready.notify_all();
+        }
+    }
+
+    svn const& repo;
+
+    std::mutex mutex;
+    std::condition_variable info_ready;
+    std::condition_variable space_ready;
+    std::deque<entry> ready;
+    int next;                   // the revision at the front of ready
+    int const last;
+    std::size_t const depth;
+    bool stopping;
+
+    std::thread thread;         // last, so it starts when all else is ready
+};
+
+void svn::prefetch(int first, int last, unsigned depth)
+{
+    prefetcher.reset();
+    if (depth > 0 && first <= last)
+        prefetcher.reset(new revision_prefetcher(*this, first, last, depth));
+}
+
+void svn::read_ahead(int distance, int drop_behind)
+{
+    readahead.reset();
+    if (options.io_uring && !readahead_ring)
+    {
+        readahead_ring = io_ring::open(64);
+        if (!readahead_ring)
+            Log::warn() << "--io-uring ignored for --fsfs-readahead: io_uring is unavailable" << std::endl;
+    }
+    readahead.reset(new fsfs_readahead(repo_path, distance, drop_behind, readahead_ring.get()));
+    if (!readahead->enabled())
+    {
+        Log::warn() << "--fsfs-readahead ignored: " << repo_path
+                    << " is not an FSFS repository" << std::endl;
+        readahead.reset();
+    }
+}
+
 svn::revision::revision(svn const& repo, int revnum)
-    : pool(svn::global_pool.make_subpool())
+    : pool(repo.revision_pools.take())
+    , scratch(repo.revision_pools.take())
     , fs_root(call(svn_fs_revision_root, repo.fs, revnum, pool))
     , revnum(revnum)
-    , epoch(0)
 {
-    apr_hash_t *revprops = call(svn_fs_revision_proplist, repo.fs, revnum, pool);
+    if (repo.readahead)
+        repo.readahead->advance(revnum);
+    if (!repo.prefetcher || !repo.prefetcher->take(revnum, *this))
+        read_revision_info(repo, repo.fs, fs_root, revnum, pool, *this);
+}
 
-    author = repo.authors[get_string(revprops, "svn:author")];
-    if (author.empty())
-        author = "nobody <nobody@localhost>";
+svn::revision::revision(svn const& repo, revision const& rev)
+    : pool(svn_handle::of_thread(repo.repo_path).make_subpool())
+    , scratch(pool.make_subpool())
+    , fs_root(svn_handle::of_thread(repo.repo_path).revision_root(rev.revnum))
+    , revnum(rev.revnum)
+{
+    committer = rev.committer;
+    epoch = rev.epoch;
+    log_message = rev.log_message;
+}
+
+void svn::changes(int revnum, std::vector<change>& result) const
+{
+    if (indexed_changes.find(revnum, result))
+        return;
+    AprPool pool = revision_pools.take();
+    read_changes(*this, call(svn_fs_revision_root, fs, revnum, pool), revnum, pool, result);
+}
 
-    std::string svndate = get_string(revprops, "svn:date");
-    if (!svndate.empty())
+void svn::changes_on_thread(int revnum, std::vector<change>& result) const
+{
+    if (indexed_changes.find(revnum, result))
+        return;
+    svn_handle& handle = svn_handle::of_thread(repo_path);
+    AprPool pool = handle.make_subpool();
+    read_changes(*this, handle.revision_root(revnum), revnum, pool, result);
+}
+
+void svn::merges(int revnum, std::vector<merge>& result) const
+{
+    if (indexed_merges.find(revnum, result))
+        return;
+    for (int r = indexed_merges.last_revision() + 1; r < revnum; ++r)
     {
-        namespace dt = boost::date_time;
-        namespace pt = boost::posix_time;
-        pt::ptime ptime = dt::parse_delimited_time<pt::ptime>(svndate, 'T');
-        static pt::ptime epoch_(boost::gregorian::date(1970, 1, 1));
-        epoch = (ptime - epoch_).total_seconds();
+        read_merges(r, result);
+        indexed_merges.add(r, result);
     }
+    read_merges(revnum, result);
+    indexed_merges.add(revnum, result);
+}
+
+// The svn:mergeinfo of the directory at svn_path under fs_root,
+// parsed, or null if it has none
+static svn_mergeinfo_t directory_mergeinfo(
+    svn_fs_root_t* fs_root, char const* svn_path, apr_pool_t* pool)
+{
+    svn_string_t* value = svn::call(svn_fs_node_prop, fs_root, svn_path, SVN_PROP_MERGEINFO, pool);
+    return value ? svn::call(svn_mergeinfo_parse, value->data, pool) : nullptr;
+}
+
+// A directory's svn:mergeinfo only changes with its properties, which
+// is all a change to a directory that isn't an add, delete or replace
+// can be, so only those are read, in revnum and the revision before.
+// Each source merged anew is recorded once, up to the last revision
+// merged from it in full: mergeinfo kept by a subtree alone doesn't
+// make the directory a descendant of the source.
+void svn::read_merges(int revnum, std::vector<merge>& result) const
+{
+    result.clear();
+    std::vector<change> revnum_changes;
+    changes(revnum, revnum_changes);
+
+    AprPool pool = revision_pools.take();
+    AprPool scratch = revision_pools.take();
+    svn_fs_root_t* root = nullptr;
+    svn_fs_root_t* prev_root = nullptr;
+    for (auto const& c : revnum_changes)
+    {
+        if (c.node_kind != svn_node_dir || c.change_kind != svn_fs_path_change_modify)
+            continue;
+        if (!root)
+        {
+            root = call(svn_fs_revision_root, fs, revnum, pool);
+            prev_root = call(svn_fs_revision_root, fs, revnum - 1, pool);
+        }
 
-    log_message = get_string(revprops, "svn:log");
-    if (log_message.empty())
-        log_message = "** empty log message **";
+        AprScratch scope(scratch);
+        svn_mergeinfo_t const to = directory_mergeinfo(root, c.path.c_str(), scope);
+        if (!to)
+            continue;
+        svn_mergeinfo_t const from = directory_mergeinfo(prev_root, c.path.c_str(), scope);
+        svn_mergeinfo_t deleted;
+        svn_mergeinfo_t added;
+        check(svn_mergeinfo_diff2, &deleted, &added,
+              from ? from : apr_hash_make(scope), to, TRUE, scope, scope);
+
+        for (apr_hash_index_t* i = apr_hash_first(scope, added); i; i = apr_hash_next(i))
+        {
+            void const* source;
+            void* value;
+            apr_hash_this(i, &source, nullptr, &value);
+            auto const* ranges = static_cast<apr_array_header_t const*>(value);
+            svn_revnum_t last = 0;
+            for (int n = 0; n < ranges->nelts; ++n)
+            {
+                svn_merge_range_t const* range = APR_ARRAY_IDX(ranges, n, svn_merge_range_t*);
+                if (range->inheritable)
+                    last = std::max(last, std::max(range->start, range->end));
+            }
+            if (last > 0)
+                result.push_back(merge{ c.path, static_cast<char const*>(source), last });
+        }
+    }
+}
+
+std::string svn::node_id(revision const& rev, char const* svn_path)
+{
+    AprScratch scope(rev.scratch);
+    svn_fs_id_t const* id = call(svn_fs_node_id, rev.fs_root, svn_path, scope);
+    return svn_fs_unparse_id(id, scope)->data;
+}
+
+std::shared_ptr<directory_cache::listing const> svn::list_directory(
+    revision const& rev, char const* svn_path, std::string const& node_id,
+    directory_cache& cache)
+{
+    if (auto cached = cache.find(node_id))
+        return cached;
+
+    AprScratch dir_pool(rev.scratch);
+    return cache.insert(node_id, read_directory(rev.fs_root, svn_path, dir_pool));
+}
+
+directory_cache::listing svn::read_directory(
+    svn_fs_root_t* fs_root, char const* svn_path, apr_pool_t* pool)
+{
+    apr_hash_t *entries = call(svn_fs_dir_entries, fs_root, svn_path, pool);
+    directory_cache::listing result;
+    for (apr_hash_index_t *i = apr_hash_first(pool, entries); i; i = apr_hash_next(i))
+    {
+        void* value;
+        apr_hash_this(i, nullptr, nullptr, &value);
+        auto const* dirent = static_cast<svn_fs_dirent_t const*>(value);
+        bool const is_dir = dirent->kind == svn_node_dir;
+        char const* const id = svn_fs_unparse_id(dirent->id, pool)->data;
+        directory_cache::entry e = { 
+            dirent->name, is_dir, is_dir ? id : "", directory_cache::location_of(id) };
+        result.push_back(std::move(e));
+    }
+    return result;
 }
@@ -21,12 +21,22 @@
 
 #include "apr_pool.hpp"
 #include "authors.hpp"
+#include "changes_index.hpp"
+#include "directory_cache.hpp"
+#include "fsfs_readahead.hpp"
+#include "io_ring.hpp"
+#include "mergeinfo_index.hpp"
+#include "svn_call_stats.hpp"
 #include "svn_error.hpp"
 
 #include <svn_fs.h>
 #include <svn_repos.h>
 
+#include <chrono>
+#include <memory>
 #include <string>
+#include <thread>
+#include <vector>
 
 class Authors;
 
@@ -39,36 +49,185 @@ class svn
 
     int latest_revision() const;
 
-    // Call an SVN function with proper error reporting
+    // Open the repository at repo_path, with libsvn_fs's caches
+    // configured by --svn-cache-megabytes and its companions.  Every
+    // view of the repository, on whatever thread, is opened this way.
+    static svn_repos_t* open_repository(std::string const& repo_path, apr_pool_t* pool);
+
+    // Print the use made of libsvn_fs's caches
+    static void report_cache();
+
+    // The repository's UUID
+    std::string uuid() const;
+
+    // Call an SVN function with proper error reporting, counted by
+    // --svn-call-stats, and slowed by --svn-latency
     template <class R, class...P, class...A>
     static R call(svn_error_t* (*f)(R*, P...), A const& ...args)
     {
         R result;
-        check_svn(f(&result, args...));
+        svn_error_t* err;
+        {
+            svn_call_stats::timer t(f);
+            inject_latency();
+            err = f(&result, args...);
+        }
+        check_svn(err);
         return result;
     }
 
-    struct revision
+    // Likewise, for an SVN function with no result of its own
+    template <class...P, class...A>
+    static void check(svn_error_t* (*f)(P...), A const& ...args)
+    {
+        svn_error_t* err;
+        {
+            svn_call_stats::timer t(f);
+            inject_latency();
+            err = f(args...);
+        }
+        check_svn(err);
+    }
+
+    // With --svn-latency, wait before a call as long as a slow disk
+    // would keep libsvn_fs waiting for the reads it makes, so that
+    // what overlaps reading SVN can be benchmarked on a fast one
+    static void inject_latency()
+    {
+        if (options.svn_latency > 0)
+            std::this_thread::sleep_for(std::chrono::microseconds(options.svn_latency));
+    }
+
+    // A path changed in a revision, as reported by svn_fs_paths_changed2
+    struct change
+    {
+        std::string path;
+        svn_fs_path_change_kind_t change_kind;
+        svn_node_kind_t node_kind;
+        bool text_mod;
+        std::string copyfrom_path; // empty unless known to be a copy
+        svn_revnum_t copyfrom_rev;
+    };
+
+    // A merge recorded by adding to the svn:mergeinfo of the
+    // directory at path: the revisions of source up to revision were
+    // merged into it
+    struct merge
+    {
+        std::string path;
+        std::string source;
+        svn_revnum_t revision;
+    };
+
+    // The parts of a revision that don't depend on an APR pool, and
+    // so can be read ahead on another thread
+    struct revision_info
+    {
+        std::string const* committer; // from Authors::committer
+        unsigned int epoch;
+        std::string log_message;
+        std::vector<change> changes; // sorted by path string
+    };
+
+    struct revision : revision_info
     {
         revision(svn const& repo, int revnum);
 
+        // The same revision as rev, without its changes, but read
+        // through the calling thread's svn_handle, so that threads
+        // can read it at once.  Its root is the handle's, and lasts
+        // while the thread reads no more than a few other revisions.
+        revision(svn const& repo, revision const& rev);
+
         AprPool pool;
+        // For what is needed only while one file or directory is
+        // looked at, lent through AprScratch
+        mutable AprPool scratch;
         svn_fs_root_t* fs_root;
         int revnum;
-        std::string author;
-        unsigned int epoch;
-        std::string log_message;
     };
     
     revision operator[](int revnum) const
     {
         return revision(*this, revnum);
     }
+
+    // The revision property name of revnum, e.g. "svn:author", read
+    // without the rest of the revision, or empty if it has none
+    std::string revision_property(int revnum, char const* name) const;
+
+    // The paths changed by revnum, as svn::revision would have them,
+    // but read without its revision properties, and from the index
+    // without even opening its root if the index has them
+    void changes(int revnum, std::vector<change>& result) const;
+
+    // The same, but safe to call on several threads at once: what the
+    // index lacks is read through the calling thread's svn_handle
+    void changes_on_thread(int revnum, std::vector<change>& result) const;
+
+    // The merges recorded by revnum in svn:mergeinfo, read from the
+    // index if it has them.  Revisions between the last indexed and
+    // revnum are indexed first, so that the index has no gaps.
+    void merges(int revnum, std::vector<merge>& result) const;
+
+    // The node-revision ID of what is at svn_path in rev
+    static std::string node_id(revision const& rev, char const* svn_path);
+
+    // The listing of the directory at svn_path in rev, whose
+    // node-revision ID is node_id, read only if it isn't in cache
+    static std::shared_ptr<directory_cache::listing const> list_directory(
+        revision const& rev, char const* svn_path, std::string const& node_id,
+        directory_cache& cache);
+
+    // The listing of the directory at svn_path under fs_root, read
+    // from SVN with scratch memory from pool
+    static directory_cache::listing read_directory(
+        svn_fs_root_t* fs_root, char const* svn_path, apr_pool_t* pool);
+
+    // Read the revisions first..last in order on a background
+    // thread, staying at most depth revisions ahead of the ones
+    // requested through operator[].
+    void prefetch(int first, int last, unsigned depth);
+
+    // Have the kernel read the repository's files up to distance
+    // revisions ahead of those requested through operator[], and
+    // drop those drop_behind revisions behind unless it's zero.
+    // Does nothing unless the repository is FSFS.
+    void read_ahead(int distance, int drop_behind);
     
-    static AprPool global_pool;
+    // Each svn has a pool of its own, so that separate svn objects
+    // can be used on separate threads
+    AprPool pool;
+    // The pools of each revision, reused from one to the next
+    mutable AprPoolRecycler revision_pools;
+    std::string repo_path;
     svn_repos_t* repos;
     svn_fs_t* fs;
     Authors authors;
+
+    // The paths changed by the revisions read so far, and by those
+    // read by earlier runs, which are not asked of SVN again
+    mutable changes_index<change> indexed_changes;
+
+    // Likewise, the merges recorded by the revisions, with
+    // --svn-mergeinfo
+    mutable mergeinfo_index<merge> indexed_merges;
+
+    // Store the changes and merges read from SVN for later runs
+    void save_changes() const
+    {
+        indexed_changes.save();
+        indexed_merges.save();
+    }
+
+ private:
+    std::string revision_date(int revnum) const;
+    void read_merges(int revnum, std::vector<merge>& result) const;
+
+    struct revision_prefetcher;
+    std::unique_ptr<revision_prefetcher> prefetcher;
+    std::unique_ptr<io_ring> readahead_ring; // with --io-uring
+    std::unique_ptr<fsfs_readahead> readahead;
 };
 
 #endif
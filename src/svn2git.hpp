@@ -0,0 +1,28 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef SVN2GIT_DWA20131125_HPP
+# define SVN2GIT_DWA20131125_HPP
+
+// The API of libsvn2git, the library svn2git itself is built on, for
+// tools that would otherwise start svn2git, or parse the rules, once
+// for every question they ask:
+//
+//   Ruleset                the rules, parsed once, and their matcher:
+//                          Ruleset::matcher().longest_match() answers
+//                          what --match-path does
+//   answer_rule_query      any query --match-stdin answers
+//   svn                    a view of an SVN repository
+//   importer               the conversion of SVN revisions to Git
+//
+// Each component consults the one global Options, which the library
+// defines with every member zero; set those wanted before making any
+// of them.  APR is initialized when the library is loaded.
+# include "options.hpp"
+# include "log.hpp"
+# include "ruleset.hpp"
+# include "rule_queries.hpp"
+# include "svn.hpp"
+# include "importer.hpp"
+
+#endif // SVN2GIT_DWA20131125_HPP
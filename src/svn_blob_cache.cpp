@@ -0,0 +1,198 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#include "svn_blob_cache.hpp"
+#include "log.hpp"
+#include "rules_cache.hpp"
+#include "sha1.hpp"
+#include "svn.hpp"
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/filesystem.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+#include <unistd.h>
+
+namespace
+{
+    char const magic[8] = { '2', 'b', 'l', 'o', 'b', 'c', '0', '1' };
+    std::size_t const header_size = sizeof(magic) + 2 * sizeof(std::uint64_t);
+    std::size_t const slot_size = 2 * object_id::size;
+
+    object_id digest_of(std::string const& svn_content_key)
+    {
+        return object_id(sha1().update(svn_content_key).digest());
+    }
+
+    // The slot a key's probing starts from
+    std::size_t first_slot(object_id const& key, std::size_t slot_count)
+    {
+        std::uint64_t start;
+        std::memcpy(&start, key.data(), sizeof(start));
+        return std::size_t(start) & (slot_count - 1);
+    }
+
+    // The slots of the table in the file mapped at data, or null if
+    // it's no such table
+    unsigned char const* table_of(char const* data, std::size_t size, std::size_t& slot_count)
+    {
+        std::uint64_t counts[2];
+        if (size < header_size || std::memcmp(data, magic, sizeof(magic)) != 0)
+            return nullptr;
+        std::memcpy(counts, data + sizeof(magic), sizeof(counts));
+        slot_count = std::size_t(counts[0]);
+        if (slot_count == 0 || (slot_count & (slot_count - 1)) != 0 || counts[1] >= slot_count
+            || size != header_size + slot_count * slot_size)
+        {
+            return nullptr;
+        }
+        return reinterpret_cast<unsigned char const*>(data + header_size);
+    }
+
+    // The blob recorded for key among slots, or the null id
+    object_id lookup(unsigned char const* slots, std::size_t slot_count, object_id const& key)
+    {
+        object_id const none;
+        for (std::size_t i = first_slot(key, slot_count);; i = (i + 1) & (slot_count - 1))
+        {
+            unsigned char const* const slot = slots + i * slot_size;
+            if (std::memcmp(slot, none.data(), object_id::size) == 0)
+                return none;
+            if (std::memcmp(slot, key.data(), object_id::size) == 0)
+            {
+                object_id::bytes_type sha;
+                std::memcpy(sha.data(), slot + object_id::size, object_id::size);
+                return object_id(sha);
+            }
+        }
+    }
+}
+
+svn_blob_cache::svn_blob_cache(svn const& repo)
+    : slots(nullptr), slot_count(0), failed(false)
+{
+    boost::filesystem::path const dir = rules_cache::directory();
+    if (dir.empty())
+        return;
+    filename_ = (dir / (repo.uuid() + ".blobs")).string();
+
+    boost::system::error_code ec;
+    if (!boost::filesystem::exists(filename_, ec))
+        return;
+    try
+    {
+        file.open(filename_);
+        slots = table_of(file.data(), file.size(), slot_count);
+        if (!slots)
+        {
+            Log::warn() << filename_ << " is not a blob cache; ignoring it" << std::endl;
+            file.close();
+        }
+    }
+    catch (std::exception const& e)
+    {
+        Log::warn() << "Couldn't read the blob cache: " << e.what() << std::endl;
+        slots = nullptr;
+    }
+}
+
+bool svn_blob_cache::cacheable(std::string const& svn_content_key)
+{
+    return boost::starts_with(svn_content_key, "sha1:")
+        && !boost::ends_with(svn_content_key, "|lfs");
+}
+
+object_id svn_blob_cache::find(std::string const& svn_content_key) const
+{
+    if (!slots || !cacheable(svn_content_key))
+        return object_id();
+    return lookup(slots, slot_count, digest_of(svn_content_key));
+}
+
+void svn_blob_cache::add(std::string const& svn_content_key, std::string const& sha)
+{
+    if (filename_.empty() || !cacheable(svn_content_key))
+        return;
+    object_id const key = digest_of(svn_content_key);
+    object_id const id = object_id::from_hex(sha);
+    if (slots && lookup(slots, slot_count, key) == id)
+        return;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!failed)
+        added[key] = id;
+}
+
+void svn_blob_cache::save()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (filename_.empty() || failed || added.empty())
+        return;
+    try
+    {
+        // Whatever the file holds now, and then what was added
+        std::unordered_map<object_id, object_id> entries;
+        boost::system::error_code ec;
+        if (boost::filesystem::exists(filename_, ec))
+        {
+            boost::iostreams::mapped_file_source current(filename_);
+            std::size_t count = 0;
+            if (unsigned char const* s = table_of(current.data(), current.size(), count))
+            {
+                entries.reserve(count / 2 + added.size());
+                object_id::bytes_type key, sha;
+                for (std::size_t i = 0; i < count; ++i, s += slot_size)
+                {
+                    std::memcpy(key.data(), s, object_id::size);
+                    std::memcpy(sha.data(), s + object_id::size, object_id::size);
+                    if (!object_id(key).is_null())
+                        entries.emplace(object_id(key), object_id(sha));
+                }
+            }
+        }
+        for (auto const& e : added)
+            entries[e.first] = e.second;
+
+        // At most half full, so that probes stay short
+        std::size_t count = 1024;
+        while (count < 2 * entries.size())
+            count *= 2;
+        std::vector<unsigned char> table(count * slot_size);
+        for (auto const& e : entries)
+        {
+            std::size_t i = first_slot(e.first, count);
+            while (!std::all_of(&table[i * slot_size], &table[i * slot_size] + object_id::size,
+                                [](unsigned char b) { return b == 0; }))
+            {
+                i = (i + 1) & (count - 1);
+            }
+            std::memcpy(&table[i * slot_size], e.first.data(), object_id::size);
+            std::memcpy(&table[i * slot_size] + object_id::size, e.second.data(), object_id::size);
+        }
+
+        boost::filesystem::create_directories(boost::filesystem::path(filename_).parent_path());
+        std::string const tmp = filename_ + ".tmp" + std::to_string(::getpid());
+        {
+            std::ofstream out(tmp.c_str(), std::ios::binary | std::ios::trunc);
+            std::uint64_t const counts[2] = { count, entries.size() };
+            out.write(magic, sizeof(magic));
+            out.write(reinterpret_cast<char const*>(counts), sizeof(counts));
+            out.write(reinterpret_cast<char const*>(table.data()), table.size());
+            out.close();
+            if (!out)
+                throw std::runtime_error("Couldn't write " + tmp);
+        }
+        boost::filesystem::rename(tmp, filename_);
+        added.clear();
+    }
+    catch (std::exception const& e)
+    {
+        Log::warn() << "Couldn't keep the blob cache: " << e.what() << std::endl;
+        failed = true;
+    }
+}
@@ -0,0 +1,71 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef SVN_BLOB_CACHE_DWA20131201_HPP
+# define SVN_BLOB_CACHE_DWA20131201_HPP
+
+# include "object_id.hpp"
+
+# include <boost/iostreams/device/mapped_file.hpp>
+# include <cstddef>
+# include <mutex>
+# include <string>
+# include <unordered_map>
+
+class svn;
+
+// With --blob-cache, the Git name of the blob made of each SVN file
+// content written by this or an earlier run, so that a run converting
+// the same history again, e.g. after the rules are fixed, can refer to
+// a blob already in the repository's object store without reading the
+// content from SVN.
+//
+// The names are kept in the cache directory, beside the SVN changes
+// index, in a file named for the repository's UUID.  It's a hash
+// table read in place from a memory mapping: after a 24-byte header,
+// of the magic, the number of slots, which is a power of two, and the
+// number of entries, each slot holds the SHA-1 of a content key and
+// the name of its blob, or zeros.  A key is found by probing onward
+// from the slot its SHA-1 begins with.  Only contents keyed by the
+// SHA-1 SVN keeps of them are cached, since a node-revision ID means
+// nothing to another repository with the same UUID, e.g. a mirror.
+//
+// Names added are kept aside until save, which merges them with the
+// file as it is then, in case another run has saved it since, and
+// replaces it.
+class svn_blob_cache
+{
+ public:
+    explicit svn_blob_cache(svn const& repo);
+
+    // The name recorded for the blob of the content whose key, as
+    // the importer gives it, is svn_content_key, or the null id
+    object_id find(std::string const& svn_content_key) const;
+
+    // Record that the blob of that content is named sha
+    void add(std::string const& svn_content_key, std::string const& sha);
+
+    // Write what was added to the file.  Failure only costs a later
+    // run reading the contents again, so it is logged, and saving is
+    // given up.
+    void save();
+
+    std::string const& filename() const { return filename_; }
+
+ private:
+    svn_blob_cache(svn_blob_cache const&);
+    svn_blob_cache& operator=(svn_blob_cache const&);
+
+    static bool cacheable(std::string const& svn_content_key);
+
+    std::string filename_;      // empty if there's no cache directory
+    boost::iostreams::mapped_file_source file; // closed if there's none
+    unsigned char const* slots;
+    std::size_t slot_count;
+
+    std::mutex mutex;           // guards everything below
+    std::unordered_map<object_id, object_id> added;
+    bool failed;                // true once saving is given up
+};
+
+#endif // SVN_BLOB_CACHE_DWA20131201_HPP
@@ -0,0 +1,121 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#include "svn_call_stats.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <dlfcn.h>
+
+namespace
+{
+    // Latencies are counted in buckets of powers of two nanoseconds:
+    // bucket i holds those of less than 2^(i+1), and the last, those
+    // of 2^(buckets-1) nanoseconds (about 8.6 seconds) or more.
+    int const buckets = 34;
+
+    struct function_stats
+    {
+        function_stats() : calls(0), nanoseconds(0), max(0), histogram() {}
+
+        std::uint64_t calls;
+        std::uint64_t nanoseconds;
+        std::uint64_t max;
+        std::uint64_t histogram[buckets];
+    };
+
+    // The calls are counted under a lock: the few tens of nanoseconds
+    // it costs are nothing beside the microseconds of even the
+    // quickest calls to libsvn_fs
+    std::mutex mutex;
+    std::unordered_map<void (*)(), function_stats> all_stats;
+
+    int bucket(std::uint64_t nanoseconds)
+    {
+        int b = 0;
+        while (nanoseconds >>= 1)
+            ++b;
+        return std::min(b, buckets - 1);
+    }
+
+    // The latency below which the given fraction of s's calls fall,
+    // to within the width of its bucket
+    double percentile_microseconds(function_stats const& s, double fraction)
+    {
+        std::uint64_t const rank = std::uint64_t(fraction * s.calls);
+        std::uint64_t seen = 0;
+        for (int b = 0; b < buckets; ++b)
+        {
+            seen += s.histogram[b];
+            if (seen > rank)
+                return std::min<double>(std::uint64_t(1) << (b + 1), s.max) / 1000;
+        }
+        return s.max / 1000.0;
+    }
+
+    // The name of f, as the dynamic linker knows it, or its address
+    std::string name(void (*f)())
+    {
+        Dl_info info;
+        if (::dladdr(reinterpret_cast<void*>(f), &info) && info.dli_sname)
+            return info.dli_sname;
+        std::ostringstream address;
+        address << reinterpret_cast<void*>(f);
+        return address.str();
+    }
+}
+
+void svn_call_stats::record(void (*f)(), std::chrono::steady_clock::duration latency)
+{
+    std::uint64_t const ns = std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count();
+    std::lock_guard<std::mutex> lock(mutex);
+    function_stats& s = all_stats[f];
+    ++s.calls;
+    s.nanoseconds += ns;
+    s.max = std::max(s.max, ns);
+    ++s.histogram[bucket(ns)];
+}
+
+void svn_call_stats::report()
+{
+    if (!options.svn_call_stats)
+        return;
+
+    std::vector<std::pair<std::string, function_stats> > sorted;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto const& kv : all_stats)
+            sorted.emplace_back(name(kv.first), kv.second);
+    }
+    std::sort(
+        sorted.begin(), sorted.end(),
+        [](std::pair<std::string, function_stats> const& x, std::pair<std::string, function_stats> const& y)
+        { return x.second.nanoseconds > y.second.nanoseconds; });
+
+    std::cout << "SVN calls (latencies in microseconds, percentiles to within a factor of 2):\n"
+              << std::setw(32) << std::left << "function" << std::right
+              << std::setw(12) << "calls" << std::setw(12) << "seconds" << std::setw(10) << "mean"
+              << std::setw(10) << "p50" << std::setw(10) << "p90" << std::setw(10) << "p99"
+              << std::setw(12) << "max" << '\n';
+    for (auto const& x : sorted)
+    {
+        function_stats const& s = x.second;
+        std::cout << std::setw(32) << std::left << x.first << std::right
+                  << std::setw(12) << s.calls << std::fixed << std::setprecision(3)
+                  << std::setw(12) << s.nanoseconds / 1e9 << std::setprecision(1)
+                  << std::setw(10) << s.nanoseconds / 1e3 / s.calls
+                  << std::setw(10) << percentile_microseconds(s, 0.5)
+                  << std::setw(10) << percentile_microseconds(s, 0.9)
+                  << std::setw(10) << percentile_microseconds(s, 0.99)
+                  << std::setw(12) << s.max / 1e3 << '\n';
+    }
+    std::cout << std::flush;
+}
@@ -0,0 +1,51 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef SVN_CALL_STATS_DWA20131118_HPP
+# define SVN_CALL_STATS_DWA20131118_HPP
+
+# include "options.hpp"
+
+# include <chrono>
+
+// How often each libsvn function called through svn::call and
+// svn::check is called, and how long the calls take, enabled by
+// --svn-call-stats.  The functions are told apart by address, and
+// named only when reported.  Unlike profile, this may be used from
+// any thread.
+struct svn_call_stats
+{
+    // Charges the time until destruction to a call of the function f
+    struct timer
+    {
+        template <class F>
+        explicit timer(F* f)
+            : f(options.svn_call_stats ? reinterpret_cast<void (*)()>(f) : nullptr)
+        {
+            if (this->f)
+                start = std::chrono::steady_clock::now();
+        }
+
+        ~timer()
+        {
+            if (f)
+                record(f, std::chrono::steady_clock::now() - start);
+        }
+
+        timer(timer const&) = delete;
+        void operator=(timer const&) = delete;
+
+     private:
+        void (*f)();             // null unless counting
+        std::chrono::steady_clock::time_point start;
+    };
+
+    // Print each function's calls, total time and the distribution of
+    // its latencies, those taking the most time in all first
+    static void report();
+
+ private:
+    static void record(void (*f)(), std::chrono::steady_clock::duration latency);
+};
+
+#endif // SVN_CALL_STATS_DWA20131118_HPP
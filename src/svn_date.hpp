@@ -0,0 +1,68 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef SVN_DATE_DWA20131104_HPP
+# define SVN_DATE_DWA20131104_HPP
+
+# include <boost/date_time/posix_time/time_parsers.hpp>
+# include <boost/date_time/posix_time/posix_time_types.hpp>
+# include <string>
+
+namespace svn_date_detail
+{
+    // The value of the count decimal digits at s, or -1 if they
+    // aren't all digits
+    inline long digits(char const* s, int count)
+    {
+        long n = 0;
+        for (int i = 0; i < count; ++i)
+        {
+            if (s[i] < '0' || s[i] > '9')
+                return -1;
+            n = n * 10 + (s[i] - '0');
+        }
+        return n;
+    }
+
+    // Days from 1970-01-01 to the given date of the proleptic
+    // Gregorian calendar
+    inline long days_from_civil(long y, long m, long d)
+    {
+        y -= m <= 2;
+        long const era = (y >= 0 ? y : y - 399) / 400;
+        long const yoe = y - era * 400;
+        long const doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+        long const doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+        return era * 146097 + doe - 719468;
+    }
+}
+
+// The whole seconds since the Unix epoch of the time in an svn:date
+// property.  SVN writes these as "YYYY-MM-DDTHH:MM:SS.uuuuuuZ", which
+// is read directly; anything else is left to Boost.Date_Time.
+inline unsigned int svn_date_epoch(std::string const& date)
+{
+    using svn_date_detail::digits;
+    char const* const s = date.c_str();
+    if (date.size() >= 20 && s[4] == '-' && s[7] == '-' && s[10] == 'T'
+        && s[13] == ':' && s[16] == ':' && s[date.size() - 1] == 'Z')
+    {
+        long const year = digits(s, 4), month = digits(s + 5, 2), day = digits(s + 8, 2);
+        long const hour = digits(s + 11, 2), minute = digits(s + 14, 2), second = digits(s + 17, 2);
+        if (year >= 1970 && month >= 1 && month <= 12 && day >= 1 && day <= 31
+            && hour >= 0 && hour < 24 && minute >= 0 && minute < 60 && second >= 0 && second < 60)
+        {
+            return (unsigned int)(
+                svn_date_detail::days_from_civil(year, month, day) * 86400
+                + hour * 3600 + minute * 60 + second);
+        }
+    }
+
+    namespace dt = boost::date_time;
+    namespace pt = boost::posix_time;
+    pt::ptime ptime = dt::parse_delimited_time<pt::ptime>(date, 'T');
+    static pt::ptime const epoch_(boost::gregorian::date(1970, 1, 1));
+    return (unsigned int)(ptime - epoch_).total_seconds();
+}
+
+#endif // SVN_DATE_DWA20131104_HPP
@@ -0,0 +1,214 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// svn_repos_load_fs4 serves every Subversion release this builds
+// with, though later ones deprecate it
+#define SVN_DEPRECATED
+
+#include "svn_dump_loader.hpp"
+#include "apr_pool.hpp"
+#include "log.hpp"
+#include "svn_error.hpp"
+
+#include <apr_hash.h>
+#include <svn_fs.h>
+#include <svn_io.h>
+#include <svn_repos.h>
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/device/file_descriptor.hpp>
+#include <boost/process.hpp>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+
+namespace fs = boost::filesystem;
+
+namespace
+{
+    // The program that decompresses the dump at dump_path, if any
+    std::string decompressor(std::string const& dump_path)
+    {
+        using boost::algorithm::ends_with;
+        if (ends_with(dump_path, ".gz"))
+            return "gzip";
+        if (ends_with(dump_path, ".bz2"))
+            return "bzip2";
+        if (ends_with(dump_path, ".xz"))
+            return "xz";
+        if (ends_with(dump_path, ".zst"))
+            return "zstd";
+        return std::string();
+    }
+
+    // The repository at repo_path, opened for loading, or created if
+    // there's none
+    svn_repos_t* open_for_loading(std::string const& repo_path, apr_pool_t* pool)
+    {
+        apr_hash_t* fs_config = apr_hash_make(pool);
+#ifdef SVN_FS_CONFIG_NO_FLUSH_TO_DISK
+        apr_hash_set(fs_config, SVN_FS_CONFIG_NO_FLUSH_TO_DISK, APR_HASH_KEY_STRING, "1");
+#endif
+        svn_repos_t* repos;
+        if (!fs::exists(repo_path))
+        {
+            Log::info() << "creating the SVN repository " << repo_path << std::endl;
+            check_svn(svn_repos_create(
+                &repos, repo_path.c_str(), nullptr, nullptr, nullptr, fs_config, pool));
+        }
+        else
+        {
+            check_svn(svn_repos_open2(&repos, repo_path.c_str(), fs_config, pool));
+        }
+        return repos;
+    }
+}
+
+svn_dump_loader::svn_dump_loader(std::string const& dump_path, std::string const& repo_path)
+    : loaded(0), done(false), stopping(false)
+{
+    // The repository is made here, so it can be opened as soon as
+    // this returns
+    int start;
+    {
+        AprPool pool;
+        svn_revnum_t youngest;
+        check_svn(svn_fs_youngest_rev(
+                      &youngest, svn_repos_fs(open_for_loading(repo_path, pool.data())), pool.data()));
+        loaded = int(youngest);
+        start = youngest > 0 ? int(youngest) + 1 : 0;
+    }
+    thread = std::thread(&svn_dump_loader::load, this, dump_path, repo_path, start);
+}
+
+svn_dump_loader::~svn_dump_loader()
+{
+    stopping = true;
+    thread.join();
+}
+
+int svn_dump_loader::wait_for(int revnum)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    progress.wait(lock, [&]{ return loaded >= revnum || done; });
+    if (error)
+        std::rethrow_exception(error);
+    return loaded;
+}
+
+int svn_dump_loader::finish()
+{
+    return wait_for(std::numeric_limits<int>::max());
+}
+
+void svn_dump_loader::load(std::string const& dump_path, std::string const& repo_path, int start)
+{
+    std::unique_ptr<boost::process::child> child;
+    try
+    {
+        AprPool pool;
+        svn_repos_t* const repos = open_for_loading(repo_path, pool.data());
+
+        svn_stream_t* dump;
+        std::string const program = decompressor(dump_path);
+        if (dump_path == "-")
+        {
+            check_svn(svn_stream_for_stdin(&dump, pool.data()));
+        }
+        else if (program.empty())
+        {
+            check_svn(svn_stream_open_readonly(&dump, dump_path.c_str(), pool.data(), pool.data()));
+        }
+        else
+        {
+            // Our end of the pipe is close-on-exec, so that other
+            // children don't hold it open
+            int fds[2];
+            if (::pipe2(fds, O_CLOEXEC) != 0)
+                throw std::runtime_error("Couldn't create a pipe");
+            {
+                boost::iostreams::file_descriptor_sink sink(fds[1], boost::iostreams::close_handle);
+                child.reset(new boost::process::child(boost::process::execute(
+                    boost::process::initializers::run_exe(boost::process::search_path(program)),
+                    boost::process::initializers::set_args(
+                        std::vector<std::string>({ program, "-dc", dump_path })),
+                    boost::process::initializers::bind_stdout(sink),
+                    boost::process::initializers::throw_on_error())));
+            }
+            apr_file_t* file = nullptr;
+            apr_os_file_t fd = fds[0];
+            if (apr_os_file_put(&file, &fd, APR_FOPEN_READ, pool.data()) != APR_SUCCESS)
+                throw std::runtime_error("Couldn't read the output of " + program);
+            dump = svn_stream_from_aprfile2(file, FALSE, pool.data());
+        }
+
+        Log::info() << "loading " << dump_path << " into " << repo_path
+                    << (start > 0 ? " from r" + std::to_string(start) : std::string()) << std::endl;
+        check_svn(svn_repos_load_fs4(
+            repos, dump,
+            start > 0 ? svn_revnum_t(start) : SVN_INVALID_REVNUM,
+            start > 0 ? std::numeric_limits<svn_revnum_t>::max() : SVN_INVALID_REVNUM,
+            svn_repos_load_uuid_default, nullptr, FALSE, FALSE, FALSE,
+            &svn_dump_loader::notify, this, &svn_dump_loader::cancel, this, pool.data()));
+        check_svn(svn_stream_close(dump));
+
+        if (child)
+        {
+            int const status = boost::process::wait_for_exit(*child);
+            child.reset();
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+                throw std::runtime_error(program + " failed to decompress " + dump_path);
+        }
+        Log::info() << "loaded " << dump_path << " to r" << loaded << std::endl;
+    }
+    catch (...)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!error)
+            error = std::current_exception();
+    }
+    if (child)
+    {
+        ::kill(child->pid, SIGTERM);
+        boost::process::wait_for_exit(*child);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    done = true;
+    progress.notify_all();
+}
+
+// Note each revision committed.  The rules name revisions as SVN
+// does, so the repository must number them as the dump does.
+void svn_dump_loader::committed(long dump_revnum, long new_revnum)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (dump_revnum != new_revnum && !error)
+    {
+        error = std::make_exception_ptr(std::runtime_error(
+            "r" + std::to_string(dump_revnum) + " of the dump was loaded as r"
+            + std::to_string(new_revnum) + "; the repository doesn't match the dump"));
+        stopping = true;
+    }
+    loaded = int(new_revnum);
+    progress.notify_all();
+}
+
+void svn_dump_loader::notify(void* baton, svn_repos_notify_t const* notify, apr_pool_t*)
+{
+    if (notify->action == svn_repos_notify_load_txn_committed)
+        static_cast<svn_dump_loader*>(baton)->committed(notify->old_revision, notify->new_revision);
+}
+
+svn_error_t* svn_dump_loader::cancel(void* baton)
+{
+    return static_cast<svn_dump_loader*>(baton)->stopping
+        ? svn_error_create(SVN_ERR_CANCELLED, nullptr, "stopped loading the SVN dump")
+        : SVN_NO_ERROR;
+}
@@ -0,0 +1,56 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef SVN_DUMP_LOADER_DWA20131121_HPP
+# define SVN_DUMP_LOADER_DWA20131121_HPP
+
+# include <atomic>
+# include <condition_variable>
+# include <exception>
+# include <mutex>
+# include <string>
+# include <thread>
+
+// Loads an "svnadmin dump" or "svnrdump" stream into the repository
+// at repo_path, created if need be, on a background thread, so that
+// the conversion reads each revision as soon as it's committed,
+// instead of after the whole dump has been loaded; see --svn-dump.
+// A dump whose name ends in .gz, .bz2, .xz or .zst is decompressed by
+// gzip, bzip2, xz or zstd on the way.  The revisions the repository
+// already has, e.g. from an earlier run, are skipped, so the dump
+// must number its revisions as the repository does.  The repository
+// is written without flushing it to disk, as it can be loaded again.
+class svn_dump_loader
+{
+ public:
+    svn_dump_loader(std::string const& dump_path, std::string const& repo_path);
+
+    // Stops loading, leaving the revisions loaded so far
+    ~svn_dump_loader();
+
+    // Wait until revnum is loaded or the whole dump is, and return
+    // the latest revision loaded.  Errors loading the dump are
+    // rethrown here.
+    int wait_for(int revnum);
+
+    // Wait until the whole dump is loaded, and return its latest
+    // revision
+    int finish();
+
+ private:
+    void load(std::string const& dump_path, std::string const& repo_path, int start);
+    void committed(long dump_revnum, long new_revnum);
+
+    static void notify(void* baton, struct svn_repos_notify_t const* notify, struct apr_pool_t*);
+    static struct svn_error_t* cancel(void* baton);
+
+    std::mutex mutex;
+    std::condition_variable progress;
+    int loaded;                 // the latest revision loaded
+    bool done;
+    std::exception_ptr error;
+    std::atomic<bool> stopping;
+    std::thread thread;
+};
+
+#endif // SVN_DUMP_LOADER_DWA20131121_HPP
@@ -0,0 +1,51 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// See svn.cpp
+#define SVN_DEPRECATED
+
+#include "svn_handle.hpp"
+#include "svn.hpp"
+
+#include <svn_repos.h>
+
+#include <map>
+#include <memory>
+
+svn_handle& svn_handle::of_thread(std::string const& repo_path)
+{
+    thread_local std::map<std::string, std::unique_ptr<svn_handle> > handles;
+    std::unique_ptr<svn_handle>& h = handles[repo_path];
+    if (!h)
+        h.reset(new svn_handle(repo_path));
+    return *h;
+}
+
+svn_handle::svn_handle(std::string const& repo_path)
+    : fs_(svn_repos_fs(svn::open_repository(repo_path, pool.data())))
+{}
+
+svn_fs_root_t* svn_handle::revision_root(svn_revnum_t revnum)
+{
+    for (auto r = roots.begin(); r != roots.end(); ++r)
+    {
+        if (r->revnum != revnum)
+            continue;
+        if (r != roots.begin())
+        {
+            root found = std::move(*r);
+            roots.erase(r);
+            roots.push_front(std::move(found));
+        }
+        return roots.front().fs_root;
+    }
+
+    AprPool root_pool = pool.make_subpool();
+    svn_fs_root_t* const fs_root = svn::call(svn_fs_revision_root, fs_, revnum, root_pool.data());
+    if (roots.size() == root_cache_size)
+        roots.pop_back();
+    root r = { revnum, std::move(root_pool), fs_root };
+    roots.push_front(std::move(r));
+    return fs_root;
+}
@@ -0,0 +1,65 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef SVN_HANDLE_DWA20131125_HPP
+# define SVN_HANDLE_DWA20131125_HPP
+
+# include "apr_pool.hpp"
+
+# include <svn_fs.h>
+
+# include <deque>
+# include <string>
+
+// A thread's own view of an SVN repository: the svn_fs_t, the pools
+// beneath it, and the roots of the revisions it read last.  APR pools
+// and svn_fs objects can't be shared between threads, so every thread
+// that reads SVN apart from an svn object's own, e.g. the tree walkers,
+// the prefetchers and the tasks of a task_scheduler, reads through
+// the handle of_thread gives it.  The handles' caches of what they
+// read are libsvn_fs's membuffer cache, shared by the whole process.
+//
+// A handle is opened on a thread's first use of the repository, and
+// closed when the thread exits.
+class svn_handle
+{
+ public:
+    // The calling thread's handle on the repository at repo_path
+    static svn_handle& of_thread(std::string const& repo_path);
+
+    svn_fs_t* fs() const
+    {
+        return fs_;
+    }
+
+    // The root of revnum, opened unless it is among the last few
+    // asked for on this handle
+    svn_fs_root_t* revision_root(svn_revnum_t revnum);
+
+    // A new pool beneath the handle's, which it outlives, e.g. for
+    // the scratch memory of what's read
+    AprPool make_subpool() const
+    {
+        return pool.make_subpool();
+    }
+
+ private:
+    explicit svn_handle(std::string const& repo_path);
+    svn_handle(svn_handle const&);
+    svn_handle& operator=(svn_handle const&);
+
+    AprPool pool;               // outlives the roots, declared after it
+    svn_fs_t* fs_;
+
+    // Most recently used first, each in a pool of its own
+    struct root
+    {
+        svn_revnum_t revnum;
+        AprPool pool;
+        svn_fs_root_t* fs_root;
+    };
+    static std::size_t const root_cache_size = 4;
+    std::deque<root> roots;
+};
+
+#endif // SVN_HANDLE_DWA20131125_HPP
@@ -0,0 +1,347 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// svn_ra_open3 and svn_auth_get_simple_provider serve every
+// Subversion release this builds with, though later ones deprecate them
+#define SVN_DEPRECATED
+
+#include "svn_mirror.hpp"
+#include "svn.hpp"
+#include "svn_error.hpp"
+#include "apr_pool.hpp"
+#include "log.hpp"
+
+#include <svn_auth.h>
+#include <svn_config.h>
+#include <svn_delta.h>
+#include <svn_props.h>
+#include <svn_ra.h>
+#include <svn_repos.h>
+
+#include <boost/filesystem.hpp>
+#include <mutex>
+#include <stdexcept>
+
+namespace
+{
+  // The commit editor of the mirror, given the edit replayed from
+  // the remote repository.  Everything is passed through unchanged,
+  // except the sources of copies: replay names them by their paths in
+  // the repository, and the commit editor wants them as URLs.
+  struct mirror_edit
+  {
+      svn_delta_editor_t const* editor;
+      void* edit_baton;
+      char const* repos_url;
+  };
+
+  struct mirror_node
+  {
+      mirror_edit* edit;
+      void* baton;
+  };
+
+  void* wrap(mirror_edit* edit, void* baton, apr_pool_t* pool)
+  {
+      mirror_node* node = static_cast<mirror_node*>(apr_palloc(pool, sizeof(mirror_node)));
+      node->edit = edit;
+      node->baton = baton;
+      return node;
+  }
+
+  mirror_node* node(void* baton)
+  {
+      return static_cast<mirror_node*>(baton);
+  }
+
+  char const* copy_source(mirror_edit const* edit, char const* copyfrom_path, apr_pool_t* pool)
+  {
+      return copyfrom_path ? apr_pstrcat(pool, edit->repos_url, copyfrom_path, nullptr) : nullptr;
+  }
+
+  svn_error_t* set_target_revision(void* edit_baton, svn_revnum_t revision, apr_pool_t* pool)
+  {
+      mirror_edit* e = static_cast<mirror_edit*>(edit_baton);
+      return e->editor->set_target_revision(e->edit_baton, revision, pool);
+  }
+
+  svn_error_t* open_root(
+      void* edit_baton, svn_revnum_t base_revision, apr_pool_t* pool, void** root_baton)
+  {
+      mirror_edit* e = static_cast<mirror_edit*>(edit_baton);
+      void* baton;
+      SVN_ERR(e->editor->open_root(e->edit_baton, base_revision, pool, &baton));
+      *root_baton = wrap(e, baton, pool);
+      return SVN_NO_ERROR;
+  }
+
+  svn_error_t* delete_entry(
+      char const* path, svn_revnum_t revision, void* parent_baton, apr_pool_t* pool)
+  {
+      mirror_node* p = node(parent_baton);
+      return p->edit->editor->delete_entry(path, revision, p->baton, pool);
+  }
+
+  svn_error_t* add_directory(
+      char const* path, void* parent_baton, char const* copyfrom_path,
+      svn_revnum_t copyfrom_revision, apr_pool_t* pool, void** child_baton)
+  {
+      mirror_node* p = node(parent_baton);
+      void* baton;
+      SVN_ERR(p->edit->editor->add_directory(
+          path, p->baton, copy_source(p->edit, copyfrom_path, pool), copyfrom_revision,
+          pool, &baton));
+      *child_baton = wrap(p->edit, baton, pool);
+      return SVN_NO_ERROR;
+  }
+
+  svn_error_t* open_directory(
+      char const* path, void* parent_baton, svn_revnum_t base_revision,
+      apr_pool_t* pool, void** child_baton)
+  {
+      mirror_node* p = node(parent_baton);
+      void* baton;
+      SVN_ERR(p->edit->editor->open_directory(path, p->baton, base_revision, pool, &baton));
+      *child_baton = wrap(p->edit, baton, pool);
+      return SVN_NO_ERROR;
+  }
+
+  svn_error_t* change_dir_prop(
+      void* dir_baton, char const* name, svn_string_t const* value, apr_pool_t* pool)
+  {
+      mirror_node* d = node(dir_baton);
+      return d->edit->editor->change_dir_prop(d->baton, name, value, pool);
+  }
+
+  svn_error_t* close_directory(void* dir_baton, apr_pool_t* pool)
+  {
+      mirror_node* d = node(dir_baton);
+      return d->edit->editor->close_directory(d->baton, pool);
+  }
+
+  svn_error_t* absent_directory(char const* path, void* parent_baton, apr_pool_t* pool)
+  {
+      mirror_node* p = node(parent_baton);
+      return p->edit->editor->absent_directory(path, p->baton, pool);
+  }
+
+  svn_error_t* add_file(
+      char const* path, void* parent_baton, char const* copyfrom_path,
+      svn_revnum_t copyfrom_revision, apr_pool_t* pool, void** file_baton)
+  {
+      mirror_node* p = node(parent_baton);
+      void* baton;
+      SVN_ERR(p->edit->editor->add_file(
+          path, p->baton, copy_source(p->edit, copyfrom_path, pool), copyfrom_revision,
+          pool, &baton));
+      *file_baton = wrap(p->edit, baton, pool);
+      return SVN_NO_ERROR;
+  }
+
+  svn_error_t* open_file(
+      char const* path, void* parent_baton, svn_revnum_t base_revision,
+      apr_pool_t* pool, void** file_baton)
+  {
+      mirror_node* p = node(parent_baton);
+      void* baton;
+      SVN_ERR(p->edit->editor->open_file(path, p->baton, base_revision, pool, &baton));
+      *file_baton = wrap(p->edit, baton, pool);
+      return SVN_NO_ERROR;
+  }
+
+  svn_error_t* apply_textdelta(
+      void* file_baton, char const* base_checksum, apr_pool_t* pool,
+      svn_txdelta_window_handler_t* handler, void** handler_baton)
+  {
+      mirror_node* f = node(file_baton);
+      return f->edit->editor->apply_textdelta(f->baton, base_checksum, pool, handler, handler_baton);
+  }
+
+  svn_error_t* change_file_prop(
+      void* file_baton, char const* name, svn_string_t const* value, apr_pool_t* pool)
+  {
+      mirror_node* f = node(file_baton);
+      return f->edit->editor->change_file_prop(f->baton, name, value, pool);
+  }
+
+  svn_error_t* close_file(void* file_baton, char const* text_checksum, apr_pool_t* pool)
+  {
+      mirror_node* f = node(file_baton);
+      return f->edit->editor->close_file(f->baton, text_checksum, pool);
+  }
+
+  svn_error_t* absent_file(char const* path, void* parent_baton, apr_pool_t* pool)
+  {
+      mirror_node* p = node(parent_baton);
+      return p->edit->editor->absent_file(path, p->baton, pool);
+  }
+
+  svn_error_t* close_edit(void* edit_baton, apr_pool_t* pool)
+  {
+      mirror_edit* e = static_cast<mirror_edit*>(edit_baton);
+      return e->editor->close_edit(e->edit_baton, pool);
+  }
+
+  svn_error_t* abort_edit(void* edit_baton, apr_pool_t* pool)
+  {
+      mirror_edit* e = static_cast<mirror_edit*>(edit_baton);
+      return e->editor->abort_edit(e->edit_baton, pool);
+  }
+
+  svn_delta_editor_t* mirror_editor(apr_pool_t* pool)
+  {
+      svn_delta_editor_t* editor = svn_delta_default_editor(pool);
+      editor->set_target_revision = set_target_revision;
+      editor->open_root = open_root;
+      editor->delete_entry = delete_entry;
+      editor->add_directory = add_directory;
+      editor->open_directory = open_directory;
+      editor->change_dir_prop = change_dir_prop;
+      editor->close_directory = close_directory;
+      editor->absent_directory = absent_directory;
+      editor->add_file = add_file;
+      editor->open_file = open_file;
+      editor->apply_textdelta = apply_textdelta;
+      editor->change_file_prop = change_file_prop;
+      editor->close_file = close_file;
+      editor->absent_file = absent_file;
+      editor->close_edit = close_edit;
+      editor->abort_edit = abort_edit;
+      return editor;
+  }
+
+  // What the replay of a range of revisions needs to commit each
+  struct replay_state
+  {
+      svn_repos_t* repos;
+      char const* repos_url;
+      svn_revnum_t committed;
+  };
+
+  svn_error_t* record_commit(svn_commit_info_t const* info, void* baton, apr_pool_t*)
+  {
+      static_cast<replay_state*>(baton)->committed = info->revision;
+      return SVN_NO_ERROR;
+  }
+
+  // Start committing the next revision to the mirror, with the revision
+  // properties it has in the remote repository
+  svn_error_t* start_revision(
+      svn_revnum_t, void* replay_baton, svn_delta_editor_t const** editor,
+      void** edit_baton, apr_hash_t* rev_props, apr_pool_t* pool)
+  {
+      replay_state* state = static_cast<replay_state*>(replay_baton);
+      mirror_edit* edit = static_cast<mirror_edit*>(apr_palloc(pool, sizeof(mirror_edit)));
+      edit->repos_url = state->repos_url;
+      SVN_ERR(svn_repos_get_commit_editor5(
+          &edit->editor, &edit->edit_baton, state->repos, nullptr, state->repos_url, "/",
+          rev_props, record_commit, state, nullptr, nullptr, pool));
+      *editor = mirror_editor(pool);
+      *edit_baton = edit;
+      return SVN_NO_ERROR;
+  }
+
+  // Commit revision, giving it the date it has in the remote
+  // repository in place of the time of the commit
+  svn_error_t* finish_revision(
+      svn_revnum_t revision, void* replay_baton, svn_delta_editor_t const* editor,
+      void* edit_baton, apr_hash_t* rev_props, apr_pool_t* pool)
+  {
+      replay_state* state = static_cast<replay_state*>(replay_baton);
+      SVN_ERR(editor->close_edit(edit_baton, pool));
+      if (state->committed != revision)
+      {
+          return svn_error_createf(
+              SVN_ERR_FS_GENERAL, nullptr,
+              "Mirroring r%ld made r%ld of the mirror", revision, state->committed);
+      }
+      svn_string_t const* date = static_cast<svn_string_t const*>(
+          apr_hash_get(rev_props, SVN_PROP_REVISION_DATE, APR_HASH_KEY_STRING));
+      SVN_ERR(svn_fs_change_rev_prop(
+          svn_repos_fs(state->repos), revision, SVN_PROP_REVISION_DATE, date, pool));
+      if (revision % 1000 == 0)
+          Log::info() << "mirrored r" << revision << std::endl;
+      return SVN_NO_ERROR;
+  }
+
+  // Credentials come from the user's Subversion configuration, as
+  // they would for svn itself, but are never prompted for
+  svn_auth_baton_t* open_auth(apr_pool_t* pool)
+  {
+      apr_array_header_t* providers
+          = apr_array_make(pool, 3, sizeof(svn_auth_provider_object_t*));
+      svn_auth_provider_object_t* provider;
+      svn_auth_get_simple_provider(&provider, pool);
+      APR_ARRAY_PUSH(providers, svn_auth_provider_object_t*) = provider;
+      svn_auth_get_username_provider(&provider, pool);
+      APR_ARRAY_PUSH(providers, svn_auth_provider_object_t*) = provider;
+      svn_auth_get_ssl_server_trust_file_provider(&provider, pool);
+      APR_ARRAY_PUSH(providers, svn_auth_provider_object_t*) = provider;
+      svn_auth_baton_t* auth;
+      svn_auth_open(&auth, providers, pool);
+      return auth;
+  }
+}
+
+bool is_svn_url(std::string const& repo_path)
+{
+    return repo_path.find("://") != std::string::npos;
+}
+
+int mirror_svn(std::string const& url, std::string const& mirror_path)
+{
+    namespace fs = boost::filesystem;
+    AprPool pool;
+
+    static std::once_flag initialized;
+    std::call_once(initialized, []{ AprPool scope; check_svn(svn_ra_initialize(scope)); });
+
+    svn_ra_callbacks2_t* callbacks;
+    check_svn(svn_ra_create_callbacks(&callbacks, pool));
+    callbacks->auth_baton = open_auth(pool);
+    apr_hash_t* config;
+    check_svn(svn_config_get_config(&config, nullptr, pool));
+    svn_ra_session_t* session;
+    check_svn(svn_ra_open3(&session, url.c_str(), nullptr, callbacks, nullptr, config, pool));
+
+    char const* root_url;
+    check_svn(svn_ra_get_repos_root2(session, &root_url, pool));
+    if (url != root_url && url + "/" != root_url && url != std::string(root_url) + "/")
+        throw std::runtime_error("Can only mirror the root of a repository, " + std::string(root_url));
+    char const* uuid;
+    check_svn(svn_ra_get_uuid2(session, &uuid, pool));
+
+    // The mirror shares the UUID of the repository, and so the
+    // changes index kept for it
+    svn_repos_t* repos;
+    if (!fs::exists(mirror_path))
+    {
+        Log::info() << "creating the SVN mirror " << mirror_path << std::endl;
+        check_svn(svn_repos_create(
+            &repos, mirror_path.c_str(), nullptr, nullptr, nullptr, nullptr, pool));
+        check_svn(svn_fs_set_uuid(svn_repos_fs(repos), uuid, pool));
+    }
+    else
+    {
+        repos = svn::open_repository(mirror_path, pool);
+        char const* mirror_uuid;
+        check_svn(svn_fs_get_uuid(svn_repos_fs(repos), &mirror_uuid, pool));
+        if (std::string(mirror_uuid) != uuid)
+            throw std::runtime_error(mirror_path + " is not a mirror of " + url);
+    }
+
+    svn_revnum_t mirrored, latest;
+    check_svn(svn_fs_youngest_rev(&mirrored, svn_repos_fs(repos), pool));
+    check_svn(svn_ra_get_latest_revnum(session, &latest, pool));
+    if (mirrored < latest)
+    {
+        Log::info() << "mirroring r" << mirrored + 1 << " to r" << latest
+                    << " of " << url << std::endl;
+        std::string const repos_url = "file://" + fs::absolute(mirror_path).string();
+        replay_state state = { repos, repos_url.c_str(), SVN_INVALID_REVNUM };
+        check_svn(svn_ra_replay_range(
+            session, mirrored + 1, latest, 0, TRUE, start_revision, finish_revision, &state, pool));
+    }
+    return int(latest);
+}
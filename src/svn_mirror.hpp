@@ -0,0 +1,22 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef SVN_MIRROR_DWA20131115_HPP
+# define SVN_MIRROR_DWA20131115_HPP
+
+# include <string>
+
+// Bring the local repository at mirror_path, created if need be, up
+// to date with the remote repository at url, which must be its root,
+// returning the latest revision mirrored.  The revisions are streamed
+// by svn_ra_replay_range, which pipelines them over one connection,
+// and committed one by one, so the mirror is a copy the conversion
+// can read as fast as any local repository, and only the revisions
+// committed since the last call are ever downloaded; see --svn-mirror.
+int mirror_svn(std::string const& url, std::string const& mirror_path);
+
+// True iff repo_path names a repository to be mirrored rather than
+// one on disk
+bool is_svn_url(std::string const& repo_path);
+
+#endif // SVN_MIRROR_DWA20131115_HPP
@@ -0,0 +1,176 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// See svn.cpp
+#define SVN_DEPRECATED
+
+#include "svn_read_bench.hpp"
+#include "revision_planner.hpp"
+#include "ruleset.hpp"
+#include "svn.hpp"
+#include "svn_handle.hpp"
+#include "path.hpp"
+#include "log.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include <svn_fs.h>
+
+namespace
+{
+    // A file the conversion would read
+    struct file_read
+    {
+        int revnum;
+        path svn_path;
+    };
+
+    extern "C"
+    {
+        // Count what is read, keeping none of it
+        svn_error_t *count_bytes(void *baton, const char *, apr_size_t *len)
+        {
+            *static_cast<std::uint64_t*>(baton) += *len;
+            return SVN_NO_ERROR;
+        }
+    }
+
+    // Read the contents of f through the calling thread's handle on
+    // the repository at repo_path, returning their length
+    std::uint64_t read_file(std::string const& repo_path, file_read const& f, apr_pool_t* pool)
+    {
+        svn_fs_root_t* const fs_root = svn_handle::of_thread(repo_path).revision_root(f.revnum);
+        std::uint64_t bytes = 0;
+        svn_stream_t* in_stream = svn::call(
+            svn_fs_file_contents, fs_root, f.svn_path.c_str(), pool);
+        svn_stream_t* out_stream = svn_stream_create(&bytes, pool);
+        svn_stream_set_write(out_stream, count_bytes);
+        svn::check(svn_stream_copy3, in_stream, out_stream, nullptr, nullptr, pool);
+        return bytes;
+    }
+
+    // Read every file in reads on threads threads, each taking the
+    // next in order, and report how fast that went
+    void read_pass(
+        std::string const& name, std::string const& repo_path,
+        std::vector<file_read> const& reads, unsigned threads)
+    {
+        std::atomic<std::size_t> next(0);
+        std::atomic<std::uint64_t> bytes(0);
+        std::mutex mutex;
+        std::exception_ptr error;
+        auto work = [&]
+        {
+            try
+            {
+                AprPool pool;
+                std::uint64_t read = 0;
+                for (std::size_t i; (i = next++) < reads.size();)
+                    read += read_file(repo_path, reads[i], AprScratch(pool));
+                bytes += read;
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error)
+                    error = std::current_exception();
+                next = reads.size();
+            }
+        };
+
+        auto const start = std::chrono::steady_clock::now();
+        if (threads <= 1)
+        {
+            work();
+        }
+        else
+        {
+            std::vector<std::thread> readers;
+            for (unsigned i = 0; i < threads; ++i)
+                readers.emplace_back(work);
+            for (auto& t : readers)
+                t.join();
+        }
+        if (error)
+            std::rethrow_exception(error);
+        double const seconds = std::max(
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(), 1e-9);
+
+        std::cout << std::setw(24) << std::left << name << std::right
+                  << std::setw(10) << reads.size() << std::setw(14) << bytes
+                  << std::fixed << std::setprecision(2) << std::setw(10) << seconds
+                  << std::setw(10) << bytes / seconds / (1 << 20)
+                  << std::setprecision(0) << std::setw(10) << reads.size() / seconds << '\n'
+                  << std::flush;
+    }
+}
+
+void bench_svn_read(
+    svn const& svn_repo, Ruleset const& ruleset, int first, int last, unsigned threads)
+{
+    // Plan the revisions, listing the files the conversion would read:
+    // those planned, but for those whose SVN SHA-1 shows the contents
+    // were sent to their repository already
+    auto const plan_start = std::chrono::steady_clock::now();
+    revision_planner planner(svn_repo, ruleset, false);
+    std::map<std::string, std::unordered_set<std::string> > contents_sent;
+    std::vector<file_read> reads;
+    std::uint64_t files_planned = 0;
+    revision_plan plan;
+    std::vector<svn::change> changes;
+    for (int revnum = first; revnum <= last; ++revnum)
+    {
+        if (revnum % 1000 == 0)
+            Log::info() << "planning revision " << revnum << std::endl;
+        svn_repo.changes(revnum, changes);
+        if (planner.changes_nothing(revnum, changes))
+        {
+            planner.skipped(revnum, revnum);
+            continue;
+        }
+        svn::revision const rev = svn_repo[revnum];
+        planner.plan(rev, plan);
+        for (auto const& f : plan.files)
+        {
+            ++files_planned;
+            AprScratch scope(rev.scratch);
+            svn_checksum_t* checksum = svn::call(
+                svn_fs_file_checksum, svn_checksum_sha1, rev.fs_root, f.svn_path.c_str(), FALSE,
+                scope);
+            if (checksum
+                && !contents_sent[f.match->git_repo_name()].insert(
+                    svn_checksum_to_cstring(checksum, scope)).second)
+            {
+                continue;
+            }
+            file_read const read = { revnum, f.svn_path };
+            reads.push_back(read);
+        }
+    }
+    double const plan_seconds
+        = std::chrono::duration<double>(std::chrono::steady_clock::now() - plan_start).count();
+
+    std::cout << "Reading the files converting r" << first << " to r" << last << " reads: "
+              << files_planned << " planned in " << std::fixed << std::setprecision(2)
+              << plan_seconds << "s, " << files_planned - reads.size()
+              << " of them sent already\n";
+    std::cout << std::setw(24) << std::left << "pass" << std::right
+              << std::setw(10) << "files" << std::setw(14) << "bytes" << std::setw(10) << "seconds"
+              << std::setw(10) << "MB/s" << std::setw(10) << "files/s" << '\n';
+    read_pass("1 thread", svn_repo.repo_path, reads, 1);
+    if (threads > 1)
+        read_pass(std::to_string(threads) + " threads", svn_repo.repo_path, reads, threads);
+    read_pass("1 thread, caches warm", svn_repo.repo_path, reads, 1);
+}
@@ -0,0 +1,25 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef SVN_READ_BENCH_DWA20131202_HPP
+# define SVN_READ_BENCH_DWA20131202_HPP
+
+class svn;
+class Ruleset;
+
+// Measure how fast SVN gives up the file contents converting
+// revisions first..last would read, to learn the most the SVN side
+// allows.  Each revision is planned as the importer would, and the
+// files it would convert are listed, but for those whose contents the
+// repository they map into was sent already.  The contents are then
+// read and thrown away: on one thread, on threads threads if more
+// than one, and on one thread again, once libsvn_fs's caches hold
+// what they kept of the first passes.  Each pass reports its files
+// and bytes a second.  The caches are as --svn-cache-megabytes,
+// --svn-cache-fulltexts and --svn-cache-deltas configure them for
+// the whole process, so runs with different settings are compared.
+// See --bench-svn-read.
+void bench_svn_read(
+    svn const& svn_repo, Ruleset const& ruleset, int first, int last, unsigned threads);
+
+#endif // SVN_READ_BENCH_DWA20131202_HPP
@@ -0,0 +1,227 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#include "task_scheduler.hpp"
+
+#include <algorithm>
+#include <utility>
+#include <time.h>
+
+namespace
+{
+    // The scheduler whose worker this thread is, if any, and its index
+    thread_local task_scheduler* current_scheduler = nullptr;
+    thread_local unsigned current_worker = 0;
+
+    double thread_cpu_seconds()
+    {
+        timespec t;
+        ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+        return t.tv_sec + t.tv_nsec * 1e-9;
+    }
+}
+
+task_scheduler::task_scheduler(unsigned threads, unsigned spare_threads)
+    : threads(std::max(threads, 1u)), queued(0), pending(0), busy(0), next_worker(0),
+      stopping(false)
+{
+    for (unsigned n = this->threads + spare_threads; n > 0; --n)
+        workers.emplace_back(new worker);
+    for (unsigned self = 0; self < workers.size(); ++self)
+        pool.emplace_back([this, self] { work(self); });
+}
+
+task_scheduler::~task_scheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        for (auto& w : workers)
+        {
+            std::lock_guard<std::mutex> lock(w->mutex);
+            w->tasks.clear();
+        }
+    }
+    work_ready.notify_all();
+    for (auto& t : pool)
+        t.join();
+}
+
+void task_scheduler::set_timer(timer t)
+{
+    time_task = std::move(t);
+}
+
+void task_scheduler::submit(char const* name, task t, void const* affinity)
+{
+    item i = { name, std::move(t), affinity };
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++pending;
+        if (affinity)
+        {
+            auto const s = strands.find(affinity);
+            if (s != strands.end())
+            {
+                s->second.push_back(std::move(i));
+                return;
+            }
+            strands[affinity];
+        }
+    }
+    push(std::move(i));
+}
+
+// Queue i on this thread's worker if it is one, or else on each in turn
+void task_scheduler::push(item i)
+{
+    unsigned target;
+    if (current_scheduler == this)
+    {
+        target = current_worker;
+    }
+    else
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        target = next_worker++ % workers.size();
+    }
+    {
+        std::lock_guard<std::mutex> lock(workers[target]->mutex);
+        workers[target]->tasks.push_back(std::move(i));
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++queued;
+    }
+    work_ready.notify_one();
+}
+
+// Take the newest task of this thread's own queue, or else the oldest
+// of another's
+bool task_scheduler::take(unsigned self, item& i)
+{
+    for (std::size_t k = 0; k < workers.size(); ++k)
+    {
+        worker& w = *workers[(self + k) % workers.size()];
+        std::lock_guard<std::mutex> lock(w.mutex);
+        if (w.tasks.empty())
+            continue;
+        if (k == 0)
+        {
+            i = std::move(w.tasks.back());
+            w.tasks.pop_back();
+        }
+        else
+        {
+            i = std::move(w.tasks.front());
+            w.tasks.pop_front();
+        }
+        return true;
+    }
+    return false;
+}
+
+void task_scheduler::work(unsigned self)
+{
+    current_scheduler = this;
+    current_worker = self;
+    for (;;)
+    {
+        // Claim one of the queued tasks; every claim is backed by a
+        // task in some queue, which take() is sure to find
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            work_ready.wait(lock, [this] { return stopping || (queued > 0 && busy < threads); });
+            if (stopping)
+                return;
+            --queued;
+            ++busy;
+        }
+        item i;
+        while (!take(self, i))
+            std::this_thread::yield();
+
+        auto const start = clock::now();
+        double const cpu_start = time_task ? thread_cpu_seconds() : 0;
+        try
+        {
+            i.run();
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!error)
+                error = std::current_exception();
+        }
+        if (time_task)
+            time_task(i.name, self, start, clock::now(), thread_cpu_seconds() - cpu_start);
+        finish(i);
+    }
+}
+
+// Release the next task of i's affinity, if any, and account for i
+// having finished
+void task_scheduler::finish(item const& i)
+{
+    item next;
+    bool released = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        --busy;
+        if (i.affinity)
+        {
+            auto const s = strands.find(i.affinity);
+            if (s->second.empty())
+            {
+                strands.erase(s);
+            }
+            else
+            {
+                next = std::move(s->second.front());
+                s->second.pop_front();
+                released = true;
+            }
+        }
+    }
+    if (released)
+        push(std::move(next));
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--pending == 0)
+            idle.notify_all();
+    }
+    work_ready.notify_one();
+}
+
+void task_scheduler::wait()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this] { return pending == 0; });
+    if (error)
+    {
+        std::exception_ptr e = error;
+        error = nullptr;
+        std::rethrow_exception(e);
+    }
+}
+
+task_scheduler::blocking::blocking()
+    : scheduler(current_scheduler)
+{
+    if (!scheduler)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(scheduler->mutex);
+        --scheduler->busy;
+    }
+    scheduler->work_ready.notify_one();
+}
+
+task_scheduler::blocking::~blocking()
+{
+    if (!scheduler)
+        return;
+    std::lock_guard<std::mutex> lock(scheduler->mutex);
+    ++scheduler->busy;
+}
@@ -0,0 +1,135 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef TASK_SCHEDULER_DWA20131125_HPP
+# define TASK_SCHEDULER_DWA20131125_HPP
+
+# include <chrono>
+# include <condition_variable>
+# include <cstddef>
+# include <deque>
+# include <exception>
+# include <functional>
+# include <map>
+# include <memory>
+# include <mutex>
+# include <thread>
+# include <vector>
+
+// One pool of threads for the work the importer farms out, so that the
+// features doing work in parallel share the machine rather than each
+// starting threads of its own.
+//
+// As in tree_walker, each thread has a queue of its own.  Tasks
+// submitted from a worker go to the back of that worker's queue, and
+// it takes them from the back, running what it made most recently
+// first.  An idle thread steals from the front of another's queue.
+//
+// Tasks may have an affinity, such as the git_repository they write
+// to.  Those with the same affinity run one at a time, in the order
+// submitted, so what they do to it stays in order.
+//
+// Beyond the threads that run tasks, spare threads are kept idle.  A
+// task about to wait on I/O declares it with a blocking object, and
+// while it waits a spare thread may run another task, so the machine
+// stays busy without running more tasks at once than threads.
+class task_scheduler
+{
+ public:
+    typedef std::function<void()> task;
+    typedef std::chrono::steady_clock clock;
+
+    // Called on the worker after each task, given the name it was
+    // submitted with, the worker's index, when it ran, and the CPU
+    // seconds it used; see profile::task
+    typedef std::function<
+        void(char const* name, unsigned worker, clock::time_point start, clock::time_point end,
+             double cpu_seconds)
+    > timer;
+
+    // Run at most threads tasks at once, with spare_threads more to
+    // take over from tasks that block
+    task_scheduler(unsigned threads, unsigned spare_threads);
+
+    // Waits for the tasks under way, abandoning those not begun
+    ~task_scheduler();
+
+    // Time each task with t.  Must be called before any task is
+    // submitted.
+    void set_timer(timer t);
+
+    // Run t on some thread.  Tasks with the same non-null affinity
+    // run one at a time, in the order they were submitted.  name must
+    // outlive the scheduler, as string literals do.
+    void submit(char const* name, task t, void const* affinity = nullptr);
+
+    // Wait for every task submitted to finish, rethrowing the first
+    // error any of them threw since the last wait.  Not to be called
+    // from a task.
+    void wait();
+
+    // The number of tasks run at once, not counting those blocked
+    unsigned concurrency() const
+    {
+        return threads;
+    }
+
+    // Held by a task while it waits on I/O or on another process,
+    // letting a spare thread run another task meanwhile.  Does
+    // nothing on a thread that isn't a worker.
+    struct blocking
+    {
+        blocking();
+        ~blocking();
+
+        blocking(blocking const&) = delete;
+        void operator=(blocking const&) = delete;
+
+     private:
+        task_scheduler* scheduler;
+    };
+
+ private:
+    task_scheduler(task_scheduler const&);
+    task_scheduler& operator=(task_scheduler const&);
+
+    struct item
+    {
+        char const* name;
+        task run;
+        void const* affinity;
+    };
+
+    struct worker
+    {
+        std::mutex mutex;
+        std::deque<item> tasks;
+    };
+
+    void work(unsigned self);
+    void push(item i);
+    bool take(unsigned self, item& i);
+    void finish(item const& i);
+
+    unsigned const threads;
+    timer time_task;
+    std::vector<std::unique_ptr<worker> > workers;
+
+    std::mutex mutex;
+    std::condition_variable work_ready;  // a task queued, a thread free, or stopping
+    std::condition_variable idle;        // no task pending
+    std::size_t queued;                  // tasks in the workers' queues
+    std::size_t pending;                 // tasks submitted and not finished
+    unsigned busy;                       // tasks running and not blocked
+    unsigned next_worker;                // to queue the next outside task
+    bool stopping;
+    std::exception_ptr error;
+
+    // The tasks waiting behind the one of each affinity queued or
+    // running; an affinity is present as long as one of its tasks is
+    std::map<void const*, std::deque<item> > strands;
+
+    std::vector<std::thread> pool;
+};
+
+#endif // TASK_SCHEDULER_DWA20131125_HPP
@@ -0,0 +1,149 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#include "text_normalizer.hpp"
+#include "byte_search.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+namespace
+{
+  // The names under which SVN expands each keyword it knows
+  char const* const keyword_aliases[][3] = {
+      { "LastChangedDate", "Date", nullptr },
+      { "LastChangedRevision", "Rev", "Revision" },
+      { "LastChangedBy", "Author", nullptr },
+      { "HeadURL", "URL", nullptr },
+      { "Id", nullptr, nullptr },
+      { "Header", nullptr, nullptr }
+  };
+
+  // SVN doesn't look further than this for the end of a keyword
+  std::size_t const max_keyword_length = 255;
+
+  bool is_keyword_char(char c)
+  {
+      return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+  }
+}
+
+text_normalizer::text_normalizer(std::string const& eol_style, std::string const& keywords_property)
+    : normalize_eols(
+        eol_style == "native" || eol_style == "LF" || eol_style == "CRLF" || eol_style == "CR")
+{
+    std::istringstream names(keywords_property);
+    for (std::string name; names >> name;)
+    {
+        // A custom keyword is NAME=FORMAT
+        name = name.substr(0, name.find('='));
+        bool known = false;
+        for (auto const& aliases : keyword_aliases)
+        {
+            for (char const* const* a = aliases; a != aliases + 3 && *a; ++a)
+            {
+                if (name == *a)
+                {
+                    keywords.insert(aliases, std::find(aliases, aliases + 3, nullptr));
+                    known = true;
+                }
+            }
+        }
+        if (!known && !name.empty())
+            keywords.insert(name);
+    }
+
+    if (normalize_eols)
+        suffix += "|eol";
+    if (!keywords.empty())
+    {
+        suffix += "|keywords";
+        for (auto const& k : keywords)
+            suffix += ":" + k;
+    }
+}
+
+char const* text_normalizer::contract(char const* p, char const* end, char*& out) const
+{
+    if (std::size_t(end - p) > max_keyword_length)
+        end = p + max_keyword_length;
+
+    char const* name_end = p + 1;
+    while (name_end != end && is_keyword_char(*name_end))
+        ++name_end;
+    if (name_end == p + 1 || name_end == end || *name_end != ':'
+        || keywords.count(std::string(p + 1, name_end)) == 0)
+    {
+        return p;
+    }
+
+    bool const fixed_width = name_end + 1 != end && name_end[1] == ':';
+    char const* const value = name_end + (fixed_width ? 2 : 1);
+    if (value == end || *value != ' ')
+        return p;
+
+    // The closing dollar sign must be on the same line
+    char const* close = value;
+    while (close != end && *close != '$' && *close != '\n' && *close != '\r')
+        ++close;
+    if (close == end || *close != '$')
+        return p;
+
+    // Neither form is longer than what it replaces, so writing it
+    // can't overtake the reading
+    if (fixed_width)
+    {
+        std::memmove(out, p, value - p);
+        out += value - p;
+        std::memset(out, ' ', close - value);
+        out += close - value;
+    }
+    else
+    {
+        std::memmove(out, p, name_end - p);
+        out += name_end - p;
+    }
+    *out++ = '$';
+    return close + 1;
+}
+
+void text_normalizer::apply(std::string& contents) const
+{
+    if (!enabled() || contents.empty())
+        return;
+
+    char* const begin = &contents[0];
+    char const* const end = begin + contents.size();
+    char const* in = begin;
+    char* out = begin;
+    while (in != end)
+    {
+        char const* const p
+            = !normalize_eols ? byte_search::find(in, end, '$')
+            : keywords.empty() ? byte_search::find(in, end, '\r')
+            : byte_search::find_either(in, end, '\r', '$');
+
+        if (out != in)
+            std::memmove(out, in, p - in);
+        out += p - in;
+        if (p == end)
+            break;
+
+        if (*p == '\r')
+        {
+            *out++ = '\n';
+            in = p + 1 != end && p[1] == '\n' ? p + 2 : p + 1;
+        }
+        else
+        {
+            in = contract(p, end, out);
+            if (in == p)
+            {
+                *out++ = '$';
+                ++in;
+            }
+        }
+    }
+    contents.resize(out - begin);
+}
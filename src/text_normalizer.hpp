@@ -0,0 +1,48 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef TEXT_NORMALIZER_DWA20131114_HPP
+# define TEXT_NORMALIZER_DWA20131114_HPP
+
+# include <set>
+# include <string>
+
+// With --normalize-text, brings the contents of an SVN file into the
+// form SVN's own properties say it should have in the repository, so
+// that no history rewrite is needed after the conversion.  A file
+// with svn:eol-style gets LF line endings, its CRLFs and lone CRs
+// being what was committed before the property was set; and the
+// keywords named by svn:keywords are contracted, "$Id: x.cpp 12 $"
+// becoming "$Id$", and the fixed-width "$Rev:: 12  $" keeping its
+// width as "$Rev::     $".
+class text_normalizer
+{
+ public:
+    // From the values of svn:eol-style and svn:keywords, each empty if
+    // the file doesn't have it
+    text_normalizer(std::string const& eol_style, std::string const& keywords);
+
+    // True iff apply can change anything
+    bool enabled() const { return normalize_eols || !keywords.empty(); }
+
+    // Appended to the SVN content key of a normalized file, whose blob
+    // can't be shared with unnormalized files of the same content
+    std::string const& key_suffix() const { return suffix; }
+
+    // Normalize contents in place, in a single pass that finds the
+    // CRs and dollar signs to act on a block at a time, and moves
+    // nothing until the first change.
+    void apply(std::string& contents) const;
+
+ private:
+    // If a keyword to contract begins at p, whose line ends before
+    // end, write its contracted form at out and return the position
+    // after the keyword; otherwise return p.
+    char const* contract(char const* p, char const* end, char*& out) const;
+
+    bool normalize_eols;
+    std::set<std::string> keywords;   // every name to contract
+    std::string suffix;
+};
+
+#endif // TEXT_NORMALIZER_DWA20131114_HPP
@@ -0,0 +1,240 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef TREE_MODEL_DWA20131120_HPP
+# define TREE_MODEL_DWA20131120_HPP
+
+# include "sha1.hpp"
+# include <algorithm>
+# include <cstdio>
+# include <memory>
+# include <string>
+# include <vector>
+
+// What a Git tree contains, for --tree-model: the blobs, gitlinks and
+// subtrees beneath each directory, by name.  Copying a tree_model
+// copies a pointer to its root; the directories are shared until one
+// of the copies changes, when those on the path to the change are
+// copied for it alone.  So a tree kept for every commit costs only
+// the directories each commit changed, and one ref's tree can be
+// given the contents of a directory of another's in constant time.
+// The SHA-1s of the directories are computed when asked for, and
+// remembered until they change.
+class tree_model
+{
+    struct directory;
+    typedef std::shared_ptr<directory> directory_ptr;
+
+ public:
+    // A blob, gitlink or subtree, as found beneath some path
+    struct object
+    {
+        unsigned long mode;
+        sha1::digest_type sha;      // except of a subtree
+        directory_ptr subtree;      // null except for a subtree
+
+        // The object's mode and SHA-1, in the form fast-import
+        // accepts in place of a data reference, e.g. "100644 e69de..."
+        std::string str() const
+        {
+            char mode_digits[8];
+            std::snprintf(mode_digits, sizeof(mode_digits), "%06lo", mode);
+            return mode_digits + (" " + sha1::to_hex(subtree ? sha_of(*subtree) : sha));
+        }
+    };
+
+    tree_model() : root(std::make_shared<directory>()) {}
+
+    // Make the blob or gitlink at p, replacing whatever is there and
+    // creating the directories above it as needed
+    void set(std::string const& p, unsigned long mode, sha1::digest_type const& sha)
+    {
+        object const o = { mode, sha, directory_ptr() };
+        set(p, o);
+    }
+
+    // Make the object found elsewhere, e.g. in another tree, the one
+    // at p
+    void set(std::string const& p, object const& o)
+    {
+        if (p.empty())
+        {
+            if (o.subtree)
+                root = o.subtree;
+            return;
+        }
+        directory_ptr* d = &root;
+        std::size_t begin = 0;
+        for (std::size_t slash; (slash = p.find('/', begin)) != std::string::npos; begin = slash + 1)
+        {
+            entry& e = writable(*d).demand(p.substr(begin, slash - begin));
+            if (!e.o.subtree)
+            {
+                e.o.mode = 040000;
+                e.o.subtree = std::make_shared<directory>();
+            }
+            d = &e.o.subtree;
+        }
+        writable(*d).demand(p.substr(begin)).o = o;
+    }
+
+    // Remove whatever is at p, and the directories left empty above it
+    void remove(std::string const& p)
+    {
+        if (p.empty())
+            clear();
+        else if (find(p))
+            remove(root, p, 0);
+    }
+
+    void clear() { root = std::make_shared<directory>(); }
+
+    // The object at p, or null if there is none.  The root is a
+    // subtree found at "".
+    std::unique_ptr<object> find(std::string const& p) const
+    {
+        object o = { 040000, sha1::digest_type(), root };
+        for (std::size_t begin = 0; !p.empty() && begin <= p.size();)
+        {
+            std::size_t const slash = std::min(p.find('/', begin), p.size());
+            entry const* e = o.subtree ? o.subtree->find(p.substr(begin, slash - begin)) : nullptr;
+            if (!e)
+                return nullptr;
+            o = e->o;
+            begin = slash + 1;
+        }
+        return std::unique_ptr<object>(new object(o));
+    }
+
+    // The SHA-1 Git gives the whole tree
+    sha1::digest_type sha() const { return sha_of(*root); }
+
+    bool empty() const { return root->entries.empty(); }
+
+    // True iff the two trees are known to be the same without
+    // hashing them, as when neither has changed since it was copied
+    bool shares_root(tree_model const& other) const { return root == other.root; }
+
+    // Append to out the outermost paths at or beneath p that hold
+    // something in this tree but nothing in other.  Directories the
+    // two trees share are not looked into.
+    void missing_from(tree_model const& other, std::string const& p, std::vector<std::string>& out) const
+    {
+        std::unique_ptr<object> const mine = find(p);
+        if (!mine)
+            return;
+        std::unique_ptr<object> const theirs = other.find(p);
+        if (!theirs)
+            out.push_back(p);
+        else if (mine->subtree && theirs->subtree)
+            missing_from(*mine->subtree, *theirs->subtree, p, out);
+    }
+
+ private:
+    struct entry
+    {
+        std::string name;
+        object o;
+    };
+
+    struct directory
+    {
+        directory() : hashed(false) {}
+
+        // Entries are sorted by name alone, so that they can be
+        // found without knowing whether they are trees.  Git's own
+        // order is applied when hashing.
+        std::vector<entry> entries;
+        bool hashed;
+        sha1::digest_type sha;
+
+        entry const* find(std::string const& name) const
+        {
+            auto const p = lower_bound(name);
+            return p != entries.end() && p->name == name ? &*p : nullptr;
+        }
+
+        entry& demand(std::string const& name)
+        {
+            auto p = lower_bound(name);
+            if (p == entries.end() || p->name != name)
+            {
+                entry const e = { name, object() };
+                p = entries.insert(p, e);
+            }
+            return *p;
+        }
+
+        std::vector<entry>::iterator lower_bound(std::string const& name)
+        {
+            return std::lower_bound(
+                entries.begin(), entries.end(), name,
+                [](entry const& e, std::string const& n) { return e.name < n; });
+        }
+
+        std::vector<entry>::const_iterator lower_bound(std::string const& name) const
+        {
+            return const_cast<directory*>(this)->lower_bound(name);
+        }
+    };
+
+    // The directory, to be changed by this tree alone
+    static directory& writable(directory_ptr& d)
+    {
+        if (d.use_count() > 1)
+            d = std::make_shared<directory>(*d);
+        d->hashed = false;
+        return *d;
+    }
+
+    // Remove the path beginning at begin from d, returning true iff d
+    // is left empty.  The path is known to be there.
+    static bool remove(directory_ptr& d, std::string const& p, std::size_t begin)
+    {
+        directory& w = writable(d);
+        std::size_t const slash = p.find('/', begin);
+        auto e = w.lower_bound(p.substr(begin, slash - begin));
+        if (slash == std::string::npos || remove(e->o.subtree, p, slash + 1))
+            w.entries.erase(e);
+        return w.entries.empty();
+    }
+
+    static void missing_from(
+        directory const& mine, directory const& theirs, std::string const& p,
+        std::vector<std::string>& out)
+    {
+        if (&mine == &theirs)
+            return;
+        for (auto const& e : mine.entries)
+        {
+            std::string const subpath = p.empty() ? e.name : p + "/" + e.name;
+            entry const* const t = theirs.find(e.name);
+            if (!t)
+                out.push_back(subpath);
+            else if (e.o.subtree && t->o.subtree)
+                missing_from(*e.o.subtree, *t->o.subtree, subpath, out);
+        }
+    }
+
+    static sha1::digest_type const& sha_of(directory& d)
+    {
+        if (!d.hashed)
+        {
+            std::vector<git_tree_entry> entries;
+            entries.reserve(d.entries.size());
+            for (auto const& e : d.entries)
+            {
+                git_tree_entry const g = {
+                    e.o.mode, e.name, e.o.subtree ? sha_of(*e.o.subtree) : e.o.sha };
+                entries.push_back(g);
+            }
+            d.sha = git_tree_sha(std::move(entries));
+            d.hashed = true;
+        }
+        return d.sha;
+    }
+
+    directory_ptr root;
+};
+
+#endif // TREE_MODEL_DWA20131120_HPP
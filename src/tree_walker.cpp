@@ -0,0 +1,206 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// See svn.cpp
+#define SVN_DEPRECATED
+
+#include "tree_walker.hpp"
+#include "svn.hpp"
+#include "svn_handle.hpp"
+
+#include <svn_fs.h>
+#include <svn_repos.h>
+
+tree_walker::tree_walker(std::string const& repo_path, unsigned nthreads)
+    : repo_path(repo_path), queued(0), pending(0), stopping(false), revnum(-1),
+      prune(nullptr), cache(nullptr)
+{
+    for (unsigned i = 0; i < nthreads; ++i)
+        workers.emplace_back(new worker);
+
+    for (std::size_t i = 0; i < workers.size(); ++i)
+        threads.emplace_back(&tree_walker::work, this, i);
+}
+
+tree_walker::~tree_walker()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work_ready.notify_all();
+    for (auto& t : threads)
+        t.join();
+}
+
+std::deque<tree_walker::directory> tree_walker::walk(
+    int revnum, path const& svn_path, std::string const& node_id,
+    std::function<bool(path const&, bool)> const& prune, directory_cache& cache)
+{
+    {
+        std::lock_guard<std::mutex> lock(shared);
+        this->prune = &prune;
+        this->cache = &cache;
+        found.clear();
+        directory root = { svn_path, node_id, nullptr, {} };
+        found.push_back(std::move(root));
+        error = nullptr;
+    }
+    this->revnum = revnum;
+    pending = 1;
+    push(0, std::vector<std::size_t>(1, 0));
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        walk_done.wait(lock, [this]{ return pending == 0; });
+    }
+
+    std::lock_guard<std::mutex> lock(shared);
+    this->prune = nullptr;
+    this->cache = nullptr;
+    if (error)
+        std::rethrow_exception(error);
+    return std::move(found);
+}
+
+// Queue tasks, which pending already counts, on the given thread
+void tree_walker::push(std::size_t self, std::vector<std::size_t> const& tasks)
+{
+    if (tasks.empty())
+        return;
+    {
+        worker& w = *workers[self];
+        std::lock_guard<std::mutex> lock(w.mutex);
+        w.tasks.insert(w.tasks.end(), tasks.begin(), tasks.end());
+    }
+    queued += tasks.size();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+    }
+    if (tasks.size() == 1)
+        work_ready.notify_one();
+    else
+        work_ready.notify_all();
+}
+
+// Take the thread's own latest task, or failing that, steal another's
+// earliest
+bool tree_walker::take(std::size_t self, std::size_t& task)
+{
+    for (std::size_t i = 0; i < workers.size(); ++i)
+    {
+        bool const own = i == 0;
+        worker& w = *workers[(self + i) % workers.size()];
+        std::lock_guard<std::mutex> lock(w.mutex);
+        if (w.tasks.empty())
+            continue;
+        if (own)
+        {
+            task = w.tasks.back();
+            w.tasks.pop_back();
+        }
+        else
+        {
+            task = w.tasks.front();
+            w.tasks.pop_front();
+        }
+        --queued;
+        return true;
+    }
+    return false;
+}
+
+void tree_walker::work(std::size_t self)
+{
+    AprPool scratch;
+
+    for (;;)
+    {
+        std::size_t task;
+        if (!take(self, task))
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            work_ready.wait(lock, [this]{ return stopping || queued > 0; });
+            if (stopping)
+                return;
+            continue;
+        }
+
+        try
+        {
+            // The walk's revision was set before its tasks were
+            // queued.  Failing to open the repository fails the walk.
+            list(self, task, svn_handle::of_thread(repo_path).revision_root(revnum), scratch);
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(shared);
+            if (!error)
+                error = std::current_exception();
+        }
+
+        if (--pending == 0)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            walk_done.notify_all();
+        }
+    }
+}
+
+// List the directory found[task], queueing its subdirectories
+void tree_walker::list(
+    std::size_t self, std::size_t task, svn_fs_root_t* fs_root, AprPool& scratch)
+{
+    path svn_path;
+    std::string node_id;
+    std::shared_ptr<directory_cache::listing const> listing;
+    {
+        std::lock_guard<std::mutex> lock(shared);
+        if (error)
+            return;             // the walk has failed; just drain it
+        svn_path = found[task].svn_path;
+        node_id = found[task].node_id;
+        listing = cache->find(node_id);
+    }
+
+    if (!listing)
+    {
+        directory_cache::listing l;
+        {
+            AprScratch scope(scratch);
+            l = svn::read_directory(fs_root, svn_path.c_str(), scope);
+        }
+        std::lock_guard<std::mutex> lock(shared);
+        listing = cache->insert(node_id, std::move(l));
+    }
+
+    // The entries are pruned, and the subdirectories added to what
+    // the walk has found, under one lock
+    std::vector<int> entries(listing->size());
+    std::vector<std::size_t> subdirectories;
+    {
+        std::lock_guard<std::mutex> lock(shared);
+        for (std::size_t i = 0; i < listing->size(); ++i)
+        {
+            directory_cache::entry const& e = (*listing)[i];
+            path const subpath = svn_path/e.name;
+            if ((*prune)(subpath, e.is_dir))
+                entries[i] = pruned;
+            else if (!e.is_dir)
+                entries[i] = file;
+            else
+            {
+                entries[i] = int(found.size());
+                subdirectories.push_back(found.size());
+                directory d = { subpath, e.node_id, nullptr, {} };
+                found.push_back(std::move(d));
+            }
+        }
+        found[task].listing = std::move(listing);
+        found[task].entries = std::move(entries);
+    }
+
+    pending += subdirectories.size();
+    push(self, subdirectories);
+}
@@ -0,0 +1,97 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef TREE_WALKER_DWA20131120_HPP
+# define TREE_WALKER_DWA20131120_HPP
+
+# include "apr_pool.hpp"
+# include "directory_cache.hpp"
+# include "path.hpp"
+
+# include <atomic>
+# include <condition_variable>
+# include <cstddef>
+# include <deque>
+# include <exception>
+# include <functional>
+# include <memory>
+# include <mutex>
+# include <string>
+# include <thread>
+# include <vector>
+
+// Lists the directories of SVN trees on a pool of background threads,
+// for --walk-threads, so that walking a whole tree made anew by a rule
+// transition or a copy of a branch isn't bound by one thread's reads
+// of SVN.  As with file_prefetcher, each thread reads through its own
+// svn_handle.
+//
+// Each directory listed is a task, and the subdirectories it finds
+// are tasks added to the back of the thread's own queue, which it
+// takes from the back, walking depth first.  An idle thread steals
+// from the front of another's queue, taking the largest subtrees
+// left.  The caller gets every directory's listing, and visits the
+// files in whatever order it would have walked them itself.
+struct tree_walker
+{
+    tree_walker(std::string const& repo_path, unsigned threads);
+    ~tree_walker();
+
+    // What a walk found in a directory: for each entry of its listing,
+    // in order, pruned, file, or the index of the entry's directory
+    // among those found
+    static int const pruned = -1;
+    static int const file = -2;
+    struct directory
+    {
+        path svn_path;
+        std::string node_id;
+        std::shared_ptr<directory_cache::listing const> listing;
+        std::vector<int> entries;
+    };
+
+    // List the directories of the tree at svn_path in revnum, whose
+    // node-revision ID is node_id, skipping the entries for which
+    // prune(path, is_dir) returns true.  The root comes first.  prune
+    // is called on one thread at a time, and cache is shared likewise.
+    // Errors on the threads are rethrown here.
+    std::deque<directory> walk(
+        int revnum, path const& svn_path, std::string const& node_id,
+        std::function<bool(path const&, bool)> const& prune, directory_cache& cache);
+
+ private:
+    // A thread's queue of directories
+    struct worker
+    {
+        std::mutex mutex;
+        std::deque<std::size_t> tasks;
+    };
+
+    void work(std::size_t self);
+    void push(std::size_t self, std::vector<std::size_t> const& tasks);
+    bool take(std::size_t self, std::size_t& task);
+    void list(
+        std::size_t self, std::size_t task, struct svn_fs_root_t* fs_root, AprPool& scratch);
+
+    std::string const repo_path;
+    std::vector<std::unique_ptr<worker> > workers;
+    std::vector<std::thread> threads;
+
+    std::mutex mutex;
+    std::condition_variable work_ready; // when a task is queued, or stopping
+    std::condition_variable walk_done;  // when no task is pending
+    std::atomic<std::size_t> queued;    // tasks in the workers' queues
+    std::atomic<std::size_t> pending;   // tasks not yet finished
+    bool stopping;
+
+    // The walk under way, set before its first task is queued.  What
+    // it finds, prune and cache are guarded by shared.
+    std::atomic<int> revnum;
+    std::function<bool(path const&, bool)> const* prune;
+    directory_cache* cache;
+    std::mutex shared;
+    std::deque<directory> found;
+    std::exception_ptr error;
+};
+
+#endif // TREE_WALKER_DWA20131120_HPP
@@ -23,10 +23,18 @@
 #include <svn_repos.h>
 #include "svn_error.hpp"
 
+#include <algorithm>
+#include <atomic>
 #include <cstdlib>
-#include <string>
+#include <exception>
 #include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
 
+// One thread's view of the repository, since APR pools and svn_fs
+// objects can't be shared between threads
 class Repository
   {
   public:
@@ -35,38 +43,44 @@ class Repository
       svn_repos_t *repos;
       check_svn(svn_repos_open(&repos, path, apr_pool));
       fs = svn_repos_fs(repos);
+      }
+    svn_revnum_t youngest_revision() const
+      {
       svn_revnum_t revnum;
-      check_svn(svn_fs_youngest_rev(&revnum, fs, apr_pool));
-      check_svn(svn_fs_revision_root(&fs_root, fs, revnum, apr_pool));
+      check_svn(svn_fs_youngest_rev(&revnum, fs, AprScratch(scratch)));
+      return revnum;
       }
+    // Open the root of revnum, replacing the last one opened
     void set_revision(svn_revnum_t revnum)
       {
-      if (revnum == 0)
-        {
-        check_svn(svn_fs_youngest_rev(&revnum, fs, apr_pool));
-        }
-      check_svn(svn_fs_revision_root(&fs_root, fs, revnum, apr_pool));
+      fs_root = 0;
+      root_pool.clear();
+      check_svn(svn_fs_revision_root(&fs_root, fs, revnum, root_pool));
       }
     bool is_dir(std::string const& path) const
       {
       svn_boolean_t result;
-      check_svn(svn_fs_is_dir(&result, fs_root, path.c_str(), apr_pool));
+      check_svn(svn_fs_is_dir(&result, fs_root, path.c_str(), AprScratch(scratch)));
       return result;
       }
   private:
-    AprInit apr_init;
     AprPool apr_pool;
+    AprPool root_pool = apr_pool.make_subpool();
+    mutable AprPool scratch = apr_pool.make_subpool();
     svn_fs_t *fs;
-    svn_fs_root_t *fs_root;
+    svn_fs_root_t *fs_root = 0;
   };
 
-std::string test_branch(Repository& repo, std::string const& line)
+svn_revnum_t line_revision(std::string const& line)
   {
   std::size_t r1 = line.find('[') + 1;
   std::size_t r2 = line.find(':', r1);
-  std::string revnum = line.substr(r1, r2 - r1);
-  repo.set_revision(atoi(revnum.c_str()));
+  return atoi(line.substr(r1, r2 - r1).c_str());
+  }
 
+// Check line against the root of its revision, which repo has open
+std::string test_branch(Repository const& repo, std::string const& line)
+  {
   std::size_t c1 = line.find('"') + 1;
   std::size_t c2 = line.find('"', c1);
   std::string path = line.substr(c1, c2 - c1);
@@ -85,6 +99,10 @@ std::string test_branch(Repository& repo, std::string const& line)
   return "//" + line.substr(2) + " // TODO: check whether this is really a common branch!";
   }
 
+// Reads lines from stdin and writes each, checked, to stdout in the
+// same order.  The lines are grouped by revision, so that each
+// revision's root is opened once, and the revisions are shared out
+// between threads (by default, one per core).
 int main(int argc, char* argv[])
   {
   if (argc < 2)
@@ -92,16 +110,85 @@ int main(int argc, char* argv[])
     std::cerr << "Insufficient arguments!" << std::endl;
     return -1;
     }
-  Repository repo(argv[1]);
+  char const* repo_path = argv[1];
+  unsigned nthreads = argc > 2 ? atoi(argv[2]) : std::thread::hardware_concurrency();
+  nthreads = std::max(nthreads, 1u);
 
-  std::string line;
-  while (std::getline(std::cin, line))
+  AprInit apr_init;
+  try
     {
-    if (line.empty())
+    AprPool fs_pool;
+    check_svn(svn_fs_initialize(fs_pool)); // before using FS on several threads
+
+    std::vector<std::string> lines;
+    std::map<svn_revnum_t, std::vector<std::size_t> > lines_by_revision;
+    svn_revnum_t const youngest = Repository(repo_path).youngest_revision();
+    for (std::string line; std::getline(std::cin, line);)
+      {
+      if (line.empty())
+        {
+        continue;
+        }
+      svn_revnum_t revnum = line_revision(line);
+      lines_by_revision[revnum == 0 ? youngest : revnum].push_back(lines.size());
+      lines.push_back(line);
+      }
+
+    std::vector<std::pair<svn_revnum_t, std::vector<std::size_t> > > work(
+      lines_by_revision.begin(), lines_by_revision.end());
+    std::vector<std::string> results(lines.size());
+    std::atomic<std::size_t> next(0);
+    std::vector<std::exception_ptr> errors(nthreads);
+
+    auto validate = [&](unsigned t)
+      {
+      try
+        {
+        Repository repo(repo_path);
+        for (std::size_t i; (i = next++) < work.size();)
+          {
+          repo.set_revision(work[i].first);
+          for (std::size_t l : work[i].second)
+            {
+            results[l] = test_branch(repo, lines[l]);
+            }
+          }
+        }
+      catch (...)
+        {
+        errors[t] = std::current_exception();
+        next = work.size();
+        }
+      };
+
+    std::vector<std::thread> threads;
+    for (unsigned t = 1; t < nthreads; ++t)
+      {
+      threads.emplace_back(validate, t);
+      }
+    validate(0);
+    for (auto& t : threads)
+      {
+      t.join();
+      }
+    for (auto const& e : errors)
+      {
+      if (e)
+        {
+        std::rethrow_exception(e);
+        }
+      }
+
+    for (auto const& r : results)
       {
-      continue;
+      std::cout << r << '\n';
       }
-    std::cout << test_branch(repo, line) << std::endl;
+    std::cout << std::flush;
+    }
+  catch (std::exception const& e)
+    {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
     }
   return 0;
   }
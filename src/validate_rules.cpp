@@ -0,0 +1,144 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#include "validate_rules.hpp"
+#include "changed_directories.hpp"
+#include "directory_cache.hpp"
+#include "rules_cache.hpp"
+#include "ruleset.hpp"
+#include "svn.hpp"
+#include "path.hpp"
+#include "log.hpp"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace
+{
+    std::size_t const directory_cache_entries = 1 << 20;
+
+    // Add each directory at or beneath svn_path in rev, whose
+    // node-revision ID is node_id, that directly holds files.  Names
+    // are kept as plain strings, since interning every directory of
+    // every copied tree as a path would never be undone.
+    void add_file_directories(
+        svn::revision const& rev, std::string const& svn_path, std::string const& node_id,
+        directory_cache& cache, std::vector<std::string>& directories)
+    {
+        bool holds_files = false;
+        auto const listing = svn::list_directory(rev, svn_path.c_str(), node_id, cache);
+        for (auto const& e : *listing)
+        {
+            std::string const subpath = svn_path.empty() ? e.name : svn_path + "/" + e.name;
+            if (e.is_dir)
+                add_file_directories(rev, subpath, e.node_id, cache, directories);
+            else
+                holds_files = true;
+        }
+        if (holds_files)
+            directories.push_back(svn_path);
+    }
+
+    // Add the directories holding the files at or beneath svn_path
+    // in rev
+    void add_tree(
+        svn::revision const& rev, std::string const& svn_path,
+        directory_cache& cache, std::vector<std::string>& directories)
+    {
+        switch (svn::call(svn_fs_check_path, rev.fs_root, svn_path.c_str(), AprScratch(rev.scratch)))
+        {
+        case svn_node_file:
+        {
+            std::size_t const slash = svn_path.rfind('/');
+            directories.push_back(slash == std::string::npos ? std::string() : svn_path.substr(0, slash));
+            break;
+        }
+        case svn_node_dir:
+            add_file_directories(
+                rev, svn_path, svn::node_id(rev, svn_path.c_str()), cache, directories);
+            break;
+        default:
+            break;
+        }
+    }
+
+    // The directories holding the files that rev adds, changes or
+    // copies, which are the ones the importer converts for it
+    std::vector<std::string> changed_file_directories(
+        svn::revision const& rev, directory_cache& cache)
+    {
+        std::vector<std::string> result;
+        for (auto const& change : rev.changes)
+        {
+            if (change.change_kind == svn_fs_path_change_delete
+                || (change.change_kind == svn_fs_path_change_modify && !change.text_mod))
+                continue;
+            add_tree(rev, path(change.path).str(), cache, result);
+        }
+        return result;
+    }
+}
+
+void validate_rules(svn const& svn_repo, Ruleset const& ruleset, int last_revision)
+{
+    directory_cache listings(directory_cache_entries);
+
+    // Bring the index of the SVN repository up to date
+    std::string const uuid = svn_repo.uuid();
+    boost::filesystem::path const cache_dir = rules_cache::directory();
+    std::string const index_file 
+        = cache_dir.empty() ? std::string() : (cache_dir / (uuid + ".dirs")).string();
+
+    changed_directories index;
+    if (!index_file.empty() && index.load(index_file, uuid))
+        Log::info() << "read the index of changed directories through r" 
+                    << index.last_revision() << std::endl;
+    if (index.last_revision() < last_revision)
+    {
+        int const indexed = index.last_revision();
+        for (int revnum = indexed + 1; revnum <= last_revision; ++revnum)
+        {
+            if (revnum % 1000 == 0)
+                Log::info() << "indexing revision " << revnum << std::endl;
+            index.add(changed_file_directories(svn_repo[revnum], listings));
+        }
+        if (!index_file.empty())
+            index.save(index_file, uuid);
+    }
+
+    auto const& matcher = ruleset.matcher();
+    for (int revnum = 1; revnum <= last_revision; ++revnum)
+    {
+        if (revnum % 1000 == 0)
+            Log::info() << "validating revision " << revnum << std::endl;
+
+        matcher.set_current_revision(revnum);
+        auto check = [&](std::string const& directory)
+        {
+            if (!matcher.longest_match(directory, revnum))
+            {
+                Log::error() << "Unmatched files in svn directory /" << directory
+                             << " in r" << revnum << std::endl;
+            }
+        };
+
+        // Rules becoming active or inactive have their whole trees
+        // converted again, so those are walked, though only ever as
+        // far as their directories
+        auto const transitions = matcher.rules_in_transition(revnum);
+        if (!transitions.empty())
+        {
+            svn::revision const rev = svn_repo[revnum];
+            std::vector<std::string> directories;
+            for (Rule const* r : transitions)
+                add_tree(rev, r->svn_path().str(), listings, directories);
+            std::sort(directories.begin(), directories.end());
+            directories.erase(
+                std::unique(directories.begin(), directories.end()), directories.end());
+            for (auto const& d : directories)
+                check(d);
+        }
+
+        index.for_each(revnum, check);
+    }
+}
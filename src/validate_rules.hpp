@@ -0,0 +1,17 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef VALIDATE_RULES_DWA20131101_HPP
+# define VALIDATE_RULES_DWA20131101_HPP
+
+class svn;
+class Ruleset;
+
+// Report, as the importer would, the SVN files of revisions
+// 1..last_revision that no rule matches, without importing anything.
+// Only the directories holding changed files are matched, from an
+// index of them made once per SVN repository and cached; see
+// changed_directories.
+void validate_rules(svn const& svn_repo, Ruleset const& ruleset, int last_revision);
+
+#endif // VALIDATE_RULES_DWA20131101_HPP
@@ -0,0 +1,642 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#include "verify_conversion.hpp"
+#include "coverage.hpp"
+#include "directory_cache.hpp"
+#include "git_executable.hpp"
+#include "git_repository.hpp"
+#include "lfs_store.hpp"
+#include "log.hpp"
+#include "lru_cache.hpp"
+#include "marks_file_name.hpp"
+#include "mark_sha_map.hpp"
+#include "options.hpp"
+#include "ruleset.hpp"
+#include "sha1.hpp"
+#include "svn.hpp"
+#include "text_normalizer.hpp"
+
+#include <boost/filesystem.hpp>
+#include <boost/function_output_iterator.hpp>
+#include <boost/iostreams/device/file_descriptor.hpp>
+#include <boost/iostreams/stream.hpp>
+#include <boost/process.hpp>
+#include <boost/regex.hpp>
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <svn_checksum.h>
+#include <svn_fs.h>
+
+namespace
+{
+    std::size_t const directory_cache_entries = 1 << 20;
+    std::size_t const blob_cache_entries = 1 << 22;
+
+    // The differences listed for a ref at a revision; the rest are
+    // only counted
+    std::size_t const differences_listed = 20;
+
+    // A file of a Git tree
+    struct tree_file
+    {
+        unsigned long mode;
+        std::string sha;        // of its blob, in hex
+
+        friend bool operator==(tree_file const& x, tree_file const& y)
+        {
+            return x.mode == y.mode && x.sha == y.sha;
+        }
+    };
+    typedef std::map<std::string, tree_file> tree_listing;      // by Git path
+
+    // A branch or tag the rules give a repository, and the revisions
+    // they give it in
+    struct ref_rule
+    {
+        std::string ref_name;
+        std::string svn_path;
+        std::size_t min, max;
+        bool is_tag;
+    };
+
+    // A repository of the conversion, as its last checkpoint left it
+    struct converted_repository
+    {
+        std::string name;
+        std::vector<ref_rule> refs;
+        git_repository::marks_by_ref marks;
+        std::size_t saved_revnum;
+        mark_sha_map commit_shas;
+    };
+
+    // A ref to check at a revision, and the files SVN says it holds
+    struct ref_check
+    {
+        converted_repository const* repo;
+        std::string ref_name;
+        std::string commit;             // empty if there's none yet
+        std::vector<std::string> svn_paths;
+        tree_listing expected;
+    };
+
+    struct rule_detector
+    {
+        explicit rule_detector(bool& found) : found(found) {}
+        void operator()(Rule const*) const { found = true; }
+        bool& found;
+    };
+
+    typedef patrie<Rule, coverage>::reader rule_reader;
+
+    bool svn_rules_beneath(rule_reader const& matcher, std::string const& svn_path, int revnum)
+    {
+        bool found = false;
+        matcher.svn_rules_beneath(
+            svn_path, revnum, boost::make_function_output_iterator(rule_detector(found)));
+        return found;
+    }
+
+    svn_error_t* append_to_string(void* baton, char const* data, apr_size_t* len)
+    {
+        static_cast<std::string*>(baton)->append(data, *len);
+        return SVN_NO_ERROR;
+    }
+
+    // The Git blob SHA-1s of SVN contents, by the key the importer
+    // gives them, shared by every thread
+    struct blob_cache
+    {
+        blob_cache() : shas("verified blobs", blob_cache_entries, 16) {}
+
+        bool find(std::string const& key, std::string& sha)
+        {
+            auto const p = shas.find(key);
+            if (!p)
+                return false;
+            sha = *p;
+            return true;
+        }
+
+        void insert(std::string const& key, std::string const& sha)
+        {
+            shas.insert(key, sha, 1);
+        }
+
+     private:
+        lru_cache<std::string, std::string, std::hash<std::string>, std::mutex> shas;
+    };
+
+    // One thread's view of SVN, working out the trees the rules call for
+    struct svn_reader
+    {
+        svn_reader(
+            std::string const& svn_path, std::string const& authors_file, Ruleset const& rules)
+            : repo(svn_path, authors_file), matcher(rules.matcher()), cache(directory_cache_entries)
+        {
+            if (!options.lfs_pattern.empty())
+                lfs_pattern.assign(options.lfs_pattern);
+        }
+
+        // Add to each of checks, keyed by repository and ref name, the
+        // files of rev the rules map to it
+        void expect(
+            svn::revision const& rev,
+            std::map<std::pair<std::string, std::string>, ref_check*> const& checks,
+            blob_cache& blobs)
+        {
+            std::vector<std::string> roots;
+            for (auto const& kv : checks)
+                roots.insert(roots.end(), kv.second->svn_paths.begin(), kv.second->svn_paths.end());
+            std::sort(roots.begin(), roots.end());
+            roots.erase(std::unique(roots.begin(), roots.end()), roots.end());
+
+            for (std::size_t i = 0; i < roots.size(); ++i)
+            {
+                std::string const& root = roots[i];
+                // A root beneath another is visited with it
+                if (i > 0 && path(root).starts_with(path(roots[i - 1])))
+                {
+                    roots.erase(roots.begin() + i--);
+                    continue;
+                }
+                switch (svn::call(svn_fs_check_path, rev.fs_root, root.c_str(), AprScratch(rev.scratch)))
+                {
+                case svn_node_dir:
+                    visit_directory(rev, root, svn::node_id(rev, root.c_str()), checks, blobs);
+                    break;
+                case svn_node_file:
+                    add_file(rev, root, match(root, rev.revnum), checks, blobs);
+                    break;
+                default:
+                    break;
+                }
+            }
+        }
+
+     private:
+        Rule const* match(std::string const& svn_path, int revnum) const
+        {
+            Rule const* const m = matcher.longest_match(svn_path, revnum);
+            if (m)
+                coverage::match(*m, revnum);
+            return m && m->excludes() ? nullptr : m;
+        }
+
+        // Visit the files beneath dir.  Where no rule lies beneath a
+        // directory, its files all match the rule it matches, as in
+        // the importer, so a directory no checked ref takes is skipped.
+        void visit_directory(
+            svn::revision const& rev, std::string const& dir, std::string const& node_id,
+            std::map<std::pair<std::string, std::string>, ref_check*> const& checks,
+            blob_cache& blobs, Rule const* covering = nullptr)
+        {
+            if (!covering && !svn_rules_beneath(matcher, dir, rev.revnum))
+            {
+                covering = match(dir, rev.revnum);
+                if (!covering || !checks.count(std::make_pair(covering->git_repo_name(), covering->git_ref_name())))
+                    return;
+            }
+
+            auto const listing = svn::list_directory(rev, dir.c_str(), node_id, cache);
+            for (auto const& e : *listing)
+            {
+                std::string const svn_path = dir.empty() ? e.name : dir + "/" + e.name;
+                if (e.is_dir)
+                    visit_directory(rev, svn_path, e.node_id, checks, blobs, covering);
+                else
+                    add_file(rev, svn_path, covering ? covering : match(svn_path, rev.revnum), checks, blobs);
+            }
+        }
+
+        void add_file(
+            svn::revision const& rev, std::string const& svn_path, Rule const* rule,
+            std::map<std::pair<std::string, std::string>, ref_check*> const& checks,
+            blob_cache& blobs)
+        {
+            if (!rule)
+                return;
+            auto const check = checks.find(std::make_pair(rule->git_repo_name(), rule->git_ref_name()));
+            if (check == checks.end())
+                return;
+            std::string const git_path = rule->git_path(path(svn_path)).str();
+            check->second->expected[git_path] = file(rev, svn_path, git_path, blobs);
+        }
+
+        // The mode and blob the importer writes for the file at
+        // svn_path, as convert_svn_file does
+        tree_file file(
+            svn::revision const& rev, std::string const& svn_path, std::string const& git_path,
+            blob_cache& blobs)
+        {
+            AprScratch scope(rev.scratch);
+            char const* const p = svn_path.c_str();
+            tree_file result;
+            result.mode = svn::call(svn_fs_node_prop, rev.fs_root, p, "svn:executable", scope)
+                ? 0100755ul : 0100644ul;
+
+            text_normalizer const* normalizer = nullptr;
+            if (options.normalize_text)
+            {
+                svn_string_t const* eol_style = svn::call(
+                    svn_fs_node_prop, rev.fs_root, p, "svn:eol-style", scope);
+                svn_string_t const* keywords = svn::call(
+                    svn_fs_node_prop, rev.fs_root, p, "svn:keywords", scope);
+                auto key = std::make_pair(
+                    eol_style ? std::string(eol_style->data, eol_style->len) : std::string(),
+                    keywords ? std::string(keywords->data, keywords->len) : std::string());
+                auto n = normalizers.find(key);
+                if (n == normalizers.end())
+                    n = normalizers.emplace(key, text_normalizer(key.first, key.second)).first;
+                if (n->second.enabled())
+                    normalizer = &n->second;
+            }
+
+            // Files --lfs-threshold offloads are committed as pointers
+            bool const lfs = options.lfs_threshold > 0 && !normalizer
+                && (options.lfs_pattern.empty() || boost::regex_search(git_path, lfs_pattern))
+                && svn::call(svn_fs_file_length, rev.fs_root, p, scope) >= options.lfs_threshold;
+
+            // SVN's checksum, where it has one, spares reading contents
+            // seen before
+            svn_checksum_t* checksum = svn::call(
+                svn_fs_file_checksum, svn_checksum_sha1, rev.fs_root, p, FALSE, scope);
+            std::string key;
+            if (checksum)
+            {
+                key = std::string("sha1:") + svn_checksum_to_cstring(checksum, scope);
+                if (normalizer)
+                    key += normalizer->key_suffix();
+                if (lfs)
+                    key += "|lfs";
+                if (blobs.find(key, result.sha))
+                    return result;
+            }
+
+            std::string contents;
+            svn_stream_t* in_stream = svn::call(svn_fs_file_contents, rev.fs_root, p, scope);
+            svn_stream_t* out_stream = svn_stream_create(&contents, scope);
+            svn_stream_set_write(out_stream, append_to_string);
+            svn::check(svn_stream_copy3, in_stream, out_stream, nullptr, nullptr, scope);
+            if (normalizer)
+                normalizer->apply(contents);
+            if (lfs)
+            {
+                contents = lfs_object::pointer(
+                    sha256().update(contents).hex_digest(), contents.size());
+            }
+            result.sha = git_blob_hasher(contents.size()).update(contents).hex_digest();
+            if (checksum)
+                blobs.insert(key, result.sha);
+            return result;
+        }
+
+     public:
+        svn repo;
+
+     private:
+        rule_reader matcher;    // shared by every thread
+        directory_cache cache;
+        std::map<std::pair<std::string, std::string>, text_normalizer> normalizers;
+        boost::regex lfs_pattern;
+    };
+
+    // The output of git, run on the repository git_dir with args
+    std::string git_output(std::string const& git_dir, std::vector<std::string> args)
+    {
+        args.insert(args.begin(), git_executable());
+
+        // Our end of the pipe is close-on-exec, so that the children
+        // of other threads don't hold it open
+        int fds[2];
+        if (::pipe2(fds, O_CLOEXEC) != 0)
+            throw std::runtime_error("Couldn't create a pipe");
+        boost::iostreams::file_descriptor_source source(fds[0], boost::iostreams::close_handle);
+        boost::process::child child = [&] {
+            boost::iostreams::file_descriptor_sink sink(fds[1], boost::iostreams::close_handle);
+            return boost::process::execute(
+                boost::process::initializers::run_exe(git_executable()),
+                boost::process::initializers::set_env(std::vector<std::string>({ "GIT_DIR=" + git_dir })),
+                boost::process::initializers::set_args(args),
+                boost::process::initializers::bind_stdout(sink),
+                boost::process::initializers::throw_on_error());
+        }();
+
+        boost::iostreams::stream<boost::iostreams::file_descriptor_source> out(source);
+        std::string const output((std::istreambuf_iterator<char>(out)), std::istreambuf_iterator<char>());
+        int const status = boost::process::wait_for_exit(child);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            throw std::runtime_error("git " + args[1] + " failed in " + git_dir);
+        return output;
+    }
+
+    // The files of the tree of commit, leaving out the gitlinks and
+    // generated files that don't come from SVN
+    tree_listing git_tree(std::string const& git_dir, std::string const& commit)
+    {
+        tree_listing result;
+        if (commit.empty())
+            return result;
+        std::string const output = git_output(git_dir, { "ls-tree", "-r", "-z", "--full-tree", commit });
+
+        // <mode> SP <type> SP <sha> HT <path> NUL
+        for (std::size_t pos = 0; pos < output.size();)
+        {
+            std::size_t const end = output.find('\0', pos);
+            std::size_t const tab = output.find('\t', pos);
+            if (end == std::string::npos || tab > end || tab < pos + 47)
+                throw std::runtime_error("Unrecognized output of git ls-tree in " + git_dir);
+            tree_file f = { std::strtoul(output.c_str() + pos, nullptr, 8), output.substr(tab - 40, 40) };
+            std::string name = output.substr(tab + 1, end - tab - 1);
+            pos = end + 1;
+            if (f.mode == 0160000 || name == ".gitmodules" || name == ".gitattributes")
+                continue;
+            result.emplace(std::move(name), std::move(f));
+        }
+        return result;
+    }
+
+    std::string describe(tree_file const& f)
+    {
+        char mode[8];
+        std::snprintf(mode, sizeof(mode), "%06lo", f.mode);
+        return std::string(mode) + " " + f.sha;
+    }
+
+    // Compare the ref's tree with the files expected at revnum,
+    // logging the differences.  Returns true iff there are none.
+    bool compare(ref_check const& check, int revnum)
+    {
+        tree_listing const actual = git_tree(check.repo->name, check.commit);
+        std::string const where =
+            "r" + std::to_string(revnum) + " " + check.repo->name + " " + check.ref_name + ": ";
+        if (check.commit.empty() && !check.expected.empty())
+        {
+            Log::error() << where << "no commit, but " << check.expected.size()
+                         << " files in SVN" << std::endl;
+            return false;
+        }
+
+        std::size_t differences = 0;
+        auto report = [&](std::string const& text) {
+            if (++differences <= differences_listed)
+                Log::error() << where << text << std::endl;
+        };
+        auto e = check.expected.begin();
+        auto a = actual.begin();
+        while (e != check.expected.end() || a != actual.end())
+        {
+            if (a == actual.end() || (e != check.expected.end() && e->first < a->first))
+            {
+                report(e->first + " is missing; expected " + describe(e->second));
+                ++e;
+            }
+            else if (e == check.expected.end() || a->first < e->first)
+            {
+                // What the conversion generates, if SVN doesn't have it
+                report(a->first + " is not in SVN; found " + describe(a->second));
+                ++a;
+            }
+            else
+            {
+                if (!(e->second == a->second))
+                    report(e->first + ": expected " + describe(e->second) + ", found " + describe(a->second));
+                ++e;
+                ++a;
+            }
+        }
+        if (differences > differences_listed)
+            Log::error() << where << differences - differences_listed << " more differences" << std::endl;
+        return differences == 0;
+    }
+
+    // The repositories of the rules, with the ref rules of each and
+    // the state of their conversion
+    std::vector<std::unique_ptr<converted_repository>> converted_repositories(Ruleset const& ruleset)
+    {
+        std::vector<std::unique_ptr<converted_repository>> result;
+        for (Ruleset::Repository const& r : ruleset.repositories())
+        {
+            if (!boost::filesystem::exists(r.name))
+            {
+                Log::warn() << "repository " << r.name << " hasn't been converted" << std::endl;
+                continue;
+            }
+            std::unique_ptr<converted_repository> repo(new converted_repository);
+            repo->name = r.name;
+
+            boost2git::RepoRule key;
+            key.git_repo_name = r.name;
+            boost2git::RepoRule const& repo_rule = *ruleset.getAST().find(key);
+            for (boost2git::BranchRule const* b : r.branches)
+            {
+                ref_rule const rr = {
+                    boost2git::git_ref_name(b), b->svn_path.str(),
+                    std::max(b->min, repo_rule.minrev), std::min(b->max, repo_rule.maxrev),
+                    std::strcmp(b->git_ref_qualifier, "refs/tags/") == 0
+                };
+                repo->refs.push_back(rr);
+            }
+
+            repo->marks = git_repository::saved_marks(r.name, repo->saved_revnum);
+            if (repo->saved_revnum > 0)
+                repo->commit_shas.read_marks_file(marks_file_path(r.name));
+            result.push_back(std::move(repo));
+        }
+        return result;
+    }
+
+    // The refs of repos to check at revnum
+    std::vector<std::shared_ptr<ref_check>> refs_to_check(
+        std::vector<std::unique_ptr<converted_repository>> const& repos, int revnum)
+    {
+        std::vector<std::shared_ptr<ref_check>> result;
+        for (auto const& repo : repos)
+        {
+            if (std::size_t(revnum) > repo->saved_revnum)
+                continue;
+            std::map<std::string, std::shared_ptr<ref_check>> checks;
+            for (ref_rule const& rr : repo->refs)
+            {
+                if (std::size_t(revnum) < rr.min || std::size_t(revnum) > rr.max)
+                    continue;
+                rev_mark_map::value_type commit(0, 0);
+                auto const marks = repo->marks.find(rr.ref_name);
+                bool const made = marks != repo->marks.end()
+                    && marks->second.find_at_or_before(revnum, commit);
+                // Tags are checked where they're made
+                if (rr.is_tag && (!made || commit.first != std::size_t(revnum)))
+                    continue;
+
+                std::shared_ptr<ref_check>& check = checks[rr.ref_name];
+                if (!check)
+                {
+                    check = std::make_shared<ref_check>();
+                    check->repo = repo.get();
+                    check->ref_name = rr.ref_name;
+                    char sha[mark_sha_map::sha_length];
+                    if (made && !repo->commit_shas.find(commit.second, sha))
+                        throw std::runtime_error(
+                            "No SHA-1 known for mark :" + std::to_string(commit.second)
+                            + " in repository " + repo->name);
+                    if (made)
+                        check->commit.assign(sha, sizeof(sha));
+                }
+                check->svn_paths.push_back(path(rr.svn_path).str());
+            }
+            for (auto& kv : checks)
+                result.push_back(std::move(kv.second));
+        }
+        return result;
+    }
+
+    // Tasks shared out between the threads, to which tasks may add
+    // more.  The threads finish once there's nothing to do and none
+    // of them is busy.
+    template <class Worker>
+    struct task_queue
+    {
+        typedef std::function<void(Worker&)> task;
+
+        task_queue() : busy(0) {}
+
+        void push(task t)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(std::move(t));
+            ready.notify_one();
+        }
+
+        // Do tasks with a worker made by make_worker when first needed
+        void work(std::function<Worker*()> const& make_worker)
+        {
+            std::unique_ptr<Worker> worker;
+            std::unique_lock<std::mutex> lock(mutex);
+            for (;;)
+            {
+                ready.wait(lock, [&]{ return !tasks.empty() || busy == 0; });
+                if (tasks.empty())
+                    break;
+                task t = std::move(tasks.front());
+                tasks.pop_front();
+                ++busy;
+                lock.unlock();
+                try
+                {
+                    if (!worker)
+                        worker.reset(make_worker());
+                    t(*worker);
+                }
+                catch (...)
+                {
+                    lock.lock();
+                    if (!error)
+                        error = std::current_exception();
+                    tasks.clear();
+                    lock.unlock();
+                }
+                lock.lock();
+                --busy;
+                ready.notify_all();
+            }
+            ready.notify_all();
+        }
+
+        std::exception_ptr error;
+
+     private:
+        std::mutex mutex;
+        std::condition_variable ready;
+        std::deque<task> tasks;
+        std::size_t busy;
+    };
+}
+
+void verify_conversion(
+    std::string const& svn_path, std::string const& authors_file,
+    Ruleset const& ruleset, std::vector<int> const& revisions, unsigned jobs)
+{
+    auto const repos = converted_repositories(ruleset);
+    for (auto const& repo : repos)
+    {
+        for (int revnum : revisions)
+        {
+            if (std::size_t(revnum) > repo->saved_revnum)
+            {
+                Log::warn() << repo->name << " has been converted only up to r" << repo->saved_revnum
+                            << ", so isn't checked after it" << std::endl;
+                break;
+            }
+        }
+    }
+
+    // Each ref's differences are logged together, in order of
+    // revision, repository and ref
+    std::mutex results_mutex;
+    std::map<std::tuple<int, std::string, std::string>, std::string> logs;
+    std::size_t checked = 0, differing = 0;
+
+    blob_cache blobs;
+    ruleset.matcher().freeze();
+    task_queue<svn_reader> queue;
+    for (int revnum : revisions)
+    {
+        queue.push([&, revnum](svn_reader& reader) {
+            std::vector<std::shared_ptr<ref_check>> const checks = refs_to_check(repos, revnum);
+            std::map<std::pair<std::string, std::string>, ref_check*> by_name;
+            for (auto const& c : checks)
+                by_name[std::make_pair(c->repo->name, c->ref_name)] = c.get();
+            reader.expect(reader.repo[revnum], by_name, blobs);
+
+            for (auto const& c : checks)
+            {
+                queue.push([&, c, revnum](svn_reader&) {
+                    std::string log;
+                    bool same;
+                    {
+                        Log::capture capture;
+                        same = compare(*c, revnum);
+                        log = capture.str();
+                    }
+                    std::lock_guard<std::mutex> lock(results_mutex);
+                    ++checked;
+                    differing += !same;
+                    logs[std::make_tuple(revnum, c->repo->name, c->ref_name)].swap(log);
+                });
+            }
+        });
+    }
+
+    auto make_reader = [&] { return new svn_reader(svn_path, authors_file, ruleset); };
+    std::vector<std::thread> threads;
+    for (unsigned n = std::max(jobs, 1u); n > 1; --n)
+        threads.emplace_back([&] { queue.work(make_reader); });
+    queue.work(make_reader);
+    for (auto& t : threads)
+        t.join();
+    if (queue.error)
+        std::rethrow_exception(queue.error);
+
+    for (auto const& kv : logs)
+        std::cout << kv.second;
+    Log::info() << "checked " << checked << " refs at " << revisions.size() << " revisions: "
+                << differing << " differ from SVN" << std::endl;
+}
@@ -0,0 +1,29 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef VERIFY_CONVERSION_DWA20131119_HPP
+# define VERIFY_CONVERSION_DWA20131119_HPP
+
+# include <string>
+# include <vector>
+
+class Ruleset;
+
+// Check the conversion in the current directory against the SVN
+// repository at svn_path: at each of the given revisions, the tree of
+// each ref's commit at or before it must hold exactly the files the
+// rules map to the ref from SVN, with the modes and Git blob SHA-1s
+// their SVN contents and properties call for.  Commits are found
+// through each repository's saved state and marks file, and trees
+// with "git ls-tree", so nothing is checked out.  Branches are checked
+// at every revision given, and tags, which never change once made, at
+// the revision they were made in, if it is among those given.
+//
+// The revisions are shared out between jobs threads, each reading
+// SVN through a connection of its own, and the comparisons of their
+// refs likewise.  Each difference is logged as an error.
+void verify_conversion(
+    std::string const& svn_path, std::string const& authors_file,
+    Ruleset const& ruleset, std::vector<int> const& revisions, unsigned jobs);
+
+#endif // VERIFY_CONVERSION_DWA20131119_HPP
@@ -0,0 +1,211 @@
+# Generates a synthetic SVN repository, and rules to convert it, for
+# the bench target.  The repository is written as a dump file and
+# loaded with svnadmin, which is much faster than committing through a
+# working copy.
+#
+# Expects BENCH_DIR, SVNADMIN and the BENCH_* scale parameters set in
+# test/CMakeLists.txt.
+#
+# Layout: trunk/README.txt and trunk/libs/libK/fileJ.txt.  Revision 1
+# adds everything; each later revision modifies BENCH_CHANGES
+# files, rotating among trunk and the branches created so far.
+# Branches and tags are copies of trunk made at evenly spaced
+# revisions.  The rules give each library its own repository, as a
+# submodule of a "bench" super-project.
+
+set(REPO_PATH "${BENCH_DIR}/bench-repo")
+set(DUMP_FILE "${BENCH_DIR}/bench-repo.dump")
+set(RULES_FILE "${BENCH_DIR}/bench-repositories.txt")
+
+file(REMOVE_RECURSE "${REPO_PATH}")
+file(REMOVE "${DUMP_FILE}")
+
+# File contents of BENCH_FILE_SIZE bytes, each beginning with a line
+# that makes it unique
+set(padding "x")
+string(LENGTH "${padding}" padding_length)
+while(padding_length LESS BENCH_FILE_SIZE)
+  set(padding "${padding}${padding}")
+  string(LENGTH "${padding}" padding_length)
+endwhile()
+string(SUBSTRING "${padding}" 0 ${BENCH_FILE_SIZE} padding)
+
+function(dump_props var)
+  set(props "")
+  while(ARGN)
+    list(GET ARGN 0 key)
+    list(GET ARGN 1 value)
+    list(REMOVE_AT ARGN 0 1)
+    string(LENGTH "${key}" key_length)
+    string(LENGTH "${value}" value_length)
+    set(props "${props}K ${key_length}\n${key}\nV ${value_length}\n${value}\n")
+  endwhile()
+  set(${var} "${props}PROPS-END\n" PARENT_SCOPE)
+endfunction()
+
+# Sets var to n as two digits
+function(two_digits var n)
+  if(n LESS 10)
+    set(n "0${n}")
+  endif()
+  set(${var} "${n}" PARENT_SCOPE)
+endfunction()
+
+# Revisions are a second apart, starting 2013-10-01
+function(dump_revision revnum message)
+  math(EXPR day "${revnum} / 86400 + 1")
+  math(EXPR hour "${revnum} / 3600 % 24")
+  math(EXPR minute "${revnum} / 60 % 60")
+  math(EXPR second "${revnum} % 60")
+  foreach(x day hour minute second)
+    two_digits(${x} ${${x}})
+  endforeach()
+  dump_props(props
+    svn:log "${message}"
+    svn:author "bench"
+    svn:date "2013-10-${day}T${hour}:${minute}:${second}.000000Z")
+  string(LENGTH "${props}" length)
+  file(APPEND "${DUMP_FILE}"
+    "Revision-number: ${revnum}\n"
+    "Prop-content-length: ${length}\n"
+    "Content-length: ${length}\n\n"
+    "${props}\n")
+endfunction()
+
+function(dump_dir node_path)
+  file(APPEND "${DUMP_FILE}"
+    "Node-path: ${node_path}\n"
+    "Node-kind: dir\n"
+    "Node-action: add\n"
+    "Prop-content-length: 10\n"
+    "Content-length: 10\n\n"
+    "PROPS-END\n\n\n")
+endfunction()
+
+function(dump_copy node_path from_path from_rev)
+  file(APPEND "${DUMP_FILE}"
+    "Node-path: ${node_path}\n"
+    "Node-kind: dir\n"
+    "Node-action: add\n"
+    "Node-copyfrom-rev: ${from_rev}\n"
+    "Node-copyfrom-path: ${from_path}\n\n\n")
+endfunction()
+
+function(dump_file node_path action revnum)
+  set(text "${node_path} as of r${revnum}\n${padding}\n")
+  string(LENGTH "${text}" text_length)
+  if(action STREQUAL "add")
+    math(EXPR length "${text_length} + 10")
+    file(APPEND "${DUMP_FILE}"
+      "Node-path: ${node_path}\n"
+      "Node-kind: file\n"
+      "Node-action: add\n"
+      "Prop-content-length: 10\n"
+      "Text-content-length: ${text_length}\n"
+      "Content-length: ${length}\n\n"
+      "PROPS-END\n${text}\n\n")
+  else()
+    file(APPEND "${DUMP_FILE}"
+      "Node-path: ${node_path}\n"
+      "Node-kind: file\n"
+      "Node-action: change\n"
+      "Text-content-length: ${text_length}\n"
+      "Content-length: ${text_length}\n\n"
+      "${text}\n\n")
+  endif()
+endfunction()
+
+math(EXPR files_per_library "(${BENCH_FILES} + ${BENCH_LIBRARIES} - 1) / ${BENCH_LIBRARIES}")
+math(EXPR last_library "${BENCH_LIBRARIES} - 1")
+math(EXPR last_file "${files_per_library} - 1")
+
+# r1: the whole initial tree
+file(WRITE "${DUMP_FILE}" "SVN-fs-dump-format-version: 2\n\n")
+dump_revision(1 "initial tree")
+foreach(dir trunk branches tags trunk/libs)
+  dump_dir(${dir})
+endforeach()
+dump_file(trunk/README.txt add 1)
+foreach(k RANGE ${last_library})
+  dump_dir(trunk/libs/lib${k})
+  foreach(j RANGE ${last_file})
+    dump_file(trunk/libs/lib${k}/file${j}.txt add 1)
+  endforeach()
+endforeach()
+
+# Revisions at which to create each branch and tag
+math(EXPR copies "${BENCH_BRANCHES} + ${BENCH_TAGS}")
+math(EXPR copy_spacing "${BENCH_REVISIONS} / (${copies} + 1)")
+if(copy_spacing LESS 1)
+  set(copy_spacing 1)
+endif()
+
+set(roots trunk)
+set(branches 0)
+set(tags 0)
+set(change 0)
+math(EXPR total_files "${BENCH_LIBRARIES} * ${files_per_library}")
+foreach(revnum RANGE 2 ${BENCH_REVISIONS})
+  math(EXPR prev "${revnum} - 1")
+  math(EXPR copy_due "${revnum} % ${copy_spacing}")
+  math(EXPR copies_made "${branches} + ${tags}")
+  if(copy_due EQUAL 0 AND copies_made LESS copies)
+    if(branches LESS BENCH_BRANCHES)
+      dump_revision(${revnum} "create branch b${branches}")
+      dump_copy(branches/b${branches} trunk ${prev})
+      list(APPEND roots branches/b${branches})
+      math(EXPR branches "${branches} + 1")
+    else()
+      dump_revision(${revnum} "create tag t${tags}")
+      dump_copy(tags/t${tags} trunk ${prev})
+      math(EXPR tags "${tags} + 1")
+    endif()
+  else()
+    list(LENGTH roots nroots)
+    math(EXPR r "${revnum} % ${nroots}")
+    list(GET roots ${r} root)
+    dump_revision(${revnum} "modify ${root}")
+    foreach(i RANGE 1 ${BENCH_CHANGES})
+      math(EXPR f "${change} % ${total_files}")
+      math(EXPR k "${f} / ${files_per_library}")
+      math(EXPR j "${f} % ${files_per_library}")
+      dump_file(${root}/libs/lib${k}/file${j}.txt change ${revnum})
+      math(EXPR change "${change} + 1")
+    endforeach()
+  endif()
+endforeach()
+
+execute_process(COMMAND "${SVNADMIN}" create "${REPO_PATH}" RESULT_VARIABLE result)
+if(NOT result STREQUAL 0)
+  message(FATAL_ERROR "svnadmin create failed with result \"${result}\"")
+endif()
+execute_process(COMMAND "${SVNADMIN}" load --quiet "${REPO_PATH}"
+  INPUT_FILE "${DUMP_FILE}" RESULT_VARIABLE result)
+if(NOT result STREQUAL 0)
+  message(FATAL_ERROR "svnadmin load failed with result \"${result}\"")
+endif()
+
+# The rules, in the style of repositories.txt
+set(rules "abstract repository bench_branches\n{\n  branches\n  {\n")
+set(rules "${rules}    [:] \"/trunk/\" : \"master\";\n")
+math(EXPR last_branch "${BENCH_BRANCHES} - 1")
+if(BENCH_BRANCHES GREATER 0)
+  foreach(b RANGE ${last_branch})
+    set(rules "${rules}    [:] \"/branches/b${b}/\" : \"b${b}\";\n")
+  endforeach()
+endif()
+set(rules "${rules}  }\n  tags\n  {\n")
+math(EXPR last_tag "${BENCH_TAGS} - 1")
+if(BENCH_TAGS GREATER 0)
+  foreach(t RANGE ${last_tag})
+    set(rules "${rules}    [:] \"/tags/t${t}/\" : \"t${t}\";\n")
+  endforeach()
+endif()
+set(rules "${rules}  }\n}\n\n")
+set(rules "${rules}repository bench : bench_branches\n{\n  content\n  {\n    \"README.txt\";\n  }\n}\n")
+foreach(k RANGE ${last_library})
+  set(rules "${rules}\nrepository lib${k} : bench_branches\n{\n")
+  set(rules "${rules}  submodule of \"bench\" : \"libs/lib${k}\";\n")
+  set(rules "${rules}  content\n  {\n    \"libs/lib${k}/\";\n  }\n}\n")
+endforeach()
+file(WRITE "${RULES_FILE}" "${rules}")
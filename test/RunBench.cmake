@@ -0,0 +1,98 @@
+# Converts the repository made by GenerateBenchRepo.cmake, once with
+# --dry-run and once writing Git repositories in each --traversal-order
+# (the "git" run taking SVN's own order), and once packing changed
+# files as deltas with --svn-deltas, failing if none were; and reports the
+# throughput of each from svn2git's --profile totals.  A line per run
+# is appended to bench-results.csv in BENCH_DIR, so that results can be
+# compared across builds.
+#
+# Expects BENCH_DIR, SVN2GIT and GIT.
+
+set(REPO_PATH "${BENCH_DIR}/bench-repo")
+set(RULES_FILE "${BENCH_DIR}/bench-repositories.txt")
+set(RESULTS_FILE "${BENCH_DIR}/bench-results.csv")
+
+if(NOT EXISTS "${RESULTS_FILE}")
+  file(WRITE "${RESULTS_FILE}" "time,mode,revisions,seconds,revisions_per_second,bytes,bytes_per_second\n")
+endif()
+
+# Converts "12.345" seconds to 12345 milliseconds
+function(to_milliseconds var seconds)
+  string(REGEX REPLACE "^([0-9]+)\\.([0-9][0-9][0-9])$" "\\1\\2" ms "${seconds}")
+  math(EXPR ms "${ms}")
+  if(ms LESS 1)
+    set(ms 1)
+  endif()
+  set(${var} ${ms} PARENT_SCOPE)
+endfunction()
+
+# Sets var to the bytes of the profile report's rows named name, added
+# up over the repositories
+function(profile_bytes var name output)
+  set(bytes 0)
+  string(REGEX MATCHALL "\n${name} +[^ ]+ +[0-9]+ +[0-9.]+ +[0-9.]+ +[0-9]+" rows "${output}")
+  foreach(row IN LISTS rows)
+    string(REGEX REPLACE ".* ([0-9]+)$" "\\1" row_bytes "${row}")
+    math(EXPR bytes "${bytes} + ${row_bytes}")
+  endforeach()
+  set(${var} ${bytes} PARENT_SCOPE)
+endfunction()
+
+function(bench mode)
+  set(work_dir "${BENCH_DIR}/bench-${mode}")
+  file(REMOVE_RECURSE "${work_dir}")
+  file(MAKE_DIRECTORY "${work_dir}")
+
+  execute_process(
+    COMMAND "${SVN2GIT}" ${ARGN}
+      --quiet
+      --profile
+      --git "${GIT}"
+      --rules "${RULES_FILE}"
+      --svnrepo "${REPO_PATH}"
+    WORKING_DIRECTORY "${work_dir}"
+    OUTPUT_VARIABLE output
+    RESULT_VARIABLE result)
+  if(NOT result STREQUAL 0)
+    message(FATAL_ERROR "svn2git ${mode} conversion failed with result \"${result}\"")
+  endif()
+
+  # Pick the totals out of the profile report
+  if(NOT output MATCHES "\nimport revision +([0-9]+) +([0-9.]+)")
+    message(FATAL_ERROR "No profile in svn2git output:\n${output}")
+  endif()
+  set(revisions ${CMAKE_MATCH_1})
+  set(seconds ${CMAKE_MATCH_2})
+  to_milliseconds(ms ${seconds})
+
+  profile_bytes(streamed "bytes streamed" "${output}")
+  profile_bytes(packed "bytes packed" "${output}")
+  math(EXPR bytes "${streamed} + ${packed}")
+  profile_bytes(delta_bytes "bytes delta-packed" "${output}")
+  set(bench_delta_bytes ${delta_bytes} PARENT_SCOPE)
+
+  math(EXPR revisions_per_second "${revisions} * 1000 / ${ms}")
+  math(EXPR bytes_per_second "${bytes} * 1000 / ${ms}")
+  message(STATUS "${mode}: ${revisions} revisions in ${seconds}s: "
+    "${revisions_per_second} revisions/s, ${bytes_per_second} bytes/s")
+  if(delta_bytes GREATER 0)
+    message(STATUS "${mode}: ${delta_bytes} bytes of changed files packed as deltas")
+  endif()
+
+  string(TIMESTAMP now "%Y-%m-%dT%H:%M:%S")
+  file(APPEND "${RESULTS_FILE}"
+    "${now},${mode},${revisions},${seconds},${revisions_per_second},${bytes},${bytes_per_second}\n")
+endfunction()
+
+bench(dry-run --dry-run)
+bench(git)
+bench(git-name --traversal-order name)
+bench(git-offset --traversal-order offset)
+
+# Every bench revision edits the first line of files last written in
+# an earlier one, so with --svn-deltas those should be packed as
+# deltas against their previous contents, across revisions
+bench(git-svn-deltas --pack-threads 2 --tree-model --svn-deltas)
+if(bench_delta_bytes EQUAL 0)
+  message(FATAL_ERROR "svn2git --svn-deltas packed no deltas")
+endif()
@@ -0,0 +1,61 @@
+# Converts the repository made by GenerateBenchRepo.cmake with
+# --mock-fast-import, each mock fast-import slowed by LATENCY_MOCK, as
+# --mock-latency takes it, and every call to libsvn by LATENCY_SVN
+# microseconds, once for each way of scheduling the work: all of it on
+# the main thread, SVN files read on --reader-threads, commits written
+# on --write-threads, and both.  The stalls are the same on every run,
+# so the strategies meet the same delays.  The time of each run is the
+# uptime its --status-file ends with, since --profile can't be given
+# with --write-threads.  A line per run is appended to
+# latency-results.csv in BENCH_DIR.
+#
+# Expects BENCH_DIR, SVN2GIT, LATENCY_MOCK, LATENCY_SVN and
+# LATENCY_THREADS.
+
+set(REPO_PATH "${BENCH_DIR}/bench-repo")
+set(RULES_FILE "${BENCH_DIR}/bench-repositories.txt")
+set(RESULTS_FILE "${BENCH_DIR}/latency-results.csv")
+
+if(NOT EXISTS "${RESULTS_FILE}")
+  file(WRITE "${RESULTS_FILE}" "time,strategy,mock_latency,svn_latency,revisions,seconds\n")
+endif()
+
+function(bench strategy)
+  set(work_dir "${BENCH_DIR}/latency-${strategy}")
+  file(REMOVE_RECURSE "${work_dir}")
+  file(MAKE_DIRECTORY "${work_dir}")
+
+  execute_process(
+    COMMAND "${SVN2GIT}" ${ARGN}
+      --quiet
+      --mock-fast-import
+      --mock-latency "${LATENCY_MOCK}"
+      --svn-latency ${LATENCY_SVN}
+      --status-file "${work_dir}/status.prom"
+      --rules "${RULES_FILE}"
+      --svnrepo "${REPO_PATH}"
+    WORKING_DIRECTORY "${work_dir}"
+    OUTPUT_VARIABLE output
+    RESULT_VARIABLE result)
+  if(NOT result STREQUAL 0)
+    message(FATAL_ERROR "svn2git ${strategy} conversion failed with result \"${result}\"")
+  endif()
+
+  file(READ "${work_dir}/status.prom" status)
+  if(NOT status MATCHES "\nsvn2git_revision ([0-9]+)\n.*\nsvn2git_uptime_seconds ([0-9.e+-]+)\n")
+    message(FATAL_ERROR "No status in ${work_dir}/status.prom:\n${status}")
+  endif()
+  set(revisions ${CMAKE_MATCH_1})
+  set(seconds ${CMAKE_MATCH_2})
+  message(STATUS "${strategy}: ${revisions} revisions in ${seconds}s")
+
+  string(TIMESTAMP now "%Y-%m-%dT%H:%M:%S")
+  file(APPEND "${RESULTS_FILE}"
+    "${now},${strategy},\"${LATENCY_MOCK}\",${LATENCY_SVN},${revisions},${seconds}\n")
+endfunction()
+
+bench(main-thread)
+bench(reader-threads --reader-threads ${LATENCY_THREADS})
+bench(write-threads --write-threads ${LATENCY_THREADS})
+bench(reader-and-write-threads
+  --reader-threads ${LATENCY_THREADS} --write-threads ${LATENCY_THREADS})
@@ -0,0 +1,119 @@
+# Converts the repository made by GenerateBenchRepo.cmake into each
+# number of Git repositories in SCALING_REPOSITORIES, once with the
+# repositories as submodules of a super-project and once without, and
+# reports the time, memory and open files of each run, so that costs
+# growing with the number of repositories show up.  The libraries of
+# the SVN tree are dealt among the repositories in turn.  A line per
+# run is appended to scaling-results.csv in BENCH_DIR.
+#
+# Expects BENCH_DIR, SVN2GIT, GIT, SCALING_REPOSITORIES, separated by
+# commas, and the
+# BENCH_LIBRARIES, BENCH_BRANCHES and BENCH_TAGS the repository was
+# generated with.
+
+set(REPO_PATH "${BENCH_DIR}/bench-repo")
+set(RESULTS_FILE "${BENCH_DIR}/scaling-results.csv")
+
+if(NOT EXISTS "${RESULTS_FILE}")
+  file(WRITE "${RESULTS_FILE}"
+    "time,repositories,super_module,revisions,seconds,svn2git_mb,fast_import_mb,open_files\n")
+endif()
+
+# Writes rules mapping the libraries to n repositories to rules_file
+function(write_rules rules_file n super_module)
+  set(rules "abstract repository bench_branches\n{\n  branches\n  {\n")
+  set(rules "${rules}    [:] \"/trunk/\" : \"master\";\n")
+  math(EXPR last_branch "${BENCH_BRANCHES} - 1")
+  if(BENCH_BRANCHES GREATER 0)
+    foreach(b RANGE ${last_branch})
+      set(rules "${rules}    [:] \"/branches/b${b}/\" : \"b${b}\";\n")
+    endforeach()
+  endif()
+  set(rules "${rules}  }\n  tags\n  {\n")
+  math(EXPR last_tag "${BENCH_TAGS} - 1")
+  if(BENCH_TAGS GREATER 0)
+    foreach(t RANGE ${last_tag})
+      set(rules "${rules}    [:] \"/tags/t${t}/\" : \"t${t}\";\n")
+    endforeach()
+  endif()
+  set(rules "${rules}  }\n}\n\n")
+  set(rules "${rules}repository bench : bench_branches\n{\n  content\n  {\n    \"README.txt\";\n  }\n}\n")
+
+  math(EXPR last_repo "${n} - 1")
+  math(EXPR last_library "${BENCH_LIBRARIES} - 1")
+  foreach(g RANGE ${last_repo})
+    set(rules "${rules}\nrepository group${g} : bench_branches\n{\n")
+    if(super_module)
+      set(rules "${rules}  submodule of \"bench\" : \"libs/group${g}\";\n")
+    endif()
+    set(rules "${rules}  content\n  {\n")
+    foreach(k RANGE ${g} ${last_library} ${n})
+      set(rules "${rules}    \"libs/lib${k}/\";\n")
+    endforeach()
+    set(rules "${rules}  }\n}\n")
+  endforeach()
+  file(WRITE "${rules_file}" "${rules}")
+endfunction()
+
+function(bench n super_module)
+  if(super_module)
+    set(mode "${n}-submodules")
+  else()
+    set(mode "${n}-repositories")
+  endif()
+  set(work_dir "${BENCH_DIR}/scaling-${mode}")
+  file(REMOVE_RECURSE "${work_dir}")
+  file(MAKE_DIRECTORY "${work_dir}")
+  write_rules("${work_dir}/rules.txt" ${n} ${super_module})
+
+  execute_process(
+    COMMAND "${SVN2GIT}"
+      --quiet
+      --profile
+      --memory-csv "${work_dir}/memory.csv"
+      --git "${GIT}"
+      --rules "${work_dir}/rules.txt"
+      --svnrepo "${REPO_PATH}"
+    WORKING_DIRECTORY "${work_dir}"
+    OUTPUT_VARIABLE output
+    RESULT_VARIABLE result)
+  if(NOT result STREQUAL 0)
+    message(FATAL_ERROR "svn2git ${mode} conversion failed with result \"${result}\"")
+  endif()
+
+  if(NOT output MATCHES "\nimport revision +([0-9]+) +([0-9.]+)")
+    message(FATAL_ERROR "No profile in svn2git output:\n${output}")
+  endif()
+  set(revisions ${CMAKE_MATCH_1})
+  set(seconds ${CMAKE_MATCH_2})
+
+  # The high-water marks of the memory report
+  set(svn2git_mb 0)
+  if(output MATCHES "\nsvn2git resident +([0-9]+)")
+    set(svn2git_mb ${CMAKE_MATCH_1})
+  endif()
+  set(fast_import_mb 0)
+  if(output MATCHES "\nfast-import resident +([0-9]+)")
+    set(fast_import_mb ${CMAKE_MATCH_1})
+  endif()
+  set(open_files 0)
+  if(output MATCHES "\nOpen files high-water mark: ([0-9]+)")
+    set(open_files ${CMAKE_MATCH_1})
+  endif()
+
+  message(STATUS "${mode}: ${revisions} revisions in ${seconds}s, "
+    "${svn2git_mb} MB in svn2git, ${fast_import_mb} MB in fast-import, ${open_files} files open")
+
+  string(TIMESTAMP now "%Y-%m-%dT%H:%M:%S")
+  file(APPEND "${RESULTS_FILE}"
+    "${now},${n},${super_module},${revisions},${seconds},${svn2git_mb},${fast_import_mb},${open_files}\n")
+endfunction()
+
+string(REPLACE "," ";" SCALING_REPOSITORIES "${SCALING_REPOSITORIES}")
+foreach(n IN LISTS SCALING_REPOSITORIES)
+  if(n GREATER BENCH_LIBRARIES)
+    message(FATAL_ERROR "Can't split ${BENCH_LIBRARIES} libraries into ${n} repositories")
+  endif()
+  bench(${n} 1)
+  bench(${n} 0)
+endforeach()
@@ -0,0 +1,30 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#undef NDEBUG
+#include "arena.hpp"
+#include <cassert>
+#include <cstdint>
+
+int main()
+{
+    arena a(64);
+    char* const c = static_cast<char*>(a.allocate(1, 1));
+    double* const d = static_cast<double*>(a.allocate(sizeof(double), alignof(double)));
+    assert(reinterpret_cast<std::uintptr_t>(d) % alignof(double) == 0);
+    assert(static_cast<void*>(d) != c);
+
+    // Requests larger than a chunk are still satisfied
+    char* const big = static_cast<char*>(a.allocate(1000, 1));
+    big[999] = 'x';
+
+    // After a reset, the same memory is handed out again
+    a.reset();
+    assert(a.allocate(1, 1) == c);
+
+    arena_vector<int> v{arena_allocator<int>(a)};
+    for (int i = 0; i < 1000; ++i)
+        v.push_back(i);
+    assert(v[999] == 999);
+}
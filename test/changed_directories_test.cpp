@@ -0,0 +1,49 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#undef NDEBUG
+#include "changed_directories.hpp"
+#include <cassert>
+#include <string>
+#include <vector>
+
+static std::vector<std::string> directories(changed_directories const& index, int revnum)
+{
+    std::vector<std::string> result;
+    index.for_each(revnum, [&](std::string const& d) { result.push_back(d); });
+    return result;
+}
+
+int main()
+{
+    std::string const filename = "changed_directories_test.dirs";
+    std::string const long_name(70000, 'x');
+
+    changed_directories index;
+    assert(index.last_revision() == 0);
+    index.add({ "trunk/libs/config", "trunk/boost", "trunk/boost/config", "trunk/boost", "" });
+    index.add({});
+    index.add({ long_name + "/a", long_name + "/b", "tags/v1.0/boost" });
+    assert(index.last_revision() == 3);
+
+    std::vector<std::string> const r1 = { "", "trunk/boost", "trunk/boost/config", "trunk/libs/config" };
+    std::vector<std::string> const r3 = { "tags/v1.0/boost", long_name + "/a", long_name + "/b" };
+    assert(directories(index, 0).empty());
+    assert(directories(index, 1) == r1);
+    assert(directories(index, 2).empty());
+    assert(directories(index, 3) == r3);
+
+    index.save(filename, "some-uuid");
+    changed_directories loaded;
+    assert(loaded.load(filename, "some-uuid"));
+    assert(loaded.last_revision() == 3);
+    assert(directories(loaded, 1) == r1 && directories(loaded, 3) == r3);
+
+    // An index of another repository, or no index at all, isn't used
+    changed_directories untouched;
+    assert(!untouched.load(filename, "other-uuid"));
+    assert(untouched.last_revision() == 0);
+    boost::filesystem::remove(filename);
+    assert(!untouched.load(filename, "some-uuid"));
+}
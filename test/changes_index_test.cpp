@@ -0,0 +1,97 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#undef NDEBUG
+#include "changes_index.hpp"
+#include <cassert>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace changes_index_test {
+
+enum kind { modify, add, remove };
+
+struct change
+{
+    std::string path;
+    kind change_kind;
+    int node_kind;
+    bool text_mod;
+    std::string copyfrom_path;
+    long copyfrom_rev;
+};
+
+bool operator==(change const& x, change const& y)
+{
+    return x.path == y.path && x.change_kind == y.change_kind && x.node_kind == y.node_kind
+        && x.text_mod == y.text_mod && x.copyfrom_path == y.copyfrom_path
+        && x.copyfrom_rev == y.copyfrom_rev;
+}
+
+}
+
+int main()
+{
+    using namespace changes_index_test;
+    typedef changes_index<change> index;
+    std::string const filename = "changes_index_test.changes";
+    boost::filesystem::remove(filename);
+
+    std::vector<change> const r1 = {
+        { "/trunk", add, 2, false, "", -1 }, { "/trunk/README", add, 1, true, "", -1 } };
+    std::vector<change> const r2;
+    std::vector<change> const r3 = { { "/tags/v1", add, 2, false, "/trunk", 2 } };
+    std::vector<change> found;
+
+    // The repository's revisions' dates
+    std::map<int, std::string> dates = {
+        { 1, "2013-10-01T00:00:00.000000Z" }, { 2, "2013-10-02T00:00:00.000000Z" },
+        { 3, "2013-10-03T00:00:00.000000Z" } };
+    auto const date_of = [&](int revnum)
+    {
+        auto const d = dates.find(revnum);
+        return d == dates.end() ? std::string() : d->second;
+    };
+
+    {
+        index i(filename, "uuid", date_of);
+        assert(i.last_revision() == 0 && !i.find(1, found));
+        i.add(1, r1);
+        i.add(3, r3);       // not the next revision; ignored
+        i.add(2, r2);
+        assert(i.last_revision() == 2);
+        assert(i.find(1, found) && found == r1);
+        i.save();
+        assert(i.find(1, found) && found == r1);
+        assert(i.find(2, found) && found.empty());
+        i.add(3, r3);
+        i.save();
+    }
+
+    {
+        index i(filename, "uuid", date_of);
+        assert(i.last_revision() == 3);
+        assert(i.find(3, found) && found == r3);
+        assert(i.find(1, found) && found == r1);
+        assert(!i.find(4, found));
+    }
+
+    // An index of another repository isn't used
+    assert(index(filename, "other", date_of).last_revision() == 0);
+
+    // Nor is one of a repository reloaded, with the same UUID, from a
+    // dump whose revisions were renumbered or dropped
+    dates[3] = "2013-10-04T00:00:00.000000Z";
+    assert(index(filename, "uuid", date_of).last_revision() == 0);
+    dates.erase(3);
+    assert(index(filename, "uuid", date_of).last_revision() == 0);
+
+    // Nor one in which an earlier revision has another date
+    dates[3] = "2013-10-03T00:00:00.000000Z";
+    assert(index(filename, "uuid", date_of).last_revision() == 3);
+    dates[1] = "2013-09-01T00:00:00.000000Z";
+    assert(index(filename, "uuid", date_of).last_revision() == 0);
+    boost::filesystem::remove(filename);
+}
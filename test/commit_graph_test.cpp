@@ -0,0 +1,47 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#undef NDEBUG
+#include "commit_graph.hpp"
+#include <cassert>
+#include <vector>
+
+int main()
+{
+    // trunk: 1 - 2 - 4 - 6
+    // branch:     \- 3 - 5 (merges 4)
+    // release: 7 (copied from 6 and 5, by a merge of each)
+    commit_graph g;
+    g.add(1, {});
+    g.add(2, { 1 });
+    g.add(3, { 2 });
+    g.add(4, { 2 });
+    g.add(5, { 3, 4 });
+    g.add(6, { 4 });
+    g.add(7, { 6, 5 });
+
+    assert(g.reaches(4, 4, 100));
+    assert(g.reaches(6, 1, 100));
+    assert(g.reaches(5, 4, 100));
+    assert(g.reaches(7, 3, 100));
+    assert(!g.reaches(6, 5, 100));
+    assert(!g.reaches(5, 6, 100));
+    assert(!g.reaches(3, 4, 100));
+
+    // Commits of earlier runs are unknown, and lead nowhere
+    g.add(9, { 8 });
+    assert(g.reaches(9, 8, 100));
+    assert(!g.reaches(8, 1, 100));
+    assert(!g.reaches(9, 1, 100));
+
+    // The search gives up
+    commit_graph line;
+    line.add(1, {});
+    for (int m = 2; m <= 1000; ++m)
+        line.add(m, { m - 1 });
+    assert(line.reaches(1000, 1, 1000));
+    assert(!line.reaches(1000, 1, 10));
+    assert(line.reaches(1000, 995, 10));
+    assert(line.bytes_held() > 0);
+}
@@ -0,0 +1,88 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#undef NDEBUG
+#include "commit_index.hpp"
+#include <boost/filesystem.hpp>
+#include <cassert>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace commit_index_test {
+
+commit_index::entry commit(
+    std::size_t revnum, std::string const& repo, std::string const& ref, std::size_t mark,
+    unsigned char first_byte)
+{
+    commit_index::entry e = { revnum, repo, ref, mark, {} };
+    if (first_byte)
+    {
+        std::memset(e.sha, 0x11, sizeof(e.sha));
+        e.sha[0] = first_byte;
+    }
+    return e;
+}
+
+}
+
+int main()
+{
+    using namespace commit_index_test;
+    std::string const filename = (
+        boost::filesystem::temp_directory_path()
+        / boost::filesystem::unique_path("commit_index_test-%%%%-%%%%.index")).string();
+
+    std::vector<commit_index::entry> const entries = {
+        commit(10, "boost", "refs/heads/master", 1, 0xab),
+        commit(12, "boost", "refs/heads/master", 3, 0x12),
+        commit(12, "libs/any", "refs/heads/master", 2, 0xcd),
+        commit(20, "boost", "refs/heads/master", 5, 0xab),
+        commit(15, "boost", "refs/tags/v1", 4, 0),
+    };
+    commit_index::write(filename, entries);
+
+    commit_index::reader const index(filename);
+    assert(index.size() == entries.size());
+
+    // By ref, at or before a revision
+    assert(index.find("boost", "refs/heads/master", 9) == nullptr);
+    assert(index.find("boost", "refs/heads/master", 10)->mark == 1);
+    assert(index.find("boost", "refs/heads/master", 11)->mark == 1);
+    assert(index.find("boost", "refs/heads/master", 19)->mark == 3);
+    assert(index.find("boost", "refs/heads/master", 1000)->mark == 5);
+    assert(index.find("boost", "refs/tags/v1", 15)->mark == 4);
+    assert(index.find("boost", "refs/tags/v1", 14) == nullptr);
+    assert(index.find("libs/any", "refs/heads/master", 12)->mark == 2);
+    assert(index.find("libs/any", "refs/tags/v1", 20) == nullptr);
+    assert(index.find("nothing", "refs/heads/master", 20) == nullptr);
+
+    commit_index::record const* r = index.find("libs/any", "refs/heads/master", 12);
+    assert(std::string(index.name(r->repo)) == "libs/any");
+    assert(std::string(index.name(r->ref)) == "refs/heads/master");
+    assert(r->revnum == 12);
+
+    // By revision
+    auto made = index.made_in(12);
+    assert(made.size() == 2);
+    assert(index.made_in(11).empty());
+    assert(index.made_in(20).size() == 1 && index.made_in(20)[0]->mark == 5);
+
+    // By SHA-1
+    assert(index.with_sha("ab11").size() == 2);
+    assert(index.with_sha("CD11")[0]->mark == 2);
+    assert(index.with_sha(commit_index::hex(index.made_in(12)[0]->sha)).size() == 1);
+    assert(index.with_sha("ef11").empty());
+    assert(commit_index::hex(index.find("boost", "refs/tags/v1", 15)->sha)
+           == std::string(40, '0'));
+
+    // An empty index
+    commit_index::write(filename, std::vector<commit_index::entry>());
+    commit_index::reader const empty(filename);
+    assert(empty.size() == 0);
+    assert(empty.find("boost", "refs/heads/master", 10) == nullptr);
+    assert(empty.made_in(10).empty());
+
+    boost::filesystem::remove(filename);
+}
@@ -0,0 +1,94 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Built twice: with GENERATE_MATCHER, to write the matcher compiled
+// from the rules below to the file named by its argument, and
+// without, to check that matcher against the trie.
+
+#undef NDEBUG
+#include "path.hpp"
+#include "patrie.hpp"
+#include <cassert>
+#include <fstream>
+#include <string>
+
+namespace compiled_matcher_test {
+
+struct Rule
+{
+    path match;
+    std::string git_address_;
+    int min;
+    int max;
+
+    path svn_path() const { return match; }
+    std::string const& git_address() const { return git_address_; }
+};
+
+bool operator==(Rule const& lhs, Rule const& rhs)
+{
+    return lhs.match == rhs.match && lhs.min == rhs.min && lhs.max == rhs.max;
+}
+
+void report_overlap(Rule const* rule0, Rule const* rule1)
+{
+    assert(!"should never get here");
+}
+
+Rule const rules[] = {
+    {"abra/sives",         "a:b:foo/bar", 1, 3},
+    {"abra/cadabra",       "a:b:baz",     1, 3},
+    {"abra",               "a:b:fubar",   1, 3},
+    {"abra/hams",          "a:b:fu/bar",  1, 1},
+    {"abra/cadabra",       "a:b:fu/bar",  4, 5},
+    {"abra/cadabra",       "a:b:fu/baz",  7, INT_MAX},
+    {"trunk",              "c:d:",        0, INT_MAX},
+    {"trunk/libs/x y",     "e:f:",        2, 6},
+    {"trunk/libs/\"q\\?",  "g:h:",        0, 4},
+    {"branches/1.0",       "c:e:",        3, INT_MAX}
+};
+
+}
+
+int main(int argc, char** argv)
+{
+    using namespace compiled_matcher_test;
+    patrie<Rule> p;
+    for (auto const& r : rules)
+        p.insert(r);
+
+#ifdef GENERATE_MATCHER
+    assert(argc == 2);
+    std::ofstream out(argv[1]);
+    p.write_compiled_matcher(out, "test_matcher");
+    return out ? 0 : 1;
+#else
+    extern compiled_matcher const test_matcher;
+    char const* const keys[] = {
+        "", "a", "abra", "abra/", "abrac", "abra/cadabra", "abra/cadabra/x", "abra/cadabrax",
+        "abra/cadaver", "abra/hams/on", "abra/sives", "abra/siv", "quantico", "trunk",
+        "trunk/", "trunk/libs", "trunk/libs/x y", "trunk/libs/x y/z", "trunk/libs/x yz",
+        "trunk/libs/\"q\\?", "trunk/libs/\"q\\?/r", "trunkated", "branches", "branches/1.0/a"
+    };
+
+    assert(p.use_compiled_matcher(&test_matcher));
+    for (char const* key : keys)
+    {
+        std::string const k = key;
+        for (std::size_t revision = 0; revision < 10; ++revision)
+        {
+            assert(p.use_compiled_matcher(&test_matcher));
+            Rule const* const compiled = p.longest_match(k, revision);
+            p.use_compiled_matcher(nullptr);
+            assert(compiled == p.longest_match(k, revision));
+        }
+    }
+
+    // A matcher compiled from other rules is refused
+    p.insert(Rule{"tags", "c:f:", 0, INT_MAX});
+    assert(!p.use_compiled_matcher(&test_matcher));
+    assert(p.longest_match(std::string("tags/1"), 1)->git_address() == "c:f:");
+    return 0;
+#endif
+}
@@ -0,0 +1,82 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#undef NDEBUG
+#include "path.hpp"
+#include "patrie.hpp"
+#include "component_trie.hpp"
+#include <cassert>
+#include <string>
+
+namespace component_trie_test {
+
+struct Rule
+{
+    path match;
+    std::string git_address_;
+    int min;
+    int max;
+
+    path svn_path() const { return match; }
+    std::string git_address() const { return git_address_; }
+};
+
+bool operator==(Rule const& lhs, Rule const& rhs)
+{
+    return lhs.match == rhs.match && lhs.min == rhs.min && lhs.max == rhs.max;
+}
+
+void report_overlap(Rule const* rule0, Rule const* rule1)
+{
+    assert(!"should never get here");
+}
+
+}
+
+int main()
+{
+    using component_trie_test::Rule;
+    Rule const rules[] = {
+        {"",                   "r:s:",        5, 6},
+        {"abra/sives",         "a:b:foo/bar", 1, 3},
+        {"abra/cadabra",       "a:b:baz",     1, 3},
+        {"abra",               "a:b:fubar",   1, 3},
+        {"abra/hams",          "a:b:fu/bar",  1, 1},
+        {"abra/cadabra",       "a:b:fu/bar",  4, 5},
+        {"abra/cadabra",       "a:b:fu/baz",  7, INT_MAX},
+        {"abra/cadabra/x/y/z", "a:c:",        0, INT_MAX},
+        {"trunk",              "c:d:",        0, INT_MAX},
+        {"trunk/libs/x y",     "e:f:",        2, 6},
+        {"branches/1.0",       "c:e:",        3, INT_MAX}
+    };
+
+    patrie<Rule> p;
+    for (auto const& r : rules)
+        p.insert(r);
+
+    // Many components, so the hash table grows
+    component_trie<Rule> c;
+    for (auto const& r : p.all_rules())
+        c.insert(r);
+    for (int i = 0; i < 100; ++i)
+        p.insert(Rule{"tags/" + std::to_string(i), "t:" + std::to_string(i) + ":", 0, INT_MAX});
+    for (std::size_t i = sizeof(rules) / sizeof(rules[0]); i < p.all_rules().size(); ++i)
+        c.insert(p.all_rules()[i]);
+
+    char const* const keys[] = {
+        "", "a", "abra", "abra/", "abrac", "abra/cadabra", "abra/cadabra/x", "abra/cadabrax",
+        "abra/cadabra/x/y", "abra/cadabra/x/y/z", "abra/cadabra/x/y/z/w", "abra//cadabra",
+        "abra/cadaver", "abra/hams/on", "abra/sives", "abra/siv", "quantico", "trunk",
+        "trunk/", "trunk/libs", "trunk/libs/x y", "trunk/libs/x y/z", "trunk/libs/x yz",
+        "trunkated", "branches", "branches/1.0/a", "tags/7", "tags/77/x", "tags/100"
+    };
+    for (char const* key : keys)
+    {
+        std::string const k = key;
+        for (std::size_t revision = 0; revision < 10; ++revision)
+            assert(c.longest_match(k, revision) == p.longest_match(k, revision));
+    }
+    assert(c.longest_match(std::string("tags/42/x"), 1)->git_address() == "t:42:");
+    return 0;
+}
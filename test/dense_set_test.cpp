@@ -0,0 +1,61 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#undef NDEBUG
+#include "dense_set.hpp"
+#include <cassert>
+#include <vector>
+
+struct numbered
+{
+    std::size_t n;
+    std::size_t id() const { return n; }
+};
+
+int main()
+{
+    std::vector<numbered> objects(200);
+    std::vector<numbered*> by_id;
+    for (std::size_t i = 0; i < objects.size(); ++i)
+    {
+        objects[i].n = i;
+        by_id.push_back(&objects[i]);
+    }
+
+    dense_set<numbered> s(by_id);
+    assert(s.empty() && s.begin() == s.end());
+
+    assert(s.insert(&objects[130]));
+    assert(s.insert(&objects[3]));
+    assert(s.insert(&objects[64]));
+    assert(!s.insert(&objects[3]));
+    assert(s.size() == 3);
+    assert(s.count(&objects[64]) == 1);
+    assert(s.count(&objects[65]) == 0);
+    assert(s.count(&objects[199]) == 0);
+
+    // Members are visited in order of their numbers
+    std::vector<std::size_t> visited;
+    for (numbered* x : s)
+        visited.push_back(x->n);
+    assert((visited == std::vector<std::size_t>{ 3, 64, 130 }));
+
+    assert(s.erase(&objects[64]) == 1);
+    assert(s.erase(&objects[64]) == 0);
+    assert(s.erase(&objects[199]) == 0);
+    visited.clear();
+    for (numbered* x : s)
+        visited.push_back(x->n);
+    assert((visited == std::vector<std::size_t>{ 3, 130 }));
+
+    dense_set<numbered> t(by_id);
+    t.insert(s);
+    t.insert(&objects[0]);
+    assert(t.size() == 3 && *t.begin() == &objects[0]);
+
+    s.clear();
+    assert(s.empty() && s.begin() == s.end());
+    assert(s.insert(&objects[130]));
+    assert(*s.begin() == &objects[130]);
+}
@@ -0,0 +1,50 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#undef NDEBUG
+#include "directory_cache.hpp"
+#include <cassert>
+#include <cstdint>
+
+int main()
+{
+    typedef directory_cache::entry entry;
+    directory_cache::listing const trunk = { entry{"src", true, "1.0.r2/5"}, entry{"README", false, ""} };
+    directory_cache::listing const src = { entry{"main.cpp", false, ""} };
+
+    directory_cache c(5);
+    assert(!c.find("0.0.r1/0"));
+
+    c.insert("0.0.r1/0", trunk);
+    c.insert("1.0.r2/5", src);
+    assert(c.entries() == 5);
+    assert(c.find("0.0.r1/0")->size() == 2);
+    assert((*c.find("0.0.r1/0"))[0].node_id == "1.0.r2/5");
+
+    // Evicts the least recently used listing, which is src's
+    c.insert("2.0.r3/9", directory_cache::listing());
+    assert(c.entries() == 4);
+    assert(!c.find("1.0.r2/5"));
+    assert(c.find("0.0.r1/0"));
+    assert(c.find("2.0.r3/9")->empty());
+
+    // A listing too large to cache is still handed back
+    directory_cache::listing const big(10, entry{"x", false, ""});
+    assert(c.insert("3.0.r4/1", big)->size() == 10);
+    assert(!c.find("3.0.r4/1"));
+    assert(c.entries() == 4);
+
+    // Shrinking the cache drops the least recently used listings
+    c.find("0.0.r1/0");
+    c.set_max_entries(3);
+    assert(c.entries() == 3);
+    assert(c.find("0.0.r1/0"));
+    assert(!c.find("2.0.r3/9"));
+
+    // FSFS node-revision IDs order by revision, then offset
+    assert(directory_cache::location_of("2.0.r13/4271") == (std::uint64_t(13) << 40 | 4271));
+    assert(directory_cache::location_of("_1.0-7.r13/9") == (std::uint64_t(13) << 40 | 9));
+    assert(directory_cache::location_of("1.0.r12/99999") < directory_cache::location_of("2.0.r13/0"));
+    assert(directory_cache::location_of("1.0.t13-1") == 0);
+}
@@ -0,0 +1,90 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#undef NDEBUG
+#include "fsfs_readahead.hpp"
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <cassert>
+
+namespace fs = boost::filesystem;
+
+namespace
+{
+    void write(fs::path const& file, char const* contents)
+    {
+        fs::create_directories(file.parent_path());
+        fs::ofstream(file) << contents;
+    }
+
+    bool is(fsfs_readahead::extent const& e, fs::path const& file,
+            std::uint64_t offset, std::uint64_t length)
+    {
+        return fs::path(e.file) == file && e.offset == offset && e.length == length;
+    }
+}
+
+int main()
+{
+    fs::path const repo = "fsfs_readahead_test.repo";
+    fs::path const db = repo / "db";
+    fs::remove_all(repo);
+
+    // Not FSFS
+    write(db / "fs-type", "bdb\n");
+    assert(!fsfs_readahead(repo.string(), 10, 0).enabled());
+
+    // Linear
+    write(db / "fs-type", "fsfs\n");
+    write(db / "format", "2\n");
+    {
+        fsfs_readahead r(repo.string(), 10, 0);
+        assert(r.enabled());
+        auto const e = r.extents(7);
+        assert(e.size() == 2);
+        assert(is(e[0], db / "revs/7", 0, 0));
+        assert(is(e[1], db / "revprops/7", 0, 0));
+    }
+
+    // Sharded, with the first shard packed
+    write(db / "format", "6\nlayout sharded 4\n");
+    write(db / "min-unpacked-rev", "4\n");
+    write(db / "revs/0.pack/manifest", "0\n100\n250\n300\n");
+    {
+        fsfs_readahead r(repo.string(), 10, 0);
+        auto e = r.extents(5);
+        assert(e.size() == 2);
+        assert(is(e[0], db / "revs/1/5", 0, 0));
+        assert(is(e[1], db / "revprops/1/5", 0, 0));
+
+        e = r.extents(1);
+        assert(e.size() == 1);
+        assert(is(e[0], db / "revs/0.pack/pack", 100, 150));
+
+        e = r.extents(3);
+        assert(e.size() == 1);
+        assert(is(e[0], db / "revs/0.pack/pack", 300, 0));
+
+        e = r.extents(0);
+        assert(e.size() == 2);
+        assert(is(e[0], db / "revs/0.pack/pack", 0, 100));
+        assert(is(e[1], db / "revprops/0/0", 0, 0));
+
+        // Advising files that don't exist is harmless
+        r.advance(2);
+        r.advance(1);
+        r.advance(20);
+    }
+
+    // A pack without a usable manifest is advised whole
+    write(db / "revs/0.pack/manifest", "");
+    {
+        fsfs_readahead r(repo.string(), 10, 2);
+        auto const e = r.extents(2);
+        assert(e.size() == 1);
+        assert(is(e[0], db / "revs/0.pack/pack", 0, 0));
+    }
+
+    fs::remove_all(repo);
+}
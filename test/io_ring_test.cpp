@@ -0,0 +1,63 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#undef NDEBUG
+#include "io_ring.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+int main()
+{
+    // Where io_uring is unavailable there's nothing to test; svn2git
+    // makes the usual system calls instead
+    std::unique_ptr<io_ring> ring = io_ring::open(4);
+    if (!ring)
+        return 0;
+
+    int pipe_fds[2];
+    assert(::pipe2(pipe_fds, O_NONBLOCK) == 0);
+    char hello[] = "hello";
+    iovec const v = { hello, 5 };
+
+    // More operations than the ring has entries
+    for (std::uint64_t tag = 0; tag < 6; ++tag)
+        ring->writev(pipe_fds[1], &v, 1, tag);
+    int const file = ::open("/proc/self/exe", O_RDONLY);
+    if (file >= 0)
+        ring->fadvise(file, 0, 0, POSIX_FADV_WILLNEED, 99);
+
+    std::vector<std::pair<std::uint64_t, int> > results = ring->complete();
+    std::sort(results.begin(), results.end());
+    assert(results.size() == (file >= 0 ? 7u : 6u));
+    for (std::uint64_t tag = 0; tag < 6; ++tag)
+        assert(results[tag].first == tag && results[tag].second == 5);
+    // Kernels before 5.6 reject fadvise
+    if (file >= 0)
+        assert(results[6].first == 99 && (results[6].second == 0 || results[6].second == -EINVAL));
+
+    char read_back[64];
+    assert(::read(pipe_fds[0], read_back, sizeof(read_back)) == 30);
+    assert(std::memcmp(read_back, "hellohello", 10) == 0);
+
+    // Nothing queued
+    assert(ring->complete().empty());
+
+    // A pipe with some room takes what it can
+    std::vector<char> lots(1 << 20);
+    iovec const big = { lots.data(), lots.size() };
+    ring->writev(pipe_fds[1], &big, 1, 7);
+    std::vector<std::pair<std::uint64_t, int> > const partial = ring->complete();
+    assert(partial.size() == 1 && partial[0].first == 7);
+    assert(partial[0].second > 0 && std::size_t(partial[0].second) < lots.size());
+
+    ::close(pipe_fds[0]);
+    ::close(pipe_fds[1]);
+    if (file >= 0)
+        ::close(file);
+}
@@ -0,0 +1,72 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#undef NDEBUG
+#include "lru_cache.hpp"
+#include <cassert>
+#include <mutex>
+#include <sstream>
+#include <string>
+
+int main()
+{
+    {
+        lru_cache<int, std::string> c("test", 10);
+        assert(!c.find(1));
+        c.insert(1, "one", 4);
+        c.insert(2, "two", 4);
+        assert(*c.find(1) == "one");
+        assert(c.weight() == 8 && c.size() == 2);
+
+        // Evicts the least recently used value, which is 2's
+        auto const three = c.insert(3, "three", 4);
+        assert(*three == "three");
+        assert(!c.find(2));
+        assert(c.find(1) && c.find(3));
+        assert(c.weight() == 8);
+
+        // A value heavier than the cache is handed back unstored, as
+        // is one whose key is already stored
+        assert(*c.insert(4, "four", 11) == "four");
+        assert(!c.find(4));
+        assert(*c.insert(1, "uno", 1) == "uno");
+        assert(*c.find(1) == "one");
+
+        // A value evicted while in use stays alive
+        c.set_max_weight(4);
+        assert(c.size() == 1 && !c.find(3));
+        assert(*three == "three");
+
+        cache_stats const s = c.stats();
+        assert(s.hits == 4);
+        assert(s.misses == 4);
+        assert(s.insertions == 3);
+        assert(s.evictions == 2);
+        assert(s.entries == 1 && s.weight == 4);
+
+        c.clear();
+        assert(c.size() == 0 && c.weight() == 0);
+        assert(c.stats().evictions == 3);
+    }
+
+    {
+        // Each of the shards holds its share of the limit
+        lru_cache<int, int, std::hash<int>, std::mutex> c("test", 8, 4);
+        for (int i = 0; i < 100; ++i)
+            c.insert(i, i, 1);
+        assert(c.size() == 8);
+        for (int i = 96; i < 100; ++i)
+            assert(*c.find(i) == i);
+    }
+
+    // The counts of caches gone are kept under their names
+    cache_stats const total = cache_registry::totals()["test"];
+    assert(total.insertions == 103);
+    assert(total.evictions == 3 + 92);
+    assert(total.entries == 0);
+
+    std::ostringstream report;
+    cache_registry::report(report);
+    assert(report.str().find("test") != std::string::npos);
+}
@@ -0,0 +1,25 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#undef NDEBUG
+#include "ls_response.hpp"
+#include <cassert>
+#include <string>
+
+int main()
+{
+    // An "ls" of the root of a branch whose files were all deleted,
+    // which --prune-branches must see as empty
+    std::string const empty = std::string("040000 tree ") + empty_tree_sha + "\t";
+    assert(ls_response_sha(empty) == empty_tree_sha);
+
+    assert(ls_response_sha("040000 tree d670460b4b4aece5915caf5c68d12f560a9fe3e4\t")
+           == "d670460b4b4aece5915caf5c68d12f560a9fe3e4");
+    assert(ls_response_sha("100644 blob ce013625030ba8dba906f756967f9e9ca394464a\tREADME.txt")
+           == "ce013625030ba8dba906f756967f9e9ca394464a");
+
+    assert(ls_response_sha("missing README.txt").empty());
+    assert(ls_response_sha("").empty());
+    assert(ls_response_sha("040000 tree 4b825dc6\t").empty());
+}
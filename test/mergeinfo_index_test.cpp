@@ -0,0 +1,69 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#undef NDEBUG
+#include "mergeinfo_index.hpp"
+#include "changes_index.hpp"
+#include <cassert>
+#include <string>
+#include <vector>
+
+namespace mergeinfo_index_test {
+
+struct merge
+{
+    std::string path;
+    std::string source;
+    long revision;
+};
+
+bool operator==(merge const& x, merge const& y)
+{
+    return x.path == y.path && x.source == y.source && x.revision == y.revision;
+}
+
+struct change
+{
+    std::string path;
+    int change_kind;
+    int node_kind;
+    bool text_mod;
+    std::string copyfrom_path;
+    long copyfrom_rev;
+};
+
+}
+
+int main()
+{
+    using namespace mergeinfo_index_test;
+    typedef mergeinfo_index<merge> index;
+    std::string const filename = "mergeinfo_index_test.mergeinfo";
+    boost::filesystem::remove(filename);
+
+    std::vector<merge> const r1;
+    std::vector<merge> const r2 = {
+        { "/trunk", "/branches/a", 1 }, { "/trunk", "/branches/b", 2 } };
+    std::vector<merge> found;
+    auto const date_of = [](int revnum) { return "2013-10-0" + std::to_string(revnum); };
+
+    {
+        index i(filename, "uuid", date_of);
+        assert(i.last_revision() == 0);
+        i.add(1, r1);
+        i.add(2, r2);
+        i.save();
+    }
+
+    {
+        index i(filename, "uuid", date_of);
+        assert(i.last_revision() == 2);
+        assert(i.find(2, found) && found == r2);
+        assert(i.find(1, found) && found.empty());
+    }
+
+    // Nor is an index of changes read as one of merges
+    assert(changes_index<change>(filename, "uuid", date_of).last_revision() == 0);
+    boost::filesystem::remove(filename);
+}
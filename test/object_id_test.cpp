@@ -0,0 +1,54 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#undef NDEBUG
+#include "object_id.hpp"
+#include "sha1.hpp"
+#include <cassert>
+#include <string>
+#include <unordered_set>
+
+int main()
+{
+    std::string const hex = "4b825dc642cb6eb9a060e54bf8d69288fbee4904";
+    object_id const id = object_id::from_hex(hex);
+    assert(!id.is_null());
+    assert(id.hex() == hex);
+    assert(id.data()[0] == 0x4b && id.data()[19] == 0x04);
+
+    // Either case is read; lowercase is written
+    assert(object_id::from_hex("4B825DC642CB6EB9A060E54BF8D69288FBEE4904") == id);
+
+    // Anything else is none, wherever the stray character is
+    for (std::size_t i = 0; i < hex.size(); ++i)
+    {
+        for (char c : { 'g', 'G', '/', ':', '@', '`', ' ', '\t', '\x80' })
+        {
+            std::string bad = hex;
+            bad[i] = c;
+            assert(object_id::from_hex(bad).is_null());
+        }
+    }
+    assert(object_id::from_hex(hex.substr(1)).is_null());
+    assert(object_id().is_null());
+
+    // Every byte value makes the round trip, in every position
+    for (int b = 0; b < 256; ++b)
+    {
+        sha1::digest_type d;
+        for (std::size_t i = 0; i < d.size(); ++i)
+            d[i] = static_cast<unsigned char>(b + 37 * i);
+        object_id const x(d);
+        assert(object_id::from_hex(x.hex()) == x);
+        assert(sha1::to_hex(d) == x.hex());
+        assert(sha1::from_hex(x.hex().c_str()) == d);
+    }
+
+    assert(object_id::from_hex("0000000000000000000000000000000000000001")
+           < object_id::from_hex("0000000000000000000000000000000000000002"));
+    assert(id != object_id());
+
+    std::unordered_set<object_id> ids = { id, object_id::from_hex(hex), object_id() };
+    assert(ids.size() == 2 && ids.count(id));
+}
@@ -0,0 +1,127 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#undef NDEBUG
+#include "pack_writer.hpp"
+#include "git_delta.hpp"
+#include <boost/filesystem.hpp>
+#include <cassert>
+#include <cstdlib>
+#include <string>
+
+namespace
+{
+    std::string const git_dir = "pack_writer_test.git";
+
+    std::string blob_sha(std::string const& contents)
+    {
+        return git_blob_hasher(contents.size()).update(contents).hex_digest();
+    }
+
+    // True iff git finds a blob with the given name and contents
+    bool has_blob(std::string const& sha, std::string const& contents)
+    {
+        std::string const expected = git_dir + "/expected";
+        {
+            std::FILE* f = std::fopen(expected.c_str(), "wb");
+            std::fwrite(contents.data(), 1, contents.size(), f);
+            std::fclose(f);
+        }
+        return std::system(
+            ("git --git-dir=" + git_dir + " cat-file blob " + sha + " 2>/dev/null"
+             + " | cmp -s - " + expected).c_str()) == 0;
+    }
+
+    std::size_t pack_count()
+    {
+        std::size_t n = 0;
+        for (boost::filesystem::directory_iterator p(git_dir + "/objects/pack"), end; p != end; ++p)
+            n += p->path().extension() == ".idx";
+        return n;
+    }
+}
+
+int main()
+{
+    boost::filesystem::remove_all(git_dir);
+    assert(std::system(("git init --bare --quiet " + git_dir).c_str()) == 0);
+
+    std::string const hello = "hello\n";
+    std::string empty;
+    std::string large;
+    for (int i = 0; large.size() < (3 << 20); ++i)
+        large += std::to_string(i * 7919 % 100003) + '\n';
+    std::string edited = large;
+    edited.insert(large.size() / 2, "edit" + std::string(300, '!'));
+
+    {
+        deflate_pool deflater(3);
+        pack_writer packs(git_dir, deflater);
+        assert(!packs.pending());
+        packs.finish();         // nothing to write
+        assert(pack_count() == 0);
+
+        packs.add_blob(blob_sha(hello), hello);
+        packs.add_blob(blob_sha(large), large);
+        packs.add_blob(blob_sha(hello), hello);   // written once
+        packs.add_blob(blob_sha(empty), empty);
+        assert(packs.pending());
+        packs.finish();
+        assert(!packs.pending());
+        assert(pack_count() == 1);
+
+        packs.add_blob(blob_sha("bye\n"), "bye\n");
+        packs.finish();
+        assert(pack_count() == 2);
+
+        // Deltas only against blobs in the same pack
+        assert(!packs.accepts_delta_base(blob_sha(large)));
+        packs.add_blob(blob_sha(large), large);
+        assert(packs.accepts_delta_base(blob_sha(large)));
+
+        // An edit in the middle, and a copy long enough to be split
+        std::size_t const half = large.size() / 2;
+        git_delta d(large.size(), edited.size());
+        d.copy(0, 1000);
+        d.copy(1000, half - 1000);
+        d.insert("edit", 4);
+        d.insert(std::string(300, '!').data(), 300);
+        d.copy(half, large.size() - half);
+        assert(d.size() == edited.size());
+        packs.add_delta(blob_sha(edited), blob_sha(large), d.str());
+
+        // A delta against a delta
+        git_delta d2(edited.size(), hello.size());
+        d2.copy(half + 304 - 2, 2);
+        d2.insert("llo\n", 4);
+        packs.add_delta(blob_sha("!!llo\n"), blob_sha(edited), d2.str());
+        packs.finish();
+        assert(pack_count() == 3);
+
+        // The sixteenth pack finished is merged with the others,
+        // deltas and all, keeping one copy of a blob in two of them
+        for (int i = 0; i < 12; ++i)
+        {
+            packs.add_blob(blob_sha(std::to_string(i)), std::to_string(i));
+            packs.finish();
+        }
+        assert(pack_count() == 15);
+        packs.add_blob(blob_sha(hello), hello);
+        packs.finish();
+        assert(pack_count() == 1);
+    }
+
+    assert(std::system(("git --git-dir=" + git_dir + " fsck --strict --no-dangling 2>/dev/null").c_str()) == 0);
+    assert(has_blob(blob_sha(hello), hello));
+    assert(has_blob(blob_sha(large), large));
+    assert(has_blob(blob_sha(empty), empty));
+    assert(has_blob(blob_sha("bye\n"), "bye\n"));
+    assert(has_blob(blob_sha(edited), edited));
+    assert(has_blob(blob_sha("!!llo\n"), "!!llo\n"));
+    assert(!has_blob(blob_sha("missing\n"), "missing\n"));
+    for (int i = 0; i < 12; ++i)
+        assert(has_blob(blob_sha(std::to_string(i)), std::to_string(i)));
+
+    boost::filesystem::remove_all(git_dir);
+}
@@ -0,0 +1,175 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#undef NDEBUG
+#include "parse_rules.hpp"
+#include <cassert>
+#include <climits>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+
+using namespace boost2git;
+
+static bool same(ContentRule const& x, ContentRule const& y)
+{
+    return x.svn_path == y.svn_path && x.git_path == y.git_path && x.line == y.line;
+}
+
+static bool same(ExcludeRule const& x, ExcludeRule const& y)
+{
+    return x.svn_path == y.svn_path && x.line == y.line;
+}
+
+static bool same(SquashRule const& x, SquashRule const& y)
+{
+    return x.kind == y.kind && x.value == y.value && x.line == y.line;
+}
+
+static bool same(BranchRule const& x, BranchRule const& y)
+{
+    return x.min == y.min && x.max == y.max && x.svn_path == y.svn_path
+        && x.git_branch_or_tag_name == y.git_branch_or_tag_name && x.line == y.line
+        && std::strcmp(x.git_ref_qualifier, y.git_ref_qualifier) == 0;
+}
+
+template <class T>
+static bool same(std::vector<T> const& x, std::vector<T> const& y)
+{
+    if (x.size() != y.size())
+        return false;
+    for (std::size_t i = 0; i < x.size(); ++i)
+    {
+        if (!same(x[i], y[i]))
+            return false;
+    }
+    return true;
+}
+
+static bool same(RepoRule const& x, RepoRule const& y)
+{
+    return x.is_abstract == y.is_abstract && x.line == y.line
+        && x.git_repo_name == y.git_repo_name && x.bases == y.bases
+        && x.submodule_info == y.submodule_info
+        && x.minrev == y.minrev && x.maxrev == y.maxrev
+        && same(x.content_rules, y.content_rules)
+        && same(x.branch_rules, y.branch_rules) && same(x.tag_rules, y.tag_rules)
+        && same(x.exclusions, y.exclusions) && same(x.squash_rules, y.squash_rules);
+}
+
+static bool same(AST const& x, AST const& y)
+{
+    return x.size() == y.size() && std::equal(
+        x.begin(), x.end(), y.begin(), [](RepoRule const& a, RepoRule const& b) { return same(a, b); });
+}
+
+static AST parse(std::string const& text)
+{
+    return parse_rules_text(text.data(), text.data() + text.size(), "test");
+}
+
+// The message of the error parsing text reports, or "" if it parses
+static std::string error(std::string const& text, bool spirit = false)
+{
+    try
+    {
+        if (spirit)
+            parse_rules_text_spirit(text.data(), text.data() + text.size(), "test");
+        else
+            parse(text);
+    }
+    catch (std::runtime_error const& e)
+    {
+        return e.what();
+    }
+    return "";
+}
+
+static void check_same_as_spirit(std::string const& text)
+{
+    AST const spirit = parse_rules_text_spirit(text.data(), text.data() + text.size(), "test");
+    assert(same(parse(text), spirit));
+}
+
+int main()
+{
+    std::string const text =
+        "// The branches every library has\n"
+        "abstract repository boost_branches\n"
+        "{\n"
+        "  branches\n"
+        "  {\n"
+        "    [:] trunk : master;\n"
+        "    [100:200] \"branches/release\" : release ;\n"
+        "  }\n"
+        "  tags { [ 5 : ] \"tags/v 1\" : v1\n"
+        "  ; }\n"
+        "}\n"
+        "/* the configuration\n"
+        "   library */ repository\n"
+        "  config : boost_branches, more-bases\n"
+        "{\n"
+        "  submodule of boost : \"libs/config\";\n"
+        "  minrev 5;\n"
+        "  maxrev 5000;\n"
+        "  content\n"
+        "  {\n"
+        "    \"boost/config\" : \"include/boost/config\";\n"
+        "    libs/*config*/ ;\n"
+        "  }\n"
+        "  exclude { CVSROOT; }\n"
+        "  squash { author regression-bot; path \"status\"\n"
+        "  ; }\n"
+        "}";
+
+    AST const ast = parse(text);
+    assert(ast.size() == 2);
+    RepoRule const& base = *ast.begin();
+    assert(base.is_abstract && base.git_repo_name == "boost_branches" && base.line == 2);
+    assert(base.minrev == 0 && base.maxrev == UINT_MAX);
+    assert(base.branch_rules.size() == 2 && base.tag_rules.size() == 1);
+    BranchRule const trunk = { 0, UINT_MAX, "trunk", "master", 6, "refs/heads/" };
+    BranchRule const release = { 100, 200, "branches/release", "release", 7, "refs/heads/" };
+    BranchRule const v1 = { 5, UINT_MAX, "tags/v 1", "v1", 10, "refs/tags/" };
+    assert(same(base.branch_rules[0], trunk) && same(base.branch_rules[1], release));
+    assert(same(base.tag_rules[0], v1));
+
+    RepoRule const& config = *++ast.begin();
+    assert(!config.is_abstract && config.git_repo_name == "config" && config.line == 14);
+    assert(config.bases.size() == 2 && config.bases[1] == "more-bases");
+    assert(config.submodule_info.size() == 2 && config.submodule_info[1] == "libs/config");
+    assert(config.minrev == 5 && config.maxrev == 5000);
+    ContentRule const headers = { "boost/config", "include/boost/config", 21 };
+    ContentRule const libs = { "libs", "", 22 };
+    assert(config.content_rules.size() == 2);
+    assert(same(config.content_rules[0], headers) && same(config.content_rules[1], libs));
+    assert(config.exclusions.size() == 1 && config.exclusions[0].line == 24);
+    SquashRule const bot = { "author", "regression-bot", 25 };
+    SquashRule const status = { "path", "status", 26 };
+    assert(config.squash_rules.size() == 2);
+    assert(same(config.squash_rules[0], bot) && same(config.squash_rules[1], status));
+
+    check_same_as_spirit(text);
+
+    // Errors are reported where they're found, as Spirit did
+    assert(error("") != "");
+    std::string const missing_semicolon = "repository x\n{\n\tcontent { a : b }\n}";
+    assert(error(missing_semicolon) == error(missing_semicolon, true));
+    assert(error(missing_semicolon).find("line 3 column 21") != std::string::npos);
+    assert(error("repository x { minrev 99999999999; }") != "");
+    assert(error("repository x { content { \"\"; } }") != "");
+    assert(error("repository x { } /* open") != "");
+    assert(error("repository x { squash { committer bot; } }") != "");
+
+    // The rules of the real conversion, and of the conversion test
+    for (char const* file : { SOURCE_DIR "/repositories.txt", SOURCE_DIR "/test/test-repositories.txt" })
+    {
+        std::ifstream in(file, std::ios::binary);
+        assert(in);
+        check_same_as_spirit(
+            std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>()));
+    }
+}
@@ -40,4 +40,24 @@ int main()
     s2.insert("x/y");
     path_set expected2 = { "a", "a.txt/bb", "x", "x.txt/yy" };
     assert(s2 == expected2);
+    assert(s2.size() == 4);
+    assert(s2.covers("a/b/c") && s2.covers("x") && !s2.covers("a.txt") && !s2.covers(""));
+
+    // Inserting an ancestor replaces what lies beneath it, however deep
+    path_set s3 = { "p/q/r/s", "p/q/t", "p/u", "v" };
+    assert(!s3.insert("p/q/r/s/w"));
+    assert(s3.insert("p/q"));
+    path_set expected3 = { "p/q", "p/u", "v" };
+    assert(s3 == expected3 && s3.size() == 3);
+    assert(s3.insert("") && s3.size() == 1 && s3.covers("anything/at/all"));
+    assert(*s3.begin() == path());
+
+    // Paths are interned; equal strings share their identity
+    path const p("/x/y/z/");
+    assert(p == path("x/y") / "z");
+    assert(p.parent() == "x/y" && p.depth() == 3);
+    assert(path().parent() == path() && path().depth() == 0);
+    assert(p.starts_with("x") && p.starts_with("") && !p.starts_with("x/y/zz"));
+    assert(path("a/b") < path("a.txt") && path("a") < path("a/b") && !(path("a/b") < path("a")));
+    assert(p.sans_prefix("x") == "/y/z");
 }
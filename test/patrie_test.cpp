@@ -7,6 +7,11 @@
 #include "patrie.hpp"
 #include <boost/fusion/adapted/struct/define_struct.hpp>
 #include <cassert>
+#include <atomic>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <iterator>
 
 namespace patrie_test {
 
@@ -18,7 +23,7 @@ struct Rule
     int max;
 
     path svn_path() const { return match; }
-    std::string git_address() const { return git_address_; }
+    std::string const& git_address() const { return git_address_; }
     void report_overlap() const {}
 };
 
@@ -27,9 +32,20 @@ bool operator==(Rule const& lhs, Rule const& rhs)
     return lhs.match == rhs.match && lhs.min == rhs.min && lhs.max == rhs.max;
 }
 
+std::ostream& operator<<(std::ostream& os, Rule const& r)
+{
+    return os << r.match.str() << " " << r.git_address_ << " " << r.min << ":" << r.max;
+}
+
+struct overlap
+{
+    Rule const* rule0;
+    Rule const* rule1;
+};
+
 void report_overlap(Rule const* rule0, Rule const* rule1) 
 {
-    assert(!"should never get here");
+    throw overlap{rule0, rule1};
 }
 
 }
@@ -75,4 +91,347 @@ int main()
         assert(*p.longest_match(test, 2) == rules[2]);
         assert(p.longest_match(test, 5) == 0);
     }
+
+    // The stats count every node and rule, and lookups enter the
+    // nodes along the key's path
+    {
+        auto const s = p.stats(false);
+        std::size_t nodes = 0, with_children = 0, rules_held = 0;
+        for (std::size_t d : s.depths)
+            nodes += d;
+        for (std::size_t i = 0; i < s.fan_outs.size(); ++i)
+            with_children += i * s.fan_outs[i];
+        for (std::size_t i = 0; i < s.rule_counts.size(); ++i)
+            rules_held += i * s.rule_counts[i];
+        assert(s.depths[0] == 1);
+        assert(with_children == nodes - 1);
+        assert(rules_held == 5);
+        assert(s.node_bytes > 0 && s.rule_vector_bytes > 0 && s.flat_bytes > 0);
+        // The root, "abra", "/", and beneath it each of the rest
+        assert(nodes == 6 && s.depths.size() == 4);
+        assert(p.lookup_depth(std::string("abra/cadabra"), false) == 4);
+        assert(p.lookup_depth(std::string("abra/cadaver"), false) == 3);
+        assert(p.lookup_depth(std::string("quantico"), false) == 1);
+
+        auto const g = p.stats(true);
+        rules_held = 0;
+        for (std::size_t i = 0; i < g.rule_counts.size(); ++i)
+            rules_held += i * g.rule_counts[i];
+        assert(rules_held == 5);
+        assert(p.rule_bytes() == 5 * sizeof(Rule));
+    }
+
+    // Each match holds over the interval it gives, and no further
+    {
+        std::size_t first, last;
+        assert(*p.longest_match(std::string("abra/hams/on"), 1, first, last) == rules[3]);
+        assert(first == 1 && last == 1);
+        assert(*p.longest_match(std::string("abra/hams/on"), 2, first, last) == rules[2]);
+        assert(first == 2 && last == 3);
+        assert(!p.longest_match(std::string("abra/hams/on"), 5, first, last));
+        assert(first == 4 && last == std::size_t(-1));
+        assert(*p.longest_match(std::string("abra/cadabra"), 5, first, last) == rules[4]);
+        assert(first == 4 && last == 5);
+        assert(!p.longest_match(std::string("quantico"), 6, first, last));
+        assert(first == 0 && last == std::size_t(-1));
+
+        for (char const* test : { "abra/cadaver", "abra/cadabra", "abra/hams/on", "abra" })
+        {
+            for (std::size_t rev = 1; rev <= 7; ++rev)
+            {
+                Rule const* const m = p.longest_match(std::string(test), rev, first, last);
+                assert(first <= rev && rev <= last);
+                for (std::size_t r = std::max<std::size_t>(first, 1); r <= std::min<std::size_t>(last, 8); ++r)
+                    assert(p.longest_match(std::string(test), r) == m);
+                if (first > 1)
+                    assert(p.longest_match(std::string(test), first - 1) != m);
+                if (last < 8)
+                    assert(p.longest_match(std::string(test), last + 1) != m);
+            }
+        }
+    }
+
+    // Matching from the snapshot of the active rules agrees with
+    // the full trie
+    for (std::size_t rev = 1; rev <= 6; ++rev)
+    {
+        char const* tests[] = { 
+            "abra/cadaver", "abra/cadabra", "abra/cadabrax", "quantico", 
+            "abra/hams/on", "abra", "ab", "abra/sives/x" };
+        std::vector<Rule const*> expected;
+        for (auto t : tests)
+            expected.push_back(p.longest_match(std::string(t), rev));
+
+        p.set_current_revision(rev);
+        for (std::size_t i = 0; i < expected.size(); ++i)
+            assert(p.longest_match(std::string(tests[i]), rev) == expected[i]);
+    }
+    p.set_current_revision(4);
+    assert(*p.longest_match(std::string("abra/cadabra"), 4) == rules[4]);
+    assert(*p.longest_match(std::string("abra/cadabra"), 3) == rules[1]);
+
+    {
+        std::vector<Rule const*> beneath;
+        p.svn_rules_beneath(std::string("abra"), 1, std::back_inserter(beneath));
+        assert(beneath.size() == 3);
+
+        beneath.clear();
+        p.svn_rules_beneath(std::string("abra"), 4, std::back_inserter(beneath));
+        assert(beneath.size() == 1 && *beneath[0] == rules[4]);
+
+        beneath.clear();
+        p.svn_rules_beneath(std::string("ab"), 1, std::back_inserter(beneath));
+        p.svn_rules_beneath(std::string("abra/cad"), 1, std::back_inserter(beneath));
+        p.svn_rules_beneath(std::string("abra/cadabra"), 1, std::back_inserter(beneath));
+        assert(beneath.empty());
+
+        p.git_rules_beneath(std::string("a:b:fu"), 1, std::back_inserter(beneath));
+        assert(beneath.size() == 1 && *beneath[0] == rules[3]);
+
+        beneath.clear();
+        p.git_rules_beneath(std::string("a:b:"), 1, std::back_inserter(beneath));
+        assert(beneath.size() == 4);
+    }
+
+    {
+        std::vector<Rule const*> subtree;
+        p.git_subtree_rules(std::string("a:b:fu"), 1, std::back_inserter(subtree));
+        assert(subtree.size() == 1 && *subtree[0] == rules[3]);
+
+        subtree.clear();
+        p.git_subtree_rules(std::string("a:b:fu"), 4, std::back_inserter(subtree));
+        assert(subtree.size() == 1 && *subtree[0] == rules[4]);
+
+        subtree.clear();
+        p.git_subtree_rules(std::string("a:b:f"), 1, std::back_inserter(subtree));
+        p.git_subtree_rules(std::string("a:b:fu/ba"), 1, std::back_inserter(subtree));
+        assert(subtree.empty());
+    }
+
+    // Rules inserted after lookups have been made are found too
+    Rule const late = {"zed", "z:y:x", 1, 9};
+    p.insert(late);
+    assert(*p.longest_match(std::string("zed/q"), 2) == late);
+    {
+        std::vector<Rule const*> subtree;
+        p.git_subtree_rules(std::string("z:y:x"), 2, std::back_inserter(subtree));
+        assert(subtree.size() == 1 && *subtree[0] == late);
+    }
+
+    // Enough siblings, and long enough labels, to need more than one
+    // block of each search
+    {
+        std::string const long_name = "libs/a_name_longer_than_two_blocks_of_comparison";
+        std::vector<Rule> many;
+        for (char c = 'A'; c <= 'z'; ++c)
+            many.push_back(Rule{long_name + "/" + c, std::string("m:b:") + c, 1, 9});
+
+        patrie<Rule> q;
+        for (auto const& m: many)
+            q.insert(m);
+        for (auto const& m: many)
+            assert(*q.longest_match(m.match.str() + "/file", 1) == m);
+        assert(q.longest_match(long_name + "/~/file", 1) == 0);
+        assert(q.longest_match("libs/a_name_longer_than_two_blocks_of_comparisoN/A", 1) == 0);
+    }
+
+    // Subtree queries, which scan the rules of whole subtrees, find
+    // exactly the rules beneath that are active
+    {
+        std::vector<Rule> many;
+        for (char c = 'a'; c <= 'z'; ++c)
+        {
+            int const min = 1 + (c - 'a') % 5;
+            many.push_back(Rule{std::string("src/") + c, std::string("s:t:dir/") + c, min, min + 2});
+            many.push_back(Rule{std::string("src/") + c + "/x", std::string("s:t:dir/") + c + "/x", 3, 9});
+        }
+        many.push_back(Rule{"other", "s:t:dirt", 1, 9});
+
+        patrie<Rule> q;
+        for (auto const& m: many)
+            q.insert(m);
+        for (int rev = 0; rev <= 10; ++rev)
+        {
+            std::vector<Rule const*> subtree, beneath;
+            q.git_subtree_rules(std::string("s:t:dir"), rev, std::back_inserter(subtree));
+            q.git_rules_beneath(std::string("s:t:dir/"), rev, std::back_inserter(beneath));
+            std::size_t expected = 0;
+            for (auto const& m: many)
+                expected += m.git_address_ != "s:t:dirt" && m.min <= rev && rev <= m.max;
+            assert(subtree.size() == expected && beneath.size() == expected);
+            for (auto r : subtree)
+                assert(r->min <= rev && rev <= r->max && r->git_address_ != "s:t:dirt");
+        }
+    }
+
+    // Bulk loading leaves the same tries and transitions as inserting
+    // the rules one at a time
+    {
+        std::vector<Rule> many(rules, rules + 5);
+        for (char c = 'a'; c <= 'z'; ++c)
+        {
+            int const min = 1 + (c - 'a') % 5;
+            many.push_back(Rule{std::string("src/") + c, std::string("s:t:dir/") + c, min, min + 2});
+            many.push_back(Rule{std::string("src/") + c + "/x", "s:t:dir", 3, 9});
+            many.push_back(Rule{std::string("src/") + c + "/x", "s:t:dir", 10, 12});
+        }
+        many.push_back(Rule{"", "s:t:root", 1, 9});
+        many.push_back(Rule{"src", "s:t:dir", 1, 12});
+
+        patrie<Rule> one_by_one, bulk;
+        for (auto const& m: many)
+            one_by_one.insert(m);
+        bulk.insert_all(many);
+
+        std::ostringstream expected, built;
+        expected << one_by_one;
+        built << bulk;
+        assert(built.str() == expected.str());
+
+        for (int rev = 0; rev <= 13; ++rev)
+        {
+            auto const e = one_by_one.rules_in_transition(rev);
+            auto const b = bulk.rules_in_transition(rev);
+            assert(std::size_t(e.size()) == std::size_t(b.size()));
+            for (std::size_t i = 0; i < std::size_t(e.size()); ++i)
+                assert(*e[i] == *b[i]);
+
+            std::vector<Rule const*> es, bs;
+            one_by_one.git_subtree_rules(std::string("s:t:dir"), rev, std::back_inserter(es));
+            bulk.git_subtree_rules(std::string("s:t:dir"), rev, std::back_inserter(bs));
+            assert(es.size() == bs.size());
+            for (std::size_t i = 0; i < es.size(); ++i)
+                assert(*es[i] == *bs[i]);
+
+            for (auto const& m: many)
+            {
+                Rule const* x = one_by_one.longest_match(m.match.str() + "/f", rev);
+                Rule const* y = bulk.longest_match(m.match.str() + "/f", rev);
+                assert(x ? y && *x == *y : !y);
+            }
+        }
+
+        // Overlapping SVN rules are reported, the later given second
+        many.push_back(Rule{"src/q", "s:t:q", 4, 7});
+        try
+        {
+            patrie<Rule>().insert_all(many);
+            assert(!"overlap not reported");
+        }
+        catch (patrie_test::overlap const& o)
+        {
+            assert(*o.rule0 == Rule({"src/q", "", 2, 4}) && o.rule1->git_address_ == "s:t:q");
+        }
+    }
+
+    // Readers on many threads at once, each moving its own snapshot
+    // from revision to revision, agree with lookups made one at a time
+    {
+        std::vector<Rule> many;
+        for (char c = 'a'; c <= 'z'; ++c)
+        {
+            int const min = 1 + (c - 'a') % 7;
+            many.push_back(Rule{std::string("src/") + c, std::string("s:t:dir/") + c, min, min + 3});
+            many.push_back(Rule{std::string("src/") + c + "/x", std::string("s:t:x/") + c, 5, 20});
+        }
+        many.push_back(Rule{"src", "s:t:src", 1, 30});
+
+        patrie<Rule> q;
+        q.insert_all(many);
+
+        std::vector<std::string> keys;
+        for (char c = 'a'; c <= 'z'; ++c)
+        {
+            keys.push_back(std::string("src/") + c + "/file");
+            keys.push_back(std::string("src/") + c + "/x/file");
+            keys.push_back(std::string("src/") + c + "x");
+        }
+        keys.push_back("elsewhere");
+        int const revisions = 32;
+        std::vector<Rule const*> expected;
+        std::vector<std::size_t> expected_beneath;
+        for (int rev = 0; rev < revisions; ++rev)
+        {
+            for (auto const& k : keys)
+                expected.push_back(q.longest_match(k, rev));
+            std::vector<Rule const*> beneath;
+            q.svn_rules_beneath(std::string("src"), rev, std::back_inserter(beneath));
+            expected_beneath.push_back(beneath.size());
+        }
+
+        std::atomic<int> mismatches(0);
+        std::vector<patrie<Rule>::reader> readers(8, patrie<Rule>::reader(q));
+        std::vector<std::thread> threads;
+        for (std::size_t t = 0; t < readers.size(); ++t)
+        {
+            threads.emplace_back([&, t] {
+                patrie<Rule>::reader& r = readers[t];
+                for (int pass = 0; pass < 200; ++pass)
+                {
+                    // Each thread visits the revisions in an order of its own
+                    int const rev = int((pass * (2 * t + 1) + t) % revisions);
+                    r.set_current_revision(rev);
+                    for (std::size_t i = 0; i < keys.size(); ++i)
+                    {
+                        if (r.longest_match(keys[i], rev) != expected[rev * keys.size() + i])
+                            ++mismatches;
+                    }
+                    std::vector<Rule const*> beneath;
+                    r.svn_rules_beneath(std::string("src"), rev, std::back_inserter(beneath));
+                    if (beneath.size() != expected_beneath[rev])
+                        ++mismatches;
+                }
+            });
+        }
+        for (auto& t : threads)
+            t.join();
+        assert(mismatches == 0);
+    }
+
+    // A cursor advanced a component at a time agrees with
+    // longest_match of each prefix of the path
+    {
+        std::vector<Rule> nested = {
+            {"trunk", "b:master:", 1, 10},
+            {"trunk/libs", "l:master:", 3, 10},
+            {"trunk/libs/any", "a:master:", 1, 10},
+            {"trunk/libs/anyhow", "h:master:", 1, 10},
+            {"trunk/lib", "x:master:", 1, 10},
+            {"branches/b1", "b:b1:", 2, 5},
+        };
+        patrie<Rule> q;
+        q.insert_all(nested);
+
+        std::vector<std::vector<std::string> > walks = {
+            {"trunk", "libs", "any", "src", "a.cpp"},
+            {"trunk", "libs", "anyhow", "x"},
+            {"trunk", "libs", "anyway", "x"},
+            {"trunk", "lib", "x"},
+            {"trunk", "li"},
+            {"trunks", "x"},
+            {"branches", "b1", "f"},
+            {"branches", "b", "f"},
+            {"elsewhere", "x"},
+        };
+        for (std::size_t rev = 0; rev <= 11; ++rev)
+        {
+            for (auto const& components : walks)
+            {
+                auto c = q.match_cursor(rev);
+                std::string key;
+                for (auto const& name : components)
+                {
+                    c.descend(name);
+                    key += (key.empty() ? "" : "/") + name;
+                    assert(c.match() == q.longest_match(key, rev));
+
+                    // Copies go their own ways
+                    auto sibling = c;
+                    sibling.descend(std::string("zz"));
+                    assert(sibling.match() == q.longest_match(key + "/zz", rev));
+                    assert(c.match() == q.longest_match(key, rev));
+                }
+            }
+        }
+    }
 };
@@ -0,0 +1,43 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#undef NDEBUG
+#include "resource_budget.hpp"
+#include <cassert>
+
+int main()
+{
+    resource_budget b(1000);
+    assert(b.due());
+    assert(b.cache_share() == 1);
+
+    // Well within the budget, nothing changes
+    b.assess(500);
+    assert(!b.due());
+    assert(b.cache_share() == 1 && b.excess() == 0);
+
+    // Nearing it, the caches shrink by half each time, to a floor
+    b.assess(900);
+    assert(b.cache_share() == 0.5 && b.excess() == 0);
+    for (int i = 0; i < 10; ++i)
+        b.assess(900);
+    assert(b.cache_share() == 1.0 / 64);
+
+    // Between the thresholds they stay as they are
+    b.assess(800);
+    assert(b.cache_share() == 1.0 / 64);
+
+    // Past the budget, enough is to be freed to get back under the
+    // point where the caches shrink
+    b.assess(1200);
+    assert(b.excess() == 1200 - 850);
+
+    // With room again, the caches grow back an eighth at a time
+    b.assess(100);
+    assert(b.excess() == 0);
+    assert(b.cache_share() == 1.0 / 64 + 1.0 / 8);
+    for (int i = 0; i < 10; ++i)
+        b.assess(100);
+    assert(b.cache_share() == 1);
+}
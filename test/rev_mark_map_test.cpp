@@ -0,0 +1,71 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#undef NDEBUG
+#include "rev_mark_map.hpp"
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+typedef rev_mark_map::value_type entry;
+
+int main()
+{
+    rev_mark_map marks;
+    entry m;
+    assert(marks.empty() && marks.begin() == marks.end());
+    assert(!marks.find_at_or_before(100, m));
+
+    // Several blocks' worth, with gaps between revisions and marks
+    // that sometimes decrease, checked against a plain vector
+    std::vector<entry> expected;
+    for (std::size_t i = 0; i < 200; ++i)
+    {
+        entry const e(10 + i * 7 + i % 3 * 1000 + i / 3 * 3000, i % 5 == 4 ? i : 5000 + i * 300);
+        marks.push_back(e.first, e.second);
+        expected.push_back(e);
+    }
+    assert(marks.size() == expected.size());
+    assert(marks.back() == expected.back());
+    assert(marks.penultimate() == expected[expected.size() - 2]);
+    assert(std::equal(marks.begin(), marks.end(), expected.begin()));
+
+    auto check_lookups = [&] {
+        for (std::size_t revnum = 0; revnum < expected.back().first + 10; revnum += 13)
+        {
+            auto const p = std::upper_bound(
+                expected.begin(), expected.end(), revnum,
+                [](std::size_t r, entry const& e) { return r < e.first; });
+            bool const found = marks.find_at_or_before(revnum, m);
+            assert(found == (p != expected.begin()));
+            if (found)
+                assert(m == *std::prev(p));
+        }
+    };
+    check_lookups();
+
+    // Forgetting later entries, within a block and at its start
+    marks.truncate(expected[96].first);
+    expected.resize(97);
+    assert(marks.size() == 97 && marks.back() == expected.back());
+    assert(std::equal(marks.begin(), marks.end(), expected.begin()));
+    check_lookups();
+
+    marks.pop_back();
+    expected.pop_back();
+    assert(marks.size() == 96 && marks.back() == expected.back());
+    assert(marks.penultimate() == expected[94]);
+
+    // Entries added after a truncation follow the ones kept
+    marks.push_back(expected.back().first + 1, 42);
+    expected.push_back(entry(expected.back().first + 1, 42));
+    assert(std::equal(marks.begin(), marks.end(), expected.begin()));
+    check_lookups();
+
+    marks.truncate(0);
+    assert(marks.empty());
+    marks.push_back(5, 1);
+    marks.pop_back();
+    assert(marks.empty() && marks.begin() == marks.end());
+}
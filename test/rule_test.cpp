@@ -0,0 +1,78 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#undef NDEBUG
+#include "rule.hpp"
+#include <cassert>
+#include <climits>
+#include <string>
+
+using namespace boost2git;
+
+int main()
+{
+    RepoRule repo;
+    repo.is_abstract = false;
+    repo.line = 1;
+    repo.git_repo_name = "config";
+    repo.minrev = 0;
+    repo.maxrev = UINT_MAX;
+    BranchRule trunk = { 0, UINT_MAX, "trunk", "master", 2, "refs/heads/" };
+    BranchRule root = { 0, UINT_MAX, "", "everything", 3, "refs/heads/" };
+    ContentRule content = { "boost/config", "include/boost/config", 4 };
+    ContentRule to_root = { "libs/config", "", 5 };
+
+    // A rule mapping a whole branch to the top of the Git tree
+    Rule const branch(&repo, &trunk, 0);
+    assert(branch.svn_path() == path("trunk") && branch.git_path() == path());
+    assert(branch.git_path(path("trunk")) == path());
+    assert(branch.git_path(path("trunk/boost/config.hpp")) == path("boost/config.hpp"));
+
+    // A content rule maps its part of the branch to a Git subdirectory
+    Rule const sub(&repo, &trunk, &content);
+    assert(sub.svn_path() == path("trunk/boost/config"));
+    assert(sub.git_path(path("trunk/boost/config")) == path("include/boost/config"));
+    assert(sub.git_path(path("trunk/boost/config/user.hpp"))
+           == path("include/boost/config/user.hpp"));
+
+    Rule const lifted(&repo, &trunk, &to_root);
+    assert(lifted.git_path(path("trunk/libs/config/test/a.cpp")) == path("test/a.cpp"));
+
+    // The SVN root is a prefix of everything
+    Rule const whole(&repo, &root, 0);
+    assert(whole.svn_path() == path());
+    assert(whole.git_path(path("trunk/index.html")) == path("trunk/index.html"));
+
+    // An exclusion lies within its branch, throughout the branch's
+    // revisions, and maps nowhere
+    RepoRule late = repo;
+    late.minrev = 100;
+    ExcludeRule cvsroot = { "CVSROOT", 6 };
+    Rule const excluded(&late, &trunk, 0, &cvsroot);
+    assert(excluded.excludes() && !branch.excludes());
+    assert(excluded.svn_path() == path("trunk/CVSROOT"));
+    assert(excluded.min == 0 && excluded.max == UINT_MAX);
+    assert(excluded.git_address().empty());
+
+    // Git addresses, and the keys that spell them without assembling
+    // a string
+    assert(branch.git_address() == "config:refs/heads/master:");
+    assert(sub.git_address() == "config:refs/heads/master:include/boost/config");
+    git_address_key const key(sub.git_repo_name(), sub.git_ref_name(), sub.git_path().str());
+    assert(key.str() == sub.git_address());
+    assert(git_address_key(
+               sub.git_repo_name(), sub.git_ref_name(), sub.git_path().str(), "user.hpp").str()
+           == "config:refs/heads/master:include/boost/config/user.hpp");
+    assert(git_address_key(
+               branch.git_repo_name(), branch.git_ref_name(), branch.git_path().str(), "a").str()
+           == "config:refs/heads/master:a");
+
+    // Its characters can be walked back from the end
+    std::string const spelled = key.str();
+    std::string const reversed(spelled.rbegin(), spelled.rend());
+    std::string walked;
+    for (auto p = key.end(); p != key.begin();)
+        walked += *--p;
+    assert(walked == reversed);
+}
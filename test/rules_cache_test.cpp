@@ -0,0 +1,101 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#undef NDEBUG
+#include "rules_cache.hpp"
+#include <cassert>
+#include <climits>
+#include <cstring>
+#include <string>
+
+using namespace boost2git;
+
+static bool same(BranchRule const& x, BranchRule const& y)
+{
+    return x.min == y.min && x.max == y.max && x.svn_path == y.svn_path
+        && x.git_branch_or_tag_name == y.git_branch_or_tag_name && x.line == y.line
+        && std::strcmp(x.git_ref_qualifier, y.git_ref_qualifier) == 0;
+}
+
+static bool same(std::vector<BranchRule> const& x, std::vector<BranchRule> const& y)
+{
+    if (x.size() != y.size())
+        return false;
+    for (std::size_t i = 0; i < x.size(); ++i)
+    {
+        if (!same(x[i], y[i]))
+            return false;
+    }
+    return true;
+}
+
+int main()
+{
+    std::string const filename = "rules_cache_test.rules";
+    std::string const key = sha1().update("some rules").hex_digest();
+
+    RepoRule base;
+    base.is_abstract = true;
+    base.line = 1;
+    base.git_repo_name = "boost_branches";
+    base.minrev = 0;
+    base.maxrev = UINT_MAX;
+    BranchRule trunk = { 0, UINT_MAX, "trunk", "master", 3, "refs/heads/" };
+    BranchRule tag = { 100, 200, "tags/release/1.0", "v1.0", 6, "refs/tags/" };
+    base.branch_rules.push_back(trunk);
+    base.tag_rules.push_back(tag);
+    ExcludeRule cvsroot = { "CVSROOT", 8 };
+    base.exclusions.push_back(cvsroot);
+
+    RepoRule lib;
+    lib.is_abstract = false;
+    lib.line = 10;
+    lib.git_repo_name = "config";
+    lib.bases.push_back("boost_branches");
+    lib.submodule_info.push_back("boost");
+    lib.submodule_info.push_back("libs/config");
+    lib.minrev = 5;
+    lib.maxrev = 5000;
+    ContentRule content = { "boost/config", "include/boost/config", 14 };
+    lib.content_rules.push_back(content);
+
+    AST ast;
+    ast.insert(lib);
+    ast.insert(base);
+
+    rules_cache::save(filename, key, ast);
+
+    AST loaded;
+    assert(rules_cache::load(filename, key, loaded));
+    assert(loaded.size() == 2);
+    for (AST::const_iterator p = ast.begin(), q = loaded.begin(); p != ast.end(); ++p, ++q)
+    {
+        assert(p->is_abstract == q->is_abstract && p->line == q->line);
+        assert(p->git_repo_name == q->git_repo_name);
+        assert(p->bases == q->bases && p->submodule_info == q->submodule_info);
+        assert(p->minrev == q->minrev && p->maxrev == q->maxrev);
+        assert(p->content_rules.size() == q->content_rules.size());
+        for (std::size_t i = 0; i < p->content_rules.size(); ++i)
+        {
+            assert(p->content_rules[i].svn_path == q->content_rules[i].svn_path);
+            assert(p->content_rules[i].git_path == q->content_rules[i].git_path);
+            assert(p->content_rules[i].line == q->content_rules[i].line);
+        }
+        assert(same(p->branch_rules, q->branch_rules));
+        assert(same(p->tag_rules, q->tag_rules));
+        assert(p->exclusions.size() == q->exclusions.size());
+        for (std::size_t i = 0; i < p->exclusions.size(); ++i)
+        {
+            assert(p->exclusions[i].svn_path == q->exclusions[i].svn_path);
+            assert(p->exclusions[i].line == q->exclusions[i].line);
+        }
+    }
+
+    // A cache made from other rules, or no cache at all, isn't used
+    AST untouched;
+    assert(!rules_cache::load(filename, sha1().update("other rules").hex_digest(), untouched));
+    assert(untouched.empty());
+    boost::filesystem::remove(filename);
+    assert(!rules_cache::load(filename, key, untouched));
+}
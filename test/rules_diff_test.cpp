@@ -0,0 +1,79 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#undef NDEBUG
+#include "rules_diff.hpp"
+#include <cassert>
+#include <climits>
+#include <vector>
+
+using namespace boost2git;
+
+namespace
+{
+    RepoRule repo_rule(char const* name)
+    {
+        RepoRule r;
+        r.is_abstract = false;
+        r.line = 1;
+        r.git_repo_name = name;
+        r.minrev = 0;
+        r.maxrev = UINT_MAX;
+        return r;
+    }
+
+    Ruleset::Repository repository(char const* name, char const* super = "", char const* path = "")
+    {
+        Ruleset::Repository r;
+        r.name = name;
+        r.submodule_in_repo = super;
+        r.submodule_path = path;
+        return r;
+    }
+}
+
+int main()
+{
+    RepoRule boost = repo_rule("boost"), config = repo_rule("config"), regex = repo_rule("regex");
+    BranchRule trunk = { 0, UINT_MAX, "trunk", "master", 2, "refs/heads/" };
+    BranchRule early_trunk = { 0, 99, "trunk", "master", 2, "refs/heads/" };
+    BranchRule branch = { 50, UINT_MAX, "branches/b", "b", 3, "refs/heads/" };
+    ContentRule config_content = { "boost/config", "include/boost/config", 4 };
+    ContentRule regex_content = { "boost/regex", "include/boost/regex", 5 };
+
+    std::vector<Rule> const rules = {
+        Rule(&boost, &trunk, 0),
+        Rule(&config, &trunk, &config_content),
+        Rule(&regex, &trunk, &regex_content)
+    };
+    std::vector<Ruleset::Repository> const repos = {
+        repository("boost"), repository("config", "boost", "libs/config"), repository("regex")
+    };
+
+    // Nothing changed
+    assert(diff_rules(rules, repos, rules, repos).empty());
+
+    // A rule that stops applying affects its repository from then on,
+    // and the rule enclosing its SVN path, which matches it instead
+    std::vector<Rule> ended = rules;
+    ended[2] = Rule(&regex, &early_trunk, &regex_content);
+    auto changed = diff_rules(rules, repos, ended, repos);
+    assert(changed.size() == 2);
+    assert(changed.at("regex") == 100 && changed.at("boost") == 100);
+
+    // A new rule applies from its first revision; the super-module
+    // follows its submodule
+    std::vector<Rule> added = rules;
+    added.push_back(Rule(&config, &branch, &config_content));
+    changed = diff_rules(rules, repos, added, repos);
+    assert(changed.size() == 2);
+    assert(changed.at("config") == 50 && changed.at("boost") == 50);
+
+    // Becoming a submodule affects a repository throughout
+    std::vector<Ruleset::Repository> nested = repos;
+    nested[2] = repository("regex", "boost", "libs/regex");
+    changed = diff_rules(rules, repos, rules, nested);
+    assert(changed.size() == 2);
+    assert(changed.at("regex") == 1 && changed.at("boost") == 1);
+}
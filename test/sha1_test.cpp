@@ -0,0 +1,48 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#undef NDEBUG
+#include "sha1.hpp"
+#include <cassert>
+#include <string>
+
+int main()
+{
+    assert(sha1().update("abc").hex_digest()
+           == "a9993e364706816aba3e25717850c26c9cd0d89d");
+
+    // Results of `git hash-object --stdin`
+    assert(git_blob_hasher(0).hex_digest()
+           == "e69de29bb2d1d6434b8b29ae775ad8c2e48c5391");
+
+    assert(git_blob_hasher(6).update("hello\n").hex_digest()
+           == "ce013625030ba8dba906f756967f9e9ca394464a");
+
+    // Feed a large blob in irregular pieces to exercise block buffering
+    std::string const xs(100000, 'x');
+    git_blob_hasher h(xs.size());
+    for (std::size_t pos = 0, n = 1; pos < xs.size(); pos += n, n = n * 3 % 997 + 1)
+        h.update(xs.data() + pos, std::min(n, xs.size() - pos));
+    assert(h.hex_digest() == "56e0448612acbb706b96b7e8e46a210f15386a38");
+
+    // Results of `git mktree`, whose order puts the tree "a" after
+    // the blob "a.b"
+    git_tree_entry const f = {
+        0100644, "f", sha1::from_hex("c1b0730e0133447badcfd47fd144e254807b06e1") };
+    sha1::digest_type const sub = git_tree_sha({ f });
+    assert(sha1::to_hex(sub) == "2561a62d4223eb7660d3b6b02b707048382f4019");
+
+    std::vector<git_tree_entry> const entries = {
+        { 0100644, "b", sha1::from_hex("ce013625030ba8dba906f756967f9e9ca394464a") },
+        { 040000, "a", sub },
+        { 0100644, "a.b", sha1::from_hex("e25f1814e51579d5f55c0f1fe0135ddb28a47f4a") } };
+    std::string const tree = sha1::to_hex(git_tree_sha(entries));
+    assert(tree == "c2ae231f724b1a88563661b5dfeaece1e9a804ee");
+
+    // Result of `git hash-object -t commit`
+    assert(git_commit_sha(
+               tree, { "01c916db0e2d58facb99bce89735e7f612f91b7e" },
+               "U <u@e> 1380000000 +0000", "U <u@e> 1380000000 +0000", "m\n")
+           == "2da097c3406f3c4105037ce187c48739226d8d00");
+}
@@ -0,0 +1,25 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#undef NDEBUG
+#include "sha256.hpp"
+#include <cassert>
+#include <string>
+
+int main()
+{
+    // Results of `sha256sum`
+    assert(sha256().hex_digest()
+           == "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+
+    assert(sha256().update("abc").hex_digest()
+           == "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+
+    // Feed a large file in irregular pieces to exercise block buffering
+    std::string const xs(100000, 'x');
+    sha256 h;
+    for (std::size_t pos = 0, n = 1; pos < xs.size(); pos += n, n = n * 3 % 997 + 1)
+        h.update(xs.data() + pos, std::min(n, xs.size() - pos));
+    assert(h.hex_digest() == "d69e68988157833272305aaf21f453c800346e8a3640db6578e260215542e5d4");
+}
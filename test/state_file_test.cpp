@@ -0,0 +1,56 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#undef NDEBUG
+#include "state_file.hpp"
+#include <cassert>
+#include <stdexcept>
+#include <string>
+
+int main()
+{
+    std::string const filename = "state_file_test.state";
+
+    state_file::writer w;
+    w.word(42).str("refs/heads/master").str("").str(std::string("a\0b", 3));
+    std::size_t const seven = w.size();
+    w.word(0).word_at(seven, 7);
+    w.save(filename);
+
+    {
+        state_file::reader in(filename);
+        assert(in.word() == 42);
+        assert(in.str() == "refs/heads/master");
+        assert(in.str() == "");
+        assert(in.str() == std::string("a\0b", 3));
+        assert(in.tell() == seven);
+        assert(in.word() == 7);
+        in.seek(seven);
+        assert(in.word() == 7);
+
+        bool threw = false;
+        try { in.word(); } catch(std::runtime_error const&) { threw = true; }
+        assert(threw);
+    }
+
+    boost::filesystem::remove(filename);
+
+    // Images appended to one file are read with one reader
+    {
+        state_file::writer first, second;
+        first.str("first");
+        second.word(2);
+        first.append_to(filename);
+        second.append_to(filename);
+
+        state_file::reader in(filename);
+        assert(in.size() == first.size() + second.size());
+        assert(in.str() == "first");
+        assert(in.tell() == first.size());
+        assert(in.word() == state_file::magic);
+        assert(in.word() == 2);
+    }
+
+    boost::filesystem::remove(filename);
+}
@@ -0,0 +1,46 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#undef NDEBUG
+#include "svn_date.hpp"
+#include <cassert>
+#include <cstdio>
+#include <string>
+
+// What svn2git computed before svn_date_epoch read dates directly
+static unsigned int boost_epoch(std::string const& date)
+{
+    namespace pt = boost::posix_time;
+    pt::ptime ptime = boost::date_time::parse_delimited_time<pt::ptime>(date, 'T');
+    return (unsigned int)(ptime - pt::ptime(boost::gregorian::date(1970, 1, 1))).total_seconds();
+}
+
+int main()
+{
+    assert(svn_date_epoch("1970-01-01T00:00:00.000000Z") == 0);
+    assert(svn_date_epoch("2000-07-07T14:10:39.000000Z") == 962979039);
+    assert(svn_date_epoch("2013-06-20T23:59:59.999999Z") == 1371772799);
+
+    // Agrees with Boost.Date_Time on dates across the history of a
+    // repository, through leap days and the turn of centuries
+    for (int year = 1970; year <= 2104; year += 3)
+    {
+        for (int month = 1; month <= 12; ++month)
+        {
+            for (int day = 1; day <= 31; day += 9)
+            {
+                if (day > 28 && month == 2)
+                    continue;
+                char date[32];
+                std::sprintf(date, "%04d-%02d-%02dT%02d:%02d:%02d.123456Z",
+                             year, month, day, day % 24, month * 4, (year + day) % 60);
+                assert(svn_date_epoch(date) == boost_epoch(date));
+            }
+        }
+    }
+    assert(svn_date_epoch("2000-02-29T12:00:00.000000Z") == boost_epoch("2000-02-29T12:00:00.000000Z"));
+
+    // Other formats are still accepted
+    assert(svn_date_epoch("2001-02-03T04:05:06") == boost_epoch("2001-02-03T04:05:06"));
+}
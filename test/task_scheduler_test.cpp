@@ -0,0 +1,94 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#undef NDEBUG
+#include "task_scheduler.hpp"
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+int main()
+{
+    // Every task runs, including those submitted by tasks
+    {
+        task_scheduler s(4, 0);
+        std::atomic<int> sum(0);
+        for (int i = 0; i < 100; ++i)
+        {
+            s.submit("outer", [&s, &sum, i] {
+                sum += i;
+                s.submit("inner", [&sum] { sum += 1000; });
+            });
+        }
+        s.wait();
+        assert(sum == 4950 + 100000);
+    }
+
+    // Tasks of the same affinity run one at a time, in order
+    {
+        task_scheduler s(8, 0);
+        int const repos[2] = { 0, 1 };
+        std::vector<int> order[2];
+        std::atomic<int> running[2];
+        running[0] = running[1] = 0;
+        for (int i = 0; i < 200; ++i)
+        {
+            int const r = i % 2;
+            s.submit("write", [&, r, i] {
+                assert(++running[r] == 1);
+                order[r].push_back(i);
+                --running[r];
+            }, &repos[r]);
+        }
+        s.wait();
+        for (int r = 0; r < 2; ++r)
+        {
+            assert(order[r].size() == 100);
+            for (std::size_t n = 0; n < order[r].size(); ++n)
+                assert(order[r][n] == int(2 * n) + r);
+        }
+    }
+
+    // A task that blocks lets a spare thread run the task it waits for
+    {
+        task_scheduler s(1, 1);
+        std::promise<void> ran;
+        s.submit("waiting", [&ran] {
+            task_scheduler::blocking b;
+            ran.get_future().wait();
+        });
+        s.submit("awaited", [&ran] { ran.set_value(); });
+        s.wait();
+    }
+
+    // Errors come out of wait(), and each is timed
+    {
+        task_scheduler s(2, 0);
+        std::mutex m;
+        int timed = 0;
+        s.set_timer([&](char const*, unsigned, task_scheduler::clock::time_point start,
+                        task_scheduler::clock::time_point end, double) {
+            assert(end >= start);
+            std::lock_guard<std::mutex> lock(m);
+            ++timed;
+        });
+        s.submit("fails", [] { throw std::runtime_error("failed"); });
+        s.submit("succeeds", [] {});
+        bool thrown = false;
+        try
+        {
+            s.wait();
+        }
+        catch (std::runtime_error const&)
+        {
+            thrown = true;
+        }
+        assert(thrown && timed == 2);
+        s.wait();
+    }
+}
@@ -0,0 +1,63 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#undef NDEBUG
+#include "text_normalizer.hpp"
+#include <cassert>
+#include <string>
+
+std::string normalize(text_normalizer const& n, std::string contents)
+{
+    n.apply(contents);
+    return contents;
+}
+
+int main()
+{
+    text_normalizer const none("", "");
+    assert(!none.enabled());
+    assert(none.key_suffix().empty());
+    assert(normalize(none, "a\r\nb $Id: x $\r") == "a\r\nb $Id: x $\r");
+
+    // Line endings
+    text_normalizer const eols("native", "");
+    assert(eols.enabled());
+    assert(normalize(eols, "") == "");
+    assert(normalize(eols, "a\r\nb\rc\nd\r") == "a\nb\nc\nd\n");
+    assert(normalize(eols, "\r\r\n\n\r") == "\n\n\n\n");
+    assert(normalize(eols, "$Id: x $\r\n") == "$Id: x $\n");
+    assert(text_normalizer("CRLF", "").key_suffix() == eols.key_suffix());
+    assert(!text_normalizer("unknown", "").enabled());
+
+    // Long enough to take the vectorized paths, with CRs at every offset
+    std::string crlf, lf;
+    for (int i = 0; i < 100; ++i)
+    {
+        crlf += std::string(i % 37, 'x') + "\r\n";
+        lf += std::string(i % 37, 'x') + "\n";
+    }
+    assert(normalize(eols, crlf) == lf);
+
+    // Keywords, by any of their names
+    text_normalizer const keywords("", "Id Revision");
+    assert(keywords.enabled());
+    assert(normalize(keywords, "$Id: x.cpp 12 2013-01-01 dave $") == "$Id$");
+    assert(normalize(keywords, "a $Rev: 12 $ b $LastChangedRevision: 12 $") == "a $Rev$ b $LastChangedRevision$");
+    assert(normalize(keywords, "$Author: dave $") == "$Author: dave $");
+    assert(normalize(keywords, "$Id$ $Id:x $ $$Id: 1 $") == "$Id$ $Id:x $ $$Id$");
+    assert(normalize(keywords, "$Id: no end\n $") == "$Id: no end\n $");
+    assert(normalize(keywords, "$Id: 1 $\r\n") == "$Id$\r\n");
+    assert(normalize(keywords, "$Id: " + std::string(300, 'x') + " $")
+           == "$Id: " + std::string(300, 'x') + " $");
+
+    // Fixed width keywords keep their width
+    assert(normalize(keywords, "$Rev:: 12   $ x") == "$Rev::" + std::string(6, ' ') + "$ x");
+    assert(normalize(keywords, "$Rev:: 12345#$") == "$Rev::" + std::string(7, ' ') + "$");
+
+    // Custom keywords, and both kinds of normalization at once
+    text_normalizer const both("LF", "MyKw=%r Author");
+    assert(both.key_suffix() != keywords.key_suffix());
+    assert(normalize(both, "$MyKw: 3 $\r\n$LastChangedBy: dave $\r") == "$MyKw$\n$LastChangedBy$\n");
+    return 0;
+}
@@ -0,0 +1,62 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#undef NDEBUG
+#include "tree_model.hpp"
+#include <cassert>
+#include <string>
+
+int main()
+{
+    sha1::digest_type const hello = sha1::from_hex("ce013625030ba8dba906f756967f9e9ca394464a");
+    sha1::digest_type const x = sha1::from_hex("c1b0730e0133447badcfd47fd144e254807b06e1");
+    sha1::digest_type const y = sha1::from_hex("e25f1814e51579d5f55c0f1fe0135ddb28a47f4a");
+
+    tree_model empty;
+    assert(empty.empty());
+    assert(sha1::to_hex(empty.sha()) == "4b825dc642cb6eb9a060e54bf8d69288fbee4904");
+
+    // The tree of sha1_test, whose SHA-1 is that given by git mktree
+    tree_model t;
+    t.set("b", 0100644, hello);
+    t.set("a/f", 0100644, x);
+    t.set("a.b", 0100644, y);
+    assert(sha1::to_hex(t.sha()) == "c2ae231f724b1a88563661b5dfeaece1e9a804ee");
+    assert(t.find("a")->str() == "040000 2561a62d4223eb7660d3b6b02b707048382f4019");
+    assert(t.find("a/f")->str() == "100644 c1b0730e0133447badcfd47fd144e254807b06e1");
+    assert(!t.find("a/g") && !t.find("b/f") && !t.find("c"));
+
+    // A copy shares everything until changed, and changing it leaves
+    // the original alone
+    tree_model u = t;
+    assert(u.shares_root(t));
+    u.set("a/g", 0100644, x);
+    assert(!u.shares_root(t));
+    assert(sha1::to_hex(t.sha()) == "c2ae231f724b1a88563661b5dfeaece1e9a804ee");
+    assert(!t.find("a/g") && u.find("a/g"));
+    u.remove("a/g");
+    assert(u.sha() == t.sha());
+
+    // Removing the last entry of a directory removes the directory
+    u.remove("a/f");
+    assert(!u.find("a"));
+    assert(t.find("a/f"));
+
+    // A subtree of one tree can become part of another
+    tree_model v;
+    v.set("lib/a", *t.find("a"));
+    assert(v.find("lib/a/f")->sha == x);
+    v.set("lib/a/f", 0100644, hello);
+    assert(t.find("a/f")->sha == x);
+    v.set("", *t.find(""));
+    assert(v.sha() == t.sha());
+
+    // A file can replace a directory, and a directory a file
+    v.set("a", 0100644, x);
+    assert(!v.find("a/f"));
+    v.set("b/c", 0100644, x);
+    assert(v.find("b")->subtree);
+    v.remove("");
+    assert(v.empty());
+}